@@ -0,0 +1,254 @@
+#!/usr/bin/env python3
+"""
+Generate and evaluate the components of the YakirOS load harness
+
+tests/vm/load-harness.sh drives this script:
+
+  generate   write N component files running tests/load-worker, wired into
+             a random dependency DAG, with a mix of readiness methods, slow
+             starters and crash-injected components. The same seed gives
+             the same components.
+  caps-up    from `graphctl analyze-boot --chrome`, when every generated
+             capability first came up
+  restarts   percentiles of the restart latencies the workers logged
+  compare    two results files side by side, with the change in percent
+"""
+
+import argparse
+import json
+import os
+import random
+import sys
+
+NAME_PREFIX = "load-"
+CAP_PREFIX = "load."
+LOAD_DIR = "/run/yakiros-load"
+
+# graph-resolver has room for 512 capabilities; leave some for the rest
+# of the system
+MAX_COUNT = 480
+
+READINESS_METHODS = ("none", "notify", "file")
+
+
+def parse_mix(text):
+    """'none=40,notify=30,file=30' -> [('none', 40), ...]"""
+    mix = []
+    for part in text.split(","):
+        method, _, weight = part.partition("=")
+        method = method.strip()
+        if method not in READINESS_METHODS:
+            raise argparse.ArgumentTypeError(
+                f"unknown readiness method '{method}' (one of {', '.join(READINESS_METHODS)})")
+        try:
+            mix.append((method, int(weight)))
+        except ValueError:
+            raise argparse.ArgumentTypeError(f"bad weight in '{part}'")
+    if sum(w for _, w in mix) <= 0:
+        raise argparse.ArgumentTypeError("readiness weights must add up to more than 0")
+    return mix
+
+
+def component_name(i):
+    return f"{NAME_PREFIX}{i:04d}"
+
+
+def generate(args):
+    if not 1 <= args.count <= MAX_COUNT:
+        print(f"Error: --count must be between 1 and {MAX_COUNT}")
+        return 1
+
+    rng = random.Random(args.seed)
+    methods = [m for m, _ in args.readiness]
+    weights = [w for _, w in args.readiness]
+
+    os.makedirs(args.out, exist_ok=True)
+    for old in os.listdir(args.out):
+        if old.startswith(NAME_PREFIX) and old.endswith(".toml"):
+            os.unlink(os.path.join(args.out, old))
+
+    counts = {m: 0 for m in methods}
+    crashers = 0
+    edges = 0
+
+    for i in range(args.count):
+        name = component_name(i)
+        method = rng.choices(methods, weights)[0]
+        counts[method] += 1
+
+        ready_ms = 0
+        if rng.random() * 100 < args.slow:
+            ready_ms = rng.randint(args.slow_ms // 2, args.slow_ms)
+
+        crash_rate = 0.0
+        if rng.random() * 100 < args.crashers:
+            crash_rate = args.crash_rate
+            crashers += 1
+
+        # Depend on earlier components only, so the graph stays acyclic
+        fanin = rng.randint(0, min(args.max_requires, i))
+        requires = sorted(rng.sample(range(i), fanin)) if fanin else []
+        edges += len(requires)
+
+        lines = [
+            f"# Generated by scripts/load-components.py (seed {args.seed})",
+            "[component]",
+            f'name = "{name}"',
+            f'binary = "{args.binary}"',
+            f'args = ["{name}", "{method}", "{ready_ms}", "{crash_rate:g}"]',
+            'type = "service"',
+            "",
+            "[provides]",
+            f'capabilities = ["{CAP_PREFIX}{i:04d}"]',
+            "",
+            "[requires]",
+            "capabilities = [" + ", ".join(f'"{CAP_PREFIX}{r:04d}"' for r in requires) + "]",
+            "",
+            "[lifecycle]",
+            f'readiness_method = "{method}"',
+        ]
+        if method == "file":
+            lines.append(f'readiness_file = "{LOAD_DIR}/{name}.ready"')
+        lines += [
+            "readiness_timeout = 30",
+            # Restart at once and never give up, so what is measured is
+            # the resolver and not the backoff policy
+            "restart_delay_ms = 1",
+            "restart_delay_max_ms = 1",
+            "restart_jitter = 0",
+            "restart_quarantine = 0",
+        ]
+
+        with open(os.path.join(args.out, f"{name}.toml"), "w") as f:
+            f.write("\n".join(lines) + "\n")
+
+    mix = ", ".join(f"{m} {counts[m]}" for m in methods)
+    print(f"Generated {args.count} components in {args.out}: {mix}; "
+          f"{crashers} crash-injected; {edges} dependencies")
+    return 0
+
+
+def caps_up(args):
+    with open(args.trace) as f:
+        trace = json.load(f)
+
+    first_up = {}
+    boot_begin = None
+    for ev in trace.get("traceEvents", []):
+        if ev.get("cat") == "boot" and boot_begin is None:
+            boot_begin = ev["ts"]
+        if ev.get("cat") != "capability":
+            continue
+        kind, _, cap = ev.get("name", "").partition(" ")
+        if kind == "up" and cap.startswith(CAP_PREFIX) and cap not in first_up:
+            first_up[cap] = ev["ts"]
+
+    dropped = trace.get("otherData", {}).get("dropped", 0)
+    if len(first_up) < args.count:
+        print(f"caps {len(first_up)}/{args.count} all_up_ms - since_boot_ms - dropped {dropped}")
+        return 1
+
+    last = max(first_up.values())
+    since = (last - boot_begin) / 1000 if boot_begin is not None else last / 1000
+    # Trace timestamps are CLOCK_MONOTONIC: from the kernel starting
+    print(f"caps {len(first_up)}/{args.count} all_up_ms {last / 1000:.1f} "
+          f"since_boot_ms {since:.1f} dropped {dropped}")
+    return 0
+
+
+def percentile(values, pct):
+    """Nearest rank, as tests/control-probe.c does"""
+    rank = max(1, (pct * len(values) + 99) // 100)
+    return values[rank - 1]
+
+
+def restarts(args):
+    latencies = []
+    with open(args.file) as f:
+        for line in f:
+            parts = line.split()
+            if len(parts) == 2 and parts[1].isdigit():
+                latencies.append(int(parts[1]))
+
+    if not latencies:
+        print("samples 0 p50 0 p90 0 p99 0 max 0")
+        return 1
+
+    latencies.sort()
+    print(f"samples {len(latencies)} p50 {percentile(latencies, 50)} "
+          f"p90 {percentile(latencies, 90)} p99 {percentile(latencies, 99)} "
+          f"max {latencies[-1]}")
+    return 0
+
+
+def read_results(path):
+    results = {}
+    with open(path) as f:
+        for line in f:
+            key, sep, value = line.strip().partition("=")
+            if sep:
+                results[key] = value
+    return results
+
+
+def compare(args):
+    old = read_results(args.old)
+    new = read_results(args.new)
+
+    print(f"{'METRIC':<32} {'BEFORE':>12} {'AFTER':>12} {'CHANGE':>8}")
+    for key in new:
+        if key not in old:
+            continue
+        try:
+            before, after = float(old[key]), float(new[key])
+        except ValueError:
+            if old[key] != new[key]:
+                print(f"{key:<32} {old[key]:>12} {new[key]:>12}")
+            continue
+        change = f"{(after - before) * 100 / before:+.1f}%" if before else "-"
+        print(f"{key:<32} {old[key]:>12} {new[key]:>12} {change:>8}")
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    gen = sub.add_parser("generate", help="write the component files")
+    gen.add_argument("--count", type=int, default=100)
+    gen.add_argument("--out", default="load-components")
+    gen.add_argument("--seed", type=int, default=1)
+    gen.add_argument("--binary", default="/usr/local/bin/load-worker")
+    gen.add_argument("--readiness", type=parse_mix, default=parse_mix("none=40,notify=30,file=30"),
+                     help="weighted readiness methods, e.g. none=40,notify=30,file=30")
+    gen.add_argument("--slow", type=float, default=10,
+                     help="percent of components slow to become ready")
+    gen.add_argument("--slow-ms", type=int, default=500,
+                     help="longest delay before a slow component is ready")
+    gen.add_argument("--crashers", type=float, default=20,
+                     help="percent of components that crash once churn begins")
+    gen.add_argument("--crash-rate", type=float, default=6,
+                     help="crashes per minute of each crash-injected component")
+    gen.add_argument("--max-requires", type=int, default=3)
+    gen.set_defaults(func=generate)
+
+    up = sub.add_parser("caps-up", help="time until every generated capability was up")
+    up.add_argument("trace")
+    up.add_argument("--count", type=int, required=True)
+    up.set_defaults(func=caps_up)
+
+    rs = sub.add_parser("restarts", help="restart latency percentiles in microseconds")
+    rs.add_argument("file")
+    rs.set_defaults(func=restarts)
+
+    cmp = sub.add_parser("compare", help="compare two results files")
+    cmp.add_argument("old")
+    cmp.add_argument("new")
+    cmp.set_defaults(func=compare)
+
+    args = parser.parse_args()
+    return args.func(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
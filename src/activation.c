@@ -0,0 +1,277 @@
+/*
+ * activation.c - YakirOS socket activation implementation
+ */
+
+#define _GNU_SOURCE
+#include "activation.h"
+#include "event.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+static event_source_t **watches = NULL;
+static int n_watches = 0;
+static int max_watches = 0;
+static int activation_epoll_fd = -1;
+
+/* Parse "[host:]port" (host in brackets for IPv6) into addr */
+static int parse_inet(const char *where, struct sockaddr_storage *addr, socklen_t *len) {
+    char host[INET6_ADDRSTRLEN];
+    const char *port;
+
+    if (*where == '[') {
+        const char *end = strchr(where, ']');
+        if (!end || end[1] != ':' || (size_t)(end - where - 1) >= sizeof(host)) return -1;
+        memcpy(host, where + 1, (size_t)(end - where - 1));
+        host[end - where - 1] = '\0';
+        port = end + 2;
+    } else {
+        const char *colon = strrchr(where, ':');
+        if (colon) {
+            if ((size_t)(colon - where) >= sizeof(host)) return -1;
+            memcpy(host, where, (size_t)(colon - where));
+            host[colon - where] = '\0';
+            port = colon + 1;
+        } else {
+            strcpy(host, "0.0.0.0");
+            port = where;
+        }
+    }
+
+    char *end;
+    long p = strtol(port, &end, 10);
+    if (!*port || *end || p < 0 || p > 65535) return -1;
+
+    memset(addr, 0, sizeof(*addr));
+    struct sockaddr_in *in = (struct sockaddr_in *)addr;
+    struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)addr;
+    if (inet_pton(AF_INET, host, &in->sin_addr) == 1) {
+        in->sin_family = AF_INET;
+        in->sin_port = htons((unsigned short)p);
+        *len = sizeof(*in);
+    } else if (inet_pton(AF_INET6, host, &in6->sin6_addr) == 1) {
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons((unsigned short)p);
+        *len = sizeof(*in6);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* Parse a socket spec into its type and address */
+static int parse_spec(const char *spec, int *type, struct sockaddr_storage *addr,
+                      socklen_t *len) {
+    if (strncmp(spec, "tcp:", 4) == 0) {
+        *type = SOCK_STREAM;
+        return parse_inet(spec + 4, addr, len);
+    }
+    if (strncmp(spec, "udp:", 4) == 0) {
+        *type = SOCK_DGRAM;
+        return parse_inet(spec + 4, addr, len);
+    }
+    if (strncmp(spec, "unix:", 5) == 0) {
+        struct sockaddr_un *un = (struct sockaddr_un *)addr;
+        const char *path = spec + 5;
+        if (*path != '/' || strlen(path) >= sizeof(un->sun_path)) return -1;
+        memset(addr, 0, sizeof(*addr));
+        un->sun_family = AF_UNIX;
+        strcpy(un->sun_path, path);
+        *type = SOCK_STREAM;
+        *len = sizeof(*un);
+        return 0;
+    }
+    return -1;
+}
+
+int activation_listen(const char *spec, int backlog) {
+    int type;
+    struct sockaddr_storage addr;
+    socklen_t len;
+
+    if (parse_spec(spec, &type, &addr, &len) < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int fd = socket(addr.ss_family, type | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    if (addr.ss_family == AF_UNIX) {
+        /* Left behind by an earlier graph-resolver, not some other file */
+        struct stat st;
+        const char *path = ((struct sockaddr_un *)&addr)->sun_path;
+        if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+    } else {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (addr.ss_family == AF_INET6) {
+            setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on));
+        }
+    }
+
+    if (bind(fd, (struct sockaddr *)&addr, len) < 0 ||
+        (type == SOCK_STREAM && listen(fd, backlog > 0 ? backlog : SOMAXCONN) < 0)) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    if (addr.ss_family == AF_UNIX) {
+        chmod(((struct sockaddr_un *)&addr)->sun_path, 0666);
+    }
+    return fd;
+}
+
+void activation_close(const char *spec, int fd) {
+    if (fd < 0) return;
+    activation_unwatch(fd);
+    close(fd);
+    if (spec && strncmp(spec, "unix:", 5) == 0) {
+        unlink(spec + 5);
+    }
+}
+
+/* Connections in a /proc/net/tcp{,6} table with their local port at port:
+ * every state but LISTEN (0A), TIME_WAIT (06) and CLOSE (07) */
+static int count_inet(const char *table, unsigned port) {
+    FILE *f = fopen(table, "re");
+    if (!f) return -1;
+
+    char line[256];
+    int n = 0;
+    if (!fgets(line, sizeof(line), f)) {
+        fclose(f);
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        unsigned local_port, state;
+        if (sscanf(line, " %*d: %*[0-9A-Fa-f]:%X %*[0-9A-Fa-f]:%*X %X",
+                   &local_port, &state) != 2) {
+            continue;
+        }
+        if (local_port == port && state != 0x0A && state != 0x06 && state != 0x07) n++;
+    }
+    fclose(f);
+    return n;
+}
+
+/* Connected (SS_CONNECTED) sockets in /proc/net/unix bound to path */
+static int count_unix(const char *path) {
+    FILE *f = fopen("/proc/net/unix", "re");
+    if (!f) return -1;
+
+    char line[512];
+    int n = 0;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned state;
+        char bound[sizeof(((struct sockaddr_un *)0)->sun_path)];
+        if (sscanf(line, "%*s %*s %*s %*s %*s %X %*s %107s", &state, bound) == 2 &&
+            state == 3 && strcmp(bound, path) == 0) {
+            n++;
+        }
+    }
+    fclose(f);
+    return n;
+}
+
+int activation_connections(const char *spec) {
+    int type;
+    struct sockaddr_storage addr;
+    socklen_t len;
+
+    if (parse_spec(spec, &type, &addr, &len) < 0 || type != SOCK_STREAM) return -1;
+    if (addr.ss_family == AF_UNIX) {
+        return count_unix(((struct sockaddr_un *)&addr)->sun_path);
+    }
+
+    unsigned port = addr.ss_family == AF_INET
+        ? ntohs(((struct sockaddr_in *)&addr)->sin_port)
+        : ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+    int n4 = count_inet("/proc/net/tcp", port);
+    int n6 = count_inet("/proc/net/tcp6", port);
+    if (n4 < 0 && n6 < 0) return -1;
+    return (n4 > 0 ? n4 : 0) + (n6 > 0 ? n6 : 0);
+}
+
+void activation_init(int epoll_fd) {
+    activation_epoll_fd = epoll_fd;
+}
+
+int activation_watch(int fd) {
+    if (activation_epoll_fd < 0) return 0;
+
+    /* Sources stay allocated once unwatched (fd -1): an event for one may
+     * still be in the batch the main loop is working through */
+    event_source_t *src = NULL;
+    for (int i = 0; i < n_watches; i++) {
+        if (watches[i]->fd == fd) return 0;
+        if (watches[i]->fd < 0 && !src) src = watches[i];
+    }
+    if (!src) {
+        if (n_watches == max_watches) {
+            int new_max = max_watches ? max_watches * 2 : 16;
+            event_source_t **grown = realloc(watches, (size_t)new_max * sizeof(*grown));
+            if (!grown) return -1;
+            watches = grown;
+            max_watches = new_max;
+        }
+        src = malloc(sizeof(*src));
+        if (!src) return -1;
+        src->type = EVENT_ACTIVATION;
+        src->fd = -1;
+        watches[n_watches++] = src;
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = src;
+    if (epoll_ctl(activation_epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) return -1;
+    src->fd = fd;
+    return 0;
+}
+
+void activation_unwatch(int fd) {
+    for (int i = 0; i < n_watches; i++) {
+        if (watches[i]->fd != fd) continue;
+        epoll_ctl(activation_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+        watches[i]->fd = -1;
+        return;
+    }
+}
+
+int activation_install(spawn_t *sp, const int *fds, int n, const char *name) {
+    if (n < 0 || n > MAX_SOCKETS) return -1;
+
+    for (int i = 0; i < n; i++) {
+        if (spawn_fd(sp, fds[i], LISTEN_FDS_START + i) < 0) return -1;
+    }
+
+    char names[MAX_SOCKETS * 256];
+    size_t used = 0;
+    names[0] = '\0';
+    for (int i = 0; i < n; i++) {
+        int w = snprintf(names + used, sizeof(names) - used, "%s%s", i ? ":" : "", name);
+        if (w < 0 || (size_t)w >= sizeof(names) - used) return -1;
+        used += (size_t)w;
+    }
+
+    char value[32];
+    snprintf(value, sizeof(value), "%d", n);
+    if (spawn_setenv(sp, LISTEN_FDS_ENV, value) < 0 ||
+        spawn_setenv_pid(sp, LISTEN_PID_ENV) < 0 ||
+        spawn_setenv(sp, LISTEN_FDNAMES_ENV, names) < 0) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,60 @@
+/*
+ * activation.h - YakirOS socket activation
+ *
+ * A component's [sockets] are created, bound and listening in
+ * graph-resolver before its process exists, and are passed to it at
+ * start as with systemd's sd_listen_fds(3): descriptors from
+ * LISTEN_FDS_START on, LISTEN_FDS saying how many, LISTEN_PID naming the
+ * process they are meant for and LISTEN_FDNAMES giving a colon-separated
+ * name for each. graph-resolver keeps its copies, so connections arriving
+ * while the service restarts or is swapped wait in the listen backlog
+ * rather than being refused.
+ *
+ * A socket is declared as "<kind>:<address>":
+ *   tcp:8080, tcp:127.0.0.1:8080, tcp:[::1]:8080   stream, IPv4 or IPv6
+ *   udp:...                                         datagram, same forms
+ *   unix:/run/foo.sock                              stream, filesystem path
+ * A bare port listens on every IPv4 address.
+ */
+
+#ifndef ACTIVATION_H
+#define ACTIVATION_H
+
+#include "spawn.h"
+
+#define LISTEN_FDS_START 3
+
+#define LISTEN_FDS_ENV     "LISTEN_FDS"
+#define LISTEN_PID_ENV     "LISTEN_PID"
+#define LISTEN_FDNAMES_ENV "LISTEN_FDNAMES"
+
+/* Sockets one component may declare */
+#define MAX_SOCKETS 16
+
+/* Create the socket spec declares, bound and (for stream sockets)
+ * listening with the given backlog. A stale unix socket at the path is
+ * replaced. The descriptor is close-on-exec (and blocking: the service
+ * shares its file description). Returns it, or -1 with errno set
+ * (EINVAL for a spec that does not parse). */
+int activation_listen(const char *spec, int backlog);
+
+/* Close a socket from activation_listen(), removing a unix socket's path */
+void activation_close(const char *spec, int fd);
+
+/* Connections open on the socket spec declares, counted from
+ * /proc/net: for tcp those whose local port is its port, for unix those
+ * accepted on its path. -1 when that cannot be told, as for udp. */
+int activation_connections(const char *spec);
+
+/* Report readability of watched sockets through epoll_fd (EVENT_ACTIVATION,
+ * the source's fd the socket). Without it, watching does nothing. */
+void activation_init(int epoll_fd);
+int activation_watch(int fd);
+void activation_unwatch(int fd);
+
+/* Have the child sp will start get the n descriptors in fds from
+ * LISTEN_FDS_START onwards, with LISTEN_FDS, LISTEN_PID and
+ * LISTEN_FDNAMES (each named name) in its environment. Returns 0 or -1. */
+int activation_install(spawn_t *sp, const int *fds, int n, const char *name);
+
+#endif /* ACTIVATION_H */
@@ -2,27 +2,123 @@
  * capability.c - YakirOS capability registry implementation
  *
  * Manages the registry of system capabilities and their providers.
+ *
+ * Capability names are interned into dense integer IDs (indices into the
+ * capabilities array) through an open-addressed hash table, so lookups by
+ * name are O(1) and components can keep ID arrays instead of comparing
+ * 128-byte strings. Each capability also carries the list of components
+ * that require it, and of the on-demand components that provide it.
  */
 
 #include "capability.h"
 #include "log.h"
+#include "trace.h"
+#include <stdlib.h>
 #include <string.h>
 
 /* Global capability registry */
 static capability_t capabilities[MAX_CAPABILITIES];
 static int n_capabilities = 0;
 
+/* Name -> ID hash table, linear probing. Entries hold ID + 1 so that a
+ * zeroed slot means empty. Capabilities are never removed individually,
+ * only by capability_init(), so no tombstones are needed. */
+#define CAP_HASH_SIZE (MAX_CAPABILITIES * 2)
+static int cap_hash[CAP_HASH_SIZE];
+
+/* Bumped on every reset so holders of interned IDs can detect staleness */
+static unsigned int cap_generation = 1;
+
+/* Capabilities whose active flag flipped since the resolver last looked.
+ * Each index is queued at most once; the resolver drains the queue to find
+ * which components need re-evaluation. */
+static int changed_queue[MAX_CAPABILITIES];
+static unsigned char changed_flag[MAX_CAPABILITIES];
+static int n_changed = 0;
+
+/* Counts every state change, degraded marks included */
+static unsigned int cap_epoch = 0;
+
+static void capability_queue_change(int idx) {
+    if (!changed_flag[idx]) {
+        changed_flag[idx] = 1;
+        changed_queue[n_changed++] = idx;
+    }
+}
+
+/* FNV-1a over at most MAX_NAME - 1 bytes, matching the stored truncation */
+static unsigned int cap_hash_name(const char *name) {
+    unsigned int h = 2166136261u;
+    for (int i = 0; i < MAX_NAME - 1 && name[i]; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Return the hash slot holding name, or the empty slot where it belongs */
+static int cap_hash_slot(const char *name) {
+    unsigned int slot = cap_hash_name(name) % CAP_HASH_SIZE;
+    while (cap_hash[slot] != 0) {
+        int idx = cap_hash[slot] - 1;
+        if (strncmp(capabilities[idx].name, name, MAX_NAME - 1) == 0)
+            break;
+        slot = (slot + 1) % CAP_HASH_SIZE;
+    }
+    return (int)slot;
+}
+
 void capability_init(void) {
+    for (int i = 0; i < n_capabilities; i++) {
+        free(capabilities[i].consumers);
+        free(capabilities[i].on_demand);
+    }
     memset(capabilities, 0, sizeof(capabilities));
     n_capabilities = 0;
+    memset(cap_hash, 0, sizeof(cap_hash));
+    cap_generation++;
+    cap_epoch++;
+    memset(changed_flag, 0, sizeof(changed_flag));
+    n_changed = 0;
+}
+
+unsigned int capability_generation(void) {
+    return cap_generation;
+}
+
+unsigned int capability_epoch(void) {
+    return cap_epoch;
 }
 
 int capability_index(const char *name) {
-    for (int i = 0; i < n_capabilities; i++) {
-        if (strcmp(capabilities[i].name, name) == 0)
-            return i;
+    int slot = cap_hash_slot(name);
+    return cap_hash[slot] - 1; /* -1 if not found */
+}
+
+int capability_intern(const char *name) {
+    int slot = cap_hash_slot(name);
+    if (cap_hash[slot] != 0)
+        return cap_hash[slot] - 1;
+
+    if (n_capabilities >= MAX_CAPABILITIES) {
+        LOG_ERR("capability limit reached");
+        return -1;
+    }
+
+    int idx = n_capabilities++;
+    strncpy(capabilities[idx].name, name, MAX_NAME - 1);
+    capabilities[idx].provider_idx = -1;
+    cap_hash[slot] = idx + 1;
+    return idx;
+}
+
+int capability_intern_list(char *const *names, int n, int *ids) {
+    int ok = 0;
+    for (int i = 0; i < n; i++) {
+        ids[i] = capability_intern(names[i]);
+        if (ids[i] < 0) ok = -1;
     }
-    return -1; /* not found */
+    return ok;
 }
 
 int capability_active(const char *name) {
@@ -30,16 +126,15 @@ int capability_active(const char *name) {
     return (idx >= 0 && capabilities[idx].active);
 }
 
-void capability_register(const char *name, int provider_idx) {
-    int idx = capability_index(name);
-    if (idx < 0) {
-        /* Create new capability */
-        if (n_capabilities >= MAX_CAPABILITIES) {
-            LOG_ERR("capability limit reached");
-            return;
-        }
-        idx = n_capabilities++;
-        strncpy(capabilities[idx].name, name, MAX_NAME - 1);
+void capability_register_id(int idx, int provider_idx) {
+    if (idx < 0 || idx >= n_capabilities) return;
+
+    if (!capabilities[idx].active || capabilities[idx].degraded) {
+        cap_epoch++;
+    }
+    if (!capabilities[idx].active) {
+        capability_queue_change(idx);
+        trace_capability(idx, 1, provider_idx);
     }
     capabilities[idx].active = 1;
     capabilities[idx].degraded = 0;  /* not degraded by default */
@@ -49,12 +144,29 @@ void capability_register(const char *name, int provider_idx) {
      * to the components array. The caller should handle logging. */
 }
 
-void capability_withdraw(const char *name) {
-    int idx = capability_index(name);
-    if (idx >= 0) {
-        capabilities[idx].active = 0;
-        LOG_INFO("capability DOWN: %s", name);
+void capability_set_provider(int idx, int provider_idx) {
+    if (idx < 0 || idx >= n_capabilities) return;
+    capabilities[idx].provider_idx = provider_idx;
+}
+
+void capability_register(const char *name, int provider_idx) {
+    capability_register_id(capability_intern(name), provider_idx);
+}
+
+void capability_withdraw_id(int idx) {
+    if (idx < 0 || idx >= n_capabilities) return;
+
+    if (capabilities[idx].active) {
+        cap_epoch++;
+        capability_queue_change(idx);
+        trace_capability(idx, 0, capabilities[idx].provider_idx);
     }
+    capabilities[idx].active = 0;
+    LOG_INFO("capability DOWN: %s", capabilities[idx].name);
+}
+
+void capability_withdraw(const char *name) {
+    capability_withdraw_id(capability_index(name));
 }
 
 int capability_count(void) {
@@ -92,7 +204,92 @@ int capability_degraded_by_idx(int idx) {
 void capability_mark_degraded(const char *name, int degraded) {
     int idx = capability_index(name);
     if (idx >= 0) {
+        if (capabilities[idx].degraded != (degraded ? 1 : 0)) cap_epoch++;
         capabilities[idx].degraded = degraded ? 1 : 0;
         LOG_INFO("capability %s marked as %s", name, degraded ? "DEGRADED" : "HEALTHY");
     }
-}
\ No newline at end of file
+}
+
+/* Add comp_idx to a capability's list of components, once */
+static int comp_list_add(const capability_t *cap, const char *what,
+                         int **list, int *n, int *max, int comp_idx) {
+    for (int i = 0; i < *n; i++) {
+        if ((*list)[i] == comp_idx) return 0;
+    }
+
+    if (*n == *max) {
+        int new_max = *max ? *max * 2 : 4;
+        int *grown = realloc(*list, new_max * sizeof(int));
+        if (!grown) {
+            LOG_ERR("out of memory growing %s of %s", what, cap->name);
+            return -1;
+        }
+        *list = grown;
+        *max = new_max;
+    }
+    (*list)[(*n)++] = comp_idx;
+    return 0;
+}
+
+static void comp_list_remove(int *list, int *n, int comp_idx) {
+    for (int i = 0; i < *n; i++) {
+        if (list[i] == comp_idx) {
+            list[i] = list[--*n];
+            return;
+        }
+    }
+}
+
+int capability_add_consumer(int idx, int comp_idx) {
+    if (idx < 0 || idx >= n_capabilities) return -1;
+    capability_t *cap = &capabilities[idx];
+    return comp_list_add(cap, "consumers", &cap->consumers, &cap->n_consumers,
+                         &cap->max_consumers, comp_idx);
+}
+
+void capability_remove_consumer(int idx, int comp_idx) {
+    if (idx < 0 || idx >= n_capabilities) return;
+    capability_t *cap = &capabilities[idx];
+    comp_list_remove(cap->consumers, &cap->n_consumers, comp_idx);
+}
+
+const int *capability_consumers(int idx, int *count) {
+    if (idx < 0 || idx >= n_capabilities) {
+        *count = 0;
+        return NULL;
+    }
+    *count = capabilities[idx].n_consumers;
+    return capabilities[idx].consumers;
+}
+
+int capability_add_on_demand(int idx, int comp_idx) {
+    if (idx < 0 || idx >= n_capabilities) return -1;
+    capability_t *cap = &capabilities[idx];
+    return comp_list_add(cap, "on-demand providers", &cap->on_demand, &cap->n_on_demand,
+                         &cap->max_on_demand, comp_idx);
+}
+
+void capability_remove_on_demand(int idx, int comp_idx) {
+    if (idx < 0 || idx >= n_capabilities) return;
+    capability_t *cap = &capabilities[idx];
+    comp_list_remove(cap->on_demand, &cap->n_on_demand, comp_idx);
+}
+
+const int *capability_on_demand(int idx, int *count) {
+    if (idx < 0 || idx >= n_capabilities) {
+        *count = 0;
+        return NULL;
+    }
+    *count = capabilities[idx].n_on_demand;
+    return capabilities[idx].on_demand;
+}
+
+int capability_take_changes(int *out, int max) {
+    int n = 0;
+    while (n < max && n_changed > 0) {
+        int idx = changed_queue[--n_changed];
+        changed_flag[idx] = 0;
+        out[n++] = idx;
+    }
+    return n;
+}
@@ -17,11 +17,32 @@ typedef struct {
     int  active;         /* 1 if this capability is currently provided */
     int  degraded;       /* 1 if provider is in DEGRADED state */
     int  provider_idx;   /* index into components array */
+    int *consumers;      /* indices of components that require this capability */
+    int  n_consumers;
+    int  max_consumers;
+    int *on_demand;      /* indices of on-demand components that provide it */
+    int  n_on_demand;
+    int  max_on_demand;
 } capability_t;
 
 /* Find a capability by name, return index (-1 if not found) */
 int capability_index(const char *name);
 
+/* Find or create a capability, return its ID (index), -1 if registry full.
+ * New capabilities start inactive. */
+int capability_intern(const char *name);
+
+/* Intern n names into ids, returns 0 or -1 if any could not be interned */
+int capability_intern_list(char *const *names, int n, int *ids);
+
+/* Registry generation; changes on every capability_init(), which
+ * invalidates all previously interned IDs */
+unsigned int capability_generation(void);
+
+/* Bumped whenever a capability comes up, goes down or changes its
+ * degraded mark, so watchers can tell cheaply that nothing changed */
+unsigned int capability_epoch(void);
+
 /* Check if a capability is currently active */
 int capability_active(const char *name);
 
@@ -31,6 +52,15 @@ void capability_register(const char *name, int provider_idx);
 /* Withdraw a capability (component stopped providing it) */
 void capability_withdraw(const char *name);
 
+/* ID-based variants of register/withdraw */
+void capability_register_id(int idx, int provider_idx);
+void capability_withdraw_id(int idx);
+
+/* Record that the provider of a capability moved to another component
+ * index; its active and degraded state are untouched and no change is
+ * queued */
+void capability_set_provider(int idx, int provider_idx);
+
 /* Get total number of registered capabilities */
 int capability_count(void);
 
@@ -49,6 +79,27 @@ int capability_degraded_by_idx(int idx);
 /* Mark a capability as degraded */
 void capability_mark_degraded(const char *name, int degraded);
 
+/* Record that component comp_idx requires capability idx */
+int capability_add_consumer(int idx, int comp_idx);
+
+/* Forget that component comp_idx requires capability idx */
+void capability_remove_consumer(int idx, int comp_idx);
+
+/* Components requiring capability idx; count receives the list length */
+const int *capability_consumers(int idx, int *count);
+
+/* Record, or forget, that on-demand component comp_idx provides
+ * capability idx, so the resolver finds what to wake without a scan */
+int capability_add_on_demand(int idx, int comp_idx);
+void capability_remove_on_demand(int idx, int comp_idx);
+
+/* On-demand components providing capability idx, like capability_consumers() */
+const int *capability_on_demand(int idx, int *count);
+
+/* Pop up to max capability indices whose active state changed since the
+ * last call. Returns the number written to out. */
+int capability_take_changes(int *out, int max);
+
 /* Initialize/reset the capability registry */
 void capability_init(void);
 
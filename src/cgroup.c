@@ -16,11 +16,18 @@
 #include <sys/types.h>
 #include <sched.h>
 #include <signal.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
 
 #include "cgroup.h"
+#include "event.h"
 #include "toml.h"
 #include "log.h"
 
+#define CGROUP_CONTROLLERS "+memory +cpu +io +pids"
+
 /* Check if cgroup v2 is mounted */
 static int cgroup_is_mounted(void) {
     struct stat st;
@@ -68,9 +75,9 @@ int cgroup_init(void) {
     snprintf(subtree_control_path, sizeof(subtree_control_path),
              "%s/cgroup.subtree_control", CGROUP_MOUNT_POINT);
 
-    int fd = open(subtree_control_path, O_WRONLY);
+    int fd = open(subtree_control_path, O_WRONLY | O_CLOEXEC);
     if (fd >= 0) {
-        if (write(fd, "+memory +cpu +io +pids", 21) < 0) {
+        if (write(fd, CGROUP_CONTROLLERS, strlen(CGROUP_CONTROLLERS)) < 0) {
             LOG_WARN("failed to enable cgroup controllers at root: %s", strerror(errno));
         }
         close(fd);
@@ -80,9 +87,9 @@ int cgroup_init(void) {
     snprintf(subtree_control_path, sizeof(subtree_control_path),
              "%s/cgroup.subtree_control", CGROUP_ROOT);
 
-    fd = open(subtree_control_path, O_WRONLY);
+    fd = open(subtree_control_path, O_WRONLY | O_CLOEXEC);
     if (fd >= 0) {
-        if (write(fd, "+memory +cpu +io +pids", 21) < 0) {
+        if (write(fd, CGROUP_CONTROLLERS, strlen(CGROUP_CONTROLLERS)) < 0) {
             LOG_WARN("failed to enable cgroup controllers for %s: %s", CGROUP_ROOT, strerror(errno));
         } else {
             LOG_INFO("enabled cgroup controllers for %s", CGROUP_ROOT);
@@ -94,30 +101,27 @@ int cgroup_init(void) {
 }
 
 /* Build full cgroup path */
-char *cgroup_build_path(const char *cgroup_path) {
-    static char full_path[1024];
-
+void cgroup_build_path(const char *cgroup_path, char *buf, size_t size) {
     if (cgroup_path[0] == '/') {
         /* Absolute path starting from cgroup root */
-        snprintf(full_path, sizeof(full_path), "%s%s", CGROUP_ROOT, cgroup_path);
+        snprintf(buf, size, "%s%s", CGROUP_ROOT, cgroup_path);
     } else {
         /* Relative path */
-        snprintf(full_path, sizeof(full_path), "%s/%s", CGROUP_ROOT, cgroup_path);
+        snprintf(buf, size, "%s/%s", CGROUP_ROOT, cgroup_path);
     }
-
-    return full_path;
 }
 
 /* Check if cgroup exists */
 int cgroup_exists(const char *cgroup_path) {
-    char *full_path = cgroup_build_path(cgroup_path);
+    char full_path[CGROUP_PATH_MAX];
     struct stat st;
+    cgroup_build_path(cgroup_path, full_path, sizeof(full_path));
     return (stat(full_path, &st) == 0 && S_ISDIR(st.st_mode));
 }
 
 /* Create cgroup directory recursively */
 static int mkdir_recursive(const char *path) {
-    char tmp[1024];
+    char tmp[CGROUP_PATH_MAX];
     char *p = NULL;
     size_t len;
 
@@ -139,83 +143,193 @@ static int mkdir_recursive(const char *path) {
     return mkdir(tmp, 0755);
 }
 
-/* Create cgroup for a component */
-int cgroup_create(const char *component_name, const char *cgroup_path) {
-    char *full_path;
+/* Open (and if need be create) the cgroup of a component */
+int cgroup_open(const char *component_name, const char *cgroup_path) {
+    char full_path[CGROUP_PATH_MAX];
 
     /* Use component name as path if no explicit path given */
     if (!cgroup_path || strlen(cgroup_path) == 0) {
-        full_path = cgroup_build_path(component_name);
-    } else {
-        full_path = cgroup_build_path(cgroup_path);
+        cgroup_path = component_name;
     }
+    cgroup_build_path(cgroup_path, full_path, sizeof(full_path));
 
-    /* Create directory if it doesn't exist */
-    if (!cgroup_exists(cgroup_path ? cgroup_path : component_name)) {
+    int fd = open(full_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
         if (mkdir_recursive(full_path) < 0 && errno != EEXIST) {
             LOG_ERR("failed to create cgroup %s: %s", full_path, strerror(errno));
             return -1;
         }
         LOG_INFO("created cgroup: %s", full_path);
+
+        fd = open(full_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            LOG_ERR("failed to open cgroup %s: %s", full_path, strerror(errno));
+            return -1;
+        }
     }
 
-    return 0;
+    /* Without cgroup v2 mounted it is an ordinary directory, which no
+     * process can join */
+    if (faccessat(fd, "cgroup.procs", W_OK, 0) < 0) {
+        LOG_ERR("%s is not a cgroup: %s", full_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    cgroup_setup_oom_monitor(fd);
+    return fd;
 }
 
-/* Add process to cgroup */
-int cgroup_add_process(const char *cgroup_path, pid_t pid) {
-    char *full_path = cgroup_build_path(cgroup_path);
-    char procs_path[1024];
-    char pid_str[16];
-
-    snprintf(procs_path, sizeof(procs_path), "%s/cgroup.procs", full_path);
-    snprintf(pid_str, sizeof(pid_str), "%d", pid);
+void cgroup_close(int cgroup_fd) {
+    if (cgroup_fd >= 0) {
+        cgroup_remove_oom_monitor(cgroup_fd);
+        close(cgroup_fd);
+    }
+}
 
-    int fd = open(procs_path, O_WRONLY);
+/* Write value to a control file of the cgroup open at cgroup_fd */
+static int cgroup_write_file(int cgroup_fd, const char *filename, const char *value) {
+    int fd = openat(cgroup_fd, filename, O_WRONLY | O_CLOEXEC);
     if (fd < 0) {
-        LOG_ERR("failed to open %s: %s", procs_path, strerror(errno));
+        LOG_ERR("failed to open cgroup file %s: %s", filename, strerror(errno));
         return -1;
     }
 
-    ssize_t written = write(fd, pid_str, strlen(pid_str));
+    ssize_t written = write(fd, value, strlen(value));
     close(fd);
 
     if (written < 0) {
-        LOG_ERR("failed to add pid %d to cgroup %s: %s", pid, cgroup_path, strerror(errno));
+        LOG_ERR("failed to write '%s' to cgroup file %s: %s", value, filename, strerror(errno));
         return -1;
     }
 
-    LOG_INFO("added pid %d to cgroup %s", pid, cgroup_path);
     return 0;
 }
 
-/* Write value to cgroup file */
-static int cgroup_write_file(const char *cgroup_path, const char *filename, const char *value) {
-    char *full_path = cgroup_build_path(cgroup_path);
-    char file_path[1024];
+/* Add process to cgroup */
+int cgroup_add_process(int cgroup_fd, pid_t pid) {
+    char pid_str[16];
+    snprintf(pid_str, sizeof(pid_str), "%d", pid);
 
-    snprintf(file_path, sizeof(file_path), "%s/%s", full_path, filename);
+    if (cgroup_write_file(cgroup_fd, "cgroup.procs", pid_str) < 0) {
+        LOG_ERR("failed to add pid %d to cgroup", pid);
+        return -1;
+    }
+
+    LOG_INFO("added pid %d to cgroup", pid);
+    return 0;
+}
 
-    int fd = open(file_path, O_WRONLY);
+int cgroup_move_processes(int from_fd, int to_fd) {
+    int fd = openat(from_fd, "cgroup.procs", O_RDONLY | O_CLOEXEC);
     if (fd < 0) {
-        LOG_ERR("failed to open %s: %s", file_path, strerror(errno));
+        LOG_ERR("failed to open cgroup.procs: %s", strerror(errno));
+        return -1;
+    }
+    FILE *fp = fdopen(fd, "r");
+    if (!fp) {
+        close(fd);
         return -1;
     }
 
-    ssize_t written = write(fd, value, strlen(value));
-    close(fd);
+    /* One pid per line; one that exits meanwhile does not count */
+    int moved = 0, ret = 0;
+    long pid;
+    while (fscanf(fp, "%ld", &pid) == 1) {
+        if (cgroup_add_process(to_fd, (pid_t)pid) == 0) {
+            moved++;
+        } else if (kill((pid_t)pid, 0) == 0) {
+            ret = -1;
+        }
+    }
+    fclose(fp);
+    return ret < 0 ? -1 : moved;
+}
 
-    if (written < 0) {
-        LOG_ERR("failed to write '%s' to %s: %s", value, file_path, strerror(errno));
+int cgroup_has_process(int cgroup_fd, pid_t pid) {
+    int fd = openat(cgroup_fd, "cgroup.procs", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    FILE *fp = fdopen(fd, "r");
+    if (!fp) {
+        close(fd);
         return -1;
     }
 
-    LOG_INFO("set %s = %s", file_path, value);
-    return 0;
+    int found = 0;
+    long member;
+    while (!found && fscanf(fp, "%ld", &member) == 1) {
+        found = (pid_t)member == pid;
+    }
+    fclose(fp);
+    return found;
+}
+
+/* struct clone_args up to the cgroup field (Linux 5.7) */
+struct cgroup_clone_args {
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t child_tid;
+    uint64_t parent_tid;
+    uint64_t exit_signal;
+    uint64_t stack;
+    uint64_t stack_size;
+    uint64_t tls;
+    uint64_t set_tid;
+    uint64_t set_tid_size;
+    uint64_t cgroup;
+};
+
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+/* fork() semantics: the child gets a copy of our stack and returns 0 */
+static pid_t sys_clone3_into_cgroup(int cgroup_fd) {
+#ifdef SYS_clone3
+    struct cgroup_clone_args args = {
+        .flags = CLONE_INTO_CGROUP,
+        .exit_signal = SIGCHLD,
+        .cgroup = (uint64_t)cgroup_fd,
+    };
+    return (pid_t)syscall(SYS_clone3, &args, sizeof(args));
+#else
+    (void)cgroup_fd;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static int have_clone_into_cgroup = 1;
+
+pid_t cgroup_fork(int cgroup_fd) {
+    if (cgroup_fd >= 0 && have_clone_into_cgroup) {
+        pid_t pid = sys_clone3_into_cgroup(cgroup_fd);
+        if (pid == 0) {
+            /* No atfork handlers ran in this child */
+            log_forked();
+            return 0;
+        }
+        if (pid > 0) {
+            return pid;
+        }
+        if (errno == ENOSYS || errno == E2BIG || errno == EINVAL) {
+            /* Older kernel, or no cgroup v2 here: stop trying */
+            LOG_INFO("clone3 into cgroup unavailable (%s), attaching after fork",
+                     strerror(errno));
+            have_clone_into_cgroup = 0;
+        } else {
+            LOG_WARN("clone3 into cgroup failed: %s", strerror(errno));
+        }
+    }
+
+    pid_t pid = fork();
+    if (pid > 0 && cgroup_fd >= 0) {
+        cgroup_add_process(cgroup_fd, pid);
+    }
+    return pid;
 }
 
 /* Parse memory limit string (e.g., "64M" -> bytes) */
-static long long parse_memory_limit(const char *limit_str) {
+long long cgroup_parse_memory(const char *limit_str) {
     if (!limit_str || strlen(limit_str) == 0) {
         return -1;
     }
@@ -242,12 +356,12 @@ static long long parse_memory_limit(const char *limit_str) {
 }
 
 /* Apply resource limits */
-int cgroup_set_memory_max(const char *cgroup_path, const char *limit) {
+int cgroup_set_memory_max(int cgroup_fd, const char *limit) {
     if (!limit || strlen(limit) == 0) {
         return 0; /* no limit specified */
     }
 
-    long long bytes = parse_memory_limit(limit);
+    long long bytes = cgroup_parse_memory(limit);
     if (bytes < 0) {
         LOG_ERR("invalid memory limit: %s", limit);
         return -1;
@@ -256,15 +370,15 @@ int cgroup_set_memory_max(const char *cgroup_path, const char *limit) {
     char bytes_str[32];
     snprintf(bytes_str, sizeof(bytes_str), "%lld", bytes);
 
-    return cgroup_write_file(cgroup_path, "memory.max", bytes_str);
+    return cgroup_write_file(cgroup_fd, "memory.max", bytes_str);
 }
 
-int cgroup_set_memory_high(const char *cgroup_path, const char *limit) {
+int cgroup_set_memory_high(int cgroup_fd, const char *limit) {
     if (!limit || strlen(limit) == 0) {
         return 0; /* no limit specified */
     }
 
-    long long bytes = parse_memory_limit(limit);
+    long long bytes = cgroup_parse_memory(limit);
     if (bytes < 0) {
         LOG_ERR("invalid memory high limit: %s", limit);
         return -1;
@@ -273,10 +387,10 @@ int cgroup_set_memory_high(const char *cgroup_path, const char *limit) {
     char bytes_str[32];
     snprintf(bytes_str, sizeof(bytes_str), "%lld", bytes);
 
-    return cgroup_write_file(cgroup_path, "memory.high", bytes_str);
+    return cgroup_write_file(cgroup_fd, "memory.high", bytes_str);
 }
 
-int cgroup_set_cpu_weight(const char *cgroup_path, int weight) {
+int cgroup_set_cpu_weight(int cgroup_fd, int weight) {
     if (weight <= 0) {
         return 0; /* no weight specified */
     }
@@ -288,18 +402,18 @@ int cgroup_set_cpu_weight(const char *cgroup_path, int weight) {
     char weight_str[16];
     snprintf(weight_str, sizeof(weight_str), "%d", weight);
 
-    return cgroup_write_file(cgroup_path, "cpu.weight", weight_str);
+    return cgroup_write_file(cgroup_fd, "cpu.weight", weight_str);
 }
 
-int cgroup_set_cpu_max(const char *cgroup_path, const char *limit) {
+int cgroup_set_cpu_max(int cgroup_fd, const char *limit) {
     if (!limit || strlen(limit) == 0) {
         return 0; /* no limit specified */
     }
 
-    return cgroup_write_file(cgroup_path, "cpu.max", limit);
+    return cgroup_write_file(cgroup_fd, "cpu.max", limit);
 }
 
-int cgroup_set_io_weight(const char *cgroup_path, int weight) {
+int cgroup_set_io_weight(int cgroup_fd, int weight) {
     if (weight <= 0) {
         return 0; /* no weight specified */
     }
@@ -311,10 +425,10 @@ int cgroup_set_io_weight(const char *cgroup_path, int weight) {
     char weight_str[16];
     snprintf(weight_str, sizeof(weight_str), "%d", weight);
 
-    return cgroup_write_file(cgroup_path, "io.weight", weight_str);
+    return cgroup_write_file(cgroup_fd, "io.weight", weight_str);
 }
 
-int cgroup_set_pids_max(const char *cgroup_path, int limit) {
+int cgroup_set_pids_max(int cgroup_fd, int limit) {
     if (limit <= 0) {
         return 0; /* no limit specified */
     }
@@ -322,60 +436,234 @@ int cgroup_set_pids_max(const char *cgroup_path, int limit) {
     char limit_str[16];
     snprintf(limit_str, sizeof(limit_str), "%d", limit);
 
-    return cgroup_write_file(cgroup_path, "pids.max", limit_str);
+    return cgroup_write_file(cgroup_fd, "pids.max", limit_str);
+}
+
+/* memory.oom.group: the OOM killer takes every process of the cgroup
+ * together, or none */
+int cgroup_set_oom_group(int cgroup_fd, int on) {
+    if (!on) {
+        return 0; /* the kernel default, one process at a time */
+    }
+
+    return cgroup_write_file(cgroup_fd, "memory.oom.group", "1");
+}
+
+/* "" lets the cgroup use all of its parent's CPUs or nodes again */
+int cgroup_set_cpuset(int cgroup_fd, const char *cpus, const char *mems) {
+    int ret = 0;
+    if (cgroup_write_file(cgroup_fd, "cpuset.mems", mems[0] ? mems : "\n") < 0) ret = -1;
+    if (cgroup_write_file(cgroup_fd, "cpuset.cpus", cpus[0] ? cpus : "\n") < 0) ret = -1;
+    return ret;
+}
+
+/* The cpuset controller is only enabled once placement needs it, since
+ * it costs every fork and CPU hotplug event a walk of the hierarchy */
+int cgroup_enable_cpuset(void) {
+    struct stat st;
+    if (stat(CGROUP_ROOT, &st) < 0) return -1;
+
+    const char *dirs[] = { CGROUP_MOUNT_POINT, CGROUP_ROOT };
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/cgroup.subtree_control", dirs[i]);
+        int fd = open(path, O_WRONLY | O_CLOEXEC);
+        if (fd < 0 || write(fd, "+cpuset", 7) < 0) {
+            LOG_WARN("failed to enable cpuset controller for %s: %s", dirs[i], strerror(errno));
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+        close(fd);
+    }
+    LOG_INFO("enabled cpuset controller for %s", CGROUP_ROOT);
+    return 0;
 }
 
 /* Apply all resource limits from component configuration */
-int cgroup_apply_limits(const char *cgroup_path, const component_t *comp) {
+int cgroup_apply_limits(int cgroup_fd, const component_t *comp) {
     int ret = 0;
 
-    if (cgroup_set_memory_max(cgroup_path, comp->memory_max) < 0) ret = -1;
-    if (cgroup_set_memory_high(cgroup_path, comp->memory_high) < 0) ret = -1;
-    if (cgroup_set_cpu_weight(cgroup_path, comp->cpu_weight) < 0) ret = -1;
-    if (cgroup_set_cpu_max(cgroup_path, comp->cpu_max) < 0) ret = -1;
-    if (cgroup_set_io_weight(cgroup_path, comp->io_weight) < 0) ret = -1;
-    if (cgroup_set_pids_max(cgroup_path, comp->pids_max) < 0) ret = -1;
+    if (cgroup_set_memory_max(cgroup_fd, comp->memory_max) < 0) ret = -1;
+    if (cgroup_set_memory_high(cgroup_fd, comp->memory_high) < 0) ret = -1;
+    if (cgroup_set_cpu_weight(cgroup_fd, comp->cpu_weight) < 0) ret = -1;
+    if (cgroup_set_cpu_max(cgroup_fd, comp->cpu_max) < 0) ret = -1;
+    if (cgroup_set_io_weight(cgroup_fd, comp->io_weight) < 0) ret = -1;
+    if (cgroup_set_pids_max(cgroup_fd, comp->pids_max) < 0) ret = -1;
+    if (cgroup_set_oom_group(cgroup_fd, comp->oom_group) < 0) ret = -1;
 
+    if (ret == 0) {
+        LOG_INFO("applied resource limits for %s", comp->name);
+    }
     return ret;
 }
 
-/* Setup OOM event monitoring */
-int cgroup_setup_oom_monitor(const char *cgroup_path) {
-    char *full_path = cgroup_build_path(cgroup_path);
-    char events_path[1024];
+/* OOM monitoring. Each watched cgroup remembers the oom_kill count it
+ * last reported, and the main loop re-reads memory.events only when
+ * inotify says the kernel changed it. */
+typedef struct {
+    int  cgroup_fd;
+    int  wd;             /* inotify watch, -1 if none */
+    long oom_kills;      /* count already reported */
+} oom_watch_t;
+
+static oom_watch_t *oom_watches = NULL;
+static int n_oom_watches = 0;
+static int max_oom_watches = 0;
+static int oom_inotify_fd = -1;
+static event_source_t oom_src = { EVENT_OOM, -1 };
+
+static int oom_watch_find(int cgroup_fd) {
+    for (int i = 0; i < n_oom_watches; i++) {
+        if (oom_watches[i].cgroup_fd == cgroup_fd) return i;
+    }
+    return -1;
+}
 
-    snprintf(events_path, sizeof(events_path), "%s/memory.events", full_path);
+static int oom_add_watch(int cgroup_fd) {
+    if (oom_inotify_fd < 0) return -1;
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d/memory.events", cgroup_fd);
+    return inotify_add_watch(oom_inotify_fd, path, IN_MODIFY);
+}
 
-    /* Check if memory.events file exists */
-    if (access(events_path, R_OK) < 0) {
-        if (errno == ENOENT) {
-            /* No memory controller available, not an error */
-            return 0;
-        }
-        LOG_ERR("cannot access %s: %s", events_path, strerror(errno));
+int cgroup_oom_init(int epoll_fd) {
+    if (oom_inotify_fd >= 0) return oom_inotify_fd;
+
+    oom_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (oom_inotify_fd < 0) {
+        LOG_WARN("OOM event watches unavailable, polling: %s", strerror(errno));
         return -1;
     }
 
-    LOG_INFO("setup OOM monitoring for %s", cgroup_path);
+    oom_src.fd = oom_inotify_fd;
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = &oom_src;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, oom_inotify_fd, &ev) < 0) {
+        LOG_WARN("epoll add for OOM event watches failed: %s", strerror(errno));
+        close(oom_inotify_fd);
+        oom_inotify_fd = -1;
+        return -1;
+    }
+
+    /* Cgroups opened before the main loop existed */
+    for (int i = 0; i < n_oom_watches; i++) {
+        oom_watches[i].wd = oom_add_watch(oom_watches[i].cgroup_fd);
+    }
+    return oom_inotify_fd;
+}
+
+int cgroup_oom_watching(void) {
+    return oom_inotify_fd >= 0;
+}
+
+/* Start OOM monitoring; kills that happened before are not reported */
+int cgroup_setup_oom_monitor(int cgroup_fd) {
+    long kills = cgroup_read_oom_kills(cgroup_fd);
+    if (kills < 0) {
+        /* No memory controller available, not an error */
+        return 0;
+    }
+    if (oom_watch_find(cgroup_fd) >= 0) {
+        return 0;
+    }
+
+    if (n_oom_watches == max_oom_watches) {
+        int new_max = max_oom_watches ? max_oom_watches * 2 : 64;
+        oom_watch_t *grown = realloc(oom_watches, (size_t)new_max * sizeof(*grown));
+        if (!grown) {
+            LOG_ERR("out of memory growing OOM event watches");
+            return -1;
+        }
+        oom_watches = grown;
+        max_oom_watches = new_max;
+    }
+
+    oom_watch_t *w = &oom_watches[n_oom_watches++];
+    w->cgroup_fd = cgroup_fd;
+    w->oom_kills = kills;
+    w->wd = oom_add_watch(cgroup_fd);
     return 0;
 }
 
-/* Check for OOM events */
-int cgroup_check_oom_events(const char *cgroup_path) {
-    char *full_path = cgroup_build_path(cgroup_path);
-    char events_path[1024];
+void cgroup_remove_oom_monitor(int cgroup_fd) {
+    int i = oom_watch_find(cgroup_fd);
+    if (i < 0) return;
+
+    int wd = oom_watches[i].wd;
+    oom_watches[i] = oom_watches[--n_oom_watches];
+    if (wd < 0) return;
+
+    /* Components sharing a cgroup share its watch */
+    for (i = 0; i < n_oom_watches; i++) {
+        if (oom_watches[i].wd == wd) return;
+    }
+    inotify_rm_watch(oom_inotify_fd, wd);
+}
+
+/* Report the kills since the last look */
+static void oom_check(oom_watch_t *w, void (*oom)(int cgroup_fd, long kills)) {
+    long kills = cgroup_read_oom_kills(w->cgroup_fd);
+    if (kills < 0) return;
+
+    long fresh = kills - w->oom_kills;
+    w->oom_kills = kills;
+    if (fresh > 0) {
+        oom(w->cgroup_fd, fresh);
+    }
+}
+
+/* oom_check() the cgroups behind watch wd, or all of them for -1 */
+static void oom_check_all(int wd, void (*oom)(int cgroup_fd, long kills)) {
+    for (int i = 0; i < n_oom_watches; i++) {
+        if (wd >= 0 && oom_watches[i].wd != wd) continue;
+        int fd = oom_watches[i].cgroup_fd;
+        oom_check(&oom_watches[i], oom);
+        /* oom() may close cgroups; look at this slot again if it did */
+        if (i < n_oom_watches && oom_watches[i].cgroup_fd != fd) i--;
+    }
+}
+
+void cgroup_oom_dispatch(void (*oom)(int cgroup_fd, long kills)) {
+    if (oom_inotify_fd < 0) return;
+
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+
+    while ((len = read(oom_inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                /* Events were lost: look at every cgroup */
+                oom_check_all(-1, oom);
+            } else if (ev->mask & IN_IGNORED) {
+                /* The cgroup is gone */
+                for (int i = 0; i < n_oom_watches; i++) {
+                    if (oom_watches[i].wd == ev->wd) oom_watches[i].wd = -1;
+                }
+            } else {
+                oom_check_all(ev->wd, oom);
+            }
+        }
+    }
+}
+
+void cgroup_oom_scan(void (*oom)(int cgroup_fd, long kills)) {
+    oom_check_all(-1, oom);
+}
+
+/* Cumulative oom_kill count from memory.events */
+long cgroup_read_oom_kills(int cgroup_fd) {
     char line[256];
     FILE *f;
     long oom_kill_count = 0;
 
-    snprintf(events_path, sizeof(events_path), "%s/memory.events", full_path);
-
-    f = fopen(events_path, "r");
-    if (!f) {
-        if (errno != ENOENT) {
-            LOG_WARN("failed to open %s: %s", events_path, strerror(errno));
-        }
-        return 0; /* No events or file doesn't exist */
+    int fd = openat(cgroup_fd, "memory.events", O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || !(f = fdopen(fd, "r"))) {
+        if (fd >= 0) close(fd);
+        return -1; /* no memory controller */
     }
 
     /* Parse memory.events file */
@@ -386,18 +674,13 @@ int cgroup_check_oom_events(const char *cgroup_path) {
     }
 
     fclose(f);
-
-    if (oom_kill_count > 0) {
-        LOG_ERR("OOM kill detected in cgroup %s (count: %ld)", cgroup_path, oom_kill_count);
-        return (int)oom_kill_count;
-    }
-
-    return 0; /* No OOM events */
+    return oom_kill_count;
 }
 
 /* Clean up cgroup when component exits */
 int cgroup_cleanup(const char *cgroup_path) {
-    char *full_path = cgroup_build_path(cgroup_path);
+    char full_path[CGROUP_PATH_MAX];
+    cgroup_build_path(cgroup_path, full_path, sizeof(full_path));
 
     /* Remove the cgroup directory (will only work if empty) */
     if (rmdir(full_path) < 0) {
@@ -456,59 +739,3 @@ int isolation_parse_namespaces(const char *namespaces_str) {
     free(str_copy);
     return flags;
 }
-
-/* Setup private mount namespace with /tmp */
-int isolation_setup_mount_namespace(void) {
-    /* Create a private /tmp for this component */
-    if (mount("tmpfs", "/tmp", "tmpfs", MS_NOSUID | MS_NODEV, "mode=1777") < 0) {
-        LOG_WARN("failed to mount private /tmp: %s", strerror(errno));
-        return -1;
-    }
-
-    LOG_INFO("mounted private /tmp for component");
-    return 0;
-}
-
-/* Set hostname in UTS namespace */
-int isolation_setup_hostname(const char *hostname) {
-    if (!hostname || strlen(hostname) == 0) {
-        return 0; /* no hostname specified */
-    }
-
-    if (sethostname(hostname, strlen(hostname)) < 0) {
-        LOG_WARN("failed to set hostname to %s: %s", hostname, strerror(errno));
-        return -1;
-    }
-
-    LOG_INFO("set hostname to %s", hostname);
-    return 0;
-}
-
-/* Setup all requested namespaces for a component */
-int isolation_setup_namespaces(const component_t *comp) {
-    int flags = isolation_parse_namespaces(comp->isolation_namespaces);
-
-    if (flags == 0) {
-        return 0; /* no namespaces requested */
-    }
-
-    /* Call unshare to create new namespaces */
-    if (unshare(flags) < 0) {
-        LOG_ERR("failed to create namespaces (flags=%d): %s", flags, strerror(errno));
-        return -1;
-    }
-
-    LOG_INFO("created namespaces for %s (flags=%d)", comp->name, flags);
-
-    /* Setup mount namespace if requested */
-    if (flags & CLONE_NEWNS) {
-        isolation_setup_mount_namespace();
-    }
-
-    /* Setup UTS namespace hostname if requested */
-    if (flags & CLONE_NEWUTS) {
-        isolation_setup_hostname(comp->isolation_hostname);
-    }
-
-    return 0;
-}
\ No newline at end of file
@@ -13,42 +13,83 @@
 
 #define CGROUP_ROOT "/sys/fs/cgroup/graph"
 #define CGROUP_MOUNT_POINT "/sys/fs/cgroup"
+#define CGROUP_PATH_MAX 1024
 
 /* Initialize cgroup subsystem */
 int cgroup_init(void);
 
-/* Create cgroup for a component */
-int cgroup_create(const char *component_name, const char *cgroup_path);
+/* Open a component's cgroup directory, creating it if needed. Every
+ * control file is then reached with openat() on the returned descriptor
+ * and no path is rebuilt; children join it as they are spawned. The
+ * descriptor is close-on-exec. Returns -1 on failure, or if the
+ * directory is not a cgroup v2 one. */
+int cgroup_open(const char *component_name, const char *cgroup_path);
+void cgroup_close(int cgroup_fd);
+
+/* fork() with the child created inside the cgroup open at cgroup_fd
+ * (clone3() with CLONE_INTO_CGROUP), so it never runs outside its
+ * limits. Where the kernel lacks that, fork() and attach the child from
+ * the parent. cgroup_fd -1 is a plain fork(). Returns like fork(). */
+pid_t cgroup_fork(int cgroup_fd);
 
 /* Add process to cgroup */
-int cgroup_add_process(const char *cgroup_path, pid_t pid);
+int cgroup_add_process(int cgroup_fd, pid_t pid);
+
+/* Move every process of the cgroup open at from_fd into to_fd's.
+ * Returns the number moved, or -1 if one could not be moved. */
+int cgroup_move_processes(int from_fd, int to_fd);
+
+/* Whether pid is one of the processes of the cgroup open at cgroup_fd:
+ * 1 if it is, 0 if not, -1 if cgroup.procs could not be read */
+int cgroup_has_process(int cgroup_fd, pid_t pid);
 
 /* Apply resource limits to cgroup */
-int cgroup_set_memory_max(const char *cgroup_path, const char *limit);
-int cgroup_set_memory_high(const char *cgroup_path, const char *limit);
-int cgroup_set_cpu_weight(const char *cgroup_path, int weight);
-int cgroup_set_cpu_max(const char *cgroup_path, const char *limit);
-int cgroup_set_io_weight(const char *cgroup_path, int weight);
-int cgroup_set_pids_max(const char *cgroup_path, int limit);
+int cgroup_set_memory_max(int cgroup_fd, const char *limit);
+int cgroup_set_memory_high(int cgroup_fd, const char *limit);
+int cgroup_set_cpu_weight(int cgroup_fd, int weight);
+int cgroup_set_cpu_max(int cgroup_fd, const char *limit);
+int cgroup_set_io_weight(int cgroup_fd, int weight);
+int cgroup_set_pids_max(int cgroup_fd, int limit);
+int cgroup_set_oom_group(int cgroup_fd, int on);
+int cgroup_set_cpuset(int cgroup_fd, const char *cpus, const char *mems);
+
+/* Enable the cpuset controller for the graph subtree, left off until
+ * placement confines a component. -1 if it could not be. */
+int cgroup_enable_cpuset(void);
+
+/* A memory size such as "64M" in bytes, -1 if it is not one */
+long long cgroup_parse_memory(const char *limit);
 
 /* Apply all resource limits from component configuration */
-int cgroup_apply_limits(const char *cgroup_path, const component_t *comp);
+int cgroup_apply_limits(int cgroup_fd, const component_t *comp);
+
+/* Monitor cgroup for OOM events. cgroup_open() starts monitoring and
+ * cgroup_close() ends it. The memory.events of every monitored cgroup is
+ * watched through one inotify instance in the main epoll set, so nothing
+ * is read until the kernel changes one; each oom_kill is reported once,
+ * with kills from before monitoring started left out. */
+int cgroup_oom_init(int epoll_fd);
+int cgroup_oom_watching(void);     /* 0 if OOM events must be polled */
+int cgroup_setup_oom_monitor(int cgroup_fd);
+void cgroup_remove_oom_monitor(int cgroup_fd);
+
+/* Read the inotify events and call oom() for each cgroup with kills
+ * since the last report; cgroup_oom_scan() looks at every cgroup */
+void cgroup_oom_dispatch(void (*oom)(int cgroup_fd, long kills));
+void cgroup_oom_scan(void (*oom)(int cgroup_fd, long kills));
 
-/* Monitor cgroup for OOM events */
-int cgroup_setup_oom_monitor(const char *cgroup_path);
-int cgroup_check_oom_events(const char *cgroup_path);
+/* Cumulative oom_kill count, or -1 without a memory controller */
+long cgroup_read_oom_kills(int cgroup_fd);
 
-/* Clean up cgroup when component exits */
+/* Remove a component's cgroup directory once it has no processes */
 int cgroup_cleanup(const char *cgroup_path);
 
-/* Namespace isolation functions */
-int isolation_setup_namespaces(const component_t *comp);
-int isolation_setup_mount_namespace(void);
-int isolation_setup_hostname(const char *hostname);
+/* Clone flags (CLONE_NEW*) for a comma-separated list of namespaces;
+ * the child spawned for the component unshares them */
 int isolation_parse_namespaces(const char *namespaces_str);
 
 /* Utility functions */
 int cgroup_exists(const char *cgroup_path);
-char *cgroup_build_path(const char *cgroup_path);
+void cgroup_build_path(const char *cgroup_path, char *buf, size_t size);
 
-#endif /* CGROUP_H */
\ No newline at end of file
+#endif /* CGROUP_H */
@@ -0,0 +1,546 @@
+/*
+ * checkpoint-catalog.c - YakirOS checkpoint catalog implementation
+ *
+ * File layout, all integers in host byte order:
+ *
+ *   header        magic, version and sizeof(catalog_record_t)
+ *   record[n]     operation, checksum and the entry it applies to
+ *
+ * The file is read once and replayed into a sorted array; after that it
+ * is only appended to. Its device, inode and size are remembered so a
+ * catalog replaced or removed behind our back (the kexec cleanup removes
+ * the one on /run) is noticed and read again.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "checkpoint-catalog.h"
+#include "checkpoint-mgmt.h"
+#include "checkpoint-store.h"
+#include "log.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CATALOG_MAGIC "YKCATLG"
+
+#define CATALOG_ADD  1
+#define CATALOG_DROP 2
+
+/* Dead records tolerated beyond the live ones before compacting */
+#define CATALOG_SLACK 32
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t record_size;        /* sizeof(catalog_record_t) */
+} catalog_header_t;
+
+typedef struct {
+    uint32_t op;                 /* CATALOG_ADD or CATALOG_DROP */
+    uint32_t check;              /* FNV-1a of op and entry */
+    checkpoint_catalog_entry_t entry;
+} catalog_record_t;
+
+typedef struct {
+    int loaded;
+    checkpoint_catalog_entry_t *entries;   /* Sorted, see entry_cmp() */
+    int n;
+    int cap;
+    int records;                 /* Records in the file */
+    dev_t dev;                   /* File as last read or written */
+    ino_t ino;
+    off_t size;
+} catalog_t;
+
+/* Temporary and persistent storage */
+static catalog_t catalogs[2];
+
+static const char *storage_dir(int persistent) {
+    return persistent ? CHECKPOINT_VAR_DIR : CHECKPOINT_RUN_DIR;
+}
+
+static void catalog_path(int persistent, char *buf, size_t size) {
+    snprintf(buf, size, "%s/%s", storage_dir(persistent), CHECKPOINT_CATALOG_FILE);
+}
+
+static uint32_t record_check(const catalog_record_t *rec) {
+    uint32_t h = 2166136261u;
+    const unsigned char *p = (const unsigned char *)&rec->op;
+    for (size_t i = 0; i < sizeof(rec->op); i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    p = (const unsigned char *)&rec->entry;
+    for (size_t i = 0; i < sizeof(rec->entry); i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+/* By component, then newest first */
+static int entry_cmp(const checkpoint_catalog_entry_t *a, const checkpoint_catalog_entry_t *b) {
+    int c = strcmp(a->component, b->component);
+    if (c != 0) return c;
+    if (a->metadata.timestamp != b->metadata.timestamp) {
+        return a->metadata.timestamp > b->metadata.timestamp ? -1 : 1;
+    }
+    return strcmp(b->id, a->id);
+}
+
+/* First entry of component, or where it would go */
+static int lower_bound(const catalog_t *cat, const char *component) {
+    int lo = 0, hi = cat->n;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strcmp(cat->entries[mid].component, component) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static int index_find(const catalog_t *cat, const char *component, const char *id) {
+    for (int i = lower_bound(cat, component);
+         i < cat->n && strcmp(cat->entries[i].component, component) == 0; i++) {
+        if (strcmp(cat->entries[i].id, id) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void index_remove(catalog_t *cat, int i) {
+    memmove(&cat->entries[i], &cat->entries[i + 1],
+            (size_t)(cat->n - i - 1) * sizeof(*cat->entries));
+    cat->n--;
+}
+
+static int index_insert(catalog_t *cat, const checkpoint_catalog_entry_t *entry) {
+    int old = index_find(cat, entry->component, entry->id);
+    if (old >= 0) {
+        index_remove(cat, old);
+    }
+
+    if (cat->n == cat->cap) {
+        int cap = cat->cap ? cat->cap * 2 : 16;
+        checkpoint_catalog_entry_t *grown = realloc(cat->entries, (size_t)cap * sizeof(*grown));
+        if (!grown) {
+            return -1;
+        }
+        cat->entries = grown;
+        cat->cap = cap;
+    }
+
+    int lo = 0, hi = cat->n;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (entry_cmp(&cat->entries[mid], entry) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    memmove(&cat->entries[lo + 1], &cat->entries[lo],
+            (size_t)(cat->n - lo) * sizeof(*cat->entries));
+    memcpy(&cat->entries[lo], entry, sizeof(*entry));
+    cat->n++;
+    return 0;
+}
+
+static void index_clear(catalog_t *cat) {
+    cat->n = 0;
+    cat->records = 0;
+    cat->loaded = 0;
+    cat->dev = 0;
+    cat->ino = 0;
+    cat->size = 0;
+}
+
+static void remember_file(catalog_t *cat, const struct stat *st) {
+    cat->dev = st->st_dev;
+    cat->ino = st->st_ino;
+    cat->size = st->st_size;
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static void fill_record(catalog_record_t *rec, uint32_t op, const checkpoint_catalog_entry_t *entry) {
+    memset(rec, 0, sizeof(*rec));
+    rec->op = op;
+    memcpy(&rec->entry, entry, sizeof(*entry));
+    rec->check = record_check(rec);
+}
+
+/* Replace the file with one ADD record per live entry */
+static int write_catalog(int persistent) {
+    catalog_t *cat = &catalogs[persistent ? 1 : 0];
+    char path[512], tmp[520];
+    catalog_path(persistent, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            LOG_WARN("cannot write checkpoint catalog %s: %s", tmp, strerror(errno));
+        }
+        return -1;
+    }
+
+    catalog_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CATALOG_MAGIC, sizeof(hdr.magic));
+    hdr.version = CHECKPOINT_CATALOG_VERSION;
+    hdr.record_size = sizeof(catalog_record_t);
+
+    int ret = write_all(fd, &hdr, sizeof(hdr));
+    for (int i = 0; i < cat->n && ret == 0; i++) {
+        catalog_record_t rec;
+        fill_record(&rec, CATALOG_ADD, &cat->entries[i]);
+        ret = write_all(fd, &rec, sizeof(rec));
+    }
+
+    struct stat st;
+    if (ret == 0 && fstat(fd, &st) < 0) ret = -1;
+    if (close(fd) < 0) ret = -1;
+    if (ret == 0 && rename(tmp, path) < 0) ret = -1;
+    if (ret < 0) {
+        LOG_WARN("cannot write checkpoint catalog %s: %s", path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+
+    remember_file(cat, &st);
+    cat->records = cat->n;
+    return 0;
+}
+
+/* Add what the storage directory holds to the index, the way it was
+ * listed before there was a catalog */
+static int scan_storage(catalog_t *cat, int persistent) {
+    const char *base = storage_dir(persistent);
+    DIR *top = opendir(base);
+    if (!top) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        LOG_ERR("Failed to open checkpoint directory %s: %s", base, strerror(errno));
+        return -1;
+    }
+
+    struct dirent *c;
+    while ((c = readdir(top)) != NULL) {
+        /* Dot entries include the chunk store and the catalog itself */
+        if (c->d_name[0] == '.') {
+            continue;
+        }
+
+        char component_dir[512];
+        snprintf(component_dir, sizeof(component_dir), "%s/%s", base, c->d_name);
+        DIR *dir = opendir(component_dir);
+        if (!dir) {
+            continue;
+        }
+
+        struct dirent *d;
+        while ((d = readdir(dir)) != NULL) {
+            /* Leaves out scratch copies such as <id>.restore */
+            if (d->d_name[0] == '.' || strchr(d->d_name, '.')) {
+                continue;
+            }
+
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/%s", component_dir, d->d_name);
+            struct stat st;
+            if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+                continue;
+            }
+
+            checkpoint_catalog_entry_t entry;
+            memset(&entry, 0, sizeof(entry));
+            if (strlen(c->d_name) >= sizeof(entry.component) ||
+                strlen(d->d_name) >= sizeof(entry.id)) {
+                LOG_WARN("checkpoint %s: name too long for the catalog", path);
+                continue;
+            }
+            strcpy(entry.component, c->d_name);
+            strcpy(entry.id, d->d_name);
+
+            if (checkpoint_load_metadata(path, &entry.metadata) != 0) {
+                memset(&entry.metadata, 0, sizeof(entry.metadata));
+                strcpy(entry.metadata.component_name, c->d_name);
+                entry.metadata.timestamp = st.st_mtime;
+            }
+            entry.size = checkpoint_directory_size(path) + checkpoint_store_share(path);
+
+            if (index_insert(cat, &entry) != 0) {
+                closedir(dir);
+                closedir(top);
+                return -1;
+            }
+        }
+        closedir(dir);
+    }
+    closedir(top);
+    return cat->n;
+}
+
+/* Replay the file into the index. Returns -1 if it is not a catalog or
+ * any record fails its check. */
+static int load_catalog(catalog_t *cat, int persistent) {
+    char path[512];
+    catalog_path(persistent, path, sizeof(path));
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return -1;
+    }
+
+    struct stat st;
+    catalog_header_t hdr;
+    if (fstat(fileno(fp), &st) < 0 || fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        memcmp(hdr.magic, CATALOG_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != CHECKPOINT_CATALOG_VERSION ||
+        hdr.record_size != sizeof(catalog_record_t) ||
+        (st.st_size - (off_t)sizeof(hdr)) % (off_t)sizeof(catalog_record_t) != 0) {
+        fclose(fp);
+        return -1;
+    }
+
+    catalog_record_t rec;
+    int ret = 0;
+    while (ret == 0 && fread(&rec, sizeof(rec), 1, fp) == 1) {
+        checkpoint_catalog_entry_t *e = &rec.entry;
+        if (rec.check != record_check(&rec) ||
+            e->component[sizeof(e->component) - 1] != '\0' ||
+            e->id[sizeof(e->id) - 1] != '\0') {
+            ret = -1;
+        } else if (rec.op == CATALOG_ADD) {
+            e->metadata.component_name[sizeof(e->metadata.component_name) - 1] = '\0';
+            e->metadata.capabilities[sizeof(e->metadata.capabilities) - 1] = '\0';
+            e->metadata.preserve_fds[sizeof(e->metadata.preserve_fds) - 1] = '\0';
+            e->metadata.parent_chain[sizeof(e->metadata.parent_chain) - 1] = '\0';
+            ret = index_insert(cat, e);
+        } else if (rec.op == CATALOG_DROP) {
+            int i = index_find(cat, e->component, e->id);
+            if (i >= 0) {
+                index_remove(cat, i);
+            }
+        } else {
+            ret = -1;
+        }
+        cat->records++;
+    }
+    if (ferror(fp)) {
+        ret = -1;
+    }
+    fclose(fp);
+
+    if (ret == 0) {
+        remember_file(cat, &st);
+    }
+    return ret;
+}
+
+/* The catalog of a storage, read or rebuilt if it changed since last use */
+static catalog_t *catalog_get(int persistent) {
+    catalog_t *cat = &catalogs[persistent ? 1 : 0];
+    char path[512];
+    catalog_path(persistent, path, sizeof(path));
+
+    struct stat st;
+    int present = stat(path, &st) == 0;
+    if (cat->loaded && present && st.st_dev == cat->dev &&
+        st.st_ino == cat->ino && st.st_size == cat->size) {
+        return cat;
+    }
+
+    index_clear(cat);
+    if (present && load_catalog(cat, persistent) == 0) {
+        cat->loaded = 1;
+        if (cat->records > 2 * cat->n + CATALOG_SLACK) {
+            write_catalog(persistent);
+        }
+        return cat;
+    }
+
+    if (present) {
+        LOG_WARN("checkpoint catalog %s is damaged, rebuilding it", path);
+    }
+    index_clear(cat);
+    if (scan_storage(cat, persistent) < 0) {
+        index_clear(cat);
+        return NULL;
+    }
+    cat->loaded = 1;
+    if (write_catalog(persistent) == 0) {
+        LOG_INFO("Rebuilt checkpoint catalog %s: %d checkpoints", path, cat->n);
+    }
+    return cat;
+}
+
+/* Append one record, falling back to rewriting the file */
+static int append_record(int persistent, uint32_t op, const checkpoint_catalog_entry_t *entry) {
+    catalog_t *cat = &catalogs[persistent ? 1 : 0];
+    char path[512];
+    catalog_path(persistent, path, sizeof(path));
+
+    if (cat->records > 2 * cat->n + CATALOG_SLACK) {
+        if (write_catalog(persistent) == 0) {
+            return 0;
+        }
+    }
+
+    int fd = cat->ino ? open(path, O_WRONLY | O_APPEND | O_CLOEXEC) : -1;
+    if (fd >= 0) {
+        catalog_record_t rec;
+        fill_record(&rec, op, entry);
+        struct stat st;
+        int ret = write_all(fd, &rec, sizeof(rec));
+        if (ret == 0 && fstat(fd, &st) < 0) ret = -1;
+        if (close(fd) < 0) ret = -1;
+        if (ret == 0) {
+            remember_file(cat, &st);
+            cat->records++;
+            return 0;
+        }
+    }
+
+    if (write_catalog(persistent) == 0) {
+        return 0;
+    }
+
+    /* The index is ahead of the file: read the directory again next time */
+    index_clear(cat);
+    return -1;
+}
+
+int checkpoint_catalog_put(int persistent, const checkpoint_catalog_entry_t *entry) {
+    if (!entry || !entry->component[0] || !entry->id[0]) {
+        return -1;
+    }
+
+    catalog_t *cat = catalog_get(persistent);
+    if (!cat || index_insert(cat, entry) != 0) {
+        return -1;
+    }
+    return append_record(persistent, CATALOG_ADD, entry);
+}
+
+int checkpoint_catalog_drop(int persistent, const char *component, const char *id) {
+    if (!component || !id) {
+        return -1;
+    }
+
+    catalog_t *cat = catalog_get(persistent);
+    if (!cat) {
+        return -1;
+    }
+
+    int i = index_find(cat, component, id);
+    if (i < 0) {
+        return 0;
+    }
+
+    checkpoint_catalog_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    memcpy(entry.component, cat->entries[i].component, sizeof(entry.component));
+    memcpy(entry.id, cat->entries[i].id, sizeof(entry.id));
+    index_remove(cat, i);
+    return append_record(persistent, CATALOG_DROP, &entry);
+}
+
+int checkpoint_catalog_find(int persistent, const char *component,
+                            const checkpoint_catalog_entry_t **first) {
+    if (!first) {
+        return -1;
+    }
+    *first = NULL;
+
+    catalog_t *cat = catalog_get(persistent);
+    if (!cat) {
+        return -1;
+    }
+
+    if (!component) {
+        *first = cat->n ? cat->entries : NULL;
+        return cat->n;
+    }
+
+    int lo = lower_bound(cat, component);
+    int hi = lo;
+    while (hi < cat->n && strcmp(cat->entries[hi].component, component) == 0) {
+        hi++;
+    }
+    if (hi > lo) {
+        *first = &cat->entries[lo];
+    }
+    return hi - lo;
+}
+
+int checkpoint_catalog_rebuild(int persistent) {
+    catalog_t *cat = &catalogs[persistent ? 1 : 0];
+
+    index_clear(cat);
+    if (scan_storage(cat, persistent) < 0) {
+        index_clear(cat);
+        return -1;
+    }
+    cat->loaded = 1;
+    write_catalog(persistent);
+    return cat->n;
+}
+
+int checkpoint_catalog_locate(const char *path, int *persistent,
+                              char *component, size_t component_size,
+                              char *id, size_t id_size) {
+    if (!path || !persistent || !component || !id) {
+        return -1;
+    }
+
+    for (int p = 0; p < 2; p++) {
+        const char *base = storage_dir(p);
+        size_t len = strlen(base);
+        if (strncmp(path, base, len) != 0 || path[len] != '/') {
+            continue;
+        }
+
+        const char *name = path + len + 1;
+        const char *slash = strchr(name, '/');
+        if (!slash || slash == name || !slash[1] || strchr(slash + 1, '/')) {
+            return -1;
+        }
+
+        size_t name_len = (size_t)(slash - name);
+        size_t id_len = strlen(slash + 1);
+        if (name_len >= component_size || id_len >= id_size) {
+            return -1;
+        }
+        memcpy(component, name, name_len);
+        component[name_len] = '\0';
+        memcpy(id, slash + 1, id_len + 1);
+        *persistent = p;
+        return 0;
+    }
+    return -1;
+}
@@ -0,0 +1,82 @@
+/*
+ * checkpoint-catalog.h - YakirOS checkpoint catalog
+ *
+ * An index of the checkpoints kept under each storage directory, so
+ * listing them or finding a component's latest one no longer opens every
+ * checkpoint directory, parses its metadata.json and adds up its files.
+ *
+ *   <storage>/.catalog
+ *   ├── header        magic, version and record size
+ *   └── records       one per change: a checkpoint added (with its
+ *                     metadata and size) or removed
+ *
+ * Changes are appended as single checksummed records, so a record is
+ * either there or, torn by a crash, recognised and dropped. Once removed
+ * and superseded records outnumber the live ones the file is compacted,
+ * written beside the old one and renamed over it. In memory the catalog
+ * is kept sorted by component and newest first.
+ *
+ * A catalog that is missing or damaged is rebuilt by scanning the
+ * storage directory once. Like the chunk store it has a single writer,
+ * graph-resolver.
+ */
+
+#ifndef CHECKPOINT_CATALOG_H
+#define CHECKPOINT_CATALOG_H
+
+#include "checkpoint.h"
+#include <stddef.h>
+
+#define CHECKPOINT_CATALOG_FILE ".catalog"
+#define CHECKPOINT_CATALOG_VERSION 1
+
+/* A checkpoint as the catalog knows it */
+typedef struct {
+    char component[128];                /* Component directory name */
+    char id[MAX_CHECKPOINT_ID];         /* Checkpoint directory name */
+    size_t size;                        /* Bytes used when it was recorded,
+                                           its share of the chunk store
+                                           included */
+    checkpoint_metadata_t metadata;     /* As saved in metadata.json */
+} checkpoint_catalog_entry_t;
+
+/* Record a checkpoint, replacing what was recorded for it before
+ *
+ * persistent: Catalog of persistent storage if true, temporary if false
+ *
+ * Returns: 0 on success, negative on failure
+ */
+int checkpoint_catalog_put(int persistent, const checkpoint_catalog_entry_t *entry);
+
+/* Forget a checkpoint
+ *
+ * Returns: 0 on success (also if it was not recorded), negative on failure
+ */
+int checkpoint_catalog_drop(int persistent, const char *component, const char *id);
+
+/* Look up the checkpoints of a component
+ *
+ * component: Component to look up, or NULL for all of them
+ * first: Set to the first entry; entries of one component follow each
+ *        other newest first. Valid until the catalog next changes.
+ *
+ * Returns: Number of entries, negative on failure
+ */
+int checkpoint_catalog_find(int persistent, const char *component,
+                            const checkpoint_catalog_entry_t **first);
+
+/* Scan the storage directory and write the catalog afresh
+ *
+ * Returns: Number of checkpoints found, negative on failure
+ */
+int checkpoint_catalog_rebuild(int persistent);
+
+/* Split a checkpoint directory path into its storage, component and ID
+ *
+ * Returns: 0 if path is <storage>/<component>/<id>, -1 otherwise
+ */
+int checkpoint_catalog_locate(const char *path, int *persistent,
+                              char *component, size_t component_size,
+                              char *id, size_t id_size);
+
+#endif /* CHECKPOINT_CATALOG_H */
@@ -5,7 +5,11 @@
  * policies, and quota enforcement for the YakirOS checkpoint system.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "checkpoint-mgmt.h"
+#include "checkpoint-catalog.h"
+#include "checkpoint-store.h"
 #include "log.h"
 
 #include <dirent.h>
@@ -32,12 +36,13 @@ static int write_json_time(FILE *fp, const char *key, time_t value, int last) {
     return fprintf(fp, "  \"%s\": %ld%s\n", key, value, last ? "" : ",");
 }
 
-/* Calculate directory size recursively */
-static size_t calculate_directory_size(const char *path) {
+/* Calculate directory size recursively, not following symlinks: CRIU
+ * links a dump to the pre-dump it builds on, which is counted once */
+size_t checkpoint_directory_size(const char *path) {
     struct stat st;
     size_t total_size = 0;
 
-    if (stat(path, &st) != 0) {
+    if (lstat(path, &st) != 0) {
         return 0;
     }
 
@@ -59,7 +64,7 @@ static size_t calculate_directory_size(const char *path) {
 
             char full_path[512];
             snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
-            total_size += calculate_directory_size(full_path);
+            total_size += checkpoint_directory_size(full_path);
         }
 
         closedir(dir);
@@ -87,7 +92,7 @@ static int remove_directory_recursive(const char *path) {
         snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
 
         struct stat st;
-        if (stat(full_path, &st) == 0) {
+        if (lstat(full_path, &st) == 0) {
             if (S_ISDIR(st.st_mode)) {
                 result = remove_directory_recursive(full_path);
             } else {
@@ -105,6 +110,48 @@ static int remove_directory_recursive(const char *path) {
     return result;
 }
 
+/* Record a checkpoint directory in the catalog of its storage; other
+ * directories are left alone */
+static void catalog_record(const char *path, const checkpoint_metadata_t *metadata) {
+    checkpoint_catalog_entry_t entry;
+    int persistent;
+
+    memset(&entry, 0, sizeof(entry));
+    if (checkpoint_catalog_locate(path, &persistent, entry.component, sizeof(entry.component),
+                                  entry.id, sizeof(entry.id)) != 0) {
+        return;
+    }
+
+    entry.metadata = *metadata;
+    entry.size = checkpoint_directory_size(path) + checkpoint_store_share(path);
+    if (checkpoint_catalog_put(persistent, &entry) != 0) {
+        LOG_WARN("Failed to record checkpoint %s in the catalog", path);
+    }
+}
+
+/* Remove a checkpoint, dropping its references into the chunk store and
+ * its catalog entry */
+int checkpoint_remove_directory(const char *path) {
+    if (!path) {
+        return -1;
+    }
+    if (checkpoint_store_release(path) != 0) {
+        LOG_WARN("Some chunks of %s could not be released", path);
+    }
+
+    struct stat st;
+    int result = remove_directory_recursive(path);
+    if (result == 0 || (lstat(path, &st) != 0 && errno == ENOENT)) {
+        char component[128], id[MAX_CHECKPOINT_ID];
+        int persistent;
+        if (checkpoint_catalog_locate(path, &persistent, component, sizeof(component),
+                                      id, sizeof(id)) == 0) {
+            checkpoint_catalog_drop(persistent, component, id);
+        }
+    }
+    return result;
+}
+
 /* Create directory path recursively */
 static int create_directory_path(const char *path) {
     char tmp[512];
@@ -184,11 +231,16 @@ int checkpoint_save_metadata(const char *image_dir, const checkpoint_metadata_t
     fprintf(fp, "  },\n");
 
     write_json_int(fp, "leave_running", metadata->leave_running, 0);
-    write_json_string(fp, "preserve_fds", metadata->preserve_fds, 1);
+    write_json_string(fp, "preserve_fds", metadata->preserve_fds, 0);
+    write_json_int(fp, "pre_dump_passes", metadata->pre_dump_passes, 0);
+    write_json_string(fp, "parent_chain", metadata->parent_chain, 1);
     fprintf(fp, "}\n");
 
     fclose(fp);
 
+    /* The catalog keeps a copy, with the size the checkpoint has now */
+    catalog_record(image_dir, metadata);
+
     LOG_INFO("Saved checkpoint metadata to %s", metadata_path);
     return 0;
 }
@@ -226,6 +278,9 @@ int checkpoint_load_metadata(const char *image_dir, checkpoint_metadata_t *metad
             } else if (strcmp(key, "preserve_fds") == 0) {
                 strncpy(metadata->preserve_fds, value, sizeof(metadata->preserve_fds) - 1);
                 metadata->preserve_fds[sizeof(metadata->preserve_fds) - 1] = '\0';
+            } else if (strcmp(key, "parent_chain") == 0) {
+                strncpy(metadata->parent_chain, value, sizeof(metadata->parent_chain) - 1);
+                metadata->parent_chain[sizeof(metadata->parent_chain) - 1] = '\0';
             }
         }
         /* Parse "key": number format */
@@ -243,6 +298,8 @@ int checkpoint_load_metadata(const char *image_dir, checkpoint_metadata_t *metad
                 metadata->criu_version.minor = int_val;
             } else if (strcmp(key, "patch") == 0) {
                 metadata->criu_version.patch = int_val;
+            } else if (strcmp(key, "pre_dump_passes") == 0) {
+                metadata->pre_dump_passes = int_val;
             }
         }
         /* Parse timestamp */
@@ -257,6 +314,24 @@ int checkpoint_load_metadata(const char *image_dir, checkpoint_metadata_t *metad
     return 0;
 }
 
+/* Record the pre-dumps an image builds on, newest first */
+void checkpoint_metadata_set_chain(checkpoint_metadata_t *metadata, int passes) {
+    metadata->pre_dump_passes = passes > 0 ? passes : 0;
+    metadata->parent_chain[0] = '\0';
+
+    size_t len = 0;
+    for (int pass = passes; pass > 0; pass--) {
+        char name[32];
+        checkpoint_pre_dump_dir(pass, name, sizeof(name));
+        int n = snprintf(metadata->parent_chain + len, sizeof(metadata->parent_chain) - len,
+                         "%s%s", pass < passes ? "," : "", name);
+        if (n < 0 || (size_t)n >= sizeof(metadata->parent_chain) - len) {
+            break;
+        }
+        len += (size_t)n;
+    }
+}
+
 /* Create a new checkpoint directory with unique ID */
 int checkpoint_create_directory(const char *component_name, int persistent,
                                char *checkpoint_id, size_t id_size,
@@ -279,6 +354,13 @@ int checkpoint_create_directory(const char *component_name, int persistent,
         return -1;
     }
 
+    /* Listed from now on, until checkpoint_save_metadata() fills it in */
+    checkpoint_metadata_t metadata;
+    memset(&metadata, 0, sizeof(metadata));
+    snprintf(metadata.component_name, sizeof(metadata.component_name), "%s", component_name);
+    metadata.timestamp = now;
+    catalog_record(path, &metadata);
+
     LOG_INFO("Created checkpoint directory %s with ID %s", path, checkpoint_id);
     return 0;
 }
@@ -291,98 +373,37 @@ int checkpoint_list_checkpoints(const char *component_name, int persistent,
     }
 
     *head = NULL;
-    int count = 0;
-
-    const char *base_dir = persistent ? CHECKPOINT_VAR_DIR : CHECKPOINT_RUN_DIR;
-    char search_dir[512];
-
-    if (component_name) {
-        snprintf(search_dir, sizeof(search_dir), "%s/%s", base_dir, component_name);
-    } else {
-        strncpy(search_dir, base_dir, sizeof(search_dir) - 1);
-    }
 
-    DIR *dir = opendir(search_dir);
-    if (!dir) {
-        if (errno == ENOENT) {
-            LOG_INFO("Checkpoint directory %s does not exist", search_dir);
-            return 0; /* No checkpoints found - not an error */
-        }
-        LOG_ERR("Failed to open checkpoint directory %s: %s", search_dir, strerror(errno));
+    const checkpoint_catalog_entry_t *first = NULL;
+    int count = checkpoint_catalog_find(persistent, component_name, &first);
+    if (count < 0) {
+        LOG_ERR("Failed to read the checkpoint catalog");
         return -1;
     }
 
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
-        }
-
-        char entry_path[1024];
-        snprintf(entry_path, sizeof(entry_path), "%s/%s", search_dir, entry->d_name);
-
-        struct stat st;
-        if (stat(entry_path, &st) != 0 || !S_ISDIR(st.st_mode)) {
-            continue;
-        }
-
-        /* If searching all components, handle nested structure */
-        if (!component_name) {
-            /* This is a component directory, recurse into it */
-            checkpoint_entry_t *component_head = NULL;
-            int component_count = checkpoint_list_checkpoints(entry->d_name, persistent, &component_head);
-
-            if (component_count > 0) {
-                /* Append component checkpoints to main list */
-                checkpoint_entry_t *tail = component_head;
-                while (tail->next) {
-                    tail = tail->next;
-                }
-                tail->next = *head;
-                *head = component_head;
-                count += component_count;
-            }
-            continue;
-        }
-
-        /* This is a checkpoint directory */
+    /* The catalog already has them newest first */
+    const char *base_dir = persistent ? CHECKPOINT_VAR_DIR : CHECKPOINT_RUN_DIR;
+    checkpoint_entry_t **tail = head;
+    for (int i = 0; i < count; i++) {
         checkpoint_entry_t *new_entry = malloc(sizeof(checkpoint_entry_t));
         if (!new_entry) {
             LOG_ERR("Failed to allocate memory for checkpoint entry");
-            continue;
+            checkpoint_free_list(*head);
+            *head = NULL;
+            return -1;
         }
 
         memset(new_entry, 0, sizeof(*new_entry));
-        snprintf(new_entry->id, sizeof(new_entry->id), "%s", entry->d_name);
-        snprintf(new_entry->path, sizeof(new_entry->path), "%s", entry_path);
-
-        /* Load metadata if available */
-        if (checkpoint_load_metadata(entry_path, &new_entry->metadata) != 0) {
-            /* If metadata loading fails, populate basic info */
-            strncpy(new_entry->metadata.component_name, component_name,
-                   sizeof(new_entry->metadata.component_name) - 1);
-            new_entry->metadata.timestamp = st.st_mtime;
-        }
-
-        /* Insert in sorted order (newest first) */
-        if (!*head || new_entry->metadata.timestamp > (*head)->metadata.timestamp) {
-            new_entry->next = *head;
-            *head = new_entry;
-        } else {
-            checkpoint_entry_t *current = *head;
-            while (current->next &&
-                   current->next->metadata.timestamp > new_entry->metadata.timestamp) {
-                current = current->next;
-            }
-            new_entry->next = current->next;
-            current->next = new_entry;
-        }
+        snprintf(new_entry->id, sizeof(new_entry->id), "%s", first[i].id);
+        snprintf(new_entry->path, sizeof(new_entry->path), "%s/%s/%s",
+                 base_dir, first[i].component, first[i].id);
+        new_entry->metadata = first[i].metadata;
+        new_entry->size = first[i].size;
 
-        count++;
+        *tail = new_entry;
+        tail = &new_entry->next;
     }
 
-    closedir(dir);
-
     LOG_INFO("Found %d checkpoints for component %s", count,
              component_name ? component_name : "(all)");
     return count;
@@ -416,9 +437,16 @@ int checkpoint_cleanup(const char *component_name, int keep_count,
     int removed_count = 0;
 
     checkpoint_entry_t *current = head;
+    const char *component = NULL;
     int position = 0;
 
     while (current) {
+        /* Entries come grouped by component; each keeps its own newest */
+        if (!component || strcmp(component, current->metadata.component_name) != 0) {
+            component = current->metadata.component_name;
+            position = 0;
+        }
+
         int should_remove = 0;
 
         /* Remove if too old */
@@ -434,7 +462,7 @@ int checkpoint_cleanup(const char *component_name, int keep_count,
         }
 
         if (should_remove) {
-            if (remove_directory_recursive(current->path) == 0) {
+            if (checkpoint_remove_directory(current->path) == 0) {
                 removed_count++;
                 LOG_INFO("Removed old checkpoint %s", current->path);
             } else {
@@ -464,7 +492,7 @@ int checkpoint_remove(const char *component_name, const char *checkpoint_id,
     snprintf(checkpoint_path, sizeof(checkpoint_path), "%s/%s/%s",
             base_dir, component_name, checkpoint_id);
 
-    if (remove_directory_recursive(checkpoint_path) != 0) {
+    if (checkpoint_remove_directory(checkpoint_path) != 0) {
         LOG_ERR("Failed to remove checkpoint %s: %s", checkpoint_path, strerror(errno));
         return -1;
     }
@@ -495,8 +523,7 @@ int checkpoint_storage_usage(const char *component_name, int persistent,
 
     checkpoint_entry_t *current = head;
     while (current) {
-        size_t checkpoint_size = calculate_directory_size(current->path);
-        quota->used_bytes += checkpoint_size;
+        quota->used_bytes += current->size;
         current = current->next;
     }
 
@@ -517,26 +544,32 @@ int checkpoint_find_latest(const char *component_name, int persistent,
         return -1;
     }
 
-    checkpoint_entry_t *head = NULL;
-    int count = checkpoint_list_checkpoints(component_name, persistent, &head);
-
-    if (count <= 0) {
-        checkpoint_free_list(head);
-        return -1; /* No checkpoints found */
-    }
+    const char *base_dir = persistent ? CHECKPOINT_VAR_DIR : CHECKPOINT_RUN_DIR;
+    const checkpoint_catalog_entry_t *first = NULL;
 
-    /* List is sorted newest first, so head is the latest */
-    strncpy(latest_id, head->id, id_size - 1);
-    latest_id[id_size - 1] = '\0';
+    while (checkpoint_catalog_find(persistent, component_name, &first) > 0) {
+        /* Catalog entries are newest first */
+        snprintf(path, path_size, "%s/%s/%s", base_dir, first->component, first->id);
 
-    strncpy(path, head->path, path_size - 1);
-    path[path_size - 1] = '\0';
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            snprintf(latest_id, id_size, "%s", first->id);
+            LOG_INFO("Found latest checkpoint %s at %s for component %s",
+                     latest_id, path, component_name);
+            return 0;
+        }
 
-    checkpoint_free_list(head);
+        /* Removed behind the catalog's back */
+        LOG_WARN("Checkpoint %s is gone, dropping it from the catalog", path);
+        char id[MAX_CHECKPOINT_ID];
+        snprintf(id, sizeof(id), "%s", first->id);
+        if (checkpoint_catalog_drop(persistent, component_name, id) != 0) {
+            break;
+        }
+    }
 
-    LOG_INFO("Found latest checkpoint %s at %s for component %s",
-             latest_id, path, component_name);
-    return 0;
+    path[0] = '\0';
+    return -1; /* No checkpoints found */
 }
 
 /* Migrate checkpoint to persistent storage */
@@ -560,16 +593,21 @@ int checkpoint_migrate_to_persistent(const char *component_name,
         return -1;
     }
 
-    /* Use system cp command for recursive copy */
-    char cmd[2048];
-    snprintf(cmd, sizeof(cmd), "cp -r '%s' '%s'", src_path, dst_path);
-
-    int result = system(cmd);
-    if (result != 0) {
+    /* Page images are streamed into the chunk store, so only what no
+     * earlier checkpoint already holds is written */
+    if (checkpoint_store_copy(src_path, dst_path) != 0) {
         LOG_ERR("Failed to migrate checkpoint %s to persistent storage", checkpoint_id);
         return -1;
     }
 
+    checkpoint_metadata_t metadata;
+    if (checkpoint_load_metadata(dst_path, &metadata) != 0) {
+        memset(&metadata, 0, sizeof(metadata));
+        snprintf(metadata.component_name, sizeof(metadata.component_name), "%s", component_name);
+        metadata.timestamp = time(NULL);
+    }
+    catalog_record(dst_path, &metadata);
+
     LOG_INFO("Migrated checkpoint %s for component %s to persistent storage",
              checkpoint_id, component_name);
     return 0;
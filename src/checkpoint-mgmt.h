@@ -14,7 +14,12 @@
  *   └── ...
  *
  *   /var/lib/graph/checkpoints/<component>/  # Long-term storage
- *   └── (same structure as /run)
+ *   └── (same structure as /run, page images packed into the chunk
+ *        store, see checkpoint-store.h)
+ *
+ * Each storage directory also holds a .catalog of the checkpoints in it
+ * (see checkpoint-catalog.h), kept up to date by the functions here and
+ * used to list them without reading the directories.
  */
 
 #ifndef CHECKPOINT_MGMT_H
@@ -51,6 +56,7 @@ typedef struct checkpoint_entry {
     char id[CHECKPOINT_ID_MAX_LEN];     /* Checkpoint ID (timestamp) */
     char path[MAX_CHECKPOINT_PATH];      /* Full path to checkpoint directory */
     checkpoint_metadata_t metadata;      /* Checkpoint metadata */
+    size_t size;                         /* Storage used, as last recorded */
     struct checkpoint_entry *next;       /* Linked list pointer */
 } checkpoint_entry_t;
 
@@ -64,6 +70,11 @@ typedef struct checkpoint_entry {
  * - Timestamp and original PID
  * - CRIU version and configuration
  * - Size information
+ * - The pre-dumps an iterative checkpoint builds on
+ *
+ * A checkpoint in one of the storage directories is recorded in its
+ * catalog along with the space it takes up now, so save the metadata
+ * once the images are final.
  *
  * Returns: 0 on success, negative error code on failure
  */
@@ -81,6 +92,14 @@ int checkpoint_save_metadata(const char *image_dir, const checkpoint_metadata_t
  */
 int checkpoint_load_metadata(const char *image_dir, checkpoint_metadata_t *metadata);
 
+/* Record in metadata that its image builds on passes pre-dumps
+ *
+ * Fills pre_dump_passes and parent_chain, the pre-dump directories
+ * relative to the image directory from the final dump's parent back to
+ * the first pass, comma separated.
+ */
+void checkpoint_metadata_set_chain(checkpoint_metadata_t *metadata, int passes);
+
 /* Create a new checkpoint directory with unique ID
  *
  * component_name: Name of component being checkpointed
@@ -108,7 +127,9 @@ int checkpoint_create_directory(const char *component_name, int persistent,
  * head: Pointer to store head of linked list
  *
  * Returns a linked list of checkpoint entries sorted by timestamp
- * (newest first). Caller must free the list using checkpoint_free_list().
+ * (newest first), grouped by component when listing all of them. The list
+ * comes from the catalog; no checkpoint directory is read. Caller must
+ * free the list using checkpoint_free_list().
  *
  * Returns: Number of checkpoints found, negative error code on failure
  */
@@ -130,9 +151,11 @@ void checkpoint_free_list(checkpoint_entry_t *head);
  *
  * Cleanup policy:
  * 1. Remove checkpoints older than max_age_hours
- * 2. Keep only the newest keep_count checkpoints
+ * 2. Keep only the newest keep_count checkpoints of each component
  * 3. Ensure total storage stays under quota
  *
+ * Chunks shared with checkpoints that are kept stay in the store.
+ *
  * Returns: Number of checkpoints removed, negative error code on failure
  */
 int checkpoint_cleanup(const char *component_name, int keep_count,
@@ -144,7 +167,8 @@ int checkpoint_cleanup(const char *component_name, int keep_count,
  * checkpoint_id: ID of checkpoint to remove
  * persistent: Remove from persistent storage if true, temporary if false
  *
- * Completely removes the checkpoint directory and all its contents.
+ * Completely removes the checkpoint directory and all its contents,
+ * releasing its chunks in the store.
  *
  * Returns: 0 on success, negative error code on failure
  */
@@ -158,7 +182,8 @@ int checkpoint_remove(const char *component_name, const char *checkpoint_id,
  * quota: Structure to populate with usage information
  *
  * Calculates:
- * - Total storage used by checkpoints
+ * - Total storage used by checkpoints, with each its share of the chunks
+ *   it references in the store, as recorded in the catalog
  * - Number of checkpoints
  * - Storage quota (from configuration or default)
  *
@@ -176,7 +201,8 @@ int checkpoint_storage_usage(const char *component_name, int persistent,
  * path: Buffer to store full path to checkpoint directory
  * path_size: Size of path buffer
  *
- * Finds the most recent checkpoint based on timestamp.
+ * Finds the most recent checkpoint based on timestamp. A catalog entry
+ * whose directory has gone is dropped and the next one tried.
  *
  * Returns: 0 on success, negative error code on failure
  */
@@ -189,9 +215,9 @@ int checkpoint_find_latest(const char *component_name, int persistent,
  * component_name: Component name
  * checkpoint_id: ID of checkpoint to migrate
  *
- * Moves checkpoint from /run/graph/checkpoints to /var/lib/graph/checkpoints
- * for long-term storage. Useful for creating permanent backups before
- * system upgrades.
+ * Copies checkpoint from /run/graph/checkpoints to /var/lib/graph/checkpoints
+ * for long-term storage, streaming its page images into the chunk store.
+ * Useful for creating permanent backups before system upgrades.
  *
  * Returns: 0 on success, negative error code on failure
  */
@@ -241,4 +267,18 @@ int checkpoint_extract_archive(const char *archive_path,
  */
 int checkpoint_init_storage(void);
 
+/* Total size of the files under path, not following symlinks
+ *
+ * For a packed checkpoint this leaves out its chunks; see
+ * checkpoint_store_share().
+ */
+size_t checkpoint_directory_size(const char *path);
+
+/* Remove a checkpoint directory and everything in it, releasing its
+ * references into the chunk store and dropping it from the catalog
+ *
+ * Returns: 0 on success, -1 on failure
+ */
+int checkpoint_remove_directory(const char *path);
+
 #endif /* CHECKPOINT_MGMT_H */
\ No newline at end of file
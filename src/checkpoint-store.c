@@ -0,0 +1,832 @@
+/*
+ * checkpoint-store.c - YakirOS content-addressed checkpoint chunk store
+ *
+ * A chunk file is a chunk_header_t followed by the chunk, compressed
+ * unless that would not make it smaller. A recipe is text:
+ *
+ *   yakiros-chunks 1 <image size>
+ *   <sha256> <chunk size>
+ *   ...
+ *
+ * New chunks and recipes are written to a temporary name and renamed into
+ * place, so a crash leaves either the whole file or none of it.
+ */
+
+#define _GNU_SOURCE
+#include "checkpoint-store.h"
+#include "checkpoint-mgmt.h"
+#include "log.h"
+#include "sha256.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#define CHUNK_MAGIC "YKC1"
+#define RECIPE_MAGIC "yakiros-chunks 1"
+#define HASH_HEX 65                       /* 64 hex digits and a NUL */
+
+typedef struct {
+    char     magic[4];
+    uint32_t refs;                        /* recipe lines naming this chunk */
+    uint32_t raw_len;
+    uint32_t stored_len;                  /* == raw_len: stored uncompressed */
+} chunk_header_t;
+
+static char store_root[MAX_CHECKPOINT_PATH] = CHECKPOINT_STORE_DIR;
+
+void checkpoint_store_set_root(const char *dir) {
+    snprintf(store_root, sizeof(store_root), "%s", dir ? dir : CHECKPOINT_STORE_DIR);
+}
+
+static void sha256_hex(const unsigned char *data, size_t len, char hex[HASH_HEX]) {
+    unsigned char digest[SHA256_DIGEST];
+    sha256_t h;
+    sha256_init(&h);
+    sha256_update(&h, data, len);
+    sha256_final(&h, digest);
+    for (int i = 0; i < SHA256_DIGEST; i++) {
+        snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+    }
+}
+
+/* --- Compression ----------------------------------------------------- */
+
+/* A block is a run of sequences, each a token byte holding a literal
+ * count in the high nibble and a match length less CHUNK_MIN_MATCH in the
+ * low nibble (15 meaning more follow in bytes of up to 255), the literals,
+ * then a two-byte little-endian match offset. The last sequence has
+ * literals only. */
+#define CHUNK_MIN_MATCH 4
+#define CHUNK_HASH_BITS 12
+#define CHUNK_MAX_OFFSET 65535
+
+static uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static int put_length(unsigned char **op, const unsigned char *oend, size_t n) {
+    while (n >= 255) {
+        if (*op >= oend) return -1;
+        *(*op)++ = 255;
+        n -= 255;
+    }
+    if (*op >= oend) return -1;
+    *(*op)++ = (unsigned char)n;
+    return 0;
+}
+
+static int put_sequence(unsigned char **op, const unsigned char *oend,
+                        const unsigned char *lit, size_t n_lit,
+                        size_t offset, size_t match_len) {
+    if (*op >= oend) return -1;
+    unsigned char *token = (*op)++;
+    size_t m = match_len ? match_len - CHUNK_MIN_MATCH : 0;
+    *token = (unsigned char)((n_lit < 15 ? n_lit : 15) << 4 | (m < 15 ? m : 15));
+
+    if (n_lit >= 15 && put_length(op, oend, n_lit - 15) < 0) return -1;
+    if ((size_t)(oend - *op) < n_lit) return -1;
+    memcpy(*op, lit, n_lit);
+    *op += n_lit;
+
+    if (!match_len) return 0;
+    if (oend - *op < 2) return -1;
+    *(*op)++ = (unsigned char)(offset & 0xff);
+    *(*op)++ = (unsigned char)(offset >> 8);
+    if (m >= 15 && put_length(op, oend, m - 15) < 0) return -1;
+    return 0;
+}
+
+size_t checkpoint_compress(const unsigned char *src, size_t len,
+                           unsigned char *dst, size_t dst_size) {
+    uint32_t table[1 << CHUNK_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    const unsigned char *ip = src, *anchor = src, *end = src + len;
+    unsigned char *op = dst, *oend = dst + dst_size;
+
+    while (len >= CHUNK_MIN_MATCH && ip + CHUNK_MIN_MATCH <= end) {
+        uint32_t seq = read32(ip);
+        uint32_t slot = (seq * 2654435761u) >> (32 - CHUNK_HASH_BITS);
+        const unsigned char *ref = src + table[slot];
+        table[slot] = (uint32_t)(ip - src);
+
+        if (ref >= ip || ip - ref > CHUNK_MAX_OFFSET || read32(ref) != seq) {
+            ip++;
+            continue;
+        }
+
+        size_t match = CHUNK_MIN_MATCH;
+        while (ip + match < end && ref[match] == ip[match]) match++;
+
+        if (put_sequence(&op, oend, anchor, (size_t)(ip - anchor),
+                         (size_t)(ip - ref), match) < 0) {
+            return 0;
+        }
+        ip += match;
+        anchor = ip;
+    }
+
+    if (put_sequence(&op, oend, anchor, (size_t)(end - anchor), 0, 0) < 0) {
+        return 0;
+    }
+    return (size_t)(op - dst);
+}
+
+static int get_length(const unsigned char **ip, const unsigned char *iend, size_t *n) {
+    unsigned char b;
+    do {
+        if (*ip >= iend) return -1;
+        b = *(*ip)++;
+        *n += b;
+    } while (b == 255);
+    return 0;
+}
+
+size_t checkpoint_decompress(const unsigned char *src, size_t len,
+                             unsigned char *dst, size_t dst_size) {
+    const unsigned char *ip = src, *iend = src + len;
+    unsigned char *op = dst, *oend = dst + dst_size;
+
+    while (ip < iend) {
+        unsigned char token = *ip++;
+
+        size_t n_lit = token >> 4;
+        if (n_lit == 15 && get_length(&ip, iend, &n_lit) < 0) return 0;
+        if ((size_t)(iend - ip) < n_lit || (size_t)(oend - op) < n_lit) return 0;
+        memcpy(op, ip, n_lit);
+        ip += n_lit;
+        op += n_lit;
+
+        if (ip == iend) break;        /* last sequence: literals only */
+
+        if (iend - ip < 2) return 0;
+        size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        size_t match = (token & 15);
+        if (match == 15 && get_length(&ip, iend, &match) < 0) return 0;
+        match += CHUNK_MIN_MATCH;
+
+        if (offset == 0 || offset > (size_t)(op - dst) || (size_t)(oend - op) < match) {
+            return 0;
+        }
+        /* Byte by byte: a match may overlap what it is copying */
+        const unsigned char *ref = op - offset;
+        for (size_t i = 0; i < match; i++) {
+            op[i] = ref[i];
+        }
+        op += match;
+    }
+    return (size_t)(op - dst);
+}
+
+/* --- Chunks ---------------------------------------------------------- */
+
+static int chunk_path(const char *hex, char *path, size_t size) {
+    int n = snprintf(path, size, "%s/%.2s/%s", store_root, hex, hex);
+    return n < 0 || (size_t)n >= size ? -1 : 0;
+}
+
+static int make_dirs(const char *path) {
+    char tmp[MAX_CHECKPOINT_PATH];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = tmp + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(tmp, 0755) != 0 && errno != EEXIST) return -1;
+            *p = '/';
+        }
+    }
+    return mkdir(tmp, 0755) != 0 && errno != EEXIST ? -1 : 0;
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Read up to len bytes, short only at end of file */
+static ssize_t read_full(int fd, void *buf, size_t len) {
+    char *p = buf;
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = read(fd, p + got, len - got);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        got += (size_t)n;
+    }
+    return (ssize_t)got;
+}
+
+static int header_read(int fd, chunk_header_t *h) {
+    if (pread(fd, h, sizeof(*h), 0) != (ssize_t)sizeof(*h) ||
+        memcmp(h->magic, CHUNK_MAGIC, 4) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/* Take another reference on a stored chunk; fails with ENOENT if there
+ * is no such chunk */
+static int chunk_ref(const char *hex) {
+    char path[MAX_CHECKPOINT_PATH];
+    if (chunk_path(hex, path, sizeof(path)) < 0) return -1;
+
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) LOG_ERR("chunk store: cannot open %s: %s", path, strerror(errno));
+        return -1;
+    }
+    chunk_header_t h;
+    int r = header_read(fd, &h);
+    if (r == 0) {
+        h.refs++;
+        r = pwrite(fd, &h.refs, sizeof(h.refs), offsetof(chunk_header_t, refs)) ==
+            (ssize_t)sizeof(h.refs) ? 0 : -1;
+    }
+    int saved = errno;
+    close(fd);
+    if (r < 0) {
+        LOG_ERR("chunk store: cannot reference %s: %s", path, strerror(saved));
+        errno = saved == ENOENT ? EIO : saved;
+    }
+    return r;
+}
+
+/* Take a reference on the chunk holding data, storing it if it is new */
+static int chunk_acquire(const unsigned char *data, size_t len, char hex[HASH_HEX]) {
+    sha256_hex(data, len, hex);
+
+    char path[MAX_CHECKPOINT_PATH];
+    if (chunk_path(hex, path, sizeof(path)) < 0) return -1;
+
+    int r = chunk_ref(hex);
+    if (r == 0 || errno != ENOENT) {
+        return r;
+    }
+
+    char dir[MAX_CHECKPOINT_PATH];
+    snprintf(dir, sizeof(dir), "%s", path);
+    *strrchr(dir, '/') = '\0';
+    int fd;
+    if (make_dirs(dir) < 0) {
+        LOG_ERR("chunk store: cannot create %s: %s", dir, strerror(errno));
+        return -1;
+    }
+
+    unsigned char *packed = malloc(len);
+    size_t stored = packed && len > 0 ? checkpoint_compress(data, len, packed, len - 1) : 0;
+
+    chunk_header_t h;
+    memcpy(h.magic, CHUNK_MAGIC, 4);
+    h.refs = 1;
+    h.raw_len = (uint32_t)len;
+    h.stored_len = stored ? (uint32_t)stored : (uint32_t)len;
+
+    char tmp[MAX_CHECKPOINT_PATH + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    r = fd < 0 || write_all(fd, &h, sizeof(h)) < 0 ||
+            write_all(fd, stored ? packed : data, h.stored_len) < 0 ? -1 : 0;
+    if (fd >= 0 && close(fd) < 0) r = -1;
+    if (r == 0 && rename(tmp, path) < 0) r = -1;
+    if (r < 0) {
+        LOG_ERR("chunk store: cannot write %s: %s", path, strerror(errno));
+        unlink(tmp);
+    }
+    free(packed);
+    return r;
+}
+
+/* Drop a reference, deleting the chunk with the last one */
+static int chunk_release(const char *hex) {
+    char path[MAX_CHECKPOINT_PATH];
+    if (chunk_path(hex, path, sizeof(path)) < 0) return -1;
+
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        LOG_WARN("chunk store: %s already gone", path);
+        return errno == ENOENT ? 0 : -1;
+    }
+    chunk_header_t h;
+    int r = header_read(fd, &h);
+    if (r == 0 && h.refs > 1) {
+        h.refs--;
+        r = pwrite(fd, &h.refs, sizeof(h.refs), offsetof(chunk_header_t, refs)) ==
+            (ssize_t)sizeof(h.refs) ? 0 : -1;
+    } else if (r == 0) {
+        r = unlink(path);
+    }
+    close(fd);
+    if (r < 0) LOG_ERR("chunk store: cannot release %s: %s", path, strerror(errno));
+    return r;
+}
+
+/* Read a chunk back into buf, checking it hashes to its name */
+static ssize_t chunk_read(const char *hex, unsigned char *buf, size_t size) {
+    char path[MAX_CHECKPOINT_PATH];
+    if (chunk_path(hex, path, sizeof(path)) < 0) return -1;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOG_ERR("chunk store: missing chunk %s: %s", path, strerror(errno));
+        return -1;
+    }
+    chunk_header_t h;
+    ssize_t got = -1;
+    unsigned char *stored = NULL;
+    if (header_read(fd, &h) == 0 && h.raw_len <= size && h.stored_len <= h.raw_len &&
+        (stored = malloc(h.stored_len ? h.stored_len : 1)) != NULL &&
+        pread(fd, stored, h.stored_len, sizeof(h)) == (ssize_t)h.stored_len) {
+        if (h.stored_len == h.raw_len) {
+            memcpy(buf, stored, h.raw_len);
+            got = h.raw_len;
+        } else if (checkpoint_decompress(stored, h.stored_len, buf, size) == h.raw_len) {
+            got = h.raw_len;
+        }
+    }
+    free(stored);
+    close(fd);
+
+    char check[HASH_HEX];
+    if (got >= 0) {
+        sha256_hex(buf, (size_t)got, check);
+        if (strcmp(check, hex) != 0) got = -1;
+    }
+    if (got < 0) LOG_ERR("chunk store: chunk %s is corrupt", path);
+    return got;
+}
+
+/* --- Recipes --------------------------------------------------------- */
+
+static int has_suffix(const char *name, const char *suffix) {
+    size_t n = strlen(name), s = strlen(suffix);
+    return n >= s && strcmp(name + n - s, suffix) == 0;
+}
+
+static int is_page_image(const char *name) {
+    return strncmp(name, "pages-", 6) == 0 && has_suffix(name, ".img");
+}
+
+static int is_recipe(const char *name) {
+    return strncmp(name, "pages-", 6) == 0 && has_suffix(name, ".img" CHECKPOINT_RECIPE_SUFFIX);
+}
+
+typedef int (*recipe_fn)(const char *hex, size_t len, void *arg);
+
+/* Call fn for every chunk a recipe lists, in order */
+static int recipe_each(const char *recipe, size_t *image_size, recipe_fn fn, void *arg) {
+    FILE *fp = fopen(recipe, "r");
+    if (!fp) {
+        LOG_ERR("chunk store: cannot open recipe %s: %s", recipe, strerror(errno));
+        return -1;
+    }
+
+    char line[128];
+    unsigned long long total = 0;
+    int r = 0;
+    if (!fgets(line, sizeof(line), fp) ||
+        strncmp(line, RECIPE_MAGIC " ", strlen(RECIPE_MAGIC) + 1) != 0 ||
+        sscanf(line + strlen(RECIPE_MAGIC) + 1, "%llu", &total) != 1) {
+        LOG_ERR("chunk store: %s is not a recipe", recipe);
+        r = -1;
+    }
+    while (r == 0 && fgets(line, sizeof(line), fp)) {
+        char hex[HASH_HEX];
+        unsigned long len;
+        if (sscanf(line, "%64s %lu", hex, &len) != 2 || strlen(hex) != HASH_HEX - 1) {
+            LOG_ERR("chunk store: bad line in recipe %s", recipe);
+            r = -1;
+            break;
+        }
+        r = fn(hex, len, arg);
+    }
+    fclose(fp);
+    if (image_size) *image_size = (size_t)total;
+    return r;
+}
+
+/* Hashes taken while packing one image, dropped again if it fails */
+typedef struct {
+    char (*hex)[HASH_HEX];
+    int  n, max;
+} hash_list_t;
+
+static void hash_list_release(hash_list_t *list) {
+    for (int i = 0; i < list->n; i++) {
+        chunk_release(list->hex[i]);
+    }
+    free(list->hex);
+    memset(list, 0, sizeof(*list));
+}
+
+/* Stream src into the store and write its recipe to recipe_path */
+static int pack_file(const char *src, const char *recipe_path) {
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        LOG_ERR("chunk store: cannot open %s: %s", src, strerror(errno));
+        return -1;
+    }
+
+    char tmp[MAX_CHECKPOINT_PATH + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", recipe_path);
+    FILE *out = fopen(tmp, "w");
+    unsigned char *buf = malloc(CHECKPOINT_CHUNK_SIZE);
+    hash_list_t taken = { NULL, 0, 0 };
+    unsigned long long total = 0;
+    int r = out && buf ? 0 : -1;
+
+    /* The size goes first: leave room and fill it in at the end */
+    if (r == 0) fprintf(out, "%s %20llu\n", RECIPE_MAGIC, 0ULL);
+
+    while (r == 0) {
+        ssize_t n = read_full(in, buf, CHECKPOINT_CHUNK_SIZE);
+        if (n <= 0) {
+            r = n < 0 ? -1 : 0;
+            break;
+        }
+        if (taken.n == taken.max) {
+            int new_max = taken.max ? taken.max * 2 : 64;
+            char (*grown)[HASH_HEX] = realloc(taken.hex, (size_t)new_max * HASH_HEX);
+            if (!grown) {
+                r = -1;
+                break;
+            }
+            taken.hex = grown;
+            taken.max = new_max;
+        }
+        if (chunk_acquire(buf, (size_t)n, taken.hex[taken.n]) < 0) {
+            r = -1;
+            break;
+        }
+        fprintf(out, "%s %zd\n", taken.hex[taken.n++], n);
+        total += (unsigned long long)n;
+    }
+
+    if (r == 0) {
+        rewind(out);
+        fprintf(out, "%s %20llu\n", RECIPE_MAGIC, total);
+        if (fflush(out) != 0 || ferror(out)) r = -1;
+    }
+    if (out && fclose(out) != 0) r = -1;
+    if (r == 0 && rename(tmp, recipe_path) < 0) r = -1;
+    close(in);
+    free(buf);
+
+    if (r < 0) {
+        LOG_ERR("chunk store: failed to pack %s: %s", src, strerror(errno));
+        unlink(tmp);
+        hash_list_release(&taken);
+        return -1;
+    }
+    free(taken.hex);
+    return 0;
+}
+
+typedef struct {
+    int            fd;
+    unsigned char *buf;
+} unpack_t;
+
+static int unpack_chunk(const char *hex, size_t len, void *arg) {
+    unpack_t *u = arg;
+    ssize_t got = chunk_read(hex, u->buf, CHECKPOINT_CHUNK_SIZE);
+    if (got < 0 || (size_t)got != len) return -1;
+    return write_all(u->fd, u->buf, (size_t)got);
+}
+
+static int ref_one(const char *hex, size_t len, void *arg) {
+    (void)len;
+    hash_list_t *taken = arg;
+    if (taken->n == taken->max) {
+        int new_max = taken->max ? taken->max * 2 : 64;
+        char (*grown)[HASH_HEX] = realloc(taken->hex, (size_t)new_max * HASH_HEX);
+        if (!grown) return -1;
+        taken->hex = grown;
+        taken->max = new_max;
+    }
+    if (chunk_ref(hex) < 0) return -1;
+    snprintf(taken->hex[taken->n++], HASH_HEX, "%s", hex);
+    return 0;
+}
+
+static int copy_file(const char *src, const char *dst, mode_t mode);
+
+/* Copy an already packed image: the copy takes its own references */
+static int copy_recipe(const char *src, const char *dst) {
+    hash_list_t taken = { NULL, 0, 0 };
+    if (recipe_each(src, NULL, ref_one, &taken) < 0 || copy_file(src, dst, 0644) < 0) {
+        hash_list_release(&taken);
+        unlink(dst);
+        return -1;
+    }
+    free(taken.hex);
+    return 0;
+}
+
+/* Rebuild the image a recipe describes at dst */
+static int unpack_file(const char *recipe, const char *dst) {
+    unpack_t u;
+    u.fd = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    u.buf = malloc(CHECKPOINT_CHUNK_SIZE);
+    size_t expected = 0;
+    int r = u.fd >= 0 && u.buf ? recipe_each(recipe, &expected, unpack_chunk, &u) : -1;
+
+    struct stat st;
+    if (r == 0 && (fstat(u.fd, &st) < 0 || (size_t)st.st_size != expected)) {
+        LOG_ERR("chunk store: %s rebuilt to the wrong size", dst);
+        r = -1;
+    }
+    if (u.fd >= 0 && close(u.fd) < 0) r = -1;
+    free(u.buf);
+    if (r < 0) {
+        LOG_ERR("chunk store: failed to unpack %s", recipe);
+        unlink(dst);
+    }
+    return r;
+}
+
+static int copy_file(const char *src, const char *dst, mode_t mode) {
+    int in = open(src, O_RDONLY | O_CLOEXEC);
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode & 07777);
+    char *buf = malloc(CHECKPOINT_CHUNK_SIZE);
+    int r = in >= 0 && out >= 0 && buf ? 0 : -1;
+
+    while (r == 0) {
+        ssize_t n = read_full(in, buf, CHECKPOINT_CHUNK_SIZE);
+        if (n <= 0) {
+            r = n < 0 ? -1 : 0;
+            break;
+        }
+        r = write_all(out, buf, (size_t)n);
+    }
+    if (in >= 0) close(in);
+    if (out >= 0 && close(out) < 0) r = -1;
+    free(buf);
+    if (r < 0) LOG_ERR("chunk store: failed to copy %s: %s", src, strerror(errno));
+    return r;
+}
+
+/* --- Walking checkpoints --------------------------------------------- */
+
+typedef int (*file_fn)(const char *path, const char *name, void *arg);
+
+/* Call fn for every regular file under dir, not following symlinks;
+ * stops at the first nonzero return and passes it on */
+static int walk_files(const char *dir, file_fn fn, void *arg) {
+    DIR *d = opendir(dir);
+    if (!d) return -1;
+
+    int r = 0;
+    struct dirent *entry;
+    while (r == 0 && (entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        char path[MAX_CHECKPOINT_PATH];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        struct stat st;
+        if (lstat(path, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            r = walk_files(path, fn, arg);
+        } else if (S_ISREG(st.st_mode)) {
+            r = fn(path, entry->d_name, arg);
+        }
+    }
+    closedir(d);
+    return r;
+}
+
+/* Copy the tree at src to dst, packing or unpacking page images */
+static int copy_tree(const char *src, const char *dst, int pack) {
+    DIR *d = opendir(src);
+    if (!d) {
+        LOG_ERR("chunk store: cannot open %s: %s", src, strerror(errno));
+        return -1;
+    }
+    if (make_dirs(dst) < 0) {
+        LOG_ERR("chunk store: cannot create %s: %s", dst, strerror(errno));
+        closedir(d);
+        return -1;
+    }
+
+    int r = 0;
+    struct dirent *entry;
+    while (r == 0 && (entry = readdir(d)) != NULL) {
+        const char *name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+
+        char from[MAX_CHECKPOINT_PATH], to[MAX_CHECKPOINT_PATH];
+        snprintf(from, sizeof(from), "%s/%s", src, name);
+        snprintf(to, sizeof(to), "%s/%s", dst, name);
+
+        struct stat st;
+        if (lstat(from, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            r = copy_tree(from, to, pack);
+        } else if (S_ISLNK(st.st_mode)) {
+            char target[MAX_CHECKPOINT_PATH];
+            ssize_t n = readlink(from, target, sizeof(target) - 1);
+            if (n < 0) {
+                r = -1;
+            } else {
+                target[n] = '\0';
+                r = symlink(target, to);
+            }
+        } else if (!S_ISREG(st.st_mode)) {
+            continue;
+        } else if (pack && is_page_image(name)) {
+            snprintf(to, sizeof(to), "%s/%s" CHECKPOINT_RECIPE_SUFFIX, dst, name);
+            r = pack_file(from, to);
+        } else if (pack && is_recipe(name)) {
+            r = copy_recipe(from, to);
+        } else if (!pack && is_recipe(name)) {
+            to[strlen(to) - strlen(CHECKPOINT_RECIPE_SUFFIX)] = '\0';
+            r = unpack_file(from, to);
+        } else {
+            r = copy_file(from, to, st.st_mode);
+        }
+    }
+    closedir(d);
+    return r;
+}
+
+/* Page images packed by one checkpoint_store_pack() call */
+typedef struct {
+    char (*path)[MAX_CHECKPOINT_PATH];
+    int  n, max;
+} path_list_t;
+
+static int pack_in_place(const char *path, const char *name, void *arg) {
+    if (!is_page_image(name)) return 0;
+
+    path_list_t *done = arg;
+    if (done->n == done->max) {
+        int new_max = done->max ? done->max * 2 : 8;
+        char (*grown)[MAX_CHECKPOINT_PATH] = realloc(done->path, (size_t)new_max * MAX_CHECKPOINT_PATH);
+        if (!grown) return -1;
+        done->path = grown;
+        done->max = new_max;
+    }
+
+    char recipe[MAX_CHECKPOINT_PATH];
+    snprintf(recipe, sizeof(recipe), "%s" CHECKPOINT_RECIPE_SUFFIX, path);
+    if (pack_file(path, recipe) < 0) return -1;
+    snprintf(done->path[done->n++], MAX_CHECKPOINT_PATH, "%s", path);
+    return 0;
+}
+
+static int release_one(const char *hex, size_t len, void *arg) {
+    (void)len;
+    int *failed = arg;
+    if (chunk_release(hex) < 0) *failed = 1;
+    return 0;
+}
+
+/* Release a recipe's chunks and remove it */
+static int release_recipe(const char *path) {
+    int failed = 0;
+    if (recipe_each(path, NULL, release_one, &failed) < 0) failed = 1;
+    unlink(path);
+    return failed ? -1 : 0;
+}
+
+static int release_file(const char *path, const char *name, void *arg) {
+    int *failed = arg;
+    if (is_recipe(name) && release_recipe(path) < 0) *failed = 1;
+    return 0;
+}
+
+int checkpoint_store_pack(const char *image_dir) {
+    if (!image_dir) return -1;
+
+    path_list_t done = { NULL, 0, 0 };
+    int r = walk_files(image_dir, pack_in_place, &done);
+
+    /* Only drop the raw images once all of them are in the store */
+    for (int i = 0; i < done.n; i++) {
+        char recipe[MAX_CHECKPOINT_PATH];
+        snprintf(recipe, sizeof(recipe), "%s" CHECKPOINT_RECIPE_SUFFIX, done.path[i]);
+        if (r == 0) {
+            unlink(done.path[i]);
+        } else {
+            release_recipe(recipe);
+        }
+    }
+    int packed = done.n;
+    free(done.path);
+
+    if (r != 0) {
+        LOG_ERR("chunk store: packing %s failed, left unpacked", image_dir);
+        return -1;
+    }
+    LOG_INFO("chunk store: packed %d page image(s) of %s", packed, image_dir);
+    return packed;
+}
+
+int checkpoint_store_copy(const char *src_dir, const char *dst_dir) {
+    if (!src_dir || !dst_dir) return -1;
+    if (copy_tree(src_dir, dst_dir, 1) < 0) {
+        checkpoint_remove_directory(dst_dir);
+        return -1;
+    }
+    return 0;
+}
+
+int checkpoint_store_unpack(const char *src_dir, const char *dst_dir) {
+    if (!src_dir || !dst_dir) return -1;
+    if (copy_tree(src_dir, dst_dir, 0) < 0) {
+        checkpoint_remove_directory(dst_dir);
+        return -1;
+    }
+    return 0;
+}
+
+static int find_recipe(const char *path, const char *name, void *arg) {
+    (void)path;
+    (void)arg;
+    return is_recipe(name) ? 1 : 0;
+}
+
+int checkpoint_store_is_packed(const char *image_dir) {
+    return image_dir && walk_files(image_dir, find_recipe, NULL) == 1;
+}
+
+int checkpoint_store_release(const char *image_dir) {
+    if (!image_dir) return -1;
+    int failed = 0;
+    walk_files(image_dir, release_file, &failed);
+    return failed ? -1 : 0;
+}
+
+static int add_share(const char *hex, size_t len, void *arg) {
+    (void)len;
+    char path[MAX_CHECKPOINT_PATH];
+    if (chunk_path(hex, path, sizeof(path)) < 0) return 0;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    chunk_header_t h;
+    if (header_read(fd, &h) == 0 && h.refs > 0) {
+        *(size_t *)arg += (sizeof(h) + h.stored_len) / h.refs;
+    }
+    close(fd);
+    return 0;
+}
+
+static int share_file(const char *path, const char *name, void *arg) {
+    if (is_recipe(name)) recipe_each(path, NULL, add_share, arg);
+    return 0;
+}
+
+size_t checkpoint_store_share(const char *image_dir) {
+    size_t share = 0;
+    if (image_dir) walk_files(image_dir, share_file, &share);
+    return share;
+}
+
+static int stat_chunk(const char *path, const char *name, void *arg) {
+    (void)name;
+    checkpoint_store_stats_t *stats = arg;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    chunk_header_t h;
+    if (header_read(fd, &h) == 0) {
+        stats->chunks++;
+        stats->stored_bytes += sizeof(h) + h.stored_len;
+        stats->raw_bytes += h.raw_len;
+        stats->referenced_bytes += (size_t)h.raw_len * h.refs;
+    }
+    close(fd);
+    return 0;
+}
+
+int checkpoint_store_stats(checkpoint_store_stats_t *stats) {
+    if (!stats) return -1;
+    memset(stats, 0, sizeof(*stats));
+    if (walk_files(store_root, stat_chunk, stats) < 0 && errno != ENOENT) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * checkpoint-store.h - YakirOS content-addressed checkpoint chunk store
+ *
+ * Memory page images make up nearly all of a checkpoint, and successive
+ * checkpoints of one service share most of their pages. In persistent
+ * storage each pages-*.img is therefore cut into fixed-size chunks, each
+ * compressed and stored once under its SHA-256:
+ *
+ *   /var/lib/graph/checkpoints/.chunks/
+ *   └── <first two hex digits>/<sha256>   # header + compressed chunk
+ *
+ * and the image is replaced by a recipe, pages-N.img.chunks, listing its
+ * chunks in order. Every chunk header carries a reference count, one per
+ * recipe line naming it: removing a checkpoint releases its references
+ * and a chunk is deleted when nothing refers to it any more.
+ *
+ * The store has a single writer, graph-resolver, so reference counts are
+ * updated without locking.
+ */
+
+#ifndef CHECKPOINT_STORE_H
+#define CHECKPOINT_STORE_H
+
+#include <stddef.h>
+
+/* Default location of the chunk store */
+#define CHECKPOINT_STORE_DIR "/var/lib/graph/checkpoints/.chunks"
+
+/* Page images are cut into chunks of this size; a multiple of the page
+ * size so unchanged pages line up between checkpoints */
+#define CHECKPOINT_CHUNK_SIZE (64 * 1024)
+
+/* Suffix of the recipe replacing a packed page image */
+#define CHECKPOINT_RECIPE_SUFFIX ".chunks"
+
+/* Chunk store statistics */
+typedef struct {
+    int    chunks;                /* Distinct chunks stored */
+    size_t stored_bytes;          /* Their size on disk, headers included */
+    size_t raw_bytes;             /* Their size uncompressed */
+    size_t referenced_bytes;      /* Uncompressed size of all references */
+} checkpoint_store_stats_t;
+
+/* Use dir for the chunk store instead of CHECKPOINT_STORE_DIR
+ *
+ * dir: Store directory, created on first use (NULL restores the default)
+ */
+void checkpoint_store_set_root(const char *dir);
+
+/* Pack the page images of a checkpoint in place
+ *
+ * image_dir: Checkpoint directory, including pre-dump subdirectories
+ *
+ * Each pages-*.img is streamed into the store and replaced by its
+ * recipe. Images already packed are left alone.
+ *
+ * Returns: Number of images packed, negative on failure (the checkpoint
+ * is left as it was)
+ */
+int checkpoint_store_pack(const char *image_dir);
+
+/* Copy a checkpoint, packing its page images on the way
+ *
+ * src_dir: Checkpoint to copy (raw or packed)
+ * dst_dir: Directory to create the copy in
+ *
+ * Other files are copied as they are, symlinks (CRIU's parent link to a
+ * pre-dump) as symlinks. Chunks already in the store are only referenced
+ * again, never written twice.
+ *
+ * Returns: 0 on success, negative on failure (nothing is left at dst_dir)
+ */
+int checkpoint_store_copy(const char *src_dir, const char *dst_dir);
+
+/* Copy a checkpoint with its page images rebuilt from the store
+ *
+ * src_dir: Packed checkpoint
+ * dst_dir: Directory to create the raw copy in, which CRIU can restore
+ *
+ * Every chunk is checked against its hash as it is read back.
+ *
+ * Returns: 0 on success, negative on failure (nothing is left at dst_dir)
+ */
+int checkpoint_store_unpack(const char *src_dir, const char *dst_dir);
+
+/* Whether a checkpoint has page images packed into the store
+ *
+ * Returns: 1 if it has, 0 if not
+ */
+int checkpoint_store_is_packed(const char *image_dir);
+
+/* Drop the references a checkpoint's recipes hold
+ *
+ * image_dir: Checkpoint about to be removed
+ *
+ * Chunks nothing else refers to are deleted. The recipes themselves are
+ * removed with the checkpoint.
+ *
+ * Returns: 0 on success, negative if some reference could not be dropped
+ */
+int checkpoint_store_release(const char *image_dir);
+
+/* This checkpoint's share of the store, in bytes on disk
+ *
+ * Each chunk counts its stored size divided among everything referring
+ * to it, so the shares of all checkpoints add up to the store's size.
+ */
+size_t checkpoint_store_share(const char *image_dir);
+
+/* Gather statistics over the whole store
+ *
+ * Returns: 0 on success, negative on failure
+ */
+int checkpoint_store_stats(checkpoint_store_stats_t *stats);
+
+/* Compress len bytes of src into dst, which has room for dst_size
+ *
+ * An LZ77 block format with byte-aligned literal runs and matches, fast
+ * enough to keep up with the disk.
+ *
+ * Returns: Compressed size, or 0 if it would not fit in dst_size
+ */
+size_t checkpoint_compress(const unsigned char *src, size_t len,
+                           unsigned char *dst, size_t dst_size);
+
+/* Decompress a block from checkpoint_compress()
+ *
+ * Returns: Decompressed size, or 0 if the block is corrupt or more than
+ * dst_size bytes long
+ */
+size_t checkpoint_decompress(const unsigned char *src, size_t len,
+                             unsigned char *dst, size_t dst_size);
+
+#endif /* CHECKPOINT_STORE_H */
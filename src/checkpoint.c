@@ -10,7 +10,9 @@
 
 #include "checkpoint.h"
 #include "log.h"
+#include "spawn.h"
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
@@ -55,15 +57,54 @@ static const char *find_criu_binary(void) {
     return NULL;
 }
 
-/* Execute CRIU command with timeout handling */
-int execute_criu_command(char *const argv[], int timeout_sec,
-                        char *output, size_t output_size) {
+/* Spawn CRIU with argv; its stdout and stderr go to out_fd, or
+ * to /dev/null if that is -1. Returns the child's pid or an error code. */
+static pid_t criu_spawn(char *const argv[], int out_fd) {
     const char *criu_binary = find_criu_binary();
     if (!criu_binary) {
         LOG_ERR("CRIU binary not found in standard locations");
         return CHECKPOINT_ERROR_CRIU_NOT_FOUND;
     }
 
+    /* Create new argv with correct binary path */
+    char *exec_argv[32];  /* Reasonable limit for arguments */
+    exec_argv[0] = (char *)criu_binary;
+    int i;
+    for (i = 1; argv[i] != NULL && i < 31; i++) {
+        exec_argv[i] = argv[i];
+    }
+    exec_argv[i] = NULL; /* Ensure null termination */
+
+    /* Its output to out_fd, or /dev/null to avoid noise */
+    spawn_t sp;
+    spawn_init(&sp, "criu", criu_binary, exec_argv);
+    spawn_output(&sp, out_fd >= 0 ? out_fd : SPAWN_DEVNULL);
+
+    pid_t pid = spawn_run(&sp);
+    if (pid < 0) {
+        LOG_ERR("Failed to spawn CRIU: %s", strerror(errno));
+        return CHECKPOINT_ERROR_CRIU_NOT_FOUND;
+    }
+
+    return pid;
+}
+
+int criu_exit_result(int status) {
+    if (WIFEXITED(status)) {
+        int exit_code = WEXITSTATUS(status);
+        if (exit_code == 0) {
+            return CHECKPOINT_SUCCESS;
+        }
+        LOG_ERR("CRIU command failed with exit code %d", exit_code);
+    } else if (WIFSIGNALED(status)) {
+        LOG_ERR("CRIU command killed by signal %d", WTERMSIG(status));
+    }
+    return CHECKPOINT_ERROR_RESTORE_FAILED;
+}
+
+/* Execute CRIU command with timeout handling */
+int execute_criu_command(char *const argv[], int timeout_sec,
+                        char *output, size_t output_size) {
     /* Create pipe for capturing output */
     int pipefd[2];
     if (output && pipe(pipefd) == -1) {
@@ -71,49 +112,13 @@ int execute_criu_command(char *const argv[], int timeout_sec,
         return CHECKPOINT_ERROR_CRIU_NOT_FOUND;
     }
 
-    pid_t pid = fork();
+    pid_t pid = criu_spawn(argv, output ? pipefd[1] : -1);
     if (pid < 0) {
-        LOG_ERR("Failed to fork for CRIU execution: %s", strerror(errno));
         if (output) {
             close(pipefd[0]);
             close(pipefd[1]);
         }
-        return CHECKPOINT_ERROR_CRIU_NOT_FOUND;
-    }
-
-    if (pid == 0) {
-        /* Child process - execute CRIU */
-
-        /* Set up output redirection if requested */
-        if (output) {
-            close(pipefd[0]); /* Close read end */
-            dup2(pipefd[1], STDOUT_FILENO);
-            dup2(pipefd[1], STDERR_FILENO);
-            close(pipefd[1]);
-        } else {
-            /* Redirect to /dev/null to avoid noise */
-            int devnull = open("/dev/null", O_RDWR);
-            if (devnull >= 0) {
-                dup2(devnull, STDOUT_FILENO);
-                dup2(devnull, STDERR_FILENO);
-                close(devnull);
-            }
-        }
-
-        /* Create new argv with correct binary path */
-        char *exec_argv[32];  /* Reasonable limit for arguments */
-        exec_argv[0] = (char *)criu_binary;
-        for (int i = 1; argv[i] != NULL && i < 31; i++) {
-            exec_argv[i] = argv[i];
-        }
-        exec_argv[31] = NULL; /* Ensure null termination */
-
-        /* Execute CRIU */
-        execv(criu_binary, exec_argv);
-
-        /* If we get here, exec failed */
-        fprintf(stderr, "Failed to execute CRIU: %s\n", strerror(errno));
-        _exit(127);
+        return pid;
     }
 
     /* Parent process - wait for completion with timeout */
@@ -140,18 +145,7 @@ int execute_criu_command(char *const argv[], int timeout_sec,
             result = waitpid(pid, &status, WNOHANG);
             if (result == pid) {
                 /* Process completed */
-                if (WIFEXITED(status)) {
-                    int exit_code = WEXITSTATUS(status);
-                    if (exit_code == 0) {
-                        return CHECKPOINT_SUCCESS;
-                    } else {
-                        LOG_ERR("CRIU command failed with exit code %d", exit_code);
-                        return CHECKPOINT_ERROR_RESTORE_FAILED;
-                    }
-                } else if (WIFSIGNALED(status)) {
-                    LOG_ERR("CRIU command killed by signal %d", WTERMSIG(status));
-                    return CHECKPOINT_ERROR_RESTORE_FAILED;
-                }
+                return criu_exit_result(status);
             } else if (result == -1) {
                 LOG_ERR("waitpid failed: %s", strerror(errno));
                 return CHECKPOINT_ERROR_RESTORE_FAILED;
@@ -173,22 +167,8 @@ int execute_criu_command(char *const argv[], int timeout_sec,
             LOG_ERR("waitpid failed: %s", strerror(errno));
             return CHECKPOINT_ERROR_RESTORE_FAILED;
         }
-
-        if (WIFEXITED(status)) {
-            int exit_code = WEXITSTATUS(status);
-            if (exit_code == 0) {
-                return CHECKPOINT_SUCCESS;
-            } else {
-                LOG_ERR("CRIU command failed with exit code %d", exit_code);
-                return CHECKPOINT_ERROR_RESTORE_FAILED;
-            }
-        } else if (WIFSIGNALED(status)) {
-            LOG_ERR("CRIU command killed by signal %d", WTERMSIG(status));
-            return CHECKPOINT_ERROR_RESTORE_FAILED;
-        }
+        return criu_exit_result(status);
     }
-
-    return CHECKPOINT_ERROR_RESTORE_FAILED;
 }
 
 /* Check if CRIU is supported on this system */
@@ -252,8 +232,13 @@ int criu_get_version(criu_version_t *version) {
     return CHECKPOINT_ERROR_RESTORE_FAILED;
 }
 
-/* Checkpoint a running process */
-int criu_checkpoint_process(pid_t pid, const char *image_dir, int leave_running) {
+/* Checks and CRIU arguments shared by every dump and pre-dump. A dump
+ * on top of earlier pre-dumps names the newest of them, relative to
+ * image_dir, as prev_images_dir (NULL for a full dump); argv must have
+ * room for 20 entries. */
+static int checkpoint_prepare(pid_t pid, const char *image_dir, int pre_dump,
+                              int leave_running, const char *prev_images_dir,
+                              char *pid_str, size_t pid_str_size, char **argv) {
     if (pid <= 0 || !image_dir) {
         return CHECKPOINT_ERROR_PROCESS_NOT_FOUND;
     }
@@ -277,14 +262,12 @@ int criu_checkpoint_process(pid_t pid, const char *image_dir, int leave_running)
     }
 
     /* Build CRIU dump command */
-    char pid_str[32];
-    snprintf(pid_str, sizeof(pid_str), "%d", pid);
+    snprintf(pid_str, pid_str_size, "%d", pid);
 
-    char *argv[16];
     int argc = 0;
 
     argv[argc++] = "criu";
-    argv[argc++] = "dump";
+    argv[argc++] = pre_dump ? "pre-dump" : "dump";
     argv[argc++] = "-t";
     argv[argc++] = pid_str;
     argv[argc++] = "-D";
@@ -292,33 +275,274 @@ int criu_checkpoint_process(pid_t pid, const char *image_dir, int leave_running)
     argv[argc++] = "--shell-job";  /* Allow dumping processes with shell job control */
     argv[argc++] = "-v4";          /* Verbose logging for debugging */
 
-    if (leave_running) {
+    /* Pre-dumps reset the soft-dirty bits so the next pass, and the final
+     * dump, only write pages touched since */
+    if (pre_dump || prev_images_dir) {
+        argv[argc++] = "--track-mem";
+    }
+    if (prev_images_dir) {
+        argv[argc++] = "--prev-images-dir";
+        argv[argc++] = (char *)prev_images_dir;
+    }
+
+    /* A pre-dump never stops the process */
+    if (leave_running && !pre_dump) {
         argv[argc++] = "--leave-running";
     }
 
     argv[argc] = NULL;
+    return CHECKPOINT_SUCCESS;
+}
 
-    LOG_INFO("Checkpointing process %d to %s (leave_running=%d)",
-             pid, image_dir, leave_running);
-
+/* Run a prepared dump or pre-dump to completion */
+static int checkpoint_run(char **argv, pid_t pid, const char *image_dir) {
     char output[2048];
     int result = execute_criu_command(argv, CHECKPOINT_DEFAULT_TIMEOUT,
-                                     output, sizeof(output));
+                                      output, sizeof(output));
 
     if (result != CHECKPOINT_SUCCESS) {
-        LOG_ERR("CRIU checkpoint failed for process %d", pid);
+        LOG_ERR("CRIU %s failed for process %d", argv[1], pid);
         if (output[0] != '\0') {
             LOG_ERR("CRIU output: %s", output);
         }
         return result;
     }
 
-    LOG_INFO("Successfully checkpointed process %d to %s", pid, image_dir);
+    LOG_INFO("Successfully %s process %d to %s",
+             strcmp(argv[1], "dump") == 0 ? "checkpointed" : "pre-dumped", pid, image_dir);
     return CHECKPOINT_SUCCESS;
 }
 
-/* Restore a process from checkpoint images */
-pid_t criu_restore_process(const char *image_dir) {
+/* Checkpoint a running process */
+int criu_checkpoint_process(pid_t pid, const char *image_dir, int leave_running) {
+    char pid_str[32];
+    char *argv[20];
+    int result = checkpoint_prepare(pid, image_dir, 0, leave_running, NULL,
+                                    pid_str, sizeof(pid_str), argv);
+    if (result != CHECKPOINT_SUCCESS) {
+        return result;
+    }
+
+    LOG_INFO("Checkpointing process %d to %s (leave_running=%d)",
+             pid, image_dir, leave_running);
+    return checkpoint_run(argv, pid, image_dir);
+}
+
+/* Copy the running process's memory while it keeps going */
+int criu_pre_dump_process(pid_t pid, const char *image_dir, const char *prev_images_dir) {
+    char pid_str[32];
+    char *argv[20];
+    int result = checkpoint_prepare(pid, image_dir, 1, 1, prev_images_dir,
+                                    pid_str, sizeof(pid_str), argv);
+    if (result != CHECKPOINT_SUCCESS) {
+        return result;
+    }
+
+    LOG_INFO("Pre-dumping process %d to %s", pid, image_dir);
+    return checkpoint_run(argv, pid, image_dir);
+}
+
+/* Append "-o log" so CRIU keeps its log in the image directory: nobody
+ * reads its output while it runs in the background */
+static void checkpoint_log_to(char **argv, const char *log) {
+    int argc = 0;
+    while (argv[argc]) argc++;
+    argv[argc++] = "-o";
+    argv[argc++] = (char *)log;
+    argv[argc] = NULL;
+}
+
+/* Start checkpointing a process without waiting for CRIU */
+pid_t criu_checkpoint_start(pid_t pid, const char *image_dir, int leave_running,
+                            const char *prev_images_dir) {
+    char pid_str[32];
+    char *argv[20];
+    int result = checkpoint_prepare(pid, image_dir, 0, leave_running, prev_images_dir,
+                                    pid_str, sizeof(pid_str), argv);
+    if (result != CHECKPOINT_SUCCESS) {
+        return result;
+    }
+    checkpoint_log_to(argv, CHECKPOINT_DUMP_LOG);
+
+    LOG_INFO("Checkpointing process %d to %s in the background (leave_running=%d%s%s)",
+             pid, image_dir, leave_running,
+             prev_images_dir ? ", on top of " : "", prev_images_dir ? prev_images_dir : "");
+    return criu_spawn(argv, -1);
+}
+
+/* Start a pre-dump without waiting for CRIU */
+pid_t criu_pre_dump_start(pid_t pid, const char *image_dir, const char *prev_images_dir) {
+    char pid_str[32];
+    char *argv[20];
+    int result = checkpoint_prepare(pid, image_dir, 1, 1, prev_images_dir,
+                                    pid_str, sizeof(pid_str), argv);
+    if (result != CHECKPOINT_SUCCESS) {
+        return result;
+    }
+    checkpoint_log_to(argv, CHECKPOINT_PRE_DUMP_LOG);
+
+    LOG_INFO("Pre-dumping process %d to %s in the background", pid, image_dir);
+    return criu_spawn(argv, -1);
+}
+
+/* Append "--page-server --address address --port port": CRIU sends the
+ * pages to a page server there instead of writing them to image_dir */
+static void checkpoint_pages_to(char **argv, const char *address, char *port_str,
+                                size_t port_str_size, int port) {
+    int argc = 0;
+    while (argv[argc]) argc++;
+    snprintf(port_str, port_str_size, "%d", port);
+    argv[argc++] = "--page-server";
+    argv[argc++] = "--address";
+    argv[argc++] = (char *)address;
+    argv[argc++] = "--port";
+    argv[argc++] = port_str;
+    argv[argc] = NULL;
+}
+
+/* Pre-dump pid with its pages going to another node */
+int criu_pre_dump_remote(pid_t pid, const char *image_dir, const char *prev_images_dir,
+                         const char *address, int port) {
+    char pid_str[32], port_str[16];
+    char *argv[20];
+    if (!address || port <= 0 || port > 65535) {
+        return CHECKPOINT_ERROR_RESTORE_FAILED;
+    }
+    int result = checkpoint_prepare(pid, image_dir, 1, 1, prev_images_dir,
+                                    pid_str, sizeof(pid_str), argv);
+    if (result != CHECKPOINT_SUCCESS) {
+        return result;
+    }
+    checkpoint_pages_to(argv, address, port_str, sizeof(port_str), port);
+
+    LOG_INFO("Pre-dumping process %d to %s, pages to %s:%d", pid, image_dir, address, port);
+    return checkpoint_run(argv, pid, image_dir);
+}
+
+/* Dump pid with its pages going to another node; it does not go on here */
+int criu_checkpoint_remote(pid_t pid, const char *image_dir, const char *prev_images_dir,
+                           const char *address, int port) {
+    char pid_str[32], port_str[16];
+    char *argv[20];
+    if (!address || port <= 0 || port > 65535) {
+        return CHECKPOINT_ERROR_RESTORE_FAILED;
+    }
+    int result = checkpoint_prepare(pid, image_dir, 0, 0, prev_images_dir,
+                                    pid_str, sizeof(pid_str), argv);
+    if (result != CHECKPOINT_SUCCESS) {
+        return result;
+    }
+    checkpoint_pages_to(argv, address, port_str, sizeof(port_str), port);
+
+    LOG_INFO("Checkpointing process %d to %s, pages to %s:%d%s%s", pid, image_dir,
+             address, port, prev_images_dir ? ", on top of " : "",
+             prev_images_dir ? prev_images_dir : "");
+    return checkpoint_run(argv, pid, image_dir);
+}
+
+/* Bytes of memory pages a dump or pre-dump wrote into image_dir */
+size_t checkpoint_pages_size(const char *image_dir) {
+    DIR *dir = image_dir ? opendir(image_dir) : NULL;
+    if (!dir) {
+        return 0;
+    }
+
+    size_t total = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "pages-", 6) != 0) {
+            continue;
+        }
+        struct stat st;
+        if (fstatat(dirfd(dir), entry->d_name, &st, 0) == 0 && S_ISREG(st.st_mode)) {
+            total += (size_t)st.st_size;
+        }
+    }
+    closedir(dir);
+    return total;
+}
+
+/* Whether another pre-dump pass is worth it after one that wrote
+ * current bytes, where the pass before wrote previous (0 if none) */
+int checkpoint_pre_dump_again(int passes, int max_passes, size_t previous, size_t current) {
+    if (passes >= max_passes || current <= CHECKPOINT_PRE_DUMP_SETTLED) {
+        return 0;
+    }
+    /* Dirtied about as fast as we copy: the final dump will not get
+     * any shorter */
+    return previous == 0 || current < previous - previous / 4;
+}
+
+void checkpoint_pre_dump_dir(int pass, char *buf, size_t size) {
+    snprintf(buf, size, CHECKPOINT_PRE_DUMP_DIR, pass);
+}
+
+/* Pre-dump pid until its dirty set settles, then dump the rest */
+int criu_checkpoint_iterative(pid_t pid, const char *image_dir, int leave_running,
+                              int max_passes, int *passes) {
+    if (passes) {
+        *passes = 0;
+    }
+    if (pid <= 0 || !image_dir) {
+        return CHECKPOINT_ERROR_PROCESS_NOT_FOUND;
+    }
+    if (mkdir(image_dir, 0755) != 0 && errno != EEXIST) {
+        LOG_ERR("Failed to create checkpoint directory %s: %s",
+                image_dir, strerror(errno));
+        return CHECKPOINT_ERROR_RESTORE_FAILED;
+    }
+
+    /* Each pass goes into image_dir/pre-N and refers back to pre-N-1 */
+    int done = 0;
+    size_t previous = 0;
+    while (done < max_passes) {
+        char name[32], dir[MAX_CHECKPOINT_PATH], prev[40];
+        checkpoint_pre_dump_dir(done + 1, name, sizeof(name));
+        snprintf(dir, sizeof(dir), "%s/%s", image_dir, name);
+        if (done > 0) {
+            char prev_name[32];
+            checkpoint_pre_dump_dir(done, prev_name, sizeof(prev_name));
+            snprintf(prev, sizeof(prev), "../%s", prev_name);
+        }
+
+        if (criu_pre_dump_process(pid, dir, done > 0 ? prev : NULL) != CHECKPOINT_SUCCESS) {
+            LOG_WARN("Pre-dump %d of process %d failed, dumping on top of %d pass(es)",
+                     done + 1, pid, done);
+            break;
+        }
+        done++;
+
+        size_t current = checkpoint_pages_size(dir);
+        LOG_INFO("Pre-dump %d of process %d wrote %zu KB", done, pid, current / 1024);
+        if (!checkpoint_pre_dump_again(done, max_passes, previous, current)) {
+            break;
+        }
+        previous = current;
+    }
+
+    char pid_str[32];
+    char *argv[20];
+    char parent[32];
+    checkpoint_pre_dump_dir(done, parent, sizeof(parent));
+    int result = checkpoint_prepare(pid, image_dir, 0, leave_running, done > 0 ? parent : NULL,
+                                    pid_str, sizeof(pid_str), argv);
+    if (result != CHECKPOINT_SUCCESS) {
+        return result;
+    }
+
+    LOG_INFO("Checkpointing process %d to %s after %d pre-dump(s) (leave_running=%d)",
+             pid, image_dir, done, leave_running);
+    result = checkpoint_run(argv, pid, image_dir);
+    if (result == CHECKPOINT_SUCCESS && passes) {
+        *passes = done;
+    }
+    return result;
+}
+
+/* Restoring detaches: CRIU exits once the tree runs again, leaving the
+ * restored root as our child, and writes its pid to CHECKPOINT_RESTORE_PID.
+ * argv must have room for 16 entries. */
+static int restore_prepare(const char *image_dir, int lazy, char **argv) {
     if (!image_dir) {
         return CHECKPOINT_ERROR_RESTORE_FAILED;
     }
@@ -331,21 +555,36 @@ pid_t criu_restore_process(const char *image_dir) {
         return validation_result;
     }
 
-    /* Build CRIU restore command */
-    char *argv[] = {
-        "criu",
-        "restore",
-        "-D", (char *)image_dir,
-        "--shell-job",
-        "-v4",
-        NULL
-    };
+    int argc = 0;
+    argv[argc++] = "criu";
+    argv[argc++] = "restore";
+    argv[argc++] = "-D";
+    argv[argc++] = (char *)image_dir;
+    argv[argc++] = "--shell-job";
+    argv[argc++] = "--restore-detached";
+    argv[argc++] = "--pidfile";
+    argv[argc++] = CHECKPOINT_RESTORE_PID;
+    if (lazy) {
+        argv[argc++] = "--lazy-pages";
+    }
+    argv[argc++] = "-v4";
+    argv[argc] = NULL;
+    return CHECKPOINT_SUCCESS;
+}
+
+/* Run a prepared restore to completion */
+static pid_t restore_run(const char *image_dir, int lazy) {
+    char *argv[16];
+    int result = restore_prepare(image_dir, lazy, argv);
+    if (result != CHECKPOINT_SUCCESS) {
+        return result;
+    }
 
-    LOG_INFO("Restoring process from %s", image_dir);
+    LOG_INFO("Restoring process from %s%s", image_dir, lazy ? " with lazy pages" : "");
 
     char output[2048];
-    int result = execute_criu_command(argv, CHECKPOINT_DEFAULT_TIMEOUT,
-                                     output, sizeof(output));
+    result = execute_criu_command(argv, CHECKPOINT_DEFAULT_TIMEOUT,
+                                  output, sizeof(output));
 
     if (result != CHECKPOINT_SUCCESS) {
         LOG_ERR("CRIU restore failed from %s", image_dir);
@@ -355,23 +594,215 @@ pid_t criu_restore_process(const char *image_dir) {
         return result;
     }
 
-    /* Parse restored PID from output */
-    /* CRIU restore output typically contains a line like "Restored process with PID 12345" */
-    pid_t restored_pid = 0;
-    char *pid_line = strstr(output, "PID");
-    if (pid_line) {
-        if (sscanf(pid_line, "PID %d", &restored_pid) == 1 && restored_pid > 0) {
-            LOG_INFO("Successfully restored process with PID %d from %s",
-                     restored_pid, image_dir);
-            return restored_pid;
-        }
+    pid_t restored_pid = criu_restore_pid(image_dir);
+    if (restored_pid > 0) {
+        LOG_INFO("Successfully restored process with PID %d from %s",
+                 restored_pid, image_dir);
+        return restored_pid;
     }
 
-    /* If we can't parse PID from output, the restore likely failed */
     LOG_ERR("Could not determine restored PID from CRIU output: %s", output);
     return CHECKPOINT_ERROR_RESTORE_FAILED;
 }
 
+/* Restore a process from checkpoint images */
+pid_t criu_restore_process(const char *image_dir) {
+    return restore_run(image_dir, 0);
+}
+
+/* Restore a process, leaving its memory to the lazy-pages daemon */
+pid_t criu_restore_lazy(const char *image_dir) {
+    return restore_run(image_dir, 1);
+}
+
+/* Check for userfaultfd support once */
+int criu_lazy_pages_supported(void) {
+    static int supported = 1;   /* 1 = not asked yet */
+
+    if (supported == 1) {
+        char *argv[] = { "criu", "check", "--feature", "uffd-noncoop", NULL };
+        char output[1024];
+        supported = execute_criu_command(argv, 10, output, sizeof(output)) == CHECKPOINT_SUCCESS ?
+                    CHECKPOINT_SUCCESS : CHECKPOINT_ERROR_KERNEL_UNSUPPORTED;
+        if (supported != CHECKPOINT_SUCCESS) {
+            LOG_INFO("CRIU lazy pages not supported on this system");
+        }
+    }
+    return supported;
+}
+
+/* Start the daemon serving a lazy restore's page faults */
+pid_t criu_lazy_pages_start(const char *image_dir, const char *address, int port) {
+    if (!image_dir) {
+        return CHECKPOINT_ERROR_RESTORE_FAILED;
+    }
+
+    /* A socket left by an earlier daemon would be taken for this one's */
+    char sock[MAX_CHECKPOINT_PATH + 32];
+    snprintf(sock, sizeof(sock), "%s/%s", image_dir, CHECKPOINT_LAZY_PAGES_SOCKET);
+    unlink(sock);
+
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+
+    char *argv[16];
+    int argc = 0;
+    argv[argc++] = "criu";
+    argv[argc++] = "lazy-pages";
+    argv[argc++] = "-D";
+    argv[argc++] = (char *)image_dir;
+    if (address) {
+        argv[argc++] = "--page-server";
+        argv[argc++] = "--address";
+        argv[argc++] = (char *)address;
+        argv[argc++] = "--port";
+        argv[argc++] = port_str;
+    }
+    argv[argc++] = "-o";
+    argv[argc++] = CHECKPOINT_LAZY_PAGES_LOG;
+    argv[argc++] = "-v4";
+    argv[argc] = NULL;
+
+    LOG_INFO("Starting lazy-pages daemon for %s%s%s", image_dir,
+             address ? ", pages from " : "", address ? address : "");
+    pid_t pid = criu_spawn(argv, -1);
+    if (pid < 0) {
+        return pid;
+    }
+
+    /* Restores connect to its socket, so wait for it to appear */
+    for (int waited = 0; waited < CHECKPOINT_DEFAULT_TIMEOUT * 100; waited++) {
+        int status;
+        if (access(sock, F_OK) == 0) {
+            return pid;
+        }
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            LOG_ERR("lazy-pages daemon for %s exited before accepting restores", image_dir);
+            criu_exit_result(status);
+            return CHECKPOINT_ERROR_RESTORE_FAILED;
+        }
+        struct timespec tick = { 0, 10 * 1000 * 1000 };
+        nanosleep(&tick, NULL);
+    }
+
+    LOG_ERR("lazy-pages daemon for %s did not start in time", image_dir);
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return CHECKPOINT_ERROR_TIMEOUT;
+}
+
+/* Serve pages to a lazy restore elsewhere */
+pid_t criu_page_server_start(const char *image_dir, int port) {
+    if (!image_dir || port <= 0 || port > 65535) {
+        return CHECKPOINT_ERROR_RESTORE_FAILED;
+    }
+
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+
+    char *argv[] = { "criu", "page-server", "-D", (char *)image_dir, "--port", port_str,
+                     "--lazy-pages", "-o", CHECKPOINT_PAGE_SERVER_LOG, "-v4", NULL };
+
+    LOG_INFO("Serving pages of %s on port %d", image_dir, port);
+    return criu_spawn(argv, -1);
+}
+
+/* Take the pages of one dump or pre-dump from another node */
+pid_t criu_page_server_receive(const char *image_dir, const char *prev_images_dir, int sock) {
+    if (!image_dir || sock < 0) {
+        return CHECKPOINT_ERROR_RESTORE_FAILED;
+    }
+
+    /* CRIU takes over the connection instead of listening itself */
+    char sock_str[16];
+    snprintf(sock_str, sizeof(sock_str), "%d", sock);
+    int flags = fcntl(sock, F_GETFD);
+    if (flags < 0 || fcntl(sock, F_SETFD, flags & ~FD_CLOEXEC) < 0) {
+        return CHECKPOINT_ERROR_RESTORE_FAILED;
+    }
+
+    char *argv[20];
+    int argc = 0;
+    argv[argc++] = "criu";
+    argv[argc++] = "page-server";
+    argv[argc++] = "-D";
+    argv[argc++] = (char *)image_dir;
+    argv[argc++] = "--ps-socket";
+    argv[argc++] = sock_str;
+    if (prev_images_dir) {
+        argv[argc++] = "--prev-images-dir";
+        argv[argc++] = (char *)prev_images_dir;
+    }
+    /* CRIU forks the server off once it is set up; the dump's pages wait
+     * in the socket meanwhile */
+    argv[argc++] = "--daemon";
+    argv[argc++] = "--pidfile";
+    argv[argc++] = CHECKPOINT_PAGE_SERVER_PID;
+    argv[argc++] = "-o";
+    argv[argc++] = CHECKPOINT_PAGE_SERVER_LOG;
+    argv[argc++] = "-v4";
+    argv[argc] = NULL;
+
+    LOG_INFO("Receiving pages into %s", image_dir);
+    char output[2048];
+    int result = execute_criu_command(argv, CHECKPOINT_DEFAULT_TIMEOUT, output, sizeof(output));
+    fcntl(sock, F_SETFD, flags);
+    if (result != CHECKPOINT_SUCCESS) {
+        LOG_ERR("CRIU page server for %s failed to start", image_dir);
+        if (output[0] != '\0') {
+            LOG_ERR("CRIU output: %s", output);
+        }
+        return result;
+    }
+
+    char path[MAX_CHECKPOINT_PATH + 32];
+    snprintf(path, sizeof(path), "%s/%s", image_dir, CHECKPOINT_PAGE_SERVER_PID);
+    FILE *f = fopen(path, "r");
+    int pid = 0;
+    if (!f || fscanf(f, "%d", &pid) != 1 || pid <= 0) {
+        pid = CHECKPOINT_ERROR_RESTORE_FAILED;
+    }
+    if (f) {
+        fclose(f);
+    }
+    return pid;
+}
+
+/* Start restoring from image_dir without waiting for CRIU */
+pid_t criu_restore_start(const char *image_dir) {
+    char *argv[18];
+    int result = restore_prepare(image_dir, 0, argv);
+    if (result != CHECKPOINT_SUCCESS) {
+        return result;
+    }
+
+    int argc = 0;
+    while (argv[argc]) argc++;
+    argv[argc++] = "-o";
+    argv[argc++] = CHECKPOINT_RESTORE_LOG;
+    argv[argc] = NULL;
+
+    LOG_INFO("Restoring process from %s in the background", image_dir);
+    return criu_spawn(argv, -1);
+}
+
+/* PID of the process a finished restore left running */
+pid_t criu_restore_pid(const char *image_dir) {
+    char path[MAX_CHECKPOINT_PATH + 32];
+    snprintf(path, sizeof(path), "%s/%s", image_dir, CHECKPOINT_RESTORE_PID);
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return CHECKPOINT_ERROR_RESTORE_FAILED;
+    }
+    int pid = 0;
+    if (fscanf(f, "%d", &pid) != 1 || pid <= 0) {
+        pid = CHECKPOINT_ERROR_RESTORE_FAILED;
+    }
+    fclose(f);
+    return pid;
+}
+
 /* Validate checkpoint images */
 int checkpoint_validate_image(const char *image_dir) {
     if (!image_dir) {
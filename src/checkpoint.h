@@ -22,6 +22,32 @@
 /* Default checkpoint timeout in seconds */
 #define CHECKPOINT_DEFAULT_TIMEOUT 30
 
+/* CRIU log of a background checkpoint or restore, and the pid of the
+ * restored process, inside the image directory */
+#define CHECKPOINT_DUMP_LOG "dump.log"
+#define CHECKPOINT_RESTORE_LOG "restore.log"
+#define CHECKPOINT_RESTORE_PID "restore.pid"
+#define CHECKPOINT_PRE_DUMP_LOG "pre-dump.log"
+
+/* Lazy restores: the lazy-pages daemon feeding a restored process and
+ * the page server feeding one on another node log here, and the daemon
+ * takes restore requests on CHECKPOINT_LAZY_PAGES_SOCKET (all inside the
+ * image directory). Page servers listen on CHECKPOINT_PAGE_SERVER_PORT
+ * unless told otherwise. */
+#define CHECKPOINT_LAZY_PAGES_LOG "lazy-pages.log"
+#define CHECKPOINT_LAZY_PAGES_SOCKET "lazy-pages.socket"
+#define CHECKPOINT_PAGE_SERVER_LOG "page-server.log"
+#define CHECKPOINT_PAGE_SERVER_PID "page-server.pid"
+#define CHECKPOINT_PAGE_SERVER_PORT 27027
+
+/* Iterative checkpoints: pre-dumps go into numbered subdirectories of
+ * the image directory, each on top of the one before, until a pass
+ * writes no more than CHECKPOINT_PRE_DUMP_SETTLED bytes of pages or
+ * CHECKPOINT_PRE_DUMP_PASSES have run */
+#define CHECKPOINT_PRE_DUMP_DIR "pre-%d"
+#define CHECKPOINT_PRE_DUMP_PASSES 3
+#define CHECKPOINT_PRE_DUMP_SETTLED (1024 * 1024)
+
 /* CRIU checkpoint result codes */
 #define CHECKPOINT_SUCCESS 0
 #define CHECKPOINT_ERROR_CRIU_NOT_FOUND -1
@@ -50,6 +76,8 @@ typedef struct {
     criu_version_t criu_version;        /* CRIU version used for checkpoint */
     int leave_running;                  /* Whether original process was left running */
     char preserve_fds[256];             /* File descriptors to preserve */
+    int pre_dump_passes;                /* Pre-dumps the final dump builds on */
+    char parent_chain[256];             /* Their directories, newest first */
 } checkpoint_metadata_t;
 
 /* Check if CRIU is available and the kernel supports checkpoint/restore
@@ -88,19 +116,180 @@ int criu_get_version(criu_version_t *version);
  */
 int criu_checkpoint_process(pid_t pid, const char *image_dir, int leave_running);
 
+/* Copy a process's memory into image_dir with CRIU pre-dump
+ *
+ * The process keeps running. Memory tracking is turned on, so a later
+ * pre-dump or dump given this directory as prev_images_dir (relative to
+ * its own image directory) writes only pages dirtied since. prev_images_dir
+ * is NULL for the first pass.
+ *
+ * Returns: CHECKPOINT_SUCCESS on success, error code on failure
+ */
+int criu_pre_dump_process(pid_t pid, const char *image_dir, const char *prev_images_dir);
+
+/* Checkpoint a process in passes, stopping it only for the last one
+ *
+ * Runs up to max_passes pre-dumps into CHECKPOINT_PRE_DUMP_DIR
+ * subdirectories of image_dir while the process keeps serving, stopping
+ * early once the dirty set settles, then a final dump into image_dir on
+ * top of the newest of them. If pre-dumping fails (no soft-dirty
+ * tracking in the kernel, say) the final dump is a full one. *passes
+ * gets the number of pre-dumps the image builds on.
+ *
+ * Returns: CHECKPOINT_SUCCESS on success, error code on failure
+ */
+int criu_checkpoint_iterative(pid_t pid, const char *image_dir, int leave_running,
+                              int max_passes, int *passes);
+
+/* Start a CRIU checkpoint of pid without waiting for it
+ *
+ * Same checks and arguments as criu_checkpoint_process(), but CRIU runs
+ * in the background with its log written to CHECKPOINT_DUMP_LOG in
+ * image_dir, so several processes can be dumped at once. prev_images_dir
+ * names an earlier pre-dump to build on, or is NULL for a full dump. The
+ * caller reaps the returned pid itself and passes the status to
+ * criu_exit_result().
+ *
+ * Returns: PID of the CRIU process on success, negative error code on failure
+ */
+pid_t criu_checkpoint_start(pid_t pid, const char *image_dir, int leave_running,
+                            const char *prev_images_dir);
+
+/* Start a CRIU pre-dump of pid without waiting for it, logging to
+ * CHECKPOINT_PRE_DUMP_LOG; reaped like criu_checkpoint_start()
+ *
+ * Returns: PID of the CRIU process on success, negative error code on failure
+ */
+pid_t criu_pre_dump_start(pid_t pid, const char *image_dir, const char *prev_images_dir);
+
+/* Like criu_pre_dump_process(), but the pages go to the page server at
+ * address:port (see criu_page_server_receive()) instead of image_dir,
+ * which only gets the rest of the images. prev_images_dir is relative to
+ * the image directory on the server's side.
+ *
+ * Returns: CHECKPOINT_SUCCESS on success, error code on failure
+ */
+int criu_pre_dump_remote(pid_t pid, const char *image_dir, const char *prev_images_dir,
+                         const char *address, int port);
+
+/* Final dump to a page server, as criu_pre_dump_remote(); the process is
+ * stopped and does not go on here
+ *
+ * Returns: CHECKPOINT_SUCCESS on success, error code on failure
+ */
+int criu_checkpoint_remote(pid_t pid, const char *image_dir, const char *prev_images_dir,
+                           const char *address, int port);
+
+/* Bytes of memory pages written into image_dir by a dump or pre-dump */
+size_t checkpoint_pages_size(const char *image_dir);
+
+/* Whether to run another pre-dump after pass number passes wrote current
+ * bytes of pages and the pass before it previous (0 for the first):
+ * not once max_passes is reached, the dirty set is down to
+ * CHECKPOINT_PRE_DUMP_SETTLED, or it stopped shrinking by a quarter */
+int checkpoint_pre_dump_again(int passes, int max_passes, size_t previous, size_t current);
+
+/* Name of the subdirectory holding pre-dump pass number pass (from 1) */
+void checkpoint_pre_dump_dir(int pass, char *buf, size_t size);
+
+/* Interpret a CRIU process's wait status
+ *
+ * Returns: CHECKPOINT_SUCCESS if it exited with status 0, error code otherwise
+ */
+int criu_exit_result(int status);
+
 /* Restore a process from CRIU checkpoint images
  *
  * image_dir: Directory containing checkpoint images
  *
  * This function:
  * 1. Validates checkpoint images exist and are not corrupted
- * 2. Forks and calls CRIU restore in child process
+ * 2. Forks and calls CRIU restore in child process, detached so CRIU
+ *    exits once the restored tree is running
  * 3. Returns PID of restored process on success
  *
  * Returns: PID of restored process on success, negative error code on failure
  */
 pid_t criu_restore_process(const char *image_dir);
 
+/* Start a CRIU restore from image_dir without waiting for it
+ *
+ * Like criu_restore_process(), with CRIU's log going to
+ * CHECKPOINT_RESTORE_LOG in image_dir. The caller reaps the returned pid,
+ * passes the status to criu_exit_result() and on success gets the
+ * restored process from criu_restore_pid().
+ *
+ * Returns: PID of the CRIU process on success, negative error code on failure
+ */
+pid_t criu_restore_start(const char *image_dir);
+
+/* PID of the process restored into image_dir, read from the pidfile CRIU
+ * leaves there
+ *
+ * Returns: the PID, or a negative error code if there is none
+ */
+pid_t criu_restore_pid(const char *image_dir);
+
+/* Check if this kernel and CRIU can restore lazily: CRIU resolves the
+ * restored process's page faults through userfaultfd, which needs
+ * uffd-noncoop support. The answer is cached.
+ *
+ * Returns: CHECKPOINT_SUCCESS if supported, error code otherwise
+ */
+int criu_lazy_pages_supported(void);
+
+/* Start the lazy-pages daemon for a restore from image_dir
+ *
+ * image_dir: Directory containing checkpoint images
+ * address: Page server to fetch pages from, or NULL to read them from
+ *          image_dir
+ * port: Page server port (ignored without address)
+ *
+ * Waits until the daemon accepts restores. It exits by itself once every
+ * page has been handed over, or when the restored process does.
+ *
+ * Returns: PID of the daemon on success, negative error code on failure
+ */
+pid_t criu_lazy_pages_start(const char *image_dir, const char *address, int port);
+
+/* Restore a process from image_dir without copying its memory first
+ *
+ * Like criu_restore_process(), but the process resumes as soon as its
+ * state is rebuilt; the lazy-pages daemon started for image_dir supplies
+ * each page the first time it is touched.
+ *
+ * Returns: PID of restored process on success, negative error code on failure
+ */
+pid_t criu_restore_lazy(const char *image_dir);
+
+/* Serve the pages of image_dir to a lazy restore on another node
+ *
+ * image_dir: Directory containing checkpoint images
+ * port: TCP port to listen on
+ *
+ * The page server exits once the remote lazy-pages daemon has
+ * everything.
+ *
+ * Returns: PID of the page server on success, negative error code on failure
+ */
+pid_t criu_page_server_start(const char *image_dir, int port);
+
+/* Receive the pages of one dump or pre-dump from another node
+ *
+ * image_dir: Directory to write pagemap and page images into (must exist)
+ * prev_images_dir: Pre-dump the incoming pass builds on, relative to
+ *                  image_dir, or NULL
+ * sock: Connected TCP socket of the dump, inherited by CRIU; the caller
+ *       has checked who is at the other end and closes its copy
+ *
+ * Returns once the page server runs. It runs detached, writing its
+ * pid to CHECKPOINT_PAGE_SERVER_PID in image_dir, and exits when the dump
+ * feeding it is done.
+ *
+ * Returns: PID of the page server on success, negative error code on failure
+ */
+pid_t criu_page_server_receive(const char *image_dir, const char *prev_images_dir, int sock);
+
 /* Validate checkpoint images before attempting restore
  *
  * image_dir: Directory containing checkpoint images
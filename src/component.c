@@ -13,6 +13,22 @@
 #include "log.h"
 #include "checkpoint.h"
 #include "checkpoint-mgmt.h"
+#include "checkpoint-store.h"
+#include "timer.h"
+#include "supervise.h"
+#include "filewatch.h"
+#include "notify.h"
+#include "graph-cache.h"
+#include "reload.h"
+#include "output.h"
+#include "telemetry.h"
+#include "pressure.h"
+#include "federation.h"
+#include "migration.h"
+#include "activation.h"
+#include "spawn.h"
+#include "metrics.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -25,23 +41,188 @@
 #include <signal.h>
 #include <sys/inotify.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
-/* Global component storage */
-component_t components[MAX_COMPONENTS];
+/* Global component storage, grown on demand by component_table_reserve() */
+component_t *components = NULL;
 int n_components = 0;
+static int max_components = 0;
+
+/* Readiness probes start fast and back off, so quick services are seen
+ * within tens of milliseconds without polling slow ones hard */
+#define READINESS_POLL_MIN_MS 50
+#define READINESS_POLL_MAX_MS 1000
+
+/* OOM events normally arrive through inotify; the scan is for kernels
+ * where memory.events cannot be watched */
+#define OOM_SCAN_INTERVAL_MS 5000
+
+static void health_begin(int idx);
+static void standby_spawn(int idx);
+static void standby_handoff_cancel(int idx);
+static void idle_begin(int idx);
+
+int component_stop_signal(const component_t *comp) {
+    return comp->stop_signal > 0 ? comp->stop_signal : SIGTERM;
+}
+
+static unsigned int placement_epoch = 1;
+
+static int is_running(comp_state_t state) {
+    return state == COMP_STARTING || state == COMP_READY_WAIT ||
+           state == COMP_ACTIVE || state == COMP_DEGRADED;
+}
+
+unsigned int component_placement_epoch(void) {
+    return placement_epoch;
+}
+
+void component_placement_changed(void) {
+    placement_epoch++;
+}
+
+void component_set_state(component_t *comp, comp_state_t state) {
+    if (comp->state != state) {
+        trace_state(comp->name, comp->state, state);
+        metrics_state(comp->name, comp->type == COMP_TYPE_ONESHOT, comp->state, state);
+        if (is_running(comp->state) != is_running(state)) placement_epoch++;
+    }
+    comp->state = state;
+}
+
+void component_arm_timer(int idx, timer_kind_t kind, uint64_t delay_ms) {
+    component_t *comp = &components[idx];
+    timer_cancel(comp->timers[kind]);
+    int handle = timer_add(timer_now_ms() + delay_ms, kind, idx);
+    comp->timers[kind] = handle > 0 ? handle : 0;
+}
+
+void component_disarm_timer(int idx, timer_kind_t kind) {
+    component_t *comp = &components[idx];
+    timer_cancel(comp->timers[kind]);
+    comp->timers[kind] = 0;
+}
+
+void component_kill(int idx) {
+    component_t *comp = &components[idx];
+    if (comp->pid <= 0) {
+        return;
+    }
+    supervise_signal(comp->pid, component_stop_signal(comp));
+    int timeout = comp->stop_timeout > 0 ? comp->stop_timeout : 10;
+    component_arm_timer(idx, TIMER_STOP_KILL, (uint64_t)timeout * 1000);
+}
+
+static void stop_kill_due(int idx) {
+    component_t *comp = &components[idx];
+    if (comp->pid > 0) {
+        LOG_WARN("component '%s' (pid %d) ignored its stop signal, sending SIGKILL",
+                 comp->name, comp->pid);
+        supervise_signal(comp->pid, SIGKILL);
+    }
+}
+
+/* Re-intern a component's capability names if the registry was reset
+ * since they were last interned (or they never were, e.g. components
+ * filled in by hand rather than by parse_component) */
+void component_refresh_cap_ids(component_t *comp) {
+    unsigned int gen = capability_generation();
+    if (comp->cap_generation != gen) {
+        capability_intern_list(comp->requires, comp->n_requires, comp->requires_id);
+        capability_intern_list(comp->provides, comp->n_provides, comp->provides_id);
+        comp->cap_generation = gen;
+    }
+}
+
+void component_link_caps(int idx) {
+    component_t *comp = &components[idx];
+    component_refresh_cap_ids(comp);
+
+    unsigned int gen = capability_generation();
+    if (comp->link_generation != gen || comp->link_idx != idx) {
+        for (int i = 0; i < comp->n_requires; i++) {
+            capability_add_consumer(comp->requires_id[i], idx);
+        }
+        for (int i = 0; comp->on_demand && i < comp->n_provides; i++) {
+            capability_add_on_demand(comp->provides_id[i], idx);
+        }
+        comp->link_generation = gen;
+        comp->link_idx = idx;
+    }
+}
+
+void component_register_provides(int idx) {
+    component_t *comp = &components[idx];
+    component_refresh_cap_ids(comp);
+    for (int i = 0; i < comp->n_provides; i++) {
+        capability_register_id(comp->provides_id[i], idx);
+    }
+}
+
+void component_withdraw_provides(int idx) {
+    component_t *comp = &components[idx];
+    component_refresh_cap_ids(comp);
+    for (int i = 0; i < comp->n_provides; i++) {
+        capability_withdraw_id(comp->provides_id[i]);
+    }
+}
+
+void component_withdraw_held_provides(int idx) {
+    component_t *comp = &components[idx];
+    if (comp->n_listen_fds == 0) return;
+
+    component_refresh_cap_ids(comp);
+    for (int i = 0; i < comp->n_provides; i++) {
+        int cap = comp->provides_id[i];
+        if (capability_provider(cap) == idx && capability_active_by_idx(cap)) {
+            capability_withdraw_id(cap);
+        }
+    }
+}
+
+void component_link_all(void) {
+    for (int i = 0; i < n_components; i++) {
+        component_link_caps(i);
+    }
+}
 
 int requirements_met(component_t *comp) {
+    component_refresh_cap_ids(comp);
     for (int i = 0; i < comp->n_requires; i++) {
-        if (!capability_active(comp->requires[i])) {
+        if (!capability_active_by_idx(comp->requires_id[i])) {
             return 0;
         }
     }
     return 1;
 }
 
+/* Stop every readiness deadline, probe and file watch of a component */
+static void readiness_end(int idx) {
+    component_disarm_timer(idx, TIMER_READINESS_TIMEOUT);
+    component_disarm_timer(idx, TIMER_READINESS_POLL);
+    filewatch_remove(idx);
+}
+
+static void readiness_timed_out(int idx) {
+    component_t *comp = &components[idx];
+    int timeout = comp->readiness_timeout > 0 ? comp->readiness_timeout : 30; /* default 30s */
+
+    LOG_ERR("component '%s' readiness timeout after %d seconds",
+            comp->name, timeout);
+
+    component_set_state(comp, COMP_FAILED);
+    readiness_end(idx);
+
+    /* Restarted once the process it still has is gone */
+    component_kill(idx);
+    graph_mark_dirty(idx);
+}
+
 /* Check if a component has exceeded its readiness timeout */
 void check_readiness_timeout(int idx) {
     component_t *comp = &components[idx];
@@ -54,15 +235,41 @@ void check_readiness_timeout(int idx) {
     int timeout = comp->readiness_timeout > 0 ? comp->readiness_timeout : 30; /* default 30s */
 
     if (now - comp->ready_wait_start >= timeout) {
-        LOG_ERR("component '%s' readiness timeout after %d seconds",
-                comp->name, timeout);
+        readiness_timed_out(idx);
+    }
+}
 
-        comp->state = COMP_FAILED;
+/* Arm the readiness deadline and the first probe for a component that
+ * has just entered READY_WAIT */
+static void readiness_begin(int idx) {
+    component_t *comp = &components[idx];
+    int timeout = comp->readiness_timeout > 0 ? comp->readiness_timeout : 30;
+    time_t waited = time(NULL) - comp->ready_wait_start;
+    uint64_t left = waited < timeout ? (uint64_t)(timeout - waited) * 1000 : 0;
 
-        /* Kill the process if it's still running */
-        if (comp->pid > 0) {
-            kill(comp->pid, SIGTERM);
-        }
+    component_arm_timer(idx, TIMER_READINESS_TIMEOUT, left);
+    comp->readiness_poll_ms = READINESS_POLL_MIN_MS;
+
+    /* Watch before the first probe so a file created in between is seen */
+    if (comp->readiness_method == READINESS_FILE) {
+        filewatch_add(idx, comp->readiness_file);
+    }
+    if (comp->readiness_method != READINESS_SIGNAL &&
+        comp->readiness_method != READINESS_NOTIFY) {
+        component_arm_timer(idx, TIMER_READINESS_POLL, 0);
+    }
+}
+
+/* Schedule the next readiness probe, backing off towards the maximum */
+static void readiness_retry(int idx) {
+    component_t *comp = &components[idx];
+    if (comp->readiness_poll_ms < READINESS_POLL_MIN_MS) {
+        comp->readiness_poll_ms = READINESS_POLL_MIN_MS;
+    }
+    component_arm_timer(idx, TIMER_READINESS_POLL, comp->readiness_poll_ms);
+    comp->readiness_poll_ms *= 2;
+    if (comp->readiness_poll_ms > READINESS_POLL_MAX_MS) {
+        comp->readiness_poll_ms = READINESS_POLL_MAX_MS;
     }
 }
 
@@ -81,15 +288,21 @@ void component_ready(int idx) {
 
     LOG_INFO("component '%s' is ready (waited %d seconds)", comp->name, wait_time);
 
-    comp->state = COMP_ACTIVE;
+    component_set_state(comp, COMP_ACTIVE);
+    readiness_end(idx);
 
     /* Register capabilities for service-type components */
     if (comp->type == COMP_TYPE_SERVICE) {
+        component_refresh_cap_ids(comp);
         for (int i = 0; i < comp->n_provides; i++) {
-            capability_register(comp->provides[i], idx);
+            capability_register_id(comp->provides_id[i], idx);
             LOG_INFO("capability UP: %s (provided by %s)", comp->provides[i], comp->name);
         }
     }
+
+    health_begin(idx);
+    idle_begin(idx);
+    standby_spawn(idx);
 }
 
 /* Check if a readiness file exists for file-based readiness */
@@ -98,15 +311,168 @@ static int check_readiness_file(const char *filepath) {
     return (stat(filepath, &st) == 0);
 }
 
-/* Execute a health check command and return success/failure */
-static int execute_readiness_check(const char *command) {
-    if (!command || !*command) return 0;
+/* Spawn "/bin/sh -c command" with its output discarded, for health and
+ * readiness checks. Returns the child pid, or -1 if it could not be
+ * created. */
+static pid_t spawn_check_command(const char *name, const char *command) {
+    char *argv[] = { "/bin/sh", "-c", (char *)command, NULL };
+    spawn_t sp;
+    spawn_init(&sp, name, "/bin/sh", argv);
+    sp.new_session = 1;
+    spawn_output(&sp, SPAWN_DEVNULL);
+    return spawn_run(&sp);
+}
+
+/* Spawn a component's readiness check without waiting for it; the result
+ * is handled by component_reap() when the check exits */
+static int start_readiness_check(int idx) {
+    component_t *comp = &components[idx];
+
+    pid_t pid = spawn_check_command(comp->name, comp_str(comp->readiness_check));
+    if (pid < 0) {
+        LOG_ERR("spawn failed for readiness check '%s': %s", comp->name, strerror(errno));
+        return -1;
+    }
+    comp->readiness_pid = pid;
+    supervise_watch(pid, idx, PROC_READINESS);
+    return 0;
+}
+
+static void readiness_check_exited(int idx, int status) {
+    component_t *comp = &components[idx];
+    comp->readiness_pid = 0;
+
+    if (comp->state != COMP_READY_WAIT) {
+        return; /* timed out or exited while the check ran */
+    }
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        LOG_INFO("component '%s' readiness check passed: %s",
+                 comp->name, comp->readiness_check);
+        component_ready(idx);
+    } else {
+        readiness_retry(idx);
+    }
+}
+
+/* Probe a READY_WAIT component's readiness once */
+static void readiness_poll(int idx) {
+    component_t *comp = &components[idx];
+
+    if (comp->state != COMP_READY_WAIT) {
+        return;
+    }
+
+    switch (comp->readiness_method) {
+        case READINESS_FILE:
+            if (comp_str(comp->readiness_file)[0] && check_readiness_file(comp->readiness_file)) {
+                LOG_INFO("component '%s' readiness file detected: %s",
+                         comp->name, comp->readiness_file);
+                component_ready(idx);
+            } else if (!filewatch_active(idx)) {
+                readiness_retry(idx); /* no inotify watch, keep polling */
+            }
+            break;
+
+        case READINESS_COMMAND:
+            /* Runs in the background, one at a time; a passing check
+             * marks the component ready when it is reaped, a failing one
+             * schedules the next probe */
+            if (comp_str(comp->readiness_check)[0] && comp->readiness_pid <= 0) {
+                if (start_readiness_check(idx) < 0) {
+                    readiness_retry(idx);
+                }
+            }
+            break;
+
+        case READINESS_SIGNAL:
+            /* Signal-based readiness is handled via signal handler, not polled */
+            break;
+
+        case READINESS_NOTIFY:
+            /* Pushed over the notify socket, see component_handle_notify() */
+            break;
+
+        case READINESS_NONE:
+        default:
+            /* Should not happen for components in READY_WAIT state */
+            LOG_WARN("component '%s' in READY_WAIT with READINESS_NONE", comp->name);
+            component_ready(idx); /* Mark ready to recover */
+            break;
+    }
+}
+
+/* A watched readiness file appeared, or its watch went away */
+static void readiness_file_changed(int idx) {
+    if (idx < n_components && components[idx].readiness_method == READINESS_FILE) {
+        readiness_poll(idx);
+    }
+}
+
+void component_handle_file_events(void) {
+    filewatch_dispatch(readiness_file_changed);
+}
+
+static void apply_notify(int idx, const notify_msg_t *msg) {
+    component_t *comp = &components[idx];
+
+    if (msg->has_status) {
+        snprintf(comp->notify_status, sizeof(comp->notify_status), "%s", msg->status);
+        LOG_INFO("component '%s' status: %s", comp->name, comp->notify_status);
+    }
+
+    if (msg->watchdog) {
+        comp->notify_watchdog_ms = timer_now_ms();
+    }
+
+    if (msg->mainpid > 0 && msg->mainpid != comp->pid) {
+        /* Forking daemons hand over to their real main process; the old
+         * one stays watched and its exit is ignored. Stop and kill
+         * signals follow the main pid, so it must be one of the
+         * component's own processes. */
+        if (comp->cgroup_fd <= 0 || cgroup_has_process(comp->cgroup_fd, msg->mainpid) != 1) {
+            LOG_WARN("component '%s' named main pid %d outside its cgroup, ignored",
+                     comp->name, msg->mainpid);
+        } else {
+            LOG_INFO("component '%s' main pid %d -> %d", comp->name, comp->pid, msg->mainpid);
+            comp->pid = msg->mainpid;
+            supervise_watch(msg->mainpid, idx, PROC_MAIN);
+        }
+    }
 
-    int status = system(command);
-    return (WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    if (msg->ready && comp->state == COMP_READY_WAIT) {
+        LOG_INFO("component '%s' sent READY=1", comp->name);
+        component_ready(idx);
+    }
 }
 
-/* Check readiness for all components in READY_WAIT state */
+void component_handle_notify(void) {
+    notify_msg_t msg;
+
+    while (notify_receive(&msg) > 0) {
+        /* Only the current main process of a component may speak for it */
+        proc_watch_t *w = supervise_lookup(msg.sender);
+        if (w && w->role == PROC_STANDBY && w->idx < n_components &&
+            components[w->idx].standby_pid == msg.sender) {
+            /* A standby only says when it has warmed up */
+            component_t *comp = &components[w->idx];
+            if (msg.ready && !comp->standby_ready) {
+                LOG_INFO("standby %d of '%s' is ready", msg.sender, comp->name);
+                comp->standby_ready = 1;
+            }
+            continue;
+        }
+        if (!w || w->role != PROC_MAIN || w->idx >= n_components ||
+            components[w->idx].pid != msg.sender) {
+            LOG_WARN("notify message from unmanaged pid %d ignored", msg.sender);
+            continue;
+        }
+        apply_notify(w->idx, &msg);
+    }
+}
+
+/* Check readiness for all components in READY_WAIT state right now,
+ * without waiting for their next scheduled probe */
 void check_all_readiness(void) {
     for (int i = 0; i < n_components; i++) {
         component_t *comp = &components[i];
@@ -121,166 +487,619 @@ void check_all_readiness(void) {
             continue; /* Component timed out */
         }
 
-        /* Check readiness based on configured method */
-        int ready = 0;
+        readiness_poll(i);
+    }
+}
 
-        switch (comp->readiness_method) {
-            case READINESS_FILE:
-                if (comp->readiness_file[0]) {
-                    ready = check_readiness_file(comp->readiness_file);
-                    if (ready) {
-                        LOG_INFO("component '%s' readiness file detected: %s",
-                                 comp->name, comp->readiness_file);
-                    }
-                }
-                break;
+/* The keepalive pipe is made on first use and kept open at both ends
+ * across restarts, so every instance of the component - main process,
+ * standby, upgrade - writes into the same one and it never reads EOF */
+static void watchdog_install(spawn_t *sp, component_t *comp) {
+    if (comp->watchdog_fd <= 0) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) < 0) {
+            LOG_WARN("no watchdog pipe for '%s': %s", comp->name, strerror(errno));
+            return;
+        }
+        comp->watchdog_fd = fds[0];
+        comp->watchdog_wfd = fds[1];
+    }
 
-            case READINESS_COMMAND:
-                if (comp->readiness_check[0]) {
-                    ready = execute_readiness_check(comp->readiness_check);
-                    if (ready) {
-                        LOG_INFO("component '%s' readiness check passed: %s",
-                                 comp->name, comp->readiness_check);
-                    }
-                }
-                break;
+    char usec[24], fd[12];
+    snprintf(usec, sizeof(usec), "%llu", (unsigned long long)comp->watchdog_sec * 1000000ULL);
+    snprintf(fd, sizeof(fd), "%d", WATCHDOG_FD);
+    spawn_fd(sp, comp->watchdog_wfd, WATCHDOG_FD);
+    spawn_setenv(sp, WATCHDOG_USEC_ENV, usec);
+    spawn_setenv(sp, WATCHDOG_FD_ENV, fd);
+}
 
-            case READINESS_SIGNAL:
-                /* Signal-based readiness is handled via signal handler, not polled */
-                break;
+/* Describe the spawn of comp's binary, in a session of its own with its
+ * output to out_fd: argv (MAX_ARGS + 2 entries) is filled in for it,
+ * notify-readiness and watchdog services are pointed at our notify socket
+ * and watchdog ones given their keepalive pipe */
+static void component_spawn_init(spawn_t *sp, component_t *comp, char **argv, int out_fd) {
+    argv[0] = comp->binary;
+    for (int i = 0; i < comp->argc; i++) {
+        argv[i + 1] = comp->args[i];
+    }
+    argv[comp->argc + 1] = NULL;
 
-            case READINESS_NONE:
-            default:
-                /* Should not happen for components in READY_WAIT state */
-                LOG_WARN("component '%s' in READY_WAIT with READINESS_NONE", comp->name);
-                ready = 1; /* Mark ready to recover */
-                break;
+    spawn_init(sp, comp->name, comp->binary, argv);
+    sp->new_session = 1;
+    spawn_output(sp, out_fd);
+
+    const char *path = notify_socket_path();
+    if ((comp->readiness_method == READINESS_NOTIFY || comp->watchdog_sec > 0) && path) {
+        spawn_setenv(sp, "NOTIFY_SOCKET", path);
+    }
+    if (comp->watchdog_sec > 0) {
+        watchdog_install(sp, comp);
+    }
+}
+
+/* The namespaces of comp's [isolation], unshared by its child */
+static void component_spawn_isolate(spawn_t *sp, const component_t *comp) {
+    sp->namespaces = isolation_parse_namespaces(comp->isolation_namespaces);
+    sp->hostname = comp->isolation_hostname;
+}
+
+static const char *cgroup_name(const component_t *comp) {
+    return comp_str(comp->cgroup_path)[0] ? comp->cgroup_path : comp->name;
+}
+
+/* A standby runs beside its component, capped, in <cgroup>.standby */
+static void standby_cgroup_path(const component_t *comp, char *buf, size_t size) {
+    snprintf(buf, size, "%s.standby", cgroup_name(comp));
+}
+
+/* The component's cgroup directory. Opened, and given its limits, on the
+ * first start; restarts reuse it as is. -1 if there is none. */
+static int component_cgroup(component_t *comp) {
+    if (comp->cgroup_fd > 0) return comp->cgroup_fd;
+
+    int fd = cgroup_open(comp->name, cgroup_name(comp));
+    if (fd < 0) {
+        LOG_WARN("failed to create cgroup for %s", comp->name);
+        return -1;
+    }
+    if (cgroup_apply_limits(fd, comp) < 0) {
+        LOG_WARN("failed to apply resource limits to cgroup for %s", comp->name);
+    }
+    telemetry_add(fd);
+    pressure_add(fd, comp);
+    comp->cgroup_fd = fd;
+    placement_epoch++;
+    return fd;
+}
+
+static void component_close_cgroup(component_t *comp) {
+    telemetry_remove(comp->cgroup_fd);
+    pressure_remove(comp->cgroup_fd);
+    cgroup_close(comp->cgroup_fd);
+    comp->cgroup_fd = 0;
+    placement_epoch++;
+}
+
+void component_release_cgroup(int idx) {
+    component_t *comp = &components[idx];
+
+    if (comp->standby_cgroup_fd > 0) {
+        cgroup_close(comp->standby_cgroup_fd);
+        comp->standby_cgroup_fd = 0;
+        char path[CGROUP_PATH_MAX];
+        standby_cgroup_path(comp, path, sizeof(path));
+        if (comp->standby_pid <= 0 && cgroup_cleanup(path) < 0) {
+            LOG_WARN("failed to cleanup standby cgroup for %s", comp->name);
         }
+    }
+
+    if (comp->cgroup_fd <= 0) return;
+
+    component_close_cgroup(comp);
+    int running = comp->pid > 0 && supervise_lookup(comp->pid) != NULL;
+    if (!running && cgroup_cleanup(cgroup_name(comp)) < 0) {
+        LOG_WARN("failed to cleanup cgroup for %s", comp->name);
+    }
+}
+
+/* xorshift32: restart jitter only has to differ between components */
+static uint32_t restart_random(void) {
+    static uint32_t state = 0;
+    if (state == 0) {
+        state = (uint32_t)timer_now_ms() ^ ((uint32_t)getpid() << 16) ^ 0x9e3779b9u;
+    }
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+uint64_t component_restart_delay(const component_t *comp, int failures, uint32_t rnd) {
+    uint64_t base = comp->restart_delay_ms > 0 ? (uint64_t)comp->restart_delay_ms : 1000;
+    uint64_t ceiling = comp->restart_delay_max_ms > 0 ? (uint64_t)comp->restart_delay_max_ms : 60000;
+    if (ceiling < base) ceiling = base;
+
+    uint64_t delay = base;
+    for (int i = 1; i < failures && delay < ceiling; i++) {
+        delay *= 2;
+    }
+    if (delay > ceiling) delay = ceiling;
+
+    /* Take up to restart_jitter percent off, so components that failed
+     * together spread out instead of restarting in lockstep */
+    uint64_t spread = delay * (uint64_t)comp->restart_jitter / 100;
+    if (spread > 0) delay -= rnd % (spread + 1);
+    return delay;
+}
+
+int component_schedule_restart(int idx) {
+    component_t *comp = &components[idx];
+
+    /* A run that lasted the decay window wipes the slate clean */
+    if (comp->last_restart > 0 && time(NULL) - comp->last_restart >= comp->restart_decay) {
+        comp->failures = 0;
+    }
+    comp->failures++;
+
+    if (comp->restart_quarantine > 0 && comp->failures >= comp->restart_quarantine) {
+        LOG_ERR("component '%s' failed %d times in a row, quarantined until reset",
+                comp->name, comp->failures);
+        component_set_state(comp, COMP_QUARANTINED);
+        comp->restart_due_ms = 0;
+        component_disarm_timer(idx, TIMER_RESTART);
+        component_withdraw_held_provides(idx);
+        return -1;
+    }
+
+    uint64_t delay = component_restart_delay(comp, comp->failures, restart_random());
+    comp->restart_due_ms = timer_now_ms() + delay;
+    component_arm_timer(idx, TIMER_RESTART, delay);
+    LOG_INFO("component '%s' failed (%d in a row), restarting in %llums",
+             comp->name, comp->failures, (unsigned long long)delay);
+    return 0;
+}
+
+int component_reset_failed(const char *name) {
+    for (int i = 0; i < n_components; i++) {
+        component_t *comp = &components[i];
+        if (strcmp(comp->name, name) != 0) continue;
+        if (comp->state != COMP_FAILED && comp->state != COMP_QUARANTINED &&
+            comp->state != COMP_MIGRATED) return -2;
+
+        LOG_INFO("component '%s' failure count reset", comp->name);
+        comp->failures = 0;
+        comp->restart_due_ms = 0;
+        component_set_state(comp, COMP_INACTIVE);
+        component_disarm_timer(i, TIMER_RESTART);
+        graph_mark_dirty(i);
+        return 0;
+    }
+    return -1;
+}
+
+/* Warm standby
+ *
+ * With standby = true a second instance of a service is kept running
+ * beside the active one, in its own <cgroup>.standby capped by
+ * standby_memory_high and standby_cpu_weight. It is started with its end
+ * of a handoff socket on HANDOFF_FD and HANDOFF_STANDBY=1, does its
+ * warm-up and, with notify readiness, sends READY=1 (otherwise it counts
+ * as warm once forked). It then waits on HANDOFF_FD.
+ *
+ * Promotion sends it the service's descriptors, if we hold any, and
+ * HANDOFF_COMPLETE, moves it into the component's cgroup and makes it the
+ * main process; the capabilities never go down. An upgrade promotes it
+ * rather than forking the new binary, and so does a crash of the active
+ * instance. A promoted standby keeps its socket: when it is upgraded in
+ * turn, the descriptors it sends back over it are held for the next one.
+ * A new standby is forked after each promotion and restart_delay_ms after
+ * one exits. */
+
+static void close_sock(int *fd) {
+    if (*fd > 0) close(*fd);
+    *fd = 0;
+}
+
+/* Drop the descriptors held for a standby; a freshly started main
+ * process opens its own, and ours would hold its ports */
+static void held_fds_close(component_t *comp) {
+    for (int i = 0; i < comp->n_held_fds; i++) {
+        close(comp->held_fds[i]);
+    }
+    free(comp->held_fds);
+    comp->held_fds = NULL;
+    comp->n_held_fds = 0;
+}
+
+/* Bind the component's [sockets] before its first start. They stay open
+ * here across restarts and hot-swaps, so clients are queued rather than
+ * refused while no process is serving them. Returns 0 or -1. */
+static int sockets_open(component_t *comp) {
+    if (comp->n_listen_fds >= comp->n_sockets) return 0;
+
+    if (!comp->listen_fds) {
+        comp->listen_fds = calloc((size_t)comp->n_sockets, sizeof(int));
+        if (!comp->listen_fds) {
+            LOG_ERR("component '%s': out of memory for sockets", comp->name);
+            return -1;
+        }
+    }
+    /* Any bound before a failure are kept; the next start tries the rest */
+    while (comp->n_listen_fds < comp->n_sockets) {
+        const char *spec = comp->sockets[comp->n_listen_fds];
+        int fd = activation_listen(spec, comp->socket_backlog);
+        if (fd < 0) {
+            LOG_ERR("component '%s': cannot listen on %s: %s",
+                    comp->name, spec, strerror(errno));
+            return -1;
+        }
+        comp->listen_fds[comp->n_listen_fds++] = fd;
+        LOG_INFO("component '%s': listening on %s", comp->name, spec);
+    }
+    return 0;
+}
+
+static void sockets_unwatch(component_t *comp) {
+    for (int i = 0; i < comp->n_listen_fds; i++) {
+        activation_unwatch(comp->listen_fds[i]);
+    }
+}
+
+void component_close_sockets(int idx) {
+    component_t *comp = &components[idx];
+    for (int i = 0; i < comp->n_listen_fds; i++) {
+        activation_close(comp->sockets[i], comp->listen_fds[i]);
+    }
+    free(comp->listen_fds);
+    comp->listen_fds = NULL;
+    comp->n_listen_fds = 0;
+}
+
+void component_close_watchdog(int idx) {
+    component_t *comp = &components[idx];
+    close_sock(&comp->watchdog_fd);
+    close_sock(&comp->watchdog_wfd);
+}
+
+/* The standby's cgroup, opened and capped on first use; -1 if none */
+static int standby_cgroup(component_t *comp) {
+    if (comp->standby_cgroup_fd > 0) return comp->standby_cgroup_fd;
+
+    char path[CGROUP_PATH_MAX];
+    standby_cgroup_path(comp, path, sizeof(path));
+    int fd = cgroup_open(comp->name, path);
+    if (fd < 0) {
+        LOG_WARN("failed to create standby cgroup for %s", comp->name);
+        return -1;
+    }
+    if (cgroup_set_memory_high(fd, comp->standby_memory_high) < 0 ||
+        cgroup_set_cpu_weight(fd, comp->standby_cpu_weight) < 0) {
+        LOG_WARN("failed to cap standby cgroup for %s", comp->name);
+    }
+    comp->standby_cgroup_fd = fd;
+    return fd;
+}
+
+/* Fork the standby of component idx unless it has one */
+static void standby_spawn(int idx) {
+    component_t *comp = &components[idx];
+    if (!comp->standby || comp->standby_pid > 0) return;
+    component_disarm_timer(idx, TIMER_STANDBY);
+
+    int socks[2];
+    if (create_handoff_socketpair(socks) != 0) {
+        LOG_WARN("no handoff socket for the standby of '%s'", comp->name);
+        return;
+    }
+
+    int out_fd = output_open(comp->name);
+    char handoff_fd_str[16];
+    snprintf(handoff_fd_str, sizeof(handoff_fd_str), "%d", HANDOFF_FD);
+
+    char *argv[MAX_ARGS + 2];
+    spawn_t sp;
+    component_spawn_init(&sp, comp, argv, out_fd);
+    component_spawn_isolate(&sp, comp);
+    sp.cgroup_fd = standby_cgroup(comp);
+    spawn_fd(&sp, socks[1], HANDOFF_FD);
+    spawn_setenv(&sp, HANDOFF_FD_ENV, handoff_fd_str);
+    spawn_setenv(&sp, HANDOFF_STANDBY_ENV, "1");
+
+    pid_t pid = spawn_run(&sp);
+    if (pid < 0) {
+        LOG_ERR("spawn failed for the standby of '%s': %s", comp->name, strerror(errno));
+        close(socks[0]);
+        close(socks[1]);
+        if (out_fd >= 0) close(out_fd);
+        return;
+    }
+
+    close(socks[1]);
+    if (out_fd >= 0) close(out_fd);
+    comp->standby_pid = pid;
+    comp->standby_sock = socks[0];
+    comp->standby_started = time(NULL);
+    comp->standby_ready = comp->readiness_method != READINESS_NOTIFY;
+    supervise_watch(pid, idx, PROC_STANDBY);
+    LOG_INFO("standby of '%s' started (pid %d)", comp->name, pid);
+}
+
+/* Forget the standby process of comp, leaving it to exit */
+static void standby_discard(component_t *comp) {
+    if (comp->standby_pid > 0) {
+        supervise_signal(comp->standby_pid, SIGTERM);
+    }
+    close_sock(&comp->standby_sock);
+    comp->standby_pid = 0;
+    comp->standby_ready = 0;
+}
+
+void component_standby_stop(int idx) {
+    component_t *comp = &components[idx];
+    component_disarm_timer(idx, TIMER_STANDBY);
+    if (comp->standby_pid > 0) {
+        LOG_INFO("stopping standby %d of '%s'", comp->standby_pid, comp->name);
+    }
+    standby_discard(comp);
+    held_fds_close(comp);
+}
+
+static void standby_respawn_later(int idx) {
+    component_t *comp = &components[idx];
+    component_arm_timer(idx, TIMER_STANDBY, component_restart_delay(comp, 1, restart_random()));
+}
+
+static void standby_exited(int idx, pid_t pid, int status) {
+    component_t *comp = &components[idx];
+    if (comp->standby_pid != pid) {
+        LOG_INFO("previous standby %d of '%s' exited", pid, comp->name);
+        return;
+    }
+
+    LOG_WARN("standby %d of '%s' exited (status %d)", pid, comp->name, status);
+    close_sock(&comp->standby_sock);
+    comp->standby_pid = 0;
+    comp->standby_ready = 0;
+    if (comp->standby && (comp->state == COMP_ACTIVE || comp->state == COMP_DEGRADED)) {
+        standby_respawn_later(idx);
+    }
+}
+
+/* Make the warmed standby of component idx its main process. The old
+ * main process, if any, is the caller's business. Returns 0, or -1 with
+ * the standby discarded and a new one on its way. */
+static int standby_promote(int idx) {
+    component_t *comp = &components[idx];
+    pid_t pid = comp->standby_pid;
+
+    /* A first instance has nothing to give beyond our activation sockets */
+    const int *fds = comp->n_held_fds > 0 ? comp->held_fds : comp->listen_fds;
+    int n_fds = comp->n_held_fds > 0 ? comp->n_held_fds : comp->n_listen_fds;
+    if (handoff_send(comp->standby_sock, fds, n_fds) != 0 ||
+        send_handoff_complete(comp->standby_sock) != 0) {
+        LOG_ERR("standby %d of '%s' could not be handed over to", pid, comp->name);
+        standby_discard(comp);
+        standby_respawn_later(idx);
+        return -1;
+    }
+
+    /* Out of the capped cgroup, along with anything it forked */
+    int cgroup_fd = component_cgroup(comp);
+    if (cgroup_fd >= 0 && comp->standby_cgroup_fd > 0 &&
+        cgroup_move_processes(comp->standby_cgroup_fd, cgroup_fd) < 0) {
+        LOG_WARN("standby %d of '%s' left partly in its standby cgroup", pid, comp->name);
+    }
+
+    close_sock(&comp->handoff_sock);
+    comp->handoff_sock = comp->standby_sock;
+    comp->standby_sock = 0;
+    comp->standby_pid = 0;
+    comp->standby_ready = 0;
+
+    comp->pid = pid;
+    supervise_watch(pid, idx, PROC_MAIN);
+    component_set_state(comp, COMP_ACTIVE);
+    comp->restart_count++;
+    comp->last_restart = time(NULL);
+    if (comp->type == COMP_TYPE_SERVICE) {
+        component_register_provides(idx);
+    }
+    health_begin(idx);
+    idle_begin(idx);
+    LOG_INFO("standby %d of '%s' took over (%d descriptors)", pid, comp->name, n_fds);
+
+    standby_spawn(idx);
+    return 0;
+}
+
+/* On-demand start. An IDLE component has its requirements met but is not
+ * started until a dependent needs it or, with [sockets], a client
+ * connects: its sockets are bound and its capabilities advertised
+ * meanwhile, and the main loop watches the sockets. Running, it is
+ * checked every idle_timeout seconds and stopped, back to IDLE, once it
+ * has been found unused twice in a row. */
+void component_idle(int idx) {
+    component_t *comp = &components[idx];
 
-        if (ready) {
-            component_ready(i);
+    component_set_state(comp, COMP_IDLE);
+    comp->demanded = 0;
+    comp->idle_unused = 0;
+    if (comp->n_sockets > 0 && sockets_open(comp) == 0) {
+        component_register_provides(idx);
+        for (int i = 0; i < comp->n_listen_fds; i++) {
+            if (activation_watch(comp->listen_fds[i]) < 0) {
+                LOG_WARN("component '%s': cannot watch %s, starting it", comp->name, comp->sockets[i]);
+                comp->demanded = 1;
+            }
         }
     }
+    LOG_INFO("component '%s' idle until needed", comp->name);
 }
 
-int component_start(int idx) {
+void component_wake(int idx) {
     component_t *comp = &components[idx];
+    sockets_unwatch(comp);
+    component_set_state(comp, COMP_INACTIVE);
+}
 
-    /* Rate limiting: don't restart too fast */
-    time_t now = time(NULL);
-    if (now - comp->last_restart < 30 && comp->restart_count >= 5) {
-        LOG_WARN("component '%s' restarting too fast, backing off",
-                 comp->name);
-        return -1;
+void component_handle_activation(int fd) {
+    for (int i = 0; i < n_components; i++) {
+        component_t *comp = &components[i];
+        for (int j = 0; j < comp->n_listen_fds; j++) {
+            if (comp->listen_fds[j] != fd) continue;
+
+            sockets_unwatch(comp);
+            if (comp->state == COMP_IDLE && !comp->demanded) {
+                LOG_INFO("component '%s' activated by a connection on %s",
+                         comp->name, comp->sockets[j]);
+                comp->demanded = 1;
+                graph_mark_dirty(i);
+            }
+            return;
+        }
     }
+}
 
-    LOG_INFO("starting component '%s': %s", comp->name, comp->binary);
-
-    /* Prepare cgroup for this component */
-    const char *cgroup_path = (strlen(comp->cgroup_path) > 0) ? comp->cgroup_path : comp->name;
-    if (cgroup_create(comp->name, cgroup_path) < 0) {
-        LOG_WARN("failed to create cgroup for %s", comp->name);
-    }
+/* Whether anything uses it: clients connected to its sockets (where that
+ * cannot be told, it counts as used) or, without sockets, a running
+ * component requiring one of its capabilities */
+static int idle_in_use(int idx) {
+    component_t *comp = &components[idx];
 
-    pid_t pid = fork();
-    if (pid < 0) {
-        LOG_ERR("fork failed for '%s': %s", comp->name, strerror(errno));
-        return -1;
+    if (comp->n_listen_fds > 0) {
+        for (int i = 0; i < comp->n_listen_fds; i++) {
+            if (activation_connections(comp->sockets[i]) != 0) return 1;
+        }
+        return 0;
     }
 
-    if (pid == 0) {
-        /* Child process */
-        char *argv[MAX_ARGS + 2];
-        argv[0] = comp->binary;
-        for (int i = 0; i < comp->argc; i++) {
-            argv[i + 1] = comp->args[i];
+    component_refresh_cap_ids(comp);
+    for (int i = 0; i < comp->n_provides; i++) {
+        int n;
+        const int *consumers = capability_consumers(comp->provides_id[i], &n);
+        for (int c = 0; c < n; c++) {
+            if (consumers[c] != idx && consumers[c] < n_components &&
+                is_running(components[consumers[c]].state)) {
+                return 1;
+            }
         }
-        argv[comp->argc + 1] = NULL;
-
-        /* Reset signal handlers */
-        signal(SIGCHLD, SIG_DFL);
-        signal(SIGPIPE, SIG_DFL);
-        signal(SIGTERM, SIG_DFL);
-        signal(SIGINT, SIG_DFL);
-        signal(SIGHUP, SIG_DFL);
-
-        /* Create new session */
-        setsid();
+    }
+    return 0;
+}
 
-        /* Set up namespace isolation if configured */
-        if (isolation_setup_namespaces(comp) < 0) {
-            LOG_ERR("failed to setup namespaces for %s", comp->name);
-            _exit(126);
-        }
+static void idle_begin(int idx) {
+    component_t *comp = &components[idx];
+    if (!comp->on_demand || comp->idle_timeout <= 0 || comp->type != COMP_TYPE_SERVICE) {
+        return;
+    }
+    comp->idle_unused = 0;
+    component_arm_timer(idx, TIMER_IDLE, (uint64_t)comp->idle_timeout * 1000);
+}
 
-        /* Set up per-component logging */
-        char log_dir[] = "/run/graph";
-        char log_path[MAX_PATH];
-        snprintf(log_path, sizeof(log_path), "%s/%s.log", log_dir, comp->name);
+static void idle_check(int idx) {
+    component_t *comp = &components[idx];
+    if (!comp->on_demand || comp->idle_timeout <= 0 ||
+        (comp->state != COMP_ACTIVE && comp->state != COMP_DEGRADED)) {
+        return;
+    }
 
-        /* Create log directory if it doesn't exist */
-        mkdir(log_dir, 0755); /* Ignore errors if it already exists */
+    if (idle_in_use(idx)) {
+        comp->idle_unused = 0;
+    } else if (comp->idle_unused) {
+        LOG_INFO("component '%s' unused for %ds, stopping it until needed",
+                 comp->name, comp->idle_timeout);
+        comp->idle_stopping = 1;
+        component_standby_stop(idx);
+        supervise_signal(comp->pid, component_stop_signal(comp));
+        return;
+    } else {
+        comp->idle_unused = 1;
+    }
+    component_arm_timer(idx, TIMER_IDLE, (uint64_t)comp->idle_timeout * 1000);
+}
 
-        /* Open log file for append */
-        int log_fd = open(log_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
-        if (log_fd >= 0) {
-            /* Redirect stdout and stderr to log file */
-            dup2(log_fd, STDOUT_FILENO);
-            dup2(log_fd, STDERR_FILENO);
-            close(log_fd);
+int component_start(int idx) {
+    component_t *comp = &components[idx];
+    time_t now = time(NULL);
 
-            /* Log startup message */
-            time_t start_time = time(NULL);
-            printf("[%ld] Starting component '%s' (pid %d)\n",
-                   start_time, comp->name, getpid());
-            fflush(stdout);
-        }
+    LOG_INFO("starting component '%s': %s", comp->name, comp->binary);
 
-        /* Execute the component */
-        execv(comp->binary, argv);
+    /* Limits are in place before the child exists; it joins its cgroup
+     * before it execs, so nothing of it runs outside */
+    int cgroup_fd = component_cgroup(comp);
 
-        /* If we get here, exec failed */
-        fprintf(stderr, "graph-resolver: exec '%s' failed: %s\n",
-                comp->binary, strerror(errno));
-        _exit(127);
+    /* A fresh start opens its own sockets, but for those declared in
+     * [sockets]; nothing else is handed to it */
+    held_fds_close(comp);
+    close_sock(&comp->handoff_sock);
+    if (sockets_open(comp) < 0) {
+        return -1;
+    }
+    sockets_unwatch(comp);
+
+    /* stdout/stderr go to a pipe the main loop drains into the log */
+    int out_fd = output_open(comp->name);
+
+    char *argv[MAX_ARGS + 2];
+    spawn_t sp;
+    component_spawn_init(&sp, comp, argv, out_fd);
+    component_spawn_isolate(&sp, comp);
+    sp.cgroup_fd = cgroup_fd;
+    if (comp->n_listen_fds > 0 &&
+        activation_install(&sp, comp->listen_fds, comp->n_listen_fds, comp->name) < 0) {
+        LOG_ERR("cannot pass sockets to '%s'", comp->name);
+        spawn_release(&sp);
+        if (out_fd >= 0) close(out_fd);
+        return -1;
     }
 
-    /* Parent process */
-    comp->pid = pid;
-
-    /* Add child process to cgroup and apply resource limits */
-    if (cgroup_add_process(cgroup_path, pid) < 0) {
-        LOG_WARN("failed to add process %d to cgroup for %s", pid, comp->name);
+    pid_t pid = spawn_run(&sp);
+    if (pid < 0) {
+        LOG_ERR("spawn failed for '%s': %s", comp->name, strerror(errno));
+        if (out_fd >= 0) close(out_fd);
+        return -1;
     }
 
-    if (cgroup_apply_limits(cgroup_path, comp) < 0) {
-        LOG_WARN("failed to apply resource limits to cgroup for %s", comp->name);
+    if (out_fd >= 0) {
+        /* Startup line in the component's log; it has exec'd by now */
+        dprintf(out_fd, "[%ld] Starting component '%s' (pid %d)\n",
+                (long)now, comp->name, pid);
+        close(out_fd);
     }
+    comp->pid = pid;
+    supervise_watch(pid, idx, PROC_MAIN);
 
-    comp->state = COMP_STARTING;
+    component_set_state(comp, COMP_STARTING);
     comp->restart_count++;
     comp->last_restart = now;
 
     /* Transition to readiness waiting or immediately active based on configuration */
     if (comp->readiness_method == READINESS_NONE) {
         /* No readiness check configured - immediately active (backward compatibility) */
-        comp->state = COMP_ACTIVE;
+        component_set_state(comp, COMP_ACTIVE);
 
         /* Register capabilities for service-type components */
         if (comp->type == COMP_TYPE_SERVICE) {
-            for (int i = 0; i < comp->n_provides; i++) {
-                capability_register(comp->provides[i], idx);
-            }
+            component_register_provides(idx);
         }
+        health_begin(idx);
+        idle_begin(idx);
+        standby_spawn(idx);
     } else {
         /* Readiness check configured - wait for readiness signal */
-        comp->state = COMP_READY_WAIT;
+        component_set_state(comp, COMP_READY_WAIT);
         comp->ready_wait_start = now;
+        readiness_begin(idx);
 
         LOG_INFO("component '%s' waiting for readiness signal (method=%d, timeout=%d)",
                  comp->name, comp->readiness_method, comp->readiness_timeout);
 
-        /* Capabilities will be registered when component signals readiness */
+        /* Capabilities will be registered when component signals
+         * readiness - or now, if they are served through its sockets:
+         * dependents may connect at once and are answered once it is up */
+        if (comp->n_listen_fds > 0) {
+            component_register_provides(idx);
+        }
     }
 
     return 0;
@@ -289,23 +1108,56 @@ int component_start(int idx) {
 void component_exited(int idx, int status) {
     component_t *comp = &components[idx];
 
+    standby_handoff_cancel(idx);
+    supervise_unwatch(comp->pid);
+    readiness_end(idx);
+    component_disarm_timer(idx, TIMER_HEALTH_DUE);
+    component_disarm_timer(idx, TIMER_WATCHDOG);
+    component_disarm_timer(idx, TIMER_STOP_KILL);
+
     if (comp->type == COMP_TYPE_ONESHOT) {
         if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
             /* Oneshot succeeded */
-            comp->state = COMP_ONESHOT_DONE;
+            component_set_state(comp, COMP_ONESHOT_DONE);
             LOG_INFO("oneshot '%s' completed successfully", comp->name);
 
             /* Register capabilities */
-            for (int i = 0; i < comp->n_provides; i++) {
-                capability_register(comp->provides[i], idx);
-            }
+            component_register_provides(idx);
         } else {
             /* Oneshot failed */
-            comp->state = COMP_FAILED;
+            component_set_state(comp, COMP_FAILED);
             LOG_ERR("oneshot '%s' failed (status %d)", comp->name, status);
         }
+    } else if (comp->on_demand && (comp->state == COMP_ACTIVE || comp->state == COMP_DEGRADED) &&
+               (comp->idle_stopping || (WIFEXITED(status) && WEXITSTATUS(status) == 0))) {
+        /* Stopped for being unused, or exited cleanly by itself: nothing
+         * failed, it only waits to be needed again */
+        LOG_INFO("service '%s' (pid %d) stopped while idle", comp->name, comp->pid);
+        comp->pid = -1;
+        comp->idle_stopping = 0;
+        component_disarm_timer(idx, TIMER_IDLE);
+        component_standby_stop(idx);
+        close_sock(&comp->handoff_sock);
+        if (comp->n_listen_fds == 0) {
+            component_withdraw_provides(idx);
+        }
+        component_idle(idx);
     } else {
-        /* Service exited */
+        comp->idle_stopping = 0;
+
+        /* Service exited: a warm standby takes over with its capabilities
+         * still up */
+        if ((comp->state == COMP_ACTIVE || comp->state == COMP_DEGRADED) &&
+            comp->standby_ready && requirements_met(comp)) {
+            LOG_WARN("service '%s' (pid %d) exited (status %d), failing over to its standby",
+                     comp->name, comp->pid, status);
+            close_sock(&comp->handoff_sock);
+            if (standby_promote(idx) == 0) {
+                graph_mark_dirty(idx);
+                return;
+            }
+        }
+
         if (comp->state == COMP_READY_WAIT) {
             LOG_ERR("service '%s' (pid %d) exited before becoming ready (status %d)",
                     comp->name, comp->pid, status);
@@ -314,50 +1166,143 @@ void component_exited(int idx, int status) {
                      comp->name, comp->pid, status);
         }
 
-        comp->state = COMP_FAILED;
+        component_set_state(comp, COMP_FAILED);
         comp->pid = -1;
+        close_sock(&comp->handoff_sock);
 
-        /* Withdraw capabilities if they were registered */
-        for (int i = 0; i < comp->n_provides; i++) {
-            capability_withdraw(comp->provides[i]);
+        /* Withdraw capabilities if they were registered; sockets held
+         * for the restart keep taking connections meanwhile */
+        if (comp->n_listen_fds == 0 || !requirements_met(comp)) {
+            component_withdraw_provides(idx);
         }
     }
 
-    /* Clean up cgroup when component exits */
-    const char *cgroup_path = (strlen(comp->cgroup_path) > 0) ? comp->cgroup_path : comp->name;
-    if (cgroup_cleanup(cgroup_path) < 0) {
-        LOG_WARN("failed to cleanup cgroup for %s", comp->name);
+    /* A finished oneshot is not started again; a service keeps its
+     * cgroup for the restart */
+    if (comp->state == COMP_ONESHOT_DONE) {
+        component_release_cgroup(idx);
     }
+
+    /* Let the resolver decide whether to restart it */
+    graph_mark_dirty(idx);
 }
 
-/* Check OOM events for all components with cgroups */
-void check_all_oom_events(void) {
+/* The cgroup of a component lost processes to the OOM killer. Each kill
+ * is reported; a killed main process arrives as an exit of its own and
+ * is restarted from there, while a service that lost a worker keeps
+ * running. With oom_group the kernel kills the whole cgroup, and a main
+ * process it spared is killed here so the component restarts whole. */
+static void component_oom(int cgroup_fd, long kills) {
     for (int i = 0; i < n_components; i++) {
         component_t *comp = &components[i];
-
-        /* Skip inactive or failed components */
-        if (comp->state == COMP_INACTIVE || comp->state == COMP_FAILED) {
-            continue;
+        if (comp->cgroup_fd != cgroup_fd) continue;
+
+        LOG_ERR("component '%s' hit OOM limit (%ld process%s killed)",
+                comp->name, kills, kills == 1 ? "" : "es");
+        metrics_oom(comp->name, kills);
+        if (comp->oom_group && comp->pid > 0 &&
+            comp->state != COMP_INACTIVE && comp->state != COMP_FAILED) {
+            supervise_signal(comp->pid, SIGKILL);
         }
+    }
+}
+
+void component_handle_oom_events(void) {
+    cgroup_oom_dispatch(component_oom);
+}
+
+/* Check OOM events for all components with cgroups */
+void check_all_oom_events(void) {
+    cgroup_oom_scan(component_oom);
+}
 
-        /* Check for OOM events in component's cgroup */
-        const char *cgroup_path = (strlen(comp->cgroup_path) > 0) ? comp->cgroup_path : comp->name;
-        int oom_count = cgroup_check_oom_events(cgroup_path);
+int component_table_reserve(int n) {
+    if (n <= max_components) return 0;
 
-        if (oom_count > 0) {
-            LOG_ERR("component '%s' hit OOM limit, marking as failed", comp->name);
+    int new_max = max_components ? max_components : COMPONENT_TABLE_INITIAL;
+    while (new_max < n) new_max *= 2;
 
-            /* Mark component as failed due to OOM */
-            comp->state = COMP_FAILED;
-            comp->pid = -1;
+    component_t *grown = realloc(components, (size_t)new_max * sizeof(component_t));
+    if (!grown) {
+        LOG_ERR("out of memory growing component table to %d", new_max);
+        return -1;
+    }
+    memset(grown + max_components, 0, (size_t)(new_max - max_components) * sizeof(component_t));
+    components = grown;
+    max_components = new_max;
+    return 0;
+}
 
-            /* Withdraw capabilities */
-            for (int j = 0; j < comp->n_provides; j++) {
-                capability_withdraw(comp->provides[j]);
-            }
+int component_table_capacity(void) {
+    return max_components;
+}
+
+void component_table_clear(void) {
+    for (int i = 0; i < n_components; i++) {
+        if (components[i].cgroup_fd > 0) component_close_cgroup(&components[i]);
+        component_close_sockets(i);
+        component_close_watchdog(i);
+        component_free_strings(&components[i]);
+    }
+    n_components = 0;
+}
+
+/* Declarations that missed the graph cache are parsed on a few threads
+ * when there are enough of them to be worth it */
+#define LOAD_MAX_THREADS 8
+#define LOAD_FILES_PER_THREAD 16
+
+typedef struct {
+    char              path[MAX_PATH];
+    graph_cache_key_t key;
+    int               parsed;      /* 1 parsed, 0 failed, -1 not yet */
+    component_t       comp;
+} load_item_t;
+
+typedef struct {
+    load_item_t *items;
+    int          n;
+    atomic_int   next;
+} load_queue_t;
+
+static void *parse_worker(void *arg) {
+    load_queue_t *q = arg;
+    int i;
+    while ((i = atomic_fetch_add(&q->next, 1)) < q->n) {
+        load_item_t *item = &q->items[i];
+        if (item->parsed < 0) {
+            item->parsed = parse_component_file(item->path, &item->comp) == 0;
+        }
+    }
+    return NULL;
+}
 
-            /* Component will be restarted by graph resolver if needed */
+static void parse_pending(load_item_t *items, int n, int pending) {
+    load_queue_t q = { items, n, 0 };
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int n_threads = pending / LOAD_FILES_PER_THREAD;
+    if (n_threads > cpus) n_threads = (int)cpus;
+    if (n_threads > LOAD_MAX_THREADS) n_threads = LOAD_MAX_THREADS;
+
+    /* Workers only parse; signals stay with the main thread */
+    pthread_t threads[LOAD_MAX_THREADS];
+    int started = 0;
+    if (n_threads > 1) {
+        sigset_t all, old;
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &old);
+        for (int t = 0; t < n_threads - 1; t++) {
+            if (pthread_create(&threads[started], NULL, parse_worker, &q) == 0) {
+                started++;
+            }
         }
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+    }
+
+    parse_worker(&q);
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
     }
 }
 
@@ -368,28 +1313,90 @@ int load_components(const char *dir) {
         return -1;
     }
 
+    load_item_t *items = NULL;
+    int n_items = 0, cap_items = 0;
     struct dirent *ent;
     while ((ent = readdir(d)) != NULL) {
         /* Only .toml files */
         char *dot = strrchr(ent->d_name, '.');
         if (!dot || strcmp(dot, ".toml") != 0) continue;
 
-        char path[MAX_PATH];
-        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        if (n_items == cap_items) {
+            int new_cap = cap_items ? cap_items * 2 : 64;
+            load_item_t *grown = realloc(items, (size_t)new_cap * sizeof(*grown));
+            if (!grown) {
+                LOG_ERR("out of memory listing %s", dir);
+                break;
+            }
+            items = grown;
+            cap_items = new_cap;
+        }
 
-        if (n_components >= MAX_COMPONENTS) {
-            LOG_ERR("component limit reached, skipping %s", path);
-            break;
+        load_item_t *item = &items[n_items];
+        snprintf(item->path, sizeof(item->path), "%s/%s", dir, ent->d_name);
+        struct stat st;
+        if (stat(item->path, &st) < 0) {
+            LOG_ERR("cannot open %s: %s", item->path, strerror(errno));
+            continue;
         }
+        graph_cache_key(&st, &item->key);
+        item->parsed = -1;
+        n_items++;
+    }
+    closedir(d);
 
-        if (parse_component(path, &components[n_components]) == 0) {
-            LOG_INFO("loaded component '%s' from %s",
-                     components[n_components].name, ent->d_name);
-            n_components++;
+    /* Unchanged declarations come straight from the cache */
+    int cached_total = graph_cache_open();
+    int hits = 0;
+    for (int i = 0; i < n_items; i++) {
+        if (graph_cache_lookup(items[i].path, &items[i].key, &items[i].comp) == 0) {
+            items[i].parsed = 1;
+            hits++;
         }
     }
+    graph_cache_close();
 
-    closedir(d);
+    if (hits < n_items) {
+        parse_pending(items, n_items, n_items - hits);
+    }
+    int parsed = 0;
+    for (int i = 0; i < n_items; i++) {
+        if (items[i].parsed == 1) parsed++;
+    }
+    parsed -= hits;
+
+    int first = n_components;
+    graph_cache_key_t *keys = malloc((size_t)(n_items > 0 ? n_items : 1) * sizeof(*keys));
+    for (int i = 0; i < n_items; i++) {
+        load_item_t *item = &items[i];
+        if (item->parsed != 1) continue;
+
+        if (component_table_reserve(n_components + 1) < 0) {
+            LOG_ERR("cannot grow component table, skipping %s", item->path);
+            component_free_strings(&item->comp);
+            continue;
+        }
+        if (component_intern_caps(&item->comp) < 0) {
+            component_free_strings(&item->comp);
+            continue;
+        }
+        if (keys) keys[n_components - first] = item->key;
+        components[n_components] = item->comp;
+        LOG_INFO("loaded component '%s' from %s",
+                 components[n_components].name, strrchr(item->path, '/') + 1);
+        n_components++;
+    }
+
+    /* Rewrite the cache when anything was parsed or a file went away */
+    if (graph_cache_path() && keys && (parsed > 0 || hits != cached_total)) {
+        graph_cache_write(&components[first], keys, n_components - first);
+    }
+    if (graph_cache_path()) {
+        LOG_INFO("%d of %d component declarations from cache", hits, n_items);
+    }
+
+    free(keys);
+    free(items);
     return n_components;
 }
 
@@ -434,14 +1441,14 @@ int validate_component_graph(int warn_only) {
 
 void register_early_capabilities(void) {
     /* Create kernel pseudo-component */
-    if (n_components < MAX_COMPONENTS) {
+    if (component_table_reserve(n_components + 1) == 0) {
         int kidx = n_components++;
         component_t *kern = &components[kidx];
         memset(kern, 0, sizeof(*kern));
         strncpy(kern->name, "kernel", MAX_NAME);
-        strncpy(kern->binary, "[kernel]", MAX_PATH);
+        kern->binary = "[kernel]";
         kern->type = COMP_TYPE_SERVICE;
-        kern->state = COMP_ACTIVE;
+        component_set_state(kern, COMP_ACTIVE);
         kern->pid = 0;
 
         /* Register kernel capabilities */
@@ -457,194 +1464,406 @@ void register_early_capabilities(void) {
     }
 }
 
-/* Helper function - remove directory recursively (internal use) */
-static int remove_directory_recursive(const char *path) {
-    DIR *dir = opendir(path);
-    if (!dir) {
-        return -1;
+/* Helper function to perform FD-passing hot-swap (existing functionality) */
+static int upgrade_with_fd_passing(const char *component_name, component_t *comp) {
+    LOG_INFO("upgrade: attempting FD-passing hot-swap for component '%s' (pid %d)",
+             component_name, comp->pid);
+
+    /* Step 1: Create socketpair for handoff communication */
+    int handoff_socks[2];
+    if (create_handoff_socketpair(handoff_socks) != 0) {
+        LOG_ERR("upgrade: failed to create handoff socketpair for '%s'", component_name);
+        return -4;
     }
 
-    struct dirent *entry;
-    int result = 0;
+    LOG_INFO("upgrade: created handoff socketpair for '%s': %d <-> %d",
+             component_name, handoff_socks[0], handoff_socks[1]);
 
-    while ((entry = readdir(dir)) != NULL && result == 0) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-            continue;
-        }
+    /* Step 2: Spawn new process with handoff socket */
+    int out_fd = output_open(comp->name);
+    char handoff_fd_str[16];
+    snprintf(handoff_fd_str, sizeof(handoff_fd_str), "%d", HANDOFF_FD);
 
-        char full_path[512];
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
+    char *argv[MAX_ARGS + 2];
+    spawn_t sp;
+    component_spawn_init(&sp, comp, argv, out_fd);
+    sp.cgroup_fd = component_cgroup(comp);
+    spawn_fd(&sp, handoff_socks[1], HANDOFF_FD);
+    spawn_setenv(&sp, HANDOFF_FD_ENV, handoff_fd_str);
 
-        struct stat st;
-        if (stat(full_path, &st) == 0) {
-            if (S_ISDIR(st.st_mode)) {
-                result = remove_directory_recursive(full_path);
-            } else {
-                result = unlink(full_path);
-            }
-        }
+    LOG_INFO("upgrade: executing new instance of '%s'", component_name);
+    pid_t new_pid = spawn_run(&sp);
+    if (new_pid < 0) {
+        LOG_ERR("upgrade: spawn failed for '%s': %s", component_name, strerror(errno));
+        close(handoff_socks[0]);
+        close(handoff_socks[1]);
+        if (out_fd >= 0) close(out_fd);
+        return -4;
     }
 
-    closedir(dir);
+    /* Parent process - graph resolver */
+    close(handoff_socks[1]); /* Close new process's end */
+    if (out_fd >= 0) close(out_fd);
+    supervise_watch(new_pid, comp - components, PROC_MAIN);
 
-    if (result == 0) {
-        result = rmdir(path);
+    LOG_INFO("upgrade: new instance of '%s' started (pid %d)", component_name, new_pid);
+
+    /* Step 3: Signal old process to initiate handoff */
+    if (supervise_signal(comp->pid, SIGUSR1) != 0) {
+        LOG_ERR("upgrade: failed to signal old process %d: %s", comp->pid, strerror(errno));
+        close(handoff_socks[0]);
+        supervise_signal(new_pid, SIGTERM); /* Clean up new process */
+        return -4;
     }
 
-    return result;
-}
+    LOG_INFO("upgrade: sent SIGUSR1 to old process %d for handoff", comp->pid);
 
-/* Helper function - calculate directory size recursively */
-static size_t calculate_directory_size(const char *path) {
-    struct stat st;
-    size_t total_size = 0;
+    /* Step 4: Wait for handoff completion from old process */
+    int handoff_result = wait_handoff_complete(handoff_socks[0], 10000); /* 10 second timeout */
 
-    if (stat(path, &st) != 0) {
-        return 0;
+    if (handoff_result != 0) {
+        LOG_ERR("upgrade: FD-passing handoff completion failed for '%s'", component_name);
+        close(handoff_socks[0]);
+        supervise_signal(new_pid, SIGTERM); /* Clean up new process */
+        return -4;
     }
 
-    if (S_ISREG(st.st_mode)) {
-        return st.st_size;
+    LOG_INFO("upgrade: received handoff complete from old process for '%s'", component_name);
+    close(handoff_socks[0]);
+
+    /* Step 5: Update component record with new PID and wait for readiness */
+    pid_t old_pid = comp->pid;
+    comp->pid = new_pid;
+    component_set_state(comp, comp->readiness_method == READINESS_NONE ? COMP_ACTIVE : COMP_READY_WAIT);
+    comp->ready_wait_start = time(NULL);
+
+    LOG_INFO("upgrade: transitioned component '%s' from pid %d to pid %d (FD-passing)",
+             component_name, old_pid, new_pid);
+
+    /* Old process should exit cleanly after sending handoff complete */
+    /* Give it a moment, then verify it's gone */
+    sleep(1);
+    if (supervise_signal(old_pid, 0) == 0) {
+        LOG_WARN("upgrade: old process %d still alive after handoff, sending SIGTERM", old_pid);
+        supervise_signal(old_pid, SIGTERM);
     }
 
-    if (S_ISDIR(st.st_mode)) {
-        DIR *dir = opendir(path);
-        if (!dir) {
-            return 0;
-        }
+    return 0; /* Success */
+}
 
-        struct dirent *entry;
-        while ((entry = readdir(dir)) != NULL) {
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-                continue;
-            }
+/* Hot-swaps onto a standby waiting for the old main process to hand its
+ * descriptors over. The handoff socket sits in the main epoll set and
+ * what arrives is taken a piece at a time, so a process that stalls
+ * halfway holds up nothing but its own upgrade; one not done within
+ * STANDBY_HANDOFF_MS is stopped, and the standby opens its own. */
+#define MAX_STANDBY_HANDOFFS 16
+#define STANDBY_HANDOFF_MS 10000
+
+typedef struct {
+    event_source_t src;             /* first: epoll hands back &src */
+    char name[MAX_NAME];            /* the component, and the pid handing over */
+    pid_t pid;
+    handoff_rx_t *rx;               /* NULL when the slot is free */
+    int timer;
+} standby_handoff_t;
+
+static standby_handoff_t standby_handoffs[MAX_STANDBY_HANDOFFS];
+static int handoff_epoll_fd = -1;
+
+void component_handoff_init(int epoll_fd) {
+    handoff_epoll_fd = epoll_fd;
+}
 
-            char full_path[512];
-            snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
-            total_size += calculate_directory_size(full_path);
+static standby_handoff_t *handoff_pending(int idx) {
+    const component_t *comp = &components[idx];
+    for (int i = 0; i < MAX_STANDBY_HANDOFFS; i++) {
+        standby_handoff_t *h = &standby_handoffs[i];
+        if (h->rx && h->pid == comp->pid && strcmp(h->name, comp->name) == 0) {
+            return h;
         }
+    }
+    return NULL;
+}
 
-        closedir(dir);
+/* The component a handoff is for, while the process handing over is
+ * still its main one; -1 once it is not */
+static int handoff_owner(const standby_handoff_t *h) {
+    for (int i = 0; i < n_components; i++) {
+        if (components[i].pid == h->pid && strcmp(components[i].name, h->name) == 0) {
+            return i;
+        }
     }
+    return -1;
+}
 
-    return total_size;
+static void handoff_close(standby_handoff_t *h) {
+    timer_cancel(h->timer);
+    h->timer = 0;
+    if (handoff_epoll_fd >= 0) {
+        epoll_ctl(handoff_epoll_fd, EPOLL_CTL_DEL, h->src.fd, NULL);
+    }
+    h->src.fd = -1;
+    handoff_rx_free(h->rx);
+    h->rx = NULL;
+    h->pid = 0;
+    h->name[0] = '\0';
 }
 
-/* Helper function to perform FD-passing hot-swap (existing functionality) */
-static int upgrade_with_fd_passing(const char *component_name, component_t *comp) {
-    LOG_INFO("upgrade: attempting FD-passing hot-swap for component '%s' (pid %d)",
-             component_name, comp->pid);
+/* The main process of component idx exited: its handoff, if it was
+ * giving one, is over */
+static void standby_handoff_cancel(int idx) {
+    standby_handoff_t *h = handoff_pending(idx);
+    if (h) {
+        LOG_WARN("upgrade: pid %d of '%s' exited while handing over", h->pid, h->name);
+        handoff_close(h);
+    }
+}
 
-    /* Step 1: Create socketpair for handoff communication */
-    int handoff_socks[2];
-    if (create_handoff_socketpair(handoff_socks) != 0) {
-        LOG_ERR("upgrade: failed to create handoff socketpair for '%s'", component_name);
+/* Put the standby in the place of old_pid. received is the number of
+ * descriptors it handed over, now held, or -1 if it did not. */
+static int standby_take_over(int idx, pid_t old_pid, int received) {
+    component_t *comp = &components[idx];
+
+    /* After a handoff the old process exits by itself; otherwise it goes
+     * first, so its ports are free for the standby */
+    if (received < 0) {
+        supervise_signal(old_pid, SIGTERM);
+    }
+    if (!comp->standby_ready) {
+        LOG_ERR("upgrade: standby of '%s' went away, pid %d not replaced", comp->name, old_pid);
+        return -4;
+    }
+    if (standby_promote(idx) != 0) {
         return -4;
     }
+    LOG_INFO("upgrade: transitioned component '%s' from pid %d to standby pid %d",
+             comp->name, old_pid, comp->pid);
+    return 0;
+}
 
-    LOG_INFO("upgrade: created handoff socketpair for '%s': %d <-> %d",
-             component_name, handoff_socks[0], handoff_socks[1]);
+/* A handoff is over: ok if everything arrived */
+static void handoff_finish(standby_handoff_t *h, int ok) {
+    int idx = handoff_owner(h);
+    pid_t old_pid = h->pid;
+    int received = -1;
+
+    if (ok && idx >= 0) {
+        handoff_fd_t *descs = NULL;
+        int n = handoff_rx_take(h->rx, &descs);
+        int *fds = n >= 0 ? malloc((size_t)(n > 0 ? n : 1) * sizeof(int)) : NULL;
+        if (fds) {
+            component_t *comp = &components[idx];
+            held_fds_close(comp);
+            for (int i = 0; i < n; i++) fds[i] = descs[i].fd;
+            comp->held_fds = fds;
+            comp->n_held_fds = n;
+            received = n;
+        } else {
+            for (int i = 0; i < n; i++) close(descs[i].fd);
+        }
+        free(descs);
+    }
+    if (received < 0) {
+        LOG_WARN("upgrade: no descriptors from pid %d of '%s'", old_pid, h->name);
+    }
+    handoff_close(h);
 
-    /* Step 2: Fork new process with handoff socket */
-    pid_t new_pid = fork();
-    if (new_pid < 0) {
-        LOG_ERR("upgrade: fork failed for '%s': %s", component_name, strerror(errno));
-        close(handoff_socks[0]);
-        close(handoff_socks[1]);
-        return -4;
+    if (idx >= 0) {
+        standby_take_over(idx, old_pid, received);
     }
+}
 
-    if (new_pid == 0) {
-        /* Child process - new component instance */
-        close(handoff_socks[0]); /* Close resolver's end */
+void component_handoff_event(event_source_t *src) {
+    standby_handoff_t *h = (standby_handoff_t *)src;
+    if (!h->rx) return;
 
-        /* Set up HANDOFF_FD environment variable */
-        char handoff_fd_str[32];
-        snprintf(handoff_fd_str, sizeof(handoff_fd_str), "%d", handoff_socks[1]);
-        setenv(HANDOFF_FD_ENV, handoff_fd_str, 1);
+    int r = handoff_rx_feed(h->rx, h->src.fd);
+    if (r != 0) {
+        handoff_finish(h, r > 0);
+    }
+}
 
-        /* Duplicate the handoff socket to HANDOFF_FD (4) */
-        if (dup2(handoff_socks[1], HANDOFF_FD) < 0) {
-            fprintf(stderr, "upgrade: dup2 failed for handoff fd: %s\n", strerror(errno));
-            _exit(127);
+static void handoff_timer_fired(int handle) {
+    for (int i = 0; i < MAX_STANDBY_HANDOFFS; i++) {
+        standby_handoff_t *h = &standby_handoffs[i];
+        if (h->rx && handle != 0 && h->timer == handle) {
+            h->timer = 0;
+            LOG_WARN("upgrade: pid %d of '%s' did not hand over within %d ms",
+                     h->pid, h->name, STANDBY_HANDOFF_MS);
+            handoff_finish(h, 0);
+            return;
         }
-        close(handoff_socks[1]);
+    }
+}
 
-        /* Prepare argv for new process */
-        char *argv[MAX_ARGS + 2];
-        argv[0] = comp->binary;
-        for (int i = 0; i < comp->argc; i++) {
-            argv[i + 1] = comp->args[i];
-        }
-        argv[comp->argc + 1] = NULL;
+/* Ask the main process of component idx with SIGUSR1 for its
+ * descriptors, received from the main loop. Returns 0 once asked. */
+static int handoff_begin(int idx) {
+    component_t *comp = &components[idx];
+    standby_handoff_t *h = NULL;
+    for (int i = 0; i < MAX_STANDBY_HANDOFFS && !h; i++) {
+        if (!standby_handoffs[i].rx) h = &standby_handoffs[i];
+    }
+    if (!h || !(h->rx = handoff_rx_new(1))) {
+        return -1;
+    }
 
-        /* Reset signal handlers */
-        signal(SIGCHLD, SIG_DFL);
-        signal(SIGPIPE, SIG_DFL);
-        signal(SIGTERM, SIG_DFL);
-        signal(SIGINT, SIG_DFL);
-        signal(SIGHUP, SIG_DFL);
-        signal(SIGUSR1, SIG_DFL);
+    h->src.type = EVENT_HANDOFF;
+    h->src.fd = comp->handoff_sock;
+    h->pid = comp->pid;
+    snprintf(h->name, sizeof(h->name), "%s", comp->name);
+    if (handoff_epoll_fd >= 0) {
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP, .data.ptr = &h->src };
+        if (epoll_ctl(handoff_epoll_fd, EPOLL_CTL_ADD, h->src.fd, &ev) < 0) {
+            LOG_WARN("upgrade: cannot watch the handoff socket of '%s': %s",
+                     comp->name, strerror(errno));
+            handoff_close(h);
+            return -1;
+        }
+    }
+    int handle = timer_add(timer_now_ms() + STANDBY_HANDOFF_MS, TIMER_HANDOFF, -1);
+    h->timer = handle > 0 ? handle : 0;
 
-        /* Create new session */
-        setsid();
+    if (supervise_signal(comp->pid, SIGUSR1) != 0) {
+        handoff_close(h);
+        return -1;
+    }
+    LOG_INFO("upgrade: waiting for pid %d of '%s' to hand over", comp->pid, comp->name);
+    return 0;
+}
 
-        LOG_INFO("upgrade: executing new instance of '%s'", component_name);
+/* Hot-swap onto the warmed standby. A main process that came in through
+ * one of our handoff sockets is asked for its descriptors, which are held
+ * for the standby after this one, and the swap finishes once they are
+ * in; any other is stopped, and the standby opens its own. A standby
+ * forked before the binary was last replaced would run the old code: it
+ * is replaced instead. */
+static int upgrade_with_standby(const char *component_name, component_t *comp) {
+    int idx = comp - components;
 
-        /* Execute the new component */
-        execv(comp->binary, argv);
+    struct stat st;
+    if (stat(comp->binary, &st) == 0 && st.st_mtime >= comp->standby_started) {
+        LOG_INFO("upgrade: standby of '%s' predates %s, replacing it",
+                 component_name, comp->binary);
+        standby_discard(comp);
+        standby_spawn(idx);
+        return -4;
+    }
 
-        /* If we get here, exec failed */
-        fprintf(stderr, "upgrade: exec '%s' failed: %s\n", comp->binary, strerror(errno));
-        _exit(127);
+    if (comp->handoff_sock > 0 && handoff_begin(idx) == 0) {
+        return 0;
     }
+    return standby_take_over(idx, comp->pid, -1);
+}
 
-    /* Parent process - graph resolver */
-    close(handoff_socks[1]); /* Close new process's end */
+/* CRIU daemons still serving pages: lazy-pages daemons paging in
+ * restored processes and page servers feeding lazy restores on other
+ * nodes. A scratch image directory goes once its daemon exits. */
+#define MAX_PAGE_DAEMONS 16
 
-    LOG_INFO("upgrade: new instance of '%s' started (pid %d)", component_name, new_pid);
+typedef struct {
+    pid_t pid;                          /* 0 when the slot is free */
+    int scratch;
+    char dir[MAX_CHECKPOINT_PATH];
+} page_daemon_t;
 
-    /* Step 3: Signal old process to initiate handoff */
-    if (kill(comp->pid, SIGUSR1) != 0) {
-        LOG_ERR("upgrade: failed to signal old process %d: %s", comp->pid, strerror(errno));
-        close(handoff_socks[0]);
-        kill(new_pid, SIGTERM); /* Clean up new process */
-        return -4;
+static page_daemon_t page_daemons[MAX_PAGE_DAEMONS];
+
+static page_daemon_t *page_daemon_slot(void) {
+    for (int i = 0; i < MAX_PAGE_DAEMONS; i++) {
+        if (page_daemons[i].pid == 0) {
+            return &page_daemons[i];
+        }
     }
+    return NULL;
+}
 
-    LOG_INFO("upgrade: sent SIGUSR1 to old process %d for handoff", comp->pid);
+static void page_daemon_add(page_daemon_t *d, pid_t pid, int idx, proc_role_t role,
+                            const char *dir, int scratch) {
+    d->pid = pid;
+    d->scratch = scratch;
+    snprintf(d->dir, sizeof(d->dir), "%s", dir);
+    supervise_watch(pid, idx, role);
+}
 
-    /* Step 4: Wait for handoff completion from old process */
-    int handoff_result = wait_handoff_complete(handoff_socks[0], 10000); /* 10 second timeout */
+static void page_daemon_exited(pid_t pid, int idx, proc_role_t role, int status) {
+    const char *what = role == PROC_LAZY_PAGES ? "lazy-pages daemon" : "page server";
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        LOG_INFO("%s %d of '%s' finished", what, pid, components[idx].name);
+    } else {
+        LOG_WARN("%s %d of '%s' failed (status %d)", what, pid, components[idx].name, status);
+    }
 
-    if (handoff_result != 0) {
-        LOG_ERR("upgrade: FD-passing handoff completion failed for '%s'", component_name);
-        close(handoff_socks[0]);
-        kill(new_pid, SIGTERM); /* Clean up new process */
-        return -4;
+    for (int i = 0; i < MAX_PAGE_DAEMONS; i++) {
+        if (page_daemons[i].pid == pid) {
+            if (page_daemons[i].scratch) {
+                checkpoint_remove_directory(page_daemons[i].dir);
+            }
+            page_daemons[i].pid = 0;
+            break;
+        }
     }
+}
 
-    LOG_INFO("upgrade: received handoff complete from old process for '%s'", component_name);
-    close(handoff_socks[0]);
+/* Bring component idx back from image_dir. lazy resumes the process at
+ * once and pages its memory in afterwards, from page_server ("host[:port]")
+ * if given; without lazy-pages support a local restore copies all of it
+ * first instead. A scratch image_dir is removed once nothing needs it.
+ * Returns the restored pid or a negative CRIU error code. */
+static pid_t restore_images(int idx, const char *image_dir, int scratch, int lazy,
+                            const char *page_server) {
+    component_t *comp = &components[idx];
+    char address[256] = "";
+    int port = CHECKPOINT_PAGE_SERVER_PORT;
+    pid_t pid = CHECKPOINT_ERROR_RESTORE_FAILED;
+
+    if (page_server) {
+        lazy = 1;
+        snprintf(address, sizeof(address), "%s", page_server);
+        char *colon = strrchr(address, ':');
+        if (colon) {
+            *colon = '\0';
+            port = atoi(colon + 1);
+        }
+        if (!address[0] || port <= 0 || port > 65535) {
+            LOG_ERR("restore: bad page server '%s' for '%s'", page_server, comp->name);
+            goto out;
+        }
+    }
 
-    /* Step 5: Update component record with new PID and wait for readiness */
-    pid_t old_pid = comp->pid;
-    comp->pid = new_pid;
-    comp->state = (comp->readiness_method == READINESS_NONE) ? COMP_ACTIVE : COMP_READY_WAIT;
-    comp->ready_wait_start = time(NULL);
+    if (lazy && criu_lazy_pages_supported() == CHECKPOINT_SUCCESS) {
+        page_daemon_t *slot = page_daemon_slot();
+        pid_t daemon = slot ? criu_lazy_pages_start(image_dir, page_server ? address : NULL, port) :
+                              CHECKPOINT_ERROR_RESTORE_FAILED;
+        if (daemon > 0) {
+            pid = criu_restore_lazy(image_dir);
+            if (pid > 0) {
+                page_daemon_add(slot, daemon, idx, PROC_LAZY_PAGES, image_dir, scratch);
+                LOG_INFO("restore: '%s' resumed as pid %d, its memory follows on demand",
+                         comp->name, pid);
+                return pid;
+            }
+            kill(daemon, SIGKILL);
+            waitpid(daemon, NULL, 0);
+        }
+        if (page_server) {
+            goto out;
+        }
+        LOG_WARN("restore: lazy restore of '%s' failed, restoring all of its memory first",
+                 comp->name);
+    } else if (page_server) {
+        LOG_ERR("restore: '%s' cannot page in from %s without lazy-pages support",
+                comp->name, page_server);
+        goto out;
+    }
 
-    LOG_INFO("upgrade: transitioned component '%s' from pid %d to pid %d (FD-passing)",
-             component_name, old_pid, new_pid);
+    pid = criu_restore_process(image_dir);
 
-    /* Old process should exit cleanly after sending handoff complete */
-    /* Give it a moment, then verify it's gone */
-    sleep(1);
-    if (kill(old_pid, 0) == 0) {
-        LOG_WARN("upgrade: old process %d still alive after handoff, sending SIGTERM", old_pid);
-        kill(old_pid, SIGTERM);
+out:
+    if (scratch) {
+        checkpoint_remove_directory(image_dir);
     }
-
-    return 0; /* Success */
+    return pid;
 }
 
 /* Helper function to perform checkpoint-based hot-swap */
@@ -672,7 +1891,7 @@ static int upgrade_with_checkpoint(const char *component_name, component_t *comp
         LOG_WARN("upgrade: checkpoint failed for '%s': %s",
                 component_name, checkpoint_error_string(checkpoint_result));
         /* Clean up failed checkpoint directory */
-        remove_directory_recursive(checkpoint_path);
+        checkpoint_remove_directory(checkpoint_path);
         return -4; /* Will trigger fallback in main function */
     }
 
@@ -698,7 +1917,7 @@ static int upgrade_with_checkpoint(const char *component_name, component_t *comp
     }
 
     /* Calculate checkpoint size */
-    metadata.image_size = calculate_directory_size(checkpoint_path);
+    metadata.image_size = checkpoint_directory_size(checkpoint_path);
 
     /* Save metadata */
     if (checkpoint_save_metadata(checkpoint_path, &metadata) != 0) {
@@ -706,40 +1925,34 @@ static int upgrade_with_checkpoint(const char *component_name, component_t *comp
         /* Continue anyway - checkpoint might still work */
     }
 
-    /* Now attempt to restore the process */
-    pid_t new_pid = criu_restore_process(checkpoint_path);
+    /* Now attempt to restore the process, resuming it before its memory
+     * is back; the temporary checkpoint goes once that is done */
+    pid_t new_pid = restore_images(comp - components, checkpoint_path, 1, 1, NULL);
 
     if (new_pid < 0) {
         LOG_ERR("upgrade: checkpoint restore failed for '%s': %s",
                 component_name, checkpoint_error_string(new_pid));
-        /* Clean up failed checkpoint */
-        remove_directory_recursive(checkpoint_path);
         return -4; /* Will trigger fallback */
     }
 
     LOG_INFO("upgrade: successfully restored process as pid %d for '%s'", new_pid, component_name);
+    supervise_watch(new_pid, comp - components, PROC_MAIN);
 
     /* Update component record with new PID */
     pid_t old_pid = comp->pid;
     comp->pid = new_pid;
-    comp->state = (comp->readiness_method == READINESS_NONE) ? COMP_ACTIVE : COMP_READY_WAIT;
+    component_set_state(comp, comp->readiness_method == READINESS_NONE ? COMP_ACTIVE : COMP_READY_WAIT);
     comp->ready_wait_start = time(NULL);
 
     LOG_INFO("upgrade: transitioned component '%s' from pid %d to pid %d (checkpoint)",
              component_name, old_pid, new_pid);
 
     /* Terminate the old process since we left it running during checkpoint */
-    if (kill(old_pid, SIGTERM) != 0) {
+    if (supervise_signal(old_pid, SIGTERM) != 0) {
         LOG_WARN("upgrade: failed to terminate old process %d: %s", old_pid, strerror(errno));
         /* Try harder */
         sleep(1);
-        kill(old_pid, SIGKILL);
-    }
-
-    /* Clean up the temporary checkpoint (successful restore) */
-    if (remove_directory_recursive(checkpoint_path) != 0) {
-        LOG_WARN("upgrade: failed to clean up temporary checkpoint %s", checkpoint_path);
-        /* Not critical - continue */
+        supervise_signal(old_pid, SIGKILL);
     }
 
     return 0; /* Success */
@@ -751,13 +1964,11 @@ static int upgrade_with_restart(const char *component_name, component_t *comp) {
              component_name);
 
     /* Withdraw capabilities first to signal unavailability */
-    for (int i = 0; i < comp->n_provides; i++) {
-        capability_withdraw(comp->provides[i]);
-    }
+    component_withdraw_provides(comp - components);
 
     /* Terminate old process */
     pid_t old_pid = comp->pid;
-    if (kill(old_pid, SIGTERM) != 0) {
+    if (supervise_signal(old_pid, SIGTERM) != 0) {
         LOG_ERR("upgrade: failed to terminate old process %d: %s", old_pid, strerror(errno));
         return -4;
     }
@@ -783,14 +1994,16 @@ static int upgrade_with_restart(const char *component_name, component_t *comp) {
 
     if (wait_time >= max_wait) {
         LOG_WARN("upgrade: old process %d did not exit, killing", old_pid);
-        kill(old_pid, SIGKILL);
+        supervise_signal(old_pid, SIGKILL);
         waitpid(old_pid, NULL, 0); /* Clean up zombie */
     }
+    supervise_unwatch(old_pid); /* reaped here, not by the main loop */
 
     /* Reset component state and restart */
     comp->pid = 0;
-    comp->state = COMP_INACTIVE;
+    component_set_state(comp, COMP_INACTIVE);
     comp->restart_count = 0;
+    comp->failures = 0;
 
     LOG_INFO("upgrade: restarting component '%s' after terminating pid %d", component_name, old_pid);
 
@@ -811,7 +2024,8 @@ static int upgrade_with_restart(const char *component_name, component_t *comp) {
  * to attempt first, with automatic fallback if that level fails.
  *
  * Returns:
- *   0 = success (upgrade completed)
+ *   0 = success (upgrade completed, or with a standby and a handoff,
+ *       finishing from the main loop)
  *  -1 = component not found
  *  -2 = component doesn't support any hot-swap method
  *  -3 = component not currently active
@@ -844,6 +2058,22 @@ int component_upgrade(const char *component_name) {
     LOG_INFO("upgrade: initiating upgrade for component '%s' (handoff=%d, pid=%d)",
              component_name, comp->handoff, comp->pid);
 
+    if (handoff_pending(idx)) {
+        LOG_ERR("upgrade: '%s' is already handing over to its standby", component_name);
+        return -4;
+    }
+
+    /* A warmed standby takes over at once, or once the old process has
+     * handed its descriptors over */
+    if (comp->standby_ready) {
+        if (upgrade_with_standby(component_name, comp) == 0) {
+            LOG_INFO("upgrade: standby hot-swap of '%s' under way", component_name);
+            return 0;
+        }
+        LOG_WARN("upgrade: standby of '%s' not used, trying handoff %d",
+                 component_name, comp->handoff);
+    }
+
     int result = -4; /* Default to failure */
 
     /* Three-level fallback strategy */
@@ -891,11 +2121,13 @@ int component_upgrade(const char *component_name) {
         if (comp->readiness_method == READINESS_NONE) {
             /* Re-register capabilities immediately */
             int idx = comp - components;
-            for (int i = 0; i < comp->n_provides; i++) {
-                capability_register(comp->provides[i], idx);
-            }
+            component_register_provides(idx);
+            health_begin(idx);
+            idle_begin(idx);
+            standby_spawn(idx);
             LOG_INFO("upgrade: component '%s' immediately active", component_name);
         } else {
+            readiness_begin(idx);
             LOG_INFO("upgrade: component '%s' waiting for readiness signal", component_name);
         }
     }
@@ -948,14 +2180,17 @@ int component_checkpoint(const char *component_name) {
         return -4;
     }
 
-    /* Perform checkpoint (leave process running) */
-    int checkpoint_result = criu_checkpoint_process(comp->pid, checkpoint_path, 1);
+    /* Perform checkpoint (leave process running), pre-dumping first so the
+     * service is only stopped for the pages it dirtied meanwhile */
+    int passes = 0;
+    int checkpoint_result = criu_checkpoint_iterative(comp->pid, checkpoint_path, 1,
+                                                      CHECKPOINT_PRE_DUMP_PASSES, &passes);
 
     if (checkpoint_result != CHECKPOINT_SUCCESS) {
         LOG_ERR("checkpoint: failed to checkpoint '%s': %s",
                 component_name, checkpoint_error_string(checkpoint_result));
         /* Clean up failed checkpoint directory */
-        remove_directory_recursive(checkpoint_path);
+        checkpoint_remove_directory(checkpoint_path);
         return -4;
     }
 
@@ -967,7 +2202,8 @@ int component_checkpoint(const char *component_name) {
     metadata.original_pid = comp->pid;
     metadata.timestamp = time(NULL);
     metadata.leave_running = 1;
-    metadata.image_size = calculate_directory_size(checkpoint_path);
+    metadata.image_size = checkpoint_directory_size(checkpoint_path);
+    checkpoint_metadata_set_chain(&metadata, passes);
 
     /* Get CRIU version info */
     criu_get_version(&metadata.criu_version);
@@ -979,7 +2215,17 @@ int component_checkpoint(const char *component_name) {
         strncat(metadata.capabilities, comp->provides[i], sizeof(metadata.capabilities) - strlen(metadata.capabilities) - 1);
     }
 
-    /* Save metadata */
+    /* Pages shared with earlier checkpoints are only stored once */
+    if (checkpoint_store_pack(checkpoint_path) < 0) {
+        LOG_WARN("checkpoint: keeping raw page images for '%s'", component_name);
+    } else {
+        LOG_INFO("checkpoint: %zu KB of images stored in %zu KB for '%s'",
+                 metadata.image_size / 1024,
+                 (checkpoint_directory_size(checkpoint_path) +
+                  checkpoint_store_share(checkpoint_path)) / 1024, component_name);
+    }
+
+    /* Save metadata last, so the catalog records the packed size */
     if (checkpoint_save_metadata(checkpoint_path, &metadata) != 0) {
         LOG_WARN("checkpoint: failed to save metadata for '%s'", component_name);
     }
@@ -991,7 +2237,8 @@ int component_checkpoint(const char *component_name) {
 }
 
 /* Restore a component from a specific checkpoint */
-int component_restore(const char *component_name, const char *checkpoint_id) {
+static int restore_component(const char *component_name, const char *checkpoint_id,
+                             int lazy, const char *page_server) {
     /* Find component by name */
     int idx = -1;
     for (int i = 0; i < n_components; i++) {
@@ -1042,26 +2289,40 @@ int component_restore(const char *component_name, const char *checkpoint_id) {
         LOG_INFO("restore: terminating current process %d for '%s'", comp->pid, component_name);
 
         /* Withdraw capabilities first */
-        for (int i = 0; i < comp->n_provides; i++) {
-            capability_withdraw(comp->provides[i]);
-        }
+        component_withdraw_provides(idx);
 
-        if (kill(comp->pid, SIGTERM) == 0) {
+        if (supervise_signal(comp->pid, SIGTERM) == 0) {
             /* Wait for process to exit */
             int wait_time = 0;
             const int max_wait = 10;
-            while (wait_time < max_wait && kill(comp->pid, 0) == 0) {
+            while (wait_time < max_wait && supervise_signal(comp->pid, 0) == 0) {
                 sleep(1);
                 wait_time++;
             }
             if (wait_time >= max_wait) {
-                kill(comp->pid, SIGKILL);
+                supervise_signal(comp->pid, SIGKILL);
             }
         }
     }
 
+    /* CRIU needs the page images back: rebuild them on /run, unless the
+     * pages come from a page server */
+    char restore_path[MAX_CHECKPOINT_PATH];
+    snprintf(restore_path, sizeof(restore_path), "%s", checkpoint_path);
+    int unpacked = !page_server && checkpoint_store_is_packed(checkpoint_path);
+    if (unpacked) {
+        snprintf(restore_path, sizeof(restore_path), "%s/%s/%s.restore",
+                 CHECKPOINT_RUN_DIR, component_name, actual_checkpoint_id);
+        checkpoint_remove_directory(restore_path);
+        if (checkpoint_store_unpack(checkpoint_path, restore_path) != 0) {
+            LOG_ERR("restore: cannot rebuild checkpoint %s of '%s' from the chunk store",
+                    actual_checkpoint_id, component_name);
+            return -4;
+        }
+    }
+
     /* Perform restore */
-    pid_t new_pid = criu_restore_process(checkpoint_path);
+    pid_t new_pid = restore_images(idx, restore_path, unpacked, lazy, page_server);
 
     if (new_pid < 0) {
         LOG_ERR("restore: failed to restore '%s' from checkpoint %s: %s",
@@ -1069,9 +2330,11 @@ int component_restore(const char *component_name, const char *checkpoint_id) {
         return -4;
     }
 
-    /* Update component record */
+    /* Update component record; restored processes are not our children,
+     * so their exit is only seen through the pidfd */
     comp->pid = new_pid;
-    comp->state = (comp->readiness_method == READINESS_NONE) ? COMP_ACTIVE : COMP_READY_WAIT;
+    supervise_watch(new_pid, idx, PROC_MAIN);
+    component_set_state(comp, comp->readiness_method == READINESS_NONE ? COMP_ACTIVE : COMP_READY_WAIT);
     comp->ready_wait_start = time(NULL);
 
     LOG_INFO("restore: successfully restored component '%s' as pid %d from checkpoint %s",
@@ -1080,91 +2343,136 @@ int component_restore(const char *component_name, const char *checkpoint_id) {
     /* Re-register capabilities if no readiness protocol */
     if (comp->readiness_method == READINESS_NONE) {
         int idx = comp - components;
-        for (int i = 0; i < comp->n_provides; i++) {
-            capability_register(comp->provides[i], idx);
-        }
+        component_register_provides(idx);
+        health_begin(idx);
+        idle_begin(idx);
+    } else {
+        readiness_begin(idx);
     }
 
     return 0; /* Success */
 }
 
-/* Execute health check for a component
- * Returns: 0=success, 1=failure, 2=timeout */
-static int execute_health_check(component_t *comp) {
-    if (!comp->health_check[0]) {
-        return 0; /* No health check configured - assume healthy */
-    }
+int component_restore(const char *component_name, const char *checkpoint_id) {
+    return restore_component(component_name, checkpoint_id, 0, NULL);
+}
 
-    LOG_INFO("running health check for '%s': %s", comp->name, comp->health_check);
+int component_restore_lazy(const char *component_name, const char *checkpoint_id,
+                           const char *page_server) {
+    return restore_component(component_name, checkpoint_id, 1, page_server);
+}
 
-    pid_t pid = fork();
-    if (pid < 0) {
-        LOG_ERR("fork failed for health check '%s': %s", comp->name, strerror(errno));
-        return 1; /* Treat fork failure as health failure */
+/* Serve a checkpoint's pages to a lazy restore on another node */
+int component_serve_pages(const char *component_name, const char *checkpoint_id, int port,
+                          char *image_dir, size_t image_dir_size) {
+    int idx = -1;
+    for (int i = 0; i < n_components; i++) {
+        if (strcmp(components[i].name, component_name) == 0) {
+            idx = i;
+            break;
+        }
+    }
+    if (idx == -1) {
+        LOG_ERR("migrate: component '%s' not found", component_name);
+        return -1;
     }
 
-    if (pid == 0) {
-        /* Child process - execute health check */
-        char *argv[] = { "/bin/sh", "-c", comp->health_check, NULL };
+    if (criu_is_supported() != CHECKPOINT_SUCCESS) {
+        LOG_ERR("migrate: CRIU not supported on this system");
+        return -2;
+    }
 
-        /* Reset signal handlers */
-        signal(SIGCHLD, SIG_DFL);
-        signal(SIGPIPE, SIG_DFL);
-        signal(SIGTERM, SIG_DFL);
-        signal(SIGINT, SIG_DFL);
-        signal(SIGHUP, SIG_DFL);
+    char id[CHECKPOINT_ID_MAX_LEN];
+    char checkpoint_path[MAX_CHECKPOINT_PATH];
+    if (checkpoint_id) {
+        snprintf(id, sizeof(id), "%s", checkpoint_id);
+        snprintf(checkpoint_path, sizeof(checkpoint_path), "%s/%s/%s",
+                 CHECKPOINT_VAR_DIR, component_name, id);
+    } else if (checkpoint_find_latest(component_name, 1, /* persistent storage */
+                                      id, sizeof(id),
+                                      checkpoint_path, sizeof(checkpoint_path)) != 0) {
+        LOG_ERR("migrate: no checkpoints found for component '%s'", component_name);
+        return -3;
+    }
 
-        /* Create new session */
-        setsid();
+    page_daemon_t *slot = page_daemon_slot();
+    if (!slot) {
+        LOG_ERR("migrate: too many page servers running");
+        return -4;
+    }
 
-        /* Redirect stdout/stderr to /dev/null to avoid noise */
-        int devnull = open("/dev/null", O_RDWR);
-        if (devnull >= 0) {
-            dup2(devnull, STDOUT_FILENO);
-            dup2(devnull, STDERR_FILENO);
-            close(devnull);
+    /* The page server reads raw images: rebuild them on /run */
+    snprintf(image_dir, image_dir_size, "%s", checkpoint_path);
+    int unpacked = checkpoint_store_is_packed(checkpoint_path);
+    if (unpacked) {
+        snprintf(image_dir, image_dir_size, "%s/%s/%s.serve",
+                 CHECKPOINT_RUN_DIR, component_name, id);
+        checkpoint_remove_directory(image_dir);
+        if (checkpoint_store_unpack(checkpoint_path, image_dir) != 0) {
+            LOG_ERR("migrate: cannot rebuild checkpoint %s of '%s' from the chunk store",
+                    id, component_name);
+            return -4;
         }
+    }
 
-        execv("/bin/sh", argv);
-        _exit(127); /* Health check script not found */
+    pid_t pid = criu_page_server_start(image_dir, port);
+    if (pid < 0) {
+        LOG_ERR("migrate: cannot serve pages of '%s': %s",
+                component_name, checkpoint_error_string(pid));
+        if (unpacked) {
+            checkpoint_remove_directory(image_dir);
+        }
+        return -4;
     }
 
-    /* Parent process - wait for health check to complete with timeout */
-    time_t start_time = time(NULL);
-    int timeout = comp->health_timeout > 0 ? comp->health_timeout : 10;
-    int status;
-    pid_t result;
+    page_daemon_add(slot, pid, idx, PROC_PAGE_SERVER, image_dir, unpacked);
+    LOG_INFO("migrate: serving pages of checkpoint %s of '%s' on port %d",
+             id, component_name, port);
+    return 0;
+}
 
-    while ((result = waitpid(pid, &status, WNOHANG)) == 0) {
-        if (time(NULL) - start_time >= timeout) {
-            /* Timeout - kill the health check process */
-            LOG_WARN("health check for '%s' timed out after %d seconds", comp->name, timeout);
-            kill(pid, SIGKILL);
-            waitpid(pid, NULL, 0); /* Clean up zombie */
-            return 2; /* Timeout */
-        }
-        usleep(100000); /* Sleep for 100ms */
+int component_adopt(int idx, pid_t pid) {
+    if (idx < 0 || idx >= n_components || pid <= 0) {
+        return -1;
     }
+    component_t *comp = &components[idx];
+
+    comp->pid = pid;
+    supervise_watch(pid, idx, PROC_MAIN);
+    component_set_state(comp, COMP_ACTIVE);
+    comp->last_restart = time(NULL);
 
-    if (result < 0) {
-        LOG_ERR("waitpid failed for health check '%s': %s", comp->name, strerror(errno));
-        return 1; /* Treat as failure */
+    /* It was ready when checkpointed: no readiness wait */
+    if (comp->type == COMP_TYPE_SERVICE) {
+        component_register_provides(idx);
     }
+    health_begin(idx);
+    idle_begin(idx);
+    return 0;
+}
 
-    /* Check exit status */
-    if (WIFEXITED(status)) {
-        int exit_code = WEXITSTATUS(status);
-        if (exit_code == 0) {
-            LOG_INFO("health check for '%s' passed", comp->name);
-            return 0; /* Success */
-        } else {
-            LOG_WARN("health check for '%s' failed with exit code %d", comp->name, exit_code);
-            return 1; /* Failure */
-        }
-    } else {
-        LOG_WARN("health check for '%s' terminated abnormally", comp->name);
-        return 1; /* Failure */
+/* Spawn a component's health check without waiting for it.
+ * Returns 0 if the check is running, -1 if it could not be started. */
+static int start_health_check(int idx) {
+    component_t *comp = &components[idx];
+
+    LOG_INFO("running health check for '%s': %s", comp->name, comp->health_check);
+
+    pid_t pid = spawn_check_command(comp->name, comp->health_check);
+    if (pid < 0) {
+        LOG_ERR("spawn failed for health check '%s': %s", comp->name, strerror(errno));
+        return -1;
     }
+
+    /* Parent: the result arrives when the child is reaped, or the timer
+     * fires first and the check counts as timed out */
+    int timeout = comp->health_timeout > 0 ? comp->health_timeout : 10;
+    comp->health_pid = pid;
+    comp->health_timed_out = 0;
+    metrics_health_started(comp->name);
+    supervise_watch(pid, idx, PROC_HEALTH);
+    component_arm_timer(idx, TIMER_HEALTH_TIMEOUT, (uint64_t)timeout * 1000);
+    return 0;
 }
 
 /* Handle health check result and update component state */
@@ -1172,12 +2480,13 @@ static void handle_health_result(int idx, int result) {
     component_t *comp = &components[idx];
     comp->last_health_check = time(NULL);
     comp->last_health_result = result;
+    metrics_health_result(comp->name, result);
 
     if (result == 0) {
         /* Health check passed */
         if (comp->state == COMP_DEGRADED) {
             /* Recovery from degraded state */
-            comp->state = COMP_ACTIVE;
+            component_set_state(comp, COMP_ACTIVE);
             comp->health_consecutive_failures = 0;
             LOG_INFO("component '%s' recovered from DEGRADED state", comp->name);
 
@@ -1199,7 +2508,7 @@ static void handle_health_result(int idx, int result) {
         if (comp->state == COMP_ACTIVE) {
             if (comp->health_consecutive_failures >= comp->health_fail_threshold) {
                 /* Transition to DEGRADED */
-                comp->state = COMP_DEGRADED;
+                component_set_state(comp, COMP_DEGRADED);
                 LOG_WARN("component '%s' entered DEGRADED state after %d failures",
                          comp->name, comp->health_consecutive_failures);
 
@@ -1211,24 +2520,126 @@ static void handle_health_result(int idx, int result) {
         } else if (comp->state == COMP_DEGRADED) {
             if (comp->health_consecutive_failures >= comp->health_restart_threshold) {
                 /* Transition to FAILED - restart the component */
-                comp->state = COMP_FAILED;
+                component_set_state(comp, COMP_FAILED);
                 LOG_ERR("component '%s' failed after %d consecutive health failures - restarting",
                         comp->name, comp->health_consecutive_failures);
 
                 /* Withdraw capabilities */
-                for (int i = 0; i < comp->n_provides; i++) {
-                    capability_withdraw(comp->provides[i]);
-                }
+                component_withdraw_provides(idx);
 
-                /* Kill the process */
-                if (comp->pid > 0) {
-                    kill(comp->pid, SIGTERM);
-                }
-                comp->pid = -1;
+                /* Stop the process: a hung one may ignore the signal,
+                 * so the restart waits for it to be reaped */
+                component_kill(idx);
                 comp->health_consecutive_failures = 0;
+                graph_mark_dirty(idx);
             }
         }
     }
+
+    /* Schedule the next check while the component is still up */
+    if ((comp->state == COMP_ACTIVE || comp->state == COMP_DEGRADED) &&
+        comp_str(comp->health_check)[0]) {
+        int interval = comp->health_interval > 0 ? comp->health_interval : 60;
+        component_arm_timer(idx, TIMER_HEALTH_DUE, (uint64_t)interval * 1000);
+    }
+}
+
+/* Watchdog: a keepalive (comp->notify_watchdog_ms, or bytes in the pipe)
+ * is due every watchdog_sec while the component is up. Nothing is timed
+ * per keepalive: the deadline is looked at when it falls due, then moved
+ * on from the last one seen. Keepalives written to the pipe are only read
+ * then, so they count from that moment. Each deadline missed is a health
+ * check timing out, taking the component through DEGRADED to a restart
+ * as handle_health_result() counts them; one met after a miss passes. */
+static void watchdog_begin(int idx) {
+    component_t *comp = &components[idx];
+    if (comp->watchdog_sec <= 0 || comp->timers[TIMER_WATCHDOG]) {
+        return;  /* off, or already running (resumed after a reload) */
+    }
+    comp->notify_watchdog_ms = timer_now_ms();
+    comp->watchdog_missed = 0;
+    component_arm_timer(idx, TIMER_WATCHDOG, (uint64_t)comp->watchdog_sec * 1000);
+}
+
+/* Empty the keepalive pipe; whether anything was in it */
+static int watchdog_drain(component_t *comp) {
+    char buf[256];
+    int got = 0;
+    if (comp->watchdog_fd <= 0) return 0;
+    while (read(comp->watchdog_fd, buf, sizeof(buf)) > 0) {
+        got = 1;
+    }
+    return got;
+}
+
+static void watchdog_due(int idx) {
+    component_t *comp = &components[idx];
+    if ((comp->state != COMP_ACTIVE && comp->state != COMP_DEGRADED) ||
+        comp->watchdog_sec <= 0) {
+        return;
+    }
+
+    uint64_t now = timer_now_ms();
+    uint64_t window = (uint64_t)comp->watchdog_sec * 1000;
+    if (watchdog_drain(comp)) {
+        comp->notify_watchdog_ms = now;
+    }
+
+    uint64_t deadline = comp->notify_watchdog_ms + window;
+    if (now < deadline) {
+        component_arm_timer(idx, TIMER_WATCHDOG, deadline - now);
+        if (comp->watchdog_missed > 0) {
+            comp->watchdog_missed = 0;
+            handle_health_result(idx, 0);
+        }
+        return;
+    }
+
+    comp->watchdog_missed++;
+    LOG_WARN("component '%s' sent no watchdog keepalive for %llu ms",
+             comp->name, (unsigned long long)(now - comp->notify_watchdog_ms));
+    handle_health_result(idx, 2);
+    if (comp->state == COMP_ACTIVE || comp->state == COMP_DEGRADED) {
+        component_arm_timer(idx, TIMER_WATCHDOG, window);
+    }
+}
+
+/* Arm the first health check of a component that has just become active,
+ * and its watchdog */
+static void health_begin(int idx) {
+    component_t *comp = &components[idx];
+    watchdog_begin(idx);
+    if (!comp_str(comp->health_check)[0]) {
+        return;
+    }
+
+    int interval = comp->health_interval > 0 ? comp->health_interval : 60;
+    time_t since = time(NULL) - comp->last_health_check;
+    uint64_t delay = 0;
+    if (comp->last_health_check > 0 && since < interval) {
+        delay = (uint64_t)(interval - since) * 1000;
+    }
+    component_arm_timer(idx, TIMER_HEALTH_DUE, delay);
+}
+
+static void health_check_due(int idx) {
+    component_t *comp = &components[idx];
+
+    if ((comp->state != COMP_ACTIVE && comp->state != COMP_DEGRADED) ||
+        !comp_str(comp->health_check)[0]) {
+        return;
+    }
+
+    if (comp->health_pid > 0) {
+        /* Previous check still being reaped, try again next interval */
+        int interval = comp->health_interval > 0 ? comp->health_interval : 60;
+        component_arm_timer(idx, TIMER_HEALTH_DUE, (uint64_t)interval * 1000);
+        return;
+    }
+
+    if (start_health_check(idx) < 0) {
+        handle_health_result(idx, 1); /* Treat fork failure as health failure */
+    }
 }
 
 /* Check health for all components with health checks enabled */
@@ -1240,7 +2651,12 @@ void check_all_health(void) {
 
         /* Only check health for active or degraded components with health checks configured */
         if ((comp->state != COMP_ACTIVE && comp->state != COMP_DEGRADED) ||
-            !comp->health_check[0]) {
+            !comp_str(comp->health_check)[0]) {
+            continue;
+        }
+
+        /* One check at a time per component */
+        if (comp->health_pid > 0) {
             continue;
         }
 
@@ -1250,8 +2666,259 @@ void check_all_health(void) {
             continue; /* Not time for health check yet */
         }
 
-        /* Execute health check */
-        int result = execute_health_check(comp);
-        handle_health_result(i, result);
+        /* Start the check; its result is handled when it exits */
+        if (start_health_check(i) < 0) {
+            handle_health_result(i, 1); /* Treat fork failure as health failure */
+        }
+    }
+}
+
+static void health_check_exited(int idx, int status) {
+    component_t *comp = &components[idx];
+
+    comp->health_pid = 0;
+    component_disarm_timer(idx, TIMER_HEALTH_TIMEOUT);
+
+    if (comp->health_timed_out) {
+        /* Already reported as a timeout when we killed it */
+        comp->health_timed_out = 0;
+        return;
+    }
+
+    /* The component may have gone away while the check ran */
+    if (comp->state != COMP_ACTIVE && comp->state != COMP_DEGRADED) {
+        return;
+    }
+
+    int result;
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        LOG_INFO("health check for '%s' passed", comp->name);
+        result = 0;
+    } else if (WIFEXITED(status)) {
+        LOG_WARN("health check for '%s' failed with exit code %d",
+                 comp->name, WEXITSTATUS(status));
+        result = 1;
+    } else {
+        LOG_WARN("health check for '%s' terminated abnormally", comp->name);
+        result = 1;
+    }
+    handle_health_result(idx, result);
+}
+
+static void health_check_timed_out(int idx) {
+    component_t *comp = &components[idx];
+    if (comp->health_pid <= 0) {
+        return;
+    }
+
+    int timeout = comp->health_timeout > 0 ? comp->health_timeout : 10;
+    LOG_WARN("health check for '%s' timed out after %d seconds", comp->name, timeout);
+
+    /* Kill it now; the zombie is collected by the normal reaper */
+    supervise_signal(comp->health_pid, SIGKILL);
+    comp->health_timed_out = 1;
+
+    if (comp->state == COMP_ACTIVE || comp->state == COMP_DEGRADED) {
+        handle_health_result(idx, 2);
+    }
+}
+
+void component_timers_start(void) {
+    uint64_t now = timer_now_ms();
+    if (!cgroup_oom_watching()) {
+        timer_add(now + OOM_SCAN_INTERVAL_MS, TIMER_OOM_SCAN, -1);
+    }
+    timer_add(now + (uint64_t)GRAPH_SWEEP_INTERVAL * 1000, TIMER_GRAPH_SWEEP, -1);
+    timer_add(now + TELEMETRY_INTERVAL_MS, TIMER_TELEMETRY, -1);
+    timer_add(now + PRESSURE_INTERVAL_MS, TIMER_PRESSURE, -1);
+}
+
+void component_resume(int idx) {
+    switch (components[idx].state) {
+    case COMP_READY_WAIT:
+        readiness_begin(idx);
+        break;
+    case COMP_ACTIVE:
+    case COMP_DEGRADED:
+        health_begin(idx);
+        idle_begin(idx);
+        standby_spawn(idx);
+        break;
+    case COMP_IDLE:
+        /* Sockets declared anew are bound and watched */
+        if (!components[idx].demanded) {
+            component_idle(idx);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void component_run_timers(void) {
+    uint64_t now = timer_now_ms();
+    timer_kind_t kind;
+    int idx, handle;
+
+    while (timer_pop(now, &kind, &idx, &handle)) {
+        /* Housekeeping timers re-arm themselves */
+        if (kind == TIMER_OOM_SCAN) {
+            check_all_oom_events();
+            timer_add(now + OOM_SCAN_INTERVAL_MS, TIMER_OOM_SCAN, -1);
+            continue;
+        }
+        if (kind == TIMER_GRAPH_SWEEP) {
+            /* Consistency check: let the resolver look at everything */
+            graph_mark_all_dirty();
+            timer_add(now + (uint64_t)GRAPH_SWEEP_INTERVAL * 1000, TIMER_GRAPH_SWEEP, -1);
+            continue;
+        }
+        if (kind == TIMER_RELOAD) {
+            reload_timer_fired(handle);
+            continue;
+        }
+        if (kind == TIMER_TELEMETRY) {
+            telemetry_sample();
+            timer_add(now + TELEMETRY_INTERVAL_MS, TIMER_TELEMETRY, -1);
+            continue;
+        }
+        if (kind == TIMER_PRESSURE) {
+            pressure_relax(now);
+            timer_add(now + PRESSURE_INTERVAL_MS, TIMER_PRESSURE, -1);
+            continue;
+        }
+        if (kind == TIMER_FEDERATION) {
+            federation_tick(now);
+            continue;
+        }
+        if (kind == TIMER_MIGRATION) {
+            migration_timer_fired(handle);
+            continue;
+        }
+        if (kind == TIMER_HANDOFF) {
+            handoff_timer_fired(handle);
+            continue;
+        }
+
+        /* Skip timers their component has since replaced or cancelled,
+         * including any left over from before a reload */
+        if (idx < 0 || idx >= n_components || components[idx].timers[kind] != handle) {
+            continue;
+        }
+        components[idx].timers[kind] = 0;
+
+        switch (kind) {
+        case TIMER_HEALTH_TIMEOUT:
+            health_check_timed_out(idx);
+            break;
+        case TIMER_HEALTH_DUE:
+            health_check_due(idx);
+            break;
+        case TIMER_READINESS_TIMEOUT:
+            if (components[idx].state == COMP_READY_WAIT) {
+                readiness_timed_out(idx);
+            }
+            break;
+        case TIMER_READINESS_POLL:
+            readiness_poll(idx);
+            break;
+        case TIMER_RESTART:
+            graph_mark_dirty(idx);
+            break;
+        case TIMER_STANDBY:
+            if (components[idx].state == COMP_ACTIVE || components[idx].state == COMP_DEGRADED) {
+                standby_spawn(idx);
+            }
+            break;
+        case TIMER_IDLE:
+            idle_check(idx);
+            break;
+        case TIMER_WATCHDOG:
+            watchdog_due(idx);
+            break;
+        case TIMER_STOP_KILL:
+            stop_kill_due(idx);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+int component_reap(pid_t pid, int status) {
+    proc_watch_t *w = supervise_lookup(pid);
+    if (!w) {
+        /* Not in the watch table (it was full): fall back to a scan */
+        for (int i = 0; i < n_components; i++) {
+            if (components[i].pid == pid) {
+                component_exited(i, status);
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    int idx = w->idx;
+    proc_role_t role = w->role;
+    supervise_unwatch(pid);
+
+    if (idx < 0 || idx >= n_components) {
+        return 1;
+    }
+    component_t *comp = &components[idx];
+
+    switch (role) {
+    case PROC_MAIN:
+        /* Replaced instances (hot-swap, restore, OOM) stay watched so
+         * they can be signalled safely; only the current one counts */
+        if (comp->pid != pid) {
+            LOG_INFO("previous process %d of '%s' exited", pid, comp->name);
+            break;
+        }
+        component_exited(idx, status);
+        break;
+    case PROC_HEALTH:
+        if (comp->health_pid == pid) {
+            health_check_exited(idx, status);
+        }
+        break;
+    case PROC_READINESS:
+        if (comp->readiness_pid == pid) {
+            readiness_check_exited(idx, status);
+        }
+        break;
+    case PROC_LAZY_PAGES:
+    case PROC_PAGE_SERVER:
+        page_daemon_exited(pid, idx, role, status);
+        break;
+    case PROC_STANDBY:
+        standby_exited(idx, pid, status);
+        break;
+    }
+    return 1;
+}
+
+void component_cancel_check(int idx) {
+    component_t *comp = &components[idx];
+
+    if (comp->health_pid > 0) {
+        supervise_signal(comp->health_pid, SIGKILL);
+        supervise_unwatch(comp->health_pid);
+        comp->health_pid = 0;
+    }
+    if (comp->readiness_pid > 0) {
+        supervise_signal(comp->readiness_pid, SIGKILL);
+        supervise_unwatch(comp->readiness_pid);
+        comp->readiness_pid = 0;
+    }
+    for (int k = 0; k < TIMER_KINDS; k++) {
+        component_disarm_timer(idx, k);
+    }
+    filewatch_remove(idx);
+}
+
+void component_cancel_checks(void) {
+    for (int i = 0; i < n_components; i++) {
+        component_cancel_check(i);
     }
-}
\ No newline at end of file
+}
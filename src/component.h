@@ -10,16 +10,86 @@
 #include "toml.h"
 #include "capability.h"
 #include "cgroup.h"
+#include "event.h"
 
-#define MAX_COMPONENTS 256
+#define COMPONENT_TABLE_INITIAL 64   /* first allocation; the table doubles as needed */
 #define GRAPH_DIR "/etc/graph.d"
 
+/* A component with watchdog_sec has WATCHDOG_USEC in its environment and
+ * keeps itself alive by sending WATCHDOG=1 to NOTIFY_SOCKET, or by
+ * writing anything to the pipe it finds at WATCHDOG_FD (past the
+ * descriptors of socket activation; non-blocking, so a keepalive never
+ * waits on us). */
+#define WATCHDOG_FD      (LISTEN_FDS_START + MAX_SOCKETS)
+#define WATCHDOG_FD_ENV  "WATCHDOG_FD"
+#define WATCHDOG_USEC_ENV "WATCHDOG_USEC"
+
+/* Move comp to state, recording the transition in the trace */
+void component_set_state(component_t *comp, comp_state_t state);
+
+/* Bumped whenever what placement decides on may have changed: a
+ * component started or stopped running, a cgroup was opened or closed,
+ * or a declaration was reloaded */
+unsigned int component_placement_epoch(void);
+void component_placement_changed(void);
+
+/* Intern comp's capability names again if the registry was reset since */
+void component_refresh_cap_ids(component_t *comp);
+
+/* The signal asking comp's process to stop: stop_signal, or SIGTERM */
+int component_stop_signal(const component_t *comp);
+
+/* Stop the main process of a failed component: its stop signal now,
+ * SIGKILL if it is still there stop_timeout seconds later. It keeps its
+ * pid and watch until reaped, and is only restarted after that */
+void component_kill(int idx);
+
 /* Check if a component's requirements are met */
 int requirements_met(component_t *comp);
 
-/* Start a component (fork/exec) */
+/* Refresh a component's interned capability IDs and register it as a
+ * consumer of each capability it requires */
+void component_link_caps(int idx);
+
+/* component_link_caps() for every loaded component */
+void component_link_all(void);
+
+/* Register / withdraw every capability a component provides */
+void component_register_provides(int idx);
+void component_withdraw_provides(int idx);
+
+/* A component with [sockets] keeps its capabilities up while it restarts,
+ * its sockets queueing connections; withdraw them once it is not coming
+ * back soon (quarantined, or its requirements lost) */
+void component_withdraw_held_provides(int idx);
+
+/* Start a component (spawn/exec) */
 int component_start(int idx);
 
+/* start = "on-demand": put a component whose requirements are met in
+ * IDLE, binding and watching its sockets and advertising its capabilities
+ * if it has any; take it back to INACTIVE, to be started (it is
+ * demanded) or to wait for its requirements again */
+void component_idle(int idx);
+void component_wake(int idx);
+
+/* A client is waiting on the activation socket fd: an IDLE component
+ * owning it is demanded */
+void component_handle_activation(int fd);
+
+/* Restart policy. A FAILED component is restarted once
+ * component_restart_delay() has passed: restart_delay_ms doubled for
+ * every failure in a row up to restart_delay_max_ms, less a random part
+ * of up to restart_jitter percent (rnd) of it. A run lasting
+ * restart_decay seconds resets the count; restart_quarantine failures in
+ * a row stop restarts until component_reset_failed().
+ * schedule_restart() counts a new failure and arms its restart timer,
+ * returning -1 if it put the component in quarantine. reset_failed()
+ * returns -1 for an unknown name, -2 if it is not failed. */
+uint64_t component_restart_delay(const component_t *comp, int failures, uint32_t rnd);
+int component_schedule_restart(int idx);
+int component_reset_failed(const char *name);
+
 /* Handle component process exit */
 void component_exited(int idx, int status);
 
@@ -32,22 +102,109 @@ void component_ready(int idx);
 /* Check readiness for all components in READY_WAIT state */
 void check_all_readiness(void);
 
+/* Handle readiness file watch events (files appearing) */
+void component_handle_file_events(void);
+
+/* Handle cgroup memory.events changes (OOM kills) */
+void component_handle_oom_events(void);
+
+/* Handle pending sd_notify messages (READY=1, STATUS=, MAINPID=, ...) */
+void component_handle_notify(void);
+
 /* Check health for all components with health checks enabled */
 void check_all_health(void);
 
-/* Check OOM events for all components with cgroups */
+/* Dispatch the exit of a supervised process (main process, health or
+ * readiness check) to its component. Returns 0 if pid is not ours. */
+int component_reap(pid_t pid, int status);
+
+/* Kill and forget every running health and readiness check and cancel
+ * every component timer, e.g. before the component table is reloaded */
+void component_cancel_checks(void);
+
+/* component_cancel_checks() for one component */
+void component_cancel_check(int idx);
+
+/* Fire every timer that is due: component deadlines and the periodic
+ * housekeeping timers */
+void component_run_timers(void);
+
+/* Arm the periodic housekeeping timers (full graph sweep, telemetry
+ * sampling, and the OOM scan where OOM events cannot be watched) */
+void component_timers_start(void);
+
+/* (Re)arm a component timer of the given kind delay_ms from now, or
+ * cancel it; each component has at most one timer per kind */
+void component_arm_timer(int idx, timer_kind_t kind, uint64_t delay_ms);
+void component_disarm_timer(int idx, timer_kind_t kind);
+
+/* Re-arm the timers implied by a component's state, e.g. after its state
+ * was carried over a reload */
+void component_resume(int idx);
+
+/* Close a component's cgroup handle, and remove the cgroup unless its
+ * process is still supervised, e.g. once it is removed from the graph */
+void component_release_cgroup(int idx);
+
+/* Stop a component's standby instance, if it has one, and close the
+ * descriptors held for it */
+void component_standby_stop(int idx);
+
+/* Close a component's activation sockets, e.g. once it is removed or
+ * declares others; the next start binds them again */
+void component_close_sockets(int idx);
+
+/* Close a component's keepalive pipe once it is removed */
+void component_close_watchdog(int idx);
+
+/* Report OOM kills in every component cgroup since the last look */
 void check_all_oom_events(void);
 
 /* Hot-swap upgrade a component to new version with three-level fallback */
 int component_upgrade(const char *component_name);
 
+/* Where upgrades onto a standby watch the old process's handoff socket,
+ * and the main loop's handler for it becoming readable */
+void component_handoff_init(int epoll_fd);
+void component_handoff_event(event_source_t *src);
+
 /* Create checkpoint of a running component for backup/migration */
 int component_checkpoint(const char *component_name);
 
 /* Restore component from checkpoint (latest if checkpoint_id is NULL) */
 int component_restore(const char *component_name, const char *checkpoint_id);
 
-/* Load all component declarations from directory */
+/* Like component_restore(), but the process resumes as soon as its state
+ * is back and CRIU pages its memory in as it is touched: from the
+ * checkpoint, or from page_server ("host[:port]") running
+ * component_serve_pages() on another node. Without lazy-pages support a
+ * local restore falls back to copying everything first. */
+int component_restore_lazy(const char *component_name, const char *checkpoint_id,
+                           const char *page_server);
+
+/* Serve the pages of a checkpoint (latest if checkpoint_id is NULL) on
+ * port for a lazy restore elsewhere. image_dir gets the directory served
+ * from, whose files other than pages-*.img the other node needs.
+ * Returns 0, or -1 to -4 like component_restore(). */
+int component_serve_pages(const char *component_name, const char *checkpoint_id, int port,
+                          char *image_dir, size_t image_dir_size);
+
+/* Take over pid, restored from a checkpoint taken while component idx was
+ * ACTIVE: it is ACTIVE again at once and its capabilities are registered.
+ * Returns 0, or -1 for a bad index or pid. */
+int component_adopt(int idx, pid_t pid);
+
+/* Make room for at least n components. New slots are zeroed; existing
+ * component_t pointers are invalidated if the table moves. Returns 0 or -1. */
+int component_table_reserve(int n);
+int component_table_capacity(void);
+
+/* Free every component's strings and empty the table (before a reload) */
+void component_table_clear(void);
+
+/* Load all component declarations from directory. Unchanged files are
+ * taken from the graph cache when one is set (graph_cache_set_path());
+ * the rest are parsed, concurrently when there are many. */
 int load_components(const char *dir);
 
 /* Validate component graph for cycles and other issues */
@@ -57,7 +214,7 @@ int validate_component_graph(int warn_only);
 void register_early_capabilities(void);
 
 /* Access to global component array */
-extern component_t components[MAX_COMPONENTS];
+extern component_t *components;
 extern int n_components;
 
 #endif /* COMPONENT_H */
\ No newline at end of file
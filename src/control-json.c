@@ -0,0 +1,406 @@
+/*
+ * control-json.c - YakirOS structured control protocol
+ *
+ * Encodes status, capability and readiness tables as JSON frames for
+ * tools that would otherwise scrape graphctl's text output, and diffs
+ * component and capability state between main loop rounds so subscribers
+ * receive one event per change instead of polling full dumps.
+ */
+
+#include "control-json.h"
+#include "component.h"
+#include "capability.h"
+#include "log.h"
+#include "telemetry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Baseline the next json_events() call is compared against. Names are
+ * copied because a reload frees the old component table's strings. */
+typedef struct {
+    char         name[MAX_NAME];
+    comp_state_t state;
+} ev_comp_t;
+
+static ev_comp_t *ev_comps = NULL;
+static int ev_comps_cap = 0;
+static int ev_n_comps = 0;
+
+static char ev_cap_name[MAX_CAPABILITIES][MAX_NAME];
+static unsigned char ev_cap_active[MAX_CAPABILITIES];
+static unsigned char ev_cap_degraded[MAX_CAPABILITIES];
+static int ev_n_caps = 0;
+
+static unsigned long long ev_seq = 0;
+
+size_t json_frame_begin(control_buf_t *out) {
+    size_t frame = out->len;
+    control_append(out, "\0\0\0\0", JSON_FRAME_HEADER);
+    return frame;
+}
+
+void json_frame_end(control_buf_t *out, size_t frame) {
+    if (!out->data || out->len < frame + JSON_FRAME_HEADER) return;
+    size_t len = out->len - frame - JSON_FRAME_HEADER;
+    unsigned char *hdr = (unsigned char *)out->data + frame;
+    hdr[0] = (len >> 24) & 0xff;
+    hdr[1] = (len >> 16) & 0xff;
+    hdr[2] = (len >> 8) & 0xff;
+    hdr[3] = len & 0xff;
+}
+
+void json_string_len(control_buf_t *out, const char *s, size_t len) {
+    control_append(out, "\"", 1);
+    size_t run = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        if (c != '"' && c != '\\' && c >= 0x20) continue;
+
+        control_append(out, s + run, i - run);
+        run = i + 1;
+        switch (c) {
+            case '"':  control_append(out, "\\\"", 2); break;
+            case '\\': control_append(out, "\\\\", 2); break;
+            case '\n': control_append(out, "\\n", 2); break;
+            case '\t': control_append(out, "\\t", 2); break;
+            case '\r': control_append(out, "\\r", 2); break;
+            default:   control_printf(out, "\\u%04x", c); break;
+        }
+    }
+    control_append(out, s + run, len - run);
+    control_append(out, "\"", 1);
+}
+
+void json_string(control_buf_t *out, const char *s) {
+    json_string_len(out, s, strlen(s));
+}
+
+const char *json_state_name(comp_state_t state) {
+    switch (state) {
+        case COMP_INACTIVE:     return "INACTIVE";
+        case COMP_STARTING:     return "STARTING";
+        case COMP_READY_WAIT:   return "READY_WAIT";
+        case COMP_ACTIVE:       return "ACTIVE";
+        case COMP_DEGRADED:     return "DEGRADED";
+        case COMP_FAILED:       return "FAILED";
+        case COMP_ONESHOT_DONE: return "DONE";
+        case COMP_QUARANTINED:  return "QUARANTINED";
+        case COMP_IDLE:         return "IDLE";
+        case COMP_MIGRATED:     return "MIGRATED";
+    }
+    return "UNKNOWN";
+}
+
+static const char *readiness_method_name(readiness_method_t method) {
+    switch (method) {
+        case READINESS_FILE:    return "file";
+        case READINESS_COMMAND: return "command";
+        case READINESS_SIGNAL:  return "signal";
+        case READINESS_NOTIFY:  return "notify";
+        case READINESS_NONE:    return "none";
+    }
+    return "unknown";
+}
+
+void json_status(control_buf_t *out) {
+    size_t frame = json_frame_begin(out);
+    time_t now = time(NULL);
+
+    control_printf(out, "{\"type\":\"status\",\"components\":[");
+    for (int i = 0; i < n_components; i++) {
+        component_t *comp = &components[i];
+        long uptime = 0;
+        if (comp->last_restart > 0 &&
+            (comp->state == COMP_ACTIVE || comp->state == COMP_READY_WAIT ||
+             comp->state == COMP_DEGRADED)) {
+            uptime = (long)(now - comp->last_restart);
+        }
+
+        control_printf(out, "%s{\"name\":", i ? "," : "");
+        json_string(out, comp->name);
+        control_printf(out, ",\"state\":\"%s\",\"pid\":%d,\"uptime\":%ld,\"restarts\":%d}",
+                       json_state_name(comp->state), comp->pid > 0 ? comp->pid : 0,
+                       uptime, comp->restart_count);
+    }
+    control_printf(out, "]}");
+
+    json_frame_end(out, frame);
+}
+
+void json_caps(control_buf_t *out) {
+    size_t frame = json_frame_begin(out);
+
+    control_printf(out, "{\"type\":\"caps\",\"capabilities\":[");
+    int total = capability_count();
+    for (int i = 0; i < total; i++) {
+        int provider = capability_provider(i);
+        int active = capability_active_by_idx(i);
+
+        control_printf(out, "%s{\"name\":", i ? "," : "");
+        json_string(out, capability_name(i));
+        control_printf(out, ",\"active\":%s,\"degraded\":%s,\"provider\":",
+                       active ? "true" : "false",
+                       capability_degraded_by_idx(i) ? "true" : "false");
+        if (active && provider >= 0 && provider < n_components) {
+            json_string(out, components[provider].name);
+        } else {
+            control_printf(out, "null");
+        }
+        control_printf(out, "}");
+    }
+    control_printf(out, "]}");
+
+    json_frame_end(out, frame);
+}
+
+void json_readiness(control_buf_t *out) {
+    size_t frame = json_frame_begin(out);
+    time_t now = time(NULL);
+    int first = 1;
+
+    control_printf(out, "{\"type\":\"readiness\",\"components\":[");
+    for (int i = 0; i < n_components; i++) {
+        component_t *comp = &components[i];
+        if (comp->readiness_method == READINESS_NONE) continue;
+
+        long waiting = 0;
+        if (comp->state == COMP_READY_WAIT && comp->ready_wait_start > 0) {
+            waiting = (long)(now - comp->ready_wait_start);
+        }
+
+        control_printf(out, "%s{\"name\":", first ? "" : ",");
+        json_string(out, comp->name);
+        control_printf(out, ",\"method\":\"%s\",\"timeout\":%d,\"state\":\"%s\",\"waiting\":%ld",
+                       readiness_method_name(comp->readiness_method),
+                       comp->readiness_timeout, json_state_name(comp->state), waiting);
+        if (comp->notify_status[0]) {
+            control_printf(out, ",\"status\":");
+            json_string(out, comp->notify_status);
+        }
+        control_printf(out, "}");
+        first = 0;
+    }
+    control_printf(out, "]}");
+
+    json_frame_end(out, frame);
+}
+
+static void json_sample(control_buf_t *out, const telemetry_sample_t *s) {
+    control_printf(out,
+                   "\"memory\":%llu,\"anon\":%llu,\"file\":%llu,"
+                   "\"pressure\":{\"cpu\":%u.%02u,\"memory\":%u.%02u,\"io\":%u.%02u}",
+                   (unsigned long long)s->mem_current, (unsigned long long)s->mem_anon,
+                   (unsigned long long)s->mem_file,
+                   s->cpu_some / 100, s->cpu_some % 100, s->mem_some / 100, s->mem_some % 100,
+                   s->io_some / 100, s->io_some % 100);
+}
+
+void json_top(control_buf_t *out) {
+    size_t frame = json_frame_begin(out);
+    int first = 1;
+
+    control_printf(out, "{\"type\":\"top\",\"interval_ms\":%d,\"pass_us\":%llu,\"components\":[",
+                   TELEMETRY_INTERVAL_MS, (unsigned long long)telemetry_last_pass_us());
+    for (int i = 0; i < n_components; i++) {
+        component_t *comp = &components[i];
+        telemetry_sample_t s[2];
+        int got = comp->cgroup_fd > 0 ? telemetry_history(comp->cgroup_fd, s, 2) : 0;
+        if (got == 0) continue;
+
+        telemetry_rate_t rate = {0};
+        if (got == 2) telemetry_rate(&s[0], &s[1], &rate);
+
+        control_printf(out, "%s{\"name\":", first ? "" : ",");
+        json_string(out, comp->name);
+        control_printf(out, ",\"cpu_percent\":%.2f,\"io_read_bps\":%.0f,\"io_write_bps\":%.0f,",
+                       rate.cpu_percent, rate.io_read_bps, rate.io_write_bps);
+        json_sample(out, &s[got - 1]);
+        control_printf(out, "}");
+        first = 0;
+    }
+    control_printf(out, "]}");
+
+    json_frame_end(out, frame);
+}
+
+void json_stats(control_buf_t *out, const char *name) {
+    component_t *comp = NULL;
+    for (int i = 0; i < n_components; i++) {
+        if (strcmp(components[i].name, name) == 0) {
+            comp = &components[i];
+            break;
+        }
+    }
+    if (!comp) {
+        json_error(out, "component not found");
+        return;
+    }
+
+    telemetry_sample_t s[TELEMETRY_SAMPLES];
+    int n = comp->cgroup_fd > 0 ? telemetry_history(comp->cgroup_fd, s, TELEMETRY_SAMPLES) : 0;
+    uint64_t now = n > 0 ? s[n - 1].time_ms : 0;
+
+    size_t frame = json_frame_begin(out);
+    control_printf(out, "{\"type\":\"stats\",\"name\":");
+    json_string(out, comp->name);
+    control_printf(out, ",\"interval_ms\":%d,\"samples\":[", TELEMETRY_INTERVAL_MS);
+    /* Raw cumulative counters; rates are for the reader to take */
+    for (int i = 0; i < n; i++) {
+        control_printf(out, "%s{\"age_ms\":%llu,\"cpu_usec\":%llu,\"io_rbytes\":%llu,"
+                       "\"io_wbytes\":%llu,",
+                       i ? "," : "", (unsigned long long)(now - s[i].time_ms),
+                       (unsigned long long)s[i].cpu_usec, (unsigned long long)s[i].io_rbytes,
+                       (unsigned long long)s[i].io_wbytes);
+        json_sample(out, &s[i]);
+        control_printf(out, "}");
+    }
+    control_printf(out, "]}");
+
+    json_frame_end(out, frame);
+}
+
+void json_text(control_buf_t *out, const char *command, const char *text, size_t len) {
+    size_t frame = json_frame_begin(out);
+    control_printf(out, "{\"type\":\"text\",\"command\":");
+    json_string(out, command);
+    control_printf(out, ",\"output\":");
+    json_string_len(out, text, len);
+    control_printf(out, "}");
+    json_frame_end(out, frame);
+}
+
+void json_error(control_buf_t *out, const char *message) {
+    size_t frame = json_frame_begin(out);
+    control_printf(out, "{\"type\":\"error\",\"message\":");
+    json_string(out, message);
+    control_printf(out, "}");
+    json_frame_end(out, frame);
+}
+
+void json_events_reset(void) {
+    if (n_components > ev_comps_cap) {
+        ev_comp_t *grown = realloc(ev_comps, (size_t)component_table_capacity() * sizeof(*grown));
+        if (!grown) {
+            LOG_ERR("out of memory tracking component events");
+            ev_n_comps = 0;
+            return;
+        }
+        ev_comps = grown;
+        ev_comps_cap = component_table_capacity();
+    }
+
+    ev_n_comps = n_components;
+    for (int i = 0; i < n_components; i++) {
+        memcpy(ev_comps[i].name, components[i].name, MAX_NAME);
+        ev_comps[i].state = components[i].state;
+    }
+
+    ev_n_caps = capability_count();
+    for (int i = 0; i < ev_n_caps; i++) {
+        strncpy(ev_cap_name[i], capability_name(i), MAX_NAME - 1);
+        ev_cap_active[i] = capability_active_by_idx(i) ? 1 : 0;
+        ev_cap_degraded[i] = capability_degraded_by_idx(i) ? 1 : 0;
+    }
+}
+
+static void component_event(control_buf_t *out, const char *event, const char *name,
+                            const char *state, const char *previous, const component_t *comp) {
+    size_t frame = json_frame_begin(out);
+    control_printf(out, "{\"type\":\"component\",\"seq\":%llu,\"event\":\"%s\",\"name\":",
+                   ++ev_seq, event);
+    json_string(out, name);
+    if (state) control_printf(out, ",\"state\":\"%s\"", state);
+    if (previous) control_printf(out, ",\"previous\":\"%s\"", previous);
+    if (comp) {
+        control_printf(out, ",\"pid\":%d,\"restarts\":%d",
+                       comp->pid > 0 ? comp->pid : 0, comp->restart_count);
+    }
+    control_printf(out, "}");
+    json_frame_end(out, frame);
+}
+
+static void capability_event(control_buf_t *out, const char *event, int idx, const char *name) {
+    size_t frame = json_frame_begin(out);
+    control_printf(out, "{\"type\":\"capability\",\"seq\":%llu,\"event\":\"%s\",\"name\":",
+                   ++ev_seq, event);
+    json_string(out, name);
+    if (idx >= 0) {
+        int provider = capability_provider(idx);
+        int active = capability_active_by_idx(idx);
+        control_printf(out, ",\"active\":%s,\"degraded\":%s,\"provider\":",
+                       active ? "true" : "false",
+                       capability_degraded_by_idx(idx) ? "true" : "false");
+        if (active && provider >= 0 && provider < n_components) {
+            json_string(out, components[provider].name);
+        } else {
+            control_printf(out, "null");
+        }
+    }
+    control_printf(out, "}");
+    json_frame_end(out, frame);
+}
+
+int json_events(control_buf_t *out) {
+    int count = 0;
+
+    /* Components are compared slot by slot; a reload that puts a different
+     * component in a slot reports the old one removed and the new one added */
+    for (int i = 0; i < n_components; i++) {
+        component_t *comp = &components[i];
+        int same_slot = i < ev_n_comps && strcmp(ev_comps[i].name, comp->name) == 0;
+
+        if (!same_slot) {
+            if (i < ev_n_comps) {
+                component_event(out, "removed", ev_comps[i].name, NULL, NULL, NULL);
+                count++;
+            }
+            component_event(out, "added", comp->name, json_state_name(comp->state), NULL, comp);
+            count++;
+        } else if (ev_comps[i].state != comp->state) {
+            component_event(out, "changed", comp->name, json_state_name(comp->state),
+                            json_state_name(ev_comps[i].state), comp);
+            count++;
+        }
+    }
+    for (int i = n_components; i < ev_n_comps; i++) {
+        component_event(out, "removed", ev_comps[i].name, NULL, NULL, NULL);
+        count++;
+    }
+
+    int n_caps = capability_count();
+    for (int i = 0; i < n_caps; i++) {
+        const char *name = capability_name(i);
+        int active = capability_active_by_idx(i) ? 1 : 0;
+        int degraded = capability_degraded_by_idx(i) ? 1 : 0;
+
+        if (i >= ev_n_caps || strcmp(ev_cap_name[i], name) != 0) {
+            if (i < ev_n_caps && ev_cap_active[i]) {
+                capability_event(out, "down", -1, ev_cap_name[i]);
+                count++;
+            }
+            /* Newly interned (or re-interned after a reset) - only worth
+             * reporting once something provides it */
+            if (active) {
+                capability_event(out, "up", i, name);
+                count++;
+            }
+        } else if (ev_cap_active[i] != active) {
+            capability_event(out, active ? "up" : "down", i, name);
+            count++;
+        } else if (ev_cap_degraded[i] != degraded) {
+            capability_event(out, degraded ? "degraded" : "healthy", i, name);
+            count++;
+        }
+    }
+    for (int i = n_caps; i < ev_n_caps; i++) {
+        if (ev_cap_active[i]) {
+            capability_event(out, "down", -1, ev_cap_name[i]);
+            count++;
+        }
+    }
+
+    json_events_reset();
+    return count;
+}
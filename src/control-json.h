@@ -0,0 +1,50 @@
+/*
+ * control-json.h - YakirOS structured control protocol
+ *
+ * A connection that sends "proto json" receives every reply as a frame: a
+ * 4-byte big-endian length followed by that many bytes of one JSON object.
+ * Requests stay newline-terminated command lines. See docs/control-protocol.md.
+ */
+
+#ifndef CONTROL_JSON_H
+#define CONTROL_JSON_H
+
+#include "control.h"
+#include "toml.h"
+
+#define JSON_FRAME_HEADER 4
+
+/* Start a frame in out and return its offset; json_frame_end() fills in
+ * the length once the object has been written */
+size_t json_frame_begin(control_buf_t *out);
+void json_frame_end(control_buf_t *out, size_t frame);
+
+/* Append s as a quoted JSON string */
+void json_string(control_buf_t *out, const char *s);
+void json_string_len(control_buf_t *out, const char *s, size_t len);
+
+const char *json_state_name(comp_state_t state);
+
+/* Whole-table replies, each written as one frame */
+void json_status(control_buf_t *out);
+void json_caps(control_buf_t *out);
+void json_readiness(control_buf_t *out);
+
+/* Resource telemetry: the latest sample and rates of every component
+ * ("top"), or every kept sample of one ("stats <name>") */
+void json_top(control_buf_t *out);
+void json_stats(control_buf_t *out, const char *name);
+
+/* Output of a text-only command, wrapped as {"type":"text",...} */
+void json_text(control_buf_t *out, const char *command, const char *text, size_t len);
+void json_error(control_buf_t *out, const char *message);
+
+/* State-change tracking for subscribers. json_events_reset() takes the
+ * current component and capability state as the baseline; json_events()
+ * appends one frame per component state or capability up/down/degraded
+ * change since the baseline, advances it, and returns the number of
+ * events written. */
+void json_events_reset(void);
+int json_events(control_buf_t *out);
+
+#endif /* CONTROL_JSON_H */
@@ -1,8 +1,21 @@
 /*
  * control.c - YakirOS control socket implementation (minimal version)
+ *
+ * The listener and every accepted connection are non-blocking and live in
+ * the main epoll set. Each connection keeps a read buffer that is split on
+ * newlines, so a client may pipeline several commands, and a growable write
+ * buffer that replies are appended to and flushed as the socket drains. A
+ * slow or stalled client therefore never holds up supervision.
+ *
+ * "proto json" switches a connection to length-prefixed JSON frames (see
+ * control-json.c), and "subscribe" on such a connection streams component
+ * and capability state changes as they happen. "log -f" streams a
+ * component's output the same way, in either protocol.
  */
 
+#define _GNU_SOURCE
 #include "control.h"
+#include "control-json.h"
 #include "component.h"
 #include "capability.h"
 #include "graph.h"
@@ -10,16 +23,51 @@
 #include "checkpoint.h"
 #include "checkpoint-mgmt.h"
 #include "kexec.h"
+#include "output.h"
+#include "metrics.h"
+#include "metrics-export.h"
+#include "federation.h"
+#include "migration.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "trace-report.h"
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdarg.h>
 #include <ctype.h>
 #include <errno.h>
 #include <time.h>
 #include <stdlib.h>
 
+typedef struct {
+    event_source_t src;             /* must be first: epoll data.ptr */
+    int            in_use;
+    int            read_closed;     /* peer shut down its write side */
+    int            closing;         /* close once the write buffer drains */
+    int            json;            /* replies are JSON frames */
+    int            subscribed;      /* receives state-change events */
+    char           follow[MAX_NAME]; /* component whose output is streamed */
+    uint32_t       interest;        /* events currently registered */
+    char           rbuf[CONTROL_LINE_MAX];
+    size_t         rlen;
+    control_buf_t  wbuf;
+    size_t         woff;            /* bytes of wbuf already sent */
+} control_conn_t;
+
+static control_conn_t conns[CONTROL_MAX_CLIENTS];
+static int n_conns = 0;
+static int n_subscribers = 0;
+static int n_followers = 0;
+static int ctl_epoll_fd = -1;
+
+/* Connection whose command is currently executing, for handlers that must
+ * push output before they return (kexec) */
+static control_conn_t *exec_conn = NULL;
+
 static char *trim(char *str) {
     while (isspace(*str)) str++;
     char *end = str + strlen(str) - 1;
@@ -27,8 +75,53 @@ static char *trim(char *str) {
     return str;
 }
 
+static int buf_reserve(control_buf_t *buf, size_t extra) {
+    if (buf->len + extra + 1 <= buf->cap) return 0;
+
+    size_t new_cap = buf->cap ? buf->cap : 4096;
+    while (new_cap < buf->len + extra + 1) new_cap *= 2;
+
+    char *grown = realloc(buf->data, new_cap);
+    if (!grown) {
+        LOG_ERR("out of memory growing control reply");
+        return -1;
+    }
+    buf->data = grown;
+    buf->cap = new_cap;
+    return 0;
+}
+
+int control_append(control_buf_t *buf, const char *data, size_t len) {
+    if (buf_reserve(buf, len) < 0) return -1;
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+    return 0;
+}
+
+int control_printf(control_buf_t *buf, const char *fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n < 0 || buf_reserve(buf, (size_t)n) < 0) return -1;
+
+    va_start(ap, fmt);
+    vsnprintf(buf->data + buf->len, buf->cap - buf->len, fmt, ap);
+    va_end(ap);
+    buf->len += (size_t)n;
+    return n;
+}
+
+void control_buf_free(control_buf_t *buf) {
+    free(buf->data);
+    buf->data = NULL;
+    buf->len = buf->cap = 0;
+}
+
 int setup_control_socket(void) {
-    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (fd < 0) {
         LOG_ERR("control socket failed: %s", strerror(errno));
         return -1;
@@ -45,7 +138,7 @@ int setup_control_socket(void) {
         return -1;
     }
 
-    if (listen(fd, 5) < 0) {
+    if (listen(fd, CONTROL_MAX_CLIENTS) < 0) {
         close(fd);
         return -1;
     }
@@ -54,21 +147,594 @@ int setup_control_socket(void) {
     return fd;
 }
 
-void handle_control_command(int client_fd) {
-    char buf[1024];
-    int n = read(client_fd, buf, sizeof(buf) - 1);
-    if (n <= 0) return;
-    buf[n] = '\0';
+static void control_output(const char *name, const char *data, size_t len);
+
+void control_init(int epoll_fd) {
+    ctl_epoll_fd = epoll_fd;
+    output_set_listener(control_output);
+}
+
+static void conn_close(control_conn_t *c) {
+    if (ctl_epoll_fd >= 0) {
+        epoll_ctl(ctl_epoll_fd, EPOLL_CTL_DEL, c->src.fd, NULL);
+    }
+    close(c->src.fd);
+    control_buf_free(&c->wbuf);
+    if (exec_conn == c) exec_conn = NULL;
+    if (c->subscribed) n_subscribers--;
+    if (c->follow[0]) n_followers--;
+    memset(c, 0, sizeof(*c));
+    c->src.fd = -1;
+    n_conns--;
+}
+
+static size_t conn_pending(const control_conn_t *c) {
+    return c->wbuf.len - c->woff;
+}
+
+/* Register for reads while we are willing to take more commands, and for
+ * writes only while output is queued */
+static void conn_update_interest(control_conn_t *c) {
+    uint32_t want = 0;
+    if (!c->read_closed && !c->closing && conn_pending(c) < CONTROL_WBUF_HIGH)
+        want |= EPOLLIN;
+    if (conn_pending(c) > 0)
+        want |= EPOLLOUT;
+
+    if (want == c->interest || ctl_epoll_fd < 0) return;
+
+    struct epoll_event ev = { .events = want, .data.ptr = &c->src };
+    epoll_ctl(ctl_epoll_fd, EPOLL_CTL_MOD, c->src.fd, &ev);
+    c->interest = want;
+}
+
+/* Send as much queued output as the socket takes. Returns -1 if the peer
+ * is gone. */
+static int conn_flush(control_conn_t *c) {
+    while (conn_pending(c) > 0) {
+        ssize_t n = send(c->src.fd, c->wbuf.data + c->woff, conn_pending(c),
+                         MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        c->woff += (size_t)n;
+    }
+
+    /* Fully drained: reuse the buffer from the start, and give back memory
+     * left over from an unusually large reply */
+    c->wbuf.len = c->woff = 0;
+    if (c->wbuf.cap > 4 * CONTROL_LINE_MAX) {
+        control_buf_free(&c->wbuf);
+    }
+    return 0;
+}
+
+static void conn_subscribe(control_conn_t *c) {
+    if (c->subscribed) return;
+
+    /* Existing subscribers get everything up to now before the baseline
+     * moves; the first subscriber starts from a fresh one */
+    if (n_subscribers > 0) {
+        control_publish();
+    } else {
+        json_events_reset();
+    }
+    c->subscribed = 1;
+    n_subscribers++;
+
+    size_t frame = json_frame_begin(&c->wbuf);
+    control_printf(&c->wbuf, "{\"type\":\"subscribed\"}");
+    json_frame_end(&c->wbuf, frame);
+    json_status(&c->wbuf);
+    json_caps(&c->wbuf);
+}
+
+static void conn_unsubscribe(control_conn_t *c) {
+    if (!c->subscribed) return;
+    c->subscribed = 0;
+    n_subscribers--;
+}
+
+/* "log -f <name> [lines]": the usual tail, then output as it arrives */
+static void conn_follow(control_conn_t *c, const char *args) {
+    char name[MAX_NAME];
+    int lines = 20;
+
+    if (sscanf(args, "%127s %d", name, &lines) < 1) {
+        const char *usage = "Usage: log -f <component_name> [lines]";
+        if (c->json) {
+            json_error(&c->wbuf, usage);
+        } else {
+            control_printf(&c->wbuf, "Error: %s\n", usage);
+        }
+        return;
+    }
+
+    char cmd[MAX_NAME + 32];
+    snprintf(cmd, sizeof(cmd), "log %s %d", name, lines);
+    if (c->json) {
+        control_buf_t text = {0};
+        control_execute(cmd, &text);
+        json_text(&c->wbuf, cmd, text.data ? text.data : "", text.len);
+        control_buf_free(&text);
+    } else {
+        control_execute(cmd, &c->wbuf);
+    }
+
+    /* The tail above already reported an unknown component */
+    for (int i = 0; i < n_components; i++) {
+        if (strcmp(components[i].name, name) == 0) {
+            if (!c->follow[0]) n_followers++;
+            snprintf(c->follow, sizeof(c->follow), "%s", name);
+            break;
+        }
+    }
+}
+
+/* Protocol switching, subscriptions and log following are per
+ * connection; everything else goes to control_execute(), wrapped in a
+ * frame in JSON mode */
+static void conn_command(control_conn_t *c, const char *line) {
+    if (strncmp(line, "log -f", 6) == 0 && (line[6] == ' ' || line[6] == '\0')) {
+        conn_follow(c, line + 6);
+        return;
+    }
+
+    if (strcmp(line, "proto json") == 0) {
+        c->json = 1;
+        size_t frame = json_frame_begin(&c->wbuf);
+        control_printf(&c->wbuf, "{\"type\":\"proto\",\"protocol\":\"json\",\"version\":1}");
+        json_frame_end(&c->wbuf, frame);
+        return;
+    }
+    if (strcmp(line, "proto text") == 0) {
+        c->json = 0;
+        conn_unsubscribe(c);
+        control_printf(&c->wbuf, "OK\n");
+        return;
+    }
+
+    if (!c->json) {
+        if (strcmp(line, "subscribe") == 0) {
+            control_printf(&c->wbuf, "Error: subscribe requires 'proto json' first\n");
+        } else {
+            control_execute(line, &c->wbuf);
+        }
+        return;
+    }
+
+    if (strcmp(line, "status") == 0) {
+        json_status(&c->wbuf);
+    } else if (strcmp(line, "caps") == 0 || strcmp(line, "capabilities") == 0) {
+        json_caps(&c->wbuf);
+    } else if (strcmp(line, "readiness") == 0) {
+        json_readiness(&c->wbuf);
+    } else if (strcmp(line, "top") == 0) {
+        json_top(&c->wbuf);
+    } else if (strncmp(line, "stats ", 6) == 0) {
+        json_stats(&c->wbuf, line + 6);
+    } else if (strcmp(line, "subscribe") == 0) {
+        conn_subscribe(c);
+    } else if (strcmp(line, "unsubscribe") == 0) {
+        conn_unsubscribe(c);
+        size_t frame = json_frame_begin(&c->wbuf);
+        control_printf(&c->wbuf, "{\"type\":\"unsubscribed\"}");
+        json_frame_end(&c->wbuf, frame);
+    } else {
+        control_buf_t text = {0};
+        control_execute(line, &text);
+        json_text(&c->wbuf, line, text.data ? text.data : "", text.len);
+        control_buf_free(&text);
+    }
+}
+
+/* Execute every complete line in the read buffer, stopping early while the
+ * reply backlog is over the high-water mark */
+static void conn_process(control_conn_t *c) {
+    size_t start = 0;
+
+    while (!c->closing && conn_pending(c) < CONTROL_WBUF_HIGH) {
+        char *nl = memchr(c->rbuf + start, '\n', c->rlen - start);
+        size_t end;
+        if (nl) {
+            end = (size_t)(nl - c->rbuf);
+        } else if (c->read_closed && start < c->rlen) {
+            end = c->rlen;  /* unterminated last command before EOF */
+        } else {
+            break;
+        }
+
+        char line[CONTROL_LINE_MAX + 1];
+        memcpy(line, c->rbuf + start, end - start);
+        line[end - start] = '\0';
+        start = nl ? end + 1 : end;
+
+        if (*trim(line) == '\0') continue;
+
+        exec_conn = c;
+        uint64_t began = trace_now_us();
+        conn_command(c, line);
+        metrics_observe(METRIC_CONTROL, trace_now_us() - began);
+        exec_conn = NULL;
+    }
+
+    if (start > 0) {
+        memmove(c->rbuf, c->rbuf + start, c->rlen - start);
+        c->rlen -= start;
+    }
+
+    if (c->rlen == sizeof(c->rbuf) && !memchr(c->rbuf, '\n', c->rlen)) {
+        control_printf(&c->wbuf, "Error: command longer than %d bytes\n",
+                   CONTROL_LINE_MAX - 1);
+        c->rlen = 0;
+        c->closing = 1;
+    }
+}
+
+static void conn_read(control_conn_t *c) {
+    while (c->rlen < sizeof(c->rbuf)) {
+        ssize_t n = read(c->src.fd, c->rbuf + c->rlen, sizeof(c->rbuf) - c->rlen);
+        if (n > 0) {
+            c->rlen += (size_t)n;
+            continue;
+        }
+        if (n == 0) {
+            c->read_closed = 1;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            c->read_closed = 1;
+            c->closing = 1;
+        }
+        break;
+    }
+}
+
+int control_add_client(int fd) {
+    if (n_conns >= CONTROL_MAX_CLIENTS) {
+        LOG_WARN("control: too many clients, refusing connection");
+        close(fd);
+        return -1;
+    }
+
+    control_conn_t *c = NULL;
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        if (!conns[i].in_use) {
+            c = &conns[i];
+            break;
+        }
+    }
+
+    memset(c, 0, sizeof(*c));
+    c->src.type = EVENT_CONTROL_CLIENT;
+    c->src.fd = fd;
+    c->in_use = 1;
+    c->interest = EPOLLIN;
+
+    if (ctl_epoll_fd >= 0) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &c->src };
+        if (epoll_ctl(ctl_epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            LOG_ERR("control: epoll add failed: %s", strerror(errno));
+            close(fd);
+            c->in_use = 0;
+            return -1;
+        }
+    }
+
+    n_conns++;
+    return 0;
+}
+
+void control_accept(int listen_fd) {
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_WARN("control accept failed: %s", strerror(errno));
+            }
+            return;
+        }
+        control_add_client(fd);
+    }
+}
+
+void control_client_event(event_source_t *src, uint32_t events) {
+    control_conn_t *c = (control_conn_t *)src;
+    if (!c->in_use) return;
+
+    if (events & EPOLLERR) {
+        conn_close(c);
+        return;
+    }
+
+    if (events & (EPOLLIN | EPOLLHUP)) {
+        conn_read(c);
+    }
+
+    conn_process(c);
+
+    /* Peer is gone entirely; nobody is left to read a subscription */
+    if (events & EPOLLHUP) c->closing = 1;
+
+    if (conn_flush(c) < 0) {
+        conn_close(c);
+        return;
+    }
+
+    /* Done once the peer has stopped sending and every reply went out;
+     * subscribers and followers stay until they hang up */
+    if (((c->read_closed && !c->subscribed && !c->follow[0]) || c->closing) &&
+        conn_pending(c) == 0) {
+        conn_close(c);
+        return;
+    }
+
+    conn_update_interest(c);
+}
+
+int control_client_count(void) {
+    return n_conns;
+}
+
+void control_publish(void) {
+    if (n_subscribers == 0) return;
+
+    control_buf_t events = {0};
+    if (json_events(&events) > 0) {
+        for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+            control_conn_t *c = &conns[i];
+            if (!c->in_use || !c->subscribed) continue;
+
+            if (conn_pending(c) >= CONTROL_WBUF_HIGH) {
+                LOG_WARN("control: dropping subscriber that stopped reading");
+                conn_close(c);
+                continue;
+            }
+            control_append(&c->wbuf, events.data, events.len);
+            if (conn_flush(c) < 0) {
+                conn_close(c);
+                continue;
+            }
+            conn_update_interest(c);
+        }
+    }
+    control_buf_free(&events);
+}
+
+/* New output of a component, for the connections following it */
+static void control_output(const char *name, const char *data, size_t len) {
+    if (n_followers == 0) return;
+
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        control_conn_t *c = &conns[i];
+        if (!c->in_use || strcmp(c->follow, name) != 0) continue;
+
+        if (conn_pending(c) >= CONTROL_WBUF_HIGH) {
+            LOG_WARN("control: dropping log follower that stopped reading");
+            conn_close(c);
+            continue;
+        }
+        if (c->json) {
+            size_t frame = json_frame_begin(&c->wbuf);
+            control_printf(&c->wbuf, "{\"type\":\"log\",\"component\":");
+            json_string(&c->wbuf, name);
+            control_printf(&c->wbuf, ",\"data\":");
+            json_string_len(&c->wbuf, data, len);
+            control_printf(&c->wbuf, "}");
+            json_frame_end(&c->wbuf, frame);
+        } else {
+            control_append(&c->wbuf, data, len);
+        }
+        if (conn_flush(c) < 0) {
+            conn_close(c);
+            continue;
+        }
+        conn_update_interest(c);
+    }
+}
+
+void control_close_all(void) {
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        if (conns[i].in_use) conn_close(&conns[i]);
+    }
+}
 
+/* 1536 -> "1.5K"; plain bytes below 1K */
+static void format_bytes(char *buf, size_t size, double bytes) {
+    static const char units[] = "KMGT";
+    if (bytes < 1024) {
+        snprintf(buf, size, "%.0f", bytes);
+        return;
+    }
+    int u = -1;
+    while (bytes >= 1024 && u < 3) {
+        bytes /= 1024;
+        u++;
+    }
+    snprintf(buf, size, "%.1f%c", bytes, units[u]);
+}
+
+/* One row per sample: what top and stats show */
+static void telemetry_row(control_buf_t *out, const char *label,
+                          const telemetry_sample_t *s, const telemetry_rate_t *rate) {
+    char mem[16], anon[16], file[16], rd[16], wr[16];
+    format_bytes(mem, sizeof(mem), (double)s->mem_current);
+    format_bytes(anon, sizeof(anon), (double)s->mem_anon);
+    format_bytes(file, sizeof(file), (double)s->mem_file);
+
+    control_printf(out, "%-20s ", label);
+    if (rate) {
+        format_bytes(rd, sizeof(rd), rate->io_read_bps);
+        format_bytes(wr, sizeof(wr), rate->io_write_bps);
+        control_printf(out, "%6.1f ", rate->cpu_percent);
+    } else {
+        snprintf(rd, sizeof(rd), "-");
+        snprintf(wr, sizeof(wr), "-");
+        control_printf(out, "%6s ", "-");
+    }
+    control_printf(out, "%8s %8s %8s %8s %8s  %u.%02u/%u.%02u/%u.%02u\n",
+                   mem, anon, file, rd, wr,
+                   s->cpu_some / 100, s->cpu_some % 100,
+                   s->mem_some / 100, s->mem_some % 100,
+                   s->io_some / 100, s->io_some % 100);
+}
+
+#define TELEMETRY_HEADER \
+    "%-20s   CPU%%   MEMORY     ANON     FILE   READ/s  WRITE/s  PSI cpu/mem/io\n"
+
+typedef struct {
+    int                idx;
+    telemetry_sample_t last;
+    telemetry_rate_t   rate;
+    int                have_rate;
+} top_row_t;
+
+static int top_row_cmp(const void *a, const void *b) {
+    const top_row_t *x = a, *y = b;
+    if (x->rate.cpu_percent != y->rate.cpu_percent) {
+        return x->rate.cpu_percent < y->rate.cpu_percent ? 1 : -1;
+    }
+    return x->idx - y->idx;
+}
+
+/* "top": the latest sample of every component, busiest first */
+static void control_top(control_buf_t *out) {
+    top_row_t *rows = calloc((size_t)(n_components ? n_components : 1), sizeof(*rows));
+    int n = 0;
+    if (!rows) {
+        control_printf(out, "Error: out of memory\n");
+        return;
+    }
+
+    for (int i = 0; i < n_components; i++) {
+        telemetry_sample_t s[2];
+        int got = components[i].cgroup_fd > 0 ?
+                  telemetry_history(components[i].cgroup_fd, s, 2) : 0;
+        if (got == 0) continue;
+
+        rows[n].idx = i;
+        rows[n].last = s[got - 1];
+        rows[n].have_rate = got == 2;
+        if (got == 2) telemetry_rate(&s[0], &s[1], &rows[n].rate);
+        n++;
+    }
+    qsort(rows, (size_t)n, sizeof(*rows), top_row_cmp);
+
+    control_printf(out, "Resource usage (every %ds, %d cgroups, last pass %lluus)\n\n",
+                   TELEMETRY_INTERVAL_MS / 1000, telemetry_count(),
+                   (unsigned long long)telemetry_last_pass_us());
+    control_printf(out, TELEMETRY_HEADER, "COMPONENT");
+    for (int i = 0; i < n; i++) {
+        telemetry_row(out, components[rows[i].idx].name, &rows[i].last,
+                      rows[i].have_rate ? &rows[i].rate : NULL);
+    }
+    if (n < n_components) {
+        control_printf(out, "\n%d component(s) without samples yet\n", n_components - n);
+    }
+    free(rows);
+}
+
+/* "stats <name>": a component's kept samples, oldest first */
+static void control_stats(control_buf_t *out, const char *name) {
+    if (!*name) {
+        control_printf(out,
+                       "Error: stats command requires component name\n"
+                       "Usage: stats <component_name>\n");
+        return;
+    }
+
+    component_t *comp = NULL;
+    for (int i = 0; i < n_components; i++) {
+        if (strcmp(components[i].name, name) == 0) {
+            comp = &components[i];
+            break;
+        }
+    }
+    if (!comp) {
+        control_printf(out, "Error: component '%s' not found\n", name);
+        return;
+    }
+
+    telemetry_sample_t s[TELEMETRY_SAMPLES];
+    int n = comp->cgroup_fd > 0 ? telemetry_history(comp->cgroup_fd, s, TELEMETRY_SAMPLES) : 0;
+    if (n == 0) {
+        control_printf(out, "No resource samples for component '%s' yet\n", name);
+        return;
+    }
+
+    control_printf(out, "Resource history of '%s' (%d samples, every %ds)\n\n",
+                   name, n, TELEMETRY_INTERVAL_MS / 1000);
+    control_printf(out, TELEMETRY_HEADER, "AGE");
+    uint64_t now = s[n - 1].time_ms;
+    for (int i = 0; i < n; i++) {
+        char age[32];
+        snprintf(age, sizeof(age), "-%llus", (unsigned long long)((now - s[i].time_ms) / 1000));
+        telemetry_rate_t rate;
+        if (i > 0) telemetry_rate(&s[i - 1], &s[i], &rate);
+        telemetry_row(out, age, &s[i], i > 0 ? &rate : NULL);
+    }
+}
+
+#define TREE_MAX_DEPTH 32
+
+/* The requirements of component idx for `tree`, each followed by its
+ * provider's own the first time that provider is shown; a running
+ * provider is the one registered, otherwise the declared one */
+static void control_tree(control_buf_t *out, int idx, char *prefix, size_t prefix_len,
+                         int depth, unsigned char *expanded) {
+    component_t *comp = &components[idx];
+    const int *deps = NULL;
+    int n_deps = graph_direct_dependencies(idx, &deps);
+
+    for (int i = 0; i < comp->n_requires; i++) {
+        int last = i == comp->n_requires - 1;
+        int cap = comp->requires_id[i];
+        int up = cap >= 0 && capability_active_by_idx(cap);
+        int provider = up ? capability_provider(cap) : -1;
+        if (provider >= n_components) provider = -1;
+        for (int d = 0; d < n_deps && provider < 0; d++) {
+            for (int p = 0; p < components[deps[d]].n_provides; p++) {
+                if (components[deps[d]].provides_id[p] == cap) {
+                    provider = deps[d];
+                    break;
+                }
+            }
+        }
+
+        int expand = provider >= 0 && components[provider].n_requires > 0;
+        control_printf(out, "%s%s requires: %s (%s%s%s)%s\n",
+                       prefix, last ? "└──" : "├──", comp->requires[i],
+                       up ? "UP" : "DOWN",
+                       provider < 0 ? "" : up ? ", from " : ", provided by ",
+                       provider < 0 ? "" : components[provider].name,
+                       expand && expanded[provider] ? " ..." : "");
+        if (!expand || expanded[provider]) continue;
+
+        size_t len = strlen(prefix);
+        snprintf(prefix + len, prefix_len - len, "%s", last ? "    " : "│   ");
+        if (depth + 1 >= TREE_MAX_DEPTH) {
+            control_printf(out, "%s└── ...\n", prefix);
+        } else {
+            expanded[provider] = 1;
+            control_tree(out, provider, prefix, prefix_len, depth + 1, expanded);
+        }
+        prefix[len] = '\0';
+    }
+}
+
+void control_execute(const char *line, control_buf_t *out) {
+    char buf[CONTROL_LINE_MAX];
+    snprintf(buf, sizeof(buf), "%s", line);
     char *cmd = trim(buf);
-    char response[4096];
-    int rlen = 0;
 
     if (strcmp(cmd, "status") == 0) {
         /* Enhanced table format status display */
-        rlen = snprintf(response, sizeof(response),
-                        "COMPONENT            STATE      PID     UPTIME  RESTARTS\n"
-                        "────────────────────────────────────────────────────────\n");
+        control_printf(out,
+                       "COMPONENT            STATE      PID     UPTIME  RESTARTS\n"
+                       "────────────────────────────────────────────────────────\n");
 
         for (int i = 0; i < n_components; i++) {
             component_t *comp = &components[i];
@@ -81,6 +747,9 @@ void handle_control_command(int client_fd) {
                 case COMP_DEGRADED:     state_str = "DEGRADED";  break;
                 case COMP_FAILED:       state_str = "FAILED";    break;
                 case COMP_ONESHOT_DONE: state_str = "DONE";      break;
+                case COMP_QUARANTINED: state_str = "QUARANTINED"; break;
+                case COMP_IDLE:        state_str = "IDLE";      break;
+                case COMP_MIGRATED:    state_str = "MIGRATED";  break;
             }
 
             /* Calculate uptime */
@@ -117,9 +786,9 @@ void handle_control_command(int client_fd) {
             }
 
             /* Add row to table with proper alignment */
-            rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                             "%-20s %-10s %-7s %-7s %d\n",
-                             comp->name, state_str, pid_str, uptime_str, comp->restart_count);
+            control_printf(out,
+                           "%-20s %-10s %-7s %-7s %d\n",
+                           comp->name, state_str, pid_str, uptime_str, comp->restart_count);
         }
 
         /* Add summary statistics */
@@ -135,6 +804,7 @@ void handle_control_command(int client_fd) {
                     degraded_count++;
                     break;
                 case COMP_FAILED:
+                case COMP_QUARANTINED:
                     failed_count++;
                     break;
                 case COMP_STARTING:
@@ -146,16 +816,16 @@ void handle_control_command(int client_fd) {
             }
         }
 
-        rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                         "────────────────────────────────────────────────────────\n"
-                         "Summary: %d active, %d degraded, %d starting, %d failed, %d total\n",
-                         active_count, degraded_count, starting_count, failed_count, n_components);
+        control_printf(out,
+                       "────────────────────────────────────────────────────────\n"
+                       "Summary: %d active, %d degraded, %d starting, %d failed, %d total\n",
+                       active_count, degraded_count, starting_count, failed_count, n_components);
 
     } else if (strcmp(cmd, "caps") == 0 || strcmp(cmd, "capabilities") == 0) {
         /* Show all capabilities with status and provider */
-        rlen = snprintf(response, sizeof(response),
-                        "CAPABILITY                     STATUS  PROVIDER\n"
-                        "──────────────────────────────────────────────────────────\n");
+        control_printf(out,
+                       "CAPABILITY                     STATUS  PROVIDER\n"
+                       "──────────────────────────────────────────────────────────\n");
 
         int total_caps = capability_count();
         int up_count = 0, down_count = 0;
@@ -175,19 +845,45 @@ void handle_control_command(int client_fd) {
             if (active && provider_idx >= 0 && provider_idx < n_components) {
                 provider = components[provider_idx].name;
                 up_count++;
+            } else if (active && strchr(cap_name, '@')) {
+                /* Federated: provided on the node it is named after */
+                provider = strrchr(cap_name, '@') + 1;
+                up_count++;
             } else {
                 down_count++;
             }
 
-            rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                             "%-30s %-7s %s\n",
-                             cap_name, status, provider);
+            control_printf(out,
+                           "%-30s %-7s %s\n",
+                           cap_name, status, provider);
         }
 
-        rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                         "──────────────────────────────────────────────────────────\n"
-                         "Total: %d capabilities (%d up, %d down)\n",
-                         total_caps, up_count, down_count);
+        control_printf(out,
+                       "──────────────────────────────────────────────────────────\n"
+                       "Total: %d capabilities (%d up, %d down)\n",
+                       total_caps, up_count, down_count);
+
+    } else if (strcmp(cmd, "peers") == 0) {
+        /* Federation peers and what they provide */
+        if (!federation_enabled()) {
+            control_printf(out, "Federation is off (no %s)\n", FEDERATION_CONFIG);
+        } else {
+            control_printf(out,
+                           "This node: %s\n\n"
+                           "NODE                 ADDRESS                  STATUS  CAPS  HEARD\n"
+                           "──────────────────────────────────────────────────────────────────\n",
+                           federation_node());
+            federation_peer_t peer;
+            for (int i = 0; federation_peer(i, &peer) == 0; i++) {
+                char heard[32] = "never";
+                if (peer.heard_ms_ago >= 0) {
+                    snprintf(heard, sizeof(heard), "%ldms ago", peer.heard_ms_ago);
+                }
+                control_printf(out, "%-20s %-24s %-7s %2d/%-2d %s\n",
+                               peer.node[0] ? peer.node : "?", peer.addr,
+                               peer.alive ? "UP" : "DOWN", peer.n_up, peer.n_caps, heard);
+            }
+        }
 
     } else if (strncmp(cmd, "tree", 4) == 0) {
         /* Show dependency tree for a component */
@@ -197,9 +893,9 @@ void handle_control_command(int client_fd) {
         }
 
         if (!component_name || strlen(component_name) == 0) {
-            rlen = snprintf(response, sizeof(response),
-                            "Error: tree command requires component name\n"
-                            "Usage: tree <component_name>\n");
+            control_printf(out,
+                           "Error: tree command requires component name\n"
+                           "Usage: tree <component_name>\n");
         } else {
             /* Find the component */
             int comp_idx = -1;
@@ -211,83 +907,29 @@ void handle_control_command(int client_fd) {
             }
 
             if (comp_idx == -1) {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: component '%s' not found\n", component_name);
+                control_printf(out,
+                               "Error: component '%s' not found\n", component_name);
             } else {
                 component_t *comp = &components[comp_idx];
+                unsigned char *expanded = calloc((size_t)n_components, 1);
+                char prefix[TREE_MAX_DEPTH * 8];
+                prefix[0] = '\0';
 
                 /* Start the tree output */
-                rlen = snprintf(response, sizeof(response), "%s\n", comp->name);
-
-                /* Show requirements */
-                for (int i = 0; i < comp->n_requires; i++) {
-                    const char *req_cap = comp->requires[i];
-                    int cap_active = capability_active(req_cap);
-                    const char *status = cap_active ? "UP" : "DOWN";
-
-                    /* Find provider component */
-                    const char *provider = "-";
-                    int provider_idx = -1;
-                    if (cap_active) {
-                        int cap_idx = capability_index(req_cap);
-                        if (cap_idx >= 0) {
-                            provider_idx = capability_provider(cap_idx);
-                            if (provider_idx >= 0 && provider_idx < n_components) {
-                                provider = components[provider_idx].name;
-                            }
-                        }
-                    }
-
-                    /* Use tree characters */
-                    const char *tree_prefix = (i == comp->n_requires - 1) ? "└──" : "├──";
-
-                    rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                     "%s requires: %s (%s%s%s)\n",
-                                     tree_prefix, req_cap, status,
-                                     (provider && strcmp(provider, "-") != 0) ? ", from " : "",
-                                     (provider && strcmp(provider, "-") != 0) ? provider : "");
-
-                    /* Recursively show provider's dependencies if it's active */
-                    if (provider_idx >= 0 && provider_idx < n_components &&
-                        strcmp(provider, "-") != 0 && components[provider_idx].n_requires > 0) {
-
-                        component_t *provider_comp = &components[provider_idx];
-                        const char *sub_tree_prefix = (i == comp->n_requires - 1) ? "    " : "│   ";
-
-                        for (int j = 0; j < provider_comp->n_requires; j++) {
-                            const char *sub_req_cap = provider_comp->requires[j];
-                            int sub_cap_active = capability_active(sub_req_cap);
-                            const char *sub_status = sub_cap_active ? "UP" : "DOWN";
-
-                            const char *sub_provider = "-";
-                            if (sub_cap_active) {
-                                int sub_cap_idx = capability_index(sub_req_cap);
-                                if (sub_cap_idx >= 0) {
-                                    int sub_provider_idx = capability_provider(sub_cap_idx);
-                                    if (sub_provider_idx >= 0 && sub_provider_idx < n_components) {
-                                        sub_provider = components[sub_provider_idx].name;
-                                    }
-                                }
-                            }
-
-                            const char *sub_tree_char = (j == provider_comp->n_requires - 1) ? "└──" : "├──";
-
-                            rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                             "%s%s requires: %s (%s%s%s)\n",
-                                             sub_tree_prefix, sub_tree_char, sub_req_cap, sub_status,
-                                             (sub_provider && strcmp(sub_provider, "-") != 0) ? ", from " : "",
-                                             (sub_provider && strcmp(sub_provider, "-") != 0) ? sub_provider : "");
-                        }
-                    }
+                control_printf(out, "%s\n", comp->name);
+                if (expanded) {
+                    expanded[comp_idx] = 1;
+                    control_tree(out, comp_idx, prefix, sizeof(prefix), 0, expanded);
+                    free(expanded);
                 }
 
                 /* Show provides */
                 if (comp->n_provides > 0) {
-                    rlen += snprintf(response + rlen, sizeof(response) - rlen, "provides:\n");
+                    control_printf(out, "provides:\n");
                     for (int i = 0; i < comp->n_provides; i++) {
                         const char *tree_prefix = (i == comp->n_provides - 1) ? "└──" : "├──";
-                        rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                         "%s %s\n", tree_prefix, comp->provides[i]);
+                        control_printf(out,
+                                       "%s %s\n", tree_prefix, comp->provides[i]);
                     }
                 }
             }
@@ -301,43 +943,50 @@ void handle_control_command(int client_fd) {
         }
 
         if (!capability_name || strlen(capability_name) == 0) {
-            rlen = snprintf(response, sizeof(response),
-                            "Error: rdeps command requires capability name\n"
-                            "Usage: rdeps <capability_name>\n");
+            control_printf(out,
+                           "Error: rdeps command requires capability name\n"
+                           "Usage: rdeps <capability_name>\n");
         } else {
-            rlen = snprintf(response, sizeof(response), "%s:\n", capability_name);
-
-            int found_deps = 0;
-            /* Search all components for this capability in their requirements */
-            for (int i = 0; i < n_components; i++) {
-                component_t *comp = &components[i];
-                for (int j = 0; j < comp->n_requires; j++) {
-                    if (strcmp(comp->requires[j], capability_name) == 0) {
-                        const char *state_str = "UNKNOWN";
-                        switch (comp->state) {
-                            case COMP_INACTIVE:     state_str = "INACTIVE";  break;
-                            case COMP_STARTING:     state_str = "STARTING";  break;
-                            case COMP_READY_WAIT:   state_str = "READY_WAIT"; break;
-                            case COMP_ACTIVE:       state_str = "ACTIVE";    break;
-                            case COMP_DEGRADED:     state_str = "DEGRADED";  break;
-                            case COMP_FAILED:       state_str = "FAILED";    break;
-                            case COMP_ONESHOT_DONE: state_str = "DONE";      break;
-                        }
-
-                        rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                         "  → %s (%s)\n", comp->name, state_str);
-                        found_deps++;
-                        break; /* Each component only listed once even if it requires the cap multiple times */
-                    }
+            control_printf(out, "%s:\n", capability_name);
+
+            /* Direct consumers from the capability's consumer list, then
+             * everything depending on them from the graph analysis */
+            component_link_all();
+            int n_consumers = 0;
+            const int *consumers = capability_consumers(capability_index(capability_name), &n_consumers);
+            unsigned char *mark = calloc((size_t)(n_components > 0 ? n_components : 1), 1);
+            int *dependents = malloc((size_t)(n_components > 0 ? n_components : 1) * sizeof(int));
+            int direct = 0, indirect = 0;
+            for (int i = 0; mark && i < n_consumers; i++) {
+                if (consumers[i] >= n_components || mark[consumers[i]]) continue;
+                mark[consumers[i]] = 2;
+                component_t *comp = &components[consumers[i]];
+                control_printf(out,
+                               "  → %s (%s)\n", comp->name, json_state_name(comp->state));
+                direct++;
+            }
+            for (int i = 0; mark && dependents && i < n_consumers; i++) {
+                if (consumers[i] >= n_components) continue;
+                int n = graph_dependents(consumers[i], dependents, n_components);
+                for (int k = 0; k < n; k++) {
+                    if (mark[dependents[k]]) continue;
+                    mark[dependents[k]] = 1;
+                    component_t *comp = &components[dependents[k]];
+                    control_printf(out,
+                                   "  ⇢ %s (%s, indirectly)\n", comp->name, json_state_name(comp->state));
+                    indirect++;
                 }
             }
+            free(mark);
+            free(dependents);
 
-            if (found_deps == 0) {
-                rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                 "  (no components depend on this capability)\n");
+            if (direct == 0) {
+                control_printf(out,
+                               "  (no components depend on this capability)\n");
             } else {
-                rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                 "Total: %d component(s) depend on this capability\n", found_deps);
+                control_printf(out,
+                               "Total: %d component(s) depend on this capability (%d directly)\n",
+                               direct + indirect, direct);
             }
         }
 
@@ -349,9 +998,9 @@ void handle_control_command(int client_fd) {
         }
 
         if (!component_name || strlen(component_name) == 0) {
-            rlen = snprintf(response, sizeof(response),
-                            "Error: simulate remove command requires component name\n"
-                            "Usage: simulate remove <component_name>\n");
+            control_printf(out,
+                           "Error: simulate remove command requires component name\n"
+                           "Usage: simulate remove <component_name>\n");
         } else {
             /* Find the component */
             int comp_idx = -1;
@@ -363,81 +1012,108 @@ void handle_control_command(int client_fd) {
             }
 
             if (comp_idx == -1) {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: component '%s' not found\n", component_name);
+                control_printf(out,
+                               "Error: component '%s' not found\n", component_name);
             } else {
                 component_t *comp = &components[comp_idx];
 
-                rlen = snprintf(response, sizeof(response),
-                                "Removing %s would:\n", component_name);
+                control_printf(out,
+                               "Removing %s would:\n", component_name);
 
                 /* Show capabilities that would be withdrawn */
                 if (comp->n_provides > 0) {
-                    rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                     "  - Withdraw capabilities:\n");
+                    control_printf(out,
+                                   "  - Withdraw capabilities:\n");
                     for (int i = 0; i < comp->n_provides; i++) {
-                        rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                         "    → %s\n", comp->provides[i]);
+                        control_printf(out,
+                                       "    → %s\n", comp->provides[i]);
                     }
 
                     /* Show directly affected components */
                     int affected_count = 0;
-                    rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                     "  - Directly affect components:\n");
+                    control_printf(out,
+                                   "  - Directly affect components:\n");
 
+                    component_link_all();
                     for (int i = 0; i < comp->n_provides; i++) {
                         const char *cap = comp->provides[i];
-                        for (int j = 0; j < n_components; j++) {
-                            if (j == comp_idx) continue; /* Skip the component being removed */
+                        int n_consumers = 0;
+                        const int *consumers = capability_consumers(comp->provides_id[i], &n_consumers);
+                        for (int c = 0; c < n_consumers; c++) {
+                            int j = consumers[c];
+                            if (j == comp_idx || j >= n_components) continue; /* Skip the component being removed */
 
                             component_t *other_comp = &components[j];
-                            for (int k = 0; k < other_comp->n_requires; k++) {
-                                if (strcmp(other_comp->requires[k], cap) == 0) {
-                                    const char *state_str = "UNKNOWN";
-                                    switch (other_comp->state) {
-                                        case COMP_INACTIVE:     state_str = "INACTIVE";  break;
-                                        case COMP_STARTING:     state_str = "STARTING";  break;
-                                        case COMP_READY_WAIT:   state_str = "READY_WAIT"; break;
-                                        case COMP_ACTIVE:       state_str = "ACTIVE";    break;
-                                        case COMP_DEGRADED:     state_str = "DEGRADED";  break;
-                                        case COMP_FAILED:       state_str = "FAILED";    break;
-                                        case COMP_ONESHOT_DONE: state_str = "DONE";      break;
-                                    }
-
-                                    rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                                     "    → %s (requires %s, currently %s)\n",
-                                                     other_comp->name, cap, state_str);
-                                    affected_count++;
-                                    break; /* Each component only listed once */
-                                }
+                            const char *state_str = "UNKNOWN";
+                            switch (other_comp->state) {
+                                case COMP_INACTIVE:     state_str = "INACTIVE";  break;
+                                case COMP_STARTING:     state_str = "STARTING";  break;
+                                case COMP_READY_WAIT:   state_str = "READY_WAIT"; break;
+                                case COMP_ACTIVE:       state_str = "ACTIVE";    break;
+                                case COMP_DEGRADED:     state_str = "DEGRADED";  break;
+                                case COMP_FAILED:       state_str = "FAILED";    break;
+                                case COMP_ONESHOT_DONE: state_str = "DONE";      break;
+                                case COMP_QUARANTINED: state_str = "QUARANTINED"; break;
+                                case COMP_IDLE:        state_str = "IDLE";      break;
+                                case COMP_MIGRATED:    state_str = "MIGRATED";  break;
                             }
+
+                            control_printf(out,
+                                           "    → %s (requires %s, currently %s)\n",
+                                           other_comp->name, cap, state_str);
+                            affected_count++;
                         }
                     }
 
                     if (affected_count == 0) {
-                        rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                         "    (no other components would be affected)\n");
+                        control_printf(out,
+                                       "    (no other components would be affected)\n");
                     } else {
-                        rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                         "  - Total: %d component(s) would lose required capabilities\n",
-                                         affected_count);
+                        control_printf(out,
+                                       "  - Total: %d component(s) would lose required capabilities\n",
+                                       affected_count);
                     }
+
+                    /* And whatever depends on those, from the graph analysis */
+                    int *dependents = malloc((size_t)n_components * sizeof(int));
+                    int n_dependents = dependents ? graph_dependents(comp_idx, dependents, n_components) : 0;
+                    int indirect = 0;
+                    for (int k = 0; k < n_dependents; k++) {
+                        int j = dependents[k];
+                        int direct = j == comp_idx;
+                        for (int i = 0; i < comp->n_provides && !direct; i++) {
+                            int n_consumers = 0;
+                            const int *consumers = capability_consumers(comp->provides_id[i], &n_consumers);
+                            for (int c = 0; c < n_consumers && !direct; c++) direct = consumers[c] == j;
+                        }
+                        if (direct) continue;
+                        if (indirect++ == 0) {
+                            control_printf(out, "  - Indirectly affect components:\n");
+                        }
+                        control_printf(out, "    ⇢ %s (currently %s)\n",
+                                       components[j].name, json_state_name(components[j].state));
+                    }
+                    if (indirect > 0) {
+                        control_printf(out,
+                                       "  - Total: %d more component(s) depend on those\n", indirect);
+                    }
+                    free(dependents);
                 } else {
-                    rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                     "  - No capabilities would be withdrawn (component provides none)\n"
-                                     "  - No other components would be affected\n");
+                    control_printf(out,
+                                   "  - No capabilities would be withdrawn (component provides none)\n"
+                                   "  - No other components would be affected\n");
                 }
             }
         }
 
     } else if (strcmp(cmd, "dot") == 0) {
         /* Output dependency graph in Graphviz DOT format */
-        rlen = snprintf(response, sizeof(response),
-                        "digraph yakiros {\n"
-                        "    rankdir=LR;\n"
-                        "    node [shape=box, style=filled];\n"
-                        "\n"
-                        "    // Components\n");
+        control_printf(out,
+                       "digraph yakiros {\n"
+                       "    rankdir=LR;\n"
+                       "    node [shape=box, style=filled];\n"
+                       "\n"
+                       "    // Components\n");
 
         /* Add component nodes with colors based on state */
         for (int i = 0; i < n_components; i++) {
@@ -451,6 +1127,9 @@ void handle_control_command(int client_fd) {
                 case COMP_FAILED:
                     color = "lightcoral";
                     break;
+                case COMP_QUARANTINED:
+                    color = "red";
+                    break;
                 case COMP_STARTING:
                 case COMP_READY_WAIT:
                     color = "lightyellow";
@@ -460,13 +1139,13 @@ void handle_control_command(int client_fd) {
                     break;
             }
 
-            rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                             "    \"%s\" [fillcolor=%s];\n",
-                             comp->name, color);
+            control_printf(out,
+                           "    \"%s\" [fillcolor=%s];\n",
+                           comp->name, color);
         }
 
-        rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                         "\n    // Capabilities\n");
+        control_printf(out,
+                       "\n    // Capabilities\n");
 
         /* Add capability nodes */
         int total_caps = capability_count();
@@ -475,49 +1154,49 @@ void handle_control_command(int client_fd) {
             int active = capability_active_by_idx(i);
             const char *color = active ? "lightblue" : "lightcoral";
 
-            rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                             "    \"%s\" [shape=ellipse, fillcolor=%s];\n",
-                             cap_name, color);
+            control_printf(out,
+                           "    \"%s\" [shape=ellipse, fillcolor=%s];\n",
+                           cap_name, color);
         }
 
-        rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                         "\n    // Dependencies\n");
+        control_printf(out,
+                       "\n    // Dependencies\n");
 
         /* Add dependency edges (component -> required capability) */
         for (int i = 0; i < n_components; i++) {
             component_t *comp = &components[i];
             for (int j = 0; j < comp->n_requires; j++) {
-                rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                 "    \"%s\" -> \"%s\" [color=red];\n",
-                                 comp->name, comp->requires[j]);
+                control_printf(out,
+                               "    \"%s\" -> \"%s\" [color=red];\n",
+                               comp->name, comp->requires[j]);
             }
         }
 
-        rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                         "\n    // Provisions\n");
+        control_printf(out,
+                       "\n    // Provisions\n");
 
         /* Add provision edges (component -> provided capability) */
         for (int i = 0; i < n_components; i++) {
             component_t *comp = &components[i];
             for (int j = 0; j < comp->n_provides; j++) {
-                rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                 "    \"%s\" -> \"%s\" [color=green, arrowhead=diamond];\n",
-                                 comp->name, comp->provides[j]);
+                control_printf(out,
+                               "    \"%s\" -> \"%s\" [color=green, arrowhead=diamond];\n",
+                               comp->name, comp->provides[j]);
             }
         }
 
-        rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                         "\n    // Legend\n"
-                         "    subgraph cluster_legend {\n"
-                         "        label=\"Legend\";\n"
-                         "        style=filled;\n"
-                         "        fillcolor=lightgray;\n"
-                         "        \"Component\" [shape=box, fillcolor=lightgreen];\n"
-                         "        \"Capability\" [shape=ellipse, fillcolor=lightblue];\n"
-                         "        \"Component\" -> \"Capability\" [label=\"requires\", color=red];\n"
-                         "        \"Component\" -> \"Provided Cap\" [label=\"provides\", color=green, arrowhead=diamond];\n"
-                         "    }\n"
-                         "}\n");
+        control_printf(out,
+                       "\n    // Legend\n"
+                       "    subgraph cluster_legend {\n"
+                       "        label=\"Legend\";\n"
+                       "        style=filled;\n"
+                       "        fillcolor=lightgray;\n"
+                       "        \"Component\" [shape=box, fillcolor=lightgreen];\n"
+                       "        \"Capability\" [shape=ellipse, fillcolor=lightblue];\n"
+                       "        \"Component\" -> \"Capability\" [label=\"requires\", color=red];\n"
+                       "        \"Component\" -> \"Provided Cap\" [label=\"provides\", color=green, arrowhead=diamond];\n"
+                       "    }\n"
+                       "}\n");
 
     } else if (strncmp(cmd, "log", 3) == 0) {
         /* Show recent log entries for a component */
@@ -527,18 +1206,18 @@ void handle_control_command(int client_fd) {
         }
 
         if (!args || strlen(args) == 0) {
-            rlen = snprintf(response, sizeof(response),
-                            "Error: log command requires component name\n"
-                            "Usage: log <component_name> [lines]\n");
+            control_printf(out,
+                           "Error: log command requires component name\n"
+                           "Usage: log [-f] <component_name> [lines]\n");
         } else {
             /* Parse component name and optional line count */
             char component_name[MAX_NAME];
             int lines = 20; /* default */
 
             if (sscanf(args, "%127s %d", component_name, &lines) < 1) {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: invalid log command format\n"
-                                "Usage: log <component_name> [lines]\n");
+                control_printf(out,
+                               "Error: invalid log command format\n"
+                               "Usage: log <component_name> [lines]\n");
             } else {
                 /* Find the component */
                 int comp_idx = -1;
@@ -550,62 +1229,29 @@ void handle_control_command(int client_fd) {
                 }
 
                 if (comp_idx == -1) {
-                    rlen = snprintf(response, sizeof(response),
-                                    "Error: component '%s' not found\n", component_name);
+                    control_printf(out,
+                                   "Error: component '%s' not found\n", component_name);
                 } else {
-                    /* Construct log file path */
-                    char log_path[MAX_PATH];
-                    snprintf(log_path, sizeof(log_path), "/run/graph/%s.log", component_name);
-
-                    /* Try to read the log file */
-                    FILE *log_file = fopen(log_path, "r");
-                    if (!log_file) {
-                        rlen = snprintf(response, sizeof(response),
-                                        "Log file for component '%s' not found at %s\n"
-                                        "(Per-component logging may not be enabled)\n",
-                                        component_name, log_path);
+                    /* From memory, or the end of the log files */
+                    size_t len = 0;
+                    char *text = output_tail(component_name, lines, &len);
+                    if (!text) {
+                        char log_path[MAX_PATH];
+                        output_path(component_name, log_path, sizeof(log_path));
+                        control_printf(out,
+                                       "No output recorded for component '%s' (%s)\n",
+                                       component_name, log_path);
                     } else {
-                        rlen = snprintf(response, sizeof(response),
-                                        "Recent logs for component '%s' (last %d lines):\n"
-                                        "────────────────────────────────────────────────\n",
-                                        component_name, lines);
-
-                        /* Read the file and show last N lines */
-                        char line[1024];
-                        char *log_lines[100]; /* Buffer for up to 100 lines */
-                        int line_count = 0;
-
-                        /* Read all lines into memory */
-                        while (fgets(line, sizeof(line), log_file) && line_count < 100) {
-                            size_t len = strlen(line);
-                            log_lines[line_count] = malloc(len + 1);
-                            if (log_lines[line_count]) {
-                                strcpy(log_lines[line_count], line);
-                                line_count++;
-                            }
-                        }
-
-                        fclose(log_file);
-
-                        /* Show the last N lines */
-                        int start_line = (line_count > lines) ? line_count - lines : 0;
-                        for (int i = start_line; i < line_count; i++) {
-                            int remaining = sizeof(response) - rlen;
-                            if (remaining > (int)strlen(log_lines[i]) + 1) {
-                                rlen += snprintf(response + rlen, remaining, "%s", log_lines[i]);
-                            }
-                            free(log_lines[i]);
-                        }
-
-                        /* Free any remaining allocated lines */
-                        for (int i = 0; i < start_line; i++) {
-                            free(log_lines[i]);
-                        }
-
-                        if (line_count == 0) {
-                            rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                             "(log file is empty)\n");
+                        control_printf(out,
+                                       "Recent logs for component '%s' (last %d lines):\n"
+                                       "────────────────────────────────────────────────\n",
+                                       component_name, lines);
+                        control_append(out, text, len);
+                        if (len == 0) {
+                            control_printf(out,
+                                           "(log is empty)\n");
                         }
+                        free(text);
                     }
                 }
             }
@@ -613,7 +1259,7 @@ void handle_control_command(int client_fd) {
 
     } else if (strcmp(cmd, "readiness") == 0) {
         /* Show detailed readiness information */
-        rlen = snprintf(response, sizeof(response), "Readiness Status:\n");
+        control_printf(out, "Readiness Status:\n");
 
         int waiting_count = 0, ready_count = 0, timeout_count = 0;
 
@@ -627,49 +1273,55 @@ void handle_control_command(int client_fd) {
                 case READINESS_FILE:    method_str = "file"; break;
                 case READINESS_COMMAND: method_str = "command"; break;
                 case READINESS_SIGNAL:  method_str = "signal"; break;
+                case READINESS_NOTIFY:  method_str = "notify"; break;
                 case READINESS_NONE:    method_str = "none"; break;
             }
 
-            rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                             "  %s: method=%s, timeout=%ds",
-                             comp->name, method_str, comp->readiness_timeout);
+            control_printf(out,
+                           "  %s: method=%s, timeout=%ds",
+                           comp->name, method_str, comp->readiness_timeout);
 
             switch (comp->state) {
                 case COMP_READY_WAIT:
                     waiting_count++;
                     if (comp->ready_wait_start > 0) {
                         time_t elapsed = time(NULL) - comp->ready_wait_start;
-                        rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                         " [WAITING %lds]", (long)elapsed);
+                        control_printf(out,
+                                       " [WAITING %lds]", (long)elapsed);
                     } else {
-                        rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                         " [WAITING]");
+                        control_printf(out,
+                                       " [WAITING]");
                     }
                     break;
                 case COMP_ACTIVE:
                     ready_count++;
-                    rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                     " [READY]");
+                    control_printf(out,
+                                   " [READY]");
                     break;
                 case COMP_FAILED:
                     timeout_count++;
-                    rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                     " [FAILED/TIMEOUT]");
+                    control_printf(out,
+                                   " [FAILED/TIMEOUT]");
                     break;
                 default:
-                    rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                     " [%s]",
-                                     comp->state == COMP_INACTIVE ? "INACTIVE" :
-                                     comp->state == COMP_STARTING ? "STARTING" : "OTHER");
+                    control_printf(out,
+                                   " [%s]",
+                                   comp->state == COMP_INACTIVE ? "INACTIVE" :
+                                   comp->state == COMP_STARTING ? "STARTING" : "OTHER");
                     break;
             }
 
-            rlen += snprintf(response + rlen, sizeof(response) - rlen, "\n");
+            if (comp->notify_status[0]) {
+                control_printf(out,
+                               " status=\"%s\"", comp->notify_status);
+            }
+
+            control_printf(out, "\n");
         }
 
-        rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                         "\nSummary: %d ready, %d waiting, %d failed/timeout\n",
-                         ready_count, waiting_count, timeout_count);
+        control_printf(out,
+                       "\nSummary: %d ready, %d waiting, %d failed/timeout\n",
+                       ready_count, waiting_count, timeout_count);
 
     } else if (strncmp(cmd, "check-readiness", 15) == 0) {
         /* Trigger readiness check for all or specific component */
@@ -698,11 +1350,11 @@ void handle_control_command(int client_fd) {
         }
 
         if (component_name) {
-            rlen = snprintf(response, sizeof(response),
-                            "Readiness check triggered for component '%s'\n", component_name);
+            control_printf(out,
+                           "Readiness check triggered for component '%s'\n", component_name);
         } else {
-            rlen = snprintf(response, sizeof(response),
-                            "Readiness checks triggered for %d components\n", checks_performed);
+            control_printf(out,
+                           "Readiness checks triggered for %d components\n", checks_performed);
         }
 
     } else if (strncmp(cmd, "upgrade", 7) == 0) {
@@ -713,29 +1365,45 @@ void handle_control_command(int client_fd) {
         }
 
         if (!component_name || strlen(component_name) == 0) {
-            rlen = snprintf(response, sizeof(response),
-                            "Error: upgrade command requires component name\n"
-                            "Usage: upgrade <component_name>\n");
+            control_printf(out,
+                           "Error: upgrade command requires component name\n"
+                           "Usage: upgrade <component_name>\n");
         } else {
             int result = component_upgrade(component_name);
             if (result == 0) {
-                rlen = snprintf(response, sizeof(response),
-                                "Hot-swap upgrade initiated for component '%s'\n", component_name);
+                control_printf(out,
+                               "Hot-swap upgrade initiated for component '%s'\n", component_name);
             } else if (result == -1) {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: component '%s' not found\n", component_name);
+                control_printf(out,
+                               "Error: component '%s' not found\n", component_name);
             } else if (result == -2) {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: component '%s' does not support hot-swap (handoff != \"fd-passing\")\n", component_name);
+                control_printf(out,
+                               "Error: component '%s' does not support hot-swap (handoff != \"fd-passing\")\n", component_name);
             } else if (result == -3) {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: component '%s' is not currently active\n", component_name);
+                control_printf(out,
+                               "Error: component '%s' is not currently active\n", component_name);
             } else {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: upgrade failed for component '%s' (error code %d)\n", component_name, result);
+                control_printf(out,
+                               "Error: upgrade failed for component '%s' (error code %d)\n", component_name, result);
             }
         }
 
+    } else if (strncmp(cmd, "reset-failed", 12) == 0 && (cmd[12] == ' ' || cmd[12] == '\0')) {
+        /* Forget a component's failures and let it start again */
+        const char *component_name = cmd[12] ? cmd + 13 : "";
+        int result;
+        if (!component_name[0]) {
+            control_printf(out,
+                           "Error: reset-failed command requires component name\n"
+                           "Usage: reset-failed <component_name>\n");
+        } else if ((result = component_reset_failed(component_name)) == 0) {
+            control_printf(out, "Component '%s' will be started again\n", component_name);
+        } else if (result == -1) {
+            control_printf(out, "Error: component '%s' not found\n", component_name);
+        } else {
+            control_printf(out, "Error: component '%s' is not failed\n", component_name);
+        }
+
     } else if (strncmp(cmd, "checkpoint", 10) == 0) {
         /* Create checkpoint of a component */
         const char *component_name = NULL;
@@ -744,26 +1412,26 @@ void handle_control_command(int client_fd) {
         }
 
         if (!component_name || strlen(component_name) == 0) {
-            rlen = snprintf(response, sizeof(response),
-                            "Error: checkpoint command requires component name\n"
-                            "Usage: checkpoint <component_name>\n");
+            control_printf(out,
+                           "Error: checkpoint command requires component name\n"
+                           "Usage: checkpoint <component_name>\n");
         } else {
             int result = component_checkpoint(component_name);
             if (result == 0) {
-                rlen = snprintf(response, sizeof(response),
-                                "Checkpoint created successfully for component '%s'\n", component_name);
+                control_printf(out,
+                               "Checkpoint created successfully for component '%s'\n", component_name);
             } else if (result == -1) {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: component '%s' not found\n", component_name);
+                control_printf(out,
+                               "Error: component '%s' not found\n", component_name);
             } else if (result == -2) {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: CRIU not supported on this system\n");
+                control_printf(out,
+                               "Error: CRIU not supported on this system\n");
             } else if (result == -3) {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: component '%s' is not currently active\n", component_name);
+                control_printf(out,
+                               "Error: component '%s' is not currently active\n", component_name);
             } else {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: checkpoint failed for component '%s' (error code %d)\n", component_name, result);
+                control_printf(out,
+                               "Error: checkpoint failed for component '%s' (error code %d)\n", component_name, result);
             }
         }
 
@@ -771,40 +1439,67 @@ void handle_control_command(int client_fd) {
         /* Restore component from checkpoint */
         char component_name[128] = {0};
         char checkpoint_id[64] = {0};
+        char page_server[256] = {0};
+        int lazy = 0;
+        int args_parsed = 0;
+        int bad_args = 0;
+
+        /* Parse "restore <component> [checkpoint_id] [--lazy] [--page-server host[:port]]" */
+        char args[1024];
+        snprintf(args, sizeof(args), "%s", cmd + 7);
+        char *save = NULL;
+        for (char *arg = strtok_r(args, " ", &save); arg; arg = strtok_r(NULL, " ", &save)) {
+            if (strcmp(arg, "--lazy") == 0) {
+                lazy = 1;
+            } else if (strcmp(arg, "--page-server") == 0) {
+                char *server = strtok_r(NULL, " ", &save);
+                if (server) {
+                    snprintf(page_server, sizeof(page_server), "%s", server);
+                } else {
+                    bad_args = 1;
+                }
+                lazy = 1;
+            } else if (args_parsed == 0) {
+                snprintf(component_name, sizeof(component_name), "%s", arg);
+                args_parsed++;
+            } else if (args_parsed == 1) {
+                snprintf(checkpoint_id, sizeof(checkpoint_id), "%s", arg);
+                args_parsed++;
+            }
+        }
 
-        /* Parse "restore <component> [checkpoint_id]" */
-        int args_parsed = sscanf(cmd, "restore %127s %63s", component_name, checkpoint_id);
-
-        if (args_parsed < 1) {
-            rlen = snprintf(response, sizeof(response),
-                            "Error: restore command requires component name\n"
-                            "Usage: restore <component_name> [checkpoint_id]\n");
+        if (args_parsed < 1 || bad_args) {
+            control_printf(out,
+                           "Error: restore command requires component name\n"
+                           "Usage: restore <component_name> [checkpoint_id] [--lazy] [--page-server host[:port]]\n");
         } else {
             const char *checkpoint_ptr = (args_parsed >= 2 && strlen(checkpoint_id) > 0) ? checkpoint_id : NULL;
-            int result = component_restore(component_name, checkpoint_ptr);
+            int result = lazy ? component_restore_lazy(component_name, checkpoint_ptr,
+                                                       page_server[0] ? page_server : NULL) :
+                                component_restore(component_name, checkpoint_ptr);
 
             if (result == 0) {
                 if (checkpoint_ptr) {
-                    rlen = snprintf(response, sizeof(response),
-                                    "Component '%s' restored successfully from checkpoint %s\n",
-                                    component_name, checkpoint_ptr);
+                    control_printf(out,
+                                   "Component '%s' restored successfully from checkpoint %s\n",
+                                   component_name, checkpoint_ptr);
                 } else {
-                    rlen = snprintf(response, sizeof(response),
-                                    "Component '%s' restored successfully from latest checkpoint\n",
-                                    component_name);
+                    control_printf(out,
+                                   "Component '%s' restored successfully from latest checkpoint\n",
+                                   component_name);
                 }
             } else if (result == -1) {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: component '%s' not found\n", component_name);
+                control_printf(out,
+                               "Error: component '%s' not found\n", component_name);
             } else if (result == -2) {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: CRIU not supported on this system\n");
+                control_printf(out,
+                               "Error: CRIU not supported on this system\n");
             } else if (result == -3) {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: no checkpoints found for component '%s'\n", component_name);
+                control_printf(out,
+                               "Error: no checkpoints found for component '%s'\n", component_name);
             } else {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: restore failed for component '%s' (error code %d)\n", component_name, result);
+                control_printf(out,
+                               "Error: restore failed for component '%s' (error code %d)\n", component_name, result);
             }
         }
 
@@ -822,29 +1517,29 @@ void handle_control_command(int client_fd) {
         int count = checkpoint_list_checkpoints(component_name, 1, &head); /* persistent storage */
 
         if (count < 0) {
-            rlen = snprintf(response, sizeof(response),
-                            "Error: failed to list checkpoints\n");
+            control_printf(out,
+                           "Error: failed to list checkpoints\n");
         } else if (count == 0) {
             if (component_name) {
-                rlen = snprintf(response, sizeof(response),
-                                "No checkpoints found for component '%s'\n", component_name);
+                control_printf(out,
+                               "No checkpoints found for component '%s'\n", component_name);
             } else {
-                rlen = snprintf(response, sizeof(response),
-                                "No checkpoints found\n");
+                control_printf(out,
+                               "No checkpoints found\n");
             }
         } else {
-            int pos = snprintf(response, sizeof(response),
-                              "Available checkpoints%s%s:\n",
-                              component_name ? " for " : "",
-                              component_name ? component_name : "");
+            control_printf(out,
+                           "Available checkpoints%s%s:\n",
+                           component_name ? " for " : "",
+                           component_name ? component_name : "");
 
             checkpoint_entry_t *current = head;
-            while (current && pos < (int)sizeof(response) - 100) {
+            while (current) {
                 char time_str[64];
                 struct tm *tm_info = localtime(&current->metadata.timestamp);
                 strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", tm_info);
 
-                pos += snprintf(response + pos, sizeof(response) - pos,
+                control_printf(out,
                                "  %s: %s (%s, %zu bytes)\n",
                                current->id,
                                current->metadata.component_name,
@@ -852,7 +1547,6 @@ void handle_control_command(int client_fd) {
                                current->metadata.image_size);
                 current = current->next;
             }
-            rlen = pos;
         }
 
         checkpoint_free_list(head);
@@ -866,34 +1560,70 @@ void handle_control_command(int client_fd) {
         int args_parsed = sscanf(cmd, "checkpoint-rm %127s %63s", component_name, checkpoint_id);
 
         if (args_parsed < 2) {
-            rlen = snprintf(response, sizeof(response),
-                            "Error: checkpoint-rm command requires component name and checkpoint ID\n"
-                            "Usage: checkpoint-rm <component_name> <checkpoint_id>\n");
+            control_printf(out,
+                           "Error: checkpoint-rm command requires component name and checkpoint ID\n"
+                           "Usage: checkpoint-rm <component_name> <checkpoint_id>\n");
         } else {
             int result = checkpoint_remove(component_name, checkpoint_id, 1); /* persistent storage */
 
             if (result == 0) {
-                rlen = snprintf(response, sizeof(response),
-                                "Checkpoint %s removed successfully for component '%s'\n",
-                                checkpoint_id, component_name);
+                control_printf(out,
+                               "Checkpoint %s removed successfully for component '%s'\n",
+                               checkpoint_id, component_name);
             } else {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: failed to remove checkpoint %s for component '%s'\n",
-                                checkpoint_id, component_name);
+                control_printf(out,
+                               "Error: failed to remove checkpoint %s for component '%s'\n",
+                               checkpoint_id, component_name);
             }
         }
 
     } else if (strncmp(cmd, "migrate", 7) == 0) {
         /* Checkpoint and prepare for migration */
-        const char *component_name = NULL;
-        if (strlen(cmd) > 8) {
-            component_name = cmd + 8; /* Skip "migrate " */
+        char component_name[128] = {0};
+        int lazy = 0;
+        int port = CHECKPOINT_PAGE_SERVER_PORT;
+
+        /* Parse "migrate <component> [<node> | --lazy [port]]" */
+        char arg[128] = {0};
+        int args_parsed = sscanf(cmd, "migrate %127s %127s %d", component_name, arg, &port);
+        if (args_parsed >= 2) {
+            lazy = strcmp(arg, "--lazy") == 0 ? 1 : -1;
         }
 
-        if (!component_name || strlen(component_name) == 0) {
-            rlen = snprintf(response, sizeof(response),
-                            "Error: migrate command requires component name\n"
-                            "Usage: migrate <component_name>\n");
+        if (args_parsed == 2 && arg[0] != '-') {
+            /* Live: stream it to the peer, which takes over */
+            migration_result_t res;
+            int result = migration_send(component_name, arg, &res);
+            if (result == 0) {
+                control_printf(out,
+                               "Component '%s' migrated to %s (pid %d there)\n"
+                               "%d pre-dump(s) moved %zu KB while it ran; stopped for %ld ms\n",
+                               component_name, arg, res.remote_pid,
+                               res.passes, res.pre_bytes / 1024, res.downtime_ms);
+            } else if (result == -1) {
+                control_printf(out,
+                               "Error: component '%s' not found or not an active service\n",
+                               component_name);
+            } else if (result == -2) {
+                control_printf(out,
+                               "Error: CRIU not supported on this system\n");
+            } else if (result == -3) {
+                control_printf(out,
+                               "Error: %s is not a live peer or did not take '%s'\n",
+                               arg, component_name);
+            } else if (result == -4) {
+                control_printf(out,
+                               "Error: migration of '%s' failed; it keeps running here\n",
+                               component_name);
+            } else {
+                control_printf(out,
+                               "Error: '%s' did not resume on %s; restarting it here\n",
+                               component_name, arg);
+            }
+        } else if (args_parsed < 1 || lazy < 0 || port <= 0 || port > 65535) {
+            control_printf(out,
+                           "Error: migrate command requires component name\n"
+                           "Usage: migrate <component_name> [<node> | --lazy [port]]\n");
         } else {
             /* First create a checkpoint */
             int result = component_checkpoint(component_name);
@@ -905,31 +1635,47 @@ void handle_control_command(int client_fd) {
                 if (checkpoint_find_latest(component_name, 1, /* persistent storage */
                                           latest_id, sizeof(latest_id),
                                           checkpoint_path, sizeof(checkpoint_path)) == 0) {
-                    rlen = snprintf(response, sizeof(response),
-                                    "Component '%s' checkpointed successfully for migration\n"
-                                    "Checkpoint ID: %s\n"
-                                    "Path: %s\n"
-                                    "Use 'checkpoint-archive %s %s <archive_path>' to create portable archive\n",
-                                    component_name, latest_id, checkpoint_path,
-                                    component_name, latest_id);
+                    control_printf(out,
+                                   "Component '%s' checkpointed successfully for migration\n"
+                                   "Checkpoint ID: %s\n"
+                                   "Path: %s\n",
+                                   component_name, latest_id, checkpoint_path);
+
+                    char serve_dir[MAX_CHECKPOINT_PATH];
+                    if (!lazy) {
+                        control_printf(out,
+                                       "Use 'checkpoint-archive %s %s <archive_path>' to create portable archive\n",
+                                       component_name, latest_id);
+                    } else if (component_serve_pages(component_name, latest_id, port,
+                                                     serve_dir, sizeof(serve_dir)) == 0) {
+                        control_printf(out,
+                                       "Serving its pages on port %d from %s\n"
+                                       "Copy that directory without pages-*.img to %s/%s/%s on the target, then run\n"
+                                       "  graphctl restore %s %s --page-server <this host>:%d\n",
+                                       port, serve_dir, CHECKPOINT_VAR_DIR, component_name, latest_id,
+                                       component_name, latest_id, port);
+                    } else {
+                        control_printf(out,
+                                       "Error: unable to serve the pages of checkpoint %s\n", latest_id);
+                    }
                 } else {
-                    rlen = snprintf(response, sizeof(response),
-                                    "Component '%s' checkpointed, but unable to determine checkpoint ID\n",
-                                    component_name);
+                    control_printf(out,
+                                   "Component '%s' checkpointed, but unable to determine checkpoint ID\n",
+                                   component_name);
                 }
             } else if (result == -1) {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: component '%s' not found\n", component_name);
+                control_printf(out,
+                               "Error: component '%s' not found\n", component_name);
             } else if (result == -2) {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: CRIU not supported on this system\n");
+                control_printf(out,
+                               "Error: CRIU not supported on this system\n");
             } else if (result == -3) {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: component '%s' is not currently active\n", component_name);
+                control_printf(out,
+                               "Error: component '%s' is not currently active\n", component_name);
             } else {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: migration checkpoint failed for component '%s' (error code %d)\n",
-                                component_name, result);
+                control_printf(out,
+                               "Error: migration checkpoint failed for component '%s' (error code %d)\n",
+                               component_name, result);
             }
         }
 
@@ -939,66 +1685,76 @@ void handle_control_command(int client_fd) {
         int result = graph_detect_cycles(&cycle_info);
 
         if (result < 0) {
-            rlen = snprintf(response, sizeof(response),
-                            "Error: failed to perform cycle detection\n");
+            control_printf(out,
+                           "Error: failed to perform cycle detection\n");
         } else if (result == 1) {
-            rlen = snprintf(response, sizeof(response),
-                            "CYCLE DETECTED: %s\n\n", cycle_info.error_message);
+            control_printf(out,
+                           "CYCLE DETECTED: %s\n\n", cycle_info.error_message);
 
             if (cycle_info.cycle_length > 0) {
-                rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                "Components involved in the cycle:\n");
+                control_printf(out,
+                               "Components involved in the cycle:\n");
                 for (int i = 0; i < cycle_info.cycle_length - 1; i++) {
                     int comp_idx = cycle_info.cycle_components[i];
                     if (comp_idx < n_components) {
-                        rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                        "  %d. %s\n", i + 1, components[comp_idx].name);
+                        control_printf(out,
+                                       "  %d. %s\n", i + 1, components[comp_idx].name);
                     }
                 }
             }
             free(cycle_info.cycle_components);
         } else {
-            rlen = snprintf(response, sizeof(response),
-                            "✓ No dependency cycles detected\n"
-                            "The component graph is valid.\n");
+            control_printf(out,
+                           "✓ No dependency cycles detected\n"
+                           "The component graph is valid.\n");
         }
 
+    } else if (strcmp(cmd, "analyze-boot") == 0) {
+        /* Where boot time went, from the lifecycle trace */
+        trace_report_boot(out);
+
+    } else if (strcmp(cmd, "analyze-boot --chrome") == 0) {
+        trace_report_chrome(out);
+
+    } else if (strcmp(cmd, "metrics") == 0) {
+        metrics_render(out);
+
     } else if (strcmp(cmd, "analyze") == 0) {
         /* Show comprehensive graph analysis and metrics */
         graph_metrics_t metrics;
         int result = graph_analyze_metrics(&metrics);
 
         if (result < 0) {
-            rlen = snprintf(response, sizeof(response),
-                            "Error: failed to analyze graph metrics\n");
+            control_printf(out,
+                           "Error: failed to analyze graph metrics\n");
         } else {
-            rlen = snprintf(response, sizeof(response),
-                            "GRAPH ANALYSIS\n"
-                            "══════════════\n\n"
-                            "Components:               %d\n"
-                            "Capabilities:             %d\n"
-                            "Total Dependencies:       %d\n"
-                            "Avg Dependencies/Comp:    %.2f\n"
-                            "Max Dependency Depth:     %d\n"
-                            "Strongly Connected Comp:  %d\n\n",
-                            metrics.total_components,
-                            metrics.total_capabilities,
-                            metrics.total_edges,
-                            metrics.average_dependencies_per_component,
-                            metrics.max_dependency_depth,
-                            metrics.strongly_connected_components);
+            control_printf(out,
+                           "GRAPH ANALYSIS\n"
+                           "══════════════\n\n"
+                           "Components:               %d\n"
+                           "Capabilities:             %d\n"
+                           "Total Dependencies:       %d\n"
+                           "Avg Dependencies/Comp:    %.2f\n"
+                           "Max Dependency Depth:     %d\n"
+                           "Strongly Connected Comp:  %d\n\n",
+                           metrics.total_components,
+                           metrics.total_capabilities,
+                           metrics.total_edges,
+                           metrics.average_dependencies_per_component,
+                           metrics.max_dependency_depth,
+                           metrics.strongly_connected_components);
 
             /* Add cycle check */
             cycle_info_t cycle_info;
             int cycle_result = graph_detect_cycles(&cycle_info);
             if (cycle_result == 1) {
-                rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                "⚠️  WARNING: Dependency cycles detected!\n"
-                                "   %s\n", cycle_info.error_message);
+                control_printf(out,
+                               "⚠️  WARNING: Dependency cycles detected!\n"
+                               "   %s\n", cycle_info.error_message);
                 free(cycle_info.cycle_components);
             } else if (cycle_result == 0) {
-                rlen += snprintf(response + rlen, sizeof(response) - rlen,
-                                "✓ Graph Status: No cycles detected\n");
+                control_printf(out,
+                               "✓ Graph Status: No cycles detected\n");
             }
         }
 
@@ -1007,14 +1763,14 @@ void handle_control_command(int client_fd) {
         int result = validate_component_graph(1); /* warn_only = 1 for status check */
 
         if (result == 0) {
-            rlen = snprintf(response, sizeof(response),
-                            "✓ Graph validation passed\n"
-                            "  No dependency cycles detected\n"
-                            "  All components have valid configurations\n");
+            control_printf(out,
+                           "✓ Graph validation passed\n"
+                           "  No dependency cycles detected\n"
+                           "  All components have valid configurations\n");
         } else {
-            rlen = snprintf(response, sizeof(response),
-                            "⚠️  Graph validation found issues\n"
-                            "  Check logs for detailed cycle information\n");
+            control_printf(out,
+                           "⚠️  Graph validation found issues\n"
+                           "  Check logs for detailed cycle information\n");
         }
 
     } else if (strncmp(cmd, "path", 4) == 0) {
@@ -1025,19 +1781,19 @@ void handle_control_command(int client_fd) {
         /* Parse capability names */
         char cap1[128], cap2[128];
         if (sscanf(args, "%127s %127s", cap1, cap2) != 2) {
-            rlen = snprintf(response, sizeof(response),
-                            "Error: path command requires two capability names\n"
-                            "Usage: path <capability1> <capability2>\n");
+            control_printf(out,
+                           "Error: path command requires two capability names\n"
+                           "Usage: path <capability1> <capability2>\n");
         } else {
             char path_desc[512];
             int result = graph_find_dependency_path(cap1, cap2, path_desc, sizeof(path_desc));
 
             if (result == 0) {
-                rlen = snprintf(response, sizeof(response),
-                                "Dependency path from '%s' to '%s':\n%s\n", cap1, cap2, path_desc);
+                control_printf(out,
+                               "Dependency path from '%s' to '%s':\n%s\n", cap1, cap2, path_desc);
             } else {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: could not find dependency path from '%s' to '%s'\n", cap1, cap2);
+                control_printf(out,
+                               "Error: could not find dependency path from '%s' to '%s'\n", cap1, cap2);
             }
         }
 
@@ -1048,15 +1804,21 @@ void handle_control_command(int client_fd) {
         int result = graph_find_strongly_connected_components(&scc_components, &scc_count);
 
         if (result < 0) {
-            rlen = snprintf(response, sizeof(response),
-                            "Error: failed to find strongly connected components\n");
+            control_printf(out,
+                           "Error: failed to find strongly connected components\n");
         } else if (scc_count == 0) {
-            rlen = snprintf(response, sizeof(response),
-                            "No strongly connected components found\n"
-                            "(This feature is not yet fully implemented)\n");
+            control_printf(out,
+                           "No dependency cycles found\n");
         } else {
-            rlen = snprintf(response, sizeof(response),
-                            "Found %d strongly connected components\n", scc_count);
+            control_printf(out,
+                           "Found %d dependency cycle(s):\n", scc_count);
+            for (int c = 0; c < scc_count; c++) {
+                control_printf(out, "  %d:", c + 1);
+                for (int i = 0; i < n_components; i++) {
+                    if (scc_components[i] == c) control_printf(out, " %s", components[i].name);
+                }
+                control_printf(out, "\n");
+            }
         }
 
         if (scc_components) {
@@ -1073,9 +1835,9 @@ void handle_control_command(int client_fd) {
             }
 
             if (!kernel_path || strlen(kernel_path) == 0) {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: kernel path required\n"
-                                "Usage: kexec --dry-run <kernel_path> [--initrd <initrd_path>] [--append <cmdline>]\n");
+                control_printf(out,
+                               "Error: kernel path required\n"
+                               "Usage: kexec --dry-run <kernel_path> [--initrd <initrd_path>] [--append <cmdline>]\n");
             } else {
                 /* Parse additional arguments (simplified parsing) */
                 char kernel_only[MAX_KERNEL_PATH];
@@ -1086,18 +1848,18 @@ void handle_control_command(int client_fd) {
                 int result = kexec_perform(kernel_only, NULL, NULL, KEXEC_FLAG_DRY_RUN);
 
                 if (result == KEXEC_SUCCESS) {
-                    rlen = snprintf(response, sizeof(response),
-                                    "✓ Dry run successful - kexec would proceed with kernel: %s\n"
-                                    "  - Kernel validation: PASSED\n"
-                                    "  - System readiness: READY\n"
-                                    "  - CRIU support: AVAILABLE\n"
-                                    "  - Checkpoint storage: ACCESSIBLE\n\n"
-                                    "Use 'kexec %s' to perform the actual kernel upgrade.\n", kernel_only, kernel_only);
+                    control_printf(out,
+                                   "✓ Dry run successful - kexec would proceed with kernel: %s\n"
+                                   "  - Kernel validation: PASSED\n"
+                                   "  - System readiness: READY\n"
+                                   "  - CRIU support: AVAILABLE\n"
+                                   "  - Checkpoint storage: ACCESSIBLE\n\n"
+                                   "Use 'kexec %s' to perform the actual kernel upgrade.\n", kernel_only, kernel_only);
                 } else {
-                    rlen = snprintf(response, sizeof(response),
-                                    "✗ Dry run failed: %s\n"
-                                    "Kernel upgrade cannot proceed with current configuration.\n",
-                                    kexec_error_string(result));
+                    control_printf(out,
+                                   "✗ Dry run failed: %s\n"
+                                   "Kernel upgrade cannot proceed with current configuration.\n",
+                                   kexec_error_string(result));
                 }
             }
         } else {
@@ -1108,16 +1870,16 @@ void handle_control_command(int client_fd) {
             }
 
             if (!kernel_path || strlen(kernel_path) == 0) {
-                rlen = snprintf(response, sizeof(response),
-                                "Error: kernel path required\n"
-                                "Usage: kexec <kernel_path> [--initrd <initrd_path>] [--append <cmdline>]\n"
-                                "       kexec --dry-run <kernel_path> [options]\n\n"
-                                "Examples:\n"
-                                "  kexec /boot/vmlinuz-6.1.0-new\n"
-                                "  kexec /boot/vmlinuz-6.1.0-new --initrd /boot/initrd.img-6.1.0-new\n"
-                                "  kexec --dry-run /boot/vmlinuz-6.1.0-new  # Test without executing\n\n"
-                                "WARNING: This will replace the running kernel. All processes will be\n"
-                                "checkpointed and restored, but this is a dangerous operation!\n");
+                control_printf(out,
+                               "Error: kernel path required\n"
+                               "Usage: kexec <kernel_path> [--initrd <initrd_path>] [--append <cmdline>]\n"
+                               "       kexec --dry-run <kernel_path> [options]\n\n"
+                               "Examples:\n"
+                               "  kexec /boot/vmlinuz-6.1.0-new\n"
+                               "  kexec /boot/vmlinuz-6.1.0-new --initrd /boot/initrd.img-6.1.0-new\n"
+                               "  kexec --dry-run /boot/vmlinuz-6.1.0-new  # Test without executing\n\n"
+                               "WARNING: This will replace the running kernel. All processes will be\n"
+                               "checkpointed and restored, but this is a dangerous operation!\n");
             } else {
                 /* Parse arguments (simplified parsing) */
                 char kernel_only[MAX_KERNEL_PATH];
@@ -1150,33 +1912,38 @@ void handle_control_command(int client_fd) {
                 LOG_INFO("initiating live kernel upgrade: kernel=%s, initrd=%s, cmdline=%s",
                          kernel_only, initrd_path ? initrd_path : "none", cmdline ? cmdline : "default");
 
-                rlen = snprintf(response, sizeof(response),
-                                "=== LIVE KERNEL UPGRADE INITIATED ===\n"
-                                "Target kernel: %s\n"
-                                "Initrd: %s\n"
-                                "Command line: %s\n\n"
-                                "Phase 1: Validation...\n", kernel_only,
-                                initrd_path ? initrd_path : "none",
-                                cmdline ? cmdline : "default");
+                control_printf(out,
+                               "=== LIVE KERNEL UPGRADE INITIATED ===\n"
+                               "Target kernel: %s\n"
+                               "Initrd: %s\n"
+                               "Command line: %s\n\n"
+                               "Phase 1: Validation...\n", kernel_only,
+                               initrd_path ? initrd_path : "none",
+                               cmdline ? cmdline : "default");
 
-                (void)!write(client_fd, response, rlen); /* Send status update */
+                /* Send the status update before kexec replaces us */
+                if (exec_conn) conn_flush(exec_conn);
 
                 /* Perform the kexec - this should not return on success */
                 int result = kexec_perform(kernel_only, initrd_path, cmdline, KEXEC_FLAG_NONE);
 
                 /* If we get here, kexec failed */
-                rlen = snprintf(response, sizeof(response),
-                                "\n✗ KEXEC FAILED: %s\n"
-                                "The kernel upgrade did not complete successfully.\n"
-                                "System remains on current kernel.\n", kexec_error_string(result));
+                control_printf(out,
+                               "\n✗ KEXEC FAILED: %s\n"
+                               "The kernel upgrade did not complete successfully.\n"
+                               "System remains on current kernel.\n", kexec_error_string(result));
             }
         }
 
+    } else if (strcmp(cmd, "top") == 0) {
+        control_top(out);
+
+    } else if (strncmp(cmd, "stats", 5) == 0 && (cmd[5] == ' ' || cmd[5] == '\0')) {
+        control_stats(out, trim(cmd + 5));
+
     } else {
-        rlen = snprintf(response, sizeof(response),
-                        "Unknown command: %s\n"
-                        "Available commands: status, caps, tree <component>, rdeps <capability>, simulate remove <component>, dot, log <component> [lines], readiness, check-readiness [component], upgrade <component>, check-cycles, analyze, validate, path <cap1> <cap2>, scc, checkpoint <component>, restore <component> [checkpoint_id], checkpoint-list [component], checkpoint-rm <component> <checkpoint_id>, migrate <component>, kexec <kernel> [--initrd <initrd>] [--append <cmdline>], kexec --dry-run <kernel> [options]\n", cmd);
+        control_printf(out,
+                       "Unknown command: %s\n"
+                       "Available commands: status, caps, top, stats <component>, tree <component>, rdeps <capability>, simulate remove <component>, dot, log <component> [lines], readiness, check-readiness [component], upgrade <component>, reset-failed <component>, check-cycles, analyze, analyze-boot [--chrome], metrics, validate, path <cap1> <cap2>, scc, checkpoint <component>, restore <component> [checkpoint_id] [--lazy] [--page-server host[:port]], checkpoint-list [component], checkpoint-rm <component> <checkpoint_id>, migrate <component> [--lazy [port]], kexec <kernel> [--initrd <initrd>] [--append <cmdline>], kexec --dry-run <kernel> [options]\n", cmd);
     }
-
-    (void)!write(client_fd, response, rlen);
 }
\ No newline at end of file
@@ -5,12 +5,55 @@
 #ifndef CONTROL_H
 #define CONTROL_H
 
+#include "event.h"
+#include <stddef.h>
+#include <stdint.h>
+
 #define CONTROL_SOCKET "/run/graph-resolver.sock"
 
-/* Set up the control socket for graphctl commands */
+#define CONTROL_MAX_CLIENTS 64      /* concurrent graphctl/monitoring connections */
+#define CONTROL_LINE_MAX    4096    /* longest command line a client may send */
+#define CONTROL_WBUF_HIGH   (1 << 20) /* stop reading while this much output is queued */
+
+/* Growable output buffer that command handlers append to */
+typedef struct {
+    char  *data;
+    size_t len;
+    size_t cap;
+} control_buf_t;
+
+int control_printf(control_buf_t *buf, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+int control_append(control_buf_t *buf, const char *data, size_t len);
+void control_buf_free(control_buf_t *buf);
+
+/* Set up the (non-blocking) control socket for graphctl commands */
 int setup_control_socket(void);
 
-/* Handle a control command from client */
-void handle_control_command(int client_fd);
+/* Remember the epoll set that client connections are registered in */
+void control_init(int epoll_fd);
+
+/* Accept every pending connection on the listener */
+void control_accept(int listen_fd);
+
+/* Adopt an already-connected stream fd as a control client.
+ * Returns 0, or -1 (and closes fd) if the client table is full. */
+int control_add_client(int fd);
+
+/* Drive one client connection for the epoll events it received */
+void control_client_event(event_source_t *src, uint32_t events);
+
+/* Number of open client connections */
+int control_client_count(void);
+
+/* Push state changes since the last call to every subscribed client.
+ * Called once per main loop round, after the graph has settled. */
+void control_publish(void);
+
+/* Close every client connection (shutdown, re-exec) */
+void control_close_all(void);
+
+/* Run one command line and append its reply to out */
+void control_execute(const char *line, control_buf_t *out);
 
-#endif /* CONTROL_H */
\ No newline at end of file
+#endif /* CONTROL_H */
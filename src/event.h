@@ -0,0 +1,40 @@
+/*
+ * event.h - YakirOS main loop event sources
+ *
+ * Every fd registered in the main epoll set carries a pointer to an
+ * event_source_t in epoll_event.data.ptr, so the loop dispatches on the
+ * source type instead of comparing fds. Sources that belong to a larger
+ * object (e.g. a supervised process) embed event_source_t as their first
+ * member.
+ */
+
+#ifndef EVENT_H
+#define EVENT_H
+
+typedef enum {
+    EVENT_SIGCHLD,    /* SIGCHLD self-pipe (orphans, non-pidfd kernels) */
+    EVENT_CONTROL,    /* control socket listener */
+    EVENT_INOTIFY,    /* /etc/graph.d watch */
+    EVENT_PROCESS,    /* pidfd of a supervised process */
+    EVENT_TIMER,      /* timerfd armed for the earliest deadline */
+    EVENT_FILEWATCH,  /* inotify on readiness file directories */
+    EVENT_NOTIFY,     /* sd_notify datagram socket */
+    EVENT_CONTROL_CLIENT, /* one accepted control connection */
+    EVENT_OUTPUT,     /* stdout/stderr pipe of a component */
+    EVENT_OOM,        /* inotify on cgroup memory.events files */
+    EVENT_PRESSURE,   /* PSI trigger of an adaptive component's cgroup */
+    EVENT_ACTIVATION, /* connection waiting on an idle component's socket */
+    EVENT_METRICS,    /* OpenMetrics endpoint listener */
+    EVENT_METRICS_CLIENT, /* one scrape connection */
+    EVENT_FEDERATION, /* capability datagrams from peer nodes */
+    EVENT_MIGRATION,  /* listener for components migrating in, or their pages */
+    EVENT_MIGRATION_CLIENT, /* a peer handing a component over */
+    EVENT_HANDOFF,    /* a main process handing its descriptors to a standby */
+} event_type_t;
+
+typedef struct {
+    event_type_t type;
+    int          fd;
+} event_source_t;
+
+#endif /* EVENT_H */
@@ -0,0 +1,704 @@
+/*
+ * federation.c - YakirOS capability federation
+ *
+ * Local capabilities are versioned by a counter bumped on every change:
+ * local_version[cap] is the version of cap's latest change. A peer is
+ * sent the capabilities changed since what it acknowledged, oldest
+ * first, split over as many datagrams as needed. Each datagram says
+ * which range of versions it covers, so the receiver only moves its
+ * acknowledgement on when nothing in between was lost; every entry
+ * carries its own version, so an entry arriving late or twice never
+ * overwrites a newer one.
+ *
+ * The socket is dual-stack IPv6, with IPv4 peers as mapped addresses.
+ * Datagrams are only accepted from configured peer addresses, and only
+ * when their last line is the HMAC-SHA256, under the shared secret, of
+ * everything before it. A peer's incarnation never goes back, so an
+ * old datagram replayed cannot make it look restarted.
+ */
+
+#define _GNU_SOURCE
+#include "federation.h"
+#include "event.h"
+#include "log.h"
+#include "sha256.h"
+#include "timer.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#define FED_MAGIC "YKF2"
+
+/* Bytes kept free for the header of each datagram */
+#define FED_HEADER_MAX (MAX_NAME + 80)
+
+/* The MAC line ending each datagram */
+#define FED_MAC_LEN (FEDERATION_MAC_HEX + 1)
+
+typedef enum {
+    FED_DOWN,
+    FED_UP,
+    FED_DEGRADED,
+} fed_state_t;
+
+static const char state_char[] = "-+~";   /* by fed_state_t */
+
+/* A capability as a peer last described it */
+typedef struct {
+    char     name[MAX_NAME];   /* its name on the peer */
+    uint8_t  state;
+    uint32_t version;          /* the peer's version of that state */
+} remote_cap_t;
+
+typedef struct {
+    struct sockaddr_in6 addr;
+    char          node[MAX_NAME];  /* learnt from its datagrams */
+    uint32_t      incarnation;     /* 0 until heard from, again once expired */
+    uint32_t      newest;          /* latest incarnation ever heard of */
+    uint32_t      seen;            /* its versions received without gaps */
+    uint32_t      acked;           /* our versions it has received */
+    uint64_t      last_heard_ms;
+    int           alive;
+    int           bad_mac;         /* failure logged, until one passes */
+    remote_cap_t *caps;
+    int           n_caps;
+    int           max_caps;
+} peer_t;
+
+static event_source_t fed_src = { .type = EVENT_FEDERATION, .fd = -1 };
+static int fed_epoll_fd = -1;
+static char node_name[MAX_NAME];
+static char secret[FEDERATION_SECRET_MAX];
+static size_t secret_len;
+static uint32_t incarnation;
+
+static peer_t peers[FEDERATION_MAX_PEERS];
+static int n_peers;
+
+/* Local capabilities, by capability ID */
+static uint8_t  local_state[MAX_CAPABILITIES];
+static uint32_t local_version[MAX_CAPABILITIES];
+static uint8_t  is_remote[MAX_CAPABILITIES];   /* a "cap@node" name */
+static uint32_t version;                       /* latest local change */
+static uint32_t flushed;                       /* version last pushed */
+static unsigned int seen_epoch;
+static unsigned int seen_generation;
+static int seen_count;
+
+/* ---- config ---- */
+
+/* Parse "addr[:port]" ([addr]:port for IPv6) into a mapped address */
+static int parse_peer(const char *spec, struct sockaddr_in6 *addr) {
+    char host[INET6_ADDRSTRLEN];
+    const char *port = NULL;
+
+    if (*spec == '[') {
+        const char *end = strchr(spec, ']');
+        if (!end || (size_t)(end - spec - 1) >= sizeof(host)) return -1;
+        memcpy(host, spec + 1, (size_t)(end - spec - 1));
+        host[end - spec - 1] = '\0';
+        if (end[1] == ':') port = end + 2;
+        else if (end[1]) return -1;
+    } else {
+        const char *colon = strchr(spec, ':');
+        size_t n = colon ? (size_t)(colon - spec) : strlen(spec);
+        if (n >= sizeof(host)) return -1;
+        memcpy(host, spec, n);
+        host[n] = '\0';
+        if (colon) port = colon + 1;
+    }
+
+    long p = FEDERATION_PORT;
+    if (port) {
+        char *end;
+        p = strtol(port, &end, 10);
+        if (!*port || *end || p <= 0 || p > 65535) return -1;
+    }
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin6_family = AF_INET6;
+    addr->sin6_port = htons((unsigned short)p);
+    struct in_addr v4;
+    if (inet_pton(AF_INET, host, &v4) == 1) {
+        addr->sin6_addr.s6_addr[10] = 0xff;
+        addr->sin6_addr.s6_addr[11] = 0xff;
+        memcpy(&addr->sin6_addr.s6_addr[12], &v4, 4);
+        return 0;
+    }
+    return inet_pton(AF_INET6, host, &addr->sin6_addr) == 1 ? 0 : -1;
+}
+
+static char *trim(char *s) {
+    while (*s == ' ' || *s == '\t') s++;
+    char *end = s + strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r')) {
+        end--;
+    }
+    *end = '\0';
+    if (end - s >= 2 && *s == '"' && end[-1] == '"') {
+        end[-1] = '\0';
+        s++;
+    }
+    return s;
+}
+
+int federation_load_config(const char *path, federation_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->port = FEDERATION_PORT;
+    if (gethostname(cfg->node, sizeof(cfg->node) - 1) < 0 || !cfg->node[0]) {
+        strcpy(cfg->node, "localhost");
+    }
+
+    FILE *f = fopen(path, "r");
+    if (!f) return errno == ENOENT ? 1 : -1;
+
+    struct stat st;
+    if (fstat(fileno(f), &st) == 0 && (st.st_mode & 077)) {
+        LOG_WARN("%s: readable by others, who can learn the federation secret", path);
+    }
+
+    char line[512];
+    int lineno = 0, bad = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char *s = trim(line);
+        if (!*s) continue;
+
+        char *eq = strchr(s, '=');
+        if (!eq) {
+            LOG_ERR("%s:%d: expected key = value", path, lineno);
+            bad = 1;
+            continue;
+        }
+        *eq = '\0';
+        char *key = trim(s), *val = trim(eq + 1);
+
+        if (strcmp(key, "node") == 0) {
+            if (!*val || strlen(val) >= MAX_NAME || strpbrk(val, " \t@")) {
+                LOG_ERR("%s:%d: invalid node name '%s'", path, lineno, val);
+                bad = 1;
+            } else {
+                strcpy(cfg->node, val);
+            }
+        } else if (strcmp(key, "port") == 0) {
+            char *end;
+            long p = strtol(val, &end, 10);
+            if (!*val || *end || p <= 0 || p > 65535) {
+                LOG_ERR("%s:%d: invalid port '%s'", path, lineno, val);
+                bad = 1;
+            } else {
+                cfg->port = (int)p;
+            }
+        } else if (strcmp(key, "secret") == 0) {
+            size_t len = strlen(val);
+            if (len < FEDERATION_SECRET_MIN || len >= FEDERATION_SECRET_MAX) {
+                LOG_ERR("%s:%d: secret must be %d to %d characters", path, lineno,
+                        FEDERATION_SECRET_MIN, FEDERATION_SECRET_MAX - 1);
+                bad = 1;
+            } else {
+                strcpy(cfg->secret, val);
+            }
+        } else if (strcmp(key, "peer") == 0) {
+            if (cfg->n_peers >= FEDERATION_MAX_PEERS) {
+                LOG_ERR("%s:%d: more than %d peers", path, lineno, FEDERATION_MAX_PEERS);
+                bad = 1;
+            } else if (parse_peer(val, &cfg->peers[cfg->n_peers]) < 0) {
+                LOG_ERR("%s:%d: invalid peer address '%s' (numeric address[:port])",
+                        path, lineno, val);
+                bad = 1;
+            } else {
+                cfg->n_peers++;
+            }
+        } else {
+            LOG_WARN("%s:%d: unknown key '%s'", path, lineno, key);
+        }
+    }
+    fclose(f);
+    if (!bad && !cfg->secret[0]) {
+        LOG_ERR("%s: no secret set, peers could not be told from impostors", path);
+        bad = 1;
+    }
+    return bad ? -1 : 0;
+}
+
+/* ---- authentication ---- */
+
+void federation_mac(const void *data, size_t len, char *hex) {
+    uint8_t mac[SHA256_DIGEST];
+    hmac_sha256(secret, secret_len, data, len, mac);
+    for (int i = 0; i < SHA256_DIGEST; i++) {
+        hex[2 * i] = "0123456789abcdef"[mac[i] >> 4];
+        hex[2 * i + 1] = "0123456789abcdef"[mac[i] & 15];
+    }
+    hex[FEDERATION_MAC_HEX] = '\0';
+}
+
+/* Whether the FEDERATION_MAC_HEX bytes at hex are the MAC of data */
+static int mac_matches(const void *data, size_t len, const char *hex) {
+    char want[FEDERATION_MAC_HEX + 1];
+    federation_mac(data, len, want);
+    unsigned char diff = 0;
+    for (int i = 0; i < FEDERATION_MAC_HEX; i++) {
+        diff |= (unsigned char)(want[i] ^ hex[i]);
+    }
+    return diff == 0;
+}
+
+int federation_mac_ok(const void *data, size_t len, const char *hex) {
+    if (fed_src.fd < 0 || !secret_len || strnlen(hex, FEDERATION_MAC_HEX + 1) != FEDERATION_MAC_HEX) {
+        return 0;
+    }
+    return mac_matches(data, len, hex);
+}
+
+/* ---- remote capabilities ---- */
+
+static peer_t *peer_by_node(const char *node) {
+    for (int i = 0; i < n_peers; i++) {
+        if (peers[i].alive && strcmp(peers[i].node, node) == 0) return &peers[i];
+    }
+    return NULL;
+}
+
+static remote_cap_t *remote_find(peer_t *p, const char *name) {
+    for (int i = 0; i < p->n_caps; i++) {
+        if (strcmp(p->caps[i].name, name) == 0) return &p->caps[i];
+    }
+    return NULL;
+}
+
+/* Set "cap@node" to state, if anything here requires it */
+static void apply_remote(const peer_t *p, const remote_cap_t *rc) {
+    char full[MAX_NAME];
+    if (snprintf(full, sizeof(full), "%s@%s", rc->name, p->node) >= (int)sizeof(full)) return;
+    int idx = capability_index(full);
+    if (idx < 0) return;
+
+    /* A local component providing it has the last word */
+    if (capability_active_by_idx(idx) && capability_provider(idx) >= 0) return;
+
+    if (rc->state == FED_DOWN) {
+        if (capability_active_by_idx(idx)) capability_withdraw_id(idx);
+        return;
+    }
+    if (!capability_active_by_idx(idx)) {
+        capability_register_id(idx, -1);
+        LOG_INFO("capability UP: %s", full);
+    }
+    if (capability_degraded_by_idx(idx) != (rc->state == FED_DEGRADED)) {
+        capability_mark_degraded(full, rc->state == FED_DEGRADED);
+    }
+}
+
+/* Take everything p provided down and start over with it */
+static void peer_forget(peer_t *p) {
+    for (int i = 0; i < p->n_caps; i++) {
+        if (p->caps[i].state != FED_DOWN) {
+            p->caps[i].state = FED_DOWN;
+            apply_remote(p, &p->caps[i]);
+        }
+    }
+    free(p->caps);
+    p->caps = NULL;
+    p->n_caps = p->max_caps = 0;
+    p->seen = 0;
+    p->acked = 0;
+}
+
+static remote_cap_t *remote_add(peer_t *p, const char *name) {
+    if (p->n_caps == MAX_CAPABILITIES) return NULL;
+    if (p->n_caps == p->max_caps) {
+        int new_max = p->max_caps ? p->max_caps * 2 : 16;
+        remote_cap_t *grown = realloc(p->caps, (size_t)new_max * sizeof(*grown));
+        if (!grown) {
+            LOG_ERR("out of memory tracking capabilities of '%s'", p->node);
+            return NULL;
+        }
+        p->caps = grown;
+        p->max_caps = new_max;
+    }
+    remote_cap_t *rc = &p->caps[p->n_caps++];
+    memset(rc, 0, sizeof(*rc));
+    strncpy(rc->name, name, MAX_NAME - 1);
+    return rc;
+}
+
+/* ---- sending ---- */
+
+static int by_version(const void *a, const void *b) {
+    uint32_t va = local_version[*(const int *)a], vb = local_version[*(const int *)b];
+    return va < vb ? -1 : va > vb;
+}
+
+static void send_datagram(const peer_t *p, uint32_t base, uint32_t upto,
+                          const char *body, size_t body_len) {
+    char buf[FEDERATION_DATAGRAM_MAX + 1];
+    int n = snprintf(buf, sizeof(buf), FED_MAGIC " %s %u %u %u %u %u\n", node_name,
+                     incarnation, base, upto, p->incarnation, p->seen);
+    if (n < 0 || (size_t)n + body_len + FED_MAC_LEN > FEDERATION_DATAGRAM_MAX) return;
+    memcpy(buf + n, body, body_len);
+    size_t len = (size_t)n + body_len;
+    federation_mac(buf, len, buf + len);
+    buf[len + FEDERATION_MAC_HEX] = '\n';
+    sendto(fed_src.fd, buf, len + FED_MAC_LEN, MSG_DONTWAIT | MSG_NOSIGNAL,
+           (const struct sockaddr *)&p->addr, sizeof(p->addr));
+}
+
+/* Send p our changes since its acknowledgement; a bare header (a
+ * heartbeat) if there are none */
+static void send_delta(const peer_t *p) {
+    int order[MAX_CAPABILITIES];
+    int n = 0;
+    for (int i = 0; i < seen_count; i++) {
+        if (!is_remote[i] && local_version[i] > p->acked) order[n++] = i;
+    }
+    qsort(order, (size_t)n, sizeof(order[0]), by_version);
+
+    char body[FEDERATION_DATAGRAM_MAX - FED_HEADER_MAX - FED_MAC_LEN];
+    uint32_t base = p->acked;
+    int k = 0;
+    do {
+        size_t len = 0;
+        uint32_t upto = base;
+        while (k < n) {
+            int cap = order[k];
+            int w = snprintf(body + len, sizeof(body) - len, "%c%u %s\n",
+                             state_char[local_state[cap]], local_version[cap],
+                             capability_name(cap));
+            if (w < 0 || (size_t)w >= sizeof(body) - len) break;
+            len += (size_t)w;
+            upto = local_version[cap];
+            k++;
+        }
+        if (k == n) upto = version;
+        send_datagram(p, base, upto, body, len);
+        base = upto;
+    } while (k < n);
+}
+
+/* ---- receiving ---- */
+
+static void format_addr(const struct sockaddr_in6 *addr, char *out, size_t size) {
+    char host[INET6_ADDRSTRLEN] = "?";
+    if (IN6_IS_ADDR_V4MAPPED(&addr->sin6_addr)) {
+        inet_ntop(AF_INET, addr->sin6_addr.s6_addr + 12, host, sizeof(host));
+        snprintf(out, size, "%s:%d", host, ntohs(addr->sin6_port));
+    } else {
+        inet_ntop(AF_INET6, addr->sin6_addr.s6_addr, host, sizeof(host));
+        snprintf(out, size, "[%s]:%d", host, ntohs(addr->sin6_port));
+    }
+}
+
+static peer_t *peer_by_addr(const struct sockaddr_in6 *from) {
+    for (int i = 0; i < n_peers; i++) {
+        if (peers[i].addr.sin6_port == from->sin6_port &&
+            memcmp(&peers[i].addr.sin6_addr, &from->sin6_addr, sizeof(from->sin6_addr)) == 0) {
+            return &peers[i];
+        }
+    }
+    return NULL;
+}
+
+static void handle_datagram(peer_t *p, char *buf) {
+    char *nl = strchr(buf, '\n');
+    if (!nl) return;
+    *nl = '\0';
+
+    char node[MAX_NAME];
+    unsigned int inc, base, upto, ack_inc, ack_ver;
+    if (sscanf(buf, FED_MAGIC " %127s %u %u %u %u %u", node, &inc, &base, &upto,
+               &ack_inc, &ack_ver) != 6 || inc == 0 || strchr(node, '@')) {
+        return;
+    }
+
+    /* A replay from before it last restarted */
+    if (p->newest && (int32_t)(inc - p->newest) < 0) return;
+    p->newest = inc;
+
+    int reply = 0;
+    if (p->incarnation && (inc != p->incarnation || strcmp(node, p->node) != 0)) {
+        LOG_INFO("federation peer '%s' restarted, relearning its capabilities", node);
+        peer_forget(p);
+    }
+    if (inc != p->incarnation) reply = 1;
+    p->incarnation = inc;
+    strcpy(p->node, node);
+    p->last_heard_ms = timer_now_ms();
+    if (!p->alive) {
+        p->alive = 1;
+        LOG_INFO("federation peer '%s' up", p->node);
+        /* "cap@node" capabilities may have been waiting for it */
+        reply = 1;
+    }
+
+    /* An acknowledgement of an older incarnation of ours means nothing */
+    p->acked = ack_inc == incarnation && ack_ver <= version ? ack_ver : 0;
+
+    for (char *line = nl + 1; *line; ) {
+        char *end = strchr(line, '\n');
+        if (!end) break;
+        *end = '\0';
+
+        const char *state = line[0] ? strchr(state_char, line[0]) : NULL;
+        char *name = line;
+        unsigned long v = state ? strtoul(line + 1, &name, 10) : 0;
+        if (state && *name == ' ' && name[1] && strlen(name + 1) < MAX_NAME) {
+            name++;
+            remote_cap_t *rc = remote_find(p, name);
+            if (!rc) rc = remote_add(p, name);
+            if (rc && v > rc->version) {
+                rc->version = (uint32_t)v;
+                if (rc->state != (uint8_t)(state - state_char)) {
+                    rc->state = (uint8_t)(state - state_char);
+                    apply_remote(p, rc);
+                }
+            }
+        }
+        line = end + 1;
+    }
+
+    /* Only a contiguous run of versions moves the acknowledgement on */
+    if (base <= p->seen && upto > p->seen) p->seen = upto;
+
+    if (reply && p->acked < version) send_delta(p);
+}
+
+void federation_receive(void) {
+    char buf[FEDERATION_DATAGRAM_MAX + 1];
+    for (;;) {
+        struct sockaddr_in6 from;
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(fed_src.fd, buf, FEDERATION_DATAGRAM_MAX, MSG_DONTWAIT,
+                             (struct sockaddr *)&from, &from_len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return;
+
+        peer_t *p = from_len == sizeof(from) ? peer_by_addr(&from) : NULL;
+        if (!p) continue;   /* not a configured peer */
+
+        size_t len = (size_t)n - FED_MAC_LEN;
+        if (n < FED_MAC_LEN + 1 || buf[n - 1] != '\n' || buf[len - 1] != '\n' ||
+            !mac_matches(buf, len, buf + len)) {
+            if (!p->bad_mac) {
+                char addr[INET6_ADDRSTRLEN + 8];
+                format_addr(&p->addr, addr, sizeof(addr));
+                LOG_WARN("federation datagram from %s failed authentication (wrong secret?)",
+                         addr);
+                p->bad_mac = 1;
+            }
+            continue;
+        }
+        p->bad_mac = 0;
+        buf[len] = '\0';
+        handle_datagram(p, buf);
+    }
+}
+
+/* ---- main loop hooks ---- */
+
+/* Apply what p told us about idx, a "cap@node" name interned just now */
+static void apply_known(int idx) {
+    char name[MAX_NAME];
+    strncpy(name, capability_name(idx), MAX_NAME - 1);
+    name[MAX_NAME - 1] = '\0';
+    char *at = strrchr(name, '@');
+    *at = '\0';
+
+    peer_t *p = peer_by_node(at + 1);
+    remote_cap_t *rc = p ? remote_find(p, name) : NULL;
+    if (rc && rc->state != FED_DOWN) apply_remote(p, rc);
+}
+
+void federation_flush(void) {
+    if (fed_src.fd < 0) return;
+
+    if (capability_generation() != seen_generation) {
+        /* Registry reset: every capability ID is new */
+        seen_generation = capability_generation();
+        memset(local_state, 0, sizeof(local_state));
+        memset(local_version, 0, sizeof(local_version));
+        seen_count = 0;
+        seen_epoch = capability_epoch() - 1;
+    }
+
+    int count = capability_count();
+    for (int i = seen_count; i < count; i++) {
+        is_remote[i] = strchr(capability_name(i), '@') != NULL;
+        if (is_remote[i]) apply_known(i);
+    }
+    if (count != seen_count) {
+        seen_count = count;
+        seen_epoch = capability_epoch() - 1;
+    }
+
+    if (capability_epoch() != seen_epoch) {
+        seen_epoch = capability_epoch();
+        for (int i = 0; i < count; i++) {
+            if (is_remote[i]) continue;
+            uint8_t st = !capability_active_by_idx(i) ? FED_DOWN :
+                         capability_degraded_by_idx(i) ? FED_DEGRADED : FED_UP;
+            if (st != local_state[i]) {
+                local_state[i] = st;
+                local_version[i] = ++version;
+            }
+        }
+    }
+
+    if (version != flushed) {
+        flushed = version;
+        for (int i = 0; i < n_peers; i++) {
+            if (peers[i].acked < version) send_delta(&peers[i]);
+        }
+    }
+}
+
+void federation_tick(uint64_t now) {
+    if (fed_src.fd < 0) return;
+
+    for (int i = 0; i < n_peers; i++) {
+        peer_t *p = &peers[i];
+        if (p->alive && now - p->last_heard_ms >= FEDERATION_DEAD_MS) {
+            LOG_WARN("federation peer '%s' silent for %dms, its capabilities are down",
+                     p->node, FEDERATION_DEAD_MS);
+            p->alive = 0;
+            p->incarnation = 0;
+            peer_forget(p);
+        }
+        send_delta(p);
+    }
+    timer_add(now + FEDERATION_INTERVAL_MS, TIMER_FEDERATION, -1);
+}
+
+int federation_init(int epoll_fd, const federation_config_t *cfg) {
+    federation_close();
+
+    if (strlen(cfg->secret) < FEDERATION_SECRET_MIN) {
+        LOG_ERR("federation needs a secret of at least %d characters", FEDERATION_SECRET_MIN);
+        return -1;
+    }
+
+    int fd = socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERR("federation socket failed: %s", strerror(errno));
+        return -1;
+    }
+    int off = 0;
+    setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+
+    struct sockaddr_in6 addr = { .sin6_family = AF_INET6, .sin6_port = htons((uint16_t)cfg->port),
+                                 .sin6_addr = IN6ADDR_ANY_INIT };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        LOG_ERR("federation port %d failed: %s", cfg->port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    fed_src.fd = fd;
+    if (epoll_fd >= 0) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &fed_src };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    fed_epoll_fd = epoll_fd;
+
+    strncpy(node_name, cfg->node, MAX_NAME - 1);
+    node_name[MAX_NAME - 1] = '\0';
+    secret_len = strnlen(cfg->secret, sizeof(secret) - 1);
+    memcpy(secret, cfg->secret, secret_len);
+    n_peers = cfg->n_peers;
+    for (int i = 0; i < n_peers; i++) {
+        memset(&peers[i], 0, sizeof(peers[i]));
+        peers[i].addr = cfg->peers[i];
+    }
+
+    /* Tells peers we restarted, so they drop what they heard before */
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    incarnation = (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+    if (incarnation == 0) incarnation = 1;
+
+    seen_generation = 0;
+    seen_count = 0;
+    version = flushed = 0;
+    federation_flush();
+
+    timer_add(timer_now_ms() + FEDERATION_INTERVAL_MS, TIMER_FEDERATION, -1);
+    LOG_INFO("federation: node '%s' on port %d, %d peers", node_name, cfg->port, n_peers);
+    return fd;
+}
+
+int federation_enabled(void) {
+    return fed_src.fd >= 0;
+}
+
+const char *federation_node(void) {
+    return fed_src.fd >= 0 ? node_name : NULL;
+}
+
+int federation_peer(int i, federation_peer_t *info) {
+    if (i < 0 || i >= n_peers) return -1;
+    const peer_t *p = &peers[i];
+
+    memset(info, 0, sizeof(*info));
+    strcpy(info->node, p->node);
+    format_addr(&p->addr, info->addr, sizeof(info->addr));
+    info->alive = p->alive;
+    info->n_caps = p->n_caps;
+    for (int c = 0; c < p->n_caps; c++) {
+        info->n_up += p->caps[c].state != FED_DOWN;
+    }
+    info->heard_ms_ago = p->last_heard_ms ? (long)(timer_now_ms() - p->last_heard_ms) : -1;
+    return 0;
+}
+
+int federation_peer_address(const char *node, struct sockaddr_in6 *addr) {
+    const peer_t *p = node ? peer_by_node(node) : NULL;
+    if (!p) return -1;
+    *addr = p->addr;
+    return 0;
+}
+
+int federation_is_peer_host(const struct sockaddr_in6 *addr) {
+    for (int i = 0; i < n_peers; i++) {
+        if (memcmp(&peers[i].addr.sin6_addr, &addr->sin6_addr, sizeof(addr->sin6_addr)) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void federation_close(void) {
+    if (fed_src.fd >= 0) {
+        /* Say goodbye: everything here is going down */
+        for (int i = 0; i < seen_count; i++) {
+            if (!is_remote[i] && local_state[i] != FED_DOWN) {
+                local_state[i] = FED_DOWN;
+                local_version[i] = ++version;
+            }
+        }
+        for (int i = 0; i < n_peers; i++) {
+            if (peers[i].acked < version) send_delta(&peers[i]);
+        }
+    }
+    for (int i = 0; i < n_peers; i++) {
+        peer_forget(&peers[i]);
+        peers[i].alive = 0;
+        peers[i].incarnation = 0;
+    }
+    n_peers = 0;
+    if (fed_src.fd >= 0) {
+        if (fed_epoll_fd >= 0) epoll_ctl(fed_epoll_fd, EPOLL_CTL_DEL, fed_src.fd, NULL);
+        close(fed_src.fd);
+        fed_src.fd = -1;
+    }
+    fed_epoll_fd = -1;
+    explicit_bzero(secret, sizeof(secret));
+    secret_len = 0;
+}
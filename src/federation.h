@@ -0,0 +1,110 @@
+/*
+ * federation.h - YakirOS capability federation
+ *
+ * Lets components require capabilities provided on other hosts, as
+ * "cap@node" (e.g. requires = ["sql@db1"]). Each graph-resolver with a
+ * federation config exchanges the state of its local capabilities - up,
+ * degraded or down - with the peers listed there, over UDP. Every local
+ * change gets a version number, and a peer is only sent what changed
+ * since the version it last acknowledged, so a message is usually a
+ * header and a line or two. Changes go out in the same main loop round
+ * they happen in; a heartbeat every FEDERATION_INTERVAL_MS repeats
+ * anything not yet acknowledged and tells peers the node is alive. A
+ * peer silent for FEDERATION_DEAD_MS is taken to be down, and so is
+ * everything it provided.
+ *
+ * Every datagram carries an HMAC-SHA256 under the secret the peers
+ * share, and one that fails the check is dropped, as is one from an
+ * address that is not a configured peer's.
+ *
+ * Remote states are applied to the local registry entry named
+ * "cap@node", which queues the change like a local one, so the
+ * components requiring it are re-resolved at once. See
+ * docs/federation-protocol.md.
+ */
+
+#ifndef FEDERATION_H
+#define FEDERATION_H
+
+#include "capability.h"
+#include <stdint.h>
+#include <netinet/in.h>
+
+#define FEDERATION_CONFIG       "/etc/graph-resolver/federation.conf"
+#define FEDERATION_PORT         7946
+#define FEDERATION_MAX_PEERS    16
+#define FEDERATION_INTERVAL_MS  1000
+#define FEDERATION_DEAD_MS      3500
+#define FEDERATION_DATAGRAM_MAX 1400   /* stays within an Ethernet MTU */
+#define FEDERATION_SECRET_MIN   16
+#define FEDERATION_SECRET_MAX   256
+#define FEDERATION_MAC_HEX      64     /* hex digits of an HMAC-SHA256 */
+
+/* What the config file says */
+typedef struct {
+    char                node[MAX_NAME];   /* name peers know us by */
+    char                secret[FEDERATION_SECRET_MAX];  /* shared by all peers */
+    int                 port;
+    int                 n_peers;
+    struct sockaddr_in6 peers[FEDERATION_MAX_PEERS];
+} federation_config_t;
+
+/* Parse path ("node = ", "port = ", "secret = " and "peer = addr[:port]"
+ * lines). node defaults to the hostname and port to FEDERATION_PORT; the
+ * secret, at least FEDERATION_SECRET_MIN characters, is required. Returns
+ * 0, 1 if there is no such file (federation off), or -1 on errors. */
+int federation_load_config(const char *path, federation_config_t *cfg);
+
+/* Bind the federation socket and register it in epoll_fd (skipped if
+ * epoll_fd < 0). Returns the socket fd, or -1 (also without a secret). */
+int federation_init(int epoll_fd, const federation_config_t *cfg);
+
+/* Whether federation_init() succeeded */
+int federation_enabled(void);
+
+/* This node's name, or NULL when federation is off */
+const char *federation_node(void);
+
+/* Apply every datagram waiting on the socket */
+void federation_receive(void);
+
+/* Send peers what changed locally since the last call, and apply known
+ * remote states to "cap@node" capabilities interned since. Called once
+ * per main loop round, after resolving. */
+void federation_flush(void);
+
+/* TIMER_FEDERATION: heartbeat every peer and expire the silent ones */
+void federation_tick(uint64_t now);
+
+/* What `graphctl peers` shows of one peer */
+typedef struct {
+    char node[MAX_NAME];     /* "" until it has been heard from */
+    char addr[64];           /* address:port as configured */
+    int  alive;
+    int  n_caps;             /* capabilities it has told us about */
+    int  n_up;               /* ... of them up or degraded */
+    long heard_ms_ago;       /* -1 if never heard from */
+} federation_peer_t;
+
+/* Fill info for peer i. Returns 0, or -1 past the last peer. */
+int federation_peer(int i, federation_peer_t *info);
+
+/* Copy the configured address of the live peer called node into addr.
+ * Returns 0, or -1 if no such peer is alive. */
+int federation_peer_address(const char *node, struct sockaddr_in6 *addr);
+
+/* Whether addr, at any port, is that of a configured peer */
+int federation_is_peer_host(const struct sockaddr_in6 *addr);
+
+/* HMAC-SHA256 of data under the federation secret, as FEDERATION_MAC_HEX
+ * hex digits and a NUL */
+void federation_mac(const void *data, size_t len, char *hex);
+
+/* Whether hex is federation_mac() of data; always false with federation
+ * off. The comparison takes the same time wherever they differ. */
+int federation_mac_ok(const void *data, size_t len, const char *hex);
+
+/* Close the socket and forget all peers; their capabilities go down */
+void federation_close(void);
+
+#endif /* FEDERATION_H */
@@ -0,0 +1,181 @@
+/*
+ * filewatch.c - YakirOS readiness file watch implementation
+ *
+ * Several components may wait on files in the same directory; inotify
+ * hands out one watch descriptor per directory, so entries sharing a wd
+ * are reference counted by scanning the entry table, which is indexed by
+ * component and grows with it.
+ */
+
+#define _GNU_SOURCE
+#include "filewatch.h"
+#include "event.h"
+#include "log.h"
+#include "toml.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+
+typedef struct {
+    int  wd;                /* -1 when unused */
+    char name[MAX_NAME];    /* file name inside the watched directory */
+} filewatch_t;
+
+static filewatch_t *watches = NULL;
+static int n_slots = 0;
+static int inotify_fd = -1;
+static int initialized = 0;
+static event_source_t filewatch_src = { EVENT_FILEWATCH, -1 };
+
+static void filewatch_reset_table(void) {
+    for (int i = 0; i < n_slots; i++) {
+        watches[i].wd = -1;
+        watches[i].name[0] = '\0';
+    }
+    initialized = 1;
+}
+
+/* Make sure component idx has an entry */
+static int filewatch_reserve(int idx) {
+    if (idx < n_slots) return 0;
+
+    int new_slots = n_slots ? n_slots : 64;
+    while (new_slots <= idx) new_slots *= 2;
+
+    filewatch_t *grown = realloc(watches, (size_t)new_slots * sizeof(*grown));
+    if (!grown) {
+        LOG_ERR("out of memory growing readiness file watches");
+        return -1;
+    }
+    for (int i = n_slots; i < new_slots; i++) {
+        grown[i].wd = -1;
+        grown[i].name[0] = '\0';
+    }
+    watches = grown;
+    n_slots = new_slots;
+    return 0;
+}
+
+int filewatch_init(int epoll_fd) {
+    if (!initialized) filewatch_reset_table();
+    if (inotify_fd >= 0) return inotify_fd;
+
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        LOG_WARN("readiness file watches unavailable: %s", strerror(errno));
+        return -1;
+    }
+
+    filewatch_src.fd = inotify_fd;
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = &filewatch_src;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, inotify_fd, &ev) < 0) {
+        LOG_WARN("epoll add for readiness file watches failed: %s", strerror(errno));
+        close(inotify_fd);
+        inotify_fd = -1;
+        return -1;
+    }
+    return inotify_fd;
+}
+
+static int wd_in_use(int wd) {
+    for (int i = 0; i < n_slots; i++) {
+        if (watches[i].wd == wd) return 1;
+    }
+    return 0;
+}
+
+int filewatch_add(int idx, const char *path) {
+    if (inotify_fd < 0 || idx < 0 || !path || !*path) {
+        return -1;
+    }
+    if (filewatch_reserve(idx) < 0) {
+        return -1;
+    }
+    filewatch_remove(idx);
+
+    char dir[MAX_PATH];
+    const char *slash = strrchr(path, '/');
+    const char *name = slash ? slash + 1 : path;
+    if (!*name || strlen(name) >= MAX_NAME) return -1;
+
+    if (!slash) {
+        strcpy(dir, ".");
+    } else if (slash == path) {
+        strcpy(dir, "/");
+    } else {
+        size_t len = (size_t)(slash - path);
+        if (len >= sizeof(dir)) return -1;
+        memcpy(dir, path, len);
+        dir[len] = '\0';
+    }
+
+    /* IN_MOVED_TO catches files written elsewhere and renamed into place */
+    int wd = inotify_add_watch(inotify_fd, dir, IN_CREATE | IN_MOVED_TO | IN_ONLYDIR);
+    if (wd < 0) {
+        return -1;
+    }
+
+    watches[idx].wd = wd;
+    strcpy(watches[idx].name, name);
+    return 0;
+}
+
+void filewatch_remove(int idx) {
+    if (!initialized || idx < 0 || idx >= n_slots || watches[idx].wd < 0) {
+        return;
+    }
+
+    int wd = watches[idx].wd;
+    watches[idx].wd = -1;
+    watches[idx].name[0] = '\0';
+    if (!wd_in_use(wd) && inotify_fd >= 0) {
+        inotify_rm_watch(inotify_fd, wd);
+    }
+}
+
+void filewatch_clear(void) {
+    for (int i = 0; i < n_slots; i++) {
+        filewatch_remove(i);
+    }
+}
+
+int filewatch_active(int idx) {
+    return initialized && idx >= 0 && idx < n_slots && watches[idx].wd >= 0;
+}
+
+void filewatch_dispatch(void (*changed)(int idx)) {
+    if (inotify_fd < 0) return;
+
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len;
+
+    while ((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            for (int i = 0; i < n_slots; i++) {
+                if (watches[i].wd < 0) continue;
+
+                if (ev->mask & IN_Q_OVERFLOW) {
+                    /* Events were lost: let every owner look again */
+                    changed(i);
+                } else if (watches[i].wd != ev->wd) {
+                    continue;
+                } else if (ev->mask & IN_IGNORED) {
+                    /* Directory went away; the owner falls back to polling */
+                    watches[i].wd = -1;
+                    watches[i].name[0] = '\0';
+                    changed(i);
+                } else if (ev->len > 0 && strcmp(ev->name, watches[i].name) == 0) {
+                    changed(i);
+                }
+            }
+        }
+    }
+}
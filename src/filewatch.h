@@ -0,0 +1,35 @@
+/*
+ * filewatch.h - YakirOS readiness file watches
+ *
+ * Components using file-based readiness are told the moment their file
+ * appears: the parent directory of each readiness file is watched through
+ * one inotify instance registered in the main epoll set. Components whose
+ * directory cannot be watched (e.g. it does not exist yet) fall back to
+ * polling.
+ */
+
+#ifndef FILEWATCH_H
+#define FILEWATCH_H
+
+/* Create the inotify instance and register it in epoll_fd.
+ * Returns the inotify fd, or -1 if file watches are unavailable. */
+int filewatch_init(int epoll_fd);
+
+/* Watch for path to appear on behalf of component idx, replacing any
+ * previous watch of that component. Returns 0, or -1 if not watchable. */
+int filewatch_add(int idx, const char *path);
+
+/* Drop the watch held by component idx, if any */
+void filewatch_remove(int idx);
+
+/* Drop every watch */
+void filewatch_clear(void);
+
+/* Non-zero while component idx has a live watch */
+int filewatch_active(int idx);
+
+/* Read pending inotify events and call changed(idx) for each component
+ * whose file may have appeared or whose watch went away */
+void filewatch_dispatch(void (*changed)(int idx));
+
+#endif /* FILEWATCH_H */
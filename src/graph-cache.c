@@ -0,0 +1,302 @@
+/*
+ * graph-cache.c - YakirOS compiled component graph cache implementation
+ *
+ * File layout, all integers in host byte order (the cache never leaves
+ * the machine that wrote it):
+ *
+ *   header        magic, version and the component_t layout it was built for
+ *   entry[n]      key, and offsets of the path, record and strings, sorted
+ *                 by path so lookups are a binary search
+ *   data          per entry: path, component_t record with its string
+ *                 pointers stored as arena offsets, then the arena itself
+ *
+ * Every offset is checked against the file size when the cache is
+ * mapped; a file that fails any check is treated as absent.
+ */
+
+#define _GNU_SOURCE
+#include "graph-cache.h"
+#include "log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define GRAPH_CACHE_MAGIC "YKGRAPH"
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t comp_size;          /* sizeof(component_t) */
+    uint32_t max_args;
+    uint32_t max_deps;
+    uint32_t n_entries;
+    uint32_t reserved;
+    uint64_t file_size;
+} cache_header_t;
+
+typedef struct {
+    graph_cache_key_t key;
+    uint64_t path_off;
+    uint64_t path_len;           /* without the NUL */
+    uint64_t comp_off;
+    uint64_t strings_off;
+    uint64_t strings_len;
+} cache_entry_t;
+
+static char *cache_path = NULL;
+static const unsigned char *cache_map = NULL;
+static size_t cache_size = 0;
+static const cache_entry_t *cache_entries = NULL;
+static int cache_n = 0;
+
+void graph_cache_key(const struct stat *st, graph_cache_key_t *key) {
+    memset(key, 0, sizeof(*key));
+    key->dev = (uint64_t)st->st_dev;
+    key->ino = (uint64_t)st->st_ino;
+    key->size = (uint64_t)st->st_size;
+    key->mtime_sec = (int64_t)st->st_mtim.tv_sec;
+    key->mtime_nsec = (int64_t)st->st_mtim.tv_nsec;
+}
+
+void graph_cache_set_path(const char *path) {
+    graph_cache_close();
+    free(cache_path);
+    cache_path = path ? strdup(path) : NULL;
+}
+
+const char *graph_cache_path(void) {
+    return cache_path;
+}
+
+static int range_ok(uint64_t off, uint64_t len) {
+    return off <= cache_size && len <= cache_size - off;
+}
+
+static int cache_valid(const cache_header_t *hdr) {
+    if (memcmp(hdr->magic, GRAPH_CACHE_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != GRAPH_CACHE_VERSION ||
+        hdr->comp_size != sizeof(component_t) ||
+        hdr->max_args != MAX_ARGS || hdr->max_deps != MAX_DEPS ||
+        hdr->file_size != cache_size) {
+        return 0;
+    }
+    if (!range_ok(sizeof(*hdr), (uint64_t)hdr->n_entries * sizeof(cache_entry_t))) {
+        return 0;
+    }
+
+    const cache_entry_t *e = (const cache_entry_t *)(cache_map + sizeof(*hdr));
+    for (uint32_t i = 0; i < hdr->n_entries; i++) {
+        if (!range_ok(e[i].path_off, e[i].path_len + 1) ||
+            cache_map[e[i].path_off + e[i].path_len] != '\0' ||
+            !range_ok(e[i].comp_off, sizeof(component_t)) ||
+            !range_ok(e[i].strings_off, e[i].strings_len)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int graph_cache_open(void) {
+    graph_cache_close();
+    if (!cache_path) return -1;
+
+    int fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            LOG_WARN("cannot open graph cache %s: %s", cache_path, strerror(errno));
+        }
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(cache_header_t)) {
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        LOG_WARN("cannot map graph cache %s: %s", cache_path, strerror(errno));
+        return -1;
+    }
+
+    cache_map = map;
+    cache_size = (size_t)st.st_size;
+    const cache_header_t *hdr = (const cache_header_t *)cache_map;
+    if (!cache_valid(hdr)) {
+        LOG_INFO("graph cache %s is stale or damaged, ignoring it", cache_path);
+        graph_cache_close();
+        return -1;
+    }
+
+    cache_entries = (const cache_entry_t *)(cache_map + sizeof(*hdr));
+    cache_n = (int)hdr->n_entries;
+    return cache_n;
+}
+
+void graph_cache_close(void) {
+    if (cache_map) {
+        munmap((void *)cache_map, cache_size);
+    }
+    cache_map = NULL;
+    cache_size = 0;
+    cache_entries = NULL;
+    cache_n = 0;
+}
+
+int graph_cache_lookup(const char *path, const graph_cache_key_t *key, component_t *comp) {
+    int lo = 0, hi = cache_n - 1;
+
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        const cache_entry_t *e = &cache_entries[mid];
+        int cmp = strcmp(path, (const char *)cache_map + e->path_off);
+
+        if (cmp < 0) {
+            hi = mid - 1;
+        } else if (cmp > 0) {
+            lo = mid + 1;
+        } else {
+            if (memcmp(&e->key, key, sizeof(*key)) != 0) return -1;
+
+            memcpy(comp, cache_map + e->comp_off, sizeof(*comp));
+            if (component_strings_attach(comp, (const char *)cache_map + e->strings_off,
+                                         e->strings_len) < 0 ||
+                !comp->name[0] || !comp_str(comp->binary)[0]) {
+                component_free_strings(comp);
+                return -1;
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static const component_t *sort_comps;
+
+static int by_path(const void *a, const void *b) {
+    return strcmp(comp_str(sort_comps[*(const int *)a].config_path),
+                  comp_str(sort_comps[*(const int *)b].config_path));
+}
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int graph_cache_write(const component_t *comps, const graph_cache_key_t *keys, int n) {
+    if (!cache_path) return -1;
+
+    int *order = malloc((size_t)(n > 0 ? n : 1) * sizeof(*order));
+    cache_entry_t *entries = calloc((size_t)(n > 0 ? n : 1), sizeof(*entries));
+    if (!order || !entries) {
+        free(order);
+        free(entries);
+        return -1;
+    }
+    /* Built-in components have no file to key them by */
+    int n_files = 0;
+    for (int i = 0; i < n; i++) {
+        if (comp_str(comps[i].config_path)[0]) order[n_files++] = i;
+    }
+    n = n_files;
+    sort_comps = comps;
+    qsort(order, (size_t)n, sizeof(*order), by_path);
+
+    /* Lay out the data section */
+    uint64_t off = sizeof(cache_header_t) + (uint64_t)n * sizeof(cache_entry_t);
+    for (int i = 0; i < n; i++) {
+        const component_t *c = &comps[order[i]];
+        cache_entry_t *e = &entries[i];
+        e->key = keys[order[i]];
+        e->path_off = off;
+        e->path_len = strlen(comp_str(c->config_path));
+        off += e->path_len + 1;
+        off = (off + 7) & ~(uint64_t)7;
+        e->comp_off = off;
+        off += sizeof(component_t);
+        e->strings_off = off;
+        e->strings_len = c->strings.len;
+        off += e->strings_len;
+        off = (off + 7) & ~(uint64_t)7;
+    }
+
+    cache_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, GRAPH_CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.version = GRAPH_CACHE_VERSION;
+    hdr.comp_size = sizeof(component_t);
+    hdr.max_args = MAX_ARGS;
+    hdr.max_deps = MAX_DEPS;
+    hdr.n_entries = (uint32_t)n;
+    hdr.file_size = off;
+
+    char tmp[MAX_PATH + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", cache_path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 && errno == ENOENT) {
+        /* First write: create the cache directory */
+        char parent[MAX_PATH];
+        snprintf(parent, sizeof(parent), "%s", cache_path);
+        char *slash = strrchr(parent, '/');
+        if (slash && slash != parent) {
+            *slash = '\0';
+            mkdir(parent, 0755);
+            fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        }
+    }
+    if (fd < 0) {
+        LOG_WARN("cannot write graph cache %s: %s", tmp, strerror(errno));
+        free(order);
+        free(entries);
+        return -1;
+    }
+
+    static const char zeros[8];
+    int ret = write_all(fd, &hdr, sizeof(hdr));
+    if (ret == 0) ret = write_all(fd, entries, (size_t)n * sizeof(*entries));
+
+    uint64_t pos = sizeof(hdr) + (uint64_t)n * sizeof(*entries);
+    for (int i = 0; i < n && ret == 0; i++) {
+        const component_t *c = &comps[order[i]];
+        const cache_entry_t *e = &entries[i];
+        component_t rec = *c;
+        component_reset_runtime(&rec);
+        component_strings_detach(&rec);
+
+        ret = write_all(fd, comp_str(c->config_path), e->path_len + 1);
+        pos += e->path_len + 1;
+        if (ret == 0) ret = write_all(fd, zeros, e->comp_off - pos);
+        if (ret == 0) ret = write_all(fd, &rec, sizeof(rec));
+        if (ret == 0 && e->strings_len) ret = write_all(fd, c->strings.base, e->strings_len);
+        pos = e->strings_off + e->strings_len;
+        uint64_t next = (pos + 7) & ~(uint64_t)7;
+        if (ret == 0) ret = write_all(fd, zeros, next - pos);
+        pos = next;
+    }
+
+    free(order);
+    free(entries);
+    if (close(fd) < 0) ret = -1;
+    if (ret == 0 && rename(tmp, cache_path) < 0) ret = -1;
+    if (ret < 0) {
+        LOG_WARN("cannot write graph cache %s: %s", cache_path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * graph-cache.h - YakirOS compiled component graph cache
+ *
+ * A binary snapshot of the parsed component declarations, written after
+ * load_components() has parsed anything and mapped read-only on the next
+ * load, so boot and reload only parse the .toml files that changed. Each
+ * record is keyed by its file's path, device, inode, size and mtime; a
+ * record whose key no longer matches the file is ignored. A cache built
+ * by a binary with a different component_t layout is ignored entirely.
+ */
+
+#ifndef GRAPH_CACHE_H
+#define GRAPH_CACHE_H
+
+#include "toml.h"
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define GRAPH_CACHE_FILE "/var/cache/graph-resolver/graph.cache"
+#define GRAPH_CACHE_VERSION 1
+
+/* Identity of a declaration file when its record was written */
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t  mtime_sec;
+    int64_t  mtime_nsec;
+} graph_cache_key_t;
+
+void graph_cache_key(const struct stat *st, graph_cache_key_t *key);
+
+/* Cache file used by load_components(); NULL (the default) disables it */
+void graph_cache_set_path(const char *path);
+const char *graph_cache_path(void);
+
+/* Map the cache file. Returns the number of records, or -1 if there is
+ * no usable cache. */
+int graph_cache_open(void);
+void graph_cache_close(void);
+
+/* Fill comp from the record for path if key matches it. comp gets its own
+ * string arena; capability IDs still need component_intern_caps().
+ * Returns 0 on a hit, -1 otherwise. */
+int graph_cache_lookup(const char *path, const graph_cache_key_t *key, component_t *comp);
+
+/* Replace the cache file with records for comps[0..n), keyed by keys[].
+ * Components without a config_path are skipped and runtime state is not
+ * recorded. The file is written beside the old one and renamed over it. */
+int graph_cache_write(const component_t *comps, const graph_cache_key_t *keys, int n);
+
+#endif /* GRAPH_CACHE_H */
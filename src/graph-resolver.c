@@ -22,6 +22,7 @@
 #include <sys/epoll.h>
 #include <sys/inotify.h>
 #include <sys/reboot.h>
+#include <time.h>
 
 /* YakirOS modules */
 #include "log.h"
@@ -32,6 +33,21 @@
 #include "control.h"
 #include "cgroup.h"
 #include "kexec.h"
+#include "timer.h"
+#include "supervise.h"
+#include "event.h"
+#include "filewatch.h"
+#include "notify.h"
+#include "graph-cache.h"
+#include "reload.h"
+#include "output.h"
+#include "pressure.h"
+#include "activation.h"
+#include "metrics-export.h"
+#include "shutdown.h"
+#include "federation.h"
+#include "migration.h"
+#include "placement.h"
 
 /* Global state */
 static int sigchld_pipe[2] = {-1, -1};
@@ -39,6 +55,12 @@ static volatile int running = 1;
 static volatile int reload_config = 0;
 static volatile int dump_state = 0;
 
+/* Main loop event sources, referenced from epoll data.ptr */
+static event_source_t sigchld_src = { EVENT_SIGCHLD, -1 };
+static event_source_t control_src = { EVENT_CONTROL, -1 };
+static event_source_t inotify_src = { EVENT_INOTIFY, -1 };
+static event_source_t timer_src = { EVENT_TIMER, -1 };
+
 /* SIGCHLD handler - write to self-pipe for epoll */
 static void sigchld_handler(int sig) {
     (void)sig;
@@ -46,25 +68,30 @@ static void sigchld_handler(int sig) {
     (void)!write(sigchld_pipe[1], &c, 1);
 }
 
-/* Reap zombie children */
+/* Reap zombie children. Supervised processes normally arrive through
+ * their pidfd; one whose exit shows up here first is still collected
+ * through its watch, never by pid. Everything else is an orphan
+ * reparented to PID 1. Exits are peeked at first, collecting nothing. */
 static void reap_children(void) {
-    pid_t pid;
+    siginfo_t info;
     int status;
 
-    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-        int found = 0;
-
-        /* Find which component this was */
-        for (int i = 0; i < n_components; i++) {
-            if (components[i].pid == pid) {
-                component_exited(i, status);
-                found = 1;
-                break;
-            }
+    for (;;) {
+        memset(&info, 0, sizeof(info));
+        if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) < 0 || info.si_pid == 0) {
+            break;
         }
-
-        if (!found) {
+        pid_t pid = info.si_pid;
+        proc_watch_t *w = supervise_lookup(pid);
+        if (w) {
+            if (!supervise_collect(w, &status)) {
+                break;   /* not collectable yet; its pidfd will say */
+            }
+            component_reap(pid, status);
+        } else if (waitpid(pid, &status, WNOHANG) == pid) {
             LOG_INFO("reaped orphan pid %d", pid);
+        } else {
+            break;
         }
     }
 }
@@ -98,59 +125,31 @@ static void mount_early_fs(void) {
     }
 }
 
-/* Handle inotify events for /etc/graph.d changes */
+/* Note which graph.d files changed; reload.c applies them once the
+ * directory has been quiet for a moment */
 static void handle_inotify(int inotify_fd) {
-    char buf[4096];
-    int n = read(inotify_fd, buf, sizeof(buf));
-    if (n <= 0) return;
-
-    LOG_INFO("graph.d changed, reloading");
-
-    /* Save current component states for restoration */
-    pid_t pids[MAX_COMPONENTS];
-    comp_state_t states[MAX_COMPONENTS];
-    char names[MAX_COMPONENTS][MAX_NAME];
-    int old_count = n_components;
-
-    for (int i = 0; i < n_components; i++) {
-        pids[i] = components[i].pid;
-        states[i] = components[i].state;
-        memcpy(names[i], components[i].name, MAX_NAME);
-        names[i][MAX_NAME - 1] = '\0';
-    }
-
-    /* Reload components */
-    n_components = 0;
-    capability_init();
-    register_early_capabilities();
-    load_components(GRAPH_DIR);
-
-    /* Validate reloaded graph (warn only, don't crash running system) */
-    validate_component_graph(1);
-
-    /* Restore states for components that still exist */
-    for (int i = 0; i < n_components; i++) {
-        for (int j = 0; j < old_count; j++) {
-            if (strcmp(components[i].name, names[j]) == 0) {
-                components[i].pid = pids[j];
-                components[i].state = states[j];
-                /* Re-register capabilities for active components */
-                if (states[j] == COMP_ACTIVE || states[j] == COMP_ONESHOT_DONE) {
-                    for (int k = 0; k < components[i].n_provides; k++) {
-                        capability_register(components[i].provides[k], i);
-                    }
-                }
-                break;
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;) {
+        ssize_t n = read(inotify_fd, buf, sizeof(buf));
+        if (n <= 0) break;
+
+        for (char *p = buf; p < buf + n;) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                LOG_WARN("graph.d event queue overflowed, rescanning");
+                reload_note_all();
+            } else if (ev->len > 0) {
+                reload_note(ev->name);
             }
+            p += sizeof(*ev) + ev->len;
         }
     }
-
-    /* Trigger graph re-resolution */
-    graph_resolve_full();
 }
 
 /* Emergency shell fallback for PID 1 - never exit */
 static void emergency_shell(void) {
+    log_set_async(0);
     if (getpid() == 1) {
         LOG_ERR("CRITICAL: PID 1 failure - dropping to emergency shell");
         execl("/bin/sh", "sh", NULL);
@@ -181,6 +180,25 @@ static void dump_handler(int sig) {
     dump_state = 1;
 }
 
+/* Read an integer yakiros.<key>=N option from the kernel command line */
+static int cmdline_int(const char *key, int def) {
+    char cmdline[4096];
+    char param[128];
+    int value = def;
+
+    FILE *f = fopen("/proc/cmdline", "r");
+    if (!f) return def;
+    if (fgets(cmdline, sizeof(cmdline), f)) {
+        snprintf(param, sizeof(param), "yakiros.%s=", key);
+        const char *p = strstr(cmdline, param);
+        if (p) {
+            value = atoi(p + strlen(param));
+        }
+    }
+    fclose(f);
+    return value;
+}
+
 int main(int argc, char *argv[]) {
     (void)argc; (void)argv;
 
@@ -197,6 +215,7 @@ int main(int argc, char *argv[]) {
 
     /* Initialize subsystems */
     capability_init();
+    timer_init();
 
     /* Initialize cgroup v2 subsystem (only if PID 1) */
     if (getpid() == 1) {
@@ -217,60 +236,8 @@ int main(int argc, char *argv[]) {
         LOG_WARN("failed to initialize kexec subsystem - live kernel upgrades disabled");
     }
 
-    /* Check for post-kexec restoration (only if PID 1) */
-    if (getpid() == 1) {
-        char checkpoint_dir[MAX_KERNEL_PATH];
-        if (kexec_parse_cmdline("", checkpoint_dir, sizeof(checkpoint_dir)) == KEXEC_SUCCESS) {
-            /* Use custom checkpoint directory from kernel command line */
-        } else {
-            strcpy(checkpoint_dir, "/checkpoint"); /* Default */
-        }
-
-        if (kexec_needs_restore(checkpoint_dir)) {
-            LOG_INFO("post-kexec: checkpoint data found, restoring system state");
-
-            checkpoint_manifest_t *manifest = NULL;
-            int result = kexec_load_manifest(checkpoint_dir, &manifest);
-
-            if (result == KEXEC_SUCCESS && manifest) {
-                LOG_INFO("post-kexec: loaded manifest with %u entries from %s kernel",
-                         manifest->entry_count, manifest->old_kernel_version);
-
-                /* Restore all checkpointed processes */
-                result = kexec_restore_all(checkpoint_dir, manifest);
-
-                if (result == KEXEC_SUCCESS) {
-                    LOG_INFO("post-kexec: restoration successful, cleaning up checkpoint data");
-                    kexec_cleanup_checkpoints(checkpoint_dir);
-
-                    /* Log successful kernel upgrade */
-                    char current_kernel[256];
-                    if (kexec_get_current_kernel_version(current_kernel, sizeof(current_kernel)) == KEXEC_SUCCESS) {
-                        LOG_INFO("=== LIVE KERNEL UPGRADE COMPLETED ===");
-                        LOG_INFO("Previous kernel: %s", manifest->old_kernel_version);
-                        LOG_INFO("Current kernel:  %s", current_kernel);
-                        LOG_INFO("Restored %u processes with preserved state", manifest->entry_count);
-                        LOG_INFO("System continues without reboot - upgrade successful!");
-                        LOG_INFO("======================================");
-                    }
-                } else {
-                    LOG_ERR("post-kexec: restoration failed: %s", kexec_error_string(result));
-                    LOG_ERR("system may be partially functional");
-                    /* Continue anyway - some manual recovery may be possible */
-                }
-
-                free(manifest);
-            } else {
-                LOG_ERR("post-kexec: failed to load checkpoint manifest: %s",
-                         kexec_error_string(result));
-                LOG_ERR("cannot restore pre-kexec state, starting fresh");
-                /* Continue with fresh start */
-            }
-        }
-    }
-
     /* Set up self-pipe for SIGCHLD */
-    if (pipe2(sigchld_pipe, O_CLOEXEC) < 0) {
+    if (pipe2(sigchld_pipe, O_CLOEXEC | O_NONBLOCK) < 0) {
         LOG_ERR("pipe2 failed: %s", strerror(errno));
         emergency_shell();
         return 1;
@@ -296,7 +263,11 @@ int main(int argc, char *argv[]) {
     sa.sa_handler = dump_handler;
     sigaction(SIGUSR2, &sa, NULL);
 
-    /* Register kernel capabilities and load components */
+    /* Register kernel capabilities and load components, reusing the
+     * compiled graph cache unless booted with yakiros.graph_cache=0 */
+    if (cmdline_int("graph_cache", 1)) {
+        graph_cache_set_path(GRAPH_CACHE_FILE);
+    }
     register_early_capabilities();
     int loaded = load_components(GRAPH_DIR);
     LOG_INFO("loaded %d components", loaded);
@@ -316,35 +287,146 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    /* Supervised processes get pidfds in the same epoll set */
+    supervise_init(epoll_fd);
+
+    /* Component stdout/stderr come back through pipes in the same set */
+    output_init(epoll_fd, OUTPUT_DIR);
+
     /* Add SIGCHLD pipe to epoll */
     struct epoll_event ev;
+    sigchld_src.fd = sigchld_pipe[0];
     ev.events = EPOLLIN;
-    ev.data.fd = sigchld_pipe[0];
+    ev.data.ptr = &sigchld_src;
     epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sigchld_pipe[0], &ev);
 
     /* Set up control socket */
     int control_fd = setup_control_socket();
     if (control_fd >= 0) {
+        control_init(epoll_fd);
+        control_src.fd = control_fd;
         ev.events = EPOLLIN;
-        ev.data.fd = control_fd;
+        ev.data.ptr = &control_src;
         epoll_ctl(epoll_fd, EPOLL_CTL_ADD, control_fd, &ev);
     }
 
     /* Set up inotify on /etc/graph.d/ */
-    int inotify_fd = inotify_init1(IN_CLOEXEC);
+    reload_init(GRAPH_DIR);
+    int inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
     if (inotify_fd >= 0) {
-        inotify_add_watch(inotify_fd, GRAPH_DIR, IN_CREATE | IN_DELETE | IN_MODIFY);
+        inotify_add_watch(inotify_fd, GRAPH_DIR, IN_CREATE | IN_DELETE | IN_MODIFY |
+                          IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO);
+        inotify_src.fd = inotify_fd;
         ev.events = EPOLLIN;
-        ev.data.fd = inotify_fd;
+        ev.data.ptr = &inotify_src;
         epoll_ctl(epoll_fd, EPOLL_CTL_ADD, inotify_fd, &ev);
     }
 
-    /* Initial graph resolution */
+    /* Deadlines wake the loop through a timerfd; without one, epoll_wait
+     * times out at the next deadline instead */
+    int timer_fd = timer_fd_open();
+    if (timer_fd >= 0) {
+        timer_src.fd = timer_fd;
+        ev.events = EPOLLIN;
+        ev.data.ptr = &timer_src;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+    }
+    /* OOM kills are reported by inotify on each cgroup's memory.events */
+    cgroup_oom_init(epoll_fd);
+    pressure_init(epoll_fd);
+    placement_init("/sys");
+    activation_init(epoll_fd);
+    component_handoff_init(epoll_fd);
+    component_timers_start();
+
+    /* Readiness files are noticed through inotify, not polling */
+    filewatch_init(epoll_fd);
+
+    /* sd_notify-style readiness socket (mkdir in case /run/graph is new) */
+    mkdir("/run/graph", 0755);
+    notify_init(epoll_fd, NOTIFY_SOCKET_PATH);
+
+    /* OpenMetrics endpoint on a Unix socket unless yakiros.metrics=0,
+     * and on TCP too with yakiros.metrics_port=N */
+    metrics_listen(epoll_fd, cmdline_int("metrics", 1) ? METRICS_SOCKET : NULL,
+                   cmdline_int("metrics_port", 0));
+
+    /* Capability state shared with peer nodes, if configured */
+    federation_config_t fed_cfg;
+    int fed = federation_load_config(FEDERATION_CONFIG, &fed_cfg);
+    if (fed == 0) {
+        /* Peers hand components over on the same port, over TCP */
+        if (federation_init(epoll_fd, &fed_cfg) >= 0) {
+            migration_listen(epoll_fd, fed_cfg.port);
+        }
+    } else if (fed < 0) {
+        LOG_ERR("federation disabled: %s could not be used", FEDERATION_CONFIG);
+    }
+
+    /* Post-kexec restoration (only if PID 1): once the declarations are
+     * loaded and supervision is up, so restored processes are adopted by
+     * their components before the rest of the graph resolves */
+    if (getpid() == 1) {
+        char checkpoint_dir[MAX_KERNEL_PATH];
+        if (kexec_parse_cmdline("", checkpoint_dir, sizeof(checkpoint_dir)) == KEXEC_SUCCESS) {
+            /* Use custom checkpoint directory from kernel command line */
+        } else {
+            strcpy(checkpoint_dir, "/checkpoint"); /* Default */
+        }
+
+        if (kexec_needs_restore(checkpoint_dir)) {
+            LOG_INFO("post-kexec: checkpoint data found, restoring system state");
+
+            checkpoint_manifest_t *manifest = NULL;
+            int result = kexec_load_manifest(checkpoint_dir, &manifest);
+
+            if (result == KEXEC_SUCCESS && manifest) {
+                LOG_INFO("post-kexec: loaded manifest with %u entries from %s kernel",
+                         manifest->entry_count, manifest->old_kernel_version);
+
+                /* Restore all checkpointed processes */
+                result = kexec_restore_all(checkpoint_dir, manifest);
+
+                if (result == KEXEC_SUCCESS) {
+                    LOG_INFO("post-kexec: restoration successful, cleaning up checkpoint data");
+                    kexec_cleanup_checkpoints(checkpoint_dir);
+
+                    /* Log successful kernel upgrade */
+                    char current_kernel[256];
+                    if (kexec_get_current_kernel_version(current_kernel, sizeof(current_kernel)) == KEXEC_SUCCESS) {
+                        LOG_INFO("=== LIVE KERNEL UPGRADE COMPLETED ===");
+                        LOG_INFO("Previous kernel: %s", manifest->old_kernel_version);
+                        LOG_INFO("Current kernel:  %s", current_kernel);
+                        LOG_INFO("Restored %u processes with preserved state", manifest->entry_count);
+                        LOG_INFO("Downtime:        %llds since checkpointing began",
+                                 (long long)(time(NULL) - (time_t)manifest->creation_time));
+                        LOG_INFO("System continues without reboot - upgrade successful!");
+                        LOG_INFO("======================================");
+                    }
+                } else {
+                    LOG_ERR("post-kexec: restoration failed: %s", kexec_error_string(result));
+                    LOG_ERR("system may be partially functional");
+                    /* Continue anyway - some manual recovery may be possible */
+                }
+
+                free(manifest);
+            } else {
+                LOG_ERR("post-kexec: failed to load checkpoint manifest: %s",
+                         kexec_error_string(result));
+                LOG_ERR("cannot restore pre-kexec state, starting fresh");
+                /* Continue with fresh start */
+            }
+        }
+    }
+
+    /* Initial graph resolution, scheduled level by level */
     LOG_INFO("performing initial graph resolution");
+    graph_boot_begin(cmdline_int("boot_parallel", 0));
     graph_resolve_full();
 
-    /* Main event loop */
+    /* Main event loop; from here on log lines are written in batches */
     LOG_INFO("entering main event loop");
+    log_set_async(1);
     #define MAX_EPOLL_EVENTS 32
     struct epoll_event events[MAX_EPOLL_EVENTS];
 
@@ -353,7 +435,8 @@ int main(int argc, char *argv[]) {
         if (reload_config) {
             reload_config = 0;
             LOG_INFO("SIGUSR1 received - reloading configuration");
-            handle_inotify(inotify_fd); /* Reuse the inotify reload logic */
+            reload_note_all();
+            reload_apply(NULL);
         }
 
         if (dump_state) {
@@ -371,6 +454,9 @@ int main(int argc, char *argv[]) {
                     case COMP_DEGRADED:     state_str = "DEGRADED";  break;
                     case COMP_FAILED:       state_str = "FAILED";    break;
                     case COMP_ONESHOT_DONE: state_str = "DONE";      break;
+                    case COMP_QUARANTINED: state_str = "QUARANTINED"; break;
+                    case COMP_IDLE:        state_str = "IDLE";      break;
+                    case COMP_MIGRATED:    state_str = "MIGRATED";  break;
                 }
                 LOG_INFO("  %s: %s (pid %d, restarts %d)",
                          components[i].name, state_str, components[i].pid, components[i].restart_count);
@@ -383,7 +469,12 @@ int main(int argc, char *argv[]) {
             LOG_INFO("=== END STATE DUMP ===");
         }
 
-        int nfds = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS, 1000);
+        /* Sleep until an event or the next deadline */
+        log_flush();
+        timer_fd_update();
+        int timeout = timer_fd >= 0 ? -1 : timer_next_ms();
+
+        int nfds = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS, timeout);
 
         if (nfds < 0) {
             if (errno == EINTR) continue;
@@ -392,58 +483,148 @@ int main(int argc, char *argv[]) {
             break;
         }
 
-        /* Check readiness for components waiting for readiness signals */
-        check_all_readiness();
-
-        /* Check health for components with health checks enabled */
-        check_all_health();
-
-        /* Check for OOM events in component cgroups */
-        check_all_oom_events();
-
         for (int i = 0; i < nfds; i++) {
-            int fd = events[i].data.fd;
+            event_source_t *src = events[i].data.ptr;
+
+            switch (src->type) {
+            case EVENT_PROCESS: {
+                /* A supervised process exited */
+                proc_watch_t *w = (proc_watch_t *)src;
+                pid_t pid = w->pid;
+                int status;
+                if (supervise_collect(w, &status)) {
+                    component_reap(pid, status);
+                }
+                break;
+            }
 
-            if (fd == sigchld_pipe[0]) {
+            case EVENT_SIGCHLD: {
                 /* Drain the pipe and reap children */
                 char c;
                 while (read(sigchld_pipe[0], &c, 1) > 0) {}
                 reap_children();
-                /* Re-resolve graph: component death may affect dependencies */
-                graph_resolve_full();
-
-            } else if (fd == control_fd) {
-                /* Accept control connection */
-                int client_fd = accept(control_fd, NULL, NULL);
-                if (client_fd >= 0) {
-                    handle_control_command(client_fd);
-                    close(client_fd);
-                }
+                break;
+            }
 
-            } else if (fd == inotify_fd) {
+            case EVENT_CONTROL:
+                /* New graphctl/monitoring connections */
+                control_accept(control_fd);
+                break;
+
+            case EVENT_CONTROL_CLIENT:
+                /* Commands in, replies out, one connection at a time */
+                control_client_event(src, events[i].events);
+                break;
+
+            case EVENT_INOTIFY:
                 /* Handle component directory changes */
                 handle_inotify(inotify_fd);
+                break;
+
+            case EVENT_TIMER:
+                timer_fd_ack();
+                break;
+
+            case EVENT_FILEWATCH:
+                /* Readiness files appeared */
+                component_handle_file_events();
+                break;
+
+            case EVENT_NOTIFY:
+                /* READY=1 and friends from notify-readiness services */
+                component_handle_notify();
+                break;
+
+            case EVENT_OUTPUT:
+                /* Component stdout/stderr */
+                output_event(src);
+                break;
+
+            case EVENT_OOM:
+                /* A cgroup's memory.events changed */
+                component_handle_oom_events();
+                break;
+
+            case EVENT_PRESSURE:
+                /* An adaptive component is stalling */
+                pressure_event(src, events[i].events);
+                break;
+
+            case EVENT_ACTIVATION:
+                /* A client is waiting on an idle component's socket */
+                component_handle_activation(src->fd);
+                break;
+
+            case EVENT_METRICS:
+                /* A scraper connecting */
+                metrics_accept(src);
+                break;
+
+            case EVENT_METRICS_CLIENT:
+                /* Request in, exposition out */
+                metrics_client_event(src, events[i].events);
+                break;
+
+            case EVENT_FEDERATION:
+                /* Capability changes from peer nodes */
+                federation_receive();
+                break;
+
+            case EVENT_MIGRATION:
+                /* A peer about to hand a component over */
+                migration_accept(src);
+                break;
+
+            case EVENT_MIGRATION_CLIENT:
+                /* Its images arriving */
+                migration_client_event(src, events[i].events);
+                break;
+
+            case EVENT_HANDOFF:
+                /* Descriptors on their way to a standby */
+                component_handoff_event(src);
+                break;
             }
         }
+
+        /* Nothing in the batch can name a removed pressure entry now */
+        pressure_reap();
+
+        /* Fire due deadlines: readiness probes and timeouts, health checks,
+         * restart backoff, OOM scan and the periodic full sweep */
+        component_run_timers();
+
+        /* Re-evaluate only the components affected by this round */
+        graph_resolve_pending();
+
+        /* Keep what started or stopped on the right CPUs and nodes */
+        placement_apply();
+
+        /* Tell peer nodes what changed here */
+        federation_flush();
+
+        /* Tell subscribers what changed */
+        control_publish();
     }
 
     /* Shutdown sequence */
+    log_set_async(0);
     LOG_INFO("graph-resolver shutting down");
+    control_close_all();
+    metrics_close_all();
+    migration_close_all();
+    federation_close();
 
-    /* Send SIGTERM to all managed processes */
+    /* Standbys and checks have nothing depending on them: they go first */
     for (int i = 0; i < n_components; i++) {
-        if (components[i].pid > 0) {
-            kill(components[i].pid, SIGTERM);
-        }
+        component_standby_stop(i);
+        component_close_sockets(i);
     }
+    component_cancel_checks();
 
-    /* Wait a moment, then SIGKILL any stragglers */
-    sleep(5);
-    for (int i = 0; i < n_components; i++) {
-        if (components[i].pid > 0) {
-            kill(components[i].pid, SIGKILL);
-        }
-    }
+    /* Then the components, dependents before what they depend on, each
+     * given its stop_timeout; done once the last one has exited */
+    shutdown_components();
 
     /* Final safety net - PID 1 should never exit normally */
     emergency_shell();
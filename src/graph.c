@@ -7,6 +7,8 @@
 #include "component.h"
 #include "capability.h"
 #include "log.h"
+#include "metrics.h"
+#include "trace.h"
 #include <time.h>
 #include <signal.h>
 #include <sys/types.h>
@@ -14,199 +16,823 @@
 #include <string.h>
 #include <stdio.h>
 
-int graph_resolve(void) {
-    int changes = 0;
+/*
+ * Incremental resolution
+ *
+ * Components are re-evaluated only when something they care about changed:
+ * a capability they require flipped state (collected from the capability
+ * registry's change queue) or their own state changed. graph_resolve() is
+ * still the full single pass and graph_resolve_full() the full convergent
+ * sweep; the main loop uses graph_resolve_pending() on every event and runs
+ * the full sweep periodically as a consistency check.
+ */
 
+static int *dirty_queue = NULL;
+static unsigned char *dirty_flag = NULL;
+static int dirty_head = 0;
+static int n_dirty = 0;
+
+/* Per-component scheduler state, see "Boot scheduling" below */
+static int *boot_level = NULL;
+static int *boot_order = NULL;           /* component indices sorted by level */
+static unsigned char *boot_held = NULL;
+
+/* Capacity of the per-component arrays above; they follow the component
+ * table as it grows */
+static int graph_cap = 0;
+
+static int graph_grow(void) {
+    int cap = component_table_capacity();
+    if (cap <= graph_cap) return 0;
+
+    int *queue = malloc((size_t)cap * sizeof(int));
+    unsigned char *flag = calloc((size_t)cap, 1);
+    int *level = calloc((size_t)cap, sizeof(int));
+    int *order = calloc((size_t)cap, sizeof(int));
+    unsigned char *held = calloc((size_t)cap, 1);
+    if (!queue || !flag || !level || !order || !held) {
+        LOG_ERR("out of memory growing resolver state to %d components", cap);
+        free(queue);
+        free(flag);
+        free(level);
+        free(order);
+        free(held);
+        return -1;
+    }
+
+    /* Unroll the dirty ring so it starts at 0 in the new array */
+    for (int i = 0; i < n_dirty; i++) {
+        queue[i] = dirty_queue[(dirty_head + i) % graph_cap];
+    }
+    if (graph_cap > 0) {
+        memcpy(flag, dirty_flag, (size_t)graph_cap);
+        memcpy(level, boot_level, (size_t)graph_cap * sizeof(int));
+        memcpy(order, boot_order, (size_t)graph_cap * sizeof(int));
+        memcpy(held, boot_held, (size_t)graph_cap);
+    }
+    free(dirty_queue);
+    free(dirty_flag);
+    free(boot_level);
+    free(boot_order);
+    free(boot_held);
+
+    dirty_queue = queue;
+    dirty_flag = flag;
+    boot_level = level;
+    boot_order = order;
+    boot_held = held;
+    dirty_head = 0;
+    graph_cap = cap;
+    return 0;
+}
+
+void graph_mark_dirty(int idx) {
+    if (idx < 0 || idx >= n_components) {
+        return;
+    }
+    if (idx >= graph_cap && graph_grow() < 0) {
+        return;
+    }
+    if (dirty_flag[idx]) {
+        return;
+    }
+    dirty_flag[idx] = 1;
+    dirty_queue[(dirty_head + n_dirty) % graph_cap] = idx;
+    n_dirty++;
+}
+
+void graph_mark_all_dirty(void) {
     for (int i = 0; i < n_components; i++) {
-        component_t *comp = &components[i];
+        graph_mark_dirty(i);
+    }
+}
 
-        switch (comp->state) {
-        case COMP_INACTIVE:
-            if (requirements_met(comp)) {
-                if (component_start(i) == 0) {
-                    changes++;
-                }
-            }
-            break;
+static int dirty_pop(void) {
+    while (n_dirty > 0) {
+        int idx = dirty_queue[dirty_head];
+        dirty_head = (dirty_head + 1) % graph_cap;
+        n_dirty--;
+        dirty_flag[idx] = 0;
+        if (idx < n_components) {
+            return idx;
+        }
+    }
+    return -1;
+}
 
-        case COMP_READY_WAIT:
-            /* Check if dependencies were lost while waiting for readiness */
-            if (!requirements_met(comp)) {
-                LOG_WARN("component '%s' dependencies lost while waiting for readiness", comp->name);
-                comp->state = COMP_FAILED;
-                if (comp->pid > 0) {
-                    kill(comp->pid, SIGTERM);
-                }
-                changes++;
+/* Queue every component that requires a capability whose state changed */
+static void collect_capability_changes(void) {
+    int changed[64];
+    int n;
+
+    while ((n = capability_take_changes(changed, 64)) > 0) {
+        for (int c = 0; c < n; c++) {
+            int n_consumers;
+            const int *consumers = capability_consumers(changed[c], &n_consumers);
+            for (int i = 0; i < n_consumers; i++) {
+                graph_mark_dirty(consumers[i]);
             }
-            break;
+        }
+    }
+}
 
-        case COMP_ACTIVE:
-            /* Check if dependencies were lost */
-            if (!requirements_met(comp)) {
-                comp->state = COMP_FAILED;
-                for (int j = 0; j < comp->n_provides; j++) {
-                    capability_withdraw(comp->provides[j]);
-                }
-                changes++;
-            }
-            break;
+/* Boot scheduler hooks, see "Boot scheduling" below */
+static int boot_active = 0;
+static void boot_hold(int idx);
+static int boot_dispatch(void);
+static void boot_check_complete(void);
+
+/* An on-demand component that is not running and provides cap, or -1.
+ * Those providing it were recorded when the components were linked. */
+static int on_demand_provider(int cap) {
+    int n;
+    const int *providers = capability_on_demand(cap, &n);
+    for (int p = 0; p < n; p++) {
+        int j = providers[p];
+        if (j < n_components && (components[j].state == COMP_IDLE ||
+                                 components[j].state == COMP_INACTIVE)) {
+            return j;
+        }
+    }
+    return -1;
+}
 
-        case COMP_FAILED:
-            /* Try to restart failed components if their dependencies are now met */
-            if (requirements_met(comp)) {
-                /* Only restart if enough time has passed since last restart */
-                time_t now = time(NULL);
-                if (now - comp->last_restart >= 5) { /* 5 second minimum between restarts */
-                    LOG_INFO("attempting to restart failed component '%s'", comp->name);
-                    comp->state = COMP_INACTIVE; /* Will be started on next iteration */
-                    changes++;
-                }
+/* A component that would start but for capabilities on-demand components
+ * provide asks them to start. Only when all it lacks can be had that way:
+ * nothing is woken for a consumer that could not run anyway. */
+static void demand_providers(int i) {
+    component_t *comp = &components[i];
+    int wanted[MAX_DEPS];
+    int n_wanted = 0;
+
+    for (int r = 0; r < comp->n_requires; r++) {
+        int cap = comp->requires_id[r];
+        if (capability_active_by_idx(cap)) continue;
+        int provider = on_demand_provider(cap);
+        if (provider < 0) return;
+        wanted[n_wanted++] = provider;
+    }
+    for (int w = 0; w < n_wanted; w++) {
+        component_t *provider = &components[wanted[w]];
+        if (!provider->demanded) {
+            LOG_INFO("component '%s' needed by '%s'", provider->name, comp->name);
+            provider->demanded = 1;
+            graph_mark_dirty(wanted[w]);
+        }
+    }
+}
+
+/* Evaluate a single component against the current capability state.
+ * Returns 1 if its state changed, 0 otherwise. */
+static int resolve_component(int i) {
+    component_t *comp = &components[i];
+
+    switch (comp->state) {
+    case COMP_INACTIVE:
+        if (requirements_met(comp)) {
+            if (comp->on_demand && !comp->demanded) {
+                component_idle(i);
+                return 1;
             }
-            break;
+            if (boot_active) {
+                /* Forked by the boot scheduler along with its level */
+                boot_hold(i);
+                break;
+            }
+            if (component_start(i) == 0) {
+                return 1;
+            }
+        } else if (!comp->on_demand || comp->demanded) {
+            demand_providers(i);
+        }
+        break;
 
-        default:
+    case COMP_IDLE:
+        if (!requirements_met(comp)) {
+            component_withdraw_held_provides(i);
+            component_wake(i);
+            return 1;
+        }
+        if (comp->demanded || !comp->on_demand) {
+            component_wake(i);
+            return 1;
+        }
+        break;
+
+    case COMP_READY_WAIT:
+        /* Check if dependencies were lost while waiting for readiness */
+        if (!requirements_met(comp)) {
+            LOG_WARN("component '%s' dependencies lost while waiting for readiness", comp->name);
+            component_set_state(comp, COMP_FAILED);
+            component_withdraw_held_provides(i);
+            component_kill(i);
+            return 1;
+        }
+        break;
+
+    case COMP_ACTIVE:
+        /* Check if dependencies were lost */
+        if (!requirements_met(comp)) {
+            component_set_state(comp, COMP_FAILED);
+            component_withdraw_provides(i);
+            component_kill(i);
+            return 1;
+        }
+        break;
+
+    case COMP_FAILED:
+        /* One still stopping comes back here once it has been reaped */
+        if (comp->pid > 0) {
             break;
         }
+        /* Try to restart failed components if their dependencies are now met */
+        if (requirements_met(comp)) {
+            /* A new failure: count it and choose its backoff */
+            if (comp->restart_due_ms == 0 && component_schedule_restart(i) < 0) {
+                return 1;
+            }
+            uint64_t now = timer_now_ms();
+            if (now >= comp->restart_due_ms) {
+                LOG_INFO("attempting to restart failed component '%s'", comp->name);
+                comp->restart_due_ms = 0;
+                component_set_state(comp, COMP_INACTIVE); /* Will be started on next iteration */
+                return 1;
+            }
+            /* Come back when the delay is over */
+            component_arm_timer(i, TIMER_RESTART, comp->restart_due_ms - now);
+        } else {
+            component_withdraw_held_provides(i);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+int graph_resolve(void) {
+    int changes = 0;
+
+    component_link_all();
+
+    for (int i = 0; i < n_components; i++) {
+        changes += resolve_component(i);
     }
 
     return changes;
 }
 
-void graph_resolve_full(void) {
-    int iterations = 0;
-    int changes;
-
-    do {
-        changes = graph_resolve();
-        iterations++;
-        if (iterations > n_components * 2) {
-            LOG_ERR("graph resolution exceeded max iterations — possible cycle");
-            break;
+/* Resolve dirty components until nothing more changes. *steps counts
+ * how many were looked at. */
+static int resolve_dirty(int *steps) {
+    int changes = 0;
+    int max_steps = n_components * 8 + 8;
+    int idx;
+
+    component_link_all();
+    collect_capability_changes();
+
+    for (;;) {
+        while ((idx = dirty_pop()) >= 0) {
+            if (++*steps > max_steps) {
+                LOG_ERR("graph resolution exceeded max iterations — possible cycle");
+                return changes;
+            }
+            if (resolve_component(idx)) {
+                changes++;
+                /* A changed component may need another look (FAILED -> INACTIVE
+                 * -> start), and whatever it provided may have flipped */
+                graph_mark_dirty(idx);
+            }
+            collect_capability_changes();
         }
-    } while (changes > 0);
 
-    LOG_INFO("graph stable after %d iterations (%d components, %d capabilities)",
-             iterations, n_components, capability_count());
+        /* Fork whatever the boot scheduler has queued; anything that comes
+         * up immediately makes more components eligible */
+        int started = boot_active ? boot_dispatch() : 0;
+        if (started == 0) break;
+        changes += started;
+    }
+
+    if (boot_active) {
+        boot_check_complete();
+    }
+
+    return changes;
+}
+
+int graph_resolve_pending(void) {
+    uint64_t began = trace_now_us();
+    int steps = 0;
+    int changes = resolve_dirty(&steps);
+
+    /* Most rounds of the main loop have nothing to resolve; only passes
+     * that did something say how long resolving takes */
+    if (steps > 0 || changes > 0) {
+        metrics_observe(METRIC_RESOLVE_PENDING, trace_now_us() - began);
+    }
+    return changes;
+}
+
+void graph_resolve_full(void) {
+    uint64_t began = trace_now_us();
+    int steps = 0;
+    graph_mark_all_dirty();
+    int changes = resolve_dirty(&steps);
+    metrics_observe(METRIC_RESOLVE_FULL, trace_now_us() - began);
+
+    /* Quiet when the periodic consistency sweep finds nothing to do */
+    if (changes > 0) {
+        LOG_INFO("graph stable after %d changes (%d components, %d capabilities)",
+                 changes, n_components, capability_count());
+    }
 }
 
 /*
  * Cycle Detection and Graph Analysis Implementation
+ *
+ * The dependency graph is built in compressed sparse row form from the
+ * interned capability IDs: capability -> providers first, then for every
+ * component its providers (the components it depends on) and the reverse,
+ * its dependents. Building it and every walk below is O(components +
+ * edges), so validation on boot and reload stays linear as the graph grows.
  */
 
-/* Build adjacency list representing component dependencies */
-static int build_dependency_graph(int **adjacency_matrix) {
-    /* Allocate adjacency matrix */
-    *adjacency_matrix = calloc(n_components * n_components, sizeof(int));
-    if (!*adjacency_matrix) {
-        LOG_ERR("failed to allocate adjacency matrix");
+typedef struct {
+    int  n;          /* components */
+    int  n_edges;    /* distinct component -> provider pairs */
+    int *dep_row;    /* dependencies of i: dep[dep_row[i] .. dep_row[i + 1]) */
+    int *dep;
+    int *rdep_row;   /* dependents of i: rdep[rdep_row[i] .. rdep_row[i + 1]) */
+    int *rdep;
+} dep_graph_t;
+
+static void dep_graph_free(dep_graph_t *g) {
+    free(g->dep_row);
+    free(g->dep);
+    free(g->rdep_row);
+    free(g->rdep);
+    memset(g, 0, sizeof(*g));
+}
+
+/* Add (fill) or count (!fill) the distinct providers of each component's
+ * requirements; seen[] holds the last component a provider was added for */
+static int dep_graph_edges(dep_graph_t *g, const int *prov_row, const int *prov,
+                           int n_caps, int *seen, int fill) {
+    int e = 0;
+    for (int i = 0; i < g->n; i++) {
+        component_t *comp = &components[i];
+        if (fill) g->dep_row[i] = e;
+        for (int r = 0; r < comp->n_requires; r++) {
+            int cap = comp->requires_id[r];
+            if (cap < 0 || cap >= n_caps) continue;
+            for (int p = prov_row[cap]; p < prov_row[cap + 1]; p++) {
+                int j = prov[p];
+                if (seen[j] == i + 1) continue;
+                seen[j] = i + 1;
+                if (fill) g->dep[e] = j;
+                e++;
+            }
+        }
+    }
+    if (fill) g->dep_row[g->n] = e;
+    return e;
+}
+
+static int dep_graph_build(dep_graph_t *g) {
+    memset(g, 0, sizeof(*g));
+    g->n = n_components;
+    component_link_all();
+
+    int n = g->n;
+    int n_caps = capability_count();
+    int *prov_row = calloc((size_t)n_caps + 1, sizeof(int));
+    int *fill = calloc((size_t)n_caps + 1, sizeof(int));
+    int *seen = calloc((size_t)n + 1, sizeof(int));
+    int n_prov = 0;
+    for (int i = 0; i < n; i++) n_prov += components[i].n_provides;
+    int *prov = malloc((size_t)(n_prov > 0 ? n_prov : 1) * sizeof(int));
+    g->dep_row = malloc(((size_t)n + 1) * sizeof(int));
+    g->rdep_row = calloc((size_t)n + 1, sizeof(int));
+    if (!prov_row || !fill || !seen || !prov || !g->dep_row || !g->rdep_row) goto oom;
+
+    /* Providers of every capability */
+    for (int i = 0; i < n; i++) {
+        for (int k = 0; k < components[i].n_provides; k++) {
+            int cap = components[i].provides_id[k];
+            if (cap >= 0 && cap < n_caps) prov_row[cap + 1]++;
+        }
+    }
+    for (int c = 0; c < n_caps; c++) prov_row[c + 1] += prov_row[c];
+    for (int i = 0; i < n; i++) {
+        for (int k = 0; k < components[i].n_provides; k++) {
+            int cap = components[i].provides_id[k];
+            if (cap >= 0 && cap < n_caps) prov[prov_row[cap] + fill[cap]++] = i;
+        }
+    }
+
+    /* Count, then fill, the component -> provider edges */
+    g->n_edges = dep_graph_edges(g, prov_row, prov, n_caps, seen, 0);
+    g->dep = malloc((size_t)(g->n_edges > 0 ? g->n_edges : 1) * sizeof(int));
+    g->rdep = malloc((size_t)(g->n_edges > 0 ? g->n_edges : 1) * sizeof(int));
+    if (!g->dep || !g->rdep) goto oom;
+    memset(seen, 0, ((size_t)n + 1) * sizeof(int));
+    dep_graph_edges(g, prov_row, prov, n_caps, seen, 1);
+
+    /* Reverse edges: who depends on each component */
+    for (int e = 0; e < g->n_edges; e++) g->rdep_row[g->dep[e] + 1]++;
+    for (int i = 0; i < n; i++) g->rdep_row[i + 1] += g->rdep_row[i];
+    memset(seen, 0, ((size_t)n + 1) * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        for (int e = g->dep_row[i]; e < g->dep_row[i + 1]; e++) {
+            int j = g->dep[e];
+            g->rdep[g->rdep_row[j] + seen[j]++] = i;
+        }
+    }
+
+    free(prov_row);
+    free(fill);
+    free(prov);
+    free(seen);
+    return 0;
+
+oom:
+    LOG_ERR("failed to allocate dependency graph for %d components", n);
+    free(prov_row);
+    free(fill);
+    free(prov);
+    free(seen);
+    dep_graph_free(g);
+    return -1;
+}
+
+/* Tarjan's strongly connected components, without recursion so deep
+ * chains cannot overflow PID 1's stack. scc[i] receives the component's
+ * SCC number; SCCs are numbered dependencies first (an edge never leads
+ * to a higher number). Returns the number of SCCs or -1. */
+static int dep_graph_scc(const dep_graph_t *g, int *scc) {
+    int n = g->n;
+    if (n == 0) return 0;
+
+    int *index = malloc((size_t)n * sizeof(int));
+    int *low = malloc((size_t)n * sizeof(int));
+    int *stack = malloc((size_t)n * sizeof(int));
+    int *call = malloc((size_t)n * sizeof(int));       /* DFS path */
+    int *next = malloc((size_t)n * sizeof(int));       /* next edge to follow */
+    unsigned char *on_stack = calloc((size_t)n, 1);
+    if (!index || !low || !stack || !call || !next || !on_stack) {
+        LOG_ERR("failed to allocate memory for SCC detection");
+        free(index); free(low); free(stack); free(call); free(next); free(on_stack);
         return -1;
     }
 
-    /* For each component, find which other components it depends on */
+    for (int i = 0; i < n; i++) index[i] = -1;
+    int counter = 0, sp = 0, n_scc = 0;
+
+    for (int root = 0; root < n; root++) {
+        if (index[root] >= 0) continue;
+
+        int depth = 0;
+        call[depth] = root;
+        next[root] = g->dep_row[root];
+        index[root] = low[root] = counter++;
+        stack[sp++] = root;
+        on_stack[root] = 1;
+
+        while (depth >= 0) {
+            int v = call[depth];
+            if (next[v] < g->dep_row[v + 1]) {
+                int w = g->dep[next[v]++];
+                if (index[w] < 0) {
+                    index[w] = low[w] = counter++;
+                    stack[sp++] = w;
+                    on_stack[w] = 1;
+                    next[w] = g->dep_row[w];
+                    call[++depth] = w;
+                } else if (on_stack[w] && index[w] < low[v]) {
+                    low[v] = index[w];
+                }
+                continue;
+            }
+
+            /* All of v's edges done: pop an SCC if v is its root */
+            if (low[v] == index[v]) {
+                int w;
+                do {
+                    w = stack[--sp];
+                    on_stack[w] = 0;
+                    scc[w] = n_scc;
+                } while (w != v);
+                n_scc++;
+            }
+            depth--;
+            if (depth >= 0 && low[v] < low[call[depth]]) {
+                low[call[depth]] = low[v];
+            }
+        }
+    }
+
+    free(index); free(low); free(stack); free(call); free(next); free(on_stack);
+    return n_scc;
+}
+
+/* Whether component i is on a cycle: it depends on a component of its
+ * own SCC, which is either another one or (requiring what it provides)
+ * itself */
+static int dep_graph_on_cycle(const dep_graph_t *g, const int *scc, int i) {
+    for (int e = g->dep_row[i]; e < g->dep_row[i + 1]; e++) {
+        if (scc[g->dep[e]] == scc[i]) return 1;
+    }
+    return 0;
+}
+
+/* Write one cycle through start (which is on one) into cycle_info:
+ * breadth-first within its SCC for the shortest way back to start */
+static int dep_graph_cycle(const dep_graph_t *g, const int *scc, int start,
+                           cycle_info_t *cycle_info) {
+    int n = g->n;
+    int *parent = malloc((size_t)n * sizeof(int));
+    int *queue = malloc((size_t)n * sizeof(int));
+    cycle_info->cycle_components = malloc(((size_t)n + 1) * sizeof(int));
+    if (!parent || !queue || !cycle_info->cycle_components) {
+        free(parent);
+        free(queue);
+        free(cycle_info->cycle_components);
+        cycle_info->cycle_components = NULL;
+        return -1;
+    }
+
+    for (int i = 0; i < n; i++) parent[i] = -2;
+    int head = 0, tail = 0, last = -1;
+    queue[tail++] = start;
+    parent[start] = -1;
+    while (head < tail && last < 0) {
+        int v = queue[head++];
+        for (int e = g->dep_row[v]; e < g->dep_row[v + 1]; e++) {
+            int w = g->dep[e];
+            if (w == start) {
+                last = v;
+                break;
+            }
+            if (scc[w] == scc[start] && parent[w] == -2) {
+                parent[w] = v;
+                queue[tail++] = w;
+            }
+        }
+    }
+
+    /* start -> ... -> last -> start, collected backwards */
+    int len = 0;
+    for (int v = last; v >= 0; v = parent[v]) queue[len++] = v;
+    cycle_info->cycle_length = 0;
+    for (int k = len - 1; k >= 0; k--) {
+        cycle_info->cycle_components[cycle_info->cycle_length++] = queue[k];
+    }
+    cycle_info->cycle_components[cycle_info->cycle_length++] = start;
+
+    LOG_WARN("cycle detected involving component %s -> %s",
+             components[last].name, components[start].name);
+
+    /* Build human-readable error message */
+    char *msg = cycle_info->error_message;
+    size_t size = sizeof(cycle_info->error_message);
+    snprintf(msg, size, "Dependency cycle detected: ");
+    for (int k = 0; k < cycle_info->cycle_length; k++) {
+        if (k > 0) strncat(msg, " -> ", size - strlen(msg) - 1);
+        strncat(msg, components[cycle_info->cycle_components[k]].name, size - strlen(msg) - 1);
+    }
+
+    free(parent);
+    free(queue);
+    return 0;
+}
+
+/*
+ * Cached analysis
+ *
+ * The CSR graph, its SCCs and the transitive closure in both directions
+ * are computed once and kept until the graph changes, so cycle checks,
+ * boot levels, metrics and the control socket's tree/rdeps/path/scc
+ * queries all answer from the same snapshot instead of rescanning the
+ * component table. The snapshot is keyed on a fingerprint of the
+ * registry generation and every component's requires/provides IDs;
+ * anything that changes an edge changes the fingerprint, so callers
+ * never have to invalidate it by hand.
+ */
+
+typedef struct {
+    int          built;
+    uint64_t     key;          /* fingerprint of the graph it describes */
+    unsigned int version;      /* bumped on every rebuild */
+    dep_graph_t  g;
+    int         *scc;          /* SCC number of each component */
+    int          n_scc;
+    int         *depth;        /* per SCC: longest dependency chain below it */
+    int         *cycle;        /* cycle number of each component, -1 if none */
+    int          n_cycles;
+    int          words;        /* uint64_t words per reachability row */
+    uint64_t    *reach;        /* per SCC: components it depends on */
+    uint64_t    *rreach;       /* per SCC: components depending on it */
+} graph_analysis_t;
+
+static graph_analysis_t analysis;
+
+#define BIT_SET(row, i)  ((row)[(i) >> 6] |= 1ULL << ((i) & 63))
+#define BIT_TEST(row, i) (((row)[(i) >> 6] >> ((i) & 63)) & 1)
+
+static uint64_t analysis_fingerprint(void) {
+    /* FNV-1a over everything an edge is derived from */
+    uint64_t h = 1469598103934665603ULL;
+#define MIX(v) (h = (h ^ (uint64_t)(unsigned int)(v)) * 1099511628211ULL)
+    MIX(n_components);
+    MIX(capability_generation());
     for (int i = 0; i < n_components; i++) {
         component_t *comp = &components[i];
+        MIX(comp->n_requires);
+        for (int r = 0; r < comp->n_requires; r++) MIX(comp->requires_id[r]);
+        MIX(comp->n_provides);
+        for (int p = 0; p < comp->n_provides; p++) MIX(comp->provides_id[p]);
+    }
+#undef MIX
+    return h;
+}
+
+static void analysis_free(void) {
+    dep_graph_free(&analysis.g);
+    free(analysis.scc);
+    free(analysis.depth);
+    free(analysis.cycle);
+    free(analysis.reach);
+    free(analysis.rreach);
+    analysis.scc = analysis.depth = analysis.cycle = NULL;
+    analysis.reach = analysis.rreach = NULL;
+    analysis.n_scc = analysis.n_cycles = analysis.words = 0;
+    analysis.built = 0;
+}
+
+static int analysis_build(uint64_t key) {
+    analysis_free();
+    if (dep_graph_build(&analysis.g) < 0) return -1;
+
+    const dep_graph_t *g = &analysis.g;
+    int n = g->n;
+    int words = (n + 63) / 64;
+    size_t rows = (size_t)(n > 0 ? n : 1);
+    analysis.scc = malloc(rows * sizeof(int));
+    analysis.depth = calloc(rows, sizeof(int));
+    analysis.cycle = malloc(rows * sizeof(int));
+    analysis.reach = calloc(rows * (size_t)(words > 0 ? words : 1), sizeof(uint64_t));
+    analysis.rreach = calloc(rows * (size_t)(words > 0 ? words : 1), sizeof(uint64_t));
+    int *pos = calloc(rows + 1, sizeof(int));
+    int *order = malloc(rows * sizeof(int));
+    int *cyclic = malloc(rows * sizeof(int));          /* per SCC: cycle number or -1 */
+    if (!analysis.scc || !analysis.depth || !analysis.cycle || !analysis.reach ||
+        !analysis.rreach || !pos || !order || !cyclic) {
+        LOG_ERR("failed to allocate graph analysis for %d components", n);
+        goto fail;
+    }
 
-        /* Check each required capability */
-        for (int req_idx = 0; req_idx < comp->n_requires; req_idx++) {
-            const char *required_cap = comp->requires[req_idx];
-
-            /* Find which component provides this capability by iterating through all components */
-            for (int j = 0; j < n_components; j++) {
-                component_t *provider = &components[j];
-
-                /* Check if component j provides the required capability */
-                for (int prov_idx = 0; prov_idx < provider->n_provides; prov_idx++) {
-                    if (strcmp(provider->provides[prov_idx], required_cap) == 0) {
-                        /* Component i depends on component j */
-                        (*adjacency_matrix)[i * n_components + j] = 1;
-                        /* LOG_INFO("dependency detected: %s -> %s (via capability %s)",
-                                comp->name, provider->name, required_cap); */
-                        break;
-                    }
+    int n_scc = dep_graph_scc(g, analysis.scc);
+    if (n_scc < 0) goto fail;
+    const int *scc = analysis.scc;
+    analysis.n_scc = n_scc;
+    analysis.words = words;
+
+    /* Components grouped by SCC number, dependencies first */
+    for (int i = 0; i < n; i++) pos[scc[i] + 1]++;
+    for (int s = 0; s < n_scc; s++) pos[s + 1] += pos[s];
+    for (int i = 0; i < n; i++) order[pos[scc[i]]++] = i;
+    /* pos[s] is now where SCC s + 1 starts */
+
+    for (int s = 0; s < n_scc; s++) cyclic[s] = -1;
+    for (int i = 0; i < n; i++) {
+        if (cyclic[scc[i]] < 0 && dep_graph_on_cycle(g, scc, i)) {
+            cyclic[scc[i]] = analysis.n_cycles++;
+        }
+    }
+    for (int i = 0; i < n; i++) analysis.cycle[i] = cyclic[scc[i]];
+
+    /* Dependencies: every edge leads to an SCC whose row is already final.
+     * Members of a cycle reach each other, and themselves. */
+    for (int s = 0, k = 0; s < n_scc; s++) {
+        uint64_t *row = &analysis.reach[(size_t)s * words];
+        for (; k < pos[s]; k++) {
+            int v = order[k];
+            if (cyclic[s] >= 0) BIT_SET(row, v);
+            for (int e = g->dep_row[v]; e < g->dep_row[v + 1]; e++) {
+                int w = g->dep[e];
+                int t = scc[w];
+                if (t == s) continue;
+                BIT_SET(row, w);
+                const uint64_t *sub = &analysis.reach[(size_t)t * words];
+                for (int x = 0; x < words; x++) row[x] |= sub[x];
+                if (analysis.depth[t] + 1 > analysis.depth[s]) {
+                    analysis.depth[s] = analysis.depth[t] + 1;
                 }
             }
         }
     }
 
-    /* Debug: log the dependency matrix */
-    /* LOG_INFO("dependency matrix for %d components:", n_components);
-    for (int i = 0; i < n_components; i++) {
-        for (int j = 0; j < n_components; j++) {
-            if ((*adjacency_matrix)[i * n_components + j]) {
-                LOG_INFO("  %s depends on %s", components[i].name, components[j].name);
+    /* Dependents, the same way from the other end */
+    for (int s = n_scc - 1; s >= 0; s--) {
+        uint64_t *row = &analysis.rreach[(size_t)s * words];
+        for (int k = s > 0 ? pos[s - 1] : 0; k < pos[s]; k++) {
+            int v = order[k];
+            if (cyclic[s] >= 0) BIT_SET(row, v);
+            for (int e = g->rdep_row[v]; e < g->rdep_row[v + 1]; e++) {
+                int u = g->rdep[e];
+                int t = scc[u];
+                if (t == s) continue;
+                BIT_SET(row, u);
+                const uint64_t *sub = &analysis.rreach[(size_t)t * words];
+                for (int x = 0; x < words; x++) row[x] |= sub[x];
             }
         }
-    } */
+    }
 
+    free(pos);
+    free(order);
+    free(cyclic);
+    analysis.key = key;
+    analysis.version++;
+    analysis.built = 1;
     return 0;
+
+fail:
+    free(pos);
+    free(order);
+    free(cyclic);
+    analysis_free();
+    return -1;
 }
 
-/* DFS helper for cycle detection */
-static int dfs_cycle_detect(int component_idx, dfs_color_t *colors, int *parent,
-                           int *adjacency_matrix, cycle_info_t *cycle_info,
-                           int *path, int path_len) {
-    colors[component_idx] = DFS_GRAY;
-    path[path_len] = component_idx;
-    path_len++;
-
-    /* Explore all adjacent components (dependencies) */
-    for (int j = 0; j < n_components; j++) {
-        if (adjacency_matrix[component_idx * n_components + j]) {
-            if (colors[j] == DFS_GRAY) {
-                /* Back edge found - cycle detected! */
-                LOG_WARN("cycle detected involving component %s -> %s",
-                        components[component_idx].name, components[j].name);
-
-                /* Build cycle information */
-                cycle_info->cycle_length = 0;
-                cycle_info->cycle_components = malloc(n_components * sizeof(int));
-
-                /* Extract the cycle from the path */
-                int cycle_start = -1;
-                for (int k = 0; k < path_len; k++) {
-                    if (path[k] == j) {
-                        cycle_start = k;
-                        break;
-                    }
-                }
+/* The analysis of the current graph, rebuilt first if it changed */
+static const graph_analysis_t *analysis_get(void) {
+    component_link_all();
+    uint64_t key = analysis_fingerprint();
+    if (analysis.built && analysis.key == key) return &analysis;
+    return analysis_build(key) < 0 ? NULL : &analysis;
+}
 
-                if (cycle_start >= 0) {
-                    for (int k = cycle_start; k < path_len; k++) {
-                        cycle_info->cycle_components[cycle_info->cycle_length++] = path[k];
-                    }
-
-                    /* Add the closing component to complete the cycle */
-                    cycle_info->cycle_components[cycle_info->cycle_length++] = j;
-
-                    /* Build human-readable error message */
-                    snprintf(cycle_info->error_message, sizeof(cycle_info->error_message),
-                            "Dependency cycle detected: ");
-                    for (int k = 0; k < cycle_info->cycle_length - 1; k++) {
-                        int comp_idx = cycle_info->cycle_components[k];
-                        strncat(cycle_info->error_message, components[comp_idx].name,
-                               sizeof(cycle_info->error_message) - strlen(cycle_info->error_message) - 1);
-                        strncat(cycle_info->error_message, " -> ",
-                               sizeof(cycle_info->error_message) - strlen(cycle_info->error_message) - 1);
-                    }
-                    int last_idx = cycle_info->cycle_components[cycle_info->cycle_length - 1];
-                    strncat(cycle_info->error_message, components[last_idx].name,
-                           sizeof(cycle_info->error_message) - strlen(cycle_info->error_message) - 1);
-                }
+unsigned int graph_analysis_version(void) {
+    return analysis_get() ? analysis.version : 0;
+}
 
-                return 1; /* Cycle found */
-            } else if (colors[j] == DFS_WHITE) {
-                parent[j] = component_idx;
-                if (dfs_cycle_detect(j, colors, parent, adjacency_matrix,
-                                   cycle_info, path, path_len) == 1) {
-                    return 1; /* Cycle found in recursive call */
-                }
-            }
+static int analysis_valid(const graph_analysis_t *a, int idx) {
+    return a && idx >= 0 && idx < a->g.n;
+}
+
+int graph_depends_on(int a, int b) {
+    const graph_analysis_t *an = analysis_get();
+    if (!analysis_valid(an, a) || !analysis_valid(an, b)) return -1;
+    return (int)BIT_TEST(&an->reach[(size_t)an->scc[a] * an->words], b);
+}
+
+/* Component indices set in a reachability row; a component is in its
+ * own row only when it is on a cycle */
+static int analysis_row(const graph_analysis_t *an, const uint64_t *row, int *out, int max) {
+    int count = 0;
+    for (int x = 0; x < an->words; x++) {
+        for (uint64_t bits = row[x]; bits; bits &= bits - 1) {
+            if (count < max && out) out[count] = x * 64 + __builtin_ctzll(bits);
+            count++;
         }
     }
+    return count;
+}
 
-    colors[component_idx] = DFS_BLACK;
-    return 0; /* No cycle found */
+int graph_dependencies(int idx, int *out, int max) {
+    const graph_analysis_t *an = analysis_get();
+    if (!analysis_valid(an, idx)) return -1;
+    return analysis_row(an, &an->reach[(size_t)an->scc[idx] * an->words], out, max);
+}
+
+int graph_dependents(int idx, int *out, int max) {
+    const graph_analysis_t *an = analysis_get();
+    if (!analysis_valid(an, idx)) return -1;
+    return analysis_row(an, &an->rreach[(size_t)an->scc[idx] * an->words], out, max);
+}
+
+int graph_direct_dependencies(int idx, const int **deps) {
+    const graph_analysis_t *an = analysis_get();
+    if (!analysis_valid(an, idx)) return -1;
+    *deps = &an->g.dep[an->g.dep_row[idx]];
+    return an->g.dep_row[idx + 1] - an->g.dep_row[idx];
+}
+
+int graph_direct_dependents(int idx, const int **dependents) {
+    const graph_analysis_t *an = analysis_get();
+    if (!analysis_valid(an, idx)) return -1;
+    *dependents = &an->g.rdep[an->g.rdep_row[idx]];
+    return an->g.rdep_row[idx + 1] - an->g.rdep_row[idx];
+}
+
+int graph_cycle_of(int idx) {
+    const graph_analysis_t *an = analysis_get();
+    if (!analysis_valid(an, idx)) return -1;
+    return an->cycle[idx];
 }
 
 int graph_detect_cycles(cycle_info_t *cycle_info) {
@@ -224,54 +850,45 @@ int graph_detect_cycles(cycle_info_t *cycle_info) {
         return 0; /* No components, no cycles */
     }
 
-    /* Build dependency graph */
-    int *adjacency_matrix = NULL;
-    if (build_dependency_graph(&adjacency_matrix) < 0) {
+    const graph_analysis_t *an = analysis_get();
+    if (!an) {
         return -1;
     }
 
-    /* Initialize DFS state */
-    dfs_color_t *colors = calloc(n_components, sizeof(dfs_color_t));
-    int *parent = calloc(n_components, sizeof(int));
-    int *path = malloc(n_components * sizeof(int));
+    for (int i = 0; i < an->g.n; i++) {
+        if (an->cycle[i] >= 0) {
+            return dep_graph_cycle(&an->g, an->scc, i, cycle_info) < 0 ? -1 : 1;
+        }
+    }
+    return 0;
+}
 
-    if (!colors || !parent || !path) {
-        LOG_ERR("failed to allocate memory for cycle detection");
-        free(adjacency_matrix);
-        free(colors);
-        free(parent);
-        free(path);
+/* Kahn's algorithm: providers before the components that require them.
+ * Returns how many components could be ordered (fewer than all on cycles). */
+static int dep_graph_toposort(const dep_graph_t *g, int *sorted) {
+    int n = g->n;
+    int *remaining = malloc((size_t)(n > 0 ? n : 1) * sizeof(int));
+    if (!remaining) {
+        LOG_ERR("failed to allocate memory for topological sort");
         return -1;
     }
 
-    /* Initialize all components as unvisited */
-    for (int i = 0; i < n_components; i++) {
-        colors[i] = DFS_WHITE;
-        parent[i] = -1;
+    /* sorted[] doubles as the queue: everything before tail is ordered */
+    int head = 0, tail = 0;
+    for (int i = 0; i < n; i++) {
+        remaining[i] = g->dep_row[i + 1] - g->dep_row[i];
+        if (remaining[i] == 0) sorted[tail++] = i;
     }
-
-    /* Run DFS from each unvisited component */
-    for (int i = 0; i < n_components; i++) {
-        if (colors[i] == DFS_WHITE) {
-            if (dfs_cycle_detect(i, colors, parent, adjacency_matrix,
-                               cycle_info, path, 0) == 1) {
-                /* Cycle found */
-                free(adjacency_matrix);
-                free(colors);
-                free(parent);
-                free(path);
-                return 1;
-            }
+    while (head < tail) {
+        int v = sorted[head++];
+        for (int e = g->rdep_row[v]; e < g->rdep_row[v + 1]; e++) {
+            int w = g->rdep[e];
+            if (--remaining[w] == 0) sorted[tail++] = w;
         }
     }
 
-    /* Cleanup */
-    free(adjacency_matrix);
-    free(colors);
-    free(parent);
-    free(path);
-
-    return 0; /* No cycles found */
+    free(remaining);
+    return tail;
 }
 
 int graph_topological_sort(int *sorted_components, int max_components) {
@@ -286,84 +903,25 @@ int graph_topological_sort(int *sorted_components, int max_components) {
         return -1;
     }
 
-    /* First check for cycles */
-    cycle_info_t cycle_info;
-    if (graph_detect_cycles(&cycle_info) == 1) {
-        LOG_ERR("cannot perform topological sort: graph contains cycles");
-        free(cycle_info.cycle_components);
+    const graph_analysis_t *an = analysis_get();
+    if (!an) {
         return -1;
     }
+    int sorted_count = dep_graph_toposort(&an->g, sorted_components);
 
-    /* Build dependency graph */
-    int *adjacency_matrix = NULL;
-    if (build_dependency_graph(&adjacency_matrix) < 0) {
+    if (sorted_count < 0) {
         return -1;
     }
-
-    /* Calculate in-degrees */
-    int *in_degree = calloc(n_components, sizeof(int));
-    if (!in_degree) {
-        LOG_ERR("failed to allocate memory for in-degree calculation");
-        free(adjacency_matrix);
-        return -1;
-    }
-
-    for (int i = 0; i < n_components; i++) {
-        for (int j = 0; j < n_components; j++) {
-            if (adjacency_matrix[i * n_components + j]) {
-                in_degree[j]++;
-            }
-        }
-    }
-
-    /* Kahn's algorithm for topological sorting */
-    int *queue = malloc(n_components * sizeof(int));
-    int queue_front = 0, queue_rear = 0;
-    int sorted_count = 0;
-
-    if (!queue) {
-        LOG_ERR("failed to allocate memory for topological sort");
-        free(adjacency_matrix);
-        free(in_degree);
-        return -1;
-    }
-
-    /* Add all components with in-degree 0 to queue */
-    for (int i = 0; i < n_components; i++) {
-        if (in_degree[i] == 0) {
-            queue[queue_rear++] = i;
-        }
-    }
-
-    /* Process queue */
-    while (queue_front < queue_rear) {
-        int current = queue[queue_front++];
-        sorted_components[sorted_count++] = current;
-
-        /* Update in-degrees of adjacent components */
-        for (int j = 0; j < n_components; j++) {
-            if (adjacency_matrix[current * n_components + j]) {
-                in_degree[j]--;
-                if (in_degree[j] == 0) {
-                    queue[queue_rear++] = j;
-                }
-            }
-        }
-    }
-
-    free(adjacency_matrix);
-    free(in_degree);
-    free(queue);
-
     if (sorted_count != n_components) {
-        LOG_ERR("topological sort failed: only sorted %d out of %d components",
-                sorted_count, n_components);
+        LOG_ERR("cannot perform topological sort: graph contains cycles "
+                "(%d of %d components ordered)", sorted_count, n_components);
         return -1;
     }
 
     return 0; /* Success */
 }
 
+
 int graph_validate_component_addition(const char *component_name) {
     /* For now, validate by checking if the current graph has cycles.
      * TODO: In a complete implementation, we would temporarily add the
@@ -397,7 +955,6 @@ int graph_validate_component_addition(const char *component_name) {
 }
 
 int graph_find_strongly_connected_components(int **scc_components, int *scc_count) {
-    /* Placeholder for Tarjan's or Kosaraju's SCC algorithm */
     if (!scc_components || !scc_count) {
         return -1;
     }
@@ -405,22 +962,122 @@ int graph_find_strongly_connected_components(int **scc_components, int *scc_coun
     *scc_count = 0;
     *scc_components = NULL;
 
-    LOG_INFO("strongly connected component detection not yet implemented");
+    const graph_analysis_t *an = analysis_get();
+    if (!an) {
+        return -1;
+    }
+    if (an->g.n == 0) {
+        return 0;
+    }
+
+    *scc_components = malloc((size_t)an->g.n * sizeof(int));
+    if (!*scc_components) {
+        LOG_ERR("failed to allocate SCC result");
+        return -1;
+    }
+    memcpy(*scc_components, an->cycle, (size_t)an->g.n * sizeof(int));
+    *scc_count = an->n_cycles;
     return 0;
 }
 
+static int provides_cap(const component_t *comp, int cap) {
+    for (int p = 0; p < comp->n_provides; p++) {
+        if (comp->provides_id[p] == cap) return 1;
+    }
+    return 0;
+}
+
+/* The first of v's requirements that w provides, for labelling an edge */
+static int edge_capability(int v, int w) {
+    for (int r = 0; r < components[v].n_requires; r++) {
+        int cap = components[v].requires_id[r];
+        if (cap >= 0 && provides_cap(&components[w], cap)) return cap;
+    }
+    return -1;
+}
+
 int graph_find_dependency_path(const char *from_capability, const char *to_capability,
                                char *path_description, int max_description_len) {
-    /* Placeholder for dependency path finding using BFS */
-    if (!from_capability || !to_capability || !path_description) {
+    if (!from_capability || !to_capability || !path_description || max_description_len <= 0) {
         return -1;
     }
+    path_description[0] = '\0';
 
-    snprintf(path_description, max_description_len,
-            "Dependency path finding from '%s' to '%s' not yet implemented",
-            from_capability, to_capability);
+    const graph_analysis_t *an = analysis_get();
+    int from_cap = capability_index(from_capability);
+    int to_cap = capability_index(to_capability);
+    if (!an || from_cap < 0 || to_cap < 0) {
+        return -1;
+    }
 
-    return 0;
+    const dep_graph_t *g = &an->g;
+    int n = g->n;
+    int *parent = malloc((size_t)(n > 0 ? n : 1) * sizeof(int));
+    int *queue = malloc((size_t)(n > 0 ? n : 1) * sizeof(int));
+    unsigned char *target = calloc((size_t)(n > 0 ? n : 1), 1);
+    if (!parent || !queue || !target) {
+        LOG_ERR("failed to allocate memory for dependency path");
+        free(parent); free(queue); free(target);
+        return -1;
+    }
+
+    /* Breadth-first from every provider of from_capability to the nearest
+     * provider of to_capability, unless the closure already says no */
+    int head = 0, tail = 0, found = -1, reachable = 0;
+    for (int i = 0; i < n; i++) {
+        parent[i] = -2;
+        target[i] = (unsigned char)provides_cap(&components[i], to_cap);
+    }
+    for (int i = 0; i < n; i++) {
+        if (!provides_cap(&components[i], from_cap)) continue;
+        parent[i] = -1;
+        queue[tail++] = i;
+        if (target[i] && found < 0) found = i;
+        const uint64_t *row = &an->reach[(size_t)an->scc[i] * an->words];
+        for (int t = 0; t < n && !reachable; t++) {
+            reachable = target[t] && BIT_TEST(row, t);
+        }
+    }
+    while (found < 0 && reachable && head < tail) {
+        int v = queue[head++];
+        for (int e = g->dep_row[v]; e < g->dep_row[v + 1] && found < 0; e++) {
+            int w = g->dep[e];
+            if (parent[w] != -2) continue;
+            parent[w] = v;
+            queue[tail++] = w;
+            if (target[w]) found = w;
+        }
+    }
+
+    int result = -1;
+    if (found >= 0) {
+        /* Collect found -> ... -> source backwards, then print forwards */
+        int len = 0;
+        for (int v = found; v >= 0; v = parent[v]) queue[len++] = v;
+
+        char *desc = path_description;
+        size_t size = (size_t)max_description_len;
+        size_t used = 0;
+        int last_cap = from_cap;
+        for (int k = len - 1; k >= 0; k--) {
+            int v = queue[k];
+            if (k < len - 1) last_cap = edge_capability(queue[k + 1], v);
+            const char *cap = last_cap >= 0 ? capability_name(last_cap) : "?";
+            int w = snprintf(desc + used, size - used, "%s%s [%s]",
+                             k < len - 1 ? " -> " : "", cap, components[v].name);
+            if (w < 0 || (size_t)w >= size - used) break;
+            used += (size_t)w;
+        }
+        if (last_cap != to_cap && used < size) {
+            snprintf(desc + used, size - used, " (also provides %s)", to_capability);
+        }
+        result = 0;
+    }
+
+    free(parent);
+    free(queue);
+    free(target);
+    return result;
 }
 
 int graph_analyze_metrics(graph_metrics_t *metrics) {
@@ -444,9 +1101,216 @@ int graph_analyze_metrics(graph_metrics_t *metrics) {
     metrics->average_dependencies_per_component =
         n_components > 0 ? (double)total_dependencies / n_components : 0.0;
 
-    /* TODO: Implement max_dependency_depth and strongly_connected_components */
-    metrics->max_dependency_depth = 0;
-    metrics->strongly_connected_components = 0;
+    if (n_components == 0) {
+        return 0;
+    }
 
+    const graph_analysis_t *an = analysis_get();
+    if (!an) {
+        return -1;
+    }
+    for (int s = 0; s < an->n_scc; s++) {
+        if (an->depth[s] > metrics->max_dependency_depth) {
+            metrics->max_dependency_depth = an->depth[s];
+        }
+    }
+    metrics->strongly_connected_components = an->n_cycles;
     return 0;
-}
\ No newline at end of file
+}
+
+/*
+ * Boot scheduling
+ *
+ * On cold boot components are grouped into dependency levels computed from
+ * graph_topological_sort(): level 0 depends on nothing inside the graph,
+ * level n on something at level n - 1. Components whose requirements are
+ * met are held rather than started one at a time as the resolver happens
+ * to reach them, and then forked together in level order, bounded by a cap
+ * on how many may be starting (STARTING/READY_WAIT) at once. A component
+ * becomes eligible as soon as the capabilities it requires register, so
+ * boot time follows the critical path rather than the component count.
+ * Once everything has settled the scheduler switches off and restarts go
+ * through the normal resolver path.
+ */
+
+static int boot_n_held = 0;
+static int boot_n_components = 0;
+static int boot_n_levels = 0;
+static int boot_max_parallel = 0;        /* 0 = unlimited */
+static time_t boot_started = 0;
+
+int graph_compute_levels(int *levels) {
+    const graph_analysis_t *an = analysis_get();
+    if (!an) {
+        return -1;
+    }
+    const dep_graph_t *g = &an->g;
+    int *sorted = malloc((size_t)(g->n > 0 ? g->n : 1) * sizeof(int));
+    int n_sorted = sorted ? dep_graph_toposort(g, sorted) : -1;
+    if (n_sorted != g->n) {
+        if (n_sorted >= 0) LOG_ERR("cannot compute dependency levels: graph contains cycles");
+        free(sorted);
+        return -1;
+    }
+
+    /* Providers come first in topological order, so each component's level
+     * is final by the time its dependents look at it */
+    int n_levels = 0;
+    for (int s = 0; s < g->n; s++) {
+        int i = sorted[s];
+        levels[i] = 0;
+        for (int e = g->dep_row[i]; e < g->dep_row[i + 1]; e++) {
+            int j = g->dep[e];
+            if (levels[j] + 1 > levels[i]) {
+                levels[i] = levels[j] + 1;
+            }
+        }
+        if (levels[i] + 1 > n_levels) {
+            n_levels = levels[i] + 1;
+        }
+    }
+
+    free(sorted);
+    return n_levels;
+}
+
+int graph_boot_begin(int max_parallel) {
+    if (graph_grow() < 0) {
+        boot_active = 0;
+        return -1;
+    }
+
+    int n_levels = graph_compute_levels(boot_level);
+    if (n_levels < 0) {
+        LOG_WARN("boot scheduler disabled: cannot compute dependency levels");
+        boot_active = 0;
+        return -1;
+    }
+
+    /* Stable counting sort of component indices by level */
+    int pos = 0;
+    for (int level = 0; level < n_levels; level++) {
+        for (int i = 0; i < n_components; i++) {
+            if (boot_level[i] == level) {
+                boot_order[pos++] = i;
+            }
+        }
+    }
+
+    if (boot_held) memset(boot_held, 0, (size_t)graph_cap);
+    boot_n_held = 0;
+    boot_n_components = n_components;
+    boot_n_levels = n_levels;
+    boot_max_parallel = max_parallel > 0 ? max_parallel : 0;
+    boot_started = time(NULL);
+    boot_active = 1;
+    trace_boot_begin();
+
+    if (boot_max_parallel > 0) {
+        LOG_INFO("boot scheduler: %d components in %d levels, at most %d starting at once",
+                 n_components, n_levels, boot_max_parallel);
+    } else {
+        LOG_INFO("boot scheduler: %d components in %d levels", n_components, n_levels);
+    }
+    return n_levels;
+}
+
+int graph_boot_active(void) {
+    return boot_active;
+}
+
+static void boot_end(const char *reason) {
+    trace_boot_end();
+    boot_active = 0;
+    boot_n_held = 0;
+    if (boot_held) memset(boot_held, 0, (size_t)graph_cap);
+    /* Anything still held goes back through the normal resolver */
+    graph_mark_all_dirty();
+    LOG_INFO("boot scheduler: %s after %ld seconds", reason,
+             (long)(time(NULL) - boot_started));
+}
+
+void graph_boot_abort(const char *reason) {
+    if (boot_active) {
+        boot_end(reason);
+    }
+}
+
+static void boot_hold(int idx) {
+    if (idx >= graph_cap && graph_grow() < 0) {
+        return;
+    }
+    if (!boot_held[idx]) {
+        boot_held[idx] = 1;
+        boot_n_held++;
+    }
+}
+
+static int boot_in_flight(void) {
+    int n = 0;
+    for (int i = 0; i < n_components; i++) {
+        if (components[i].state == COMP_STARTING || components[i].state == COMP_READY_WAIT) {
+            n++;
+        }
+    }
+    return n;
+}
+
+/* Start held components in level order while slots are free.
+ * Returns the number started. */
+static int boot_dispatch(void) {
+    if (boot_n_components != n_components) {
+        /* Component set changed under us (reload); levels are stale */
+        boot_end("component set changed, handing over to resolver");
+        return 0;
+    }
+    if (boot_n_held == 0) {
+        return 0;
+    }
+
+    int in_flight = boot_max_parallel > 0 ? boot_in_flight() : 0;
+    int started = 0;
+
+    for (int o = 0; o < n_components && boot_n_held > 0; o++) {
+        int i = boot_order[o];
+        if (!boot_held[i]) continue;
+
+        if (boot_max_parallel > 0 && in_flight >= boot_max_parallel) {
+            break;
+        }
+
+        boot_held[i] = 0;
+        boot_n_held--;
+
+        component_t *comp = &components[i];
+        if (comp->state != COMP_INACTIVE || !requirements_met(comp)) {
+            continue;
+        }
+
+        if (component_start(i) == 0) {
+            started++;
+            if (comp->state == COMP_STARTING || comp->state == COMP_READY_WAIT) {
+                in_flight++;
+            }
+            graph_mark_dirty(i);
+        }
+    }
+
+    if (started > 0) {
+        collect_capability_changes();
+    }
+    return started;
+}
+
+/* Boot is over once nothing is held and nothing is still coming up */
+static void boot_check_complete(void) {
+    if (boot_n_held > 0 || n_dirty > 0) {
+        return;
+    }
+    for (int i = 0; i < n_components; i++) {
+        if (components[i].state == COMP_STARTING || components[i].state == COMP_READY_WAIT) {
+            return;
+        }
+    }
+    boot_end("boot complete");
+}
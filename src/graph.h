@@ -8,9 +8,38 @@
 /* Single pass graph resolution, returns number of state changes */
 int graph_resolve(void);
 
-/* Iterate graph resolution until stable */
+/* Iterate graph resolution until stable (full consistency sweep) */
 void graph_resolve_full(void);
 
+/* Incremental resolution: evaluate only queued components until stable,
+ * returns number of state changes */
+int graph_resolve_pending(void);
+
+/* Queue a component for re-evaluation by graph_resolve_pending() */
+void graph_mark_dirty(int idx);
+
+/* Queue every component for re-evaluation */
+void graph_mark_all_dirty(void);
+
+/* Boot scheduler: start components in dependency-level order with at most
+ * max_parallel (0 = unlimited) starting at once, until boot settles.
+ * Returns the number of levels, -1 if levels cannot be computed. */
+int graph_boot_begin(int max_parallel);
+
+/* Non-zero while the boot scheduler is in control of component starts */
+int graph_boot_active(void);
+
+/* Hand any components the boot scheduler still holds back to the normal
+ * resolver, e.g. because the component set changed */
+void graph_boot_abort(const char *reason);
+
+/* Compute each component's dependency level into levels[] (0 = no
+ * in-graph dependencies). Returns the number of levels, -1 on cycles. */
+int graph_compute_levels(int *levels);
+
+/* Seconds between full consistency sweeps (TIMER_GRAPH_SWEEP) */
+#define GRAPH_SWEEP_INTERVAL 30
+
 /* Cycle detection and graph analysis */
 
 /* Cycle information structure */
@@ -36,13 +65,40 @@ int graph_topological_sort(int *sorted_components, int max_components);
 /* Validate that adding a component wouldn't create cycles */
 int graph_validate_component_addition(const char *component_name);
 
-/* Find strongly connected components in the dependency graph */
+/* Dependency cycles: *scc_components receives a malloc'd array giving
+ * each component's cycle number (0 .. *scc_count - 1), or -1 if it is on
+ * none. A cycle is an SCC of several components or one requiring what it
+ * provides itself. */
 int graph_find_strongly_connected_components(int **scc_components, int *scc_count);
 
-/* Find dependency path between two capabilities */
+/* Shortest chain from a provider of from_capability, through what each
+ * link requires, to a provider of to_capability, written as
+ * "cap [provider] -> cap [provider] ...". -1 if there is none. */
 int graph_find_dependency_path(const char *from_capability, const char *to_capability,
                                char *path_description, int max_description_len);
 
+/* The queries above and below answer from one analysis of the graph
+ * (SCCs and transitive closure), rebuilt only when a requires/provides
+ * edge changed; its version is bumped on every rebuild */
+unsigned int graph_analysis_version(void);
+
+/* Whether component a depends on component b, directly or not (-1 if
+ * either index is invalid) */
+int graph_depends_on(int a, int b);
+
+/* Everything component idx depends on / that depends on it, directly or
+ * not, into out (at most max entries). Returns the full count, or -1. */
+int graph_dependencies(int idx, int *out, int max);
+int graph_dependents(int idx, int *out, int max);
+
+/* Components providing what idx requires / requiring what it provides;
+ * the array stays valid until the graph changes. Returns the count, or -1. */
+int graph_direct_dependencies(int idx, const int **deps);
+int graph_direct_dependents(int idx, const int **dependents);
+
+/* Cycle number of component idx as above, -1 if on none */
+int graph_cycle_of(int idx);
+
 /* Get detailed graph analysis metrics */
 typedef struct {
     int total_components;
@@ -17,13 +17,25 @@
  *   graphctl tree <name>               Show dependency tree for a component
  *   graphctl reload                    Reload all component declarations
  *   graphctl upgrade <name>            Hot-swap upgrade component to new version
+ *   graphctl reset-failed <name>       Clear restart backoff/quarantine and start again
+ *   graphctl log <name> [lines]        Show the last output of a component
+ *   graphctl log -f <name> [lines]     Show it, then follow new output
+ *   graphctl top                       Show resource usage of every component
+ *   graphctl stats <name>              Show the resource history of a component
  *
  *   Graph Analysis Commands:
  *   graphctl check-cycles              Detect and report dependency cycles
  *   graphctl analyze                   Show comprehensive graph analysis and metrics
+ *   graphctl analyze-boot [--chrome]   Show boot critical path (or export a Chrome trace)
+ *   graphctl metrics                   Print the OpenMetrics exposition
+ *   graphctl peers                     Show federation peers
  *   graphctl validate                  Validate current graph configuration
  *   graphctl path <cap1> <cap2>        Show dependency path between capabilities
  *   graphctl scc                       Show strongly connected components
+ *
+ *   Machine-readable output:
+ *   graphctl --json <command>          Print replies as JSON, one object per line
+ *   graphctl subscribe                 Stream component/capability changes as JSON
  */
 
 #define _GNU_SOURCE
@@ -46,9 +58,57 @@
 /* Color state */
 static int use_colors = 0;
 
-#define CONTROL_SOCKET "/tmp/graph-resolver.sock"
+#define CONTROL_SOCKET "/run/graph-resolver.sock"
 #define BUF_SIZE 8192
 
+/* Machine protocol: after "proto json" every reply is a 4-byte big-endian
+ * length followed by one JSON object. The first frame acknowledges the
+ * protocol switch and is not printed. Returns 0 on a clean EOF. */
+static int print_json_frames(int fd) {
+    size_t len = 0, cap = BUF_SIZE;
+    char *buf = malloc(cap);
+    int frames = 0;
+    ssize_t n;
+
+    if (!buf) return -1;
+
+    while ((n = read(fd, buf + len, cap - len)) > 0) {
+        len += (size_t)n;
+
+        size_t off = 0;
+        while (len - off >= 4) {
+            const unsigned char *hdr = (const unsigned char *)buf + off;
+            size_t flen = ((size_t)hdr[0] << 24) | ((size_t)hdr[1] << 16) |
+                          ((size_t)hdr[2] << 8) | hdr[3];
+            if (len - off - 4 < flen) {
+                /* Incomplete frame: make sure the buffer can hold it */
+                if (flen + 4 > cap) {
+                    char *grown = realloc(buf, flen + 4);
+                    if (!grown) {
+                        free(buf);
+                        return -1;
+                    }
+                    buf = grown;
+                    cap = flen + 4;
+                }
+                break;
+            }
+            if (frames++ > 0) {
+                fwrite(buf + off + 4, 1, flen, stdout);
+                fputc('\n', stdout);
+                fflush(stdout);
+            }
+            off += 4 + flen;
+        }
+
+        memmove(buf, buf + off, len - off);
+        len -= off;
+    }
+
+    free(buf);
+    return n < 0 ? -1 : 0;
+}
+
 /* Apply colors to output based on keywords */
 static void colorize_output(const char *line) {
     if (!use_colors) {
@@ -74,8 +134,15 @@ int main(int argc, char *argv[]) {
     /* Detect if stdout is a terminal for color output */
     use_colors = isatty(STDOUT_FILENO);
 
+    int json = 0;
+    if (argc >= 2 && strcmp(argv[1], "--json") == 0) {
+        json = 1;
+        argv++;
+        argc--;
+    }
+
     if (argc < 2) {
-        fprintf(stderr, "Usage: graphctl <command> [args...]\n");
+        fprintf(stderr, "Usage: graphctl [--json] <command> [args...]\n");
         fprintf(stderr, "Commands:\n");
         fprintf(stderr, "  status                    Show all components and capabilities\n");
         fprintf(stderr, "  caps                      Show all capabilities with status and provider\n");
@@ -86,13 +153,24 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "  tree <name>               Show dependency tree for a component\n");
         fprintf(stderr, "  reload                    Reload all component declarations\n");
         fprintf(stderr, "  upgrade <name>            Hot-swap upgrade component to new version\n");
+        fprintf(stderr, "  reset-failed <name>       Clear restart backoff/quarantine and start again\n");
+        fprintf(stderr, "  log [-f] <name> [lines]   Show (and follow) the output of a component\n");
+        fprintf(stderr, "  top                       Show resource usage of every component\n");
+        fprintf(stderr, "  stats <name>              Show the resource history of a component\n");
         fprintf(stderr, "\n");
         fprintf(stderr, "Graph Analysis Commands:\n");
         fprintf(stderr, "  check-cycles              Detect and report dependency cycles\n");
         fprintf(stderr, "  analyze                   Show comprehensive graph analysis and metrics\n");
+        fprintf(stderr, "  analyze-boot [--chrome]   Show the boot critical path, or export a Chrome trace\n");
+        fprintf(stderr, "  metrics                   Print the OpenMetrics exposition\n");
+        fprintf(stderr, "  peers                     Show federation peers and their capabilities\n");
         fprintf(stderr, "  validate                  Validate current graph configuration\n");
         fprintf(stderr, "  path <cap1> <cap2>        Show dependency path between capabilities\n");
         fprintf(stderr, "  scc                       Show strongly connected components\n");
+        fprintf(stderr, "\n");
+        fprintf(stderr, "Machine-readable output:\n");
+        fprintf(stderr, "  --json <command>          Print replies as JSON, one object per line\n");
+        fprintf(stderr, "  subscribe                 Stream component/capability changes as JSON\n");
         return 1;
     }
 
@@ -121,6 +199,20 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    int subscribe = strcmp(cmd, "subscribe") == 0;
+    if (json || subscribe) {
+        /* Switch protocols, then send the command; a subscription stays
+         * open until the resolver or the user ends it */
+        char line[1100];
+        int len = snprintf(line, sizeof(line), "proto json\n%s\n", cmd);
+        (void)!write(fd, line, len);
+        if (!subscribe) shutdown(fd, SHUT_WR);
+
+        int rc = print_json_frames(fd);
+        close(fd);
+        return rc < 0 ? 1 : 0;
+    }
+
     /* send command */
     (void)!write(fd, cmd, strlen(cmd));
 
@@ -152,6 +244,8 @@ int main(int argc, char *argv[]) {
             /* No colors - just output directly */
             fputs(buf, stdout);
         }
+        /* "log -f" keeps streaming, so show each piece as it comes */
+        fflush(stdout);
     }
 
     /* Output any remaining line buffer */
@@ -3,7 +3,9 @@
  *
  * Implements Unix domain socket file descriptor passing using SCM_RIGHTS.
  * This enables zero-downtime service upgrades by passing open file
- * descriptors from old process to new process.
+ * descriptors from old process to new process. send_fds()/recv_fds() move
+ * one message's worth; handoff_send()/handoff_recv() any number, with a
+ * description of each.
  */
 
 #define _GNU_SOURCE
@@ -15,8 +17,11 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
-#include <poll.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
 
 int send_fds(int sock, int *fds, int n_fds) {
     if (sock < 0 || !fds || n_fds <= 0 || n_fds > MAX_FDS_PER_MSG) {
@@ -155,37 +160,103 @@ int send_handoff_complete(int sock) {
     return 0;
 }
 
-int wait_handoff_complete(int sock, int timeout_ms) {
-    if (sock < 0) {
-        errno = EINVAL;
+/* Milliseconds left until deadline (0 = none, wait forever): -1 forever,
+ * 0 once it has passed */
+static int time_left(uint64_t deadline) {
+    if (deadline == 0) return -1;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+    return now >= deadline ? 0 : (int)(deadline - now);
+}
+
+static uint64_t deadline_in(int timeout_ms) {
+    if (timeout_ms <= 0) return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000 + (uint64_t)timeout_ms;
+}
+
+/* An epoll instance watching sock for input, -1 on error */
+static int watch_socket(int sock) {
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0) {
+        LOG_ERR("epoll_create1 failed for handoff: %s", strerror(errno));
+        return -1;
+    }
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLRDHUP };
+    ev.data.fd = sock;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, sock, &ev) < 0) {
+        LOG_ERR("epoll_ctl failed for handoff socket: %s", strerror(errno));
+        close(ep);
         return -1;
     }
+    return ep;
+}
 
-    struct pollfd pfd;
-    pfd.fd = sock;
-    pfd.events = POLLIN;
-    pfd.revents = 0;
+/* Wait on ep until its socket is readable. Returns 0, or -1 with errno
+ * ETIMEDOUT once deadline has passed. */
+static int wait_readable(int ep, uint64_t deadline) {
+    struct epoll_event ev;
+    for (;;) {
+        int left = time_left(deadline);
+        if (left == 0) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        int n = epoll_wait(ep, &ev, 1, left);
+        if (n > 0) return 0;
+        if (n < 0 && errno != EINTR) return -1;
+    }
+}
 
-    int poll_result = poll(&pfd, 1, timeout_ms);
-    if (poll_result < 0) {
-        LOG_ERR("poll failed waiting for handoff complete: %s", strerror(errno));
-        return -1;
+/* Read exactly len bytes of a partly received message */
+static int read_full(int ep, int sock, void *buf, size_t len, uint64_t deadline) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = recv(sock, p, len, MSG_DONTWAIT);
+        if (n > 0) {
+            p += n;
+            len -= (size_t)n;
+            continue;
+        }
+        if (n == 0) {
+            errno = EPIPE;
+            return -1;
+        }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN || wait_readable(ep, deadline) < 0) return -1;
     }
+    return 0;
+}
 
-    if (poll_result == 0) {
-        LOG_WARN("timeout waiting for handoff complete message");
-        errno = ETIMEDOUT;
+int wait_handoff_complete(int sock, int timeout_ms) {
+    if (sock < 0) {
+        errno = EINVAL;
         return -1;
     }
 
+    int ep = watch_socket(sock);
+    if (ep < 0) return -1;
+
+    uint64_t deadline = deadline_in(timeout_ms);
     char buffer[HANDOFF_COMPLETE_LEN + 1];
-    ssize_t bytes_read = read(sock, buffer, sizeof(buffer) - 1);
-    if (bytes_read < 0) {
-        LOG_ERR("failed to read handoff complete message: %s", strerror(errno));
+    int result = wait_readable(ep, deadline);
+    if (result == 0) {
+        result = read_full(ep, sock, buffer, HANDOFF_COMPLETE_LEN, deadline);
+    }
+    close(ep);
+
+    if (result < 0) {
+        if (errno == ETIMEDOUT) {
+            LOG_WARN("timeout waiting for handoff complete message");
+        } else {
+            LOG_ERR("failed to read handoff complete message: %s", strerror(errno));
+        }
         return -1;
     }
 
-    buffer[bytes_read] = '\0';
+    buffer[HANDOFF_COMPLETE_LEN] = '\0';
 
     if (strncmp(buffer, HANDOFF_COMPLETE_MSG, HANDOFF_COMPLETE_LEN) == 0) {
         LOG_INFO("received handoff complete message");
@@ -197,13 +268,444 @@ int wait_handoff_complete(int sock, int timeout_ms) {
     }
 }
 
+/* Wire format of handoff_send(): one message per batch of descriptors,
+ * a header and a record for each, with the descriptors themselves
+ * attached as SCM_RIGHTS. Sender and receiver are on the same host, so
+ * records are in native byte order. */
+#define HANDOFF_MAGIC 0x4f484b59u   /* "YKHO" */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t total;                 /* descriptors in the whole handoff */
+    uint32_t count;                 /* in this message */
+    uint32_t reserved;
+} handoff_wire_header_t;
+
+typedef struct {
+    int32_t  type;
+    int32_t  family;
+    int32_t  listening;
+    uint32_t addr_len;
+    uint64_t dev;
+    uint64_t ino;
+    uint8_t  addr[sizeof(struct sockaddr_storage)];
+} handoff_wire_fd_t;
+
+int handoff_describe(int fd, handoff_fd_t *desc) {
+    memset(desc, 0, sizeof(*desc));
+    desc->fd = fd;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return -1;
+    }
+    desc->dev = st.st_dev;
+    desc->ino = st.st_ino;
+    if (!S_ISSOCK(st.st_mode)) {
+        return 0;
+    }
+
+    socklen_t len = sizeof(int);
+    getsockopt(fd, SOL_SOCKET, SO_TYPE, &desc->type, &len);
+    len = sizeof(int);
+    getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &desc->family, &len);
+    len = sizeof(int);
+    getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &desc->listening, &len);
+
+    desc->addr_len = sizeof(desc->addr);
+    if (getsockname(fd, (struct sockaddr *)&desc->addr, &desc->addr_len) < 0) {
+        desc->addr_len = 0;
+    }
+    return 0;
+}
+
+/* Send one batch, finishing a message the socket only took part of
+ * (the descriptors go with its first byte) */
+static int send_batch(int sock, const handoff_wire_header_t *hdr,
+                      const handoff_wire_fd_t *recs, const int *fds) {
+    struct iovec iov[2] = {
+        { .iov_base = (void *)hdr, .iov_len = sizeof(*hdr) },
+        { .iov_base = (void *)recs, .iov_len = hdr->count * sizeof(*recs) },
+    };
+    union {
+        char buf[CMSG_SPACE(HANDOFF_BATCH_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = hdr->count > 0 ? 2 : 1;
+    if (hdr->count > 0) {
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE(hdr->count * sizeof(int));
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(hdr->count * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, hdr->count * sizeof(int));
+    }
+
+    size_t total = iov[0].iov_len + (hdr->count > 0 ? iov[1].iov_len : 0);
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        LOG_ERR("sendmsg failed for fd passing: %s", strerror(errno));
+        return -1;
+    }
+
+    /* The rest of the message, without the descriptors */
+    size_t done = (size_t)n;
+    while (done < total) {
+        const char *from = done < sizeof(*hdr)
+            ? (const char *)hdr + done
+            : (const char *)recs + (done - sizeof(*hdr));
+        size_t len = done < sizeof(*hdr) ? sizeof(*hdr) - done : total - done;
+        n = send(sock, from, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERR("send failed for fd passing: %s", strerror(errno));
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+int handoff_send(int sock, const int *fds, int n_fds) {
+    if (sock < 0 || n_fds < 0 || (n_fds > 0 && !fds)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int batch = n_fds < HANDOFF_BATCH_FDS ? n_fds : HANDOFF_BATCH_FDS;
+    handoff_wire_fd_t *recs = calloc(batch > 0 ? (size_t)batch : 1, sizeof(*recs));
+    if (!recs) {
+        LOG_ERR("malloc failed for handoff records");
+        return -1;
+    }
+
+    int sent = 0, messages = 0;
+    do {
+        handoff_wire_header_t hdr = {
+            .magic = HANDOFF_MAGIC,
+            .total = (uint32_t)n_fds,
+            .count = (uint32_t)(n_fds - sent < batch ? n_fds - sent : batch),
+        };
+        for (uint32_t i = 0; i < hdr.count; i++) {
+            handoff_fd_t desc;
+            if (handoff_describe(fds[sent + i], &desc) < 0) {
+                LOG_ERR("cannot hand over fd %d: %s", fds[sent + i], strerror(errno));
+                free(recs);
+                return -1;
+            }
+            handoff_wire_fd_t *rec = &recs[i];
+            memset(rec, 0, sizeof(*rec));
+            rec->type = desc.type;
+            rec->family = desc.family;
+            rec->listening = desc.listening;
+            rec->addr_len = desc.addr_len;
+            rec->dev = desc.dev;
+            rec->ino = desc.ino;
+            memcpy(rec->addr, &desc.addr, desc.addr_len);
+        }
+        if (send_batch(sock, &hdr, recs, fds + sent) < 0) {
+            free(recs);
+            return -1;
+        }
+        sent += (int)hdr.count;
+        messages++;
+    } while (sent < n_fds);
+
+    free(recs);
+    LOG_INFO("handed over %d file descriptors in %d messages", n_fds, messages);
+    return 0;
+}
+
+/* Receiver state. Reads never go past the end of the message part being
+ * read, so the descriptors of the next message are not taken along. */
+typedef enum {
+    RX_HEADER,                      /* reading a batch header */
+    RX_RECORDS,                     /* reading the records after it */
+    RX_COMPLETE,                    /* reading HANDOFF_COMPLETE_MSG */
+    RX_DONE,
+    RX_FAILED,
+} rx_phase_t;
+
+struct handoff_rx {
+    rx_phase_t phase;
+    int with_complete;
+    handoff_wire_header_t hdr;
+    size_t hdr_len;
+    handoff_wire_fd_t *recs;
+    size_t recs_len;
+    int batch[HANDOFF_BATCH_FDS];   /* attached to the current header */
+    int n_batch;
+    handoff_fd_t *out;
+    uint32_t total, got;
+    int first;
+    char complete[HANDOFF_COMPLETE_LEN];
+    size_t complete_len;
+};
+
+handoff_rx_t *handoff_rx_new(int with_complete) {
+    handoff_rx_t *rx = calloc(1, sizeof(*rx));
+    if (!rx) return NULL;
+    rx->recs = calloc(HANDOFF_BATCH_FDS, sizeof(*rx->recs));
+    if (!rx->recs) {
+        free(rx);
+        return NULL;
+    }
+    rx->with_complete = with_complete;
+    rx->first = 1;
+    return rx;
+}
+
+/* Close everything received so far */
+static void rx_drop(handoff_rx_t *rx) {
+    for (int i = 0; i < rx->n_batch; i++) close(rx->batch[i]);
+    rx->n_batch = 0;
+    for (uint32_t i = 0; i < rx->got; i++) close(rx->out[i].fd);
+    rx->got = 0;
+    free(rx->out);
+    rx->out = NULL;
+}
+
+static int rx_fail(handoff_rx_t *rx, int err) {
+    LOG_ERR("handoff receive failed after %u of %u descriptors: %s",
+            rx->got, rx->total, strerror(err));
+    rx_drop(rx);
+    rx->phase = RX_FAILED;
+    errno = err;
+    return -1;
+}
+
+/* Read up to len bytes: > 0 read, 0 nothing there yet, -1 error */
+static ssize_t rx_read(int sock, void *buf, size_t len) {
+    for (;;) {
+        ssize_t n = recv(sock, buf, len, MSG_DONTWAIT);
+        if (n > 0) return n;
+        if (n == 0) {
+            errno = EPIPE;
+            return -1;
+        }
+        if (errno == EINTR) continue;
+        return errno == EAGAIN ? 0 : -1;
+    }
+}
+
+/* Read more of a header, with whatever descriptors come attached */
+static int rx_header(handoff_rx_t *rx, int sock) {
+    struct iovec iov = {
+        .iov_base = (char *)&rx->hdr + rx->hdr_len,
+        .iov_len = sizeof(rx->hdr) - rx->hdr_len,
+    };
+    union {
+        char buf[CMSG_SPACE(HANDOFF_BATCH_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) return errno == EAGAIN ? 0 : -1;
+    if (n == 0) {
+        errno = EPIPE;
+        return -1;
+    }
+
+    /* Whatever came attached is ours to close if anything is wrong */
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            int k = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            const int *fds = (const int *)CMSG_DATA(cmsg);
+            for (int i = 0; i < k; i++) {
+                if (rx->n_batch < HANDOFF_BATCH_FDS) {
+                    rx->batch[rx->n_batch++] = fds[i];
+                } else {
+                    close(fds[i]);
+                }
+            }
+        }
+    }
+    if (msg.msg_flags & MSG_CTRUNC) {
+        errno = EMFILE;
+        return -1;
+    }
+    rx->hdr_len += (size_t)n;
+    return 1;
+}
+
+/* A whole header has arrived: check it against what came before */
+static int rx_header_done(handoff_rx_t *rx) {
+    const handoff_wire_header_t *hdr = &rx->hdr;
+    if (hdr->magic != HANDOFF_MAGIC || hdr->count > HANDOFF_BATCH_FDS ||
+        (int)hdr->count != rx->n_batch || (!rx->first && hdr->total != rx->total) ||
+        (rx->first ? hdr->count > hdr->total : hdr->count > rx->total - rx->got)) {
+        errno = EPROTO;
+        return -1;
+    }
+    if (rx->first) {
+        rx->out = calloc(hdr->total > 0 ? hdr->total : 1, sizeof(*rx->out));
+        if (!rx->out) {
+            errno = ENOMEM;
+            return -1;
+        }
+        rx->total = hdr->total;
+        rx->first = 0;
+    }
+    return 0;
+}
+
+/* The records of a batch have arrived: describe its descriptors */
+static void rx_batch_done(handoff_rx_t *rx) {
+    for (uint32_t i = 0; i < rx->hdr.count; i++) {
+        handoff_fd_t *desc = &rx->out[rx->got + i];
+        const handoff_wire_fd_t *rec = &rx->recs[i];
+        desc->fd = rx->batch[i];
+        desc->type = rec->type;
+        desc->family = rec->family;
+        desc->listening = rec->listening;
+        desc->dev = (dev_t)rec->dev;
+        desc->ino = (ino_t)rec->ino;
+        desc->addr_len = rec->addr_len < sizeof(desc->addr) ? rec->addr_len : sizeof(desc->addr);
+        memcpy(&desc->addr, rec->addr, desc->addr_len);
+    }
+    rx->got += rx->hdr.count;
+    rx->n_batch = 0;
+    rx->hdr_len = 0;
+    rx->recs_len = 0;
+}
+
+int handoff_rx_feed(handoff_rx_t *rx, int sock) {
+    for (;;) {
+        ssize_t n;
+        switch (rx->phase) {
+        case RX_HEADER:
+            n = rx_header(rx, sock);
+            if (n < 0) return rx_fail(rx, errno);
+            if (n == 0) return 0;
+            if (rx->hdr_len < sizeof(rx->hdr)) break;
+            if (rx_header_done(rx) < 0) return rx_fail(rx, errno);
+            rx->phase = RX_RECORDS;
+            break;
+
+        case RX_RECORDS: {
+            size_t need = rx->hdr.count * sizeof(*rx->recs);
+            if (rx->recs_len < need) {
+                n = rx_read(sock, (char *)rx->recs + rx->recs_len, need - rx->recs_len);
+                if (n < 0) return rx_fail(rx, errno);
+                if (n == 0) return 0;
+                rx->recs_len += (size_t)n;
+                break;
+            }
+            rx_batch_done(rx);
+            if (rx->got < rx->total) {
+                rx->phase = RX_HEADER;
+            } else {
+                LOG_INFO("received %u file descriptors over handoff socket", rx->total);
+                rx->phase = rx->with_complete ? RX_COMPLETE : RX_DONE;
+            }
+            break;
+        }
+
+        case RX_COMPLETE:
+            n = rx_read(sock, rx->complete + rx->complete_len,
+                        HANDOFF_COMPLETE_LEN - rx->complete_len);
+            if (n < 0) return rx_fail(rx, errno);
+            if (n == 0) return 0;
+            rx->complete_len += (size_t)n;
+            if (rx->complete_len < HANDOFF_COMPLETE_LEN) break;
+            if (memcmp(rx->complete, HANDOFF_COMPLETE_MSG, HANDOFF_COMPLETE_LEN) != 0) {
+                LOG_ERR("received invalid handoff message: '%.*s'",
+                        HANDOFF_COMPLETE_LEN, rx->complete);
+                return rx_fail(rx, EPROTO);
+            }
+            LOG_INFO("received handoff complete message");
+            rx->phase = RX_DONE;
+            break;
+
+        case RX_DONE:
+            return 1;
+
+        case RX_FAILED:
+            errno = EPROTO;
+            return -1;
+        }
+    }
+}
+
+int handoff_rx_take(handoff_rx_t *rx, handoff_fd_t **fds) {
+    if (rx->phase != RX_DONE) {
+        *fds = NULL;
+        errno = EINVAL;
+        return -1;
+    }
+    int total = (int)rx->total;
+    *fds = rx->out;
+    rx->out = NULL;
+    rx->got = 0;
+    rx->phase = RX_FAILED;
+    return total;
+}
+
+void handoff_rx_free(handoff_rx_t *rx) {
+    if (!rx) return;
+    rx_drop(rx);
+    free(rx->recs);
+    free(rx);
+}
+
+int handoff_recv(int sock, int timeout_ms, handoff_fd_t **fds) {
+    if (sock < 0 || !fds) {
+        errno = EINVAL;
+        return -1;
+    }
+    *fds = NULL;
+
+    int ep = watch_socket(sock);
+    if (ep < 0) return -1;
+    handoff_rx_t *rx = handoff_rx_new(0);
+    if (!rx) {
+        close(ep);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    uint64_t deadline = deadline_in(timeout_ms);
+    int r;
+    while ((r = handoff_rx_feed(rx, sock)) == 0) {
+        if (wait_readable(ep, deadline) < 0) {
+            rx_fail(rx, errno);
+            r = -1;
+            break;
+        }
+    }
+    close(ep);
+
+    int n = r > 0 ? handoff_rx_take(rx, fds) : -1;
+    int err = errno;
+    handoff_rx_free(rx);
+    errno = err;
+    return n;
+}
+
 int create_handoff_socketpair(int socks[2]) {
     if (!socks) {
         errno = EINVAL;
         return -1;
     }
 
-    if (socketpair(AF_UNIX, SOCK_STREAM, 0, socks) < 0) {
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, socks) < 0) {
         LOG_ERR("socketpair failed for handoff: %s", strerror(errno));
         return -1;
     }
@@ -4,22 +4,37 @@
  * Implements Unix domain socket file descriptor passing using SCM_RIGHTS
  * for zero-downtime service upgrades. This enables the core hot-swap
  * capability that makes YakirOS truly rebootless.
+ *
+ * A process giving up its descriptors sends them with handoff_send() and
+ * then HANDOFF_COMPLETE_MSG; the one taking over reads them with
+ * handoff_recv(). Any number may be handed over, proxies with thousands
+ * of sockets included.
  */
 
 #ifndef HANDOFF_H
 #define HANDOFF_H
 
 #include <sys/types.h>
+#include <sys/socket.h>
 
 /* Maximum number of file descriptors that can be passed in one message */
 #define MAX_FDS_PER_MSG 32
 
+/* Descriptors per message of handoff_send(); the kernel takes at most
+ * SCM_MAX_FD (253) */
+#define HANDOFF_BATCH_FDS 250
+
 /* Standard file descriptor number used for handoff socket */
 #define HANDOFF_FD 4
 
 /* Environment variable name for handoff socket */
 #define HANDOFF_FD_ENV "HANDOFF_FD"
 
+/* Set to "1" for a standby instance: it warms up, then waits on
+ * HANDOFF_FD for the descriptors it is to serve (handoff_recv(), possibly
+ * none) followed by HANDOFF_COMPLETE_MSG, and only then takes over */
+#define HANDOFF_STANDBY_ENV "HANDOFF_STANDBY"
+
 /* Protocol messages */
 #define HANDOFF_COMPLETE_MSG "HANDOFF_COMPLETE\n"
 #define HANDOFF_COMPLETE_LEN 16
@@ -44,6 +59,61 @@ int send_fds(int sock, int *fds, int n_fds);
  */
 int recv_fds(int sock, int *fds, int max_fds);
 
+/* A descriptor handed over by handoff_send(), described as the sender
+ * saw it so the receiver can map it without asking the kernel again */
+typedef struct {
+    int fd;                             /* the receiver's descriptor */
+    int type;                           /* SO_TYPE, 0 if not a socket */
+    int family;                         /* SO_DOMAIN (AF_INET, AF_UNIX, ...) */
+    int listening;                      /* SO_ACCEPTCONN */
+    dev_t dev;                          /* fstat() of the sender's descriptor */
+    ino_t ino;
+    socklen_t addr_len;                 /* getsockname(), 0 if not bound */
+    struct sockaddr_storage addr;
+} handoff_fd_t;
+
+/* Describe fd as handoff_send() would. Returns 0, -1 if it is not open. */
+int handoff_describe(int fd, handoff_fd_t *desc);
+
+/* Hand over n_fds descriptors (0 is fine: the receiver then learns there
+ * are none), in batches of HANDOFF_BATCH_FDS, each with its description
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int handoff_send(int sock, const int *fds, int n_fds);
+
+/* Receive everything one handoff_send() sent. The descriptors are
+ * close-on-exec; *fds is set to a malloc()ed array of their descriptions.
+ * On failure every descriptor received so far is closed.
+ *
+ * timeout_ms: Limit for the whole handoff (0 for blocking)
+ *
+ * Returns: Number of descriptors, -1 on error or timeout
+ */
+int handoff_recv(int sock, int timeout_ms, handoff_fd_t **fds);
+
+/* Receiving from the main loop: handoff_rx_feed() takes whatever the
+ * socket has each time it is readable, never waiting for the rest */
+typedef struct handoff_rx handoff_rx_t;
+
+/* A receiver for one handoff_send(), and the HANDOFF_COMPLETE_MSG after
+ * it if with_complete. NULL if out of memory. */
+handoff_rx_t *handoff_rx_new(int with_complete);
+
+/* Read what has arrived on sock without blocking
+ *
+ * Returns: 1 once everything has, 0 if more is to come, -1 on error
+ *          (every descriptor received so far is then closed)
+ */
+int handoff_rx_feed(handoff_rx_t *rx, int sock);
+
+/* The descriptors of a finished receive, *fds as from handoff_recv()
+ * (the caller's to free). Returns their number, -1 if it has not finished. */
+int handoff_rx_take(handoff_rx_t *rx, handoff_fd_t **fds);
+
+/* Free rx, closing any descriptor it still holds */
+void handoff_rx_free(handoff_rx_t *rx);
+
 /* Send a handoff completion message over the socket
  *
  * sock: Unix domain socket
@@ -52,7 +122,7 @@ int recv_fds(int sock, int *fds, int max_fds);
  */
 int send_handoff_complete(int sock);
 
-/* Wait for handoff completion message from the socket
+/* Wait for handoff completion message from the socket, with epoll
  *
  * sock: Unix domain socket
  * timeout_ms: Timeout in milliseconds (0 for blocking)
@@ -63,7 +133,8 @@ int wait_handoff_complete(int sock, int timeout_ms);
 
 /* Create a Unix domain socketpair for handoff communication
  *
- * socks: Array of 2 ints to store the socket pair
+ * socks: Array of 2 ints to store the socket pair; both ends are
+ *        close-on-exec, the child's being passed on with spawn_fd()
  *
  * Returns: 0 on success, -1 on error
  */
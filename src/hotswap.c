@@ -10,6 +10,7 @@
 #include "hotswap.h"
 #include "component.h"
 #include "capability.h"
+#include "handoff.h"
 #include "log.h"
 
 #include <stdio.h>
@@ -118,60 +119,6 @@ int hotswap_get_transfer_fds(int component_idx, int **fds, int *count) {
     return -1;
 }
 
-/* Send file descriptors over Unix socket */
-static int send_fds(int sock, int *fds, int count) {
-    struct msghdr msg = {0};
-    struct cmsghdr *cmsg;
-    char buf[CMSG_SPACE(sizeof(int) * count)];
-    char data = 'X';  /* Dummy data */
-    struct iovec iov = { .iov_base = &data, .iov_len = 1 };
-
-    msg.msg_iov = &iov;
-    msg.msg_iovlen = 1;
-    msg.msg_control = buf;
-    msg.msg_controllen = sizeof(buf);
-
-    cmsg = CMSG_FIRSTHDR(&msg);
-    cmsg->cmsg_level = SOL_SOCKET;
-    cmsg->cmsg_type = SCM_RIGHTS;
-    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
-
-    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
-    msg.msg_controllen = cmsg->cmsg_len;
-
-    return sendmsg(sock, &msg, 0);
-}
-
-/* Receive file descriptors over Unix socket */
-static int recv_fds(int sock, int *fds, int max_count) {
-    struct msghdr msg = {0};
-    struct cmsghdr *cmsg;
-    char buf[CMSG_SPACE(sizeof(int) * max_count)];
-    char data;
-    struct iovec iov = { .iov_base = &data, .iov_len = 1 };
-
-    msg.msg_iov = &iov;
-    msg.msg_iovlen = 1;
-    msg.msg_control = buf;
-    msg.msg_controllen = sizeof(buf);
-
-    ssize_t n = recvmsg(sock, &msg, 0);
-    if (n < 0) return -1;
-
-    int count = 0;
-    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
-            int fd_bytes = cmsg->cmsg_len - CMSG_LEN(0);
-            count = fd_bytes / sizeof(int);
-            if (count > max_count) count = max_count;
-            memcpy(fds, CMSG_DATA(cmsg), count * sizeof(int));
-            break;
-        }
-    }
-
-    return count;
-}
-
 /* Start a hot-swap operation */
 int hotswap_start(int component_idx, const char *new_binary_path) {
     if (!hotswap_supported(component_idx)) {
@@ -248,8 +195,9 @@ int hotswap_transfer_fds(hotswap_context_t *ctx) {
         return -1;
     }
 
-    /* Transfer file descriptors */
-    if (send_fds(ctx->swap_socket_pair[0], ctx->fds_to_transfer, ctx->n_fds) < 0) {
+    /* Transfer file descriptors, with their descriptions, in as many
+     * messages as it takes */
+    if (handoff_send(ctx->swap_socket_pair[0], ctx->fds_to_transfer, ctx->n_fds) < 0) {
         LOG_ERR("failed to transfer file descriptors: %s", strerror(errno));
         ctx->state = SWAP_FAILED;
         return -1;
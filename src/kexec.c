@@ -8,6 +8,9 @@
 #include "component.h"
 #include "checkpoint.h"
 #include "checkpoint-mgmt.h"
+#include "checkpoint-catalog.h"
+#include "graph.h"
+#include "timer.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,6 +19,7 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <sys/syscall.h>
 #include <sys/utsname.h>
 #include <sys/statvfs.h>
@@ -23,6 +27,7 @@
 #include <linux/reboot.h>
 #include <time.h>
 #include <dirent.h>
+#include <signal.h>
 
 /* Default checkpoint directory that survives kexec */
 #define DEFAULT_CHECKPOINT_DIR "/checkpoint"
@@ -48,6 +53,8 @@
 static int kexec_initialized = 0;
 static char current_kernel_version[256];
 static char checkpoint_base_dir[MAX_KERNEL_PATH];
+static int checkpoint_parallel = 0;      /* concurrent CRIU dumps, 0 = one per CPU */
+static int pre_dump_passes = CHECKPOINT_PRE_DUMP_PASSES; /* per component, 0 = full dumps */
 
 /* Initialize kexec subsystem */
 int kexec_init(void) {
@@ -77,6 +84,14 @@ int kexec_init(void) {
                 strcpy(checkpoint_base_dir, parsed_dir);
                 LOG_INFO("using checkpoint directory from cmdline: %s", checkpoint_base_dir);
             }
+            const char *parallel = strstr(cmdline, "yakiros.checkpoint_parallel=");
+            if (parallel) {
+                kexec_set_checkpoint_parallel(atoi(parallel + strlen("yakiros.checkpoint_parallel=")));
+            }
+            const char *passes = strstr(cmdline, "yakiros.pre_dump_passes=");
+            if (passes) {
+                kexec_set_pre_dump_passes(atoi(passes + strlen("yakiros.pre_dump_passes=")));
+            }
         }
         fclose(cmdline_file);
     }
@@ -498,7 +513,356 @@ static int validate_all_checkpoints(const checkpoint_manifest_t *manifest) {
     return KEXEC_SUCCESS;
 }
 
-/* Create checkpoints of all managed processes */
+void kexec_set_checkpoint_parallel(int max_parallel) {
+    checkpoint_parallel = max_parallel > 0 ? max_parallel : 0;
+}
+
+void kexec_set_pre_dump_passes(int passes) {
+    pre_dump_passes = passes > 0 ? passes : 0;
+}
+
+/* One CRIU pre-dump in flight */
+typedef struct {
+    int      comp;                        /* component index */
+    pid_t    criu_pid;
+    uint64_t started_ms;
+    char     path[MAX_CHECKPOINT_PATH];
+} criu_job_t;
+
+/* Whether a CRIU process has finished: 1 with *result set, 0 if still
+ * running. Kills it once it has run for CHECKPOINT_DEFAULT_TIMEOUT. */
+static int criu_collect(void *ctx, pid_t pid, uint64_t started_ms, uint64_t now, int *result) {
+    (void)ctx;
+    int status;
+    pid_t r = waitpid(pid, &status, WNOHANG);
+    if (r == pid) {
+        *result = criu_exit_result(status);
+    } else if (r < 0) {
+        LOG_ERR("waitpid failed: %s", strerror(errno));
+        *result = CHECKPOINT_ERROR_RESTORE_FAILED;
+    } else if (now - started_ms >= CHECKPOINT_DEFAULT_TIMEOUT * 1000ULL) {
+        LOG_ERR("CRIU command timed out after %d seconds", CHECKPOINT_DEFAULT_TIMEOUT);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0); /* Clean up zombie */
+        *result = CHECKPOINT_ERROR_TIMEOUT;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+static int criu_job_done(criu_job_t *job, uint64_t now, int *result) {
+    if (!criu_collect(NULL, job->criu_pid, job->started_ms, now, result)) return 0;
+    job->criu_pid = 0;
+    return 1;
+}
+
+/* Nothing finished this round: wait a little before looking again */
+static void criu_jobs_pause(void *ctx) {
+    (void)ctx;
+    struct timespec ts = { 0, 5 * 1000 * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+static int criu_workers(int count) {
+    int workers = checkpoint_parallel;
+    if (workers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (int)cpus : 1;
+    }
+    return workers < count ? workers : count;
+}
+
+/* A process kexec_schedule() has running */
+typedef struct {
+    int      node;
+    pid_t    pid;                         /* 0 if the slot is free */
+    uint64_t started_ms;
+} schedule_slot_t;
+
+/* node is done: the nodes waiting for it may go next, unless the
+ * schedule is to stop */
+static void schedule_done(const kexec_schedule_ops_t *ops, int node, int result,
+                          uint64_t took_ms, int count, const unsigned char *todo,
+                          int *waiting, int *ready, int *n_ready, int *stopped) {
+    if (ops->finished(ops->ctx, node, result, took_ms) < 0) {
+        *stopped = 1;
+        return;
+    }
+    const int *next = NULL;
+    int n = ops->released(ops->ctx, node, &next);
+    for (int k = 0; k < n; k++) {
+        int f = next[k];
+        if (f >= 0 && f < count && f != node && todo[f] && waiting[f] > 0 && --waiting[f] == 0) {
+            ready[(*n_ready)++] = f;
+        }
+    }
+}
+
+int kexec_schedule(const kexec_schedule_ops_t *ops, int count, unsigned char *todo,
+                   int *waiting, int workers) {
+    if (workers < 1) workers = 1;
+    int *ready = malloc((size_t)(count > 0 ? count : 1) * sizeof(int));
+    schedule_slot_t *slots = calloc((size_t)workers, sizeof(*slots));
+    if (!ready || !slots) {
+        free(ready);
+        free(slots);
+        return -1;
+    }
+
+    /* Popped from the end: lower nodes first */
+    int total = 0, n_ready = 0;
+    for (int i = count - 1; i >= 0; i--) {
+        total += todo[i] != 0;
+        if (todo[i] && waiting[i] == 0) ready[n_ready++] = i;
+    }
+
+    int running = 0, started = 0, stopped = 0;
+    while (running > 0 || (!stopped && started < total)) {
+        /* Fill free slots with nodes nothing unfinished holds back */
+        for (int w = 0; w < workers && !stopped && n_ready > 0; w++) {
+            if (slots[w].pid > 0) continue;
+            int node = ready[--n_ready];
+            todo[node] = 0;
+            started++;
+            pid_t pid = ops->start(ops->ctx, node);
+            if (pid <= 0) {
+                schedule_done(ops, node, pid < 0 ? (int)pid : -1, 0, count, todo, waiting,
+                              ready, &n_ready, &stopped);
+                w--;    /* the slot is still free */
+                continue;
+            }
+            slots[w].node = node;
+            slots[w].pid = pid;
+            slots[w].started_ms = timer_now_ms();
+            running++;
+        }
+
+        if (running == 0) {
+            if (stopped || started == total || n_ready > 0) continue;
+            /* Only dependency cycles left: break one open */
+            for (int i = 0; i < count; i++) {
+                if (todo[i]) {
+                    ops->cycle(ops->ctx, i);
+                    waiting[i] = 0;
+                    ready[n_ready++] = i;
+                    break;
+                }
+            }
+            continue;
+        }
+
+        int finished = 0;
+        uint64_t now = timer_now_ms();
+        for (int w = 0; w < workers; w++) {
+            schedule_slot_t *slot = &slots[w];
+            int result;
+            if (slot->pid <= 0 || !ops->collect(ops->ctx, slot->pid, slot->started_ms, now, &result)) {
+                continue;
+            }
+            slot->pid = 0;
+            running--;
+            finished++;
+            schedule_done(ops, slot->node, result, now - slot->started_ms, count, todo,
+                          waiting, ready, &n_ready, &stopped);
+        }
+
+        if (!finished) {
+            ops->pause(ops->ctx);
+        }
+    }
+
+    free(ready);
+    free(slots);
+    return started;
+}
+
+/* Where a component's images go, and what its pre-dumps left there */
+typedef struct {
+    char   id[CHECKPOINT_ID_MAX_LEN];
+    char   path[MAX_CHECKPOINT_PATH];
+    int    passes;                        /* pre-dumps completed */
+    size_t dirty;                         /* pages the last one wrote */
+    int    settled;                       /* no more passes */
+} checkpoint_image_t;
+
+/* Start pre-dump pass image->passes + 1 of component idx */
+static int pre_dump_job_start(criu_job_t *job, int idx, checkpoint_image_t *image) {
+    component_t *comp = &components[idx];
+    char name[32], prev_name[32], prev[40];
+
+    checkpoint_pre_dump_dir(image->passes + 1, name, sizeof(name));
+    int len = snprintf(job->path, sizeof(job->path), "%s/%s", image->path, name);
+    if (len < 0 || (size_t)len >= sizeof(job->path)) {
+        LOG_WARN("checkpoint path of %s too long to pre-dump into", comp->name);
+        return -1;
+    }
+    if (image->passes > 0) {
+        checkpoint_pre_dump_dir(image->passes, prev_name, sizeof(prev_name));
+        snprintf(prev, sizeof(prev), "../%s", prev_name);
+    }
+
+    pid_t criu_pid = criu_pre_dump_start(comp->pid, job->path,
+                                         image->passes > 0 ? prev : NULL);
+    if (criu_pid < 0) {
+        LOG_WARN("CRIU pre-dump failed for %s: %s",
+                 comp->name, checkpoint_error_string(criu_pid));
+        return -1;
+    }
+
+    job->comp = idx;
+    job->criu_pid = criu_pid;
+    job->started_ms = timer_now_ms();
+    return 0;
+}
+
+/* Pre-dump every component about to be checkpointed while they all keep
+ * serving. Nothing is frozen, so there is no order to respect: passes run
+ * in rounds over all of them, and a component drops out once its dirty
+ * set settles. A failed pass only means its final dump builds on fewer. */
+static void pre_dump_all(const unsigned char *todo, checkpoint_image_t *images,
+                         int count, criu_job_t *jobs, int workers) {
+    uint64_t started_ms = timer_now_ms();
+    int next = 0, running = 0, rounds = 1;
+
+    for (;;) {
+        for (int w = 0; w < workers && next < count; w++) {
+            if (jobs[w].criu_pid > 0) continue;
+            while (next < count && (!todo[next] || images[next].settled)) next++;
+            if (next == count) break;
+            int idx = next++;
+            if (pre_dump_job_start(&jobs[w], idx, &images[idx]) < 0) {
+                images[idx].settled = 1;
+                continue;
+            }
+            running++;
+        }
+
+        if (running == 0) {
+            if (next < count) continue;
+            /* Round over: go again for whoever is still converging */
+            int unsettled = 0;
+            for (int i = 0; i < count; i++) {
+                unsettled += todo[i] && !images[i].settled;
+            }
+            if (!unsettled) break;
+            next = 0;
+            rounds++;
+            continue;
+        }
+
+        int finished = 0;
+        uint64_t now = timer_now_ms();
+        for (int w = 0; w < workers; w++) {
+            criu_job_t *job = &jobs[w];
+            if (job->criu_pid <= 0) continue;
+
+            int result;
+            if (!criu_job_done(job, now, &result)) continue;
+            running--;
+            finished++;
+
+            checkpoint_image_t *image = &images[job->comp];
+            if (result != CHECKPOINT_SUCCESS) {
+                LOG_WARN("CRIU pre-dump failed for %s: %s (see %s/%s), dumping on top of "
+                         "%d pass(es)", components[job->comp].name,
+                         checkpoint_error_string(result), job->path,
+                         CHECKPOINT_PRE_DUMP_LOG, image->passes);
+                image->settled = 1;
+                continue;
+            }
+
+            size_t dirty = checkpoint_pages_size(job->path);
+            image->passes++;
+            LOG_INFO("pre-dump %d of %s wrote %zu KB in %llu ms", image->passes,
+                     components[job->comp].name, dirty / 1024,
+                     (unsigned long long)(now - job->started_ms));
+            image->settled = !checkpoint_pre_dump_again(image->passes, pre_dump_passes,
+                                                        image->dirty, dirty);
+            image->dirty = dirty;
+        }
+
+        if (!finished) {
+            criu_jobs_pause(NULL);
+        }
+    }
+
+    LOG_INFO("pre-dumped in %d round(s) over %llu ms", rounds,
+             (unsigned long long)(timer_now_ms() - started_ms));
+}
+
+/* What kexec_checkpoint_all() schedules over, by component index */
+typedef struct {
+    checkpoint_manifest_t *manifest;
+    checkpoint_image_t    *images;
+    int                    total;
+} dump_schedule_t;
+
+/* Start the final dump of component idx, on top of its newest pre-dump
+ * if there is one */
+static pid_t dump_start(void *ctx, int idx) {
+    dump_schedule_t *sched = ctx;
+    const checkpoint_image_t *image = &sched->images[idx];
+    component_t *comp = &components[idx];
+    LOG_INFO("checkpointing component: %s (pid %d)", comp->name, comp->pid);
+
+    char parent[32];
+    checkpoint_pre_dump_dir(image->passes, parent, sizeof(parent));
+    return criu_checkpoint_start(comp->pid, image->path, 1, /* leave running */
+                                 image->passes > 0 ? parent : NULL);
+}
+
+/* Any failure aborts the checkpoint: the old kernel keeps running */
+static int dump_finished(void *ctx, int idx, int result, uint64_t took) {
+    dump_schedule_t *sched = ctx;
+    const checkpoint_image_t *image = &sched->images[idx];
+    component_t *comp = &components[idx];
+    if (result != CHECKPOINT_SUCCESS) {
+        LOG_ERR("CRIU checkpoint failed for %s: %s (see %s/%s)",
+                comp->name, checkpoint_error_string(result),
+                image->path, CHECKPOINT_DUMP_LOG);
+        return -1;
+    }
+    LOG_INFO("checkpointed %s in %llu ms", comp->name, (unsigned long long)took);
+
+    checkpoint_manifest_t *manifest = sched->manifest;
+    checkpoint_manifest_entry_t *entry = &manifest->entries[manifest->entry_count];
+    strcpy(entry->component_name, comp->name);
+    strcpy(entry->checkpoint_id, image->id);
+    strcpy(entry->checkpoint_path, image->path);
+    entry->original_pid = comp->pid;
+    entry->timestamp = time(NULL);
+    entry->checkpoint_ms = (uint32_t)took;
+    entry->pre_dump_passes = (uint32_t)image->passes;
+    /* Providers finish last, and are restored first */
+    entry->restore_priority = sched->total - 1 - (int)manifest->entry_count;
+    manifest->entry_count++;
+    return 0;
+}
+
+/* Its providers may be next */
+static int dump_released(void *ctx, int idx, const int **nodes) {
+    (void)ctx;
+    return graph_direct_dependencies(idx, nodes);
+}
+
+static void dump_cycle(void *ctx, int idx) {
+    (void)ctx;
+    LOG_WARN("%s is on a dependency cycle, checkpointing it before "
+             "what depends on it", components[idx].name);
+}
+
+/* Create checkpoints of all managed processes
+ *
+ * Dumps run concurrently, at most checkpoint_parallel at a time, in
+ * dependency order from the leaves: a provider is only frozen once every
+ * active component requiring it has been dumped, so consumers stop before
+ * what they consume. Components on a dependency cycle are started one at
+ * a time once nothing else can run.
+ *
+ * Before that, up to pre_dump_passes CRIU pre-dumps of every component
+ * run while the system keeps serving, so each final dump, and the pause
+ * it imposes, only covers the memory dirtied since. */
 int kexec_checkpoint_all(const char *checkpoint_dir, checkpoint_manifest_t **manifest) {
     if (!checkpoint_dir || !manifest) {
         return KEXEC_ERROR_CHECKPOINT_FAILED;
@@ -525,8 +889,15 @@ int kexec_checkpoint_all(const char *checkpoint_dir, checkpoint_manifest_t **man
     size_t manifest_size = sizeof(checkpoint_manifest_t) +
                           component_count * sizeof(checkpoint_manifest_entry_t);
     *manifest = calloc(1, manifest_size);
-    if (!*manifest) {
+    int *waiting = calloc((size_t)component_count, sizeof(int));  /* undumped active dependents */
+    unsigned char *todo = calloc((size_t)component_count, 1);
+    int workers = criu_workers(component_count);
+    criu_job_t *jobs = calloc((size_t)workers, sizeof(criu_job_t));
+    checkpoint_image_t *images = calloc((size_t)component_count, sizeof(checkpoint_image_t));
+    if (!*manifest || !waiting || !todo || !jobs || !images) {
         LOG_ERR("failed to allocate checkpoint manifest");
+        free(*manifest); free(waiting); free(todo); free(jobs); free(images);
+        *manifest = NULL;
         return KEXEC_ERROR_CHECKPOINT_FAILED;
     }
 
@@ -536,50 +907,63 @@ int kexec_checkpoint_all(const char *checkpoint_dir, checkpoint_manifest_t **man
     (*manifest)->creation_time = time(NULL);
     strcpy((*manifest)->old_kernel_version, current_kernel_version);
 
-    /* Checkpoint each active component */
+    /* Count, for every active component, the active ones requiring it */
+    int total = 0;
     for (int i = 0; i < component_count; i++) {
-        component_t *comp = &components[i];
-        if (!comp || comp->state != COMP_ACTIVE) {
-            continue; /* Skip inactive components */
-        }
-
-        LOG_INFO("checkpointing component: %s (pid %d)", comp->name, comp->pid);
-
-        /* Create checkpoint */
-        char checkpoint_id[CHECKPOINT_ID_MAX_LEN];
-        char checkpoint_path[MAX_CHECKPOINT_PATH];
-
-        int result = checkpoint_create_directory(comp->name, 0, /* temporary */
-                                               checkpoint_id, sizeof(checkpoint_id),
-                                               checkpoint_path, sizeof(checkpoint_path));
-        if (result != 0) {
-            LOG_ERR("failed to create checkpoint directory for %s", comp->name);
-            free(*manifest);
-            return KEXEC_ERROR_CHECKPOINT_FAILED;
+        todo[i] = components[i].state == COMP_ACTIVE && components[i].pid > 0;
+        total += todo[i];
+    }
+    for (int i = 0; i < component_count; i++) {
+        const int *deps = NULL;
+        int n_deps = todo[i] ? graph_direct_dependencies(i, &deps) : 0;
+        for (int d = 0; d < n_deps; d++) {
+            if (deps[d] != i && todo[deps[d]]) waiting[deps[d]]++;
         }
+    }
 
-        /* Perform CRIU checkpoint */
-        result = criu_checkpoint_process(comp->pid, checkpoint_path, 1); /* leave running */
-        if (result != CHECKPOINT_SUCCESS) {
-            LOG_ERR("CRIU checkpoint failed for %s: %s",
-                     comp->name, checkpoint_error_string(result));
-            free(*manifest);
-            return KEXEC_ERROR_CHECKPOINT_FAILED;
+    uint64_t started_ms = timer_now_ms();
+    int failed = 0;
+    for (int i = 0; i < component_count && !failed; i++) {
+        if (todo[i] && checkpoint_create_directory(components[i].name, 0, /* temporary */
+                                                   images[i].id, sizeof(images[i].id),
+                                                   images[i].path, sizeof(images[i].path)) != 0) {
+            LOG_ERR("failed to create checkpoint directory for %s", components[i].name);
+            failed = 1;
         }
-
-        /* Add to manifest */
-        checkpoint_manifest_entry_t *entry = &(*manifest)->entries[(*manifest)->entry_count];
-        strcpy(entry->component_name, comp->name);
-        strcpy(entry->checkpoint_id, checkpoint_id);
-        strcpy(entry->checkpoint_path, checkpoint_path);
-        entry->original_pid = comp->pid;
-        entry->timestamp = time(NULL);
-        entry->restore_priority = i; /* Restore in original order */
-
-        (*manifest)->entry_count++;
+    }
+    if (!failed && pre_dump_passes > 0) {
+        pre_dump_all(todo, images, component_count, jobs, workers);
+    }
+
+    uint64_t frozen_ms = timer_now_ms();
+    if (!failed) {
+        dump_schedule_t sched = { .manifest = *manifest, .images = images, .total = total };
+        kexec_schedule_ops_t ops = {
+            .ctx = &sched, .start = dump_start, .collect = criu_collect,
+            .finished = dump_finished, .released = dump_released,
+            .cycle = dump_cycle, .pause = criu_jobs_pause,
+        };
+        kexec_schedule(&ops, component_count, todo, waiting, workers);
+        failed = (int)(*manifest)->entry_count != total;
+    }
+
+    uint64_t took = timer_now_ms() - started_ms;
+    uint64_t final_ms = timer_now_ms() - frozen_ms;
+    free(waiting);
+    free(todo);
+    free(jobs);
+    free(images);
+
+    if (failed) {
+        LOG_ERR("checkpointing aborted after %llu ms", (unsigned long long)took);
+        free(*manifest);
+        *manifest = NULL;
+        return KEXEC_ERROR_CHECKPOINT_FAILED;
     }
 
-    LOG_INFO("successfully checkpointed %d components", (*manifest)->entry_count);
+    LOG_INFO("successfully checkpointed %d components in %llu ms, %llu ms of it "
+             "final dumps (%d at a time)", (*manifest)->entry_count,
+             (unsigned long long)took, (unsigned long long)final_ms, workers);
     return KEXEC_SUCCESS;
 }
 
@@ -631,6 +1015,7 @@ int kexec_load_kernel(const char *kernel_path, const char *initrd_path, const ch
 /* Execute kexec (no return on success) */
 int kexec_execute(void) {
     LOG_INFO("executing kexec - transferring to new kernel (no return expected)");
+    log_flush();
 
     /* Sync filesystems before kexec */
     sync();
@@ -679,7 +1064,9 @@ int kexec_save_manifest(const char *checkpoint_dir, const checkpoint_manifest_t
         fprintf(fp, "      \"checkpoint_path\": \"%s\",\n", entry->checkpoint_path);
         fprintf(fp, "      \"original_pid\": %d,\n", entry->original_pid);
         fprintf(fp, "      \"timestamp\": %lu,\n", entry->timestamp);
-        fprintf(fp, "      \"restore_priority\": %d\n", entry->restore_priority);
+        fprintf(fp, "      \"restore_priority\": %d,\n", entry->restore_priority);
+        fprintf(fp, "      \"checkpoint_ms\": %u,\n", entry->checkpoint_ms);
+        fprintf(fp, "      \"pre_dump_passes\": %u\n", entry->pre_dump_passes);
         fprintf(fp, "    }%s\n", (i < manifest->entry_count - 1) ? "," : "");
     }
 
@@ -1034,6 +1421,12 @@ int kexec_load_manifest(const char *checkpoint_dir, checkpoint_manifest_t **mani
                 if ((field_ptr = strstr(ptr, "\"restore_priority\":")) != NULL && field_ptr < entry_end) {
                     sscanf(field_ptr, "\"restore_priority\": %d", &entry->restore_priority);
                 }
+                if ((field_ptr = strstr(ptr, "\"checkpoint_ms\":")) != NULL && field_ptr < entry_end) {
+                    sscanf(field_ptr, "\"checkpoint_ms\": %u", &entry->checkpoint_ms);
+                }
+                if ((field_ptr = strstr(ptr, "\"pre_dump_passes\":")) != NULL && field_ptr < entry_end) {
+                    sscanf(field_ptr, "\"pre_dump_passes\": %u", &entry->pre_dump_passes);
+                }
 
                 ptr = entry_end + 1;
             }
@@ -1048,7 +1441,73 @@ int kexec_load_manifest(const char *checkpoint_dir, checkpoint_manifest_t **mani
     return KEXEC_SUCCESS;
 }
 
-/* Restore all processes from checkpoint manifest */
+/* What kexec_restore_all() schedules over, by manifest entry */
+typedef struct {
+    const checkpoint_manifest_t *manifest;
+    const int *comp_of;                   /* component of each entry */
+    const int *entry_of;                  /* entry of each component, -1 for none */
+    int       *next;                      /* what restore_released() returns */
+    int        restored;
+    int        failed;
+} restore_schedule_t;
+
+static pid_t restore_start(void *ctx, int e) {
+    restore_schedule_t *sched = ctx;
+    const checkpoint_manifest_entry_t *entry = &sched->manifest->entries[e];
+    LOG_INFO("restoring component %s from checkpoint %s (original pid %d)",
+             entry->component_name, entry->checkpoint_id, entry->original_pid);
+    return criu_restore_start(entry->checkpoint_path);
+}
+
+/* A failed entry does not hold back what requires it */
+static int restore_finished(void *ctx, int e, int result, uint64_t took) {
+    restore_schedule_t *sched = ctx;
+    const checkpoint_manifest_entry_t *entry = &sched->manifest->entries[e];
+    pid_t restored_pid = result == CHECKPOINT_SUCCESS ?
+                         criu_restore_pid(entry->checkpoint_path) : result;
+    if (restored_pid < 0) {
+        LOG_ERR("CRIU restore failed for %s: %s (see %s/%s)",
+                entry->component_name, checkpoint_error_string(restored_pid),
+                entry->checkpoint_path, CHECKPOINT_RESTORE_LOG);
+        sched->failed++;
+        return 0;
+    }
+    LOG_INFO("successfully restored %s in %llu ms: old pid %d -> new pid %d",
+             entry->component_name, (unsigned long long)took,
+             entry->original_pid, restored_pid);
+    component_adopt(sched->comp_of[e], restored_pid);
+    sched->restored++;
+    return 0;
+}
+
+/* The entries of the components requiring entry e's */
+static int restore_released(void *ctx, int e, const int **nodes) {
+    restore_schedule_t *sched = ctx;
+    const int *dependents = NULL;
+    int n = graph_direct_dependents(sched->comp_of[e], &dependents);
+    int count = 0;
+    for (int k = 0; k < n; k++) {
+        int f = sched->entry_of[dependents[k]];
+        if (f >= 0) sched->next[count++] = f;
+    }
+    *nodes = sched->next;
+    return count;
+}
+
+static void restore_cycle(void *ctx, int e) {
+    restore_schedule_t *sched = ctx;
+    LOG_WARN("%s is on a dependency cycle, restoring it before "
+             "what it depends on", sched->manifest->entries[e].component_name);
+}
+
+/* Restore all processes from checkpoint manifest
+ *
+ * Providers come back before their consumers: an entry is restored once
+ * every entry providing what it requires has been, and independent
+ * entries are restored concurrently, at most checkpoint_parallel at a
+ * time. A restored component is ACTIVE with its capabilities registered
+ * as soon as its CRIU process returns, so its consumers follow at once.
+ * The component declarations must already be loaded. */
 int kexec_restore_all(const char *checkpoint_dir, const checkpoint_manifest_t *manifest) {
     if (!checkpoint_dir || !manifest) {
         return KEXEC_ERROR_CHECKPOINT_FAILED;
@@ -1061,22 +1520,45 @@ int kexec_restore_all(const char *checkpoint_dir, const checkpoint_manifest_t *m
         return KEXEC_SUCCESS;
     }
 
-    /* Sort entries by restore priority (lower number = restore first) */
-    /* For simplicity, we'll restore in the order they appear (which should be priority order) */
+    int count = (int)manifest->entry_count;
+    int *comp_of = malloc((size_t)count * sizeof(int));
+    int *entry_of = malloc((size_t)(n_components > 0 ? n_components : 1) * sizeof(int));
+    int *waiting = calloc((size_t)count, sizeof(int));   /* unrestored providers */
+    int *next = malloc((size_t)(n_components > 0 ? n_components : 1) * sizeof(int));
+    unsigned char *todo = calloc((size_t)count, 1);
+    if (!comp_of || !entry_of || !waiting || !next || !todo) {
+        LOG_ERR("failed to allocate restore schedule");
+        free(comp_of); free(entry_of); free(waiting); free(next); free(todo);
+        return KEXEC_ERROR_CHECKPOINT_FAILED;
+    }
 
-    int restored_count = 0;
-    int failed_count = 0;
+    restore_schedule_t sched = { .manifest = manifest, .comp_of = comp_of,
+                                 .entry_of = entry_of, .next = next };
+    int total = 0;
 
-    for (uint32_t i = 0; i < manifest->entry_count; i++) {
-        const checkpoint_manifest_entry_t *entry = &manifest->entries[i];
+    for (int i = 0; i < n_components; i++) entry_of[i] = -1;
+    for (int e = 0; e < count; e++) {
+        const checkpoint_manifest_entry_t *entry = &manifest->entries[e];
+        comp_of[e] = -1;
 
-        LOG_INFO("restoring component %s from checkpoint %s (original pid %d)",
-                 entry->component_name, entry->checkpoint_id, entry->original_pid);
+        int idx = -1;
+        for (int i = 0; i < n_components; i++) {
+            if (strcmp(components[i].name, entry->component_name) == 0) {
+                idx = i;
+                break;
+            }
+        }
+        if (idx < 0) {
+            LOG_ERR("%s is no longer declared, not restoring checkpoint %s",
+                    entry->component_name, entry->checkpoint_id);
+            sched.failed++;
+            continue;
+        }
 
         /* Validate checkpoint still exists */
         if (access(entry->checkpoint_path, F_OK) != 0) {
             LOG_ERR("checkpoint path no longer exists: %s", entry->checkpoint_path);
-            failed_count++;
+            sched.failed++;
             continue;
         }
 
@@ -1085,32 +1567,49 @@ int kexec_restore_all(const char *checkpoint_dir, const checkpoint_manifest_t *m
         if (validation_result != CHECKPOINT_SUCCESS) {
             LOG_ERR("checkpoint validation failed for %s: %s",
                      entry->component_name, checkpoint_error_string(validation_result));
-            failed_count++;
-            continue;
-        }
-
-        /* Restore the process using CRIU */
-        pid_t restored_pid = criu_restore_process(entry->checkpoint_path);
-        if (restored_pid < 0) {
-            LOG_ERR("CRIU restore failed for %s: %s",
-                     entry->component_name, checkpoint_error_string(restored_pid));
-            failed_count++;
+            sched.failed++;
             continue;
         }
 
-        LOG_INFO("successfully restored %s: old pid %d -> new pid %d",
-                 entry->component_name, entry->original_pid, restored_pid);
+        comp_of[e] = idx;
+        entry_of[idx] = e;
+        todo[e] = 1;
+        total++;
+    }
 
-        /* Update component record with new PID */
-        /* Note: This assumes component structures are available -
-         * in practice we'd need to reload component configurations first */
+    /* Count, for every entry, the entries providing what it requires */
+    for (int e = 0; e < count; e++) {
+        const int *deps = NULL;
+        int n_deps = todo[e] ? graph_direct_dependencies(comp_of[e], &deps) : 0;
+        for (int d = 0; d < n_deps; d++) {
+            int f = entry_of[deps[d]];
+            if (f >= 0 && f != e) waiting[e]++;
+        }
+    }
 
-        restored_count++;
+    int workers = criu_workers(total > 0 ? total : 1);
+    uint64_t started_ms = timer_now_ms();
+    kexec_schedule_ops_t ops = {
+        .ctx = &sched, .start = restore_start, .collect = criu_collect,
+        .finished = restore_finished, .released = restore_released,
+        .cycle = restore_cycle, .pause = criu_jobs_pause,
+    };
+    if (kexec_schedule(&ops, count, todo, waiting, workers) < 0) {
+        LOG_ERR("failed to allocate restore schedule");
+        sched.failed += total;
     }
 
-    LOG_INFO("restoration complete: %d successful, %d failed", restored_count, failed_count);
+    uint64_t took = timer_now_ms() - started_ms;
+    free(comp_of);
+    free(entry_of);
+    free(waiting);
+    free(next);
+    free(todo);
 
-    if (failed_count > 0) {
+    LOG_INFO("restoration complete: %d successful, %d failed in %llu ms (%d at a time)",
+             sched.restored, sched.failed, (unsigned long long)took, workers);
+
+    if (sched.failed > 0) {
         LOG_WARN("some processes failed to restore - system may be partially functional");
         return KEXEC_ERROR_CHECKPOINT_FAILED;
     }
@@ -1135,6 +1634,14 @@ int kexec_cleanup_checkpoints(const char *checkpoint_dir) {
                  manifest_path, strerror(errno));
     }
 
+    /* The directories go below, so the catalog goes with them */
+    char catalog_path[2048];
+    snprintf(catalog_path, sizeof(catalog_path), "%s/%s", checkpoint_dir, CHECKPOINT_CATALOG_FILE);
+    if (unlink(catalog_path) != 0 && errno != ENOENT) {
+        LOG_WARN("failed to remove checkpoint catalog %s: %s",
+                 catalog_path, strerror(errno));
+    }
+
     /* Remove checkpoint directories */
     DIR *dir = opendir(checkpoint_dir);
     if (dir) {
@@ -57,6 +57,8 @@ typedef struct {
     pid_t original_pid;
     uint64_t timestamp;
     int restore_priority;                 /* Lower number = restore first */
+    uint32_t checkpoint_ms;               /* How long the dump took */
+    uint32_t pre_dump_passes;             /* Pre-dumps the dump builds on */
 } checkpoint_manifest_entry_t;
 
 /* Checkpoint manifest structure */
@@ -116,7 +118,22 @@ int kexec_validate_initrd(const char *initrd_path);
 int kexec_check_ready(void);
 
 /**
- * Create checkpoints of all managed processes
+ * Set how many CRIU dumps kexec_checkpoint_all() runs at once
+ * (yakiros.checkpoint_parallel=N on the kernel command line)
+ * @param max_parallel Concurrent dumps, 0 for one per online CPU
+ */
+void kexec_set_checkpoint_parallel(int max_parallel);
+
+/**
+ * Set how many CRIU pre-dump passes kexec_checkpoint_all() runs per
+ * component before the final dump (yakiros.pre_dump_passes=N)
+ * @param passes At most this many passes, 0 for full dumps only
+ */
+void kexec_set_pre_dump_passes(int passes);
+
+/**
+ * Create checkpoints of all managed processes, dependents before their
+ * providers and independent components concurrently
  * @param checkpoint_dir Directory to store checkpoints
  * @param manifest Output manifest of created checkpoints
  * @return KEXEC_SUCCESS on success, error code on failure
@@ -124,14 +141,50 @@ int kexec_check_ready(void);
 int kexec_checkpoint_all(const char *checkpoint_dir, checkpoint_manifest_t **manifest);
 
 /**
- * Restore all processes from checkpoint manifest
- * Called during system startup after kexec
+ * Restore all processes from checkpoint manifest, providers before their
+ * consumers and independent components concurrently; each one is ACTIVE
+ * with its capabilities registered as soon as CRIU returns
+ * Called during system startup after kexec, once components are loaded
  * @param checkpoint_dir Directory containing checkpoints
  * @param manifest Checkpoint manifest to restore from
  * @return KEXEC_SUCCESS on success, error code on failure
  */
 int kexec_restore_all(const char *checkpoint_dir, const checkpoint_manifest_t *manifest);
 
+/* How kexec_schedule() runs one process per node, CRIU's for the two
+ * callers above */
+typedef struct {
+    void  *ctx;
+    /* Start node's process: its pid, or a negative error */
+    pid_t (*start)(void *ctx, int node);
+    /* Whether pid finished: 1 with *result set, 0 while it runs */
+    int   (*collect)(void *ctx, pid_t pid, uint64_t started_ms, uint64_t now, int *result);
+    /* node is done with result, a start error included, after took_ms:
+     * 0 to go on, -1 to start nothing more */
+    int   (*finished)(void *ctx, int node, int result, uint64_t took_ms);
+    /* The nodes that may be waiting for node */
+    int   (*released)(void *ctx, int node, const int **nodes);
+    /* Only a dependency cycle is left: node goes first anyway */
+    void  (*cycle)(void *ctx, int node);
+    /* Nothing finished in a round: wait a little */
+    void  (*pause)(void *ctx);
+} kexec_schedule_ops_t;
+
+/**
+ * Run ops over the nodes with todo set, at most workers at a time. A
+ * node starts once waiting[node] of the nodes releasing it are done, a
+ * failed one included; with only cycles left, the first one waiting
+ * starts. Nodes are cleared from todo as they start.
+ * @param ops Callbacks the schedule runs on
+ * @param count Number of nodes
+ * @param todo Nodes to run
+ * @param waiting For every node, the nodes it waits for
+ * @param workers Processes that may run at once
+ * @return Number of nodes started, -1 if out of memory
+ */
+int kexec_schedule(const kexec_schedule_ops_t *ops, int count, unsigned char *todo,
+                   int *waiting, int workers);
+
 /**
  * Load new kernel into memory using kexec_load()
  * @param kernel_path Path to kernel image
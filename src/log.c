@@ -3,33 +3,106 @@
  *
  * Centralized logging for the graph resolver system.
  * Uses /dev/kmsg for early boot logging before syslog is available.
+ *
+ * The async ring is a bounded multi-producer queue: a producer claims a
+ * slot by advancing ring_head with a compare-and-swap, formats its line
+ * in place and publishes it by bumping the slot's sequence number. The
+ * main loop is the only consumer. A producer that finds the ring full
+ * writes its line directly rather than lose it.
  */
 
+#define _GNU_SOURCE
 #include "log.h"
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <string.h>
 
 #define LOG_PATH "/dev/kmsg"   /* Early logging before syslog */
 #define MAX_LOG_LINE 1024
+#define LOG_FLUSH_BATCH 64     /* lines per writev() */
+
+typedef struct {
+    atomic_size_t seq;         /* == ticket: free, == ticket + 1: ready */
+    int           len;
+    char          text[MAX_LOG_LINE];
+} log_slot_t;
 
 static int log_fd = -1;
+static int log_is_kmsg = 0;
+
+static log_slot_t ring[LOG_RING_SLOTS];
+static atomic_size_t ring_head;    /* next ticket handed to a producer */
+static size_t ring_tail;           /* next ticket log_flush() reads */
+static atomic_int log_async;
 
 void log_open(void) {
-    log_fd = open(LOG_PATH, O_WRONLY | O_APPEND);
+    log_fd = open(LOG_PATH, O_WRONLY | O_APPEND | O_CLOEXEC);
+    log_is_kmsg = log_fd >= 0;
     if (log_fd < 0) {
         /* Fallback to stderr if /dev/kmsg unavailable */
         log_fd = STDERR_FILENO;
     }
 }
 
-void graph_log(const char *level, const char *fmt, ...) {
-    va_list ap;
-    char buf[MAX_LOG_LINE];
+/* A forked child must not queue lines nobody will flush */
+void log_forked(void) {
+    atomic_store(&log_async, 0);
+}
+
+void log_set_async(int on) {
+    static int atfork_done = 0;
+
+    if (on && !atomic_load(&log_async)) {
+        for (size_t i = 0; i < LOG_RING_SLOTS; i++) {
+            atomic_store_explicit(&ring[i].seq, i, memory_order_relaxed);
+        }
+        atomic_store(&ring_head, 0);
+        ring_tail = 0;
+        if (!atfork_done) {
+            pthread_atfork(NULL, NULL, log_forked);
+            atfork_done = 1;
+        }
+    } else if (!on) {
+        log_flush();
+    }
+    atomic_store(&log_async, on ? 1 : 0);
+}
+
+/* Claim a free slot; returns its ticket, or -1 if the ring is full */
+static intptr_t ring_reserve(void) {
+    size_t pos = atomic_load_explicit(&ring_head, memory_order_relaxed);
+
+    for (;;) {
+        log_slot_t *slot = &ring[pos & (LOG_RING_SLOTS - 1)];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring_head, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                return (intptr_t)pos;
+            }
+        } else if (diff < 0) {
+            return -1; /* the flusher has not caught up */
+        } else {
+            pos = atomic_load_explicit(&ring_head, memory_order_relaxed);
+        }
+    }
+}
+
+/* Format one newline-terminated line into buf, returns its length */
+static int format_line(char *buf, size_t size, const char *level,
+                       const char *fmt, va_list ap) {
     struct timeval tv;
     int n;
 
@@ -37,19 +110,95 @@ void graph_log(const char *level, const char *fmt, ...) {
     gettimeofday(&tv, NULL);
 
     /* Format: [timestamp] graph-resolver <level> message */
-    n = snprintf(buf, sizeof(buf), "[%5ld.%03ld] graph-resolver <%s> ",
+    n = snprintf(buf, size, "[%5ld.%03ld] graph-resolver <%s> ",
                  tv.tv_sec % 100000, tv.tv_usec / 1000, level);
 
     /* Add the actual message */
-    va_start(ap, fmt);
-    n += vsnprintf(buf + n, sizeof(buf) - n, fmt, ap);
-    va_end(ap);
+    int m = vsnprintf(buf + n, size - n, fmt, ap);
+    if (m > 0) n += m;
+    if (n > (int)size - 1) n = (int)size - 1;
 
     /* Ensure newline termination */
-    if (n > 0 && n < (int)sizeof(buf) - 1 && buf[n - 1] != '\n') {
+    if (n > 0 && buf[n - 1] != '\n') {
+        if (n == (int)size - 1) n--;
         buf[n++] = '\n';
     }
+    return n;
+}
+
+void graph_log(const char *level, const char *fmt, ...) {
+    va_list ap;
+
+    if (atomic_load_explicit(&log_async, memory_order_relaxed)) {
+        intptr_t ticket = ring_reserve();
+        if (ticket >= 0) {
+            log_slot_t *slot = &ring[(size_t)ticket & (LOG_RING_SLOTS - 1)];
+            va_start(ap, fmt);
+            slot->len = format_line(slot->text, sizeof(slot->text), level, fmt, ap);
+            va_end(ap);
+            atomic_store_explicit(&slot->seq, (size_t)ticket + 1, memory_order_release);
+            return;
+        }
+    }
+
+    char buf[MAX_LOG_LINE];
+    va_start(ap, fmt);
+    int n = format_line(buf, sizeof(buf), level, fmt, ap);
+    va_end(ap);
 
     /* Write to log destination */
     (void)!write(log_fd, buf, n);
-}
\ No newline at end of file
+}
+
+/* writev() the whole batch, picking up after short writes */
+static void write_batch(struct iovec *iov, int n) {
+    while (n > 0) {
+        ssize_t w = writev(log_fd, iov, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        while (n > 0 && (size_t)w >= iov->iov_len) {
+            w -= (ssize_t)iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char *)iov->iov_base + w;
+            iov->iov_len -= (size_t)w;
+        }
+    }
+}
+
+void log_flush(void) {
+    struct iovec iov[LOG_FLUSH_BATCH];
+
+    for (;;) {
+        size_t pos = ring_tail;
+        int n = 0;
+
+        while (n < LOG_FLUSH_BATCH) {
+            log_slot_t *slot = &ring[pos & (LOG_RING_SLOTS - 1)];
+            if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1) break;
+            iov[n].iov_base = slot->text;
+            iov[n].iov_len = (size_t)slot->len;
+            n++;
+            pos++;
+        }
+        if (n == 0) return;
+
+        if (log_is_kmsg) {
+            /* /dev/kmsg makes one record per write, so no writev there */
+            for (int i = 0; i < n; i++) {
+                (void)!write(log_fd, iov[i].iov_base, iov[i].iov_len);
+            }
+        } else {
+            write_batch(iov, n);
+        }
+
+        for (; ring_tail != pos; ring_tail++) {
+            atomic_store_explicit(&ring[ring_tail & (LOG_RING_SLOTS - 1)].seq,
+                                  ring_tail + LOG_RING_SLOTS, memory_order_release);
+        }
+    }
+}
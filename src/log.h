@@ -3,6 +3,11 @@
  *
  * Provides centralized logging for the graph resolver and its modules.
  * Writes to /dev/kmsg when available (early boot), falls back to stderr.
+ *
+ * Once the main loop is running, lines are formatted into a lock-free
+ * in-memory ring instead of being written one syscall at a time, and
+ * log_flush() writes out everything queued since the last round. Any
+ * thread may log; only the main loop flushes.
  */
 
 #ifndef LOG_H
@@ -13,6 +18,20 @@
 /* Initialize the logging system */
 void log_open(void);
 
+#define LOG_RING_SLOTS 256  /* lines queued between flushes (power of two) */
+
+/* Queue lines for log_flush() (on) or write each line as it is logged
+ * (off, the default). Switch while no other thread is logging. Forked
+ * children always go back to writing directly. */
+void log_set_async(int on);
+
+/* Write out the queued lines */
+void log_flush(void);
+
+/* What fork() does for a child: write directly from now on. For children
+ * created without fork(), e.g. by clone3(), which skips atfork handlers. */
+void log_forked(void);
+
 /* Core logging function - use macros below instead */
 void graph_log(const char *level, const char *fmt, ...);
 
@@ -0,0 +1,541 @@
+/*
+ * metrics-export.c - YakirOS OpenMetrics endpoint
+ *
+ * The exposition is global families first, then the per-component ones.
+ * OpenMetrics wants every sample of a family together, so each
+ * component's cached text is split by family: fragment off[f] to
+ * off[f + 1] is what it adds to family f. A fragment is rendered again
+ * when the component's metrics record, state, start count, cgroup or
+ * latest telemetry sample differ from what it was rendered from.
+ */
+
+#define _GNU_SOURCE
+
+#include "metrics-export.h"
+#include "metrics.h"
+#include "capability.h"
+#include "component.h"
+#include "control-json.h"
+#include "log.h"
+#include "telemetry.h"
+#include "trace.h"
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/* Per-component families, in exposition order */
+typedef enum {
+    FAM_UP,
+    FAM_STARTS,
+    FAM_HEALTH_FAILURES,
+    FAM_OOM_KILLS,
+    FAM_READINESS,
+    FAM_HEALTH,
+    FAM_CPU,
+    FAM_MEMORY,
+    FAM_IO_READ,
+    FAM_IO_WRITE,
+    FAM_PRESSURE,
+    FAM_COUNT
+} family_t;
+
+static const struct {
+    const char *name;
+    const char *type;
+    const char *unit;
+    const char *help;
+} families[FAM_COUNT] = {
+    [FAM_UP]              = { "yakiros_component_up", "gauge", NULL,
+                              "Whether the component is active, degraded or done" },
+    [FAM_STARTS]          = { "yakiros_component_starts", "counter", NULL,
+                              "Times the component was started; every start after the first is a restart" },
+    [FAM_HEALTH_FAILURES] = { "yakiros_component_health_failures", "counter", NULL,
+                              "Health checks that failed or timed out" },
+    [FAM_OOM_KILLS]       = { "yakiros_component_oom_kills", "counter", NULL,
+                              "Processes the kernel OOM killer killed in the component's cgroup" },
+    [FAM_READINESS]       = { "yakiros_component_readiness_seconds", "histogram", "seconds",
+                              "Time from starting to ready" },
+    [FAM_HEALTH]          = { "yakiros_component_health_check_seconds", "histogram", "seconds",
+                              "Health check runtime" },
+    [FAM_CPU]             = { "yakiros_component_cpu_seconds", "counter", "seconds",
+                              "CPU time of the component's cgroup (cpu.stat usage_usec)" },
+    [FAM_MEMORY]          = { "yakiros_component_memory_bytes", "gauge", "bytes",
+                              "Memory of the component's cgroup (memory.current)" },
+    [FAM_IO_READ]         = { "yakiros_component_io_read_bytes", "counter", "bytes",
+                              "Bytes the component's cgroup read (io.stat rbytes)" },
+    [FAM_IO_WRITE]        = { "yakiros_component_io_write_bytes", "counter", "bytes",
+                              "Bytes the component's cgroup wrote (io.stat wbytes)" },
+    [FAM_PRESSURE]        = { "yakiros_component_pressure_ratio", "gauge", "ratio",
+                              "Share of the last 10s some task of the cgroup stalled (PSI some avg10)" },
+};
+
+typedef struct {
+    control_buf_t text;
+    size_t   off[FAM_COUNT + 1];
+    int      rendered;            /* text is valid for the key below */
+    uint32_t version;
+    int      state;
+    int      starts;
+    int      cgroup_fd;
+    uint64_t sample_ms;
+} fragment_t;
+
+static fragment_t *fragments[TRACE_MAX_NAMES];
+static uint64_t fragments_rendered;
+
+/* Listeners and connections */
+typedef struct {
+    event_source_t src;           /* first: epoll hands back &src */
+    char     req[METRICS_REQUEST_MAX];
+    size_t   req_len;
+    control_buf_t out;
+    size_t   off;
+} metrics_conn_t;
+
+static int mx_epoll_fd = -1;
+static event_source_t listeners[2] = {
+    { EVENT_METRICS, -1 },
+    { EVENT_METRICS, -1 },
+};
+static metrics_conn_t conns[METRICS_MAX_CLIENTS];
+static control_buf_t body;        /* scratch, kept between scrapes */
+
+/* Rendering */
+
+static void print_seconds(control_buf_t *out, uint64_t us) {
+    control_printf(out, "%llu.%06llu", (unsigned long long)(us / 1000000),
+                   (unsigned long long)(us % 1000000));
+}
+
+/* component="name" into dst, escaped as label values must be */
+static void component_label(char *dst, size_t size, const char *name) {
+    size_t n = (size_t)snprintf(dst, size, "component=\"");
+    for (const char *p = name; *p && n + 4 < size; p++) {
+        if (*p == '"' || *p == '\\') {
+            dst[n++] = '\\';
+            dst[n++] = *p;
+        } else if (*p == '\n') {
+            dst[n++] = '\\';
+            dst[n++] = 'n';
+        } else {
+            dst[n++] = *p;
+        }
+    }
+    dst[n++] = '"';
+    dst[n] = '\0';
+}
+
+static void print_header(control_buf_t *out, const char *name, const char *type,
+                         const char *unit, const char *help) {
+    control_printf(out, "# TYPE %s %s\n", name, type);
+    if (unit) control_printf(out, "# UNIT %s %s\n", name, unit);
+    control_printf(out, "# HELP %s %s.\n", name, help);
+}
+
+/* The samples of histogram h; labels (may be empty) go before le */
+static void print_histogram(control_buf_t *out, const char *name, const char *labels,
+                            const metrics_hist_t *h) {
+    const char *sep = labels[0] ? "," : "";
+    uint64_t cumulative = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+        cumulative += h->bucket[b];
+        control_printf(out, "%s_bucket{%s%sle=\"%s\"} %llu\n", name, labels, sep,
+                       metrics_bucket_le[b], (unsigned long long)cumulative);
+    }
+    control_printf(out, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, labels, sep,
+                   (unsigned long long)h->count);
+
+    if (labels[0]) {
+        control_printf(out, "%s_sum{%s} ", name, labels);
+    } else {
+        control_printf(out, "%s_sum ", name);
+    }
+    print_seconds(out, h->sum_us);
+    if (labels[0]) {
+        control_printf(out, "\n%s_count{%s} %llu\n", name, labels, (unsigned long long)h->count);
+    } else {
+        control_printf(out, "\n%s_count %llu\n", name, (unsigned long long)h->count);
+    }
+}
+
+/* Start a sample line of family f for the component in lbl */
+static void print_sample(control_buf_t *out, family_t f, const char *suffix, const char *lbl) {
+    control_printf(out, "%s%s{%s} ", families[f].name, suffix, lbl);
+}
+
+static void render_fragment(fragment_t *fr, const component_t *comp,
+                            const metrics_component_t *m, const telemetry_sample_t *s) {
+    control_buf_t *out = &fr->text;
+    out->len = 0;
+
+    char lbl[2 * MAX_NAME + 16];
+    component_label(lbl, sizeof(lbl), comp->name);
+
+    for (int f = 0; f < FAM_COUNT; f++) {
+        fr->off[f] = out->len;
+        switch ((family_t)f) {
+        case FAM_UP: {
+            int up = comp->state == COMP_ACTIVE || comp->state == COMP_DEGRADED ||
+                     comp->state == COMP_ONESHOT_DONE;
+            print_sample(out, f, "", lbl);
+            control_printf(out, "%d\n", up);
+            break;
+        }
+        case FAM_STARTS:
+            print_sample(out, f, "_total", lbl);
+            control_printf(out, "%d\n", comp->restart_count);
+            break;
+        case FAM_HEALTH_FAILURES:
+            print_sample(out, f, "_total", lbl);
+            control_printf(out, "%llu\n", (unsigned long long)(m ? m->health_failures : 0));
+            break;
+        case FAM_OOM_KILLS:
+            print_sample(out, f, "_total", lbl);
+            control_printf(out, "%llu\n", (unsigned long long)(m ? m->oom_kills : 0));
+            break;
+        case FAM_READINESS:
+            /* Histograms only once observed: most components never
+             * have a health check, and empty ones are 19 lines each */
+            if (m && m->readiness.count) {
+                print_histogram(out, families[f].name, lbl, &m->readiness);
+            }
+            break;
+        case FAM_HEALTH:
+            if (m && m->health.count) {
+                print_histogram(out, families[f].name, lbl, &m->health);
+            }
+            break;
+        case FAM_CPU:
+            if (s && (s->have & TELEMETRY_HAVE_CPU)) {
+                print_sample(out, f, "_total", lbl);
+                print_seconds(out, s->cpu_usec);
+                control_append(out, "\n", 1);
+            }
+            break;
+        case FAM_MEMORY:
+            if (s && (s->have & TELEMETRY_HAVE_MEMORY)) {
+                print_sample(out, f, "", lbl);
+                control_printf(out, "%llu\n", (unsigned long long)s->mem_current);
+            }
+            break;
+        case FAM_IO_READ:
+        case FAM_IO_WRITE:
+            if (s && (s->have & TELEMETRY_HAVE_IO)) {
+                print_sample(out, f, "_total", lbl);
+                control_printf(out, "%llu\n", (unsigned long long)
+                               (f == FAM_IO_READ ? s->io_rbytes : s->io_wbytes));
+            }
+            break;
+        case FAM_PRESSURE:
+            if (s && (s->have & TELEMETRY_HAVE_PRESSURE)) {
+                const struct { const char *resource; uint16_t value; } psi[] = {
+                    { "cpu", s->cpu_some }, { "memory", s->mem_some }, { "io", s->io_some },
+                };
+                for (int i = 0; i < 3; i++) {
+                    /* avg10 is kept in hundredths of a percent */
+                    control_printf(out, "%s{%s,resource=\"%s\"} %u.%04u\n", families[f].name,
+                                   lbl, psi[i].resource, psi[i].value / 10000u,
+                                   psi[i].value % 10000u);
+                }
+            }
+            break;
+        case FAM_COUNT:
+            break;
+        }
+    }
+    fr->off[FAM_COUNT] = out->len;
+    fragments_rendered++;
+}
+
+/* The component's fragment, rendered again if it is out of date */
+static fragment_t *fragment_for(const component_t *comp) {
+    int id = trace_intern(comp->name);
+    if (id < 0) return NULL;
+    if (!fragments[id]) {
+        fragments[id] = calloc(1, sizeof(*fragments[id]));
+        if (!fragments[id]) return NULL;
+    }
+    fragment_t *fr = fragments[id];
+
+    const metrics_component_t *m = metrics_component(comp->name);
+    telemetry_sample_t sample;
+    const telemetry_sample_t *s = NULL;
+    if (comp->cgroup_fd > 0 && telemetry_history(comp->cgroup_fd, &sample, 1) == 1) {
+        s = &sample;
+    }
+
+    uint32_t version = m ? m->version : 0;
+    uint64_t sample_ms = s ? s->time_ms : 0;
+    if (fr->rendered && fr->version == version && fr->state == (int)comp->state &&
+        fr->starts == comp->restart_count && fr->cgroup_fd == comp->cgroup_fd &&
+        fr->sample_ms == sample_ms) {
+        return fr;
+    }
+
+    render_fragment(fr, comp, m, s);
+    fr->rendered = 1;
+    fr->version = version;
+    fr->state = (int)comp->state;
+    fr->starts = comp->restart_count;
+    fr->cgroup_fd = comp->cgroup_fd;
+    fr->sample_ms = sample_ms;
+    return fr;
+}
+
+static void render_globals(control_buf_t *out) {
+    static const comp_state_t states[] = {
+        COMP_INACTIVE, COMP_STARTING, COMP_READY_WAIT, COMP_ACTIVE, COMP_DEGRADED,
+        COMP_FAILED, COMP_ONESHOT_DONE, COMP_QUARANTINED, COMP_IDLE, COMP_MIGRATED,
+    };
+    int n_states = (int)(sizeof(states) / sizeof(states[0]));
+    int count[sizeof(states) / sizeof(states[0])] = {0};
+    for (int i = 0; i < n_components; i++) {
+        for (int s = 0; s < n_states; s++) {
+            if (components[i].state == states[s]) count[s]++;
+        }
+    }
+    print_header(out, "yakiros_components", "gauge", NULL, "Components by state");
+    for (int s = 0; s < n_states; s++) {
+        control_printf(out, "yakiros_components{state=\"%s\"} %d\n",
+                       json_state_name(states[s]), count[s]);
+    }
+
+    int up = 0, total = capability_count();
+    for (int i = 0; i < total; i++) {
+        up += capability_active_by_idx(i) ? 1 : 0;
+    }
+    print_header(out, "yakiros_capabilities", "gauge", NULL, "Registered capabilities by status");
+    control_printf(out, "yakiros_capabilities{status=\"up\"} %d\n"
+                   "yakiros_capabilities{status=\"down\"} %d\n", up, total - up);
+
+    print_header(out, "yakiros_spawn_seconds", "histogram", "seconds",
+                 "Time from cloning a process to it having exec'd");
+    print_histogram(out, "yakiros_spawn_seconds", "", metrics_global(METRIC_SPAWN));
+
+    print_header(out, "yakiros_resolve_seconds", "histogram", "seconds",
+                 "Graph resolution passes, full sweeps and incremental ones");
+    print_histogram(out, "yakiros_resolve_seconds", "pass=\"full\"",
+                    metrics_global(METRIC_RESOLVE_FULL));
+    print_histogram(out, "yakiros_resolve_seconds", "pass=\"incremental\"",
+                    metrics_global(METRIC_RESOLVE_PENDING));
+
+    print_header(out, "yakiros_control_command_seconds", "histogram", "seconds",
+                 "Time to execute a control socket command");
+    print_histogram(out, "yakiros_control_command_seconds", "", metrics_global(METRIC_CONTROL));
+}
+
+void metrics_render(control_buf_t *out) {
+    render_globals(out);
+
+    fragment_t **frs = n_components > 0 ? calloc((size_t)n_components, sizeof(*frs)) : NULL;
+    if (n_components > 0 && !frs) {
+        control_printf(out, "# EOF\n");
+        return;
+    }
+    for (int i = 0; i < n_components; i++) {
+        frs[i] = fragment_for(&components[i]);
+    }
+
+    for (int f = 0; f < FAM_COUNT; f++) {
+        print_header(out, families[f].name, families[f].type, families[f].unit, families[f].help);
+        for (int i = 0; i < n_components; i++) {
+            if (!frs[i]) continue;
+            size_t len = frs[i]->off[f + 1] - frs[i]->off[f];
+            if (len) control_append(out, frs[i]->text.data + frs[i]->off[f], len);
+        }
+    }
+    free(frs);
+    control_printf(out, "# EOF\n");
+}
+
+uint64_t metrics_fragments_rendered(void) {
+    return fragments_rendered;
+}
+
+/* Endpoint */
+
+static int listen_unix(const char *path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(fd, METRICS_MAX_CLIENTS) < 0) {
+        LOG_ERR("metrics socket %s failed: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    LOG_INFO("metrics endpoint ready: %s", path);
+    return fd;
+}
+
+static int listen_tcp(int port) {
+    int fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    int on = 1, off = 0;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+
+    struct sockaddr_in6 addr = { .sin6_family = AF_INET6, .sin6_port = htons((uint16_t)port),
+                                 .sin6_addr = IN6ADDR_ANY_INIT };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(fd, METRICS_MAX_CLIENTS) < 0) {
+        LOG_ERR("metrics port %d failed: %s", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    LOG_INFO("metrics endpoint ready: port %d", port);
+    return fd;
+}
+
+static void watch(event_source_t *src, uint32_t events, int op) {
+    if (mx_epoll_fd < 0) return;
+    struct epoll_event ev = { .events = events, .data.ptr = src };
+    epoll_ctl(mx_epoll_fd, op, src->fd, &ev);
+}
+
+int metrics_listen(int epoll_fd, const char *unix_path, int port) {
+    mx_epoll_fd = epoll_fd;
+    for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+        conns[i].src.type = EVENT_METRICS_CLIENT;
+        conns[i].src.fd = -1;
+    }
+
+    int n = 0;
+    if (unix_path) listeners[n].fd = listen_unix(unix_path);
+    if (listeners[n].fd >= 0) watch(&listeners[n++], EPOLLIN, EPOLL_CTL_ADD);
+    if (port > 0) listeners[n].fd = listen_tcp(port);
+    if (listeners[n].fd >= 0) watch(&listeners[n++], EPOLLIN, EPOLL_CTL_ADD);
+    return n;
+}
+
+static void conn_close(metrics_conn_t *c) {
+    if (mx_epoll_fd >= 0) epoll_ctl(mx_epoll_fd, EPOLL_CTL_DEL, c->src.fd, NULL);
+    close(c->src.fd);
+    control_buf_free(&c->out);
+    c->src.fd = -1;
+    c->req_len = 0;
+    c->off = 0;
+}
+
+void metrics_accept(event_source_t *src) {
+    for (;;) {
+        int fd = accept4(src->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+
+        metrics_conn_t *c = NULL;
+        for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+            if (conns[i].src.fd < 0) {
+                c = &conns[i];
+                break;
+            }
+        }
+        if (!c) {
+            /* Scrapers retry; turning one away is cheaper than queueing */
+            close(fd);
+            continue;
+        }
+        c->src.fd = fd;
+        watch(&c->src, EPOLLIN, EPOLL_CTL_ADD);
+    }
+}
+
+/* Send what is queued; close once it is all out or the peer is gone */
+static void conn_send(metrics_conn_t *c) {
+    while (c->off < c->out.len) {
+        ssize_t n = send(c->src.fd, c->out.data + c->off, c->out.len - c->off, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            watch(&c->src, EPOLLOUT, EPOLL_CTL_MOD);
+            return;
+        }
+        if (n <= 0) break;
+        c->off += (size_t)n;
+    }
+    conn_close(c);
+}
+
+static void respond(metrics_conn_t *c, const char *status, const char *type,
+                    const char *data, size_t len) {
+    control_printf(&c->out, "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                   "Connection: close\r\n\r\n", status, type, len);
+    control_append(&c->out, data, len);
+    c->off = 0;
+    conn_send(c);
+}
+
+/* A whole request head is in: answer GET /metrics (or /) */
+static void handle_request(metrics_conn_t *c) {
+    char method[8] = "", path[256] = "";
+    sscanf(c->req, "%7s %255s", method, path);
+    char *query = strchr(path, '?');
+    if (query) *query = '\0';
+
+    if (strcmp(method, "GET") != 0) {
+        const char *msg = "Only GET is supported\n";
+        respond(c, "405 Method Not Allowed", "text/plain", msg, strlen(msg));
+    } else if (strcmp(path, "/metrics") != 0 && strcmp(path, "/") != 0) {
+        const char *msg = "Not found: the metrics are at /metrics\n";
+        respond(c, "404 Not Found", "text/plain", msg, strlen(msg));
+    } else {
+        body.len = 0;
+        metrics_render(&body);
+        respond(c, "200 OK", CONTENT_TYPE, body.data, body.len);
+        /* Keep the capacity for the next scrape, unless it was unusual */
+        if (body.cap > 4 * body.len + 65536) control_buf_free(&body);
+    }
+}
+
+void metrics_client_event(event_source_t *src, uint32_t events) {
+    metrics_conn_t *c = (metrics_conn_t *)src;
+
+    /* A reply is being sent: ignore anything more the client says */
+    if (c->out.len > 0) {
+        if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) conn_send(c);
+        return;
+    }
+
+    for (;;) {
+        ssize_t n = recv(c->src.fd, c->req + c->req_len, sizeof(c->req) - 1 - c->req_len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n <= 0) {
+            conn_close(c);
+            return;
+        }
+        c->req_len += (size_t)n;
+        c->req[c->req_len] = '\0';
+
+        if (strstr(c->req, "\r\n\r\n") || strstr(c->req, "\n\n")) {
+            handle_request(c);
+            return;
+        }
+        if (c->req_len == sizeof(c->req) - 1) {
+            const char *msg = "Request too large\n";
+            respond(c, "431 Request Header Fields Too Large", "text/plain", msg, strlen(msg));
+            return;
+        }
+    }
+}
+
+void metrics_close_all(void) {
+    for (int i = 0; i < METRICS_MAX_CLIENTS; i++) {
+        if (conns[i].src.fd >= 0) conn_close(&conns[i]);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (listeners[i].fd < 0) continue;
+        close(listeners[i].fd);
+        listeners[i].fd = -1;
+    }
+}
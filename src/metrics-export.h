@@ -0,0 +1,43 @@
+/*
+ * metrics-export.h - YakirOS OpenMetrics endpoint
+ *
+ * Serves the metrics of metrics.c, the component table and the last
+ * telemetry sample of each cgroup as OpenMetrics text over HTTP, on a
+ * Unix socket (METRICS_SOCKET) and, if a port is given, TCP. Connections
+ * are handled in the main epoll loop like control clients; a scrape is
+ * answered in one pass with no blocking.
+ *
+ * Rendering is incremental: what a component contributes to each metric
+ * family is kept as text and rendered again only once something it shows
+ * has changed, so a scrape is mostly copying.
+ */
+
+#ifndef METRICS_EXPORT_H
+#define METRICS_EXPORT_H
+
+#include "control.h"
+#include "event.h"
+#include <stdint.h>
+
+#define METRICS_SOCKET      "/run/graph/metrics.sock"
+#define METRICS_MAX_CLIENTS 8
+#define METRICS_REQUEST_MAX 2048   /* longest request head accepted */
+
+/* Listen on unix_path (if not NULL) and on TCP port (if > 0), registering
+ * the listeners in epoll_fd. Returns how many listeners are open. */
+int metrics_listen(int epoll_fd, const char *unix_path, int port);
+
+/* Accept on a listener, or serve a connection, as epoll reports */
+void metrics_accept(event_source_t *src);
+void metrics_client_event(event_source_t *src, uint32_t events);
+
+/* Close listeners and connections */
+void metrics_close_all(void);
+
+/* The whole exposition, ending in "# EOF" (also `graphctl metrics`) */
+void metrics_render(control_buf_t *out);
+
+/* Component fragments rendered since start, for tests */
+uint64_t metrics_fragments_rendered(void);
+
+#endif /* METRICS_EXPORT_H */
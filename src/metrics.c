@@ -0,0 +1,124 @@
+/*
+ * metrics.c - YakirOS pre-aggregated metrics
+ *
+ * A record per component name is allocated the first time something is
+ * recorded for it and kept until exit, like the interned name itself, so
+ * counters carry on across reloads and restarts the way a scraper
+ * expects.
+ */
+
+#include "metrics.h"
+#include "toml.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+const uint64_t metrics_bucket_us[METRICS_BUCKETS] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000,
+    50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000,
+};
+
+const char *const metrics_bucket_le[METRICS_BUCKETS] = {
+    "0.0001", "0.00025", "0.0005", "0.001", "0.0025", "0.005", "0.01", "0.025",
+    "0.05", "0.1", "0.25", "0.5", "1.0", "2.5", "5.0", "10.0",
+};
+
+static metrics_hist_t globals[METRIC_GLOBAL_KINDS];
+static metrics_component_t *records[TRACE_MAX_NAMES];
+
+/* Versions are drawn from one sequence, so a record that was reset and
+ * recreated never repeats the version of the one it replaced */
+static uint32_t change_seq;
+
+void metrics_hist_observe(metrics_hist_t *h, uint64_t us) {
+    int b = 0;
+    while (b < METRICS_BUCKETS && us > metrics_bucket_us[b]) b++;
+    h->bucket[b]++;
+    h->count++;
+    h->sum_us += us;
+}
+
+void metrics_observe(metrics_kind_t kind, uint64_t us) {
+    if ((unsigned)kind < METRIC_GLOBAL_KINDS) {
+        metrics_hist_observe(&globals[kind], us);
+    }
+}
+
+const metrics_hist_t *metrics_global(metrics_kind_t kind) {
+    return (unsigned)kind < METRIC_GLOBAL_KINDS ? &globals[kind] : NULL;
+}
+
+/* The record of name, allocated on first use; NULL once names run out */
+static metrics_component_t *record_of(const char *name) {
+    int id = trace_intern(name);
+    if (id < 0) return NULL;
+    if (!records[id]) {
+        records[id] = calloc(1, sizeof(*records[id]));
+    }
+    return records[id];
+}
+
+void metrics_state(const char *name, int oneshot, int from, int to) {
+    metrics_component_t *m = record_of(name);
+    if (!m || from == to) return;
+    m->version = ++change_seq;
+
+    uint64_t now = trace_now_us();
+    switch ((comp_state_t)to) {
+    case COMP_STARTING:
+        m->started_us = now;
+        break;
+    case COMP_READY_WAIT:
+        break;
+    case COMP_ACTIVE:
+        if (oneshot) break;
+        /* fall through */
+    case COMP_ONESHOT_DONE:
+        if (m->started_us) {
+            metrics_hist_observe(&m->readiness, now - m->started_us);
+        }
+        m->started_us = 0;
+        break;
+    default:
+        m->started_us = 0;
+        break;
+    }
+}
+
+void metrics_health_started(const char *name) {
+    metrics_component_t *m = record_of(name);
+    if (m) m->health_started_us = trace_now_us();
+}
+
+void metrics_health_result(const char *name, int result) {
+    metrics_component_t *m = record_of(name);
+    if (!m) return;
+    m->version = ++change_seq;
+
+    /* A check that could not even be started took no time */
+    if (m->health_started_us) {
+        metrics_hist_observe(&m->health, trace_now_us() - m->health_started_us);
+        m->health_started_us = 0;
+    }
+    if (result != 0) m->health_failures++;
+}
+
+void metrics_oom(const char *name, long kills) {
+    metrics_component_t *m = record_of(name);
+    if (!m || kills <= 0) return;
+    m->version = ++change_seq;
+    m->oom_kills += (uint64_t)kills;
+}
+
+const metrics_component_t *metrics_component(const char *name) {
+    int id = trace_intern(name);
+    return id >= 0 ? records[id] : NULL;
+}
+
+void metrics_reset(void) {
+    memset(globals, 0, sizeof(globals));
+    for (int i = 0; i < TRACE_MAX_NAMES; i++) {
+        free(records[i]);
+        records[i] = NULL;
+    }
+}
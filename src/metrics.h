@@ -0,0 +1,68 @@
+/*
+ * metrics.h - YakirOS pre-aggregated metrics
+ *
+ * Latencies are counted into fixed histograms as they happen, so a scrape
+ * only reads numbers: nothing is kept per event and nothing computed
+ * later. Global histograms cover spawning, resolve passes and control
+ * commands; each component (by trace_intern() name, so its record
+ * outlives a reload) has readiness and health check histograms and the
+ * counters component_t does not keep. metrics-export.c renders them.
+ *
+ * Only the main loop records; nothing is locked.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+/* Bucket upper bounds run from 100us to 10s; past the last is +Inf */
+#define METRICS_BUCKETS 16
+
+extern const uint64_t metrics_bucket_us[METRICS_BUCKETS];
+extern const char *const metrics_bucket_le[METRICS_BUCKETS];
+
+typedef struct {
+    uint64_t bucket[METRICS_BUCKETS + 1];  /* observations per bucket, not cumulative */
+    uint64_t count;
+    uint64_t sum_us;
+} metrics_hist_t;
+
+typedef enum {
+    METRIC_SPAWN,             /* fork/clone to exec of any process */
+    METRIC_RESOLVE_FULL,      /* graph_resolve_full() */
+    METRIC_RESOLVE_PENDING,   /* graph_resolve_pending() with something to do */
+    METRIC_CONTROL,           /* one control command */
+    METRIC_GLOBAL_KINDS
+} metrics_kind_t;
+
+typedef struct {
+    uint32_t version;            /* bumped by every change below */
+    uint64_t started_us;         /* entered STARTING, 0 when not starting */
+    uint64_t health_started_us;  /* health check running since, 0 if none */
+    uint64_t health_failures;    /* failed or timed out checks */
+    uint64_t oom_kills;          /* processes the kernel killed in its cgroup */
+    metrics_hist_t readiness;    /* STARTING to ready */
+    metrics_hist_t health;       /* health check runtime */
+} metrics_component_t;
+
+void metrics_hist_observe(metrics_hist_t *h, uint64_t us);
+
+void metrics_observe(metrics_kind_t kind, uint64_t us);
+const metrics_hist_t *metrics_global(metrics_kind_t kind);
+
+/* Hooks: a state transition (comp_state_t values; a oneshot is ready
+ * once done), a health check starting and its result (0 passed, 1
+ * failed, 2 timed out), OOM kills */
+void metrics_state(const char *name, int oneshot, int from, int to);
+void metrics_health_started(const char *name);
+void metrics_health_result(const char *name, int result);
+void metrics_oom(const char *name, long kills);
+
+/* The record of a component name, NULL if nothing was recorded for it */
+const metrics_component_t *metrics_component(const char *name);
+
+/* Forget every observation, for tests */
+void metrics_reset(void);
+
+#endif /* METRICS_H */
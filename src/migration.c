@@ -0,0 +1,824 @@
+/*
+ * migration.c - YakirOS live migration of components between nodes
+ *
+ * The target side runs in the main loop: one incoming migration at a
+ * time, read without blocking, the component held in COMP_MIGRATED so
+ * the resolver leaves it alone until it is restored or let go, at the
+ * latest once the peer has been quiet for MIGRATION_IDLE_SEC. The
+ * source side is a single control command and blocks like the other
+ * checkpoint commands do; each step has MIGRATION_TIMEOUT_SEC.
+ *
+ * Each side proves it has the federation secret by MACing a nonce the
+ * other just made up, over labels of its own so neither proof can be
+ * played back as the other; the target takes nothing else before.
+ */
+
+#define _GNU_SOURCE
+#include "migration.h"
+#include "checkpoint.h"
+#include "checkpoint-mgmt.h"
+#include "component.h"
+#include "federation.h"
+#include "graph.h"
+#include "log.h"
+#include "timer.h"
+#include "toml.h"
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/random.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+
+/* What each side MACs the other's nonce under */
+#define MIGRATION_TARGET_LABEL "migrate-target"
+#define MIGRATION_SOURCE_LABEL "migrate-source"
+
+/* One component coming in */
+typedef struct {
+    event_source_t src;             /* first: epoll hands back &src */
+    char         in[MIGRATION_LINE_MAX];
+    size_t       in_len;
+    char         name[MAX_NAME];    /* component held for it, "" before MIGRATE */
+    comp_state_t held_from;         /* its state before */
+    char         dir[MAX_CHECKPOINT_PATH];
+    struct sockaddr_in6 peer;       /* federation peer handing it over */
+    event_source_t pages;           /* where that pass's pages connect, fd -1 if none */
+    char         pages_dir[MAX_CHECKPOINT_PATH + 32];
+    char         pages_prev[40];    /* pre-dump they build on, "" for none */
+    int          server_pidfd;      /* page server of the latest pass */
+    int          file_fd;           /* image being received, -1 if dropped */
+    long long    file_left;
+    int          broken;            /* an image could not be written */
+    int          timer;             /* TIMER_MIGRATION handle, 0 if none */
+    char         nonce[MIGRATION_NONCE_HEX + 1];  /* ours, "" before CHALLENGE */
+    int          authed;            /* the peer has proved the secret */
+} migration_conn_t;
+
+static int mg_epoll_fd = -1;
+static event_source_t listener = { EVENT_MIGRATION, -1 };
+static migration_conn_t conn = {
+    .src = { EVENT_MIGRATION_CLIENT, -1 }, .pages = { EVENT_MIGRATION, -1 },
+    .server_pidfd = -1, .file_fd = -1,
+};
+
+static int find_component(const char *name) {
+    for (int i = 0; i < n_components; i++) {
+        if (strcmp(components[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+/* mkdir -p */
+static int make_dirs(const char *path) {
+    char tmp[MAX_CHECKPOINT_PATH];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = tmp + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(tmp, 0755) != 0 && errno != EEXIST) return -1;
+        *p = '/';
+    }
+    return mkdir(tmp, 0700) != 0 && errno != EEXIST ? -1 : 0;
+}
+
+/* Where pass number pass goes: the image directory itself for the final
+ * dump, pre-N below it for pre-dumps */
+static void pass_dir(const char *base, int pass, char *buf, size_t size) {
+    if (pass == 0) {
+        snprintf(buf, size, "%s", base);
+        return;
+    }
+    char name[32];
+    checkpoint_pre_dump_dir(pass, name, sizeof(name));
+    snprintf(buf, size, "%s/%s", base, name);
+}
+
+/* A fresh nonce as hex, or -1 */
+static int make_nonce(char *hex) {
+    uint8_t raw[MIGRATION_NONCE_HEX / 2];
+    if (getrandom(raw, sizeof(raw), 0) != (ssize_t)sizeof(raw)) return -1;
+    for (size_t i = 0; i < sizeof(raw); i++) {
+        snprintf(hex + 2 * i, 3, "%02x", raw[i]);
+    }
+    return 0;
+}
+
+/* The MAC of "<label> <nonce>" under the federation secret */
+static void nonce_mac(const char *label, const char *nonce, char *hex) {
+    char msg[MIGRATION_LINE_MAX];
+    int n = snprintf(msg, sizeof(msg), "%s %s", label, nonce);
+    federation_mac(msg, (size_t)n, hex);
+}
+
+static int nonce_mac_ok(const char *label, const char *nonce, const char *hex) {
+    char msg[MIGRATION_LINE_MAX];
+    int n = snprintf(msg, sizeof(msg), "%s %s", label, nonce);
+    return federation_mac_ok(msg, (size_t)n, hex);
+}
+
+/* ---- target ---- */
+
+static int sys_pidfd_open(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/* A page server left waiting by a pass the source gave up on would hold
+ * the port; the pidfd makes sure the kill cannot hit a reused pid */
+static void stop_page_server(migration_conn_t *c) {
+    if (c->pages.fd >= 0) {
+        if (mg_epoll_fd >= 0) epoll_ctl(mg_epoll_fd, EPOLL_CTL_DEL, c->pages.fd, NULL);
+        close(c->pages.fd);
+        c->pages.fd = -1;
+    }
+    if (c->server_pidfd < 0) return;
+#ifdef SYS_pidfd_send_signal
+    syscall(SYS_pidfd_send_signal, c->server_pidfd, SIGKILL, NULL, 0);
+#endif
+    close(c->server_pidfd);
+    c->server_pidfd = -1;
+}
+
+static void reply(migration_conn_t *c, const char *fmt, ...) {
+    char line[MIGRATION_LINE_MAX];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line) - 1, fmt, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if ((size_t)n > sizeof(line) - 2) n = (int)sizeof(line) - 2;
+    line[n++] = '\n';
+    /* One short line on an otherwise idle socket: it fits */
+    if (send(c->src.fd, line, (size_t)n, MSG_NOSIGNAL) != n) {
+        LOG_WARN("migration: answer to peer lost: %s", strerror(errno));
+    }
+}
+
+/* Give the peer another MIGRATION_IDLE_SEC */
+static void conn_arm(migration_conn_t *c) {
+    timer_cancel(c->timer);
+    int handle = timer_add(timer_now_ms() + MIGRATION_IDLE_SEC * 1000ULL, TIMER_MIGRATION, -1);
+    c->timer = handle > 0 ? handle : 0;
+}
+
+static void conn_close(migration_conn_t *c) {
+    timer_cancel(c->timer);
+    c->timer = 0;
+    stop_page_server(c);
+    if (c->file_fd >= 0) close(c->file_fd);
+    c->file_fd = -1;
+    c->file_left = 0;
+
+    /* Not restored: let the component go back to what it was doing */
+    int idx = c->name[0] ? find_component(c->name) : -1;
+    if (idx >= 0 && components[idx].state == COMP_MIGRATED) {
+        LOG_WARN("migration: '%s' did not arrive, released", c->name);
+        component_set_state(&components[idx], c->held_from);
+        graph_mark_dirty(idx);
+    }
+    if (c->dir[0]) checkpoint_remove_directory(c->dir);
+    c->name[0] = '\0';
+    c->dir[0] = '\0';
+    c->broken = 0;
+    c->in_len = 0;
+    c->nonce[0] = '\0';
+    c->authed = 0;
+
+    if (c->src.fd >= 0) {
+        if (mg_epoll_fd >= 0) epoll_ctl(mg_epoll_fd, EPOLL_CTL_DEL, c->src.fd, NULL);
+        close(c->src.fd);
+        c->src.fd = -1;
+    }
+}
+
+static void handle_migrate(migration_conn_t *c, const char *name) {
+    int idx = find_component(name);
+    if (c->name[0]) {
+        reply(c, "ERR already migrating '%s'", c->name);
+        return;
+    }
+    if (idx < 0) {
+        reply(c, "ERR no component '%s' here", name);
+        return;
+    }
+    component_t *comp = &components[idx];
+    if (comp->type != COMP_TYPE_SERVICE || comp->pid > 0) {
+        reply(c, "ERR '%s' is running here", name);
+        return;
+    }
+    switch (comp->state) {
+    case COMP_INACTIVE:
+    case COMP_FAILED:
+    case COMP_QUARANTINED:
+    case COMP_IDLE:
+    case COMP_MIGRATED:
+        break;
+    default:
+        reply(c, "ERR '%s' is running here", name);
+        return;
+    }
+
+    snprintf(c->dir, sizeof(c->dir), "%s/%s/%s", CHECKPOINT_RUN_DIR, name, MIGRATION_IN_DIR);
+    checkpoint_remove_directory(c->dir);
+    if (make_dirs(c->dir) != 0) {
+        reply(c, "ERR cannot create %s: %s", c->dir, strerror(errno));
+        c->dir[0] = '\0';
+        return;
+    }
+
+    /* Hold it so the resolver does not start it meanwhile */
+    snprintf(c->name, sizeof(c->name), "%s", name);
+    c->held_from = comp->state;
+    component_disarm_timer(idx, TIMER_RESTART);
+    component_set_state(comp, COMP_MIGRATED);
+    LOG_INFO("migration: receiving '%s'", name);
+    reply(c, "OK");
+}
+
+static int listen_tcp(const struct in6_addr *addr, int port, int backlog) {
+    int fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    int on = 1, off = 0;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+
+    struct sockaddr_in6 sa = { .sin6_family = AF_INET6, .sin6_port = htons((uint16_t)port),
+                               .sin6_addr = *addr };
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(fd, backlog) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+static void handle_pages(migration_conn_t *c, int pass, int parent) {
+    if (!c->name[0] || pass < 0 || parent < 0 || (pass > 0 && parent >= pass)) {
+        reply(c, "ERR bad pass");
+        return;
+    }
+
+    pass_dir(c->dir, pass, c->pages_dir, sizeof(c->pages_dir));
+    c->pages_prev[0] = '\0';
+    if (parent > 0) {
+        char name[32];
+        checkpoint_pre_dump_dir(parent, name, sizeof(name));
+        snprintf(c->pages_prev, sizeof(c->pages_prev), "%s%s", pass > 0 ? "../" : "", name);
+    }
+    if (mkdir(c->pages_dir, 0700) != 0 && errno != EEXIST) {
+        reply(c, "ERR cannot create %s: %s", c->pages_dir, strerror(errno));
+        return;
+    }
+
+    /* Only on the address the peer reached us at; the page server is
+     * started once the peer itself has connected */
+    stop_page_server(c);
+    struct sockaddr_in6 local;
+    socklen_t len = sizeof(local);
+    if (getsockname(c->src.fd, (struct sockaddr *)&local, &len) < 0 ||
+        (c->pages.fd = listen_tcp(&local.sin6_addr, CHECKPOINT_PAGE_SERVER_PORT, 1)) < 0) {
+        reply(c, "ERR cannot receive pages: %s", strerror(errno));
+        return;
+    }
+    if (mg_epoll_fd >= 0) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &c->pages };
+        epoll_ctl(mg_epoll_fd, EPOLL_CTL_ADD, c->pages.fd, &ev);
+    }
+    reply(c, "READY %d", CHECKPOINT_PAGE_SERVER_PORT);
+}
+
+static int same_host(const struct sockaddr_in6 *a, const struct sockaddr_in6 *b) {
+    return memcmp(&a->sin6_addr, &b->sin6_addr, sizeof(a->sin6_addr)) == 0;
+}
+
+/* The dump of the pass connected: hand its socket to CRIU */
+static void accept_pages(migration_conn_t *c) {
+    for (;;) {
+        struct sockaddr_in6 from;
+        socklen_t len = sizeof(from);
+        int fd = accept4(c->pages.fd, (struct sockaddr *)&from, &len, SOCK_CLOEXEC);
+        if (fd < 0) return;
+        if (len != sizeof(from) || !same_host(&from, &c->peer)) {
+            LOG_WARN("migration: refused a page connection not from the peer sending '%s'", c->name);
+            close(fd);
+            continue;
+        }
+
+        stop_page_server(c);
+        pid_t pid = criu_page_server_receive(c->pages_dir, c->pages_prev[0] ? c->pages_prev : NULL, fd);
+        close(fd);
+        if (pid < 0) {
+            /* The dump fails with it and the source gives up */
+            LOG_ERR("migration: cannot receive pages of '%s': %s", c->name, checkpoint_error_string(pid));
+            return;
+        }
+        c->server_pidfd = sys_pidfd_open(pid);
+        return;
+    }
+}
+
+/* An image name as CRIU writes them: no directories, nothing hidden */
+static int image_name_ok(const char *name) {
+    return name[0] && name[0] != '.' && !strchr(name, '/');
+}
+
+static void handle_file(migration_conn_t *c, const char *name, long long size) {
+    if (!c->name[0] || !image_name_ok(name) || size < 0 || size > MIGRATION_FILE_MAX) {
+        /* The bytes that follow cannot be told from requests: give up */
+        LOG_WARN("migration: bad image '%s' (%lld bytes) for '%s'", name, size, c->name);
+        conn_close(c);
+        return;
+    }
+
+    char path[MAX_CHECKPOINT_PATH + MAX_NAME];
+    snprintf(path, sizeof(path), "%s/%s", c->dir, name);
+    c->file_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (c->file_fd < 0) {
+        LOG_ERR("migration: cannot write %s: %s", path, strerror(errno));
+        c->broken = 1;
+    }
+    c->file_left = size;
+    if (size == 0 && c->file_fd >= 0) {
+        close(c->file_fd);
+        c->file_fd = -1;
+    }
+}
+
+static void handle_restore(migration_conn_t *c) {
+    int idx = c->name[0] ? find_component(c->name) : -1;
+    if (idx < 0 || c->broken) {
+        reply(c, "FAIL %s", idx < 0 ? "nothing to restore" : "images could not be written");
+        return;
+    }
+
+    stop_page_server(c);
+    pid_t pid = criu_restore_process(c->dir);
+    if (pid < 0) {
+        reply(c, "FAIL %s", checkpoint_error_string(pid));
+        return;
+    }
+
+    /* It ran ACTIVE on the source up to the final dump */
+    component_adopt(idx, pid);
+    LOG_INFO("migration: '%s' resumed here as pid %d", c->name, pid);
+    reply(c, "DONE %d", pid);
+    c->name[0] = '\0';
+    checkpoint_remove_directory(c->dir);
+    c->dir[0] = '\0';
+}
+
+/* Before anything else: CHALLENGE, then AUTH */
+static void handle_auth(migration_conn_t *c, const char *word, const char *line) {
+    char arg[MIGRATION_LINE_MAX] = "";
+    if (strcmp(word, "CHALLENGE") == 0 && !c->nonce[0] &&
+        sscanf(line, "CHALLENGE %128s", arg) == 1) {
+        char mac[FEDERATION_MAC_HEX + 1];
+        if (make_nonce(c->nonce) != 0) {
+            LOG_ERR("migration: no random nonce: %s", strerror(errno));
+            reply(c, "ERR no nonce");
+            conn_close(c);
+            return;
+        }
+        nonce_mac(MIGRATION_TARGET_LABEL, arg, mac);
+        reply(c, "PROOF %s %s", c->nonce, mac);
+        return;
+    }
+    if (strcmp(word, "AUTH") == 0 && c->nonce[0] && sscanf(line, "AUTH %128s", arg) == 1 &&
+        nonce_mac_ok(MIGRATION_SOURCE_LABEL, c->nonce, arg)) {
+        c->authed = 1;
+        reply(c, "OK");
+        return;
+    }
+    LOG_WARN("migration: dropped a peer that did not prove the federation secret");
+    reply(c, "ERR unauthenticated");
+    conn_close(c);
+}
+
+static void handle_line(migration_conn_t *c, char *line) {
+    char word[16] = "", arg[MAX_NAME] = "";
+    long long size = -1;
+    int pass = -1, parent = -1;
+
+    sscanf(line, "%15s", word);
+    if (!c->authed) {
+        handle_auth(c, word, line);
+    } else if (strcmp(word, "MIGRATE") == 0 && sscanf(line, "MIGRATE %127s", arg) == 1) {
+        handle_migrate(c, arg);
+    } else if (strcmp(word, "PAGES") == 0 && sscanf(line, "PAGES %d %d", &pass, &parent) == 2) {
+        handle_pages(c, pass, parent);
+    } else if (strcmp(word, "SIZE") == 0 && sscanf(line, "SIZE %d", &pass) == 1 && pass > 0) {
+        char dir[MAX_CHECKPOINT_PATH + 32];
+        pass_dir(c->dir, pass, dir, sizeof(dir));
+        reply(c, "SIZE %zu", c->name[0] ? checkpoint_pages_size(dir) : 0);
+    } else if (strcmp(word, "FILE") == 0 && sscanf(line, "FILE %127s %lld", arg, &size) == 2) {
+        handle_file(c, arg, size);
+    } else if (strcmp(word, "RESTORE") == 0) {
+        handle_restore(c);
+    } else {
+        reply(c, "ERR unknown request");
+    }
+}
+
+/* Take what has arrived: image bytes first if one is being received,
+ * then whole lines */
+static void consume(migration_conn_t *c) {
+    size_t off = 0;
+    while (c->src.fd >= 0 && off < c->in_len) {
+        if (c->file_left > 0) {
+            size_t take = c->in_len - off;
+            if ((long long)take > c->file_left) take = (size_t)c->file_left;
+            if (c->file_fd >= 0 && write(c->file_fd, c->in + off, take) != (ssize_t)take) {
+                LOG_ERR("migration: writing an image of '%s' failed: %s", c->name, strerror(errno));
+                close(c->file_fd);
+                c->file_fd = -1;
+                c->broken = 1;
+            }
+            off += take;
+            c->file_left -= (long long)take;
+            if (c->file_left == 0 && c->file_fd >= 0) {
+                close(c->file_fd);
+                c->file_fd = -1;
+            }
+            continue;
+        }
+
+        char *nl = memchr(c->in + off, '\n', c->in_len - off);
+        if (!nl) break;
+        *nl = '\0';
+        handle_line(c, c->in + off);
+        off = (size_t)(nl - c->in) + 1;
+    }
+    if (c->src.fd < 0) return;
+
+    memmove(c->in, c->in + off, c->in_len - off);
+    c->in_len -= off;
+    if (c->in_len == sizeof(c->in) && c->file_left == 0) {
+        LOG_WARN("migration: request too long, dropping the connection");
+        conn_close(c);
+    }
+}
+
+int migration_listen(int epoll_fd, int port) {
+    mg_epoll_fd = epoll_fd;
+    listener.fd = listen_tcp(&in6addr_any, port, 4);
+    if (listener.fd < 0) {
+        LOG_ERR("migration port %d failed: %s", port, strerror(errno));
+        return -1;
+    }
+    LOG_INFO("taking migrations on port %d", port);
+    if (epoll_fd >= 0) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &listener };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listener.fd, &ev);
+    }
+    return listener.fd;
+}
+
+void migration_accept(event_source_t *src) {
+    if (src == &conn.pages) {
+        accept_pages(&conn);
+        return;
+    }
+    for (;;) {
+        struct sockaddr_in6 from;
+        socklen_t len = sizeof(from);
+        int fd = accept4(src->fd, (struct sockaddr *)&from, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+
+        /* Whoever sends images gets them restored as root: peers only */
+        if (len != sizeof(from) || !federation_is_peer_host(&from)) {
+            LOG_WARN("migration: refused a connection from a host that is not a federation peer");
+            close(fd);
+            continue;
+        }
+
+        if (conn.src.fd >= 0) {
+            const char *busy = "ERR busy\n";
+            send(fd, busy, strlen(busy), MSG_NOSIGNAL);
+            close(fd);
+            continue;
+        }
+        conn.src.fd = fd;
+        conn.peer = from;
+        conn_arm(&conn);
+        if (mg_epoll_fd >= 0) {
+            struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &conn.src };
+            epoll_ctl(mg_epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+        }
+    }
+}
+
+void migration_client_event(event_source_t *src, uint32_t events) {
+    migration_conn_t *c = (migration_conn_t *)src;
+    (void)events;
+
+    while (c->src.fd >= 0) {
+        ssize_t n = recv(c->src.fd, c->in + c->in_len, sizeof(c->in) - c->in_len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n <= 0) {
+            conn_close(c);
+            return;
+        }
+        c->in_len += (size_t)n;
+        conn_arm(c);
+        consume(c);
+    }
+}
+
+void migration_timer_fired(int handle) {
+    if (handle == 0 || handle != conn.timer) return;
+    conn.timer = 0;
+    LOG_WARN("migration: peer quiet for %ds%s%s, dropping it", MIGRATION_IDLE_SEC,
+             conn.name[0] ? " while sending " : "", conn.name);
+    conn_close(&conn);
+}
+
+void migration_close_all(void) {
+    if (conn.src.fd >= 0) conn_close(&conn);
+    if (listener.fd >= 0) {
+        close(listener.fd);
+        listener.fd = -1;
+    }
+    mg_epoll_fd = -1;
+}
+
+/* ---- source ---- */
+
+static int send_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Send a request line and read the one-line answer into answer */
+static int request(int fd, char *answer, size_t size, const char *fmt, ...) {
+    char line[MIGRATION_LINE_MAX];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    answer[0] = '\0';
+    if (n < 0 || (size_t)n >= sizeof(line) || send_all(fd, line, (size_t)n) != 0) {
+        return -1;
+    }
+
+    /* Answers are short and each is followed by the next request, so
+     * reading a byte at a time never swallows anything */
+    size_t len = 0;
+    for (;;) {
+        char ch;
+        ssize_t r = recv(fd, &ch, 1, 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        if (ch == '\n') break;
+        if (len + 1 < size) answer[len++] = ch;
+    }
+    answer[len] = '\0';
+    return 0;
+}
+
+/* Have the target receive the pages of pass; *port gets its page server */
+static int request_pages(int fd, int pass, int parent, int *port) {
+    char answer[MIGRATION_LINE_MAX];
+    if (request(fd, answer, sizeof(answer), "PAGES %d %d\n", pass, parent) != 0) {
+        return -1;
+    }
+    if (sscanf(answer, "READY %d", port) != 1) {
+        LOG_ERR("migrate: target cannot take pass %d: %s", pass, answer);
+        return -1;
+    }
+    return 0;
+}
+
+/* The images the final dump left here: everything but the pages, which
+ * are on the target already, and CRIU's logs */
+static int send_images(int fd, const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return -1;
+
+    int result = 0;
+    struct dirent *entry;
+    while (result == 0 && (entry = readdir(d)) != NULL) {
+        const char *name = entry->d_name;
+        size_t len = strlen(name);
+        struct stat st;
+        if (!image_name_ok(name) || (len > 4 && strcmp(name + len - 4, ".log") == 0) ||
+            fstatat(dirfd(d), name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        int in = openat(dirfd(d), name, O_RDONLY | O_CLOEXEC);
+        if (in < 0) {
+            result = -1;
+            break;
+        }
+
+        char header[MIGRATION_LINE_MAX];
+        int n = snprintf(header, sizeof(header), "FILE %s %lld\n", name, (long long)st.st_size);
+        result = send_all(fd, header, (size_t)n);
+        off_t pos = 0;
+        while (result == 0 && pos < st.st_size) {
+            ssize_t sent = sendfile(fd, in, &pos, (size_t)(st.st_size - pos));
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent <= 0) result = -1;
+        }
+        close(in);
+    }
+    closedir(d);
+    return result;
+}
+
+/* Prove the secret to the target, and have it prove it back */
+static int authenticate(int fd, const char *node) {
+    char ours[MIGRATION_NONCE_HEX + 1], theirs[MIGRATION_NONCE_HEX + 1];
+    char mac[FEDERATION_MAC_HEX + 1], answer[MIGRATION_LINE_MAX];
+    if (make_nonce(ours) != 0 ||
+        request(fd, answer, sizeof(answer), "CHALLENGE %s\n", ours) != 0) {
+        return -1;
+    }
+    if (sscanf(answer, "PROOF %32s %64s", theirs, mac) != 2 ||
+        !nonce_mac_ok(MIGRATION_TARGET_LABEL, ours, mac)) {
+        LOG_ERR("migrate: %s did not prove the federation secret", node);
+        return -1;
+    }
+    nonce_mac(MIGRATION_SOURCE_LABEL, theirs, mac);
+    if (request(fd, answer, sizeof(answer), "AUTH %s\n", mac) != 0 || strcmp(answer, "OK") != 0) {
+        LOG_ERR("migrate: %s refused our proof of the federation secret", node);
+        return -1;
+    }
+    return 0;
+}
+
+static int peer_connect(const struct sockaddr_in6 *addr) {
+    int fd = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    struct timeval tv = { .tv_sec = MIGRATION_TIMEOUT_SEC };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    if (connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Pre-dump while it runs, for as long as that shortens the final pass */
+static int pre_dump_passes(int fd, pid_t pid, const char *dir, const char *host,
+                           migration_result_t *res) {
+    int done = 0;
+    size_t previous = 0;
+    while (done < CHECKPOINT_PRE_DUMP_PASSES) {
+        int port;
+        if (request_pages(fd, done + 1, done, &port) != 0) break;
+
+        char sub[MAX_CHECKPOINT_PATH + 32], prev[40];
+        pass_dir(dir, done + 1, sub, sizeof(sub));
+        if (done > 0) {
+            char name[32];
+            checkpoint_pre_dump_dir(done, name, sizeof(name));
+            snprintf(prev, sizeof(prev), "../%s", name);
+        }
+        if (criu_pre_dump_remote(pid, sub, done > 0 ? prev : NULL, host, port) != CHECKPOINT_SUCCESS) {
+            LOG_WARN("migrate: pre-dump %d of process %d failed, dumping on top of %d pass(es)",
+                     done + 1, pid, done);
+            break;
+        }
+        done++;
+
+        char answer[MIGRATION_LINE_MAX];
+        size_t current = 0;
+        if (request(fd, answer, sizeof(answer), "SIZE %d\n", done) != 0 ||
+            sscanf(answer, "SIZE %zu", &current) != 1) {
+            break;
+        }
+        res->pre_bytes += current;
+        LOG_INFO("migrate: pre-dump %d of process %d moved %zu KB", done, pid, current / 1024);
+        if (!checkpoint_pre_dump_again(done, CHECKPOINT_PRE_DUMP_PASSES, previous, current)) {
+            break;
+        }
+        previous = current;
+    }
+    return done;
+}
+
+int migration_send(const char *name, const char *node, migration_result_t *res) {
+    memset(res, 0, sizeof(*res));
+    int idx = find_component(name);
+    if (idx < 0) {
+        LOG_ERR("migrate: component '%s' not found", name);
+        return -1;
+    }
+    component_t *comp = &components[idx];
+    if (comp->type != COMP_TYPE_SERVICE || comp->state != COMP_ACTIVE || comp->pid <= 0) {
+        LOG_ERR("migrate: component '%s' is not an active service", name);
+        return -1;
+    }
+    if (criu_is_supported() != CHECKPOINT_SUCCESS) {
+        LOG_ERR("migrate: CRIU not supported on this system");
+        return -2;
+    }
+
+    struct sockaddr_in6 addr;
+    if (federation_peer_address(node, &addr) != 0) {
+        LOG_ERR("migrate: '%s' is not a live federation peer", node);
+        return -3;
+    }
+    char host[INET6_ADDRSTRLEN];
+    if (IN6_IS_ADDR_V4MAPPED(&addr.sin6_addr)) {
+        inet_ntop(AF_INET, addr.sin6_addr.s6_addr + 12, host, sizeof(host));
+    } else {
+        inet_ntop(AF_INET6, &addr.sin6_addr, host, sizeof(host));
+    }
+
+    char answer[MIGRATION_LINE_MAX];
+    int fd = peer_connect(&addr);
+    if (fd >= 0 && authenticate(fd, node) != 0) {
+        close(fd);
+        return -3;
+    }
+    if (fd < 0 || request(fd, answer, sizeof(answer), "MIGRATE %s\n", name) != 0 ||
+        strcmp(answer, "OK") != 0) {
+        LOG_ERR("migrate: %s did not take '%s'%s%s", node, name,
+                answer[0] && fd >= 0 ? ": " : "", fd >= 0 ? answer : "");
+        if (fd >= 0) close(fd);
+        return -3;
+    }
+
+    char dir[MAX_CHECKPOINT_PATH];
+    snprintf(dir, sizeof(dir), "%s/%s/%s", CHECKPOINT_RUN_DIR, name, MIGRATION_OUT_DIR);
+    checkpoint_remove_directory(dir);
+    if (make_dirs(dir) != 0) {
+        LOG_ERR("migrate: cannot create %s: %s", dir, strerror(errno));
+        close(fd);
+        return -4;
+    }
+
+    LOG_INFO("migrate: moving '%s' (pid %d) to %s", name, comp->pid, node);
+    res->passes = pre_dump_passes(fd, comp->pid, dir, host, res);
+
+    /* Final pass: the service stops here and only what it dirtied since
+     * the last pre-dump goes over */
+    int port;
+    char parent[32];
+    checkpoint_pre_dump_dir(res->passes, parent, sizeof(parent));
+    uint64_t stopped_ms = timer_now_ms();
+    if (request_pages(fd, 0, res->passes, &port) != 0 ||
+        criu_checkpoint_remote(comp->pid, dir, res->passes > 0 ? parent : NULL,
+                               host, port) != CHECKPOINT_SUCCESS) {
+        /* CRIU lets the process go on when a dump fails */
+        LOG_ERR("migrate: final dump of '%s' failed, it keeps running here", name);
+        close(fd);
+        checkpoint_remove_directory(dir);
+        return -4;
+    }
+
+    /* The process is gone here. Its exit is reported as that of a
+     * previous instance. */
+    comp->pid = 0;
+    component_withdraw_provides(idx);
+    component_cancel_check(idx);
+    component_standby_stop(idx);
+
+    int result = 0;
+    if (send_images(fd, dir) != 0 ||
+        request(fd, answer, sizeof(answer), "RESTORE\n") != 0 ||
+        sscanf(answer, "DONE %d", &res->remote_pid) != 1) {
+        LOG_ERR("migrate: '%s' did not resume on %s%s%s, starting it here again", name, node,
+                answer[0] ? ": " : "", answer);
+        component_set_state(comp, COMP_INACTIVE);
+        graph_mark_dirty(idx);
+        result = -5;
+    } else {
+        res->downtime_ms = (long)(timer_now_ms() - stopped_ms);
+        component_set_state(comp, COMP_MIGRATED);
+        LOG_INFO("migrate: '%s' runs on %s as pid %d after %ld ms stopped (%d pre-dump(s))",
+                 name, node, res->remote_pid, res->downtime_ms, res->passes);
+    }
+    close(fd);
+    checkpoint_remove_directory(dir);
+    return result;
+}
@@ -0,0 +1,88 @@
+/*
+ * migration.h - YakirOS live migration of components between nodes
+ *
+ * `graphctl migrate <component> <node>` moves a running service to a
+ * federation peer without restarting it. The source pre-dumps the
+ * process with CRIU while it keeps serving, each pass streaming its
+ * dirty pages straight into a CRIU page server the target starts for
+ * it, until the dirty set settles. The final pass stops the process
+ * and sends only what changed since; the few non-page images follow on
+ * the migration connection, staged on /run on both sides. The target
+ * restores the process, adopts it as the component's and registers its
+ * capabilities; the source then withdraws its own and leaves the
+ * component MIGRATED, so it is not started there again.
+ *
+ * Targets listen on TCP at their federation port, for configured peers
+ * only. The protocol is text lines, one answer per request:
+ *
+ *   CHALLENGE <nonce>          PROOF <nonce> <mac>
+ *   AUTH <mac>                 OK | ERR unauthenticated
+ *   MIGRATE <component>        OK | ERR <why>
+ *   PAGES <pass> <parent>      READY <port> | ERR <why>
+ *   SIZE <pass>                SIZE <bytes>
+ *   FILE <name> <size>         (no answer; <size> bytes follow)
+ *   RESTORE                    DONE <pid> | FAIL <why>
+ *
+ * Pass 0 is the final dump, passes from 1 are pre-dumps; parent is the
+ * pre-dump a pass builds on, 0 for none. The pages of a pass connect to
+ * <port> from the peer's host and are handed to a CRIU page server. A connection that goes away
+ * before DONE releases the component on the target.
+ *
+ * A connection starts by both sides proving the federation secret:
+ * nonces are MIGRATION_NONCE_HEX random hex digits, the PROOF mac is
+ * federation_mac() of "migrate-target <source nonce>" and the AUTH mac
+ * that of "migrate-source <target nonce>". Any other request before
+ * that is answered ERR unauthenticated and the connection closed.
+ */
+
+#ifndef MIGRATION_H
+#define MIGRATION_H
+
+#include "event.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Image directories under CHECKPOINT_RUN_DIR/<component> */
+#define MIGRATION_OUT_DIR     "migrate-out"
+#define MIGRATION_IN_DIR      "migrate-in"
+#define MIGRATION_LINE_MAX    512
+#define MIGRATION_NONCE_HEX   32
+#define MIGRATION_FILE_MAX    (64 * 1024 * 1024)   /* largest non-page image taken */
+/* Longer than CRIU may take to restore on the far side */
+#define MIGRATION_TIMEOUT_SEC 40
+/* A target drops a migration quiet this long: past any step of the
+ * source, a pre-dump streaming its pages included */
+#define MIGRATION_IDLE_SEC    (2 * MIGRATION_TIMEOUT_SEC)
+
+/* What migration_send() reports */
+typedef struct {
+    int    passes;        /* pre-dumps made while the service ran */
+    size_t pre_bytes;     /* page bytes they moved */
+    long   downtime_ms;   /* from stopping it here to running there */
+    int    remote_pid;    /* its pid on the target */
+} migration_result_t;
+
+/* Take migrations in on TCP port, registering the listener in epoll_fd.
+ * Returns the listening fd or -1. */
+int migration_listen(int epoll_fd, int port);
+
+/* Accept on a listener (for migrations or a pass's pages), or serve
+ * the connection, as epoll reports */
+void migration_accept(event_source_t *src);
+void migration_client_event(event_source_t *src, uint32_t events);
+
+/* TIMER_MIGRATION: drop the incoming migration if handle is its timer */
+void migration_timer_fired(int handle);
+
+/* Close the listener and drop a migration in progress */
+void migration_close_all(void);
+
+/* Move the ACTIVE service name to the live federation peer node. Blocks
+ * until it runs there or has failed. Returns 0; -1 if name is not an
+ * active service; -2 without CRIU; -3 if node is not a live peer or
+ * turned the component down; -4 if it failed and the service still runs
+ * here; -5 if it failed after the service was stopped, which is then
+ * started here afresh. */
+int migration_send(const char *name, const char *node, migration_result_t *res);
+
+#endif /* MIGRATION_H */
@@ -0,0 +1,180 @@
+/*
+ * notify.c - YakirOS sd_notify-compatible readiness socket implementation
+ */
+
+#define _GNU_SOURCE
+#include "notify.h"
+#include "event.h"
+#include "log.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+static int notify_fd = -1;
+static char notify_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static event_source_t notify_src = { EVENT_NOTIFY, -1 };
+
+int notify_init(int epoll_fd, const char *path) {
+    if (notify_fd >= 0) return notify_fd;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        LOG_ERR("notify socket path too long: %s", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG_ERR("notify socket: %s", strerror(errno));
+        return -1;
+    }
+
+    int on = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_PASSCRED, &on, sizeof(on)) < 0) {
+        LOG_ERR("notify socket SO_PASSCRED: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        LOG_ERR("notify socket bind %s: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    /* Services may drop privileges; the credential check does the gating */
+    chmod(path, 0666);
+
+    if (epoll_fd >= 0) {
+        notify_src.fd = fd;
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = &notify_src;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            LOG_ERR("epoll add for notify socket failed: %s", strerror(errno));
+            close(fd);
+            unlink(path);
+            return -1;
+        }
+    }
+
+    notify_fd = fd;
+    strcpy(notify_path, path);
+    LOG_INFO("notify socket listening on %s", path);
+    return fd;
+}
+
+const char *notify_socket_path(void) {
+    return notify_fd >= 0 ? notify_path : NULL;
+}
+
+void notify_close(void) {
+    if (notify_fd < 0) return;
+    close(notify_fd);
+    unlink(notify_path);
+    notify_fd = -1;
+    notify_src.fd = -1;
+    notify_path[0] = '\0';
+}
+
+int notify_parse(const char *buf, size_t len, notify_msg_t *msg) {
+    int fields = 0;
+    const char *end = buf + len;
+
+    while (buf < end) {
+        const char *nl = memchr(buf, '\n', (size_t)(end - buf));
+        const char *line_end = nl ? nl : end;
+        size_t line_len = (size_t)(line_end - buf);
+
+        if (line_len == 7 && memcmp(buf, "READY=1", 7) == 0) {
+            msg->ready = 1;
+            fields++;
+        } else if (line_len == 10 && memcmp(buf, "WATCHDOG=1", 10) == 0) {
+            msg->watchdog = 1;
+            fields++;
+        } else if (line_len > 7 && memcmp(buf, "STATUS=", 7) == 0) {
+            size_t n = line_len - 7;
+            if (n >= sizeof(msg->status)) n = sizeof(msg->status) - 1;
+            memcpy(msg->status, buf + 7, n);
+            msg->status[n] = '\0';
+            msg->has_status = 1;
+            fields++;
+        } else if (line_len > 8 && line_len < 32 && memcmp(buf, "MAINPID=", 8) == 0) {
+            char num[32];
+            memcpy(num, buf + 8, line_len - 8);
+            num[line_len - 8] = '\0';
+            char *endp;
+            long pid = strtol(num, &endp, 10);
+            if (*endp == '\0' && pid > 0) {
+                msg->mainpid = (pid_t)pid;
+                fields++;
+            }
+        }
+
+        buf = nl ? nl + 1 : end;
+    }
+    return fields;
+}
+
+int notify_receive(notify_msg_t *msg) {
+    if (notify_fd < 0) return 0;
+
+    for (;;) {
+        char buf[NOTIFY_MSG_MAX];
+        char control[CMSG_SPACE(sizeof(struct ucred))];
+        struct iovec iov = { .iov_base = buf, .iov_len = sizeof(buf) };
+        struct msghdr mh;
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = control;
+        mh.msg_controllen = sizeof(control);
+
+        ssize_t n = recvmsg(notify_fd, &mh, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_WARN("notify socket recvmsg: %s", strerror(errno));
+            }
+            return 0;
+        }
+
+        memset(msg, 0, sizeof(*msg));
+        for (struct cmsghdr *c = CMSG_FIRSTHDR(&mh); c; c = CMSG_NXTHDR(&mh, c)) {
+            if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_CREDENTIALS) {
+                struct ucred cred;
+                memcpy(&cred, CMSG_DATA(c), sizeof(cred));
+                msg->sender = cred.pid;
+            } else if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+                /* No fd store: never keep descriptors sent along */
+                int n_fds = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+                for (int i = 0; i < n_fds; i++) {
+                    int fd;
+                    memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+                    close(fd);
+                }
+            }
+        }
+
+        if (msg->sender <= 0) {
+            LOG_WARN("notify message without credentials dropped");
+            continue;
+        }
+        if (mh.msg_flags & MSG_TRUNC) {
+            LOG_WARN("oversized notify message from pid %d dropped", msg->sender);
+            continue;
+        }
+
+        notify_parse(buf, (size_t)n, msg);
+        return 1;
+    }
+}
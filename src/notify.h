@@ -0,0 +1,50 @@
+/*
+ * notify.h - YakirOS sd_notify-compatible readiness socket
+ *
+ * Components declared with readiness_method = "notify" get NOTIFY_SOCKET
+ * in their environment and report state by sending newline-separated
+ * KEY=VALUE datagrams to it, as with systemd's sd_notify(3). The socket
+ * has SO_PASSCRED set, so every message carries the sender's pid as
+ * checked by the kernel; messages are only accepted from the main process
+ * of a managed component.
+ */
+
+#ifndef NOTIFY_H
+#define NOTIFY_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#define NOTIFY_SOCKET_PATH "/run/graph/notify"
+#define NOTIFY_STATUS_MAX 128
+#define NOTIFY_MSG_MAX 4096
+
+/* One parsed notification */
+typedef struct {
+    pid_t sender;                     /* from SCM_CREDENTIALS */
+    int   ready;                      /* READY=1 */
+    int   watchdog;                   /* WATCHDOG=1 */
+    pid_t mainpid;                    /* MAINPID=, 0 if absent */
+    int   has_status;                 /* STATUS= present */
+    char  status[NOTIFY_STATUS_MAX];  /* STATUS= text, truncated */
+} notify_msg_t;
+
+/* Bind the notify socket at path and register it in epoll_fd (skipped if
+ * epoll_fd < 0). Returns the socket fd or -1. */
+int notify_init(int epoll_fd, const char *path);
+
+/* Path to export as NOTIFY_SOCKET, or NULL if the socket is not up */
+const char *notify_socket_path(void);
+
+/* Close and unlink the socket */
+void notify_close(void);
+
+/* Parse a datagram body into msg (sender untouched). Unknown keys are
+ * ignored. Returns the number of recognised fields. */
+int notify_parse(const char *buf, size_t len, notify_msg_t *msg);
+
+/* Receive the next pending notification. Messages without credentials
+ * are dropped. Returns 1 with msg filled, 0 when nothing is pending. */
+int notify_receive(notify_msg_t *msg);
+
+#endif /* NOTIFY_H */
@@ -0,0 +1,400 @@
+/*
+ * output.c - YakirOS component output capture implementation
+ *
+ * Output is tracked per component name rather than table index, so it
+ * survives reloads that move components around, and a pipe left over
+ * from a previous run of the component (e.g. held open by a forked
+ * daemon) keeps draining into the same place until it reaches EOF.
+ */
+
+#define _GNU_SOURCE
+#include "output.h"
+#include "toml.h"
+#include "timer.h"
+#include "log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+
+#define OUTPUT_READ_SIZE 4096
+#define OUTPUT_READS_PER_EVENT 16  /* then let other sources have a turn */
+#define OUTPUT_PATH_MAX (MAX_PATH + MAX_NAME + 8)
+#define OUTPUT_TAIL_CHUNK 8192     /* read backwards from the end this much at a time */
+
+typedef struct {
+    char     name[MAX_NAME];
+    int      log_fd;
+    off_t    log_size;
+    char    *ring;           /* OUTPUT_RING_BYTES, allocated on first output */
+    size_t   ring_start;
+    size_t   ring_len;
+    int      partial;        /* oldest line was partly overwritten */
+    uint64_t tokens;         /* rate limit budget in bytes */
+    uint64_t refill_ms;
+    size_t   suppressed;     /* bytes dropped since output was last accepted */
+} output_sink_t;
+
+typedef struct {
+    event_source_t src;      /* must be first: epoll hands us this */
+    output_sink_t *sink;
+} output_pipe_t;
+
+static int output_epoll_fd = -1;
+static char output_dir[MAX_PATH] = OUTPUT_DIR;
+static output_sink_t **sinks = NULL;
+static int n_sinks = 0;
+static int max_sinks = 0;
+static size_t rotate_bytes = OUTPUT_ROTATE_BYTES;
+static uint64_t rate_bytes = OUTPUT_RATE_BYTES;
+static uint64_t burst_bytes = OUTPUT_BURST_BYTES;
+static output_listener_t listener = NULL;
+
+void output_init(int epoll_fd, const char *dir) {
+    output_epoll_fd = epoll_fd;
+    snprintf(output_dir, sizeof(output_dir), "%s", dir);
+    mkdir(output_dir, 0755);
+}
+
+void output_set_limits(size_t rotate, size_t rate, size_t burst) {
+    rotate_bytes = rotate ? rotate : OUTPUT_ROTATE_BYTES;
+    rate_bytes = rate ? rate : OUTPUT_RATE_BYTES;
+    burst_bytes = burst ? burst : OUTPUT_BURST_BYTES;
+}
+
+void output_set_listener(output_listener_t fn) {
+    listener = fn;
+}
+
+void output_path(const char *name, char *buf, size_t size) {
+    snprintf(buf, size, "%s/%s.log", output_dir, name);
+}
+
+static int open_log_file(const char *name) {
+    char path[OUTPUT_PATH_MAX];
+    output_path(name, path, sizeof(path));
+    return open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+}
+
+static output_sink_t *sink_find(const char *name) {
+    for (int i = 0; i < n_sinks; i++) {
+        if (strcmp(sinks[i]->name, name) == 0) return sinks[i];
+    }
+    return NULL;
+}
+
+static output_sink_t *sink_get(const char *name) {
+    output_sink_t *s = sink_find(name);
+    if (s) return s;
+
+    if (n_sinks == max_sinks) {
+        int new_max = max_sinks ? max_sinks * 2 : 64;
+        output_sink_t **grown = realloc(sinks, (size_t)new_max * sizeof(*grown));
+        if (!grown) return NULL;
+        sinks = grown;
+        max_sinks = new_max;
+    }
+    s = calloc(1, sizeof(*s));
+    if (!s) return NULL;
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    s->log_fd = -1;
+    s->tokens = burst_bytes;
+    s->refill_ms = timer_now_ms();
+    sinks[n_sinks++] = s;
+    return s;
+}
+
+static void ring_append(output_sink_t *s, const char *data, size_t len) {
+    if (!s->ring) {
+        s->ring = malloc(OUTPUT_RING_BYTES);
+        if (!s->ring) return;
+    }
+    if (len >= OUTPUT_RING_BYTES) {
+        char before = '\n';
+        if (len > OUTPUT_RING_BYTES) {
+            before = data[len - OUTPUT_RING_BYTES - 1];
+        } else if (s->ring_len > 0) {
+            before = s->ring[(s->ring_start + s->ring_len - 1) % OUTPUT_RING_BYTES];
+        }
+        data += len - OUTPUT_RING_BYTES;
+        memcpy(s->ring, data, OUTPUT_RING_BYTES);
+        s->ring_start = 0;
+        s->ring_len = OUTPUT_RING_BYTES;
+        s->partial = before != '\n';
+        return;
+    }
+
+    /* The last byte pushed out decides whether the oldest line is whole */
+    size_t total = s->ring_len + len;
+    if (total > OUTPUT_RING_BYTES) {
+        size_t lost = total - OUTPUT_RING_BYTES - 1;
+        char before = lost < s->ring_len
+            ? s->ring[(s->ring_start + lost) % OUTPUT_RING_BYTES]
+            : data[lost - s->ring_len];
+        s->partial = before != '\n';
+    }
+
+    size_t end = (s->ring_start + s->ring_len) % OUTPUT_RING_BYTES;
+    size_t first = OUTPUT_RING_BYTES - end;
+    if (first > len) first = len;
+    memcpy(s->ring + end, data, first);
+    memcpy(s->ring, data + first, len - first);
+
+    if (total > OUTPUT_RING_BYTES) {
+        s->ring_start = (s->ring_start + total - OUTPUT_RING_BYTES) % OUTPUT_RING_BYTES;
+        s->ring_len = OUTPUT_RING_BYTES;
+    } else {
+        s->ring_len = total;
+    }
+}
+
+/* <name>.log becomes <name>.log.1, and so on up to OUTPUT_KEEP_FILES */
+static void rotate(output_sink_t *s) {
+    char base[OUTPUT_PATH_MAX], from[OUTPUT_PATH_MAX + 16], to[OUTPUT_PATH_MAX + 16];
+
+    output_path(s->name, base, sizeof(base));
+    close(s->log_fd);
+    for (int i = OUTPUT_KEEP_FILES - 1; i >= 1; i--) {
+        snprintf(from, sizeof(from), "%s.%d", base, i);
+        snprintf(to, sizeof(to), "%s.%d", base, i + 1);
+        rename(from, to);
+    }
+    snprintf(to, sizeof(to), "%s.1", base);
+    rename(base, to);
+
+    s->log_fd = open_log_file(s->name);
+    s->log_size = 0;
+}
+
+static void sink_write(output_sink_t *s, const char *data, size_t len) {
+    ring_append(s, data, len);
+    if (listener) listener(s->name, data, len);
+
+    if (s->log_fd < 0) {
+        s->log_fd = open_log_file(s->name);
+        if (s->log_fd < 0) return;
+        struct stat st;
+        s->log_size = fstat(s->log_fd, &st) == 0 ? st.st_size : 0;
+    }
+    if (s->log_size > 0 && (size_t)s->log_size + len > rotate_bytes) {
+        rotate(s);
+        if (s->log_fd < 0) return;
+    }
+    ssize_t n = write(s->log_fd, data, len);
+    if (n > 0) s->log_size += n;
+}
+
+/* Apply the rate limit, then keep what passes */
+static void sink_accept(output_sink_t *s, const char *data, size_t len) {
+    uint64_t now = timer_now_ms();
+    s->tokens += (now - s->refill_ms) * rate_bytes / 1000;
+    if (s->tokens > burst_bytes) s->tokens = burst_bytes;
+    s->refill_ms = now;
+
+    if (len > s->tokens) {
+        if (!s->suppressed) {
+            LOG_WARN("component '%s' is writing output too fast, dropping some", s->name);
+        }
+        s->suppressed += len;
+        return;
+    }
+    s->tokens -= len;
+
+    if (s->suppressed) {
+        char note[128];
+        int n = snprintf(note, sizeof(note),
+                         "[graph-resolver: %zu bytes of output suppressed]\n", s->suppressed);
+        sink_write(s, note, (size_t)n);
+        s->suppressed = 0;
+    }
+    sink_write(s, data, len);
+}
+
+int output_open(const char *name) {
+    if (output_epoll_fd < 0) {
+        /* No main loop to drain a pipe: write to the file directly */
+        mkdir(output_dir, 0755);
+        return open_log_file(name);
+    }
+
+    output_sink_t *s = sink_get(name);
+    output_pipe_t *p = calloc(1, sizeof(*p));
+    int fds[2];
+    if (!s || !p || pipe2(fds, O_CLOEXEC) < 0) {
+        LOG_WARN("cannot capture output of '%s', writing to its log file", name);
+        free(p);
+        return open_log_file(name);
+    }
+    /* Only our end is non-blocking; the component's writes must block */
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+
+    p->src.type = EVENT_OUTPUT;
+    p->src.fd = fds[0];
+    p->sink = s;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = p;
+    if (epoll_ctl(output_epoll_fd, EPOLL_CTL_ADD, fds[0], &ev) < 0) {
+        LOG_WARN("epoll add for output of '%s' failed: %s", name, strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        free(p);
+        return open_log_file(name);
+    }
+    return fds[1];
+}
+
+void output_event(event_source_t *src) {
+    output_pipe_t *p = (output_pipe_t *)src;
+    char buf[OUTPUT_READ_SIZE];
+
+    for (int i = 0; i < OUTPUT_READS_PER_EVENT; i++) {
+        ssize_t n = read(src->fd, buf, sizeof(buf));
+        if (n > 0) {
+            sink_accept(p->sink, buf, (size_t)n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) return;
+
+        /* Every writer has gone */
+        epoll_ctl(output_epoll_fd, EPOLL_CTL_DEL, src->fd, NULL);
+        close(src->fd);
+        free(p);
+        return;
+    }
+}
+
+/* The last lines lines kept in memory. complete is set if the ring held
+ * that many; otherwise everything it has is returned. */
+static char *ring_tail(const output_sink_t *s, int lines, size_t *len, int *complete) {
+    char *text = malloc(s->ring_len + 1);
+    if (!text) return NULL;
+    size_t first = OUTPUT_RING_BYTES - s->ring_start;
+    if (first > s->ring_len) first = s->ring_len;
+    memcpy(text, s->ring + s->ring_start, first);
+    memcpy(text + first, s->ring, s->ring_len - first);
+
+    /* Skip what is left of a line the ring has partly overwritten */
+    size_t begin = 0, end = s->ring_len;
+    if (s->partial) {
+        char *nl = memchr(text, '\n', end);
+        if (nl && (size_t)(nl - text) + 1 < end) begin = (size_t)(nl - text) + 1;
+    }
+
+    /* Walk back over lines line ends; an unterminated last line counts */
+    size_t p = end;
+    if (p > begin && text[p - 1] == '\n') p--;
+    int found = 0;
+    while (p > begin) {
+        if (text[p - 1] == '\n' && ++found == lines) break;
+        p--;
+    }
+    *complete = found == lines;
+
+    memmove(text, text + p, end - p);
+    text[end - p] = '\0';
+    *len = end - p;
+    return text;
+}
+
+/* Offset in the first size bytes of fd where its last lines lines start,
+ * scanning backwards a chunk at a time. found receives how many lines
+ * that is, fewer if the file is shorter. */
+static off_t tail_offset(int fd, off_t size, int lines, int *found) {
+    char buf[OUTPUT_TAIL_CHUNK];
+    off_t pos = size, start = size;
+    int n = 0;
+
+    while (pos > 0) {
+        size_t chunk = pos < OUTPUT_TAIL_CHUNK ? (size_t)pos : OUTPUT_TAIL_CHUNK;
+        pos -= (off_t)chunk;
+        if (pread(fd, buf, chunk, pos) != (ssize_t)chunk) {
+            *found = n;
+            return start;
+        }
+        for (size_t i = chunk; i-- > 0;) {
+            /* The newline ending the last line separates nothing */
+            if (buf[i] != '\n' || pos + (off_t)i == size - 1) continue;
+            start = pos + (off_t)i + 1;
+            if (++n == lines) {
+                *found = n;
+                return start;
+            }
+        }
+    }
+    *found = size > 0 ? n + 1 : 0;
+    return 0;
+}
+
+/* The last lines lines of name's log file, continuing into the rotated
+ * files if it is shorter. Only the returned lines are read. */
+static char *file_tail(const char *name, int lines, size_t *len) {
+    char base[OUTPUT_PATH_MAX], path[OUTPUT_PATH_MAX + 16];
+    char *text = NULL;
+    size_t text_len = 0;
+
+    output_path(name, base, sizeof(base));
+    for (int i = 0; i <= OUTPUT_KEEP_FILES && lines > 0; i++) {
+        if (i == 0) {
+            snprintf(path, sizeof(path), "%s", base);
+        } else {
+            snprintf(path, sizeof(path), "%s.%d", base, i);
+        }
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) break;
+
+        struct stat st;
+        int found = 0;
+        off_t off = fstat(fd, &st) == 0 ? tail_offset(fd, st.st_size, lines, &found) : 0;
+        size_t n = found > 0 ? (size_t)(st.st_size - off) : 0;
+
+        /* Older output goes in front */
+        char *joined = malloc(n + text_len + 1);
+        if (!joined) {
+            close(fd);
+            break;
+        }
+        ssize_t got = n ? pread(fd, joined, n, off) : 0;
+        close(fd);
+        if (got < 0) got = 0;
+        if (text_len) memcpy(joined + got, text, text_len);
+        free(text);
+        text = joined;
+        text_len += (size_t)got;
+        lines -= found;
+    }
+
+    if (!text) return NULL;
+    text[text_len] = '\0';
+    *len = text_len;
+    return text;
+}
+
+char *output_tail(const char *name, int lines, size_t *len) {
+    if (lines < 1) lines = 1;
+    if (lines > OUTPUT_TAIL_MAX_LINES) lines = OUTPUT_TAIL_MAX_LINES;
+
+    output_sink_t *s = sink_find(name);
+    if (!s || !s->ring) return file_tail(name, lines, len);
+
+    int complete;
+    char *text = ring_tail(s, lines, len, &complete);
+    if (!text || complete) return text;
+
+    /* The files go back further than memory does */
+    size_t file_len;
+    char *older = file_tail(name, lines, &file_len);
+    if (older && file_len > *len) {
+        free(text);
+        *len = file_len;
+        return older;
+    }
+    free(older);
+    return text;
+}
@@ -0,0 +1,59 @@
+/*
+ * output.h - YakirOS component output capture
+ *
+ * Components write stdout and stderr into a pipe owned by graph-resolver
+ * instead of straight into a file. The main loop drains the pipes, keeps
+ * the most recent output of every component in memory for the control
+ * socket's `log` command, and appends it to /run/graph/<name>.log,
+ * rotating the file once it reaches OUTPUT_ROTATE_BYTES. Output beyond
+ * OUTPUT_RATE_BYTES per second (after a burst allowance) is dropped and
+ * replaced by a note of how much was suppressed.
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "event.h"
+#include <stddef.h>
+
+#define OUTPUT_DIR          "/run/graph"
+#define OUTPUT_RING_BYTES   (32 * 1024)    /* recent output kept per component */
+#define OUTPUT_ROTATE_BYTES (1024 * 1024)  /* rotate <name>.log past this size */
+#define OUTPUT_KEEP_FILES   3              /* <name>.log.1 .. <name>.log.3 */
+#define OUTPUT_RATE_BYTES   (64 * 1024)    /* sustained bytes/s per component */
+#define OUTPUT_BURST_BYTES  (256 * 1024)   /* accepted at once above the rate */
+#define OUTPUT_TAIL_MAX_LINES 10000        /* most lines output_tail() returns */
+
+/* Called with each piece of output as it is kept, e.g. to stream it */
+typedef void (*output_listener_t)(const char *name, const char *data, size_t len);
+
+/* Register pipes in epoll_fd and keep log files in dir. Before this is
+ * called, or with epoll_fd -1, output_open() hands out the log file
+ * itself. */
+void output_init(int epoll_fd, const char *dir);
+
+/* Override the rotation size and rate limit; 0 keeps the default */
+void output_set_limits(size_t rotate, size_t rate, size_t burst);
+
+/* Descriptor for the stdout/stderr of name's next process: the write end
+ * of a fresh pipe, or the component's log file opened for append. It is
+ * close-on-exec; dup2() it in the child and close it in the parent once
+ * forked. Returns -1 if neither could be opened. */
+int output_open(const char *name);
+
+/* Drain a pipe the main loop reported ready */
+void output_event(event_source_t *src);
+
+void output_set_listener(output_listener_t fn);
+
+/* The last lines lines of name's output as a malloc'd string (len
+ * receives its length), or NULL if there is none. Served from memory when
+ * it holds that many lines, otherwise read backwards from the end of the
+ * log files, so the cost follows the lines asked for and not the size of
+ * the files. */
+char *output_tail(const char *name, int lines, size_t *len);
+
+/* Log file path of a component */
+void output_path(const char *name, char *buf, size_t size);
+
+#endif /* OUTPUT_H */
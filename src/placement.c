@@ -0,0 +1,590 @@
+/*
+ * placement.c - YakirOS CPU and memory placement implementation
+ *
+ * Each pass plans every running component from scratch: isolated CPUs
+ * are reserved first, then pinned components get their CPUs, then the
+ * rest are grouped along dependency edges and the groups spread over
+ * the nodes' remaining CPUs, largest first. What was written is kept per
+ * cgroup inode, so a cgroup reopened at another's descriptor is not
+ * mistaken for it.
+ */
+
+#define _GNU_SOURCE
+#include "placement.h"
+#include "capability.h"
+#include "cgroup.h"
+#include "component.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+typedef struct {
+    int             id;            /* N of /sys/devices/system/node/nodeN */
+    placement_set_t cpus;
+} placement_node_t;
+
+/* What was last written to a cgroup */
+typedef struct {
+    ino_t ino;
+    int   node;                    /* node it was placed on, -1 if pinned */
+    char  cpus[PLACEMENT_LIST_MAX];
+    char  mems[128];
+} placement_record_t;
+
+/* A component with a cgroup, while a pass plans it */
+typedef struct {
+    int             idx;
+    int             running;
+    ino_t           ino;
+    long long       load;          /* cpu.weight */
+    int             parent;        /* union-find over run[], for groups */
+    int             want;          /* node asked for, -1 for any */
+    int             prev;          /* node it was on, -1 if none */
+    int             pinned;        /* cpus fixed by cpuset or isolate_cpus */
+    int             node;          /* node it goes to, -1 if pinned or unconfined */
+    placement_set_t cpus;          /* empty: unconfined */
+} placement_run_t;
+
+typedef struct {
+    int provider, consumer;        /* into run[] */
+    int weight;                    /* running consumers of the provider */
+} placement_edge_t;
+
+static placement_node_t nodes[PLACEMENT_MAX_NODES];
+static int n_nodes = 0;
+static placement_set_t online;
+static unsigned int applied_epoch = 0;
+static int cpuset_enabled = 0;
+
+static placement_record_t *records = NULL;   /* sorted by ino */
+static int n_records = 0;
+
+static void set_add(placement_set_t *set, int cpu) {
+    set->bits[cpu / 64] |= 1ULL << (cpu % 64);
+}
+
+static int set_has(const placement_set_t *set, int cpu) {
+    return (set->bits[cpu / 64] >> (cpu % 64)) & 1;
+}
+
+static int set_count(const placement_set_t *set) {
+    int n = 0;
+    for (int i = 0; i < PLACEMENT_MAX_CPUS / 64; i++) n += __builtin_popcountll(set->bits[i]);
+    return n;
+}
+
+static void set_and(placement_set_t *set, const placement_set_t *other) {
+    for (int i = 0; i < PLACEMENT_MAX_CPUS / 64; i++) set->bits[i] &= other->bits[i];
+}
+
+static void set_andnot(placement_set_t *set, const placement_set_t *other) {
+    for (int i = 0; i < PLACEMENT_MAX_CPUS / 64; i++) set->bits[i] &= ~other->bits[i];
+}
+
+static void set_or(placement_set_t *set, const placement_set_t *other) {
+    for (int i = 0; i < PLACEMENT_MAX_CPUS / 64; i++) set->bits[i] |= other->bits[i];
+}
+
+static int set_intersects(const placement_set_t *a, const placement_set_t *b) {
+    for (int i = 0; i < PLACEMENT_MAX_CPUS / 64; i++) {
+        if (a->bits[i] & b->bits[i]) return 1;
+    }
+    return 0;
+}
+
+int placement_parse_list(const char *list, placement_set_t *set) {
+    memset(set, 0, sizeof(*set));
+    const char *p = list;
+    while (*p && *p != '\n') {
+        char *end;
+        long lo = strtol(p, &end, 10);
+        if (end == p || lo < 0) return -1;
+        long hi = lo;
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if (end == p || hi < lo) return -1;
+        }
+        if (hi >= PLACEMENT_MAX_CPUS) return -1;
+        for (long cpu = lo; cpu <= hi; cpu++) set_add(set, (int)cpu);
+        p = end;
+        if (*p == ',') {
+            p++;
+        } else if (*p && *p != '\n') {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* A list too long for buf ends at the last range that fit */
+void placement_format_list(const placement_set_t *set, char *buf, size_t size) {
+    size_t len = 0;
+    buf[0] = '\0';
+    for (int cpu = 0; cpu < PLACEMENT_MAX_CPUS; cpu++) {
+        if (!set_has(set, cpu)) continue;
+        int last = cpu;
+        while (last + 1 < PLACEMENT_MAX_CPUS && set_has(set, last + 1)) last++;
+        int n = last == cpu
+            ? snprintf(buf + len, size - len, "%s%d", len ? "," : "", cpu)
+            : snprintf(buf + len, size - len, "%s%d-%d", len ? "," : "", cpu, last);
+        if (n < 0 || (size_t)n >= size - len) {
+            buf[len] = '\0';
+            return;
+        }
+        len += (size_t)n;
+        cpu = last;
+    }
+}
+
+/* An empty file is an empty list */
+static int read_list(const char *path, placement_set_t *set) {
+    char buf[4096] = "";
+    FILE *f = fopen(path, "re");
+    if (!f) return -1;
+    if (!fgets(buf, sizeof(buf), f)) buf[0] = '\0';
+    fclose(f);
+    return placement_parse_list(buf, set);
+}
+
+int placement_init(const char *sysfs_root) {
+    char path[512];
+    placement_set_t ids;
+
+    n_nodes = 0;
+    memset(&online, 0, sizeof(online));
+    applied_epoch = 0;
+    free(records);
+    records = NULL;
+    n_records = 0;
+
+    snprintf(path, sizeof(path), "%s/devices/system/node/online", sysfs_root);
+    if (read_list(path, &ids) == 0) {
+        for (int id = 0; id < PLACEMENT_MAX_NODES; id++) {
+            if (!set_has(&ids, id)) continue;
+            placement_node_t *node = &nodes[n_nodes];
+            snprintf(path, sizeof(path), "%s/devices/system/node/node%d/cpulist", sysfs_root, id);
+            /* Memory-only nodes have nothing to run on */
+            if (read_list(path, &node->cpus) < 0 || set_count(&node->cpus) == 0) continue;
+            node->id = id;
+            set_or(&online, &node->cpus);
+            n_nodes++;
+        }
+    }
+
+    /* Without NUMA support the online CPUs are one node */
+    if (n_nodes == 0) {
+        snprintf(path, sizeof(path), "%s/devices/system/cpu/online", sysfs_root);
+        if (read_list(path, &online) < 0 || set_count(&online) == 0) {
+            LOG_WARN("cannot read the CPU topology under %s, placement is off", sysfs_root);
+            return 0;
+        }
+        nodes[0].id = 0;
+        nodes[0].cpus = online;
+        n_nodes = 1;
+    }
+
+    LOG_INFO("placement: %d NUMA node(s), %d CPUs", n_nodes, set_count(&online));
+    return n_nodes;
+}
+
+static int is_running(comp_state_t state) {
+    return state == COMP_STARTING || state == COMP_READY_WAIT ||
+           state == COMP_ACTIVE || state == COMP_DEGRADED;
+}
+
+static int has_hint(const component_t *comp) {
+    return comp->cpuset[0] || comp->numa >= 0 || comp->isolate_cpus > 0;
+}
+
+static int node_index(int id) {
+    for (int i = 0; i < n_nodes; i++) {
+        if (nodes[i].id == id) return i;
+    }
+    return -1;
+}
+
+/* The one node holding all of cpus, -1 if they span several */
+static int node_of(const placement_set_t *cpus) {
+    int found = -1;
+    for (int i = 0; i < n_nodes; i++) {
+        if (!set_intersects(cpus, &nodes[i].cpus)) continue;
+        if (found >= 0) return -1;
+        found = i;
+    }
+    return found;
+}
+
+static int compare_ino(const void *a, const void *b) {
+    ino_t x = ((const placement_record_t *)a)->ino;
+    ino_t y = ((const placement_record_t *)b)->ino;
+    return (x > y) - (x < y);
+}
+
+static placement_record_t *record_find(ino_t ino) {
+    placement_record_t key = { .ino = ino };
+    return bsearch(&key, records, (size_t)n_records, sizeof(*records), compare_ino);
+}
+
+static int find_root(placement_run_t *run, int r) {
+    while (run[r].parent != r) {
+        run[r].parent = run[run[r].parent].parent;
+        r = run[r].parent;
+    }
+    return r;
+}
+
+/* Take up to count of the highest free CPUs in pool for run[r] alone,
+ * always leaving one CPU to everything else */
+static void reserve(placement_run_t *run, int r, placement_set_t pool,
+                    placement_set_t *reserved) {
+    const component_t *comp = &components[run[r].idx];
+    set_andnot(&pool, reserved);
+    int spare = set_count(&online) - set_count(reserved) - 1;
+    int want = comp->isolate_cpus;
+    for (int cpu = PLACEMENT_MAX_CPUS - 1; cpu >= 0 && want > 0 && spare > 0; cpu--) {
+        if (!set_has(&pool, cpu)) continue;
+        set_add(&run[r].cpus, cpu);
+        set_add(reserved, cpu);
+        want--;
+        spare--;
+    }
+    if (want > 0) {
+        LOG_WARN("%s: only %d of %d CPUs could be isolated", comp->name,
+                 comp->isolate_cpus - want, comp->isolate_cpus);
+    }
+    run[r].pinned = set_count(&run[r].cpus) > 0;
+}
+
+/* Isolated CPUs go first, by priority, from the component's pinned CPUs,
+ * its node, or else the node with the most still free */
+static void plan_isolated(placement_run_t *run, int n, placement_set_t *reserved) {
+    for (;;) {
+        int best = -1;
+        for (int r = 0; r < n; r++) {
+            const component_t *comp = &components[run[r].idx];
+            if (!run[r].running || comp->isolate_cpus <= 0 || run[r].pinned || run[r].node == -2) continue;
+            if (best < 0 || comp->priority > components[run[best].idx].priority) best = r;
+        }
+        if (best < 0) break;
+
+        const component_t *comp = &components[run[best].idx];
+        placement_set_t pool = online;
+        int node = node_index(comp->numa);
+        if (comp->cpuset[0] && placement_parse_list(comp->cpuset, &pool) == 0) {
+            set_and(&pool, &online);
+        } else if (node >= 0) {
+            pool = nodes[node].cpus;
+        } else {
+            int most = -1;
+            for (int i = 0; i < n_nodes; i++) {
+                placement_set_t free_cpus = nodes[i].cpus;
+                set_andnot(&free_cpus, reserved);
+                if (most < 0 || set_count(&free_cpus) > most) {
+                    most = set_count(&free_cpus);
+                    pool = nodes[i].cpus;
+                }
+            }
+        }
+        reserve(run, best, pool, reserved);
+        run[best].node = -2;      /* tried; left to the passes below if nothing was free */
+    }
+    for (int r = 0; r < n; r++) {
+        if (run[r].node == -2) run[r].node = -1;
+    }
+}
+
+/* Pinned CPUs, other than those isolated for someone else */
+static void plan_pinned(placement_run_t *run, int n, const placement_set_t *reserved) {
+    for (int r = 0; r < n; r++) {
+        const component_t *comp = &components[run[r].idx];
+        if (!run[r].running || run[r].pinned || !comp->cpuset[0]) continue;
+        placement_set_t cpus;
+        if (placement_parse_list(comp->cpuset, &cpus) < 0) {
+            LOG_WARN("%s: cpuset \"%s\" is not a CPU list", comp->name, comp->cpuset);
+            continue;
+        }
+        set_and(&cpus, &online);
+        set_andnot(&cpus, reserved);
+        if (set_count(&cpus) == 0) {
+            LOG_WARN("%s: none of cpuset \"%s\" is free to run on", comp->name, comp->cpuset);
+            continue;
+        }
+        run[r].cpus = cpus;
+        run[r].pinned = 1;
+    }
+}
+
+static int compare_edge(const void *a, const void *b) {
+    const placement_edge_t *x = a, *y = b;
+    if (x->weight != y->weight) return x->weight - y->weight;
+    if (x->consumer != y->consumer) return x->consumer - y->consumer;
+    return x->provider - y->provider;
+}
+
+/* Dependency edges between running components, loosest couplings last */
+static placement_edge_t *collect_edges(placement_run_t *run, int n, int *n_edges) {
+    *n_edges = 0;
+    for (int r = 0; r < n; r++) {
+        if (run[r].running) component_refresh_cap_ids(&components[run[r].idx]);
+    }
+    int n_caps = capability_count();
+    int *provider = malloc(sizeof(int) * (size_t)(n_caps > 0 ? n_caps : 1));
+    int *consumers = calloc((size_t)(n > 0 ? n : 1), sizeof(int));
+    int max_edges = 0;
+    if (!provider || !consumers) goto out;
+    for (int c = 0; c < n_caps; c++) provider[c] = -1;
+
+    for (int r = 0; r < n; r++) {
+        const component_t *comp = &components[run[r].idx];
+        if (!run[r].running) continue;
+        max_edges += comp->n_requires;
+        for (int i = 0; i < comp->n_provides; i++) {
+            int cap = comp->provides_id[i];
+            if (cap >= 0 && cap < n_caps) provider[cap] = r;
+        }
+    }
+
+    placement_edge_t *edges = malloc(sizeof(*edges) * (size_t)(max_edges > 0 ? max_edges : 1));
+    if (!edges) goto out;
+    for (int r = 0; r < n; r++) {
+        const component_t *comp = &components[run[r].idx];
+        if (!run[r].running) continue;
+        for (int i = 0; i < comp->n_requires; i++) {
+            int cap = comp->requires_id[i];
+            int p = cap >= 0 && cap < n_caps ? provider[cap] : -1;
+            if (p < 0 || p == r) continue;
+            edges[*n_edges].provider = p;
+            edges[*n_edges].consumer = r;
+            (*n_edges)++;
+            consumers[p]++;
+        }
+    }
+    for (int e = 0; e < *n_edges; e++) edges[e].weight = consumers[edges[e].provider];
+    qsort(edges, (size_t)*n_edges, sizeof(*edges), compare_edge);
+    free(provider);
+    free(consumers);
+    return edges;
+
+out:
+    free(provider);
+    free(consumers);
+    return NULL;
+}
+
+/* Everything neither pinned nor isolated, grouped and spread */
+static void plan_groups(placement_run_t *run, int n, const placement_set_t *reserved) {
+    placement_set_t shared[PLACEMENT_MAX_NODES];
+    long long share[PLACEMENT_MAX_NODES], used[PLACEMENT_MAX_NODES];
+    long long total = 0, limit = 0;
+    int total_cpus = 0;
+
+    for (int i = 0; i < n_nodes; i++) {
+        shared[i] = nodes[i].cpus;
+        set_andnot(&shared[i], reserved);
+        total_cpus += set_count(&shared[i]);
+        used[i] = 0;
+    }
+    for (int r = 0; r < n; r++) {
+        if (run[r].running && !run[r].pinned) total += run[r].load;
+    }
+    if (total_cpus == 0) return;
+    for (int i = 0; i < n_nodes; i++) {
+        share[i] = (total * set_count(&shared[i]) * PLACEMENT_SLACK_PCT / 100 + total_cpus - 1) /
+                   total_cpus;
+        if (share[i] > limit) limit = share[i];
+    }
+
+    /* Group along dependencies while a group still fits on a node */
+    long long *load = malloc(sizeof(long long) * (size_t)(n > 0 ? n : 1));
+    if (!load) return;
+    for (int r = 0; r < n; r++) load[r] = run[r].load;
+    int n_edges;
+    placement_edge_t *edges = collect_edges(run, n, &n_edges);
+    for (int e = 0; edges && e < n_edges; e++) {
+        placement_run_t *p = &run[edges[e].provider], *c = &run[edges[e].consumer];
+        if (p->pinned && c->pinned) continue;
+        if (p->pinned || c->pinned) {
+            /* Follow a component pinned within one node */
+            int anchor = node_of(p->pinned ? &p->cpus : &c->cpus);
+            int root = find_root(run, p->pinned ? edges[e].consumer : edges[e].provider);
+            if (anchor >= 0 && run[root].want < 0) run[root].want = anchor;
+            continue;
+        }
+        int a = find_root(run, edges[e].provider), b = find_root(run, edges[e].consumer);
+        if (a == b || load[a] + load[b] > limit) continue;
+        if (run[a].want >= 0 && run[b].want >= 0 && run[a].want != run[b].want) continue;
+        run[b].parent = a;
+        load[a] += load[b];
+        if (run[a].want < 0) run[a].want = run[b].want;
+        if (run[a].prev < 0) run[a].prev = run[b].prev;
+    }
+    free(edges);
+
+    /* Largest groups first: each stays where it was while that node has
+     * room, or goes where the most is free */
+    for (;;) {
+        int best = -1;
+        for (int r = 0; r < n; r++) {
+            if (!run[r].running || run[r].pinned || run[r].node >= 0 || find_root(run, r) != r) continue;
+            if (best < 0 || load[r] > load[best]) best = r;
+        }
+        if (best < 0) break;
+
+        int node = run[best].want;
+        if (node < 0 || set_count(&shared[node]) == 0) {
+            node = run[best].prev;
+            if (node < 0 || set_count(&shared[node]) == 0 ||
+                (used[node] > 0 && used[node] + load[best] > share[node])) {
+                node = -1;
+                for (int i = 0; i < n_nodes; i++) {
+                    int cpus = set_count(&shared[i]);
+                    if (cpus == 0) continue;
+                    if (node < 0 || (used[i] + load[best]) * set_count(&shared[node]) <
+                                    (used[node] + load[best]) * cpus) {
+                        node = i;
+                    }
+                }
+            }
+        }
+        used[node] += load[best];
+        run[best].node = node;
+    }
+    free(load);
+
+    for (int r = 0; r < n; r++) {
+        if (!run[r].running || run[r].pinned) continue;
+        run[r].node = run[find_root(run, r)].node;
+        run[r].cpus = shared[run[r].node];
+    }
+}
+
+static void plan(placement_run_t *run, int n) {
+    placement_set_t reserved;
+    memset(&reserved, 0, sizeof(reserved));
+
+    for (int r = 0; r < n; r++) {
+        const component_t *comp = &components[run[r].idx];
+        run[r].parent = r;
+        run[r].node = -1;
+        run[r].want = -1;
+        if (comp->numa >= 0) {
+            run[r].want = node_index(comp->numa);
+            if (run[r].want < 0 && run[r].running) {
+                LOG_WARN("%s: there is no NUMA node %d with CPUs", comp->name, comp->numa);
+            }
+        }
+    }
+
+    plan_isolated(run, n, &reserved);
+    plan_pinned(run, n, &reserved);
+
+    /* One node with nothing isolated: the rest may run anywhere */
+    if (n_nodes > 1 || set_count(&reserved) > 0) plan_groups(run, n, &reserved);
+}
+
+/* Write what changed and keep it for the next pass. Components that are
+ * not running keep what they had, so a restart finds its node again. */
+static void write_out(placement_run_t *run, int n) {
+    placement_record_t *next = malloc(sizeof(*next) * (size_t)(n > 0 ? n : 1));
+    int n_next = 0;
+    if (!next) return;
+
+    for (int r = 0; r < n; r++) {
+        const component_t *comp = &components[run[r].idx];
+        placement_record_t *old = record_find(run[r].ino);
+        placement_record_t *rec = &next[n_next];
+
+        if (!run[r].running) {
+            if (old) next[n_next++] = *old;
+            continue;
+        }
+
+        rec->ino = run[r].ino;
+        rec->node = run[r].pinned ? node_of(&run[r].cpus) : run[r].node;
+        placement_format_list(&run[r].cpus, rec->cpus, sizeof(rec->cpus));
+        rec->mems[0] = '\0';
+        if (rec->cpus[0]) {
+            placement_set_t mems;
+            memset(&mems, 0, sizeof(mems));
+            for (int i = 0; i < n_nodes; i++) {
+                if (set_intersects(&run[r].cpus, &nodes[i].cpus)) set_add(&mems, nodes[i].id);
+            }
+            placement_format_list(&mems, rec->mems, sizeof(rec->mems));
+        }
+
+        if (old ? strcmp(old->cpus, rec->cpus) == 0 && strcmp(old->mems, rec->mems) == 0
+                : rec->cpus[0] == '\0') {
+            if (rec->cpus[0]) n_next++;
+            continue;
+        }
+
+        if (!cpuset_enabled) {
+            cgroup_enable_cpuset();
+            cpuset_enabled = 1;
+        }
+        /* A cgroup that refuses is not tried again until its placement changes */
+        if (cgroup_set_cpuset(comp->cgroup_fd, rec->cpus, rec->mems) < 0) {
+            LOG_WARN("failed to place %s on CPUs %s", comp->name, rec->cpus[0] ? rec->cpus : "(all)");
+        } else if (rec->cpus[0]) {
+            LOG_INFO("placed %s on CPUs %s, nodes %s", comp->name, rec->cpus, rec->mems);
+        }
+        if (rec->cpus[0]) n_next++;
+    }
+
+    free(records);
+    records = next;
+    n_records = n_next;
+    qsort(records, (size_t)n_records, sizeof(*records), compare_ino);
+}
+
+void placement_apply(void) {
+    unsigned int epoch = component_placement_epoch();
+    if (n_nodes == 0 || epoch == applied_epoch) return;
+    applied_epoch = epoch;
+
+    int n = 0, hinted = 0;
+    for (int i = 0; i < n_components; i++) {
+        if (components[i].cgroup_fd <= 0) continue;
+        n++;
+        if (is_running(components[i].state) && has_hint(&components[i])) hinted = 1;
+    }
+    /* A single node and nothing asked for: nothing to decide */
+    if (n_nodes == 1 && !hinted && n_records == 0) return;
+
+    placement_run_t *run = calloc((size_t)(n > 0 ? n : 1), sizeof(*run));
+    if (!run) {
+        LOG_ERR("placement: out of memory");
+        return;
+    }
+    n = 0;
+    for (int i = 0; i < n_components; i++) {
+        component_t *comp = &components[i];
+        struct stat st;
+        if (comp->cgroup_fd <= 0 || fstat(comp->cgroup_fd, &st) < 0) continue;
+        placement_run_t *r = &run[n++];
+        r->idx = i;
+        r->running = is_running(comp->state);
+        r->ino = st.st_ino;
+        r->load = comp->cpu_weight > 0 ? comp->cpu_weight : 100;
+        placement_record_t *old = record_find(st.st_ino);
+        r->prev = old ? old->node : -1;
+    }
+
+    plan(run, n);
+    write_out(run, n);
+    free(run);
+}
+
+int placement_current(int cgroup_fd, char *cpus, size_t cpus_size,
+                      char *mems, size_t mems_size) {
+    struct stat st;
+    if (fstat(cgroup_fd, &st) < 0) return -1;
+    placement_record_t *rec = record_find(st.st_ino);
+    if (!rec) return -1;
+    snprintf(cpus, cpus_size, "%s", rec->cpus);
+    snprintf(mems, mems_size, "%s", rec->mems);
+    return 0;
+}
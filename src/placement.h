@@ -0,0 +1,60 @@
+/*
+ * placement.h - YakirOS CPU and memory placement of components
+ *
+ * On a host with more than one NUMA node every running component's
+ * cgroup is given a cpuset.cpus and cpuset.mems of one node, so its
+ * threads run next to its memory. Components joined by a dependency are
+ * kept on the same node, as far as that leaves the nodes evenly loaded
+ * by cpu.weight: a provider with few consumers is taken to talk to them
+ * more than one everything depends on, and is grouped with them first.
+ * A group stays where it was while its node has room, so components
+ * are not moved about as others come and go.
+ *
+ * [resources] can steer it: `cpuset` pins a component to those CPUs,
+ * `numa` puts it (and whatever is grouped with it) on that node, and
+ * `isolate_cpus` keeps that many CPUs for it alone, taken out of every
+ * other cpuset. A single-node host with none of them is left alone.
+ *
+ * Placement is worked out again whenever a component starts or stops
+ * running or a declaration is reloaded, and only cgroups whose cpuset
+ * changes are written.
+ */
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PLACEMENT_MAX_CPUS  1024
+#define PLACEMENT_MAX_NODES 64
+#define PLACEMENT_LIST_MAX  1024   /* a CPU list as written to cpuset.cpus */
+/* A group may grow to, and stay on a node up to, this much of the node's
+ * fair share of the load */
+#define PLACEMENT_SLACK_PCT 150
+
+typedef struct {
+    uint64_t bits[PLACEMENT_MAX_CPUS / 64];
+} placement_set_t;
+
+/* Parse a kernel CPU list ("0-3,8,10-11") into set. Returns 0, or -1 if
+ * it is not one. */
+int placement_parse_list(const char *list, placement_set_t *set);
+
+/* Format set as a CPU list; "" for the empty set */
+void placement_format_list(const placement_set_t *set, char *buf, size_t size);
+
+/* Read the CPU and node topology under sysfs_root ("/sys"). Returns the
+ * number of nodes with CPUs, 0 if none could be read and placement is
+ * off. Forgets all earlier placement. */
+int placement_init(const char *sysfs_root);
+
+/* Place running components again if anything changed since last time */
+void placement_apply(void);
+
+/* The CPU and node lists last written to the cgroup open at cgroup_fd.
+ * Returns 0, or -1 if it was left unconfined. */
+int placement_current(int cgroup_fd, char *cpus, size_t cpus_size,
+                      char *mems, size_t mems_size);
+
+#endif /* PLACEMENT_H */
@@ -0,0 +1,298 @@
+/*
+ * pressure.c - YakirOS PSI-driven adaptive cgroup limits implementation
+ *
+ * A PSI trigger is a pressure file opened read-write with a threshold
+ * written to it; the kernel then raises POLLPRI on that fd at most once
+ * per window while the threshold is crossed, so nothing is read or
+ * polled while the system is calm.
+ */
+
+#define _GNU_SOURCE
+#include "pressure.h"
+#include "cgroup.h"
+#include "log.h"
+#include "timer.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+typedef struct {
+    int       on;               /* declared with a usable range */
+    long long min, max;
+    long long base;             /* declared value, drifted back to */
+    long long cur;              /* last value written */
+    uint64_t  changed_ms;       /* last stall that moved or held it */
+} pressure_knob_t;
+
+struct pressure_entry;
+
+typedef struct {
+    event_source_t         src;       /* first: epoll data.ptr points here */
+    struct pressure_entry *entry;
+    pressure_resource_t    resource;
+} pressure_trigger_t;
+
+typedef struct pressure_entry {
+    char               name[MAX_NAME];
+    int                cgroup_fd;
+    int                priority;
+    pressure_knob_t    knob[PRESSURE_RESOURCES];
+    pressure_trigger_t trigger[PRESSURE_RESOURCES];
+} pressure_entry_t;
+
+static const char *pressure_files[PRESSURE_RESOURCES] = {
+    "memory.pressure", "cpu.pressure"
+};
+static const char *knob_files[PRESSURE_RESOURCES] = {
+    "memory.high", "cpu.weight"
+};
+
+static pressure_entry_t **entries = NULL;
+static int n_entries = 0;
+static int max_entries = 0;
+static int pressure_epoll_fd = -1;
+static int triggers_warned = 0;
+
+static pressure_entry_t *entry_find(int cgroup_fd) {
+    for (int i = 0; i < n_entries; i++) {
+        if (entries[i]->cgroup_fd == cgroup_fd) return entries[i];
+    }
+    return NULL;
+}
+
+static int knob_write(pressure_entry_t *e, pressure_resource_t r) {
+    long long v = e->knob[r].cur;
+    if (r == PRESSURE_CPU) return cgroup_set_cpu_weight(e->cgroup_fd, (int)v);
+
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lld", v);
+    return cgroup_set_memory_high(e->cgroup_fd, buf);
+}
+
+/* Move a step toward target; returns 1 if the value changed */
+static int knob_step(pressure_entry_t *e, pressure_resource_t r, long long target) {
+    pressure_knob_t *k = &e->knob[r];
+    if (k->cur == target) return 0;
+
+    long long step = (k->max - k->min + PRESSURE_STEPS - 1) / PRESSURE_STEPS;
+    if (step < 1) step = 1;
+    if (k->cur < target) {
+        k->cur = k->cur + step < target ? k->cur + step : target;
+    } else {
+        k->cur = k->cur - step > target ? k->cur - step : target;
+    }
+    knob_write(e, r);
+    return 1;
+}
+
+static long long clamp(long long v, long long lo, long long hi) {
+    return v < lo ? lo : v > hi ? hi : v;
+}
+
+/* Range and starting point of each knob from the declaration */
+static void knobs_from(pressure_entry_t *e, const component_t *comp) {
+    pressure_knob_t *mem = &e->knob[PRESSURE_MEMORY];
+    mem->min = cgroup_parse_memory(comp->memory_high_min);
+    mem->max = cgroup_parse_memory(comp->memory_high_max);
+    if (mem->min > 0 && mem->max >= mem->min) {
+        /* No memory.high declared means none: start at the top */
+        long long high = cgroup_parse_memory(comp->memory_high);
+        mem->base = clamp(high > 0 ? high : mem->max, mem->min, mem->max);
+        mem->on = 1;
+    } else if (comp->memory_high_min[0] || comp->memory_high_max[0]) {
+        LOG_WARN("%s: unusable memory_high range %s..%s, memory.high stays fixed",
+                 comp->name, comp->memory_high_min, comp->memory_high_max);
+    }
+
+    pressure_knob_t *cpu = &e->knob[PRESSURE_CPU];
+    cpu->min = comp->cpu_weight_min;
+    cpu->max = comp->cpu_weight_max;
+    if (cpu->min > 0 && cpu->max >= cpu->min) {
+        /* cpu.weight defaults to 100 */
+        cpu->base = clamp(comp->cpu_weight > 0 ? comp->cpu_weight : 100, cpu->min, cpu->max);
+        cpu->on = 1;
+    } else if (comp->cpu_weight_min || comp->cpu_weight_max) {
+        LOG_WARN("%s: unusable cpu_weight range %d..%d, cpu.weight stays fixed",
+                 comp->name, comp->cpu_weight_min, comp->cpu_weight_max);
+    }
+
+    for (int r = 0; r < PRESSURE_RESOURCES; r++) {
+        e->knob[r].cur = e->knob[r].base;
+    }
+}
+
+static void trigger_arm(pressure_entry_t *e, pressure_resource_t r) {
+    pressure_trigger_t *t = &e->trigger[r];
+    if (pressure_epoll_fd < 0 || !e->knob[r].on || t->src.fd >= 0) return;
+
+    int fd = openat(e->cgroup_fd, pressure_files[r], O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) goto unavailable;
+
+    char spec[64];
+    int len = snprintf(spec, sizeof(spec), "some %d %d", PRESSURE_STALL_US, PRESSURE_WINDOW_US);
+    /* The kernel wants the terminating NUL written as well */
+    if (write(fd, spec, (size_t)len + 1) < 0) goto unavailable;
+
+    struct epoll_event ev;
+    ev.events = EPOLLPRI;
+    ev.data.ptr = &t->src;
+    if (epoll_ctl(pressure_epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) goto unavailable;
+
+    t->src.fd = fd;
+    return;
+
+unavailable:
+    if (!triggers_warned) {
+        LOG_WARN("PSI trigger on %s of %s unavailable, limits stay fixed: %s",
+                 pressure_files[r], e->name, strerror(errno));
+        triggers_warned = 1;
+    }
+    if (fd >= 0) close(fd);
+}
+
+static void trigger_disarm(pressure_trigger_t *t) {
+    if (t->src.fd < 0) return;
+    /* Explicitly: a child between fork and exec still shares the fd */
+    epoll_ctl(pressure_epoll_fd, EPOLL_CTL_DEL, t->src.fd, NULL);
+    close(t->src.fd);
+    t->src.fd = -1;
+}
+
+void pressure_init(int epoll_fd) {
+    pressure_epoll_fd = epoll_fd;
+    for (int i = 0; i < n_entries; i++) {
+        for (int r = 0; r < PRESSURE_RESOURCES; r++) trigger_arm(entries[i], r);
+    }
+}
+
+int pressure_add(int cgroup_fd, const component_t *comp) {
+    if (cgroup_fd < 0 || !comp->adaptive) return 0;
+    if (entry_find(cgroup_fd)) return 0;
+
+    pressure_entry_t *e = calloc(1, sizeof(*e));
+    if (!e) {
+        LOG_ERR("out of memory for pressure controller");
+        return -1;
+    }
+    knobs_from(e, comp);
+    if (!e->knob[PRESSURE_MEMORY].on && !e->knob[PRESSURE_CPU].on) {
+        LOG_WARN("%s is adaptive but declares no memory_high or cpu_weight range",
+                 comp->name);
+        free(e);
+        return 0;
+    }
+
+    if (n_entries == max_entries) {
+        int new_max = max_entries ? max_entries * 2 : 16;
+        pressure_entry_t **grown = realloc(entries, (size_t)new_max * sizeof(*grown));
+        if (!grown) {
+            LOG_ERR("out of memory growing pressure controller table");
+            free(e);
+            return -1;
+        }
+        entries = grown;
+        max_entries = new_max;
+    }
+
+    snprintf(e->name, sizeof(e->name), "%s", comp->name);
+    e->cgroup_fd = cgroup_fd;
+    e->priority = comp->priority;
+    for (int r = 0; r < PRESSURE_RESOURCES; r++) {
+        e->trigger[r].src.type = EVENT_PRESSURE;
+        e->trigger[r].src.fd = -1;
+        e->trigger[r].entry = e;
+        e->trigger[r].resource = r;
+        if (e->knob[r].on) {
+            knob_write(e, r);
+            trigger_arm(e, r);
+        }
+    }
+    entries[n_entries++] = e;
+    return 0;
+}
+
+/* Its triggers may still be in the main loop's current batch of events,
+ * so the entry is only disarmed and switched off here; cgroup_fd -1
+ * keeps it from being found, and pressure_reap() frees it */
+void pressure_remove(int cgroup_fd) {
+    pressure_entry_t *e = entry_find(cgroup_fd);
+    if (!e) return;
+
+    for (int r = 0; r < PRESSURE_RESOURCES; r++) {
+        trigger_disarm(&e->trigger[r]);
+        e->knob[r].on = 0;
+    }
+    e->cgroup_fd = -1;
+}
+
+void pressure_reap(void) {
+    for (int i = 0; i < n_entries; ) {
+        if (entries[i]->cgroup_fd < 0) {
+            free(entries[i]);
+            entries[i] = entries[--n_entries];
+        } else {
+            i++;
+        }
+    }
+}
+
+void pressure_event(event_source_t *src, uint32_t events) {
+    pressure_trigger_t *t = (pressure_trigger_t *)src;
+
+    /* Disarmed earlier in the same batch */
+    if (t->src.fd < 0) return;
+
+    if (events & EPOLLERR) {
+        /* The cgroup went away underneath us */
+        LOG_WARN("PSI trigger on %s of %s failed", pressure_files[t->resource], t->entry->name);
+        trigger_disarm(t);
+        return;
+    }
+    if (events & EPOLLPRI) {
+        pressure_stall(t->entry->cgroup_fd, t->resource, timer_now_ms());
+    }
+}
+
+void pressure_stall(int cgroup_fd, pressure_resource_t r, uint64_t now_ms) {
+    pressure_entry_t *e = entry_find(cgroup_fd);
+    if (!e || !e->knob[r].on) return;
+
+    /* The stalled component gets more, up to its maximum ... */
+    e->knob[r].changed_ms = now_ms;
+    if (knob_step(e, r, e->knob[r].max)) {
+        LOG_INFO("%s under %s stall: %s raised to %lld",
+                 e->name, pressure_files[r], knob_files[r], e->knob[r].cur);
+    }
+
+    /* ... at the expense of lower priorities, down to their minimum */
+    for (int i = 0; i < n_entries; i++) {
+        pressure_entry_t *o = entries[i];
+        if (o == e || !o->knob[r].on || o->priority >= e->priority) continue;
+        o->knob[r].changed_ms = now_ms;
+        if (knob_step(o, r, o->knob[r].min)) {
+            LOG_INFO("%s: %s lowered to %lld for %s", o->name, knob_files[r],
+                     o->knob[r].cur, e->name);
+        }
+    }
+}
+
+void pressure_relax(uint64_t now_ms) {
+    for (int i = 0; i < n_entries; i++) {
+        pressure_entry_t *e = entries[i];
+        for (int r = 0; r < PRESSURE_RESOURCES; r++) {
+            pressure_knob_t *k = &e->knob[r];
+            if (!k->on || now_ms - k->changed_ms < PRESSURE_SETTLE_MS) continue;
+            knob_step(e, r, k->base);
+        }
+    }
+}
+
+long long pressure_current(int cgroup_fd, pressure_resource_t r) {
+    pressure_entry_t *e = entry_find(cgroup_fd);
+    if (!e || !e->knob[r].on) return -1;
+    return e->knob[r].cur;
+}
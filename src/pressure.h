@@ -0,0 +1,59 @@
+/*
+ * pressure.h - YakirOS PSI-driven adaptive cgroup limits
+ *
+ * Components declared with `adaptive = true` in [resources] get PSI
+ * triggers on their memory.pressure and cpu.pressure files, polled in
+ * the main epoll set. When one of them stalls, its memory.high or
+ * cpu.weight is raised a step within its declared range, and that of
+ * every adaptive component with a lower priority is lowered a step, so
+ * higher priorities keep headroom under contention instead of everyone
+ * being throttled evenly. After PRESSURE_SETTLE_MS without a change the
+ * values drift back a step per PRESSURE_INTERVAL_MS to what the
+ * component declared.
+ */
+
+#ifndef PRESSURE_H
+#define PRESSURE_H
+
+#include "event.h"
+#include "toml.h"
+#include <stdint.h>
+
+#define PRESSURE_STALL_US    100000    /* trigger: 100ms of "some" stall ... */
+#define PRESSURE_WINDOW_US   1000000   /* ... within 1s */
+#define PRESSURE_STEPS       4         /* steps from one end of a range to the other */
+#define PRESSURE_SETTLE_MS   30000
+#define PRESSURE_INTERVAL_MS 5000
+
+typedef enum {
+    PRESSURE_MEMORY,         /* memory.pressure adjusts memory.high */
+    PRESSURE_CPU,            /* cpu.pressure adjusts cpu.weight */
+    PRESSURE_RESOURCES
+} pressure_resource_t;
+
+/* Register triggers in epoll_fd; cgroups added before are armed now */
+void pressure_init(int epoll_fd);
+
+/* Start or stop controlling the cgroup open at cgroup_fd. A component
+ * that is not adaptive, or has no usable range, is ignored. */
+int pressure_add(int cgroup_fd, const component_t *comp);
+void pressure_remove(int cgroup_fd);
+
+/* Free what pressure_remove() let go of; called once the main loop has
+ * dispatched its batch of events, which may still name its triggers */
+void pressure_reap(void);
+
+/* A trigger the main loop reported ready */
+void pressure_event(event_source_t *src, uint32_t events);
+
+/* React to a stall of resource in the cgroup, as a trigger does */
+void pressure_stall(int cgroup_fd, pressure_resource_t resource, uint64_t now_ms);
+
+/* Move settled values back toward their declared ones */
+void pressure_relax(uint64_t now_ms);
+
+/* Current value of resource in the cgroup (bytes or weight), -1 if it
+ * is not controlled */
+long long pressure_current(int cgroup_fd, pressure_resource_t resource);
+
+#endif /* PRESSURE_H */
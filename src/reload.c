@@ -0,0 +1,396 @@
+/*
+ * reload.c - YakirOS incremental reload implementation
+ *
+ * How each kind of change is applied:
+ *
+ *   added      appended to the table and queued for the resolver
+ *   changed    declaration replaced in place; state, process, restart and
+ *              health bookkeeping carry over. Capabilities it no longer
+ *              provides are withdrawn and new ones registered if it is up.
+ *              The process is not restarted; the new declaration takes
+ *              effect the next time it starts.
+ *   removed    capabilities withdrawn and its process left running, no
+ *              longer supervised. The last component moves into the free
+ *              slot, with its watch, timers and registrations re-pointed.
+ *
+ * Withdrawn and registered capabilities queue their consumers through the
+ * usual change tracking, so the next graph_resolve_pending() only looks
+ * at the components touched and what depends on them.
+ */
+
+#define _GNU_SOURCE
+#include "reload.h"
+#include "component.h"
+#include "capability.h"
+#include "graph.h"
+#include "graph-cache.h"
+#include "supervise.h"
+#include "timer.h"
+#include "log.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static char reload_dir[MAX_PATH] = GRAPH_DIR;
+static char **pending = NULL;
+static int n_pending = 0;
+static int max_pending = 0;
+static int pending_all = 0;
+static int reload_timer = 0;
+static uint64_t first_note_ms = 0;
+
+void reload_init(const char *dir) {
+    snprintf(reload_dir, sizeof(reload_dir), "%s", dir);
+}
+
+static int is_declaration(const char *name) {
+    size_t len = strlen(name);
+    return len > 5 && strcmp(name + len - 5, ".toml") == 0 && !strchr(name, '/');
+}
+
+/* Add name to the pending set unless it is already there */
+static void pending_add(const char *name) {
+    for (int i = 0; i < n_pending; i++) {
+        if (strcmp(pending[i], name) == 0) return;
+    }
+    if (n_pending == max_pending) {
+        int new_max = max_pending ? max_pending * 2 : 16;
+        char **grown = realloc(pending, (size_t)new_max * sizeof(*grown));
+        if (!grown) {
+            LOG_ERR("out of memory noting change to %s, rescanning everything", name);
+            pending_all = 1;
+            return;
+        }
+        pending = grown;
+        max_pending = new_max;
+    }
+    char *copy = strdup(name);
+    if (!copy) {
+        pending_all = 1;
+        return;
+    }
+    pending[n_pending++] = copy;
+}
+
+static void pending_clear(void) {
+    for (int i = 0; i < n_pending; i++) {
+        free(pending[i]);
+    }
+    n_pending = 0;
+    pending_all = 0;
+}
+
+/* Push the reload back until things are quiet, within RELOAD_MAX_DELAY_MS
+ * of the first change */
+static void schedule(void) {
+    uint64_t now = timer_now_ms();
+    if (!reload_timer) {
+        first_note_ms = now;
+    }
+
+    uint64_t due = now + RELOAD_DEBOUNCE_MS;
+    if (due > first_note_ms + RELOAD_MAX_DELAY_MS) {
+        due = first_note_ms + RELOAD_MAX_DELAY_MS;
+    }
+    timer_cancel(reload_timer);
+    int handle = timer_add(due, TIMER_RELOAD, -1);
+    reload_timer = handle > 0 ? handle : 0;
+}
+
+void reload_note(const char *name) {
+    if (!is_declaration(name)) return;
+    pending_add(name);
+    schedule();
+}
+
+void reload_note_all(void) {
+    pending_all = 1;
+    schedule();
+}
+
+int reload_pending(void) {
+    return pending_all ? -1 : n_pending;
+}
+
+void reload_timer_fired(int handle) {
+    if (handle != reload_timer) return;
+    reload_timer = 0;
+    reload_apply(NULL);
+}
+
+/* File name of a component declared in reload_dir, or NULL */
+static const char *declared_here(const component_t *comp) {
+    const char *path = comp_str(comp->config_path);
+    size_t dlen = strlen(reload_dir);
+    if (strncmp(path, reload_dir, dlen) != 0 || path[dlen] != '/') return NULL;
+    const char *name = path + dlen + 1;
+    return is_declaration(name) ? name : NULL;
+}
+
+static int find_by_path(const char *path) {
+    for (int i = 0; i < n_components; i++) {
+        if (strcmp(comp_str(components[i].config_path), path) == 0) return i;
+    }
+    return -1;
+}
+
+/* Every file in the directory plus every component that came from it */
+static void collect_all(void) {
+    DIR *d = opendir(reload_dir);
+    if (d) {
+        struct dirent *ent;
+        while ((ent = readdir(d)) != NULL) {
+            if (is_declaration(ent->d_name)) pending_add(ent->d_name);
+        }
+        closedir(d);
+    } else {
+        LOG_ERR("cannot open %s: %s", reload_dir, strerror(errno));
+    }
+    for (int i = 0; i < n_components; i++) {
+        const char *name = declared_here(&components[i]);
+        if (name) pending_add(name);
+    }
+}
+
+static int is_up(comp_state_t state) {
+    return state == COMP_ACTIVE || state == COMP_DEGRADED || state == COMP_ONESHOT_DONE;
+}
+
+static int has_id(const int *ids, int n, int id) {
+    for (int i = 0; i < n; i++) {
+        if (ids[i] == id) return 1;
+    }
+    return 0;
+}
+
+/* Drop idx from the consumer and on-demand provider lists it was
+ * linked into */
+static void unlink_consumer(int idx) {
+    component_t *comp = &components[idx];
+    if (comp->link_generation != capability_generation() || comp->link_idx != idx) return;
+    for (int i = 0; i < comp->n_requires; i++) {
+        capability_remove_consumer(comp->requires_id[i], idx);
+    }
+    for (int i = 0; comp->on_demand && i < comp->n_provides; i++) {
+        capability_remove_on_demand(comp->provides_id[i], idx);
+    }
+    comp->link_generation = 0;
+}
+
+static int provides_now(int idx, int cap) {
+    return capability_provider(cap) == idx && capability_active_by_idx(cap);
+}
+
+static void reload_add(component_t *fresh) {
+    if (component_table_reserve(n_components + 1) < 0) {
+        LOG_ERR("cannot grow component table, skipping %s", comp_str(fresh->config_path));
+        component_free_strings(fresh);
+        return;
+    }
+    int idx = n_components++;
+    components[idx] = *fresh;
+    LOG_INFO("loaded component '%s' from %s", fresh->name, comp_str(fresh->config_path));
+    graph_mark_dirty(idx);
+}
+
+static void reload_update(int idx, component_t *fresh) {
+    component_t *old = &components[idx];
+
+    /* Checks and deadlines follow the old declaration; restart them */
+    component_cancel_check(idx);
+    unlink_consumer(idx);
+
+    for (int i = 0; i < old->n_provides; i++) {
+        int cap = old->provides_id[i];
+        if (provides_now(idx, cap) && !has_id(fresh->provides_id, fresh->n_provides, cap)) {
+            capability_withdraw_id(cap);
+        }
+    }
+    if (is_up(old->state)) {
+        for (int i = 0; i < fresh->n_provides; i++) {
+            int cap = fresh->provides_id[i];
+            if (!has_id(old->provides_id, old->n_provides, cap)) {
+                capability_register_id(cap, idx);
+            }
+        }
+    }
+
+    /* New limits are written into a freshly opened cgroup at next start;
+     * placement hints are followed at once */
+    component_placement_changed();
+    if (!component_same_limits(old, fresh)) {
+        component_release_cgroup(idx);
+    }
+    /* Sockets declared now are bound at next start; the running process
+     * keeps its copies of the old ones */
+    if (!component_same_sockets(old, fresh)) {
+        component_close_sockets(idx);
+    }
+
+    component_copy_runtime(fresh, old);
+    /* A changed declaration is worth another try */
+    if (fresh->state == COMP_QUARANTINED) {
+        component_set_state(fresh, COMP_FAILED);
+        fresh->failures = 0;
+        fresh->restart_due_ms = 0;
+    }
+    component_free_strings(old);
+    *old = *fresh;
+    LOG_INFO("component '%s' updated from %s", old->name, comp_str(old->config_path));
+    if (!old->standby) {
+        component_standby_stop(idx);
+    }
+
+    component_resume(idx);
+    graph_mark_dirty(idx);
+}
+
+/* Move the component in slot from to the free slot to */
+static void reload_move(int from, int to) {
+    component_t *comp = &components[from];
+
+    component_cancel_check(from);
+    unlink_consumer(from);
+    for (int i = 0; i < comp->n_provides; i++) {
+        if (capability_provider(comp->provides_id[i]) == from) {
+            capability_set_provider(comp->provides_id[i], to);
+        }
+    }
+    if (comp->pid > 0) {
+        supervise_watch(comp->pid, to, PROC_MAIN);
+    }
+    if (comp->standby_pid > 0) {
+        supervise_watch(comp->standby_pid, to, PROC_STANDBY);
+    }
+
+    components[to] = *comp;
+    memset(comp, 0, sizeof(*comp));
+    component_resume(to);
+    graph_mark_dirty(to);
+}
+
+static void reload_remove(int idx) {
+    component_t *comp = &components[idx];
+
+    component_cancel_check(idx);
+    unlink_consumer(idx);
+    for (int i = 0; i < comp->n_provides; i++) {
+        if (provides_now(idx, comp->provides_id[i])) {
+            capability_withdraw_id(comp->provides_id[i]);
+        }
+    }
+    /* Its process keeps running, unsupervised, in its cgroup */
+    component_standby_stop(idx);
+    component_close_sockets(idx);
+    component_close_watchdog(idx);
+    component_release_cgroup(idx);
+    if (comp->pid > 0) {
+        supervise_unwatch(comp->pid);
+    }
+    LOG_INFO("component '%s' removed", comp->name);
+    component_free_strings(comp);
+
+    int last = n_components - 1;
+    if (idx != last) {
+        reload_move(last, idx);
+    } else {
+        memset(comp, 0, sizeof(*comp));
+    }
+    n_components--;
+}
+
+/* Rewrite the graph cache from the table as it now stands */
+static void refresh_cache(void) {
+    if (!graph_cache_path() || n_components == 0) return;
+
+    graph_cache_key_t *keys = calloc((size_t)n_components, sizeof(*keys));
+    if (!keys) return;
+    for (int i = 0; i < n_components; i++) {
+        struct stat st;
+        if (components[i].config_path && stat(components[i].config_path, &st) == 0) {
+            graph_cache_key(&st, &keys[i]);
+        }
+    }
+    graph_cache_write(components, keys, n_components);
+    free(keys);
+}
+
+int reload_apply(reload_stats_t *stats) {
+    reload_stats_t st = { 0, 0, 0, 0, 0 };
+    int deps_changed = 0;
+
+    timer_cancel(reload_timer);
+    reload_timer = 0;
+    if (pending_all) {
+        collect_all();
+    }
+
+    for (int p = 0; p < n_pending; p++) {
+        char path[MAX_PATH];
+        snprintf(path, sizeof(path), "%s/%s", reload_dir, pending[p]);
+        int idx = find_by_path(path);
+
+        struct stat sb;
+        if (stat(path, &sb) < 0) {
+            if (idx >= 0) {
+                reload_remove(idx);
+                st.removed++;
+                deps_changed = 1;
+            }
+            continue;
+        }
+
+        component_t fresh;
+        if (parse_component_file(path, &fresh) < 0) {
+            st.failed++;
+            if (idx >= 0) {
+                LOG_WARN("keeping the previous declaration of '%s'", components[idx].name);
+            }
+            continue;
+        }
+        if (component_intern_caps(&fresh) < 0) {
+            component_free_strings(&fresh);
+            st.failed++;
+            continue;
+        }
+
+        if (idx < 0) {
+            reload_add(&fresh);
+            st.added++;
+            deps_changed = 1;
+        } else if (strcmp(components[idx].name, fresh.name) != 0) {
+            /* Renamed: a different component as far as anyone can tell */
+            reload_remove(idx);
+            reload_add(&fresh);
+            st.removed++;
+            st.added++;
+            deps_changed = 1;
+        } else if (component_same_declaration(&components[idx], &fresh)) {
+            component_free_strings(&fresh);
+            st.unchanged++;
+        } else {
+            if (!component_same_deps(&components[idx], &fresh)) deps_changed = 1;
+            reload_update(idx, &fresh);
+            st.changed++;
+        }
+    }
+    pending_clear();
+
+    int changes = st.added + st.changed + st.removed;
+    if (changes > 0) {
+        LOG_INFO("reload: %d added, %d changed, %d removed, %d unchanged",
+                 st.added, st.changed, st.removed, st.unchanged);
+        /* Levels computed at boot no longer describe the table */
+        graph_boot_abort("component set changed, handing over to resolver");
+        if (deps_changed) {
+            validate_component_graph(1);
+        }
+        refresh_cache();
+    }
+
+    if (stats) *stats = st;
+    return changes;
+}
@@ -0,0 +1,52 @@
+/*
+ * reload.h - YakirOS incremental reload of component declarations
+ *
+ * Changes to the graph directory are collected by file name and applied
+ * together once the directory has been quiet for RELOAD_DEBOUNCE_MS, so
+ * an editor's write-temp-and-rename save costs one reload. Only the named
+ * files are parsed again, and the result is applied to the component
+ * table as a diff; components whose files did not change keep their slot,
+ * process watch, timers and capability registrations.
+ */
+
+#ifndef RELOAD_H
+#define RELOAD_H
+
+#define RELOAD_DEBOUNCE_MS 200    /* quiet time before applying changes */
+#define RELOAD_MAX_DELAY_MS 2000  /* upper bound under a steady stream */
+
+/* Outcome of one reload_apply() */
+typedef struct {
+    int added;
+    int changed;
+    int removed;
+    int unchanged;
+    int failed;     /* files that did not parse; any old declaration stays */
+} reload_stats_t;
+
+/* Directory the noted names are relative to */
+void reload_init(const char *dir);
+
+/* Note that a file in the directory was created, written, renamed or
+ * deleted, and (re)arm the debounce timer. Names not ending in .toml are
+ * ignored. */
+void reload_note(const char *name);
+
+/* Re-examine every file and component, e.g. after an inotify queue
+ * overflow or on SIGUSR1 */
+void reload_note_all(void);
+
+/* Number of noted files waiting for the debounce timer (-1 for "all") */
+int reload_pending(void);
+
+/* Parse the noted files and apply the differences: new files add a
+ * component, changed files replace the declaration in place keeping its
+ * runtime state, deleted files remove it. The affected components are
+ * queued for the resolver. Returns the number of components added,
+ * changed or removed; stats may be NULL. */
+int reload_apply(reload_stats_t *stats);
+
+/* TIMER_RELOAD fired with the given handle */
+void reload_timer_fired(int handle);
+
+#endif /* RELOAD_H */
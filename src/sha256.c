@@ -0,0 +1,126 @@
+/*
+ * sha256.c - YakirOS SHA-256 and HMAC-SHA256 implementation
+ */
+
+#include "sha256.h"
+#include <string.h>
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(sha256_t *h, const unsigned char *p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 |
+               (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = h->state[0], b = h->state[1], c = h->state[2], d = h->state[3];
+    uint32_t e = h->state[4], f = h->state[5], g = h->state[6], k = h->state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = k + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) +
+                      sha256_k[i] + w[i];
+        uint32_t t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        k = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    h->state[0] += a; h->state[1] += b; h->state[2] += c; h->state[3] += d;
+    h->state[4] += e; h->state[5] += f; h->state[6] += g; h->state[7] += k;
+}
+
+void sha256_init(sha256_t *h) {
+    static const uint32_t init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(h->state, init, sizeof(init));
+    h->bytes = 0;
+    h->used = 0;
+}
+
+void sha256_update(sha256_t *h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    h->bytes += len;
+
+    if (h->used > 0) {
+        size_t take = SHA256_BLOCK - h->used < len ? SHA256_BLOCK - h->used : len;
+        memcpy(h->block + h->used, p, take);
+        h->used += take;
+        p += take;
+        len -= take;
+        if (h->used < SHA256_BLOCK) return;
+        sha256_block(h, h->block);
+        h->used = 0;
+    }
+    for (; len >= SHA256_BLOCK; p += SHA256_BLOCK, len -= SHA256_BLOCK) {
+        sha256_block(h, p);
+    }
+    memcpy(h->block, p, len);
+    h->used = len;
+}
+
+void sha256_final(sha256_t *h, unsigned char digest[SHA256_DIGEST]) {
+    /* Padding: 0x80, zeros, then the length in bits */
+    h->block[h->used++] = 0x80;
+    if (h->used > 56) {
+        memset(h->block + h->used, 0, SHA256_BLOCK - h->used);
+        sha256_block(h, h->block);
+        h->used = 0;
+    }
+    memset(h->block + h->used, 0, 56 - h->used);
+    uint64_t bits = h->bytes * 8;
+    for (int i = 0; i < 8; i++) {
+        h->block[63 - i] = (unsigned char)(bits >> (8 * i));
+    }
+    sha256_block(h, h->block);
+
+    for (int i = 0; i < 8; i++) {
+        digest[4 * i] = (unsigned char)(h->state[i] >> 24);
+        digest[4 * i + 1] = (unsigned char)(h->state[i] >> 16);
+        digest[4 * i + 2] = (unsigned char)(h->state[i] >> 8);
+        digest[4 * i + 3] = (unsigned char)h->state[i];
+    }
+}
+
+void hmac_sha256(const void *key, size_t key_len, const void *data, size_t len,
+                 unsigned char mac[SHA256_DIGEST]) {
+    unsigned char k[SHA256_BLOCK] = { 0 };
+    sha256_t h;
+
+    /* Keys longer than a block are hashed first */
+    if (key_len > SHA256_BLOCK) {
+        sha256_init(&h);
+        sha256_update(&h, key, key_len);
+        sha256_final(&h, k);
+    } else {
+        memcpy(k, key, key_len);
+    }
+
+    unsigned char pad[SHA256_BLOCK], inner[SHA256_DIGEST];
+    for (int i = 0; i < SHA256_BLOCK; i++) pad[i] = k[i] ^ 0x36;
+    sha256_init(&h);
+    sha256_update(&h, pad, sizeof(pad));
+    sha256_update(&h, data, len);
+    sha256_final(&h, inner);
+
+    for (int i = 0; i < SHA256_BLOCK; i++) pad[i] = k[i] ^ 0x5c;
+    sha256_init(&h);
+    sha256_update(&h, pad, sizeof(pad));
+    sha256_update(&h, inner, sizeof(inner));
+    sha256_final(&h, mac);
+}
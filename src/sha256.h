@@ -0,0 +1,32 @@
+/*
+ * sha256.h - YakirOS SHA-256 and HMAC-SHA256
+ *
+ * Content addresses for the checkpoint chunk store, and the keyed MACs
+ * federation peers authenticate each other with.
+ */
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST 32
+#define SHA256_BLOCK  64
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t bytes;
+    unsigned char block[SHA256_BLOCK];
+    size_t   used;
+} sha256_t;
+
+void sha256_init(sha256_t *h);
+void sha256_update(sha256_t *h, const void *data, size_t len);
+void sha256_final(sha256_t *h, unsigned char digest[SHA256_DIGEST]);
+
+/* HMAC-SHA256 (RFC 2104) of data under key */
+void hmac_sha256(const void *key, size_t key_len, const void *data, size_t len,
+                 unsigned char mac[SHA256_DIGEST]);
+
+#endif /* SHA256_H */
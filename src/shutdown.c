@@ -0,0 +1,223 @@
+/*
+ * shutdown.c - YakirOS ordered shutdown
+ *
+ * Runs once the main loop has ended, with an epoll set of its own holding
+ * only the pidfds of the processes being stopped, so nothing else - notify
+ * datagrams, output, timers - wakes it. Each component counts the running
+ * components depending on it; it is signalled when that count reaches
+ * zero, and its own exit counts down those it depends on.
+ */
+
+#define _GNU_SOURCE
+#include "shutdown.h"
+#include "component.h"
+#include "graph.h"
+#include "log.h"
+#include "supervise.h"
+#include "timer.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+
+/* How often processes without a pidfd are looked at */
+#define SHUTDOWN_POLL_MS 50
+
+typedef enum {
+    STOP_WAITING,    /* dependents still running */
+    STOP_SIGNALLED,  /* sent stop_signal, SIGKILL at deadline */
+    STOP_KILLED,     /* sent SIGKILL, given up on at deadline */
+    STOP_DONE,       /* exited, or had no process */
+} stop_phase_t;
+
+typedef struct {
+    stop_phase_t phase;
+    int          blockers;     /* running dependents not yet exited */
+    int          polled;       /* no pidfd: exit found by polling */
+    uint64_t     deadline_ms;
+} stop_t;
+
+static stop_t *stops;
+static int remaining;
+
+/* Whether edge a - b is ordered: members of one cycle stop together */
+static int ordered(int a, int b) {
+    if (a == b) return 0;
+    int cycle = graph_cycle_of(a);
+    return cycle < 0 || cycle != graph_cycle_of(b);
+}
+
+static void finish(int idx) {
+    component_t *comp = &components[idx];
+    supervise_unwatch(comp->pid);
+    comp->pid = -1;
+    component_set_state(comp, COMP_INACTIVE);
+    stops[idx].phase = STOP_DONE;
+    remaining--;
+
+    /* What it depended on may now be next */
+    const int *deps;
+    int n = graph_direct_dependencies(idx, &deps);
+    for (int i = 0; i < n; i++) {
+        int p = deps[i];
+        if (ordered(idx, p) && stops[p].phase == STOP_WAITING) {
+            stops[p].blockers--;
+        }
+    }
+}
+
+/* Whether pid is gone, reaping it if it is our child; used without a
+ * pidfd */
+static int poll_exited(pid_t pid) {
+    int status;
+    pid_t r = waitpid(pid, &status, WNOHANG);
+    if (r == pid) return 1;
+    return r < 0 && errno == ECHILD && kill(pid, 0) < 0 && errno == ESRCH;
+}
+
+static void send_stop(int idx, uint64_t now) {
+    component_t *comp = &components[idx];
+    int sig = component_stop_signal(comp);
+    int timeout = comp->stop_timeout > 0 ? comp->stop_timeout : 10;
+
+    LOG_INFO("stopping '%s' (pid %d, signal %d, %ds to exit)", comp->name, comp->pid, sig, timeout);
+    if (supervise_signal(comp->pid, sig) < 0 && errno == ESRCH) {
+        /* Already gone; collect it if it is ours */
+        poll_exited(comp->pid);
+        finish(idx);
+        return;
+    }
+    stops[idx].phase = STOP_SIGNALLED;
+    stops[idx].deadline_ms = now + (uint64_t)timeout * 1000;
+}
+
+/* Escalate or give up on processes past their deadline; returns how
+ * many were sent SIGKILL */
+static int enforce_deadline(int idx, uint64_t now) {
+    component_t *comp = &components[idx];
+    if (now < stops[idx].deadline_ms) return 0;
+
+    if (stops[idx].phase == STOP_SIGNALLED) {
+        LOG_WARN("'%s' (pid %d) did not stop within %ds, killing it", comp->name, comp->pid,
+                 comp->stop_timeout > 0 ? comp->stop_timeout : 10);
+        supervise_signal(comp->pid, SIGKILL);
+        stops[idx].phase = STOP_KILLED;
+        stops[idx].deadline_ms = now + SHUTDOWN_KILL_GRACE * 1000;
+        return 1;
+    }
+    LOG_ERR("'%s' (pid %d) survived SIGKILL, leaving it behind", comp->name, comp->pid);
+    finish(idx);
+    return 0;
+}
+
+int shutdown_components(void) {
+    int n = n_components;
+    int killed = 0;
+    if (n == 0) return 0;
+
+    stops = calloc((size_t)n, sizeof(*stops));
+    if (!stops) {
+        LOG_ERR("shutdown: out of memory, killing every process at once");
+        for (int i = 0; i < n; i++) {
+            if (components[i].pid > 0) supervise_signal(components[i].pid, SIGKILL);
+        }
+        return 0;
+    }
+    int efd = epoll_create1(EPOLL_CLOEXEC);
+
+    remaining = 0;
+    for (int i = 0; i < n; i++) {
+        stops[i].phase = components[i].pid > 0 ? STOP_WAITING : STOP_DONE;
+        remaining += stops[i].phase == STOP_WAITING;
+    }
+
+    int n_polled = 0;
+    for (int i = 0; i < n; i++) {
+        if (stops[i].phase != STOP_WAITING) continue;
+
+        const int *dependents;
+        int nd = graph_direct_dependents(i, &dependents);
+        for (int k = 0; k < nd; k++) {
+            int j = dependents[k];
+            if (ordered(i, j) && stops[j].phase == STOP_WAITING) {
+                stops[i].blockers++;
+            }
+        }
+
+        proc_watch_t *w = supervise_lookup(components[i].pid);
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = w };
+        if (w && w->src.fd >= 0 && efd >= 0 &&
+            epoll_ctl(efd, EPOLL_CTL_ADD, w->src.fd, &ev) == 0) {
+            continue;
+        }
+        stops[i].polled = 1;
+        n_polled++;
+    }
+    LOG_INFO("shutdown: stopping %d processes, dependents first", remaining);
+
+    while (remaining > 0) {
+        uint64_t now = timer_now_ms();
+        uint64_t next = UINT64_MAX;
+        int in_flight = 0;
+
+        for (int i = 0; i < n; i++) {
+            if (stops[i].phase == STOP_WAITING && stops[i].blockers <= 0) {
+                send_stop(i, now);
+            } else if (stops[i].phase == STOP_SIGNALLED || stops[i].phase == STOP_KILLED) {
+                killed += enforce_deadline(i, now);
+            }
+            if (stops[i].phase == STOP_SIGNALLED || stops[i].phase == STOP_KILLED) {
+                in_flight++;
+                if (stops[i].deadline_ms < next) next = stops[i].deadline_ms;
+            }
+        }
+        if (remaining == 0) break;
+        if (in_flight == 0) {
+            /* Nothing left to exit that could unblock the rest */
+            LOG_WARN("shutdown: %d components still waiting on dependents, stopping them", remaining);
+            for (int i = 0; i < n; i++) {
+                if (stops[i].phase == STOP_WAITING) stops[i].blockers = 0;
+            }
+            continue;
+        }
+
+        int timeout = next > now ? (int)(next - now) : 0;
+        if (n_polled > 0 && timeout > SHUTDOWN_POLL_MS) timeout = SHUTDOWN_POLL_MS;
+
+        struct epoll_event events[32];
+        int ready = 0;
+        if (efd >= 0) {
+            ready = epoll_wait(efd, events, 32, timeout);
+        } else {
+            usleep((useconds_t)timeout * 1000);
+        }
+        for (int e = 0; e < ready; e++) {
+            proc_watch_t *w = events[e].data.ptr;
+            int status;
+            int idx = w->idx;
+            if (idx < 0 || idx >= n || components[idx].pid != w->pid ||
+                stops[idx].phase == STOP_DONE) {
+                continue;
+            }
+            if (supervise_collect(w, &status)) {
+                finish(idx);
+            }
+        }
+        for (int i = 0; i < n && n_polled > 0; i++) {
+            if (stops[i].polled && stops[i].phase != STOP_WAITING && stops[i].phase != STOP_DONE &&
+                poll_exited(components[i].pid)) {
+                finish(i);
+            }
+        }
+    }
+
+    if (efd >= 0) close(efd);
+    free(stops);
+    stops = NULL;
+    LOG_INFO("shutdown: all processes stopped%s", killed ? ", some killed" : "");
+    return killed;
+}
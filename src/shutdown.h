@@ -0,0 +1,24 @@
+/*
+ * shutdown.h - YakirOS ordered shutdown
+ *
+ * Stops every running component in reverse dependency order: a component
+ * is sent its stop_signal once everything depending on it has exited, so
+ * consumers go before their providers and everything with nothing left
+ * depending on it stops at once, in parallel. Members of one dependency
+ * cycle stop together. A process not gone stop_timeout seconds after its
+ * signal is sent SIGKILL. Exits are seen through the processes' pidfds,
+ * and shutdown is over as soon as the last one has exited.
+ */
+
+#ifndef SHUTDOWN_H
+#define SHUTDOWN_H
+
+/* Seconds a SIGKILLed process is given to disappear before it is left
+ * behind (e.g. stuck in uninterruptible sleep) */
+#define SHUTDOWN_KILL_GRACE 2
+
+/* Stop all component processes as above. Returns how many had to be
+ * killed. */
+int shutdown_components(void);
+
+#endif /* SHUTDOWN_H */
@@ -0,0 +1,272 @@
+/*
+ * spawn.c - YakirOS process spawning implementation
+ *
+ * The child runs spawn_child() on a stack of its own, sharing our memory
+ * until exec, while we are suspended (CLONE_VFORK). It must not allocate,
+ * lock, log or touch stdio: its work is plain system calls on what
+ * spawn_run() prepared. All signals are blocked around the clone, so none
+ * of our handlers runs in the child before it has reset them.
+ */
+
+#define _GNU_SOURCE
+#include "spawn.h"
+#include "cgroup.h"
+#include "log.h"
+#include "metrics.h"
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/mount.h>
+
+extern char **environ;
+
+#define SPAWN_STACK_SIZE (64 * 1024)
+
+/* Room left after "NAME=" for the digits of a pid */
+#define PID_DIGITS 16
+
+struct spawn_child {
+    spawn_t *sp;
+    char **envp;
+    sigset_t mask;              /* the caller's, restored in the child */
+    int forked;                 /* own memory and placed by cgroup_fork() */
+};
+
+void spawn_init(spawn_t *sp, const char *name, const char *path, char *const argv[]) {
+    memset(sp, 0, sizeof(*sp));
+    sp->name = name;
+    sp->path = path;
+    sp->argv = argv;
+    sp->cgroup_fd = -1;
+    sp->pid_env = -1;
+}
+
+int spawn_fd(spawn_t *sp, int source, int target) {
+    if (sp->n_fds == SPAWN_MAX_FDS || target < 0) return -1;
+    sp->fds[sp->n_fds][0] = source;
+    sp->fds[sp->n_fds][1] = target;
+    sp->n_fds++;
+    return 0;
+}
+
+int spawn_output(spawn_t *sp, int fd) {
+    if (fd == -1) return 0;
+    if (spawn_fd(sp, fd, STDOUT_FILENO) < 0) return -1;
+    return spawn_fd(sp, fd, STDERR_FILENO);
+}
+
+static int env_add(spawn_t *sp, const char *name, const char *value, size_t room) {
+    if (sp->n_env == SPAWN_MAX_ENV) return -1;
+    size_t size = strlen(name) + 1 + strlen(value) + room + 1;
+    char *entry = malloc(size);
+    if (!entry) return -1;
+    snprintf(entry, size, "%s=%s", name, value);
+    sp->env[sp->n_env++] = entry;
+    return 0;
+}
+
+int spawn_setenv(spawn_t *sp, const char *name, const char *value) {
+    return env_add(sp, name, value, 0);
+}
+
+int spawn_setenv_pid(spawn_t *sp, const char *name) {
+    if (env_add(sp, name, "", PID_DIGITS) < 0) return -1;
+    sp->pid_env = sp->n_env - 1;
+    return 0;
+}
+
+/* Does entry ("NAME=value") set a variable sp->env sets too? */
+static int env_overridden(const spawn_t *sp, const char *entry) {
+    size_t len = strcspn(entry, "=");
+    for (int i = 0; i < sp->n_env; i++) {
+        if (strncmp(sp->env[i], entry, len) == 0 && sp->env[i][len] == '=') return 1;
+    }
+    return 0;
+}
+
+/* Our environment with sp->env on top, for execve() */
+static char **env_build(const spawn_t *sp) {
+    size_t n = 0;
+    while (environ && environ[n]) n++;
+
+    char **envp = malloc((n + (size_t)sp->n_env + 1) * sizeof(*envp));
+    if (!envp) return NULL;
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!env_overridden(sp, environ[i])) envp[k++] = environ[i];
+    }
+    for (int i = 0; i < sp->n_env; i++) {
+        envp[k++] = sp->env[i];
+    }
+    envp[k] = NULL;
+    return envp;
+}
+
+void spawn_release(spawn_t *sp) {
+    for (int i = 0; i < sp->n_env; i++) {
+        free(sp->env[i]);
+    }
+    sp->n_env = 0;
+    sp->pid_env = -1;
+}
+
+/* In the child: give up before exec */
+static void child_fail(struct spawn_child *child, const char *what, int status) {
+    spawn_t *sp = child->sp;
+    sp->failed = what;
+    sp->err = errno;
+    if (child->forked) {
+        dprintf(STDERR_FILENO, "graph-resolver: %s failed for '%s': %s\n",
+                what, sp->name, strerror(sp->err));
+    }
+    _exit(status);
+}
+
+/* In the child: write our pid after the '=' of entry */
+static void put_pid(char *entry) {
+    char digits[PID_DIGITS];
+    int n = 0;
+    long pid = (long)getpid();
+    do {
+        digits[n++] = (char)('0' + pid % 10);
+        pid /= 10;
+    } while (pid > 0 && n < PID_DIGITS - 1);
+
+    char *p = strchr(entry, '=') + 1;
+    while (n > 0) *p++ = digits[--n];
+    *p = '\0';
+}
+
+static int spawn_child(void *arg) {
+    struct spawn_child *child = arg;
+    spawn_t *sp = child->sp;
+
+    struct sigaction dfl;
+    memset(&dfl, 0, sizeof(dfl));
+    dfl.sa_handler = SIG_DFL;
+    for (int sig = 1; sig < _NSIG; sig++) {
+        if (sig != SIGKILL && sig != SIGSTOP) sigaction(sig, &dfl, NULL);
+    }
+    sigprocmask(SIG_SETMASK, &child->mask, NULL);
+
+    /* Before it runs anything of its own. One its cgroup will not take
+     * would run in ours, without its limits, so it gives up instead. */
+    if (sp->cgroup_fd >= 0 && !child->forked) {
+        int fd = openat(sp->cgroup_fd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+        if (fd < 0 || write(fd, "0", 1) != 1) child_fail(child, "joining its cgroup", 126);
+        close(fd);
+    }
+
+    if (sp->new_session) setsid();
+
+    /* Every source above every target first, then into place */
+    int top = STDERR_FILENO;
+    for (int i = 0; i < sp->n_fds; i++) {
+        if (sp->fds[i][1] > top) top = sp->fds[i][1];
+    }
+    int devnull = -1;
+    int moved[SPAWN_MAX_FDS];
+    for (int i = 0; i < sp->n_fds; i++) {
+        int source = sp->fds[i][0];
+        if (source == SPAWN_DEVNULL) {
+            if (devnull < 0) devnull = open("/dev/null", O_RDWR | O_CLOEXEC);
+            source = devnull;
+        }
+        moved[i] = fcntl(source, F_DUPFD_CLOEXEC, top + 1);
+        if (moved[i] < 0) child_fail(child, "passing descriptors", 126);
+    }
+    for (int i = 0; i < sp->n_fds; i++) {
+        if (dup2(moved[i], sp->fds[i][1]) < 0) child_fail(child, "passing descriptors", 126);
+        close(moved[i]);
+    }
+    if (devnull >= 0) close(devnull);
+
+    if (sp->namespaces) {
+        if (unshare(sp->namespaces) < 0) child_fail(child, "creating namespaces", 126);
+        if (sp->namespaces & CLONE_NEWNS) {
+            /* A private /tmp; without it the component shares ours */
+            mount("tmpfs", "/tmp", "tmpfs", MS_NOSUID | MS_NODEV, "mode=1777");
+        }
+        if ((sp->namespaces & CLONE_NEWUTS) && sp->hostname && sp->hostname[0]) {
+            sethostname(sp->hostname, strlen(sp->hostname));
+        }
+    }
+
+    if (sp->pid_env >= 0) put_pid(sp->env[sp->pid_env]);
+
+    execve(sp->path, sp->argv, child->envp);
+    child_fail(child, "exec", 127);
+    return 127;
+}
+
+/* The descriptor the child's stderr comes from, or -1 */
+static int stderr_source(const spawn_t *sp) {
+    for (int i = sp->n_fds - 1; i >= 0; i--) {
+        if (sp->fds[i][1] == STDERR_FILENO) return sp->fds[i][0] >= 0 ? sp->fds[i][0] : -1;
+    }
+    return -1;
+}
+
+pid_t spawn_run(spawn_t *sp) {
+    struct spawn_child child = { .sp = sp };
+    pid_t pid = -1;
+    int saved = ENOMEM;
+
+    uint64_t started_us = trace_now_us();
+    sp->failed = NULL;
+    sp->err = 0;
+    child.envp = env_build(sp);
+    if (!child.envp) goto out;
+
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &child.mask);
+
+    if (sp->namespaces & CLONE_NEWUSER) {
+        child.forked = 1;
+        pid = cgroup_fork(sp->cgroup_fd);
+        if (pid == 0) spawn_child(&child);
+        saved = errno;
+    } else {
+        void *stack = mmap(NULL, SPAWN_STACK_SIZE, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+        if (stack != MAP_FAILED) {
+            /* Returns once the child has exec'd or exited */
+            pid = clone(spawn_child, (char *)stack + SPAWN_STACK_SIZE,
+                        CLONE_VM | CLONE_VFORK | SIGCHLD, &child);
+            saved = errno;
+            munmap(stack, SPAWN_STACK_SIZE);
+        } else {
+            saved = errno;
+        }
+    }
+
+    pthread_sigmask(SIG_SETMASK, &child.mask, NULL);
+    free(child.envp);
+
+    if (pid > 0) {
+        trace_spawn(sp->name, sp->path, pid, started_us);
+        metrics_observe(METRIC_SPAWN, trace_now_us() - started_us);
+    }
+    if (pid > 0 && sp->failed) {
+        LOG_ERR("%s failed for '%s': %s", sp->failed, sp->name, strerror(sp->err));
+        int err_fd = stderr_source(sp);
+        if (err_fd >= 0) {
+            dprintf(err_fd, "graph-resolver: %s failed for '%s': %s\n",
+                    sp->failed, sp->name, strerror(sp->err));
+        }
+    }
+
+out:
+    spawn_release(sp);
+    errno = saved;
+    return pid;
+}
@@ -0,0 +1,77 @@
+/*
+ * spawn.h - YakirOS process spawning
+ *
+ * Every process graph-resolver runs (components, their standbys and
+ * upgrades, health and readiness checks, CRIU) is started here. The child
+ * is created with clone(CLONE_VM | CLONE_VFORK): it borrows our memory
+ * until it execs, so no page tables are copied and spawning costs the
+ * same however large graph-resolver grows. Everything it needs (argv,
+ * environment, descriptors) is prepared beforehand; between clone and
+ * exec it only makes system calls: it joins its cgroup, starts a session,
+ * unshares namespaces and moves descriptors into place.
+ *
+ * A user namespace cannot be unshared by a process sharing its memory,
+ * so a child that is to have one is forked instead, with cgroup_fork().
+ */
+
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <sys/types.h>
+
+/* Descriptors and environment variables one spawn may pass on: enough
+ * for stdout, stderr, a handoff socket and every declared socket */
+#define SPAWN_MAX_FDS 24
+#define SPAWN_MAX_ENV 8
+
+/* Source descriptor opened on /dev/null in the child */
+#define SPAWN_DEVNULL (-2)
+
+typedef struct {
+    const char *name;                   /* what is spawned, for messages */
+    const char *path;                   /* executable, run with execve() */
+    char *const *argv;
+    int cgroup_fd;                      /* child joins it; -1 stays in ours */
+    int new_session;                    /* setsid() in the child */
+    int namespaces;                     /* CLONE_NEW* flags to unshare() */
+    const char *hostname;               /* of a new UTS namespace */
+
+    int n_fds;
+    int fds[SPAWN_MAX_FDS][2];          /* {source, target} */
+    int n_env;
+    char *env[SPAWN_MAX_ENV];           /* "NAME=value", over our environ */
+    int pid_env;                        /* index of the one holding the child's pid */
+
+    /* Set by the child when it gives up before exec */
+    const char *failed;
+    int err;
+} spawn_t;
+
+/* Describe a child running path with argv, in our cgroup, its signal
+ * dispositions at their defaults and our descriptors not marked
+ * close-on-exec (with stdin, stdout and stderr) left to it */
+void spawn_init(spawn_t *sp, const char *name, const char *path, char *const argv[]);
+
+/* Have the child find source (one of ours, or SPAWN_DEVNULL) at target.
+ * All sources are moved out of the way before any is placed, so one
+ * target may be another's source. Returns 0, or -1 if there are too many. */
+int spawn_fd(spawn_t *sp, int source, int target);
+
+/* stdout and stderr to fd (or SPAWN_DEVNULL); -1 leaves ours */
+int spawn_output(spawn_t *sp, int fd);
+
+/* Set NAME=value in the child's environment. spawn_setenv_pid() sets it
+ * to the child's own pid, which only the child knows. Return 0 or -1. */
+int spawn_setenv(spawn_t *sp, const char *name, const char *value);
+int spawn_setenv_pid(spawn_t *sp, const char *name);
+
+/* Start the child and release what spawn_setenv() kept. Returns once it
+ * has exec'd: its pid, or -1 with errno set if it could not be created.
+ * A child failing between clone and exec exits 126 (127 if exec itself
+ * failed), with why logged and written to its stderr. */
+pid_t spawn_run(spawn_t *sp);
+
+/* Release what spawn_setenv() kept, for a spawn given up before run */
+void spawn_release(spawn_t *sp);
+
+#endif /* SPAWN_H */
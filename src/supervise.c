@@ -0,0 +1,247 @@
+/*
+ * supervise.c - YakirOS process supervision implementation
+ *
+ * Watch entries live in a fixed pool and never move, so their addresses
+ * can sit in epoll data.ptr. The pid index is an open-addressed table with
+ * linear probing; removal shifts later entries back instead of leaving
+ * tombstones, since pids come and go constantly.
+ */
+
+#define _GNU_SOURCE
+#include "supervise.h"
+#include "log.h"
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#define WATCH_HASH_SIZE (MAX_WATCHES * 2)
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+static proc_watch_t watches[MAX_WATCHES];
+static int free_list[MAX_WATCHES];
+static int n_free = 0;
+static int n_watched = 0;
+static int initialized = 0;
+
+/* Slot + 1, 0 means empty */
+static int watch_hash[WATCH_HASH_SIZE];
+
+static int epoll_fd = -1;
+static int have_pidfd = 0;
+
+static int sys_pidfd_open(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static int sys_pidfd_send_signal(int pidfd, int sig) {
+#ifdef SYS_pidfd_send_signal
+    return (int)syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0);
+#else
+    (void)pidfd;
+    (void)sig;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static unsigned int pid_hash(pid_t pid) {
+    return ((unsigned int)pid * 2654435761u) % WATCH_HASH_SIZE;
+}
+
+/* Hash slot holding pid, or the empty slot where it belongs */
+static unsigned int hash_slot(pid_t pid) {
+    unsigned int h = pid_hash(pid);
+    while (watch_hash[h] != 0 && watches[watch_hash[h] - 1].pid != pid) {
+        h = (h + 1) % WATCH_HASH_SIZE;
+    }
+    return h;
+}
+
+static void hash_remove(unsigned int hole) {
+    watch_hash[hole] = 0;
+    unsigned int h = (hole + 1) % WATCH_HASH_SIZE;
+    while (watch_hash[h] != 0) {
+        unsigned int home = pid_hash(watches[watch_hash[h] - 1].pid);
+        /* Move the entry back if the hole lies between its home and here */
+        if ((h > hole && (home <= hole || home > h)) ||
+            (h < hole && (home <= hole && home > h))) {
+            watch_hash[hole] = watch_hash[h];
+            watch_hash[h] = 0;
+            hole = h;
+        }
+        h = (h + 1) % WATCH_HASH_SIZE;
+    }
+}
+
+int supervise_init(int efd) {
+    /* Release pidfds still held from a previous table */
+    for (int i = 0; i < MAX_WATCHES && initialized; i++) {
+        if (watches[i].pid > 0 && watches[i].src.fd >= 0) {
+            close(watches[i].src.fd);
+        }
+    }
+
+    memset(watches, 0, sizeof(watches));
+    memset(watch_hash, 0, sizeof(watch_hash));
+    n_free = 0;
+    for (int i = MAX_WATCHES - 1; i >= 0; i--) {
+        watches[i].src.type = EVENT_PROCESS;
+        watches[i].src.fd = -1;
+        free_list[n_free++] = i;
+    }
+    n_watched = 0;
+    initialized = 1;
+
+    epoll_fd = efd;
+    have_pidfd = 0;
+    if (epoll_fd >= 0) {
+        int fd = sys_pidfd_open(getpid());
+        if (fd >= 0) {
+            close(fd);
+            have_pidfd = 1;
+        } else {
+            LOG_WARN("pidfd unavailable (%s), supervising via SIGCHLD only",
+                     strerror(errno));
+        }
+    }
+    return have_pidfd;
+}
+
+int supervise_watch(pid_t pid, int idx, proc_role_t role) {
+    if (!initialized) supervise_init(-1);
+    if (pid <= 0) return -1;
+
+    unsigned int h = hash_slot(pid);
+    if (watch_hash[h] != 0) {
+        proc_watch_t *w = &watches[watch_hash[h] - 1];
+        w->idx = idx;
+        w->role = role;
+        return 0;
+    }
+
+    if (n_free == 0) {
+        LOG_ERR("supervision table full, pid %d unwatched", pid);
+        return -1;
+    }
+
+    int slot = free_list[--n_free];
+    proc_watch_t *w = &watches[slot];
+    w->pid = pid;
+    w->idx = idx;
+    w->role = role;
+    w->src.fd = -1;
+    watch_hash[h] = slot + 1;
+    n_watched++;
+
+    if (have_pidfd) {
+        int fd = sys_pidfd_open(pid);
+        if (fd >= 0) {
+            struct epoll_event ev;
+            ev.events = EPOLLIN;
+            ev.data.ptr = &w->src;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0) {
+                w->src.fd = fd;
+            } else {
+                LOG_WARN("epoll add for pidfd of %d failed: %s", pid, strerror(errno));
+                close(fd);
+            }
+        } else if (errno != ESRCH) {
+            LOG_WARN("pidfd_open(%d) failed: %s", pid, strerror(errno));
+        }
+        /* ESRCH: already gone; SIGCHLD delivers the exit */
+    }
+    return 0;
+}
+
+void supervise_unwatch(pid_t pid) {
+    if (!initialized || pid <= 0) return;
+
+    unsigned int h = hash_slot(pid);
+    if (watch_hash[h] == 0) return;
+
+    int slot = watch_hash[h] - 1;
+    proc_watch_t *w = &watches[slot];
+    if (w->src.fd >= 0) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, w->src.fd, NULL);
+        close(w->src.fd);
+        w->src.fd = -1;
+    }
+    w->pid = 0;
+    hash_remove(h);
+    free_list[n_free++] = slot;
+    n_watched--;
+}
+
+proc_watch_t *supervise_lookup(pid_t pid) {
+    if (!initialized || pid <= 0) return NULL;
+    unsigned int h = hash_slot(pid);
+    return watch_hash[h] ? &watches[watch_hash[h] - 1] : NULL;
+}
+
+/* Wait status of an exit reported by waitid() */
+static int wait_status(const siginfo_t *info) {
+    switch (info->si_code) {
+    case CLD_EXITED: return (info->si_status & 0xff) << 8;
+    case CLD_DUMPED: return info->si_status | 0x80;
+    default:         return info->si_status;
+    }
+}
+
+int supervise_collect(proc_watch_t *w, int *status) {
+    if (w->pid <= 0) return 0;   /* already handled */
+
+    int r;
+    if (w->src.fd >= 0) {
+        /* Through the pidfd, so a reused pid cannot be collected instead */
+        siginfo_t info;
+        memset(&info, 0, sizeof(info));
+        r = waitid(P_PIDFD, (id_t)w->src.fd, &info, WEXITED | WNOHANG);
+        if (r == 0 && info.si_pid == w->pid) {
+            *status = wait_status(&info);
+            return 1;
+        }
+    } else {
+        pid_t pid = waitpid(w->pid, status, WNOHANG);
+        if (pid == w->pid) return 1;
+        r = pid < 0 ? -1 : 0;
+    }
+    if (r < 0 && errno == ECHILD && w->src.fd >= 0) {
+        /* Adopted process that is not our child: its exit status is not
+         * ours to collect, so trust the pidfd (the event may be stale if
+         * the slot was reused within one epoll batch) */
+        struct pollfd pfd = { .fd = w->src.fd, .events = POLLIN };
+        if (poll(&pfd, 1, 0) == 1) {
+            *status = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int supervise_signal(pid_t pid, int sig) {
+    if (pid <= 0) return -1;   /* never kill(0) or kill(-1) */
+    proc_watch_t *w = supervise_lookup(pid);
+    if (w && w->src.fd >= 0) {
+        if (sys_pidfd_send_signal(w->src.fd, sig) == 0) return 0;
+        if (errno != ENOSYS) return -1;
+    }
+    return kill(pid, sig);
+}
+
+int supervise_count(void) {
+    return n_watched;
+}
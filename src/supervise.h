@@ -0,0 +1,64 @@
+/*
+ * supervise.h - YakirOS process supervision
+ *
+ * Tracks every process the resolver spawns or adopts (service and oneshot
+ * main processes, health and readiness checks, hot-swap and restored
+ * instances). Each one gets a pidfd registered in the main epoll set, so
+ * an exit is delivered straight to its watch entry, and a pid -> watch
+ * hash table so exits collected through SIGCHLD are dispatched in O(1)
+ * as well. Signals go through the pidfd when there is one, so they cannot
+ * hit an unrelated process that reused the pid.
+ */
+
+#ifndef SUPERVISE_H
+#define SUPERVISE_H
+
+#include <sys/types.h>
+#include "event.h"
+
+#define MAX_WATCHES 1024
+
+/* What a supervised process is to its component */
+typedef enum {
+    PROC_MAIN,          /* the component's service or oneshot process */
+    PROC_HEALTH,        /* a running health check */
+    PROC_READINESS,     /* a running readiness check command */
+    PROC_LAZY_PAGES,    /* CRIU daemon paging in a lazily restored process */
+    PROC_PAGE_SERVER,   /* CRIU page server for a lazy restore elsewhere */
+    PROC_STANDBY,       /* warmed spare instance waiting to take over */
+} proc_role_t;
+
+typedef struct {
+    event_source_t src;     /* must be first; src.fd is the pidfd or -1 */
+    pid_t          pid;     /* 0 when the entry is free */
+    int            idx;     /* owning component index */
+    proc_role_t    role;
+} proc_watch_t;
+
+/* Reset the watch table. epoll_fd is where pidfds get registered; pass -1
+ * to track processes by pid only. Returns 1 if pidfds are available. */
+int supervise_init(int epoll_fd);
+
+/* Start watching pid for component idx. Watching an already watched pid
+ * just updates its owner and role. Returns 0, or -1 if the table is full. */
+int supervise_watch(pid_t pid, int idx, proc_role_t role);
+
+/* Stop watching pid and close its pidfd; unknown pids are ignored */
+void supervise_unwatch(pid_t pid);
+
+/* Watch entry for pid, or NULL */
+proc_watch_t *supervise_lookup(pid_t pid);
+
+/* Collect the exit of a watched process, through waitid(P_PIDFD) when
+ * it has a pidfd, otherwise by pid. Returns 1 with *status filled, 0 if
+ * it has not exited yet. Processes
+ * that are not our children (e.g. restored by CRIU) report status 0. */
+int supervise_collect(proc_watch_t *w, int *status);
+
+/* Send sig to pid, through its pidfd if it has one */
+int supervise_signal(pid_t pid, int sig);
+
+/* Number of watched processes */
+int supervise_count(void);
+
+#endif /* SUPERVISE_H */
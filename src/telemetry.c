@@ -0,0 +1,223 @@
+/*
+ * telemetry.c - YakirOS per-component resource telemetry implementation
+ *
+ * A pass costs a handful of small openat()/read() pairs per cgroup and
+ * allocates nothing: each cgroup's ring is allocated once, when it is
+ * added. Values are parsed in place from read buffers on the stack.
+ */
+
+#define _GNU_SOURCE
+#include "telemetry.h"
+#include "log.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TELEMETRY_READ_MAX 8192   /* memory.stat is the largest file read */
+
+typedef struct {
+    int                cgroup_fd;
+    int                head;      /* next slot written */
+    int                count;
+    telemetry_sample_t ring[TELEMETRY_SAMPLES];
+} telemetry_entry_t;
+
+static telemetry_entry_t **entries = NULL;
+static int n_entries = 0;
+static int max_entries = 0;
+static uint64_t last_pass_us = 0;
+
+static telemetry_entry_t *entry_find(int cgroup_fd) {
+    for (int i = 0; i < n_entries; i++) {
+        if (entries[i]->cgroup_fd == cgroup_fd) return entries[i];
+    }
+    return NULL;
+}
+
+int telemetry_add(int cgroup_fd) {
+    if (cgroup_fd < 0) return -1;
+    if (entry_find(cgroup_fd)) return 0;
+
+    if (n_entries == max_entries) {
+        int new_max = max_entries ? max_entries * 2 : 64;
+        telemetry_entry_t **grown = realloc(entries, (size_t)new_max * sizeof(*grown));
+        if (!grown) {
+            LOG_ERR("out of memory growing telemetry table");
+            return -1;
+        }
+        entries = grown;
+        max_entries = new_max;
+    }
+
+    telemetry_entry_t *e = calloc(1, sizeof(*e));
+    if (!e) {
+        LOG_ERR("out of memory for telemetry samples");
+        return -1;
+    }
+    e->cgroup_fd = cgroup_fd;
+    entries[n_entries++] = e;
+    return 0;
+}
+
+void telemetry_remove(int cgroup_fd) {
+    for (int i = 0; i < n_entries; i++) {
+        if (entries[i]->cgroup_fd == cgroup_fd) {
+            free(entries[i]);
+            entries[i] = entries[--n_entries];
+            return;
+        }
+    }
+}
+
+/* Read a control file into buf as a string; returns its length or -1 */
+static ssize_t read_control(int cgroup_fd, const char *name, char *buf, size_t size) {
+    int fd = openat(cgroup_fd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+
+    ssize_t len = read(fd, buf, size - 1);
+    close(fd);
+    if (len < 0) return -1;
+    buf[len] = '\0';
+    return len;
+}
+
+/* The number after "key " at the start of a line of text */
+static int stat_value(const char *text, const char *key, uint64_t *value) {
+    size_t klen = strlen(key);
+    const char *p = text;
+    while (p && *p) {
+        if (strncmp(p, key, klen) == 0 && p[klen] == ' ') {
+            *value = strtoull(p + klen + 1, NULL, 10);
+            return 0;
+        }
+        p = strchr(p, '\n');
+        if (p) p++;
+    }
+    return -1;
+}
+
+/* "some avg10=1.25 ..." as hundredths of a percent */
+static uint16_t pressure_some(int cgroup_fd, const char *name, int *ok) {
+    char buf[256];
+    if (read_control(cgroup_fd, name, buf, sizeof(buf)) < 0) return 0;
+
+    const char *p = strstr(buf, "some avg10=");
+    if (!p) return 0;
+    p += strlen("some avg10=");
+
+    char *end;
+    unsigned long whole = strtoul(p, &end, 10);
+    unsigned long frac = 0;
+    if (*end == '.') {
+        /* Two decimals, as the kernel prints them */
+        const char *d = end + 1;
+        for (int i = 0; i < 2; i++) {
+            frac *= 10;
+            if (*d >= '0' && *d <= '9') frac += (unsigned long)(*d++ - '0');
+        }
+    }
+    *ok = 1;
+    unsigned long v = whole * 100 + frac;
+    return (uint16_t)(v > 10000 ? 10000 : v);
+}
+
+static void sample_one(telemetry_entry_t *e, uint64_t now_ms) {
+    telemetry_sample_t *s = &e->ring[e->head];
+    char buf[TELEMETRY_READ_MAX];
+
+    memset(s, 0, sizeof(*s));
+    s->time_ms = now_ms;
+
+    if (read_control(e->cgroup_fd, "cpu.stat", buf, sizeof(buf)) >= 0 &&
+        stat_value(buf, "usage_usec", &s->cpu_usec) == 0) {
+        s->have |= TELEMETRY_HAVE_CPU;
+    }
+
+    if (read_control(e->cgroup_fd, "memory.current", buf, sizeof(buf)) >= 0) {
+        s->mem_current = strtoull(buf, NULL, 10);
+        s->have |= TELEMETRY_HAVE_MEMORY;
+        if (read_control(e->cgroup_fd, "memory.stat", buf, sizeof(buf)) >= 0) {
+            stat_value(buf, "anon", &s->mem_anon);
+            stat_value(buf, "file", &s->mem_file);
+        }
+    }
+
+    /* One line per device: "8:0 rbytes=N wbytes=N rios=N ..." */
+    if (read_control(e->cgroup_fd, "io.stat", buf, sizeof(buf)) >= 0) {
+        s->have |= TELEMETRY_HAVE_IO;
+        for (char *line = buf; line && *line; ) {
+            char *next = strchr(line, '\n');
+            if (next) *next++ = '\0';
+            const char *r = strstr(line, "rbytes=");
+            const char *w = strstr(line, "wbytes=");
+            if (r) s->io_rbytes += strtoull(r + 7, NULL, 10);
+            if (w) s->io_wbytes += strtoull(w + 7, NULL, 10);
+            line = next;
+        }
+    }
+
+    int psi = 0;
+    s->cpu_some = pressure_some(e->cgroup_fd, "cpu.pressure", &psi);
+    s->mem_some = pressure_some(e->cgroup_fd, "memory.pressure", &psi);
+    s->io_some = pressure_some(e->cgroup_fd, "io.pressure", &psi);
+    if (psi) s->have |= TELEMETRY_HAVE_PRESSURE;
+
+    e->head = (e->head + 1) % TELEMETRY_SAMPLES;
+    if (e->count < TELEMETRY_SAMPLES) e->count++;
+}
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+void telemetry_sample(void) {
+    uint64_t start = now_us();
+    uint64_t now_ms = start / 1000;
+
+    for (int i = 0; i < n_entries; i++) {
+        sample_one(entries[i], now_ms);
+    }
+    last_pass_us = now_us() - start;
+}
+
+int telemetry_history(int cgroup_fd, telemetry_sample_t *out, int max) {
+    telemetry_entry_t *e = entry_find(cgroup_fd);
+    if (!e || max <= 0) return 0;
+
+    int n = e->count < max ? e->count : max;
+    int first = (e->head - n + TELEMETRY_SAMPLES) % TELEMETRY_SAMPLES;
+    for (int i = 0; i < n; i++) {
+        out[i] = e->ring[(first + i) % TELEMETRY_SAMPLES];
+    }
+    return n;
+}
+
+void telemetry_rate(const telemetry_sample_t *prev, const telemetry_sample_t *cur,
+                    telemetry_rate_t *rate) {
+    memset(rate, 0, sizeof(*rate));
+    if (cur->time_ms <= prev->time_ms) return;
+
+    double secs = (double)(cur->time_ms - prev->time_ms) / 1000.0;
+    /* Counters restart with a recreated cgroup; skip that interval */
+    if (cur->cpu_usec >= prev->cpu_usec) {
+        rate->cpu_percent = (double)(cur->cpu_usec - prev->cpu_usec) / 1e4 / secs;
+    }
+    if (cur->io_rbytes >= prev->io_rbytes) {
+        rate->io_read_bps = (double)(cur->io_rbytes - prev->io_rbytes) / secs;
+    }
+    if (cur->io_wbytes >= prev->io_wbytes) {
+        rate->io_write_bps = (double)(cur->io_wbytes - prev->io_wbytes) / secs;
+    }
+}
+
+int telemetry_count(void) {
+    return n_entries;
+}
+
+uint64_t telemetry_last_pass_us(void) {
+    return last_pass_us;
+}
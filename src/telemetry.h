@@ -0,0 +1,66 @@
+/*
+ * telemetry.h - YakirOS per-component resource telemetry
+ *
+ * Every TELEMETRY_INTERVAL_MS the main loop samples cpu.stat,
+ * memory.current, memory.stat, io.stat and the cpu, memory and io
+ * pressure (PSI) files of every component cgroup in one pass, reading
+ * them with openat() on the cgroup's open directory. The last
+ * TELEMETRY_SAMPLES samples of each cgroup are kept in a fixed ring for
+ * the control socket's `top` and `stats` commands.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+#define TELEMETRY_INTERVAL_MS 10000
+#define TELEMETRY_SAMPLES     60     /* ten minutes at the default interval */
+
+/* Which files a sample could be read from */
+#define TELEMETRY_HAVE_CPU      0x01
+#define TELEMETRY_HAVE_MEMORY   0x02
+#define TELEMETRY_HAVE_IO       0x04
+#define TELEMETRY_HAVE_PRESSURE 0x08
+
+typedef struct {
+    uint64_t time_ms;        /* monotonic time of the sample */
+    uint64_t cpu_usec;       /* cpu.stat usage_usec, cumulative */
+    uint64_t mem_current;    /* memory.current, bytes */
+    uint64_t mem_anon;       /* memory.stat anon */
+    uint64_t mem_file;       /* memory.stat file (page cache) */
+    uint64_t io_rbytes;      /* io.stat rbytes of all devices, cumulative */
+    uint64_t io_wbytes;      /* io.stat wbytes of all devices, cumulative */
+    uint16_t cpu_some;       /* "some avg10" of cpu.pressure, in 0.01% */
+    uint16_t mem_some;       /* ... of memory.pressure */
+    uint16_t io_some;        /* ... of io.pressure */
+    uint16_t have;           /* TELEMETRY_HAVE_* */
+} telemetry_sample_t;
+
+/* What changed between two samples of the same cgroup, per second */
+typedef struct {
+    double cpu_percent;      /* of one CPU */
+    double io_read_bps;
+    double io_write_bps;
+} telemetry_rate_t;
+
+/* Keep samples of the cgroup open at cgroup_fd, or stop and forget them */
+int telemetry_add(int cgroup_fd);
+void telemetry_remove(int cgroup_fd);
+
+/* Take one sample of every cgroup */
+void telemetry_sample(void);
+
+/* Copy up to max of the cgroup's samples into out, oldest first.
+ * Returns how many, 0 for a cgroup without samples. */
+int telemetry_history(int cgroup_fd, telemetry_sample_t *out, int max);
+
+/* Rates from prev to cur; all zero if they are not in that order */
+void telemetry_rate(const telemetry_sample_t *prev, const telemetry_sample_t *cur,
+                    telemetry_rate_t *rate);
+
+/* Cgroups sampled, and how long the last pass over them took */
+int telemetry_count(void);
+uint64_t telemetry_last_pass_us(void);
+
+#endif /* TELEMETRY_H */
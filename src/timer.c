@@ -0,0 +1,208 @@
+/*
+ * timer.c - YakirOS deadline scheduler implementation
+ *
+ * Timers live in a fixed slot table; the heap orders slot numbers by
+ * deadline and each slot remembers its heap position so cancellation is
+ * O(log n). Handles carry a per-slot generation so a handle kept after its
+ * timer fired cannot cancel whatever reused the slot.
+ *
+ * The timerfd uses absolute CLOCK_MONOTONIC expirations, the same clock
+ * as timer_now_ms(), and remembers what it was last armed for so
+ * timer_fd_update() can run after every loop iteration.
+ */
+
+#define _GNU_SOURCE
+#include "timer.h"
+#include "log.h"
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#define TIMER_SLOT_BITS 10   /* MAX_TIMERS == 1 << TIMER_SLOT_BITS */
+#define TIMER_GEN_MASK  0xFFFFF
+
+typedef struct {
+    uint64_t     deadline;
+    timer_kind_t kind;
+    int          idx;
+    int          heap_pos;   /* -1 when the slot is free */
+    int          gen;
+} timer_slot_t;
+
+static timer_slot_t slots[MAX_TIMERS];
+static int heap[MAX_TIMERS];
+static int heap_size = 0;
+static int free_list[MAX_TIMERS];
+static int n_free = 0;
+
+static int tfd = -1;
+static uint64_t tfd_armed = 0;   /* deadline the timerfd is set for, 0 = disarmed */
+
+void timer_init(void) {
+    memset(slots, 0, sizeof(slots));
+    heap_size = 0;
+    n_free = 0;
+    for (int i = MAX_TIMERS - 1; i >= 0; i--) {
+        slots[i].heap_pos = -1;
+        slots[i].gen = 1;
+        free_list[n_free++] = i;
+    }
+}
+
+uint64_t timer_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void heap_set(int pos, int slot) {
+    heap[pos] = slot;
+    slots[slot].heap_pos = pos;
+}
+
+static void heap_up(int pos) {
+    int slot = heap[pos];
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (slots[heap[parent]].deadline <= slots[slot].deadline) break;
+        heap_set(pos, heap[parent]);
+        pos = parent;
+    }
+    heap_set(pos, slot);
+}
+
+static void heap_down(int pos) {
+    int slot = heap[pos];
+    for (;;) {
+        int child = pos * 2 + 1;
+        if (child >= heap_size) break;
+        if (child + 1 < heap_size &&
+            slots[heap[child + 1]].deadline < slots[heap[child]].deadline) {
+            child++;
+        }
+        if (slots[slot].deadline <= slots[heap[child]].deadline) break;
+        heap_set(pos, heap[child]);
+        pos = child;
+    }
+    heap_set(pos, slot);
+}
+
+static void heap_remove(int pos) {
+    int slot = heap[pos];
+    heap_size--;
+    if (pos < heap_size) {
+        int moved = heap[heap_size];
+        heap_set(pos, moved);
+        heap_down(pos);
+        heap_up(slots[moved].heap_pos);
+    }
+
+    slots[slot].heap_pos = -1;
+    slots[slot].gen = (slots[slot].gen + 1) & TIMER_GEN_MASK;
+    if (slots[slot].gen == 0) slots[slot].gen = 1;
+    free_list[n_free++] = slot;
+}
+
+int timer_add(uint64_t deadline_ms, timer_kind_t kind, int idx) {
+    if (heap_size == 0 && n_free == 0) {
+        timer_init(); /* first use */
+    }
+    if (n_free == 0) {
+        LOG_ERR("timer table full (%d timers)", MAX_TIMERS);
+        return -1;
+    }
+
+    int slot = free_list[--n_free];
+    slots[slot].deadline = deadline_ms;
+    slots[slot].kind = kind;
+    slots[slot].idx = idx;
+    heap_set(heap_size, slot);
+    heap_up(heap_size++);
+
+    return (slots[slot].gen << TIMER_SLOT_BITS) | slot;
+}
+
+void timer_cancel(int handle) {
+    if (handle <= 0) return;
+
+    int slot = handle & (MAX_TIMERS - 1);
+    int gen = handle >> TIMER_SLOT_BITS;
+    if (slots[slot].gen != gen || slots[slot].heap_pos < 0) {
+        return; /* already fired or cancelled */
+    }
+    heap_remove(slots[slot].heap_pos);
+}
+
+int timer_next_ms(void) {
+    if (heap_size == 0) return -1;
+
+    uint64_t now = timer_now_ms();
+    uint64_t deadline = slots[heap[0]].deadline;
+    if (deadline <= now) return 0;
+    if (deadline - now > 0x7fffffff) return 0x7fffffff;
+    return (int)(deadline - now);
+}
+
+int timer_pop(uint64_t now, timer_kind_t *kind, int *idx, int *handle) {
+    if (heap_size == 0 || slots[heap[0]].deadline > now) {
+        return 0;
+    }
+
+    int slot = heap[0];
+    *kind = slots[slot].kind;
+    *idx = slots[slot].idx;
+    *handle = (slots[slot].gen << TIMER_SLOT_BITS) | slot;
+    heap_remove(0);
+    return 1;
+}
+
+int timer_expire(uint64_t now, timer_kind_t *kind, int *idx) {
+    int handle;
+    return timer_pop(now, kind, idx, &handle);
+}
+
+int timer_pending(void) {
+    return heap_size;
+}
+
+int timer_fd_open(void) {
+    if (tfd >= 0) return tfd;
+
+    tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd < 0) {
+        LOG_WARN("timerfd_create failed: %s", strerror(errno));
+        return -1;
+    }
+    tfd_armed = 0;
+    return tfd;
+}
+
+void timer_fd_update(void) {
+    if (tfd < 0) return;
+
+    /* A zero it_value disarms; an overdue deadline fires immediately */
+    uint64_t deadline = heap_size > 0 ? slots[heap[0]].deadline : 0;
+    if (deadline == 0 && heap_size > 0) deadline = 1;
+    if (deadline == tfd_armed) return;
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = deadline / 1000;
+    its.it_value.tv_nsec = (deadline % 1000) * 1000000;
+    if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        LOG_ERR("timerfd_settime failed: %s", strerror(errno));
+        return;
+    }
+    tfd_armed = deadline;
+}
+
+void timer_fd_ack(void) {
+    if (tfd < 0) return;
+
+    uint64_t expirations;
+    (void)!read(tfd, &expirations, sizeof(expirations));
+    tfd_armed = 0;   /* one-shot: it needs arming again */
+}
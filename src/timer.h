@@ -0,0 +1,78 @@
+/*
+ * timer.h - YakirOS deadline scheduler
+ *
+ * Keeps per-component deadlines (readiness and health timeouts, health
+ * intervals, restart backoff) and the periodic housekeeping deadlines in a
+ * binary min-heap on CLOCK_MONOTONIC, so the main loop can find the next
+ * due deadline in O(1) and add/cancel in O(log n). A timerfd armed for the
+ * earliest deadline lets epoll sleep until something is actually due.
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+#define MAX_TIMERS 1024
+
+/* What a deadline is for; the owner is identified by component index,
+ * or -1 for the global housekeeping timers */
+typedef enum {
+    TIMER_HEALTH_TIMEOUT,    /* running health check took too long */
+    TIMER_HEALTH_DUE,        /* next health check should start */
+    TIMER_READINESS_TIMEOUT, /* component did not become ready in time */
+    TIMER_READINESS_POLL,    /* re-probe a file or command readiness check */
+    TIMER_RESTART,           /* restart backoff of a failed component over */
+    TIMER_STANDBY,           /* fork a new standby for one that exited */
+    TIMER_IDLE,              /* see whether an on-demand component is still used */
+    TIMER_WATCHDOG,          /* keepalive deadline of a watchdog component */
+    TIMER_STOP_KILL,         /* a failed process ignored its stop signal */
+    TIMER_OOM_SCAN,          /* periodic cgroup OOM event scan */
+    TIMER_GRAPH_SWEEP,       /* periodic full graph consistency sweep */
+    TIMER_RELOAD,            /* graph.d has been quiet long enough to reload */
+    TIMER_TELEMETRY,         /* periodic cgroup resource sampling */
+    TIMER_PRESSURE,          /* adaptive limits drift back after contention */
+    TIMER_FEDERATION,        /* heartbeat peer nodes, expire silent ones */
+    TIMER_MIGRATION,         /* an incoming migration has gone quiet */
+    TIMER_HANDOFF,           /* a main process is slow handing over to its standby */
+    TIMER_KINDS
+} timer_kind_t;
+
+/* Reset the scheduler, dropping all pending timers */
+void timer_init(void);
+
+/* Current CLOCK_MONOTONIC time in milliseconds */
+uint64_t timer_now_ms(void);
+
+/* Schedule a deadline, returns a handle (> 0) or -1 if the table is full */
+int timer_add(uint64_t deadline_ms, timer_kind_t kind, int idx);
+
+/* Cancel a pending timer; stale or zero handles are ignored */
+void timer_cancel(int handle);
+
+/* Milliseconds until the next deadline (0 if overdue), -1 if none */
+int timer_next_ms(void);
+
+/* Pop one timer due at or before now. Returns 1 and fills kind/idx,
+ * or 0 if nothing is due. */
+int timer_expire(uint64_t now, timer_kind_t *kind, int *idx);
+
+/* timer_expire() that also reports the handle of the fired timer, so
+ * owners can tell their current timer from one they replaced */
+int timer_pop(uint64_t now, timer_kind_t *kind, int *idx, int *handle);
+
+/* Create a timerfd that becomes readable when the earliest deadline is
+ * due. Returns the fd, or -1 (callers then use epoll timeouts instead). */
+int timer_fd_open(void);
+
+/* Re-arm the timerfd for the current earliest deadline; no syscall when
+ * it has not changed */
+void timer_fd_update(void);
+
+/* Consume a timerfd expiration */
+void timer_fd_ack(void);
+
+/* Number of pending timers */
+int timer_pending(void);
+
+#endif /* TIMER_H */
@@ -7,12 +7,14 @@
 
 #include "toml.h"
 #include "log.h"
+#include "capability.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <time.h>
 #include <errno.h>
+#include <stdint.h>
 
 #define MAX_LINE 1024
 
@@ -27,6 +29,7 @@ typedef enum {
     SECTION_RESOURCES,
     SECTION_ISOLATION,
     SECTION_CHECKPOINT,
+    SECTION_SOCKETS,
 } toml_section_t;
 
 /* Helper function to trim whitespace */
@@ -47,11 +50,272 @@ static toml_section_t parse_section(const char *line) {
     if (strstr(line, "[resources]"))  return SECTION_RESOURCES;
     if (strstr(line, "[isolation]"))  return SECTION_ISOLATION;
     if (strstr(line, "[checkpoint]")) return SECTION_CHECKPOINT;
+    if (strstr(line, "[sockets]"))    return SECTION_SOCKETS;
     return SECTION_NONE; /* unknown section, skip */
 }
 
-/* Parse a TOML array like ["value1", "value2"] into dest, return count */
-static int parse_array(const char *value, char dest[][MAX_NAME], int max) {
+#define COMP_STRINGS_MIN 256
+
+#define COMP_STRING_FIELDS (7 + MAX_ARGS + 3 * MAX_DEPS + MAX_SOCKETS)
+
+/* Collect the address of every char * member of comp */
+static int string_fields(component_t *comp, char **fields[COMP_STRING_FIELDS]) {
+    int n = 0;
+    fields[n++] = &comp->binary;
+    fields[n++] = &comp->config_path;
+    fields[n++] = &comp->health_check;
+    fields[n++] = &comp->readiness_file;
+    fields[n++] = &comp->readiness_check;
+    fields[n++] = &comp->cgroup_path;
+    fields[n++] = &comp->isolation_root;
+    for (int i = 0; i < MAX_ARGS; i++) {
+        fields[n++] = &comp->args[i];
+    }
+    for (int i = 0; i < MAX_DEPS; i++) {
+        fields[n++] = &comp->requires[i];
+        fields[n++] = &comp->provides[i];
+        fields[n++] = &comp->optional[i];
+    }
+    for (int i = 0; i < MAX_SOCKETS; i++) {
+        fields[n++] = &comp->sockets[i];
+    }
+    return n;
+}
+
+/* The arena moved (or was freed, new_base == NULL): re-point every field
+ * that referred into it */
+static void rebase_strings(component_t *comp, uintptr_t old_base, size_t old_cap,
+                           char *new_base) {
+    char **fields[COMP_STRING_FIELDS];
+    int n = string_fields(comp, fields);
+
+    for (int i = 0; i < n; i++) {
+        uintptr_t v = (uintptr_t)*fields[i];
+        if (*fields[i] && v >= old_base && v < old_base + old_cap) {
+            *fields[i] = new_base ? new_base + (v - old_base) : NULL;
+        }
+    }
+}
+
+/* Copy len bytes of value (plus a NUL) into the arena */
+static char *arena_store(component_t *comp, const char *value, size_t len) {
+    comp_strings_t *a = &comp->strings;
+
+    if (a->len + len + 1 > a->cap) {
+        size_t new_cap = a->cap ? a->cap : COMP_STRINGS_MIN;
+        while (new_cap < a->len + len + 1) new_cap *= 2;
+
+        uintptr_t old_base = (uintptr_t)a->base;
+        size_t old_cap = a->cap;
+        /* value may itself live in the arena */
+        int inside = a->base && (uintptr_t)value >= old_base &&
+                     (uintptr_t)value < old_base + old_cap;
+        size_t value_off = inside ? (size_t)((uintptr_t)value - old_base) : 0;
+
+        char *grown = realloc(a->base, new_cap);
+        if (!grown) {
+            LOG_ERR("component '%s': out of memory for strings", comp->name);
+            return NULL;
+        }
+        a->base = grown;
+        a->cap = new_cap;
+        if (old_base && (uintptr_t)grown != old_base) {
+            rebase_strings(comp, old_base, old_cap, grown);
+        }
+        if (inside) value = grown + value_off;
+    }
+
+    char *dst = a->base + a->len;
+    memcpy(dst, value, len);
+    dst[len] = '\0';
+    a->len += len + 1;
+    return dst;
+}
+
+int component_set_str(component_t *comp, char **field, const char *value) {
+    char *dst = arena_store(comp, value, strlen(value));
+    if (!dst) return -1;
+    *field = dst;
+    return 0;
+}
+
+int component_add_str(component_t *comp, char **list, int *n, int max, const char *value) {
+    if (*n >= max) return -1;
+    if (component_set_str(comp, &list[*n], value) < 0) return -1;
+    (*n)++;
+    return 0;
+}
+
+void component_strings_detach(component_t *comp) {
+    char **fields[COMP_STRING_FIELDS];
+    int n = string_fields(comp, fields);
+    uintptr_t base = (uintptr_t)comp->strings.base;
+
+    /* Offsets are stored biased by one so that NULL stays NULL */
+    for (int i = 0; i < n; i++) {
+        uintptr_t v = (uintptr_t)*fields[i];
+        if (*fields[i] && base && v >= base && v < base + comp->strings.len) {
+            *fields[i] = (char *)(v - base + 1);
+        } else {
+            *fields[i] = NULL;
+        }
+    }
+    comp->strings.base = NULL;
+    comp->strings.cap = 0;
+}
+
+int component_strings_attach(component_t *comp, const char *strings, size_t len) {
+    char **fields[COMP_STRING_FIELDS];
+    int n = string_fields(comp, fields);
+
+    memset(&comp->strings, 0, sizeof(comp->strings));
+    if (len > 0 && strings[len - 1] != '\0') {
+        goto bad;
+    }
+    for (int i = 0; i < n; i++) {
+        if ((uintptr_t)*fields[i] > len) goto bad;
+    }
+
+    char *base = malloc(len ? len : 1);
+    if (!base) {
+        LOG_ERR("component '%s': out of memory for strings", comp->name);
+        goto bad;
+    }
+    memcpy(base, strings, len);
+    for (int i = 0; i < n; i++) {
+        uintptr_t off = (uintptr_t)*fields[i];
+        *fields[i] = off ? base + off - 1 : NULL;
+    }
+    comp->strings.base = base;
+    comp->strings.len = len;
+    comp->strings.cap = len ? len : 1;
+    return 0;
+
+bad:
+    for (int i = 0; i < n; i++) {
+        *fields[i] = NULL;
+    }
+    return -1;
+}
+
+void component_copy_runtime(component_t *dst, const component_t *src) {
+    dst->state = src->state;
+    dst->pid = src->pid;
+    memcpy(dst->timers, src->timers, sizeof(dst->timers));
+    dst->restart_count = src->restart_count;
+    dst->last_restart = src->last_restart;
+    dst->failures = src->failures;
+    dst->restart_due_ms = src->restart_due_ms;
+    dst->cgroup_fd = src->cgroup_fd;
+    dst->standby_pid = src->standby_pid;
+    dst->standby_ready = src->standby_ready;
+    dst->standby_started = src->standby_started;
+    dst->standby_sock = src->standby_sock;
+    dst->standby_cgroup_fd = src->standby_cgroup_fd;
+    dst->handoff_sock = src->handoff_sock;
+    dst->held_fds = src->held_fds;
+    dst->n_held_fds = src->n_held_fds;
+    dst->listen_fds = src->listen_fds;
+    dst->n_listen_fds = src->n_listen_fds;
+    dst->demanded = src->demanded;
+    dst->idle_unused = src->idle_unused;
+    dst->idle_stopping = src->idle_stopping;
+    dst->health_consecutive_failures = src->health_consecutive_failures;
+    dst->last_health_check = src->last_health_check;
+    dst->last_health_result = src->last_health_result;
+    dst->health_pid = src->health_pid;
+    dst->health_timed_out = src->health_timed_out;
+    dst->watchdog_missed = src->watchdog_missed;
+    dst->watchdog_fd = src->watchdog_fd;
+    dst->watchdog_wfd = src->watchdog_wfd;
+    dst->ready_wait_start = src->ready_wait_start;
+    dst->readiness_pid = src->readiness_pid;
+    dst->readiness_poll_ms = src->readiness_poll_ms;
+    memcpy(dst->notify_status, src->notify_status, sizeof(dst->notify_status));
+    dst->notify_watchdog_ms = src->notify_watchdog_ms;
+}
+
+void component_reset_runtime(component_t *comp) {
+    static const component_t fresh;
+    component_copy_runtime(comp, &fresh);
+    comp->state = COMP_INACTIVE;
+    comp->pid = -1;
+    comp->cap_generation = 0;
+    comp->link_generation = 0;
+    comp->link_idx = 0;
+}
+
+static int same_list(char *const *a, int na, char *const *b, int nb) {
+    if (na != nb) return 0;
+    for (int i = 0; i < na; i++) {
+        if (strcmp(comp_str(a[i]), comp_str(b[i])) != 0) return 0;
+    }
+    return 1;
+}
+
+int component_same_deps(const component_t *a, const component_t *b) {
+    return same_list(a->requires, a->n_requires, b->requires, b->n_requires) &&
+           same_list(a->provides, a->n_provides, b->provides, b->n_provides) &&
+           same_list(a->optional, a->n_optional, b->optional, b->n_optional);
+}
+
+int component_same_sockets(const component_t *a, const component_t *b) {
+    return same_list(a->sockets, a->n_sockets, b->sockets, b->n_sockets) &&
+           a->socket_backlog == b->socket_backlog;
+}
+
+#define SAME(field) (a->field == b->field)
+#define SAME_STR(field) (strcmp(comp_str(a->field), comp_str(b->field)) == 0)
+
+int component_same_limits(const component_t *a, const component_t *b) {
+    return SAME_STR(cgroup_path) && SAME_STR(memory_max) && SAME_STR(memory_high) &&
+           SAME(cpu_weight) && SAME_STR(cpu_max) && SAME(io_weight) && SAME(pids_max) &&
+           SAME(oom_group) && SAME(adaptive) && SAME(priority) && SAME_STR(memory_high_min) &&
+           SAME_STR(memory_high_max) && SAME(cpu_weight_min) && SAME(cpu_weight_max) &&
+           SAME_STR(standby_memory_high) && SAME(standby_cpu_weight);
+}
+
+int component_same_declaration(const component_t *a, const component_t *b) {
+    return SAME_STR(name) && SAME(type) && SAME_STR(binary) &&
+           same_list(a->args, a->argc, b->args, b->argc) &&
+           SAME_STR(config_path) && component_same_deps(a, b) &&
+           component_same_sockets(a, b) &&
+           SAME(handoff) && SAME(reload_signal) && SAME(stop_signal) &&
+           SAME(stop_timeout) && SAME_STR(health_check) &&
+           SAME(health_interval) && SAME(health_timeout) &&
+           SAME(health_fail_threshold) && SAME(health_restart_threshold) &&
+           SAME(watchdog_sec) &&
+           SAME(restart_delay_ms) && SAME(restart_delay_max_ms) && SAME(restart_jitter) &&
+           SAME(restart_decay) && SAME(restart_quarantine) &&
+           SAME(standby) && SAME(on_demand) && SAME(idle_timeout) &&
+           SAME(readiness_method) && SAME_STR(readiness_file) &&
+           SAME_STR(readiness_check) && SAME(readiness_signal) &&
+           SAME(readiness_timeout) && SAME(readiness_interval) &&
+           component_same_limits(a, b) &&
+           SAME_STR(cpuset) && SAME(numa) && SAME(isolate_cpus) &&
+           SAME_STR(isolation_namespaces) && SAME_STR(isolation_root) &&
+           SAME_STR(isolation_hostname) && SAME(checkpoint_enabled) &&
+           SAME_STR(checkpoint_preserve_fds) && SAME(checkpoint_leave_running) &&
+           SAME(checkpoint_memory_estimate) && SAME(checkpoint_max_age);
+}
+
+#undef SAME
+#undef SAME_STR
+
+void component_free_strings(component_t *comp) {
+    uintptr_t base = (uintptr_t)comp->strings.base;
+    size_t cap = comp->strings.cap;
+
+    /* Clear the fields that pointed into the arena; static strings that
+     * tests or built-in components assigned stay as they are */
+    if (base) rebase_strings(comp, base, cap, NULL);
+    free(comp->strings.base);
+    memset(&comp->strings, 0, sizeof(comp->strings));
+}
+
+/* Parse a TOML array like ["value1", "value2"] into an arena-backed list,
+ * return count */
+static int parse_array(component_t *comp, const char *value, char **dest, int max) {
     int count = 0;
     const char *p = strchr(value, '[');
     if (!p) return 0;
@@ -68,9 +332,7 @@ static int parse_array(const char *value, char dest[][MAX_NAME], int max) {
             while (*p && *p != '"') p++;
             if (*p == '"') {
                 int len = p - start;
-                if (len < MAX_NAME) {
-                    memcpy(dest[count], start, len);
-                    dest[count][len] = '\0';
+                if (len < MAX_NAME && (dest[count] = arena_store(comp, start, len)) != NULL) {
                     count++;
                 }
                 p++; /* skip closing quote */
@@ -80,9 +342,7 @@ static int parse_array(const char *value, char dest[][MAX_NAME], int max) {
             const char *start = p;
             while (*p && *p != ',' && *p != ']') p++;
             int len = p - start;
-            if (len < MAX_NAME) {
-                memcpy(dest[count], start, len);
-                dest[count][len] = '\0';
+            if (len < MAX_NAME && (dest[count] = arena_store(comp, start, len)) != NULL) {
                 count++;
             }
         }
@@ -93,6 +353,8 @@ static int parse_array(const char *value, char dest[][MAX_NAME], int max) {
 /* Parse signal names to signal numbers */
 static int parse_signal(const char *name) {
     if (strcmp(name, "SIGHUP") == 0)  return SIGHUP;
+    if (strcmp(name, "SIGINT") == 0)  return SIGINT;
+    if (strcmp(name, "SIGQUIT") == 0) return SIGQUIT;
     if (strcmp(name, "SIGUSR1") == 0) return SIGUSR1;
     if (strcmp(name, "SIGUSR2") == 0) return SIGUSR2;
     if (strcmp(name, "SIGTERM") == 0) return SIGTERM;
@@ -108,7 +370,7 @@ static handoff_t parse_handoff(const char *name) {
 }
 
 /* Parse a component TOML file, populate a component_t */
-int parse_component(const char *path, component_t *comp) {
+int parse_component_file(const char *path, component_t *comp) {
     FILE *f = fopen(path, "r");
     if (!f) {
         LOG_ERR("cannot open %s: %s", path, strerror(errno));
@@ -121,15 +383,25 @@ int parse_component(const char *path, component_t *comp) {
     comp->state = COMP_INACTIVE;
     comp->handoff = HANDOFF_NONE;
     comp->reload_signal = 0;
+    comp->stop_signal = SIGTERM;
+    comp->stop_timeout = 10;                  /* default 10 seconds to exit */
     comp->health_interval = 0;
     comp->health_timeout = 10;                /* default 10 second timeout */
     comp->health_fail_threshold = 3;          /* default 3 failures before DEGRADED */
     comp->health_restart_threshold = 5;       /* default 5 failures before restart */
+    comp->restart_delay_ms = 1000;            /* 1s, 2s, 4s, ... */
+    comp->restart_delay_max_ms = 60000;       /* up to a minute */
+    comp->restart_jitter = 25;
+    comp->restart_decay = 60;
+    comp->restart_quarantine = 10;
+    comp->standby = 0;
+    comp->on_demand = 0;                      /* started as soon as requirements are met */
+    comp->idle_timeout = 0;
     comp->health_consecutive_failures = 0;
     comp->last_health_check = 0;
     comp->last_health_result = 0;
     comp->pid = -1;
-    snprintf(comp->config_path, MAX_PATH, "%s", path);
+    component_set_str(comp, &comp->config_path, path);
 
     /* Initialize readiness protocol defaults */
     comp->readiness_method = READINESS_NONE;  /* backward compatibility */
@@ -139,17 +411,28 @@ int parse_component(const char *path, component_t *comp) {
     comp->ready_wait_start = 0;
 
     /* Initialize cgroup resource limits defaults */
-    memset(comp->cgroup_path, 0, MAX_PATH);
     memset(comp->memory_max, 0, 32);
     memset(comp->memory_high, 0, 32);
     memset(comp->cpu_max, 0, 32);
     comp->cpu_weight = 0;                     /* 0 = no weight specified, use default */
     comp->io_weight = 0;                      /* 0 = no weight specified, use default */
     comp->pids_max = 0;                       /* 0 = no limit */
+    comp->oom_group = 0;                      /* an OOM kill takes one process */
+    comp->adaptive = 0;                       /* static limits */
+    comp->priority = 0;
+    memset(comp->memory_high_min, 0, 32);
+    memset(comp->memory_high_max, 0, 32);
+    comp->cpu_weight_min = 0;
+    comp->cpu_weight_max = 0;
+    memset(comp->standby_memory_high, 0, 32);
+    comp->standby_cpu_weight = 10;            /* a tenth of the default share */
+    memset(comp->cpuset, 0, sizeof(comp->cpuset));
+    comp->numa = -1;                          /* any node */
+    comp->isolate_cpus = 0;                   /* shares its CPUs */
 
     /* Initialize namespace isolation defaults */
     memset(comp->isolation_namespaces, 0, 256);
-    strncpy(comp->isolation_root, "/", MAX_PATH - 1);  /* default to root filesystem */
+    component_set_str(comp, &comp->isolation_root, "/");  /* default to root filesystem */
     memset(comp->isolation_hostname, 0, MAX_NAME);
 
     /* Initialize checkpoint configuration defaults */
@@ -193,37 +476,49 @@ int parse_component(const char *path, component_t *comp) {
             if (strcmp(key, "name") == 0)
                 strncpy(comp->name, val, MAX_NAME - 1);
             else if (strcmp(key, "binary") == 0)
-                strncpy(comp->binary, val, MAX_PATH - 1);
+                component_set_str(comp, &comp->binary, val);
             else if (strcmp(key, "type") == 0) {
                 comp->type = (strcmp(val, "oneshot") == 0)
                     ? COMP_TYPE_ONESHOT : COMP_TYPE_SERVICE;
             } else if (strcmp(key, "args") == 0) {
-                comp->argc = parse_array(val, comp->args, MAX_ARGS);
+                comp->argc = parse_array(comp, val, comp->args, MAX_ARGS);
             }
             break;
 
         case SECTION_PROVIDES:
             if (strcmp(key, "capabilities") == 0)
-                comp->n_provides = parse_array(val, comp->provides, MAX_DEPS);
+                comp->n_provides = parse_array(comp, val, comp->provides, MAX_DEPS);
             break;
 
         case SECTION_REQUIRES:
             if (strcmp(key, "capabilities") == 0)
-                comp->n_requires = parse_array(val, comp->requires, MAX_DEPS);
+                comp->n_requires = parse_array(comp, val, comp->requires, MAX_DEPS);
             break;
 
         case SECTION_OPTIONAL:
             if (strcmp(key, "capabilities") == 0)
-                comp->n_optional = parse_array(val, comp->optional, MAX_DEPS);
+                comp->n_optional = parse_array(comp, val, comp->optional, MAX_DEPS);
             break;
 
         case SECTION_LIFECYCLE:
             if (strcmp(key, "reload_signal") == 0)
                 comp->reload_signal = parse_signal(val);
+            else if (strcmp(key, "stop_signal") == 0) {
+                comp->stop_signal = parse_signal(val);
+                if (comp->stop_signal <= 0) {
+                    comp->stop_signal = SIGTERM; /* default */
+                }
+            }
+            else if (strcmp(key, "stop_timeout") == 0) {
+                comp->stop_timeout = atoi(val);
+                if (comp->stop_timeout <= 0) {
+                    comp->stop_timeout = 10; /* default */
+                }
+            }
             else if (strcmp(key, "handoff") == 0)
                 comp->handoff = parse_handoff(val);
             else if (strcmp(key, "health_check") == 0)
-                strncpy(comp->health_check, val, MAX_PATH - 1);
+                component_set_str(comp, &comp->health_check, val);
             else if (strcmp(key, "health_interval") == 0)
                 comp->health_interval = atoi(val);
             else if (strcmp(key, "health_timeout") == 0) {
@@ -244,13 +539,65 @@ int parse_component(const char *path, component_t *comp) {
                     comp->health_restart_threshold = 5; /* default */
                 }
             }
+            else if (strcmp(key, "watchdog_sec") == 0) {
+                comp->watchdog_sec = atoi(val);
+                if (comp->watchdog_sec < 0) {
+                    comp->watchdog_sec = 0; /* off */
+                }
+            }
+            /* Restart policy */
+            else if (strcmp(key, "restart_delay_ms") == 0) {
+                comp->restart_delay_ms = atoi(val);
+                if (comp->restart_delay_ms <= 0) {
+                    comp->restart_delay_ms = 1000; /* default */
+                }
+            }
+            else if (strcmp(key, "restart_delay_max_ms") == 0) {
+                comp->restart_delay_max_ms = atoi(val);
+                if (comp->restart_delay_max_ms <= 0) {
+                    comp->restart_delay_max_ms = 60000; /* default */
+                }
+            }
+            else if (strcmp(key, "restart_jitter") == 0) {
+                comp->restart_jitter = atoi(val);
+                if (comp->restart_jitter < 0) comp->restart_jitter = 0;
+                if (comp->restart_jitter > 100) comp->restart_jitter = 100;
+            }
+            else if (strcmp(key, "restart_decay") == 0) {
+                comp->restart_decay = atoi(val);
+                if (comp->restart_decay < 0) comp->restart_decay = 0;
+            }
+            else if (strcmp(key, "restart_quarantine") == 0) {
+                comp->restart_quarantine = atoi(val);
+                if (comp->restart_quarantine < 0) comp->restart_quarantine = 0;
+            }
+            else if (strcmp(key, "standby") == 0) {
+                comp->standby = (strcmp(val, "true") == 0 || strcmp(val, "1") == 0);
+            }
+            else if (strcmp(key, "start") == 0) {
+                if (strcmp(val, "on-demand") == 0) comp->on_demand = 1;
+                else if (strcmp(val, "eager") == 0) comp->on_demand = 0;
+                else LOG_WARN("component '%s': unknown start policy '%s'", comp->name, val);
+            }
+            else if (strcmp(key, "idle_timeout") == 0) {
+                comp->idle_timeout = atoi(val);
+                if (comp->idle_timeout < 0) comp->idle_timeout = 0;
+            }
             /* Readiness protocol configuration */
+            else if (strcmp(key, "readiness_method") == 0) {
+                if (strcmp(val, "notify") == 0) comp->readiness_method = READINESS_NOTIFY;
+                else if (strcmp(val, "file") == 0) comp->readiness_method = READINESS_FILE;
+                else if (strcmp(val, "command") == 0) comp->readiness_method = READINESS_COMMAND;
+                else if (strcmp(val, "signal") == 0) comp->readiness_method = READINESS_SIGNAL;
+                else if (strcmp(val, "none") == 0) comp->readiness_method = READINESS_NONE;
+                else LOG_WARN("%s: unknown readiness_method '%s'", path, val);
+            }
             else if (strcmp(key, "readiness_file") == 0) {
-                strncpy(comp->readiness_file, val, MAX_PATH - 1);
+                component_set_str(comp, &comp->readiness_file, val);
                 comp->readiness_method = READINESS_FILE;
             }
             else if (strcmp(key, "readiness_check") == 0) {
-                strncpy(comp->readiness_check, val, MAX_PATH - 1);
+                component_set_str(comp, &comp->readiness_check, val);
                 comp->readiness_method = READINESS_COMMAND;
             }
             else if (strcmp(key, "readiness_signal") == 0) {
@@ -275,7 +622,7 @@ int parse_component(const char *path, component_t *comp) {
 
         case SECTION_RESOURCES:
             if (strcmp(key, "cgroup") == 0) {
-                strncpy(comp->cgroup_path, val, MAX_PATH - 1);
+                component_set_str(comp, &comp->cgroup_path, val);
             }
             else if (strcmp(key, "memory_max") == 0) {
                 strncpy(comp->memory_max, val, 31);
@@ -300,6 +647,50 @@ int parse_component(const char *path, component_t *comp) {
                 comp->pids_max = atoi(val);
                 if (comp->pids_max < 0) comp->pids_max = 0;
             }
+            else if (strcmp(key, "oom_group") == 0) {
+                comp->oom_group = (strcmp(val, "true") == 0 || strcmp(val, "1") == 0);
+            }
+            else if (strcmp(key, "adaptive") == 0) {
+                comp->adaptive = (strcmp(val, "true") == 0 || strcmp(val, "1") == 0);
+            }
+            else if (strcmp(key, "priority") == 0) {
+                comp->priority = atoi(val);
+            }
+            else if (strcmp(key, "memory_high_min") == 0) {
+                strncpy(comp->memory_high_min, val, 31);
+            }
+            else if (strcmp(key, "memory_high_max") == 0) {
+                strncpy(comp->memory_high_max, val, 31);
+            }
+            else if (strcmp(key, "cpu_weight_min") == 0) {
+                comp->cpu_weight_min = atoi(val);
+                if (comp->cpu_weight_min < 1) comp->cpu_weight_min = 1;
+                if (comp->cpu_weight_min > 10000) comp->cpu_weight_min = 10000;
+            }
+            else if (strcmp(key, "cpu_weight_max") == 0) {
+                comp->cpu_weight_max = atoi(val);
+                if (comp->cpu_weight_max < 1) comp->cpu_weight_max = 1;
+                if (comp->cpu_weight_max > 10000) comp->cpu_weight_max = 10000;
+            }
+            else if (strcmp(key, "standby_memory_high") == 0) {
+                strncpy(comp->standby_memory_high, val, 31);
+            }
+            else if (strcmp(key, "standby_cpu_weight") == 0) {
+                comp->standby_cpu_weight = atoi(val);
+                if (comp->standby_cpu_weight < 1) comp->standby_cpu_weight = 1;
+                if (comp->standby_cpu_weight > 10000) comp->standby_cpu_weight = 10000;
+            }
+            else if (strcmp(key, "cpuset") == 0) {
+                strncpy(comp->cpuset, val, sizeof(comp->cpuset) - 1);
+            }
+            else if (strcmp(key, "numa") == 0) {
+                comp->numa = atoi(val);
+                if (comp->numa < 0) comp->numa = -1;
+            }
+            else if (strcmp(key, "isolate_cpus") == 0) {
+                comp->isolate_cpus = atoi(val);
+                if (comp->isolate_cpus < 0) comp->isolate_cpus = 0;
+            }
             break;
 
         case SECTION_ISOLATION:
@@ -307,7 +698,7 @@ int parse_component(const char *path, component_t *comp) {
                 strncpy(comp->isolation_namespaces, val, 255);
             }
             else if (strcmp(key, "root") == 0) {
-                strncpy(comp->isolation_root, val, MAX_PATH - 1);
+                component_set_str(comp, &comp->isolation_root, val);
             }
             else if (strcmp(key, "hostname") == 0) {
                 strncpy(comp->isolation_hostname, val, MAX_NAME - 1);
@@ -334,6 +725,16 @@ int parse_component(const char *path, component_t *comp) {
             }
             break;
 
+        case SECTION_SOCKETS:
+            if (strcmp(key, "listen") == 0) {
+                comp->n_sockets = parse_array(comp, val, comp->sockets, MAX_SOCKETS);
+            }
+            else if (strcmp(key, "backlog") == 0) {
+                comp->socket_backlog = atoi(val);
+                if (comp->socket_backlog < 0) comp->socket_backlog = 0;
+            }
+            break;
+
         default:
             /* Ignore unknown sections for now */
             break;
@@ -345,12 +746,44 @@ int parse_component(const char *path, component_t *comp) {
     /* Validation */
     if (!comp->name[0]) {
         LOG_ERR("component in %s has no name", path);
+        component_free_strings(comp);
         return -1;
     }
-    if (!comp->binary[0]) {
+    if (!comp_str(comp->binary)[0]) {
         LOG_ERR("component '%s' has no binary", comp->name);
+        component_free_strings(comp);
         return -1;
     }
+    if (comp->standby && comp->type != COMP_TYPE_SERVICE) {
+        LOG_WARN("oneshot '%s' cannot have a standby, ignored", comp->name);
+        comp->standby = 0;
+    }
+    if (comp->n_sockets > 0 && comp->type != COMP_TYPE_SERVICE) {
+        LOG_WARN("oneshot '%s' cannot have sockets, ignored", comp->name);
+        comp->n_sockets = 0;
+    }
 
+    return 0;
+}
+
+int component_intern_caps(component_t *comp) {
+    /* Intern capability names so the resolver works on integer IDs */
+    if (capability_intern_list(comp->requires, comp->n_requires, comp->requires_id) < 0 ||
+        capability_intern_list(comp->provides, comp->n_provides, comp->provides_id) < 0) {
+        LOG_ERR("component '%s': too many distinct capabilities", comp->name);
+        return -1;
+    }
+    comp->cap_generation = capability_generation();
+    return 0;
+}
+
+int parse_component(const char *path, component_t *comp) {
+    if (parse_component_file(path, comp) < 0) {
+        return -1;
+    }
+    if (component_intern_caps(comp) < 0) {
+        component_free_strings(comp);
+        return -1;
+    }
     return 0;
 }
\ No newline at end of file
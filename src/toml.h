@@ -13,7 +13,11 @@
 
 #include <signal.h>
 #include <sys/types.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
+#include "timer.h"
+#include "activation.h"
 
 /* Maximum sizes for arrays and strings */
 #define MAX_NAME 128
@@ -36,6 +40,9 @@ typedef enum {
     COMP_DEGRADED,      /* running but health checks failing */
     COMP_FAILED,        /* crashed, readiness timeout, or other failure */
     COMP_ONESHOT_DONE,  /* oneshot completed successfully */
+    COMP_QUARANTINED,   /* failed restart_quarantine times in a row; not restarted */
+    COMP_IDLE,          /* start = "on-demand": requirements met, not needed yet */
+    COMP_MIGRATED,      /* handed over to another node; not started here */
 } comp_state_t;
 
 /* Handoff types for hot-swap */
@@ -52,69 +59,155 @@ typedef enum {
     READINESS_FILE,      /* monitor file creation */
     READINESS_SIGNAL,    /* wait for signal from component */
     READINESS_COMMAND,   /* run health check command */
+    READINESS_NOTIFY,    /* READY=1 on the sd_notify socket */
 } readiness_method_t;
 
-/* Component structure - populated by TOML parser */
+/* Strings owned by one component - binary, args, capability names and
+ * paths - packed into a single allocation. The char * fields of
+ * component_t point into it (or at static strings set up by tests and
+ * built-in components), so a component costs what its declaration uses
+ * rather than the worst case of every fixed-size buffer. */
 typedef struct {
-    char name[MAX_NAME];
-    char binary[MAX_PATH];
-    char args[MAX_ARGS][MAX_NAME];
-    int  argc;
-    char config_path[MAX_PATH];  /* path to the .toml file */
+    char  *base;
+    size_t len;
+    size_t cap;
+} comp_strings_t;
 
-    comp_type_t  type;
+/* Component structure - populated by TOML parser.
+ *
+ * Fields the resolver and supervisor touch on every pass come first so
+ * they share the leading cache lines; declaration-only data follows. */
+typedef struct {
+    /* State machine (hot) */
     comp_state_t state;
-    handoff_t    handoff;
+    comp_type_t  type;
+    pid_t pid;
+    int   n_requires;
+    int   n_provides;
+    int   n_optional;
 
-    /* Dependencies */
-    char requires[MAX_DEPS][MAX_NAME];
-    int  n_requires;
+    /* Interned capability IDs for requires/provides, valid while
+     * cap_generation matches capability_generation() */
+    unsigned int cap_generation;
+    unsigned int link_generation;  /* generation of consumer registration */
+    int link_idx;                  /* component index consumers refer to */
+    int requires_id[MAX_DEPS];
+    int provides_id[MAX_DEPS];
 
-    char provides[MAX_DEPS][MAX_NAME];
-    int  n_provides;
+    /* Pending deadlines */
+    int      timers[TIMER_KINDS];              /* timer handle by kind, 0 if none */
 
-    char optional[MAX_DEPS][MAX_NAME];
-    int  n_optional;
+    char name[MAX_NAME];
+
+    /* Declaration, all pointing into strings */
+    comp_strings_t strings;
+    char *binary;
+    char *args[MAX_ARGS];
+    int   argc;
+    char *config_path;             /* path to the .toml file */
+    char *requires[MAX_DEPS];
+    char *provides[MAX_DEPS];
+    char *optional[MAX_DEPS];
+    char *sockets[MAX_SOCKETS];    /* [sockets] listen, "<kind>:<address>" */
+    int   n_sockets;
+    int   socket_backlog;          /* listen() backlog, 0 = SOMAXCONN */
+
+    handoff_t    handoff;
 
     /* Process management */
-    pid_t pid;
     int   restart_count;
     time_t last_restart;
+    int   failures;                        /* failed runs in a row, for backoff */
+    uint64_t restart_due_ms;               /* FAILED: earliest restart, 0 = not yet scheduled */
+    int   cgroup_fd;                       /* open cgroup directory, 0 if none */
+
+    /* Warm standby (standby = true) */
+    pid_t standby_pid;                     /* spare instance, 0 if none */
+    int   standby_ready;                   /* it has warmed up and can take over */
+    time_t standby_started;                /* when it was forked */
+    int   standby_sock;                    /* our end of its handoff socket, 0 if none */
+    int   standby_cgroup_fd;               /* open <cgroup>.standby directory, 0 if none */
+    int   handoff_sock;                    /* our end of the main process's, 0 if none */
+    int  *held_fds;                        /* last descriptors handed over, for failover */
+    int   n_held_fds;
+
+    /* Socket activation */
+    int  *listen_fds;                      /* bound [sockets], one per entry once open */
+    int   n_listen_fds;
+
+    /* On-demand start */
+    int   demanded;                        /* a dependent or a connection needs it */
+    int   idle_unused;                     /* found unused at the last idle check */
+    int   idle_stopping;                   /* stopped for being unused, not failed */
 
     /* Lifecycle management */
     int      reload_signal;
-    char     health_check[MAX_PATH];        /* path to health check script */
+    int      stop_signal;                   /* asks the process to stop (default SIGTERM) */
+    int      stop_timeout;                  /* seconds from stop_signal to SIGKILL at shutdown (default 10) */
+    char    *health_check;                  /* path to health check script */
     int      health_interval;               /* health check interval in seconds */
     int      health_timeout;                /* health check timeout in seconds (default 10) */
     int      health_fail_threshold;         /* failures before entering DEGRADED (default 3) */
     int      health_restart_threshold;      /* failures before restarting (default 5) */
+    int      watchdog_sec;                  /* keepalive due this often, or it counts as a failure; 0 = off */
+
+    /* Restart policy */
+    int      restart_delay_ms;              /* delay after the first failure (default 1000) */
+    int      restart_delay_max_ms;          /* backoff ceiling (default 60000) */
+    int      restart_jitter;                /* percent of each delay drawn at random (default 25) */
+    int      restart_decay;                 /* seconds up that forgive past failures (default 60) */
+    int      restart_quarantine;            /* failures in a row before quarantine, 0 = never (default 10) */
+    int      standby;                       /* keep a warmed spare instance for hot-swap and failover */
+    int      on_demand;                     /* start = "on-demand": only once needed */
+    int      idle_timeout;                  /* seconds unused before an on-demand stop, 0 = never */
 
     /* Health check status */
     int      health_consecutive_failures;   /* current consecutive failure count */
     time_t   last_health_check;            /* timestamp of last health check */
     int      last_health_result;           /* 0=success, 1=failure, 2=timeout */
+    pid_t    health_pid;                   /* running health check, 0 if none */
+    int      health_timed_out;             /* running check was killed on timeout */
+    int      watchdog_missed;              /* watchdog deadlines missed in a row */
+    int      watchdog_fd;                  /* our end of the keepalive pipe, 0 if none */
+    int      watchdog_wfd;                 /* the end passed as WATCHDOG_FD, 0 if none */
 
     /* Readiness protocol */
     readiness_method_t readiness_method;       /* which readiness method to use */
-    char     readiness_file[MAX_PATH];         /* file to monitor for readiness */
-    char     readiness_check[MAX_PATH];        /* command to check readiness */
+    char    *readiness_file;                   /* file to monitor for readiness */
+    char    *readiness_check;                  /* command to check readiness */
     int      readiness_signal;                 /* signal number for readiness */
     int      readiness_timeout;                /* timeout in seconds (default 30) */
     int      readiness_interval;               /* check interval for health checks */
     time_t   ready_wait_start;                 /* when COMP_READY_WAIT state started */
+    pid_t    readiness_pid;                    /* running readiness check, 0 if none */
+    int      readiness_poll_ms;                /* current readiness re-probe delay */
+    char     notify_status[128];               /* last STATUS= from the notify socket */
+    uint64_t notify_watchdog_ms;               /* last WATCHDOG=1, monotonic ms */
 
     /* cgroup resource limits */
-    char     cgroup_path[MAX_PATH];            /* cgroup path under /sys/fs/cgroup/graph/ */
+    char    *cgroup_path;                      /* cgroup path under /sys/fs/cgroup/graph/ */
     char     memory_max[32];                   /* memory.max limit (e.g., "64M") */
     char     memory_high[32];                  /* memory.high limit (e.g., "48M") */
     int      cpu_weight;                       /* cpu.weight (1-10000, default 100) */
     char     cpu_max[32];                      /* cpu.max limit (e.g., "50000 100000") */
     int      io_weight;                        /* io.weight (1-10000, default 100) */
     int      pids_max;                         /* pids.max limit (default 0 = no limit) */
+    int      oom_group;                        /* an OOM kill takes the whole component (default 0) */
+    int      adaptive;                         /* memory.high/cpu.weight follow pressure (default 0) */
+    int      priority;                         /* keeps headroom over lower priorities (default 0) */
+    char     memory_high_min[32];              /* adaptive memory.high range */
+    char     memory_high_max[32];
+    int      cpu_weight_min;                   /* adaptive cpu.weight range */
+    int      cpu_weight_max;
+    char     standby_memory_high[32];          /* memory.high of the standby's cgroup */
+    int      standby_cpu_weight;               /* cpu.weight of the standby's cgroup (default 10) */
+    char     cpuset[128];                      /* CPUs it is pinned to (e.g., "2-3,6"), "" = placed */
+    int      numa;                             /* NUMA node it is placed on (default -1 = any) */
+    int      isolate_cpus;                     /* CPUs kept for it alone (default 0) */
 
     /* namespace isolation */
     char     isolation_namespaces[256];        /* comma-separated list: "mount,pid,net,uts,ipc" */
-    char     isolation_root[MAX_PATH];         /* chroot/pivot_root target (default "/") */
+    char    *isolation_root;                   /* chroot/pivot_root target (default "/") */
     char     isolation_hostname[MAX_NAME];     /* hostname for UTS namespace */
 
     /* checkpoint configuration */
@@ -125,7 +218,59 @@ typedef struct {
     int      checkpoint_max_age;               /* cleanup checkpoints older than this (hours) */
 } component_t;
 
+/* A string field that may be unset (NULL) or empty */
+static inline const char *comp_str(const char *s) {
+    return s ? s : "";
+}
+
+/* Copy value into the component's string arena and point *field at it.
+ * field must be one of comp's own char * members. Returns 0 or -1. */
+int component_set_str(component_t *comp, char **field, const char *value);
+
+/* Append value to an arena-backed string list (args, requires, ...)
+ * holding *n of at most max entries. Returns 0 or -1 when full. */
+int component_add_str(component_t *comp, char **list, int *n, int max, const char *value);
+
+/* Release the string arena; every string field is reset to NULL */
+void component_free_strings(component_t *comp);
+
+/* For snapshots of parsed components: detach rewrites comp's string
+ * fields as offsets into its arena and forgets the arena (it is not
+ * freed - call it on a copy). attach gives a detached record its own
+ * copy of the len bytes at strings and turns the offsets back into
+ * pointers; it fails, leaving every field NULL, if an offset is out of
+ * range. */
+void component_strings_detach(component_t *comp);
+int component_strings_attach(component_t *comp, const char *strings, size_t len);
+
+/* component_t holds both what a file declares and what the supervisor
+ * has since done with it. copy_runtime copies the latter (state, pid,
+ * timers, cgroup handle, restart and health/readiness bookkeeping) from
+ * src to dst;
+ * reset_runtime puts it back to what parse_component() leaves, and clears
+ * the interned capability and consumer link bookkeeping. */
+void component_copy_runtime(component_t *dst, const component_t *src);
+void component_reset_runtime(component_t *comp);
+
+/* Whether two components declare the same thing (runtime state is not
+ * compared), and whether their requires/provides/optional lists match */
+int component_same_declaration(const component_t *a, const component_t *b);
+int component_same_deps(const component_t *a, const component_t *b);
+
+/* Whether a and b declare the same [sockets] */
+int component_same_sockets(const component_t *a, const component_t *b);
+
+/* Whether a and b use the same cgroup with the same resource limits */
+int component_same_limits(const component_t *a, const component_t *b);
+
 /* Parse a component TOML file, populate a component_t structure */
 int parse_component(const char *path, component_t *comp);
 
+/* parse_component() in two steps. parse_component_file() touches no
+ * shared state, so several files may be parsed concurrently; the caller
+ * then runs component_intern_caps() on each result from one thread (and
+ * frees the strings if it fails). */
+int parse_component_file(const char *path, component_t *comp);
+int component_intern_caps(component_t *comp);
+
 #endif /* TOML_H */
\ No newline at end of file
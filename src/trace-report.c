@@ -0,0 +1,434 @@
+/*
+ * trace-report.c - YakirOS boot analysis implementation
+ *
+ * Components are followed by their traced name id, so one that has been
+ * reloaded or removed since still shows up under its name. Capability
+ * events name their provider by its index at the time.
+ */
+
+#define _GNU_SOURCE
+#include "trace-report.h"
+#include "trace.h"
+#include "component.h"
+#include "capability.h"
+#include "control-json.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Components listed as slowest by analyze-boot */
+#define REPORT_SLOWEST 10
+
+/* Threads of the Chrome trace */
+#define TID_RESOLVER 1
+#define TID_CRITICAL 2
+#define TID_COMPONENT(id) ((id) + 3)
+
+/* The boot window as seen by one component */
+typedef struct {
+    uint64_t started;       /* first STARTING, or 0 */
+    uint64_t ready;         /* first ACTIVE or DEGRADED (DONE for a oneshot) after it, or 0 */
+    int      failed;        /* FAILED and not started again */
+    int      on_path;
+    int      via;           /* requirement that came up last before it started, or -1 */
+    uint64_t via_up;
+} boot_comp_t;
+
+typedef struct {
+    uint64_t begin;         /* the boot scheduler taking over, or the first event */
+    uint64_t end;           /* the last component ready with none coming up, or 0 */
+    uint64_t handed_over;   /* the boot scheduler handing over, or 0 */
+    int      scheduled;     /* begin is the boot scheduler's */
+    int      coming_up;     /* started, neither ready nor failed, at the end */
+    int      last;          /* name id of the last component ready, or -1 */
+    boot_comp_t *comps;     /* by name id */
+    int     *comp_of;       /* name id -> component index, or -1 */
+    int      n_caps;
+    uint64_t *cap_up;       /* first registration in the window, or 0 */
+    int     *cap_provider;
+    int     *path;          /* name ids, first to last */
+    int      n_path;
+} boot_t;
+
+static double secs(uint64_t us) {
+    return (double)us / 1e6;
+}
+
+/* A oneshot is ready once done: what it provides comes up then */
+static int ready_state(const boot_t *b, int id, int state) {
+    int idx = b->comp_of[id];
+    if (idx >= 0 && components[idx].type == COMP_TYPE_ONESHOT) {
+        return state == COMP_ONESHOT_DONE;
+    }
+    return state == COMP_ACTIVE || state == COMP_DEGRADED || state == COMP_ONESHOT_DONE;
+}
+
+static void boot_free(boot_t *b) {
+    free(b->comps);
+    free(b->comp_of);
+    free(b->cap_up);
+    free(b->cap_provider);
+    free(b->path);
+}
+
+/* Name id of the component at idx, or -1 */
+static int component_name_id(int idx) {
+    return idx >= 0 && idx < n_components ? trace_intern(components[idx].name) : -1;
+}
+
+/* The requirement of the component named id that came up last before
+ * started, and when; -1 if none did */
+static int latest_requirement(const boot_t *b, int id, uint64_t started, uint64_t *up_out) {
+    int idx = b->comp_of[id];
+    int via = -1;
+    uint64_t latest = 0;
+    if (idx < 0) return -1;
+
+    const component_t *comp = &components[idx];
+    for (int j = 0; j < comp->n_requires; j++) {
+        int cap = comp->requires_id[j];
+        if (cap < 0 || cap >= b->n_caps) continue;
+        uint64_t up = b->cap_up[cap];
+        if (up && up <= started && up > latest) {
+            via = cap;
+            latest = up;
+        }
+    }
+    *up_out = latest;
+    return via;
+}
+
+/* Follow the path back from the last component ready */
+static void boot_critical_path(boot_t *b) {
+    int cur = b->last;
+    while (cur >= 0 && b->n_path < TRACE_MAX_NAMES) {
+        boot_comp_t *c = &b->comps[cur];
+        if (c->on_path) break;
+        c->on_path = 1;
+        b->path[b->n_path++] = cur;
+
+        c->via = latest_requirement(b, cur, c->started, &c->via_up);
+        if (c->via < 0) break;
+
+        cur = component_name_id(b->cap_provider[c->via]);
+        if (cur >= 0 && !b->comps[cur].ready) cur = -1;
+    }
+
+    /* Collected last to first */
+    for (int i = 0, j = b->n_path - 1; i < j; i++, j--) {
+        int id = b->path[i];
+        b->path[i] = b->path[j];
+        b->path[j] = id;
+    }
+}
+
+static int boot_analyze(boot_t *b) {
+    memset(b, 0, sizeof(*b));
+    b->last = -1;
+    b->n_caps = capability_count();
+    size_t n_caps = b->n_caps > 0 ? (size_t)b->n_caps : 1;
+    b->comps = calloc(TRACE_MAX_NAMES, sizeof(*b->comps));
+    b->comp_of = malloc(TRACE_MAX_NAMES * sizeof(*b->comp_of));
+    b->path = malloc(TRACE_MAX_NAMES * sizeof(*b->path));
+    b->cap_up = calloc(n_caps, sizeof(*b->cap_up));
+    b->cap_provider = malloc(n_caps * sizeof(*b->cap_provider));
+    if (!b->comps || !b->comp_of || !b->path || !b->cap_up || !b->cap_provider) {
+        boot_free(b);
+        return -1;
+    }
+    for (int i = 0; i < TRACE_MAX_NAMES; i++) {
+        b->comp_of[i] = -1;
+        b->comps[i].via = -1;
+    }
+    for (int i = 0; i < b->n_caps; i++) {
+        b->cap_provider[i] = -1;
+    }
+    for (int i = 0; i < n_components; i++) {
+        int id = component_name_id(i);
+        if (id >= 0) b->comp_of[id] = i;
+    }
+
+    int n = trace_count();
+    int first = 0;
+    for (int i = 0; i < n; i++) {
+        if (trace_event(i)->kind == TRACE_BOOT_BEGIN) {
+            first = i;
+            b->scheduled = 1;
+            break;
+        }
+    }
+    if (n > 0) b->begin = trace_event(first)->time_us;
+
+    /* Boot is over when the last component started is ready and nothing
+     * it brought up starts anything more: a component starting later on a
+     * requirement that was up by then (on demand, after a reload) was not
+     * waiting for boot */
+    uint64_t settled = 0;
+    for (int i = 0; i < n; i++) {
+        const trace_event_t *ev = trace_event(i);
+        if (ev->kind == TRACE_BOOT_END && !b->handed_over) {
+            b->handed_over = ev->time_us;
+        }
+        /* Capabilities from the start: the kernel's come before boot */
+        if (ev->kind == TRACE_CAP_UP && ev->cap >= 0 && ev->cap < b->n_caps &&
+            !b->cap_up[ev->cap]) {
+            b->cap_up[ev->cap] = ev->time_us;
+            b->cap_provider[ev->cap] = ev->value;
+        }
+        if (ev->kind != TRACE_STATE || i < first || ev->name < 0) continue;
+
+        boot_comp_t *c = &b->comps[ev->name];
+        if (ev->to == COMP_STARTING && (!c->started || c->failed)) {
+            if (settled) {
+                uint64_t up = 0;
+                if (latest_requirement(b, ev->name, ev->time_us, &up) < 0 || up < settled) break;
+                settled = 0;
+            }
+            if (!c->started) c->started = ev->time_us;
+            c->failed = 0;
+            b->coming_up++;
+        } else if (c->started && !c->ready && !c->failed) {
+            if (ready_state(b, ev->name, ev->to)) {
+                c->ready = ev->time_us;
+                b->last = ev->name;
+            } else if (ev->to == COMP_FAILED || ev->to == COMP_QUARANTINED) {
+                c->failed = 1;
+            } else {
+                continue;
+            }
+            if (--b->coming_up == 0) settled = ev->time_us;
+        }
+    }
+    b->end = settled;
+
+    boot_critical_path(b);
+    return 0;
+}
+
+void trace_report_boot(control_buf_t *out) {
+    boot_t b;
+    if (boot_analyze(&b) < 0) {
+        control_printf(out, "Error: out of memory analyzing boot\n");
+        return;
+    }
+    if (b.last < 0) {
+        control_printf(out, "No component has become ready yet: nothing to analyze\n");
+        boot_free(&b);
+        return;
+    }
+
+    uint64_t last_ready = b.comps[b.last].ready;
+    control_printf(out,
+                   "BOOT ANALYSIS\n"
+                   "═════════════\n\n"
+                   "%-28s+%.3fs after the kernel started\n",
+                   b.scheduled ? "Boot scheduler took over:" : "First event traced:",
+                   secs(b.begin));
+    if (b.handed_over) {
+        control_printf(out, "Boot scheduler handed over: +%.3fs\n", secs(b.handed_over));
+    }
+    if (b.end) {
+        control_printf(out, "Boot finished:              +%.3fs (%s ready)\n",
+                       secs(b.end), trace_name(b.last));
+    } else {
+        control_printf(out, "Still booting:              %d coming up, %s ready last\n",
+                       b.coming_up, trace_name(b.last));
+    }
+    control_printf(out,
+                   "Boot time:                  %.3fs%s\n"
+                   "Traced events:              %d (%llu dropped)\n\n",
+                   secs(last_ready - b.begin), b.end ? "" : " so far", trace_count(),
+                   (unsigned long long)trace_dropped());
+
+    /* Times in seconds: started since boot began, waited since the
+     * requirement came up, took until ready */
+    control_printf(out,
+                   "Critical path:\n"
+                   "  %-10s %-9s %-9s %-24s %s\n",
+                   "STARTED", "WAITED", "TOOK", "COMPONENT", "AFTER");
+    for (int i = 0; i < b.n_path; i++) {
+        const boot_comp_t *c = &b.comps[b.path[i]];
+        uint64_t since = c->via >= 0 && c->via_up > b.begin ? c->via_up : b.begin;
+        control_printf(out, "  +%-9.3f %-9.3f %-9.3f %-24s %s\n",
+                       secs(c->started - b.begin),
+                       secs(c->started > since ? c->started - since : 0),
+                       secs(c->ready - c->started), trace_name(b.path[i]),
+                       c->via >= 0 ? capability_name(c->via) : "-");
+    }
+
+    /* The slowest first, picking each time the slowest after the last
+     * listed in (time taken, name id) order */
+    control_printf(out, "\nSlowest to become ready:\n  %-9s %s\n", "TOOK", "COMPONENT");
+    uint64_t prev_took = UINT64_MAX;
+    int prev_id = -1;
+    for (int k = 0; k < REPORT_SLOWEST; k++) {
+        int pick = -1;
+        uint64_t took = 0;
+        for (int i = 0; i < n_components; i++) {
+            int id = component_name_id(i);
+            if (id < 0 || !b.comps[id].ready) continue;
+            uint64_t t = b.comps[id].ready - b.comps[id].started;
+            if (t > prev_took || (t == prev_took && id <= prev_id)) continue;
+            if (pick < 0 || t > took || (t == took && id < pick)) {
+                pick = id;
+                took = t;
+            }
+        }
+        if (pick < 0) break;
+        control_printf(out, "  %-9.3f %s\n", secs(took), trace_name(pick));
+        prev_took = took;
+        prev_id = pick;
+    }
+
+    int shown = 0;
+    for (int i = 0; i < n_components; i++) {
+        int id = component_name_id(i);
+        if (id < 0 || !b.comps[id].started || b.comps[id].ready) continue;
+        control_printf(out, "%s%s%s", shown++ ? ", " : "\nStarted but not ready: ",
+                       components[i].name, b.comps[id].failed ? " (failed)" : "");
+    }
+    if (shown) control_printf(out, "\n");
+
+    boot_free(&b);
+}
+
+/* Start an event object; the caller adds its own fields and the '}' */
+static void chrome_begin(control_buf_t *out, int *count, const char *name,
+                         const char *cat, const char *ph, int tid, uint64_t ts) {
+    control_printf(out, "%s{\"name\":", (*count)++ ? ",\n" : "");
+    json_string(out, name);
+    control_printf(out, ",\"cat\":\"%s\",\"ph\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%llu",
+                   cat, ph, tid, (unsigned long long)ts);
+}
+
+static void chrome_thread(control_buf_t *out, int *count, int tid, const char *name, int sort) {
+    control_printf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                   "\"args\":{\"name\":", (*count)++ ? ",\n" : "", tid);
+    json_string(out, name);
+    control_printf(out, "}},\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,"
+                   "\"tid\":%d,\"args\":{\"sort_index\":%d}}", tid, sort);
+}
+
+static void chrome_span_end(control_buf_t *out, uint64_t from, uint64_t to) {
+    control_printf(out, ",\"dur\":%llu}", (unsigned long long)(to > from ? to - from : 0));
+}
+
+/* Track of the component named id, naming it the first time */
+static int chrome_component(control_buf_t *out, int *count, uint8_t *seen, int id) {
+    if (id < 0) return TID_RESOLVER;
+    if (!seen[id]) {
+        seen[id] = 1;
+        chrome_thread(out, count, TID_COMPONENT(id), trace_name(id), TID_COMPONENT(id));
+    }
+    return TID_COMPONENT(id);
+}
+
+void trace_report_chrome(control_buf_t *out) {
+    boot_t b;
+    uint8_t *seen = calloc(TRACE_MAX_NAMES, 1);
+    uint64_t *open_time = calloc(TRACE_MAX_NAMES, sizeof(*open_time));
+    int *open_state = malloc(TRACE_MAX_NAMES * sizeof(*open_state));
+    if (!seen || !open_time || !open_state || boot_analyze(&b) < 0) {
+        free(seen);
+        free(open_time);
+        free(open_state);
+        control_printf(out, "Error: out of memory exporting the trace\n");
+        return;
+    }
+    for (int i = 0; i < TRACE_MAX_NAMES; i++) {
+        open_state[i] = -1;
+    }
+
+    int count = 0;
+    control_printf(out, "{\"traceEvents\":[\n"
+                   "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                   "\"args\":{\"name\":\"graph-resolver\"}}");
+    count++;
+    chrome_thread(out, &count, TID_RESOLVER, "graph-resolver", 0);
+    chrome_thread(out, &count, TID_CRITICAL, "boot critical path", 1);
+
+    uint64_t boot_begin = 0;
+    char label[512];
+    int n = trace_count();
+    for (int i = 0; i < n; i++) {
+        const trace_event_t *ev = trace_event(i);
+        int tid;
+        switch ((trace_kind_t)ev->kind) {
+        case TRACE_STATE:
+            if (ev->name < 0) break;
+            tid = chrome_component(out, &count, seen, ev->name);
+            if (open_state[ev->name] > COMP_INACTIVE) {
+                chrome_begin(out, &count, json_state_name((comp_state_t)open_state[ev->name]),
+                             "state", "X", tid, open_time[ev->name]);
+                chrome_span_end(out, open_time[ev->name], ev->time_us);
+            }
+            open_state[ev->name] = ev->to;
+            open_time[ev->name] = ev->time_us;
+            break;
+
+        case TRACE_SPAWN:
+            tid = chrome_component(out, &count, seen, ev->name);
+            snprintf(label, sizeof(label), "exec %s", trace_name(ev->cap));
+            chrome_begin(out, &count, label, "spawn", "X", tid, ev->time_us);
+            control_printf(out, ",\"dur\":%u,\"args\":{\"pid\":%d}}",
+                           (unsigned)ev->duration_us, (int)ev->value);
+            break;
+
+        case TRACE_CAP_UP:
+        case TRACE_CAP_DOWN: {
+            const char *cap = capability_name(ev->cap);
+            tid = chrome_component(out, &count, seen, component_name_id(ev->value));
+            snprintf(label, sizeof(label), "%s %s",
+                     ev->kind == TRACE_CAP_UP ? "up" : "down", cap ? cap : "?");
+            chrome_begin(out, &count, label, "capability", "i", tid, ev->time_us);
+            control_printf(out, ",\"s\":\"t\"}");
+            break;
+        }
+
+        case TRACE_BOOT_BEGIN:
+            boot_begin = ev->time_us;
+            break;
+
+        case TRACE_BOOT_END:
+            if (boot_begin) {
+                chrome_begin(out, &count, "boot", "boot", "X", TID_RESOLVER, boot_begin);
+                chrome_span_end(out, boot_begin, ev->time_us);
+                boot_begin = 0;
+            }
+            break;
+        }
+    }
+
+    /* What is still going on lasts until now */
+    uint64_t now = trace_now_us();
+    for (int id = 0; id < TRACE_MAX_NAMES; id++) {
+        if (open_state[id] <= COMP_INACTIVE) continue;
+        chrome_begin(out, &count, json_state_name((comp_state_t)open_state[id]),
+                     "state", "X", TID_COMPONENT(id), open_time[id]);
+        chrome_span_end(out, open_time[id], now);
+    }
+    if (boot_begin) {
+        chrome_begin(out, &count, "booting", "boot", "X", TID_RESOLVER, boot_begin);
+        chrome_span_end(out, boot_begin, now);
+    }
+
+    for (int i = 0; i < b.n_path; i++) {
+        const boot_comp_t *c = &b.comps[b.path[i]];
+        uint64_t since = c->via >= 0 && c->via_up > b.begin ? c->via_up : b.begin;
+        chrome_begin(out, &count, trace_name(b.path[i]), "critical", "X",
+                     TID_CRITICAL, c->started);
+        control_printf(out, ",\"dur\":%llu,\"args\":{\"waited_us\":%llu,\"after\":",
+                       (unsigned long long)(c->ready - c->started),
+                       (unsigned long long)(c->started > since ? c->started - since : 0));
+        json_string(out, c->via >= 0 ? capability_name(c->via) : "");
+        control_printf(out, "}}");
+    }
+
+    control_printf(out, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":%llu}}\n",
+                   (unsigned long long)trace_dropped());
+
+    boot_free(&b);
+    free(seen);
+    free(open_time);
+    free(open_state);
+}
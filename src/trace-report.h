@@ -0,0 +1,27 @@
+/*
+ * trace-report.h - YakirOS boot analysis from the lifecycle trace
+ *
+ * The boot is the traced window from the boot scheduler taking over to
+ * its handing over (or to now, if it has not yet). Its critical path is
+ * found backwards: from the last component to become ready, to the
+ * provider of the requirement that came up last before it started, and
+ * so on until a component waited on nothing another provided. Shortening
+ * anything off that path does not make boot any shorter.
+ */
+
+#ifndef TRACE_REPORT_H
+#define TRACE_REPORT_H
+
+#include "control.h"
+
+/* `analyze-boot`: total boot time, its critical path and the components
+ * slowest to become ready */
+void trace_report_boot(control_buf_t *out);
+
+/* `analyze-boot --chrome`: every kept event in the Chrome trace event
+ * format, for chrome://tracing or ui.perfetto.dev. Each component is a
+ * thread, its states and spawns spans on it; the critical path has a
+ * thread of its own. */
+void trace_report_chrome(control_buf_t *out);
+
+#endif /* TRACE_REPORT_H */
@@ -0,0 +1,128 @@
+/*
+ * trace.c - YakirOS lifecycle tracing implementation
+ *
+ * kept[] fills first and is never overwritten; after it, ring[] takes
+ * events round and round. Names are interned into an open-addressed hash
+ * so an event carries a small id rather than a copy of the string.
+ */
+
+#define _GNU_SOURCE
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NAME_SLOTS (TRACE_MAX_NAMES * 2)
+
+static trace_event_t kept[TRACE_KEPT];
+static trace_event_t ring[TRACE_RING];
+static int n_kept = 0;
+static uint64_t n_ring = 0;   /* ever written to ring[] */
+
+static char *names[TRACE_MAX_NAMES];
+static int n_names = 0;
+static int name_slots[NAME_SLOTS];   /* id + 1, or 0 for free */
+
+uint64_t trace_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static unsigned name_hash(const char *s) {
+    unsigned h = 2166136261u;
+    for (; *s; s++) {
+        h = (h ^ (unsigned char)*s) * 16777619u;
+    }
+    return h;
+}
+
+int trace_intern(const char *name) {
+    if (!name) return -1;
+
+    unsigned slot = name_hash(name) % NAME_SLOTS;
+    while (name_slots[slot]) {
+        int id = name_slots[slot] - 1;
+        if (strcmp(names[id], name) == 0) return id;
+        slot = (slot + 1) % NAME_SLOTS;
+    }
+    if (n_names == TRACE_MAX_NAMES) return -1;
+
+    char *copy = strdup(name);
+    if (!copy) return -1;
+    names[n_names] = copy;
+    name_slots[slot] = n_names + 1;
+    return n_names++;
+}
+
+const char *trace_name(int id) {
+    return id >= 0 && id < n_names ? names[id] : "?";
+}
+
+static trace_event_t *next_slot(void) {
+    if (n_kept < TRACE_KEPT) return &kept[n_kept++];
+    return &ring[n_ring++ % TRACE_RING];
+}
+
+static trace_event_t *record(trace_kind_t kind, uint64_t time_us) {
+    trace_event_t *ev = next_slot();
+    memset(ev, 0, sizeof(*ev));
+    ev->time_us = time_us;
+    ev->kind = (uint8_t)kind;
+    ev->name = -1;
+    ev->cap = -1;
+    ev->value = -1;
+    return ev;
+}
+
+void trace_state(const char *name, int from, int to) {
+    trace_event_t *ev = record(TRACE_STATE, trace_now_us());
+    ev->name = trace_intern(name);
+    ev->from = (uint8_t)from;
+    ev->to = (uint8_t)to;
+}
+
+void trace_capability(int cap, int up, int provider) {
+    trace_event_t *ev = record(up ? TRACE_CAP_UP : TRACE_CAP_DOWN, trace_now_us());
+    ev->cap = cap;
+    ev->value = provider;
+}
+
+void trace_spawn(const char *name, const char *path, int pid, uint64_t started_us) {
+    uint64_t now = trace_now_us();
+    trace_event_t *ev = record(TRACE_SPAWN, started_us);
+    ev->name = trace_intern(name);
+    ev->cap = trace_intern(path);
+    ev->value = pid;
+    ev->duration_us = (uint32_t)(now - started_us);
+}
+
+void trace_boot_begin(void) {
+    record(TRACE_BOOT_BEGIN, trace_now_us());
+}
+
+void trace_boot_end(void) {
+    record(TRACE_BOOT_END, trace_now_us());
+}
+
+int trace_count(void) {
+    return n_kept + (int)(n_ring < TRACE_RING ? n_ring : TRACE_RING);
+}
+
+const trace_event_t *trace_event(int i) {
+    if (i < 0 || i >= trace_count()) return NULL;
+    if (i < n_kept) return &kept[i];
+
+    i -= n_kept;
+    uint64_t first = n_ring < TRACE_RING ? 0 : n_ring - TRACE_RING;
+    return &ring[(first + (uint64_t)i) % TRACE_RING];
+}
+
+uint64_t trace_dropped(void) {
+    return n_ring < TRACE_RING ? 0 : n_ring - TRACE_RING;
+}
+
+void trace_reset(void) {
+    n_kept = 0;
+    n_ring = 0;
+}
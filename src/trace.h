@@ -0,0 +1,68 @@
+/*
+ * trace.h - YakirOS lifecycle tracing
+ *
+ * Every component state transition, capability registration and
+ * withdrawal and every spawn is recorded with a CLOCK_MONOTONIC
+ * timestamp (microseconds since the kernel booted) into a fixed
+ * in-memory buffer, so `graphctl analyze-boot` can tell where boot time
+ * went. Recording is a store into the next slot: nothing is allocated and
+ * nothing written out. The first TRACE_KEPT events, which on a cold boot
+ * are the boot itself, are kept for good; later ones go round a ring of
+ * TRACE_RING, the oldest giving way.
+ *
+ * Only the main loop records; the buffer is not locked.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_KEPT 4096
+#define TRACE_RING 8192
+
+/* Distinct component names remembered; later ones are traced as "?" */
+#define TRACE_MAX_NAMES 2048
+
+typedef enum {
+    TRACE_STATE,        /* name went from `from` to `to` (comp_state_t) */
+    TRACE_CAP_UP,       /* capability cap registered, value its provider's index */
+    TRACE_CAP_DOWN,     /* capability cap withdrawn, value its last provider's index */
+    TRACE_SPAWN,        /* name spawned cap (an executable) as pid value */
+    TRACE_BOOT_BEGIN,   /* the boot scheduler took over */
+    TRACE_BOOT_END      /* and handed over again */
+} trace_kind_t;
+
+typedef struct {
+    uint64_t time_us;
+    uint8_t  kind;                  /* trace_kind_t */
+    uint8_t  from, to;
+    int32_t  name;                  /* trace_intern()ed, or -1 */
+    int32_t  cap;
+    int32_t  value;
+    uint32_t duration_us;           /* TRACE_SPAWN: how long spawning took */
+} trace_event_t;
+
+/* Microseconds on CLOCK_MONOTONIC */
+uint64_t trace_now_us(void);
+
+/* Id of a name, remembered until exit; -1 once TRACE_MAX_NAMES are */
+int trace_intern(const char *name);
+const char *trace_name(int id);
+
+void trace_state(const char *name, int from, int to);
+void trace_capability(int cap, int up, int provider);
+void trace_spawn(const char *name, const char *path, int pid, uint64_t started_us);
+void trace_boot_begin(void);
+void trace_boot_end(void);
+
+/* Events kept, oldest first: trace_event(0) .. trace_event(trace_count() - 1).
+ * trace_dropped() counts those the ring has lost. */
+int trace_count(void);
+const trace_event_t *trace_event(int i);
+uint64_t trace_dropped(void);
+
+/* Forget every event (names stay), for tests */
+void trace_reset(void);
+
+#endif /* TRACE_H */
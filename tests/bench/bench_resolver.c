@@ -0,0 +1,449 @@
+/*
+ * bench_resolver.c - Microbenchmarks for the resolver core
+ *
+ * Synthetic graphs of 100, 1000 and 10000 components are built in memory
+ * in three shapes, and each operation is run in rounds of at least
+ * BENCH_ROUND_NS. The best of BENCH_ROUNDS rounds is reported as ns/op,
+ * with the heap allocations made per op (counted by wrapping malloc,
+ * calloc and realloc).
+ *
+ *   chain   each level requires the capability of the level before. The
+ *           registry holds MAX_CAPABILITIES capabilities, so past
+ *           CHAIN_MAX_DEPTH levels a level is a group sharing one.
+ *   fanout  one root every other component requires
+ *   dag     DAG_LEVELS levels, each component requiring two of the (up to
+ *           DAG_WIDTH) capabilities of the level before
+ *
+ * Usage: bench_resolver [--filter TEXT] [--save FILE]
+ *                       [--check FILE [--threshold PCT]]
+ *
+ * --save writes the results to FILE; --check compares against such a
+ * file and exits 1 if a resolve_full or cycles benchmark (the resolver
+ * and the validator) got more than PCT percent (default 25) slower, in
+ * each of BENCH_RETRIES + 1 measurements.
+ */
+
+#define _GNU_SOURCE
+#include "../../src/component.h"
+#include "../../src/capability.h"
+#include "../../src/control.h"
+#include "../../src/graph.h"
+#include "../../src/log.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_ROUND_NS   (20 * 1000 * 1000)
+#define BENCH_ROUNDS     5
+#define BENCH_RETRIES    5
+#define BENCH_MAX        64
+
+#define CHAIN_MAX_DEPTH  400
+#define DAG_LEVELS       10
+#define DAG_WIDTH        32
+#define PARSE_FILES      64
+
+/* Allocation counting: glibc lets a program replace malloc, and its own
+ * calls (strdup, qsort, ...) come through here too */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static unsigned long n_allocs;
+
+void *malloc(size_t size) {
+    n_allocs++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    n_allocs++;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    n_allocs++;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+
+typedef struct {
+    char   name[64];
+    double ns_per_op;
+    double allocs_per_op;
+} bench_result_t;
+
+static bench_result_t results[BENCH_MAX];
+static int n_results = 0;
+static const char *filter = NULL;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Time fn(iters) once; the allocations it made go to *allocs */
+static uint64_t bench_round(void (*fn)(long), long iters, unsigned long *allocs) {
+    unsigned long before = n_allocs;
+    uint64_t start = now_ns();
+    fn(iters);
+    uint64_t took = now_ns() - start;
+    *allocs = n_allocs - before;
+    return took;
+}
+
+/* Baseline being checked against, and the allowed slowdown in percent */
+static bench_result_t baseline[BENCH_MAX];
+static int n_baseline = 0;
+static double threshold = 25.0;
+
+static int gated(const char *name) {
+    return strncmp(name, "resolve_full/", 13) == 0 || strncmp(name, "cycles/", 7) == 0;
+}
+
+/* How much slower than the baseline ns is, in percent; 0 if not gated */
+static double slowdown(const char *name, double ns) {
+    if (!gated(name)) return 0;
+    for (int i = 0; i < n_baseline; i++) {
+        if (strcmp(baseline[i].name, name) == 0) {
+            return (ns - baseline[i].ns_per_op) * 100.0 / baseline[i].ns_per_op;
+        }
+    }
+    return 0;
+}
+
+/* Best ns/op of BENCH_ROUNDS rounds of *iters ops, doubling *iters first
+ * (if 0) until a round is long enough to time */
+static double bench_measure(void (*fn)(long), long *iters, unsigned long *allocs) {
+    uint64_t took = 0;
+    if (*iters == 0) {
+        for (*iters = 1;; *iters *= 2) {
+            took = bench_round(fn, *iters, allocs);
+            if (took >= BENCH_ROUND_NS || *iters >= (1L << 30)) break;
+        }
+    } else {
+        took = bench_round(fn, *iters, allocs);
+    }
+
+    double best = (double)took / (double)*iters;
+    for (int r = 1; r < BENCH_ROUNDS; r++) {
+        double ns = (double)bench_round(fn, *iters, allocs) / (double)*iters;
+        if (ns < best) best = ns;
+    }
+    return best;
+}
+
+/* Run fn after setup (if any). How the memory it works on happens to be
+ * laid out moves timings by a third and more from run to run, so a
+ * regression counts only if it shows again after setting up afresh. */
+static void bench_run(const char *name, int (*setup)(void), void (*fn)(long)) {
+    if (filter && !strstr(name, filter)) return;
+    if (n_results == BENCH_MAX) return;
+    if (setup && setup() < 0) {
+        fprintf(stderr, "%s: setup failed\n", name);
+        return;
+    }
+
+    long iters = 0;
+    unsigned long allocs;
+    double best = bench_measure(fn, &iters, &allocs);
+
+    for (int retry = 0; retry < BENCH_RETRIES && slowdown(name, best) > threshold; retry++) {
+        if (setup && setup() < 0) break;
+        double ns = bench_measure(fn, &iters, &allocs);
+        if (ns < best) best = ns;
+    }
+
+    bench_result_t *res = &results[n_results++];
+    snprintf(res->name, sizeof(res->name), "%s", name);
+    res->ns_per_op = best;
+    res->allocs_per_op = (double)allocs / (double)iters;
+    printf("%-32s %12ld %14.1f %10.2f\n", res->name, iters, res->ns_per_op, res->allocs_per_op);
+    fflush(stdout);
+}
+
+/* --- Synthetic graphs --------------------------------------------- */
+
+static void add_component(int i, char *const *requires, int n_req, const char *provides) {
+    component_t *comp = &components[i];
+    memset(comp, 0, sizeof(*comp));
+    snprintf(comp->name, MAX_NAME, "c%05d", i);
+    component_set_str(comp, &comp->binary, "/bin/true");
+    comp->type = COMP_TYPE_SERVICE;
+    comp->state = COMP_INACTIVE;
+    comp->pid = -1;
+    for (int r = 0; r < n_req; r++) {
+        component_add_str(comp, comp->requires, &comp->n_requires, MAX_DEPS, requires[r]);
+    }
+    if (provides) {
+        component_add_str(comp, comp->provides, &comp->n_provides, MAX_DEPS, provides);
+    }
+}
+
+/* graph_shape of graph_size components, every one ACTIVE with its
+ * capabilities up */
+static const char *graph_shape;
+static int graph_size;
+
+static int build_graph(void) {
+    const char *shape = graph_shape;
+    int n = graph_size;
+    component_table_clear();
+    capability_init();
+    if (component_table_reserve(n) < 0) return -1;
+
+    char req_buf[2][MAX_NAME], prov[MAX_NAME];
+    char *req[2] = { req_buf[0], req_buf[1] };
+    int depth = n < CHAIN_MAX_DEPTH ? n : CHAIN_MAX_DEPTH;
+    int per_level = (n + DAG_LEVELS - 1) / DAG_LEVELS;
+    int width = per_level < DAG_WIDTH ? per_level : DAG_WIDTH;
+
+    for (int i = 0; i < n; i++) {
+        int n_req = 0;
+        if (strcmp(shape, "chain") == 0) {
+            int level = (int)((long)i * depth / n);
+            snprintf(prov, sizeof(prov), "chain-%d", level);
+            if (level > 0) snprintf(req[n_req++], MAX_NAME, "chain-%d", level - 1);
+        } else if (strcmp(shape, "fanout") == 0) {
+            snprintf(prov, sizeof(prov), "%s", i == 0 ? "root" : "");
+            if (i > 0) snprintf(req[n_req++], MAX_NAME, "root");
+        } else {
+            int level = i / per_level, slot = i % per_level;
+            snprintf(prov, sizeof(prov), "dag-%d-%d", level, slot % width);
+            if (level > 0) {
+                snprintf(req[n_req++], MAX_NAME, "dag-%d-%d", level - 1, (slot * 7) % width);
+                snprintf(req[n_req++], MAX_NAME, "dag-%d-%d", level - 1, (slot * 13 + 1) % width);
+            }
+        }
+        add_component(i, req, n_req, prov[0] ? prov : NULL);
+        if (component_intern_caps(&components[i]) < 0) return -1;
+    }
+    n_components = n;
+
+    for (int i = 0; i < n; i++) {
+        component_set_state(&components[i], COMP_ACTIVE);
+        component_register_provides(i);
+    }
+    graph_resolve_full();
+    return 0;
+}
+
+/* --- Operations --------------------------------------------------- */
+
+static void op_resolve_full(long iters) {
+    for (long i = 0; i < iters; i++) {
+        graph_resolve_full();
+    }
+}
+
+/* The analysis behind cycle detection is cached until the graph changes;
+ * leaving out the last component (always a leaf) every other op changes
+ * it, so every op rebuilds as after a reload */
+static int leaf_dropped;
+
+static void op_detect_cycles(long iters) {
+    for (long i = 0; i < iters; i++) {
+        leaf_dropped = !leaf_dropped;
+        n_components = graph_size - leaf_dropped;
+        cycle_info_t info;
+        graph_detect_cycles(&info);
+        free(info.cycle_components);
+    }
+    n_components = graph_size;
+}
+
+static control_buf_t status_out;
+
+static void op_control_status(long iters) {
+    for (long i = 0; i < iters; i++) {
+        status_out.len = 0;
+        control_execute("status", &status_out);
+    }
+}
+
+static char cap_names[MAX_CAPABILITIES][MAX_NAME];
+static int n_cap_names;
+
+static void op_capability_index(long iters) {
+    for (long i = 0; i < iters; i++) {
+        capability_index(cap_names[i % n_cap_names]);
+    }
+}
+
+static char parse_paths[PARSE_FILES][256];
+
+static void op_parse_component(long iters) {
+    for (long i = 0; i < iters; i++) {
+        component_t comp;
+        memset(&comp, 0, sizeof(comp));
+        if (parse_component(parse_paths[i % PARSE_FILES], &comp) == 0) {
+            component_free_strings(&comp);
+        }
+    }
+}
+
+static int write_parse_files(char *dir) {
+    if (!mkdtemp(dir)) return -1;
+    for (int i = 0; i < PARSE_FILES; i++) {
+        snprintf(parse_paths[i], sizeof(parse_paths[i]), "%s/c%02d.toml", dir, i);
+        FILE *f = fopen(parse_paths[i], "w");
+        if (!f) return -1;
+        fprintf(f,
+                "[component]\n"
+                "name = \"bench-%d\"\n"
+                "type = \"service\"\n"
+                "binary = \"/usr/bin/bench-%d\"\n"
+                "args = [\"--config\", \"/etc/bench/%d.conf\", \"--verbose\"]\n\n"
+                "[requires]\n"
+                "capabilities = [\"cap-%d\", \"cap-%d\", \"cap-%d\"]\n\n"
+                "[provides]\n"
+                "capabilities = [\"bench-%d\"]\n\n"
+                "[lifecycle]\n"
+                "reload_signal = \"SIGHUP\"\n"
+                "health_check = \"/usr/bin/bench-check\"\n"
+                "health_interval = 30\n",
+                i, i, i, i % 16, (i + 5) % 16, (i + 11) % 16, i);
+        fclose(f);
+    }
+    return 0;
+}
+
+static void remove_parse_files(const char *dir) {
+    for (int i = 0; i < PARSE_FILES; i++) {
+        unlink(parse_paths[i]);
+    }
+    rmdir(dir);
+}
+
+/* --- Baselines ---------------------------------------------------- */
+
+static int save_results(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    for (int i = 0; i < n_results; i++) {
+        fprintf(f, "%s %.1f %.2f\n", results[i].name, results[i].ns_per_op,
+                results[i].allocs_per_op);
+    }
+    fclose(f);
+    return 0;
+}
+
+static int load_baseline(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    bench_result_t *b = &baseline[0];
+    while (n_baseline < BENCH_MAX &&
+           fscanf(f, "%63s %lf %lf", b->name, &b->ns_per_op, &b->allocs_per_op) == 3) {
+        b = &baseline[++n_baseline];
+    }
+    fclose(f);
+    return 0;
+}
+
+/* Report the gated benchmarks slower than the threshold; returns how many */
+static int check_results(void) {
+    int regressions = 0;
+    for (int i = 0; i < n_results; i++) {
+        double change = slowdown(results[i].name, results[i].ns_per_op);
+        if (change > threshold) {
+            printf("REGRESSION %s: %.1f ns/op (%+.0f%%)\n",
+                   results[i].name, results[i].ns_per_op, change);
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+int main(int argc, char **argv) {
+    const char *save = NULL, *check = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+            save = argv[++i];
+        } else if (strcmp(argv[i], "--check") == 0 && i + 1 < argc) {
+            check = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [--filter TEXT] [--save FILE] "
+                    "[--check FILE [--threshold PCT]]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    log_open();
+    if (check && load_baseline(check) < 0) return 1;
+
+    static const char *shapes[] = { "chain", "fanout", "dag" };
+    static const int sizes[] = { 100, 1000, 10000 };
+    char name[64];
+
+    printf("%-32s %12s %14s %10s\n", "BENCHMARK", "OPS", "NS/OP", "ALLOCS/OP");
+
+    for (size_t s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++) {
+        for (size_t z = 0; z < sizeof(sizes) / sizeof(sizes[0]); z++) {
+            graph_shape = shapes[s];
+            graph_size = sizes[z];
+
+            snprintf(name, sizeof(name), "resolve_full/%s/%d", shapes[s], sizes[z]);
+            bench_run(name, build_graph, op_resolve_full);
+            snprintf(name, sizeof(name), "cycles/%s/%d", shapes[s], sizes[z]);
+            bench_run(name, build_graph, op_detect_cycles);
+            if (strcmp(shapes[s], "fanout") == 0) {
+                snprintf(name, sizeof(name), "control_status/%d", sizes[z]);
+                bench_run(name, build_graph, op_control_status);
+            }
+        }
+    }
+    component_table_clear();
+    control_buf_free(&status_out);
+
+    /* Lookups hit every interned name in turn */
+    static const int n_caps[] = { 100, MAX_CAPABILITIES };
+    for (size_t k = 0; k < sizeof(n_caps) / sizeof(n_caps[0]); k++) {
+        capability_init();
+        n_cap_names = n_caps[k];
+        for (int i = 0; i < n_cap_names; i++) {
+            snprintf(cap_names[i], MAX_NAME, "bench.capability-%d", i);
+            capability_intern(cap_names[i]);
+        }
+        snprintf(name, sizeof(name), "capability_index/%d", n_cap_names);
+        bench_run(name, NULL, op_capability_index);
+    }
+
+    capability_init();
+    char dir[] = "/tmp/yakiros-bench-XXXXXX";
+    if (write_parse_files(dir) < 0) {
+        perror("writing declarations");
+        return 1;
+    }
+    bench_run("parse_component", NULL, op_parse_component);
+    remove_parse_files(dir);
+
+    if (save && save_results(save) < 0) return 1;
+    if (check) {
+        int regressions = check_results();
+        if (regressions > 0) {
+            printf("%d benchmark(s) more than %.0f%% slower than %s\n", regressions, threshold, check);
+            return 1;
+        }
+        printf("resolver and validator within %.0f%% of %s\n", threshold, check);
+    }
+    return 0;
+}
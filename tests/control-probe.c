@@ -0,0 +1,129 @@
+/*
+ * control-probe.c - Control socket latency probe for the YakirOS load harness
+ *
+ * Sends one command at a time over the control socket, the way graphctl
+ * does, and times each from connect() to the resolver closing the
+ * connection. Unlike timing graphctl itself this leaves out fork, exec
+ * and the dynamic loader, so what is left is the resolver's own
+ * responsiveness while it supervises.
+ *
+ * Usage:
+ *   control-probe [-n count] [-i interval_ms] [-c command]
+ *
+ * Defaults: 1000 requests of "status", 10ms apart. Prints one line:
+ *   samples N failed N p50 US p90 US p99 US max US
+ *
+ * Build: cc -Isrc -o control-probe control-probe.c
+ */
+
+#define _GNU_SOURCE
+
+#include "../src/control.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static unsigned long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + (unsigned long long)ts.tv_nsec / 1000;
+}
+
+/* One request; its latency in microseconds, or -1 if it failed */
+static long long probe(const char *cmd) {
+    unsigned long long start = now_us();
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, CONTROL_SOCKET, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        write(fd, cmd, strlen(cmd)) != (ssize_t)strlen(cmd)) {
+        close(fd);
+        return -1;
+    }
+    shutdown(fd, SHUT_WR);
+
+    char buf[4096];
+    ssize_t n;
+    size_t total = 0;
+    while ((n = read(fd, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR)) {
+        if (n > 0) total += (size_t)n;
+    }
+    close(fd);
+    if (n < 0 || total == 0) return -1;
+
+    return (long long)(now_us() - start);
+}
+
+static int compare_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of sorted samples */
+static long long percentile(const long long *sorted, int n, int pct) {
+    int rank = (pct * n + 99) / 100;
+    if (rank < 1) rank = 1;
+    return sorted[rank - 1];
+}
+
+int main(int argc, char *argv[]) {
+    int count = 1000;
+    long interval_ms = 10;
+    const char *cmd = "status";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:i:c:")) != -1) {
+        switch (opt) {
+        case 'n': count = atoi(optarg); break;
+        case 'i': interval_ms = atol(optarg); break;
+        case 'c': cmd = optarg; break;
+        default:
+            fprintf(stderr, "Usage: %s [-n count] [-i interval_ms] [-c command]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (count <= 0 || interval_ms < 0) {
+        fprintf(stderr, "%s: count must be positive and interval not negative\n", argv[0]);
+        return 2;
+    }
+
+    long long *samples = malloc((size_t)count * sizeof(*samples));
+    if (!samples) {
+        perror("malloc");
+        return 1;
+    }
+
+    int n = 0, failed = 0;
+    for (int i = 0; i < count; i++) {
+        long long us = probe(cmd);
+        if (us < 0) failed++;
+        else samples[n++] = us;
+
+        if (interval_ms > 0) {
+            struct timespec ts = { .tv_sec = interval_ms / 1000,
+                                   .tv_nsec = (interval_ms % 1000) * 1000000L };
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    if (n == 0) {
+        printf("samples 0 failed %d p50 0 p90 0 p99 0 max 0\n", failed);
+        free(samples);
+        return 1;
+    }
+
+    qsort(samples, (size_t)n, sizeof(*samples), compare_ll);
+    printf("samples %d failed %d p50 %lld p90 %lld p99 %lld max %lld\n",
+           n, failed, percentile(samples, n, 50), percentile(samples, n, 90),
+           percentile(samples, n, 99), samples[n - 1]);
+    free(samples);
+    return 0;
+}
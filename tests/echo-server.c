@@ -5,16 +5,21 @@
  * 1. Listening on a TCP port and echoing data back to clients
  * 2. Handling SIGUSR1 by passing its listen socket over HANDOFF_FD
  * 3. Accepting an inherited listen socket via HANDOFF_FD on startup
+ * 4. Serving the socket graph-resolver bound for it ([sockets]), passed
+ *    as fd 3 with LISTEN_FDS
  *
  * Usage:
  *   echo-server <port>                # Normal startup
  *   HANDOFF_FD=4 echo-server <port>   # Hot-swap startup (inherits socket)
+ *   HANDOFF_FD=4 HANDOFF_STANDBY=1 echo-server <port>
+ *                                     # Standby, waits until promoted
  *
  * Build: cc -o echo-server echo-server.c ../src/handoff.c ../src/log.c
  */
 
 #define _GNU_SOURCE
 
+#include "../src/activation.h"
 #include "../src/handoff.h"
 #include "../src/log.h"
 #include <stdio.h>
@@ -88,7 +93,7 @@ int perform_handoff(void) {
     LOG_INFO("performing handoff: sending listen socket fd %d", listen_fd);
 
     /* Send the listen socket over the handoff channel */
-    if (send_fds(handoff_fd, &listen_fd, 1) != 0) {
+    if (handoff_send(handoff_fd, &listen_fd, 1) != 0) {
         LOG_ERR("failed to send listen socket during handoff");
         return -1;
     }
@@ -217,16 +222,38 @@ int main(int argc, char *argv[]) {
         LOG_INFO("hot-swap startup detected, HANDOFF_FD=%d", handoff_fd);
 
         /* Receive the listen socket from old process */
-        int received_fd;
-        int n_received = recv_fds(handoff_fd, &received_fd, 1);
-        if (n_received != 1) {
+        handoff_fd_t *received = NULL;
+        int n_received = handoff_recv(handoff_fd, 0, &received);
+        for (int i = 0; i < n_received; i++) {
+            /* Ours is the listening TCP socket; anything else is closed */
+            if (listen_fd < 0 && received[i].listening && received[i].type == SOCK_STREAM &&
+                received[i].family == AF_INET) {
+                listen_fd = received[i].fd;
+            } else {
+                close(received[i].fd);
+            }
+        }
+        free(received);
+
+        if (listen_fd >= 0) {
+            LOG_INFO("inherited listen socket fd %d from previous instance", listen_fd);
+        } else if (n_received >= 0 && getenv(HANDOFF_STANDBY_ENV)) {
+            /* A standby promoted without descriptors opens its own */
+            LOG_INFO("standby promoted without a listen socket");
+            listen_fd = create_listen_socket(server_port);
+            if (listen_fd < 0) {
+                return 1;
+            }
+        } else {
             LOG_ERR("failed to receive listen socket during hot-swap startup");
             return 1;
         }
 
-        listen_fd = received_fd;
-        LOG_INFO("inherited listen socket fd %d from previous instance", listen_fd);
-
+    } else if (getenv(LISTEN_FDS_ENV) && getenv(LISTEN_PID_ENV) &&
+               atoi(getenv(LISTEN_PID_ENV)) == getpid() && atoi(getenv(LISTEN_FDS_ENV)) >= 1) {
+        /* Socket activation - graph-resolver already listens for us */
+        listen_fd = LISTEN_FDS_START;
+        LOG_INFO("serving activation socket fd %d", listen_fd);
     } else {
         /* Normal startup - create listen socket */
         listen_fd = create_listen_socket(server_port);
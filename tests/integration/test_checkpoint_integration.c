@@ -41,7 +41,7 @@
 #define TEST_COMPONENTS_DIR "tests/data"
 
 /* Global test state */
-extern component_t components[MAX_COMPONENTS];
+extern component_t *components;
 extern int n_components;
 
 /* Connect to echo server and send test data */
@@ -252,7 +252,7 @@ TEST(three_level_fallback_no_criu) {
     create_test_component_config("none-fallback", HANDOFF_NONE);
 
     /* Initialize empty components array for testing */
-    memset(components, 0, sizeof(components));
+    memset(components, 0, (size_t)component_table_capacity() * sizeof(*components));
     n_components = 3;
 
     /* Parse components */
@@ -484,7 +484,7 @@ TEST(checkpoint_error_handling) {
     /* Test checkpoint operations with CRIU unavailable */
     if (criu_is_supported() != CHECKPOINT_SUCCESS) {
         /* Mock a component */
-        memset(components, 0, sizeof(components));
+        memset(components, 0, (size_t)component_table_capacity() * sizeof(*components));
         n_components = 1;
         strcpy(components[0].name, "test-component");
         components[0].state = COMP_ACTIVE;
@@ -546,6 +546,7 @@ TEST(checkpoint_concurrent_operations) {
 int main(void) {
     /* Initialize logging for tests */
     log_init("test-checkpoint-integration", 1);
+    component_table_reserve(16);
 
     RUN_TEST(criu_support_detection);
     RUN_TEST(checkpoint_storage_lifecycle);
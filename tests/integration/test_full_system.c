@@ -16,6 +16,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <sys/wait.h>
 #include <stdio.h>
 
 /* Test data directory */
@@ -271,14 +272,14 @@ TEST(readiness_protocol_file_based) {
     component_t *comp = &components[0];
     memset(comp, 0, sizeof(*comp));
     strcpy(comp->name, "file-ready-service");
-    strcpy(comp->binary, "/bin/true");
+    component_set_str(comp, &comp->binary, "/bin/true");
     comp->type = COMP_TYPE_SERVICE;
     comp->state = COMP_INACTIVE;
     comp->pid = -1;
     comp->readiness_method = READINESS_FILE;
-    strcpy(comp->readiness_file, "/tmp/integration_test_ready");
+    component_set_str(comp, &comp->readiness_file, "/tmp/integration_test_ready");
     comp->readiness_timeout = 10;
-    strcpy(comp->provides[0], "test-service");
+    component_set_str(comp, &comp->provides[0], "test-service");
     comp->n_provides = 1;
     n_components = 1;
 
@@ -319,15 +320,15 @@ TEST(readiness_protocol_command_based) {
     component_t *comp = &components[0];
     memset(comp, 0, sizeof(*comp));
     strcpy(comp->name, "cmd-ready-service");
-    strcpy(comp->binary, "/bin/true");
+    component_set_str(comp, &comp->binary, "/bin/true");
     comp->type = COMP_TYPE_SERVICE;
     comp->state = COMP_INACTIVE;
     comp->pid = -1;
     comp->readiness_method = READINESS_COMMAND;
-    strcpy(comp->readiness_check, "/bin/true");
+    component_set_str(comp, &comp->readiness_check, "/bin/true");
     comp->readiness_timeout = 10;
     comp->readiness_interval = 2;
-    strcpy(comp->provides[0], "cmd-service");
+    component_set_str(comp, &comp->provides[0], "cmd-service");
     comp->n_provides = 1;
     n_components = 1;
 
@@ -341,8 +342,13 @@ TEST(readiness_protocol_command_based) {
         comp->pid = 123;
         comp->ready_wait_start = time(NULL);
 
-        /* Check readiness - should succeed with /bin/true */
+        /* Check readiness - should succeed with /bin/true once reaped */
         check_all_readiness();
+        pid_t check_pid = comp->readiness_pid;
+        ASSERT_TRUE(check_pid > 0);
+        int status;
+        ASSERT_EQ(check_pid, waitpid(check_pid, &status, 0));
+        component_reap(check_pid, status);
         ASSERT_EQ(COMP_ACTIVE, comp->state);
         ASSERT_TRUE(capability_active("cmd-service"));
     }
@@ -357,15 +363,15 @@ TEST(readiness_protocol_timeout_handling) {
     component_t *comp = &components[0];
     memset(comp, 0, sizeof(*comp));
     strcpy(comp->name, "timeout-service");
-    strcpy(comp->binary, "/bin/true");
+    component_set_str(comp, &comp->binary, "/bin/true");
     comp->type = COMP_TYPE_SERVICE;
     comp->state = COMP_READY_WAIT;
     comp->pid = 123;
     comp->readiness_method = READINESS_FILE;
-    strcpy(comp->readiness_file, "/tmp/never_created_file");
+    component_set_str(comp, &comp->readiness_file, "/tmp/never_created_file");
     comp->readiness_timeout = 1;  /* Very short timeout */
     comp->ready_wait_start = time(NULL) - 5;  /* Started 5 seconds ago */
-    strcpy(comp->provides[0], "timeout-service");
+    component_set_str(comp, &comp->provides[0], "timeout-service");
     comp->n_provides = 1;
     n_components = 1;
 
@@ -378,6 +384,7 @@ TEST(readiness_protocol_timeout_handling) {
 int main(void) {
     /* Initialize logging */
     log_open();
+    component_table_reserve(256);
 
     return RUN_ALL_TESTS();
 }
\ No newline at end of file
@@ -0,0 +1,148 @@
+/*
+ * load-worker.c - Generated service for the YakirOS load harness
+ *
+ * Every component tests/vm/load-harness.sh generates runs one of these.
+ * A worker:
+ * 1. Records how long it took to come back if its last instance crashed
+ * 2. Waits ready_ms, then reports ready the way its component declares
+ *    (readiness_method none, notify or file)
+ * 3. Idles; once the churn file exists it crashes crash_per_min times a
+ *    minute on average, noting the moment it died
+ *
+ * The restart latency is from the crash, just before the kernel sends
+ * graph-resolver SIGCHLD, to the new instance running in main(), both on
+ * CLOCK_MONOTONIC. It includes the component's restart_delay_ms, which the
+ * generator sets to the 1ms minimum.
+ *
+ * Usage:
+ *   load-worker <name> <none|notify|file> <ready_ms> <crash_per_min>
+ *
+ * Build: cc -o load-worker load-worker.c
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define LOAD_DIR      "/run/yakiros-load"
+#define CHURN_FILE    LOAD_DIR "/churn"
+#define RESTARTS_FILE LOAD_DIR "/restarts"
+#define TICK_MS       100
+
+static char crash_path[256];
+static char ready_path[256];
+
+static unsigned long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + (unsigned long long)ts.tv_nsec / 1000;
+}
+
+static void sleep_ms(long ms) {
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L };
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+    }
+}
+
+/* Append one line with a single write(), so workers restarting at the
+ * same moment do not interleave */
+static void append_line(const char *path, const char *line) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) return;
+    (void)!write(fd, line, strlen(line));
+    close(fd);
+}
+
+/* If the last instance crashed, log how long the restart took */
+static void record_restart(const char *name) {
+    FILE *f = fopen(crash_path, "r");
+    if (!f) return;
+
+    unsigned long long crashed = 0;
+    int ok = fscanf(f, "%llu", &crashed) == 1;
+    fclose(f);
+    unlink(crash_path);
+
+    unsigned long long now = now_us();
+    if (!ok || crashed == 0 || crashed > now) return;
+
+    char line[160];
+    snprintf(line, sizeof(line), "%s %llu\n", name, now - crashed);
+    append_line(RESTARTS_FILE, line);
+}
+
+static void notify_ready(void) {
+    const char *path = getenv("NOTIFY_SOCKET");
+    if (!path || !*path) return;
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    (void)!sendto(fd, "READY=1", 7, 0, (struct sockaddr *)&addr, sizeof(addr));
+    close(fd);
+}
+
+static void report_ready(const char *mode) {
+    if (strcmp(mode, "notify") == 0) {
+        notify_ready();
+    } else if (strcmp(mode, "file") == 0) {
+        int fd = open(ready_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd >= 0) close(fd);
+    }
+}
+
+static void crash(void) {
+    char line[32];
+    snprintf(line, sizeof(line), "%llu\n", now_us());
+
+    /* The next instance must not find this one's readiness file */
+    unlink(ready_path);
+    int fd = open(crash_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        (void)!write(fd, line, strlen(line));
+        close(fd);
+    }
+    _exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 5) {
+        fprintf(stderr, "Usage: %s <name> <none|notify|file> <ready_ms> <crash_per_min>\n", argv[0]);
+        return 2;
+    }
+
+    const char *name = argv[1];
+    const char *mode = argv[2];
+    long ready_ms = atol(argv[3]);
+    double crash_per_min = atof(argv[4]);
+
+    mkdir(LOAD_DIR, 0755);
+    snprintf(crash_path, sizeof(crash_path), LOAD_DIR "/%s.crashed", name);
+    snprintf(ready_path, sizeof(ready_path), LOAD_DIR "/%s.ready", name);
+
+    record_restart(name);
+
+    if (ready_ms > 0) sleep_ms(ready_ms);
+    report_ready(mode);
+
+    /* Chance of crashing each tick, once churn has begun */
+    double per_tick = crash_per_min * TICK_MS / 60000.0;
+    srandom((unsigned)(now_us() ^ ((unsigned long long)getpid() << 16)));
+
+    for (;;) {
+        sleep_ms(TICK_MS);
+        if (per_tick <= 0 || access(CHURN_FILE, F_OK) != 0) continue;
+        if ((double)random() / RAND_MAX < per_tick) crash();
+    }
+}
@@ -190,6 +190,34 @@ if [ -x tests/unit/test_readiness_comprehensive ]; then
     tests/unit/test_readiness_comprehensive | grep -i "performance\|ms\|seconds" || true
 fi
 
+# Resolver and validator regression gate. Timings only compare on the
+# same machine, so the first run records the baseline the later ones are
+# held to; delete it after changing hardware.
+BENCH_BASELINE="${BENCH_BASELINE:-tests/bench/baseline.txt}"
+BENCH_THRESHOLD="${BENCH_THRESHOLD:-25}"
+
+if make tests/bench/bench_resolver >/dev/null 2>&1; then
+    ((TESTS_RUN++))
+    if [ -f "$BENCH_BASELINE" ]; then
+        log_info "Running resolver benchmarks against $BENCH_BASELINE (threshold ${BENCH_THRESHOLD}%)..."
+        if tests/bench/bench_resolver --check "$BENCH_BASELINE" --threshold "$BENCH_THRESHOLD"; then
+            ((TESTS_PASSED++))
+            log_success "Resolver benchmarks within ${BENCH_THRESHOLD}% of baseline"
+        else
+            ((TESTS_FAILED++))
+            log_error "Resolver or validator got slower than baseline"
+        fi
+    elif tests/bench/bench_resolver --save "$BENCH_BASELINE"; then
+        ((TESTS_PASSED++))
+        log_warning "No benchmark baseline yet; recorded $BENCH_BASELINE"
+    else
+        ((TESTS_FAILED++))
+        log_error "Resolver benchmarks failed"
+    fi
+else
+    log_warning "Resolver benchmarks failed to compile"
+fi
+
 # Test YakirOS binaries
 log_info "Phase 5: Binary Validation"
 echo ""
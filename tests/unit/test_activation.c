@@ -0,0 +1,174 @@
+/*
+ * test_activation.c - Tests for socket activation
+ *
+ * Sockets are bound on loopback ports chosen by the kernel and under
+ * /tmp; handing them over is checked by a spawned shell.
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/activation.h"
+#include "../../src/log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define ACTIVATION_TEST_SOCK "/tmp/yakiros_test_activation.sock"
+
+static int sock_opt(int fd, int opt) {
+    int value = -1;
+    socklen_t len = sizeof(value);
+    if (getsockopt(fd, SOL_SOCKET, opt, &value, &len) < 0) return -1;
+    return value;
+}
+
+TEST(sockets_from_specs) {
+    int tcp = activation_listen("tcp:127.0.0.1:0", 16);
+    ASSERT_TRUE(tcp >= 0);
+    ASSERT_EQ(SOCK_STREAM, sock_opt(tcp, SO_TYPE));
+    ASSERT_EQ(1, sock_opt(tcp, SO_ACCEPTCONN));
+    ASSERT_TRUE(fcntl(tcp, F_GETFD) & FD_CLOEXEC);
+    ASSERT_FALSE(fcntl(tcp, F_GETFL) & O_NONBLOCK);
+
+    /* Connections queue before anyone accepts them */
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    ASSERT_EQ(0, getsockname(tcp, (struct sockaddr *)&addr, &len));
+    ASSERT_EQ(AF_INET, addr.sin_family);
+    ASSERT_EQ(htonl(INADDR_LOOPBACK), addr.sin_addr.s_addr);
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_EQ(0, connect(client, (struct sockaddr *)&addr, len));
+    close(client);
+    activation_close("tcp:127.0.0.1:0", tcp);
+
+    int udp = activation_listen("udp:127.0.0.1:0", 0);
+    ASSERT_TRUE(udp >= 0);
+    ASSERT_EQ(SOCK_DGRAM, sock_opt(udp, SO_TYPE));
+    activation_close("udp:127.0.0.1:0", udp);
+
+    /* A socket left behind is replaced, and removed on close */
+    int un = activation_listen("unix:" ACTIVATION_TEST_SOCK, 0);
+    ASSERT_TRUE(un >= 0);
+    close(un);
+    un = activation_listen("unix:" ACTIVATION_TEST_SOCK, 0);
+    ASSERT_TRUE(un >= 0);
+    struct stat st;
+    ASSERT_EQ(0, stat(ACTIVATION_TEST_SOCK, &st));
+    ASSERT_TRUE(S_ISSOCK(st.st_mode));
+    activation_close("unix:" ACTIVATION_TEST_SOCK, un);
+    ASSERT_EQ(-1, stat(ACTIVATION_TEST_SOCK, &st));
+}
+
+TEST(bad_specs_are_rejected) {
+    const char *bad[] = {
+        "tcp:", "tcp:localhost:80", "tcp:127.0.0.1:99999", "tcp:[::1:80",
+        "sctp:80", "unix:relative.sock", "8080",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        errno = 0;
+        ASSERT_EQ(-1, activation_listen(bad[i], 0));
+        ASSERT_EQ(EINVAL, errno);
+    }
+
+    /* Something else on the path is left alone */
+    int fd = open(ACTIVATION_TEST_SOCK, O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+    ASSERT_TRUE(fd >= 0);
+    close(fd);
+    ASSERT_EQ(-1, activation_listen("unix:" ACTIVATION_TEST_SOCK, 0));
+    ASSERT_EQ(EADDRINUSE, errno);
+    ASSERT_EQ(0, unlink(ACTIVATION_TEST_SOCK));
+}
+
+TEST(connections_are_counted) {
+    int tcp = activation_listen("tcp:127.0.0.1:0", 0);
+    ASSERT_TRUE(tcp >= 0);
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    ASSERT_EQ(0, getsockname(tcp, (struct sockaddr *)&addr, &len));
+    char spec[64];
+    snprintf(spec, sizeof(spec), "tcp:127.0.0.1:%d", ntohs(addr.sin_port));
+
+    /* The listener itself is not a connection */
+    ASSERT_EQ(0, activation_connections(spec));
+    int client = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_EQ(0, connect(client, (struct sockaddr *)&addr, len));
+    int served = accept(tcp, NULL, NULL);
+    ASSERT_TRUE(served >= 0);
+    ASSERT_EQ(1, activation_connections(spec));
+    close(client);
+    close(served);
+    activation_close(spec, tcp);
+
+    int un = activation_listen("unix:" ACTIVATION_TEST_SOCK, 0);
+    ASSERT_TRUE(un >= 0);
+    ASSERT_EQ(0, activation_connections("unix:" ACTIVATION_TEST_SOCK));
+    struct sockaddr_un uaddr;
+    memset(&uaddr, 0, sizeof(uaddr));
+    uaddr.sun_family = AF_UNIX;
+    strcpy(uaddr.sun_path, ACTIVATION_TEST_SOCK);
+    client = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_EQ(0, connect(client, (struct sockaddr *)&uaddr, sizeof(uaddr)));
+    served = accept(un, NULL, NULL);
+    ASSERT_TRUE(served >= 0);
+    ASSERT_EQ(1, activation_connections("unix:" ACTIVATION_TEST_SOCK));
+    close(client);
+    close(served);
+    activation_close("unix:" ACTIVATION_TEST_SOCK, un);
+
+    /* Datagrams leave no trace to count */
+    ASSERT_EQ(-1, activation_connections("udp:127.0.0.1:514"));
+}
+
+TEST(sockets_are_installed_from_fd_3) {
+    /* Opened in reverse, so each lands where the other must go */
+    int fds[2];
+    fds[1] = activation_listen("tcp:127.0.0.1:0", 0);
+    fds[0] = activation_listen("udp:127.0.0.1:0", 0);
+    ASSERT_TRUE(fds[0] >= 0 && fds[1] >= 0);
+
+    unsigned long inodes[2];
+    for (int i = 0; i < 2; i++) {
+        struct stat st;
+        ASSERT_EQ(0, fstat(fds[i], &st));
+        inodes[i] = (unsigned long)st.st_ino;
+    }
+
+    /* The shell exits 0 if it got them as sd_listen_fds() expects */
+    char script[512];
+    snprintf(script, sizeof(script),
+             "[ \"$(stat -L -c %%i /proc/$$/fd/3)\" = %lu ] || exit 10; "
+             "[ \"$(stat -L -c %%i /proc/$$/fd/4)\" = %lu ] || exit 11; "
+             "[ \"$LISTEN_FDS\" = 2 ] || exit 30; "
+             "[ \"$LISTEN_PID\" = $$ ] || exit 31; "
+             "[ \"$LISTEN_FDNAMES\" = web:web ] || exit 32",
+             inodes[0], inodes[1]);
+    char *argv[] = { "/bin/sh", "-c", script, NULL };
+    spawn_t sp;
+    spawn_init(&sp, "web", "/bin/sh", argv);
+    ASSERT_EQ(0, activation_install(&sp, fds, 2, "web"));
+    pid_t pid = spawn_run(&sp);
+    ASSERT_TRUE(pid > 0);
+
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(0, WEXITSTATUS(status));
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+
+    return RUN_ALL_TESTS();
+}
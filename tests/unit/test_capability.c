@@ -6,6 +6,7 @@
 #include "../../src/capability.h"
 #include "../../src/log.h"
 #include <string.h>
+#include <stdio.h>
 
 TEST(capability_init_clears_registry) {
     /* Register a capability first */
@@ -175,6 +176,118 @@ TEST(capability_name_truncation) {
     ASSERT_NE(-1, idx);
 }
 
+TEST(capability_intern_stable_ids) {
+    capability_init();
+
+    int a = capability_intern("network");
+    int b = capability_intern("storage");
+    ASSERT_NE(-1, a);
+    ASSERT_NE(a, b);
+
+    /* Interning again returns the same ID and does not activate it */
+    ASSERT_EQ(a, capability_intern("network"));
+    ASSERT_EQ(2, capability_count());
+    ASSERT_FALSE(capability_active("network"));
+
+    /* Registering by name reuses the interned ID */
+    capability_register("network", 7);
+    ASSERT_EQ(a, capability_index("network"));
+    ASSERT_TRUE(capability_active_by_idx(a));
+    ASSERT_EQ(7, capability_provider(a));
+}
+
+TEST(capability_generation_changes_on_init) {
+    capability_init();
+    unsigned int gen = capability_generation();
+
+    capability_init();
+    ASSERT_NE(gen, capability_generation());
+}
+
+TEST(capability_hash_many_names) {
+    capability_init();
+
+    char name[32];
+    for (int i = 0; i < MAX_CAPABILITIES; i++) {
+        snprintf(name, sizeof(name), "cap.%d", i);
+        ASSERT_EQ(i, capability_intern(name));
+    }
+
+    /* Registry is full: new names are rejected, existing ones still found */
+    ASSERT_EQ(-1, capability_intern("one-too-many"));
+    for (int i = 0; i < MAX_CAPABILITIES; i++) {
+        snprintf(name, sizeof(name), "cap.%d", i);
+        ASSERT_EQ(i, capability_index(name));
+    }
+    ASSERT_EQ(-1, capability_index("one-too-many"));
+}
+
+TEST(capability_consumer_lists) {
+    capability_init();
+
+    int cap = capability_intern("database");
+    ASSERT_EQ(0, capability_add_consumer(cap, 3));
+    ASSERT_EQ(0, capability_add_consumer(cap, 9));
+    ASSERT_EQ(0, capability_add_consumer(cap, 3)); /* duplicate ignored */
+
+    int count = 0;
+    const int *consumers = capability_consumers(cap, &count);
+    ASSERT_EQ(2, count);
+    ASSERT_EQ(3, consumers[0]);
+    ASSERT_EQ(9, consumers[1]);
+
+    capability_remove_consumer(cap, 3);
+    consumers = capability_consumers(cap, &count);
+    ASSERT_EQ(1, count);
+    ASSERT_EQ(9, consumers[0]);
+
+    /* Unknown capability has no consumers */
+    capability_consumers(-1, &count);
+    ASSERT_EQ(0, count);
+}
+
+TEST(capability_on_demand_lists) {
+    capability_init();
+
+    int cap = capability_intern("cache");
+    ASSERT_EQ(0, capability_add_on_demand(cap, 4));
+    ASSERT_EQ(0, capability_add_on_demand(cap, 4)); /* duplicate ignored */
+    ASSERT_EQ(0, capability_add_on_demand(cap, 7));
+
+    int count = 0;
+    const int *providers = capability_on_demand(cap, &count);
+    ASSERT_EQ(2, count);
+    ASSERT_EQ(4, providers[0]);
+    ASSERT_EQ(7, providers[1]);
+
+    /* Kept apart from the consumers */
+    capability_consumers(cap, &count);
+    ASSERT_EQ(0, count);
+
+    capability_remove_on_demand(cap, 4);
+    providers = capability_on_demand(cap, &count);
+    ASSERT_EQ(1, count);
+    ASSERT_EQ(7, providers[0]);
+
+    capability_on_demand(-1, &count);
+    ASSERT_EQ(0, count);
+}
+
+TEST(capability_change_queue) {
+    capability_init();
+
+    int changed[8];
+    capability_register("net", 1);
+    capability_register("net", 2);   /* already active: no new change */
+    ASSERT_EQ(1, capability_take_changes(changed, 8));
+    ASSERT_EQ(capability_index("net"), changed[0]);
+
+    capability_withdraw("net");
+    capability_withdraw("net");      /* already down: no new change */
+    ASSERT_EQ(1, capability_take_changes(changed, 8));
+    ASSERT_EQ(0, capability_take_changes(changed, 8));
+}
+
 int main(void) {
     /* Initialize logging for tests */
     log_open();
@@ -0,0 +1,209 @@
+/*
+ * test_cgroup.c - Tests for cgroup handles and limit application
+ *
+ * A scratch directory with the control files pre-created stands in for
+ * a cgroup, so this runs without cgroup v2 or root.
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/cgroup.h"
+#include "../../src/log.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define CGROUP_TEST_DIR "/tmp/yakiros_cgroup_test"
+
+static const char *control_files[] = {
+    "memory.max", "memory.high", "cpu.weight", "cpu.max", "io.weight",
+    "pids.max", "cgroup.procs", "memory.events", "memory.oom.group", NULL
+};
+
+/* A fake cgroup: the directory, optionally with empty control files */
+static int fake_cgroup(int with_files) {
+    mkdir(CGROUP_TEST_DIR, 0755);
+    for (int i = 0; control_files[i]; i++) {
+        char path[256];
+        snprintf(path, sizeof(path), CGROUP_TEST_DIR "/%s", control_files[i]);
+        unlink(path);
+        if (with_files) close(open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    }
+    return open(CGROUP_TEST_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+static const char *read_control(const char *name) {
+    static char buf[64];
+    char path[256];
+    snprintf(path, sizeof(path), CGROUP_TEST_DIR "/%s", name);
+    FILE *f = fopen(path, "r");
+    buf[0] = '\0';
+    if (f) {
+        size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+        buf[n] = '\0';
+        fclose(f);
+    }
+    return buf;
+}
+
+TEST(apply_limits_writes_through_directory_fd) {
+    int fd = fake_cgroup(1);
+    ASSERT_TRUE(fd >= 0);
+
+    component_t comp;
+    memset(&comp, 0, sizeof(comp));
+    strcpy(comp.name, "limited");
+    strcpy(comp.memory_max, "64M");
+    strcpy(comp.cpu_max, "50000 100000");
+    comp.cpu_weight = 200;
+    comp.pids_max = 50;
+    comp.oom_group = 1;
+
+    ASSERT_EQ(0, cgroup_apply_limits(fd, &comp));
+    ASSERT_STR_EQ("67108864", read_control("memory.max"));
+    ASSERT_STR_EQ("50000 100000", read_control("cpu.max"));
+    ASSERT_STR_EQ("200", read_control("cpu.weight"));
+    ASSERT_STR_EQ("50", read_control("pids.max"));
+    ASSERT_STR_EQ("1", read_control("memory.oom.group"));
+
+    /* Unset limits are left alone */
+    ASSERT_STR_EQ("", read_control("memory.high"));
+    ASSERT_STR_EQ("", read_control("io.weight"));
+    cgroup_close(fd);
+}
+
+TEST(missing_control_file_fails) {
+    int fd = fake_cgroup(0);
+    ASSERT_TRUE(fd >= 0);
+
+    ASSERT_EQ(-1, cgroup_set_pids_max(fd, 10));
+    ASSERT_EQ(0, cgroup_set_pids_max(fd, 0));
+    ASSERT_EQ(-1, cgroup_set_oom_group(fd, 1));
+    ASSERT_EQ(0, cgroup_set_oom_group(fd, 0));
+    ASSERT_EQ(-1, cgroup_set_memory_max(fd, "12X"));
+    cgroup_close(fd);
+}
+
+TEST(fork_without_cgroup) {
+    pid_t pid = cgroup_fork(-1);
+    if (pid == 0) _exit(7);
+    ASSERT_TRUE(pid > 0);
+
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_EQ(7, WEXITSTATUS(status));
+}
+
+TEST(fork_attaches_child_where_clone3_cannot) {
+    /* Not a real cgroup, so the child ends up written to cgroup.procs */
+    int fd = fake_cgroup(1);
+    ASSERT_TRUE(fd >= 0);
+
+    pid_t pid = cgroup_fork(fd);
+    if (pid == 0) _exit(0);
+    ASSERT_TRUE(pid > 0);
+    waitpid(pid, NULL, 0);
+
+    char expect[16];
+    snprintf(expect, sizeof(expect), "%d", pid);
+    ASSERT_STR_EQ(expect, read_control("cgroup.procs"));
+    cgroup_close(fd);
+}
+
+static void write_events(long oom_kill) {
+    FILE *f = fopen(CGROUP_TEST_DIR "/memory.events", "w");
+    fprintf(f, "low 0\nhigh 4\nmax 3\noom 1\noom_kill %ld\n", oom_kill);
+    fclose(f);
+}
+
+static int oom_fd;
+static long oom_kills;
+static int oom_calls;
+
+static void record_oom(int cgroup_fd, long kills) {
+    oom_fd = cgroup_fd;
+    oom_kills = kills;
+    oom_calls++;
+}
+
+TEST(oom_events_counted) {
+    int fd = fake_cgroup(1);
+    ASSERT_TRUE(fd >= 0);
+    ASSERT_EQ(0, (int)cgroup_read_oom_kills(fd));
+
+    write_events(2);
+    ASSERT_EQ(2, (int)cgroup_read_oom_kills(fd));
+    cgroup_close(fd);
+
+    /* No memory controller: nothing to read */
+    fd = fake_cgroup(0);
+    ASSERT_EQ(-1, (int)cgroup_read_oom_kills(fd));
+    ASSERT_EQ(0, cgroup_setup_oom_monitor(fd));
+    cgroup_close(fd);
+}
+
+TEST(oom_scan_reports_each_kill_once) {
+    int fd = fake_cgroup(1);
+    write_events(7);
+    ASSERT_EQ(0, cgroup_setup_oom_monitor(fd));
+
+    /* Kills from before monitoring started are not news */
+    oom_calls = 0;
+    cgroup_oom_scan(record_oom);
+    ASSERT_EQ(0, oom_calls);
+
+    write_events(9);
+    cgroup_oom_scan(record_oom);
+    ASSERT_EQ(1, oom_calls);
+    ASSERT_EQ(fd, oom_fd);
+    ASSERT_EQ(2, (int)oom_kills);
+
+    cgroup_oom_scan(record_oom);
+    ASSERT_EQ(1, oom_calls);
+
+    cgroup_close(fd);
+    write_events(12);
+    cgroup_oom_scan(record_oom);
+    ASSERT_EQ(1, oom_calls);
+}
+
+TEST(oom_watch_wakes_epoll_on_change) {
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    ASSERT_TRUE(cgroup_oom_init(epoll_fd) >= 0);
+    ASSERT_TRUE(cgroup_oom_watching());
+
+    int fd = fake_cgroup(1);
+    write_events(1);
+    ASSERT_EQ(0, cgroup_setup_oom_monitor(fd));
+
+    /* Idle: nothing to wake up for */
+    struct epoll_event ev;
+    ASSERT_EQ(0, epoll_wait(epoll_fd, &ev, 1, 0));
+
+    write_events(4);
+    ASSERT_EQ(1, epoll_wait(epoll_fd, &ev, 1, 100));
+    oom_calls = 0;
+    cgroup_oom_dispatch(record_oom);
+    ASSERT_EQ(1, oom_calls);
+    ASSERT_EQ(3, (int)oom_kills);
+    ASSERT_EQ(0, epoll_wait(epoll_fd, &ev, 1, 0));
+
+    cgroup_close(fd);
+    close(epoll_fd);
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+
+    int result = RUN_ALL_TESTS();
+
+    fake_cgroup(0);
+    rmdir(CGROUP_TEST_DIR);
+    return result;
+}
@@ -222,6 +222,99 @@ TEST(checkpoint_metadata_invalid_args) {
     ASSERT_NE(result, 0);
 }
 
+/* Test the pre-dump parent chain survives save and load */
+TEST(checkpoint_metadata_parent_chain) {
+    char tmpdir[] = "/tmp/checkpoint_chain_test_XXXXXX";
+    ASSERT_TRUE(mkdtemp(tmpdir) != NULL);
+
+    checkpoint_metadata_t metadata;
+    memset(&metadata, 0, sizeof(metadata));
+    strcpy(metadata.component_name, "big-service");
+    checkpoint_metadata_set_chain(&metadata, 3);
+    ASSERT_EQ(metadata.pre_dump_passes, 3);
+    ASSERT_STR_EQ(metadata.parent_chain, "pre-3,pre-2,pre-1");
+
+    ASSERT_EQ(checkpoint_save_metadata(tmpdir, &metadata), 0);
+    checkpoint_metadata_t loaded;
+    ASSERT_EQ(checkpoint_load_metadata(tmpdir, &loaded), 0);
+    ASSERT_EQ(loaded.pre_dump_passes, 3);
+    ASSERT_STR_EQ(loaded.parent_chain, "pre-3,pre-2,pre-1");
+
+    /* A full dump has no parents */
+    checkpoint_metadata_set_chain(&metadata, 0);
+    ASSERT_EQ(metadata.pre_dump_passes, 0);
+    ASSERT_STR_EQ(metadata.parent_chain, "");
+
+    char metadata_file[512];
+    snprintf(metadata_file, sizeof(metadata_file), "%s/metadata.json", tmpdir);
+    unlink(metadata_file);
+    rmdir(tmpdir);
+}
+
+/* Test when iterative checkpoints stop pre-dumping */
+TEST(checkpoint_pre_dump_convergence) {
+    size_t mb = 1024 * 1024;
+
+    /* Large first pass: go again */
+    ASSERT_EQ(checkpoint_pre_dump_again(1, 3, 0, 200 * mb), 1);
+    /* Shrinking well: go again */
+    ASSERT_EQ(checkpoint_pre_dump_again(2, 3, 200 * mb, 40 * mb), 1);
+    /* Dirtied as fast as it is copied: stop */
+    ASSERT_EQ(checkpoint_pre_dump_again(2, 3, 40 * mb, 35 * mb), 0);
+    /* Small enough to dump straight away */
+    ASSERT_EQ(checkpoint_pre_dump_again(1, 3, 0, CHECKPOINT_PRE_DUMP_SETTLED), 0);
+    /* Out of passes */
+    ASSERT_EQ(checkpoint_pre_dump_again(3, 3, 200 * mb, 40 * mb), 0);
+
+    char name[32];
+    checkpoint_pre_dump_dir(2, name, sizeof(name));
+    ASSERT_STR_EQ(name, "pre-2");
+}
+
+/* Test only page images count toward a pass's dirty set */
+TEST(checkpoint_pages_size) {
+    char tmpdir[] = "/tmp/checkpoint_pages_test_XXXXXX";
+    ASSERT_TRUE(mkdtemp(tmpdir) != NULL);
+
+    const char *files[] = { "pages-1.img", "pages-2.img", "pagemap-1.img" };
+    for (int i = 0; i < 3; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", tmpdir, files[i]);
+        FILE *fp = fopen(path, "w");
+        ASSERT_TRUE(fp != NULL);
+        fprintf(fp, "%*s", 100, "");
+        fclose(fp);
+    }
+
+    ASSERT_EQ((int)checkpoint_pages_size(tmpdir), 200);
+    ASSERT_EQ((int)checkpoint_pages_size("/nonexistent/checkpoint"), 0);
+
+    for (int i = 0; i < 3; i++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", tmpdir, files[i]);
+        unlink(path);
+    }
+    rmdir(tmpdir);
+}
+
+/* Test iterative checkpoint argument validation */
+TEST(criu_checkpoint_iterative_invalid_args) {
+    int passes = -1;
+    ASSERT_NE(criu_checkpoint_iterative(0, "/tmp/test", 1, 3, &passes), CHECKPOINT_SUCCESS);
+    ASSERT_EQ(passes, 0);
+    ASSERT_NE(criu_checkpoint_iterative(getpid(), NULL, 1, 3, &passes), CHECKPOINT_SUCCESS);
+}
+
+/* Test lazy restore argument validation */
+TEST(criu_lazy_restore_invalid_args) {
+    ASSERT_TRUE(criu_lazy_pages_start(NULL, NULL, 0) < 0);
+    ASSERT_TRUE(criu_restore_lazy(NULL) < 0);
+    ASSERT_TRUE(criu_restore_lazy("/nonexistent/checkpoint") < 0);
+    ASSERT_TRUE(criu_page_server_start(NULL, CHECKPOINT_PAGE_SERVER_PORT) < 0);
+    ASSERT_TRUE(criu_page_server_start("/tmp", 0) < 0);
+    ASSERT_TRUE(criu_page_server_start("/tmp", 70000) < 0);
+}
+
 /* Test checkpoint listing with no checkpoints */
 TEST(checkpoint_list_checkpoints_empty) {
     checkpoint_entry_t *head = NULL;
@@ -0,0 +1,206 @@
+/*
+ * test_checkpoint_catalog.c - Tests for the checkpoint catalog
+ *
+ * Checkpoints of a made-up component are created in temporary storage
+ * (/run/graph/checkpoints) with hand-written images and metadata.
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/checkpoint-catalog.h"
+#include "../../src/checkpoint-mgmt.h"
+#include "../../src/log.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define CATALOG_TEST_COMPONENT "test-catalog"
+#define CATALOG_TEST_DIR CHECKPOINT_RUN_DIR "/" CATALOG_TEST_COMPONENT
+#define CATALOG_TEST_FILE CHECKPOINT_RUN_DIR "/" CHECKPOINT_CATALOG_FILE
+
+static void make_checkpoint(const char *id, time_t timestamp) {
+    char path[512];
+    snprintf(path, sizeof(path), CATALOG_TEST_DIR "/%s", id);
+    ASSERT_EQ(0, mkdir(path, 0755));
+
+    char image[600];
+    snprintf(image, sizeof(image), "%s/core-1.img", path);
+    FILE *fp = fopen(image, "w");
+    ASSERT_TRUE(fp != NULL);
+    fprintf(fp, "mock checkpoint data for %s", id);
+    fclose(fp);
+
+    checkpoint_metadata_t metadata;
+    memset(&metadata, 0, sizeof(metadata));
+    strcpy(metadata.component_name, CATALOG_TEST_COMPONENT);
+    metadata.timestamp = timestamp;
+    metadata.original_pid = (pid_t)timestamp;
+    strcpy(metadata.capabilities, "catalog.test");
+    ASSERT_EQ(0, checkpoint_save_metadata(path, &metadata));
+}
+
+static void reset_storage(void) {
+    int removed = system("rm -rf " CATALOG_TEST_DIR);
+    (void)removed;
+    ASSERT_EQ(0, checkpoint_init_storage());
+    ASSERT_EQ(0, mkdir(CATALOG_TEST_DIR, 0755));
+    ASSERT_TRUE(checkpoint_catalog_rebuild(0) >= 0);
+}
+
+static off_t file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+TEST(listing_comes_from_the_catalog) {
+    reset_storage();
+    make_checkpoint("200", 200);
+    make_checkpoint("300", 300);
+    make_checkpoint("100", 100);
+
+    /* Metadata files are not read again */
+    ASSERT_EQ(0, unlink(CATALOG_TEST_DIR "/300/metadata.json"));
+
+    checkpoint_entry_t *head = NULL;
+    ASSERT_EQ(3, checkpoint_list_checkpoints(CATALOG_TEST_COMPONENT, 0, &head));
+    ASSERT_STR_EQ("300", head->id);
+    ASSERT_STR_EQ(CATALOG_TEST_DIR "/300", head->path);
+    ASSERT_EQ(300, (int)head->metadata.original_pid);
+    ASSERT_STR_EQ("catalog.test", head->metadata.capabilities);
+    ASSERT_TRUE(head->size > 0);
+    ASSERT_STR_EQ("200", head->next->id);
+    ASSERT_STR_EQ("100", head->next->next->id);
+    ASSERT_TRUE(head->next->next->next == NULL);
+    checkpoint_free_list(head);
+
+    char id[CHECKPOINT_ID_MAX_LEN], path[MAX_CHECKPOINT_PATH];
+    ASSERT_EQ(0, checkpoint_find_latest(CATALOG_TEST_COMPONENT, 0, id, sizeof(id),
+                                        path, sizeof(path)));
+    ASSERT_STR_EQ("300", id);
+
+    checkpoint_quota_t quota;
+    ASSERT_EQ(0, checkpoint_storage_usage(CATALOG_TEST_COMPONENT, 0, &quota));
+    ASSERT_EQ(3, quota.current_count);
+    ASSERT_TRUE(quota.used_bytes > 0);
+
+    /* Removal goes through the catalog too */
+    ASSERT_EQ(0, checkpoint_remove(CATALOG_TEST_COMPONENT, "300", 0));
+    ASSERT_EQ(0, checkpoint_find_latest(CATALOG_TEST_COMPONENT, 0, id, sizeof(id),
+                                        path, sizeof(path)));
+    ASSERT_STR_EQ("200", id);
+
+    /* A directory removed behind its back is dropped on lookup */
+    int removed = system("rm -rf " CATALOG_TEST_DIR "/200");
+    (void)removed;
+    ASSERT_EQ(0, checkpoint_find_latest(CATALOG_TEST_COMPONENT, 0, id, sizeof(id),
+                                        path, sizeof(path)));
+    ASSERT_STR_EQ("100", id);
+    ASSERT_EQ(1, checkpoint_list_checkpoints(CATALOG_TEST_COMPONENT, 0, &head));
+    checkpoint_free_list(head);
+
+    ASSERT_EQ(1, checkpoint_cleanup(CATALOG_TEST_COMPONENT, 0, 1, 0));
+    ASSERT_EQ(0, checkpoint_list_checkpoints(CATALOG_TEST_COMPONENT, 0, &head));
+    ASSERT_TRUE(head == NULL);
+}
+
+TEST(missing_or_damaged_catalog_is_rebuilt) {
+    reset_storage();
+    make_checkpoint("100", 100);
+    make_checkpoint("200", 200);
+
+    checkpoint_entry_t *head = NULL;
+    ASSERT_EQ(0, unlink(CATALOG_TEST_FILE));
+    ASSERT_EQ(2, checkpoint_list_checkpoints(CATALOG_TEST_COMPONENT, 0, &head));
+    ASSERT_STR_EQ("200", head->id);
+    ASSERT_EQ(200, (int)head->metadata.original_pid);
+    checkpoint_free_list(head);
+    ASSERT_TRUE(file_size(CATALOG_TEST_FILE) > 0);
+
+    /* A torn record at the end */
+    int fd = open(CATALOG_TEST_FILE, O_WRONLY | O_APPEND);
+    ASSERT_TRUE(fd >= 0);
+    ASSERT_EQ(5, (int)write(fd, "torn!", 5));
+    close(fd);
+    make_checkpoint("300", 300);
+    ASSERT_EQ(3, checkpoint_list_checkpoints(CATALOG_TEST_COMPONENT, 0, &head));
+    ASSERT_STR_EQ("300", head->id);
+    checkpoint_free_list(head);
+
+    /* A flipped byte in a record, in a catalog put in place by someone else */
+    ASSERT_EQ(0, system("cp " CATALOG_TEST_FILE " " CATALOG_TEST_FILE ".copy"));
+    fd = open(CATALOG_TEST_FILE ".copy", O_RDWR);
+    ASSERT_TRUE(fd >= 0);
+    unsigned char b = 0;
+    off_t at = file_size(CATALOG_TEST_FILE) - 100;
+    ASSERT_EQ(1, (int)pread(fd, &b, 1, at));
+    b ^= 0xff;
+    ASSERT_EQ(1, (int)pwrite(fd, &b, 1, at));
+    close(fd);
+    ASSERT_EQ(0, rename(CATALOG_TEST_FILE ".copy", CATALOG_TEST_FILE));
+    ASSERT_EQ(0, checkpoint_catalog_drop(0, CATALOG_TEST_COMPONENT, "none"));
+    ASSERT_EQ(3, checkpoint_list_checkpoints(CATALOG_TEST_COMPONENT, 0, &head));
+    checkpoint_free_list(head);
+}
+
+TEST(dropped_records_are_compacted) {
+    reset_storage();
+    make_checkpoint("100", 100);
+    off_t base = file_size(CATALOG_TEST_FILE);
+    ASSERT_TRUE(base > 0);
+
+    checkpoint_catalog_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    strcpy(entry.component, CATALOG_TEST_COMPONENT);
+    strcpy(entry.id, "999");
+    strcpy(entry.metadata.component_name, CATALOG_TEST_COMPONENT);
+    for (int i = 0; i < 500; i++) {
+        entry.metadata.timestamp = 1000 + i;
+        ASSERT_EQ(0, checkpoint_catalog_put(0, &entry));
+        ASSERT_EQ(0, checkpoint_catalog_drop(0, CATALOG_TEST_COMPONENT, "999"));
+    }
+    ASSERT_TRUE(file_size(CATALOG_TEST_FILE) < 50 * base);
+
+    const checkpoint_catalog_entry_t *first = NULL;
+    ASSERT_EQ(1, checkpoint_catalog_find(0, CATALOG_TEST_COMPONENT, &first));
+    ASSERT_STR_EQ("100", first->id);
+
+    /* Other components are kept apart */
+    strcpy(entry.component, CATALOG_TEST_COMPONENT "-other");
+    ASSERT_EQ(0, checkpoint_catalog_put(0, &entry));
+    ASSERT_EQ(1, checkpoint_catalog_find(0, CATALOG_TEST_COMPONENT, &first));
+    ASSERT_EQ(1, checkpoint_catalog_find(0, CATALOG_TEST_COMPONENT "-other", &first));
+    ASSERT_EQ(0, checkpoint_catalog_drop(0, CATALOG_TEST_COMPONENT "-other", "999"));
+}
+
+TEST(paths_outside_storage_are_not_catalogued) {
+    char component[128], id[MAX_CHECKPOINT_ID];
+    int persistent = -1;
+
+    ASSERT_EQ(0, checkpoint_catalog_locate(CHECKPOINT_VAR_DIR "/sshd/1700000000", &persistent,
+                                           component, sizeof(component), id, sizeof(id)));
+    ASSERT_EQ(1, persistent);
+    ASSERT_STR_EQ("sshd", component);
+    ASSERT_STR_EQ("1700000000", id);
+
+    ASSERT_EQ(-1, checkpoint_catalog_locate("/tmp/sshd/1700000000", &persistent,
+                                            component, sizeof(component), id, sizeof(id)));
+    ASSERT_EQ(-1, checkpoint_catalog_locate(CHECKPOINT_RUN_DIR "/sshd", &persistent,
+                                            component, sizeof(component), id, sizeof(id)));
+    ASSERT_EQ(-1, checkpoint_catalog_locate(CHECKPOINT_RUN_DIR "/sshd/1/pre-1", &persistent,
+                                            component, sizeof(component), id, sizeof(id)));
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+
+    int result = RUN_ALL_TESTS();
+
+    int removed = system("rm -rf " CATALOG_TEST_DIR);
+    (void)removed;
+    checkpoint_catalog_rebuild(0);
+    return result;
+}
@@ -0,0 +1,224 @@
+/*
+ * test_checkpoint_store.c - Tests for the checkpoint chunk store
+ *
+ * Scratch checkpoint directories with made-up page images are packed into
+ * a store under /tmp.
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/checkpoint-store.h"
+#include "../../src/checkpoint-mgmt.h"
+#include "../../src/log.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define STORE_TEST_DIR "/tmp/yakiros_store_test"
+#define STORE_TEST_CHUNKS STORE_TEST_DIR "/chunks"
+
+/* Pages that are mostly zero with a pattern every 4KB, like a real heap */
+static unsigned char *make_pages(size_t len, unsigned seed) {
+    unsigned char *p = calloc(1, len);
+    for (size_t off = 0; off < len; off += 4096) {
+        for (int i = 0; i < 64; i++) {
+            p[off + i] = (unsigned char)(seed + off / 4096 + i);
+        }
+    }
+    return p;
+}
+
+static void write_file(const char *path, const unsigned char *data, size_t len) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ssize_t n = write(fd, data, len);
+    (void)n;
+    close(fd);
+}
+
+static unsigned char *read_file(const char *path, size_t *len) {
+    struct stat st;
+    if (stat(path, &st) != 0) return NULL;
+    unsigned char *p = malloc((size_t)st.st_size + 1);
+    int fd = open(path, O_RDONLY);
+    ssize_t n = read(fd, p, (size_t)st.st_size);
+    close(fd);
+    *len = n > 0 ? (size_t)n : 0;
+    return p;
+}
+
+static void make_checkpoint(const char *dir, const unsigned char *pages, size_t len) {
+    char path[512];
+    mkdir(STORE_TEST_DIR, 0755);
+    mkdir(dir, 0755);
+    snprintf(path, sizeof(path), "%s/pages-1.img", dir);
+    write_file(path, pages, len);
+    snprintf(path, sizeof(path), "%s/core-1.img", dir);
+    write_file(path, (const unsigned char *)"core", 4);
+}
+
+static int exists(const char *dir, const char *name) {
+    char path[512];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    return lstat(path, &st) == 0;
+}
+
+/* Flip the last byte of every chunk in the store */
+static int corrupt_chunks(void) {
+    int found = -1;
+    DIR *top = opendir(STORE_TEST_CHUNKS);
+    struct dirent *d;
+    while (top && (d = readdir(top)) != NULL) {
+        if (d->d_name[0] == '.') continue;
+        char sub[512];
+        snprintf(sub, sizeof(sub), STORE_TEST_CHUNKS "/%s", d->d_name);
+        DIR *dir = opendir(sub);
+        struct dirent *c;
+        while (dir && (c = readdir(dir)) != NULL) {
+            if (c->d_name[0] == '.') continue;
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/%s", sub, c->d_name);
+            int fd = open(path, O_RDWR);
+            off_t end = lseek(fd, -1, SEEK_END);
+            unsigned char b = 0;
+            if (end > 0 && pread(fd, &b, 1, end) == 1) {
+                b ^= 0xff;
+                if (pwrite(fd, &b, 1, end) == 1) found = 0;
+            }
+            close(fd);
+        }
+        if (dir) closedir(dir);
+    }
+    if (top) closedir(top);
+    return found;
+}
+
+TEST(compression_round_trip) {
+    size_t len = CHECKPOINT_CHUNK_SIZE;
+    unsigned char *pages = make_pages(len, 7);
+    unsigned char *packed = malloc(len);
+    unsigned char *back = malloc(len);
+
+    size_t n = checkpoint_compress(pages, len, packed, len - 1);
+    ASSERT_TRUE(n > 0);
+    ASSERT_TRUE(n < len / 8);
+    ASSERT_EQ((int)len, (int)checkpoint_decompress(packed, n, back, len));
+    ASSERT_EQ(0, memcmp(pages, back, len));
+
+    /* Corrupt blocks are refused rather than overrunning */
+    ASSERT_EQ(0, (int)checkpoint_decompress(packed, n, back, len / 2));
+    packed[1] ^= 0xff;
+    packed[2] ^= 0xff;
+    size_t bad = checkpoint_decompress(packed, n, back, len);
+    ASSERT_TRUE(bad == 0 || memcmp(pages, back, len) != 0);
+
+    /* Random bytes do not fit in less */
+    for (size_t i = 0; i < len; i++) pages[i] = (unsigned char)rand();
+    ASSERT_EQ(0, (int)checkpoint_compress(pages, len, packed, len - 1));
+
+    free(pages);
+    free(packed);
+    free(back);
+}
+
+TEST(repeated_checkpoints_share_chunks) {
+    size_t len = 4 * CHECKPOINT_CHUNK_SIZE;
+    unsigned char *pages = make_pages(len, 1);
+    checkpoint_store_stats_t stats;
+
+    make_checkpoint(STORE_TEST_DIR "/one", pages, len);
+    ASSERT_EQ(1, checkpoint_store_pack(STORE_TEST_DIR "/one"));
+    ASSERT_FALSE(exists(STORE_TEST_DIR "/one", "pages-1.img"));
+    ASSERT_TRUE(exists(STORE_TEST_DIR "/one", "pages-1.img" CHECKPOINT_RECIPE_SUFFIX));
+    ASSERT_TRUE(exists(STORE_TEST_DIR "/one", "core-1.img"));
+    ASSERT_TRUE(checkpoint_store_is_packed(STORE_TEST_DIR "/one"));
+    ASSERT_EQ(0, checkpoint_store_stats(&stats));
+    ASSERT_EQ(4, stats.chunks);
+    ASSERT_TRUE(stats.stored_bytes < len / 8);
+
+    /* The next checkpoint changed one chunk */
+    pages[2 * CHECKPOINT_CHUNK_SIZE + 100] ^= 0x55;
+    make_checkpoint(STORE_TEST_DIR "/two", pages, len);
+    ASSERT_EQ(1, checkpoint_store_pack(STORE_TEST_DIR "/two"));
+    ASSERT_EQ(0, checkpoint_store_stats(&stats));
+    ASSERT_EQ(5, stats.chunks);
+    ASSERT_EQ((int)(2 * len), (int)stats.referenced_bytes);
+
+    /* Shares add up to the store */
+    size_t shares = checkpoint_store_share(STORE_TEST_DIR "/one") +
+                    checkpoint_store_share(STORE_TEST_DIR "/two");
+    ASSERT_TRUE(shares <= stats.stored_bytes && shares + 8 >= stats.stored_bytes);
+
+    /* Removing one keeps what the other still refers to */
+    ASSERT_EQ(0, checkpoint_remove_directory(STORE_TEST_DIR "/one"));
+    ASSERT_EQ(0, checkpoint_store_stats(&stats));
+    ASSERT_EQ(4, stats.chunks);
+
+    ASSERT_EQ(0, checkpoint_remove_directory(STORE_TEST_DIR "/two"));
+    ASSERT_EQ(0, checkpoint_store_stats(&stats));
+    ASSERT_EQ(0, stats.chunks);
+    free(pages);
+}
+
+TEST(copies_unpack_to_the_original_images) {
+    size_t len = 3 * CHECKPOINT_CHUNK_SIZE + 1234;
+    unsigned char *pages = make_pages(len, 9);
+
+    make_checkpoint(STORE_TEST_DIR "/raw", pages, len);
+    mkdir(STORE_TEST_DIR "/raw/pre-1", 0755);
+    write_file(STORE_TEST_DIR "/raw/pre-1/pages-1.img", pages, CHECKPOINT_CHUNK_SIZE);
+    ASSERT_EQ(0, symlink("pre-1", STORE_TEST_DIR "/raw/parent"));
+
+    ASSERT_EQ(0, checkpoint_store_copy(STORE_TEST_DIR "/raw", STORE_TEST_DIR "/packed"));
+    ASSERT_TRUE(checkpoint_store_is_packed(STORE_TEST_DIR "/packed"));
+    ASSERT_TRUE(exists(STORE_TEST_DIR "/packed/pre-1", "pages-1.img" CHECKPOINT_RECIPE_SUFFIX));
+
+    /* A copy of a packed checkpoint holds its own references */
+    ASSERT_EQ(0, checkpoint_store_copy(STORE_TEST_DIR "/packed", STORE_TEST_DIR "/again"));
+    ASSERT_EQ(0, checkpoint_remove_directory(STORE_TEST_DIR "/packed"));
+
+    ASSERT_EQ(0, checkpoint_store_unpack(STORE_TEST_DIR "/again", STORE_TEST_DIR "/back"));
+    ASSERT_FALSE(checkpoint_store_is_packed(STORE_TEST_DIR "/back"));
+
+    size_t n = 0;
+    unsigned char *back = read_file(STORE_TEST_DIR "/back/pages-1.img", &n);
+    ASSERT_TRUE(back != NULL);
+    ASSERT_EQ((int)len, (int)n);
+    ASSERT_EQ(0, memcmp(pages, back, len));
+    free(back);
+
+    char target[64] = {0};
+    ASSERT_EQ(5, (int)readlink(STORE_TEST_DIR "/back/parent", target, sizeof(target) - 1));
+    ASSERT_STR_EQ("pre-1", target);
+
+    /* A damaged chunk is caught on the way back */
+    ASSERT_EQ(0, checkpoint_remove_directory(STORE_TEST_DIR "/back"));
+    ASSERT_EQ(0, corrupt_chunks());
+    ASSERT_NE(0, checkpoint_store_unpack(STORE_TEST_DIR "/again", STORE_TEST_DIR "/back"));
+    ASSERT_FALSE(exists(STORE_TEST_DIR, "back"));
+    ASSERT_EQ(0, checkpoint_store_unpack(STORE_TEST_DIR "/raw", STORE_TEST_DIR "/back"));
+
+    checkpoint_store_stats_t stats;
+    ASSERT_EQ(0, checkpoint_remove_directory(STORE_TEST_DIR "/raw"));
+    ASSERT_EQ(0, checkpoint_remove_directory(STORE_TEST_DIR "/again"));
+    ASSERT_EQ(0, checkpoint_remove_directory(STORE_TEST_DIR "/back"));
+    ASSERT_EQ(0, checkpoint_store_stats(&stats));
+    ASSERT_EQ(0, stats.chunks);
+    free(pages);
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+    checkpoint_store_set_root(STORE_TEST_CHUNKS);
+
+    int result = RUN_ALL_TESTS();
+
+    int removed = system("rm -rf " STORE_TEST_DIR);
+    (void)removed;
+    return result;
+}
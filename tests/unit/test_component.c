@@ -5,18 +5,31 @@
  * to enable userspace testing without requiring root privileges.
  */
 
+#define _GNU_SOURCE
 #include "../test_framework.h"
 #include "../../src/component.h"
 #include "../../src/capability.h"
+#include "../../src/graph.h"
 #include "../../src/log.h"
+#include "../../src/notify.h"
+#include "../../src/supervise.h"
+#include "../../src/handoff.h"
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/wait.h>
+#include <signal.h>
 #include <time.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
 
 /* Create test component directory path */
-#define TEST_COMPONENT_DIR "../data"
+#define TEST_COMPONENT_DIR "tests/data"
 
 /* Helper to create a mock component for testing */
 static void create_mock_component(int idx, const char *name, const char *binary, comp_type_t type) {
@@ -24,16 +37,16 @@ static void create_mock_component(int idx, const char *name, const char *binary,
     memset(comp, 0, sizeof(*comp));
 
     strncpy(comp->name, name, MAX_NAME - 1);
-    strncpy(comp->binary, binary, MAX_PATH - 1);
+    component_set_str(comp, &comp->binary, binary);
     comp->type = type;
     comp->state = COMP_INACTIVE;
     comp->pid = -1;
 
     /* Add some mock dependencies */
     if (strcmp(name, "test-service") == 0) {
-        strncpy(comp->requires[0], "network", MAX_NAME - 1);
+        component_set_str(comp, &comp->requires[0], "network");
         comp->n_requires = 1;
-        strncpy(comp->provides[0], "test-api", MAX_NAME - 1);
+        component_set_str(comp, &comp->provides[0], "test-api");
         comp->n_provides = 1;
     }
 }
@@ -83,14 +96,14 @@ TEST(requirements_met_multiple_dependencies) {
     component_t *comp = &components[0];
     memset(comp, 0, sizeof(*comp));
     strncpy(comp->name, "complex-service", MAX_NAME - 1);
-    strncpy(comp->binary, "/bin/true", MAX_PATH - 1);
+    component_set_str(comp, &comp->binary, "/bin/true");
     comp->type = COMP_TYPE_SERVICE;
     comp->state = COMP_INACTIVE;
     comp->pid = -1;
 
-    strncpy(comp->requires[0], "network", MAX_NAME - 1);
-    strncpy(comp->requires[1], "filesystem", MAX_NAME - 1);
-    strncpy(comp->requires[2], "database", MAX_NAME - 1);
+    component_set_str(comp, &comp->requires[0], "network");
+    component_set_str(comp, &comp->requires[1], "filesystem");
+    component_set_str(comp, &comp->requires[2], "database");
     comp->n_requires = 3;
     n_components = 1;
 
@@ -131,6 +144,8 @@ TEST(component_exited_oneshot_success) {
     create_mock_component(0, "init-task", "/bin/true", COMP_TYPE_ONESHOT);
     components[0].state = COMP_STARTING;
     components[0].pid = 123;
+    component_set_str(&components[0], &components[0].provides[0], "test-api");
+    components[0].n_provides = 1;
     n_components = 1;
 
     /* Simulate successful exit (status 0) */
@@ -151,10 +166,12 @@ TEST(component_exited_oneshot_failure) {
     create_mock_component(0, "failing-task", "/bin/false", COMP_TYPE_ONESHOT);
     components[0].state = COMP_STARTING;
     components[0].pid = 124;
+    component_set_str(&components[0], &components[0].provides[0], "test-api");
+    components[0].n_provides = 1;
     n_components = 1;
 
     /* Simulate failed exit (status 1) */
-    int status = WEXITSTATUS(1) << 8; /* exit code 1 */
+    int status = 1 << 8; /* exit code 1 */
     component_exited(0, status);
 
     /* Should be marked as failed */
@@ -171,13 +188,15 @@ TEST(component_exited_service_crash) {
     create_mock_component(0, "test-daemon", "/usr/bin/daemon", COMP_TYPE_SERVICE);
     components[0].state = COMP_ACTIVE;
     components[0].pid = 125;
+    component_set_str(&components[0], &components[0].provides[0], "test-api");
+    components[0].n_provides = 1;
     capability_register("test-api", 0);
     n_components = 1;
 
     ASSERT_TRUE(capability_active("test-api"));
 
     /* Simulate service crash */
-    int status = WEXITSTATUS(1) << 8;
+    int status = 1 << 8;
     component_exited(0, status);
 
     /* Should be marked as failed and capabilities withdrawn */
@@ -212,6 +231,27 @@ TEST(load_components_from_directory) {
     ASSERT_TRUE(found_oneshot);
 }
 
+TEST(component_table_grows_past_initial_size) {
+    n_components = 0;
+    capability_init();
+
+    int target = component_table_capacity() * 4;
+    for (int i = 0; i < target; i++) {
+        ASSERT_EQ(0, component_table_reserve(n_components + 1));
+        component_t *comp = &components[n_components++];
+        snprintf(comp->name, MAX_NAME, "comp-%d", i);
+        ASSERT_EQ(0, component_set_str(comp, &comp->binary, "/bin/true"));
+    }
+
+    ASSERT_TRUE(component_table_capacity() >= target);
+    ASSERT_STR_EQ("comp-0", components[0].name);
+    ASSERT_STR_EQ("/bin/true", components[0].binary);
+    ASSERT_STR_EQ("/bin/true", components[target - 1].binary);
+
+    component_table_clear();
+    ASSERT_EQ(0, n_components);
+}
+
 TEST(load_components_nonexistent_directory) {
     /* Reset state */
     n_components = 0;
@@ -265,7 +305,7 @@ static void create_readiness_component(int idx, const char *name, readiness_meth
     memset(comp, 0, sizeof(*comp));
 
     strncpy(comp->name, name, MAX_NAME - 1);
-    strncpy(comp->binary, "/bin/true", MAX_PATH - 1);
+    component_set_str(comp, &comp->binary, "/bin/true");
     comp->type = COMP_TYPE_SERVICE;
     comp->state = COMP_INACTIVE;
     comp->pid = -1;
@@ -275,20 +315,21 @@ static void create_readiness_component(int idx, const char *name, readiness_meth
 
     switch (method) {
         case READINESS_FILE:
-            strncpy(comp->readiness_file, readiness_config, MAX_PATH - 1);
+            component_set_str(comp, &comp->readiness_file, readiness_config);
             break;
         case READINESS_COMMAND:
-            strncpy(comp->readiness_check, readiness_config, MAX_PATH - 1);
+            component_set_str(comp, &comp->readiness_check, readiness_config);
             break;
         case READINESS_SIGNAL:
             comp->readiness_signal = atoi(readiness_config);
             break;
+        case READINESS_NOTIFY:  /* the notify socket needs no setting */
         case READINESS_NONE:
             break;
     }
 
     /* Add mock capability */
-    strncpy(comp->provides[0], "test-cap", MAX_NAME - 1);
+    component_set_str(comp, &comp->provides[0], "test-cap");
     comp->n_provides = 1;
 }
 
@@ -341,6 +382,7 @@ TEST(readiness_file_detection_success) {
     const char *ready_file = "/tmp/test_component_ready";
     create_readiness_component(0, "file-service", READINESS_FILE, ready_file, 30);
     components[0].state = COMP_READY_WAIT;
+    components[0].ready_wait_start = time(NULL);
     n_components = 1;
 
     /* Create the readiness file */
@@ -368,6 +410,7 @@ TEST(readiness_file_detection_missing) {
     const char *ready_file = "/tmp/nonexistent_ready_file";
     create_readiness_component(0, "file-service", READINESS_FILE, ready_file, 30);
     components[0].state = COMP_READY_WAIT;
+    components[0].ready_wait_start = time(NULL);
     n_components = 1;
 
     /* Ensure file doesn't exist */
@@ -387,10 +430,20 @@ TEST(readiness_command_success) {
     /* Create component with command-based readiness using /bin/true */
     create_readiness_component(0, "cmd-service", READINESS_COMMAND, "/bin/true", 30);
     components[0].state = COMP_READY_WAIT;
+    components[0].ready_wait_start = time(NULL);
     n_components = 1;
 
-    /* Check readiness - /bin/true should succeed */
+    /* Check readiness - the command runs in the background */
     check_all_readiness();
+    pid_t pid = components[0].readiness_pid;
+    ASSERT_TRUE(pid > 0);
+    ASSERT_EQ(COMP_READY_WAIT, components[0].state);
+
+    /* /bin/true should succeed once it is reaped */
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_EQ(1, component_reap(pid, status));
+    ASSERT_EQ(0, components[0].readiness_pid);
     ASSERT_EQ(COMP_ACTIVE, components[0].state);
     ASSERT_TRUE(capability_active("test-cap"));
 }
@@ -403,10 +456,17 @@ TEST(readiness_command_failure) {
     /* Create component with command-based readiness using /bin/false */
     create_readiness_component(0, "cmd-service", READINESS_COMMAND, "/bin/false", 30);
     components[0].state = COMP_READY_WAIT;
+    components[0].ready_wait_start = time(NULL);
     n_components = 1;
 
     /* Check readiness - /bin/false should fail */
     check_all_readiness();
+    pid_t pid = components[0].readiness_pid;
+    ASSERT_TRUE(pid > 0);
+
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_EQ(1, component_reap(pid, status));
     ASSERT_EQ(COMP_READY_WAIT, components[0].state);
     ASSERT_FALSE(capability_active("test-cap"));
 }
@@ -428,9 +488,830 @@ TEST(readiness_timeout_failure) {
     ASSERT_FALSE(capability_active("test-cap"));
 }
 
+TEST(health_check_runs_asynchronously) {
+    n_components = 0;
+    capability_init();
+
+    create_mock_component(0, "healthy", "/bin/true", COMP_TYPE_SERVICE);
+    components[0].state = COMP_ACTIVE;
+    component_set_str(&components[0], &components[0].health_check, "exit 0");
+    components[0].health_timeout = 5;
+    n_components = 1;
+
+    /* Starting the check must not wait for it */
+    check_all_health();
+    pid_t pid = components[0].health_pid;
+    ASSERT_TRUE(pid > 0);
+    ASSERT_EQ(0, components[0].last_health_check);
+
+    /* A second sweep does not start another check while one is running */
+    check_all_health();
+    ASSERT_EQ(pid, components[0].health_pid);
+
+    /* Result is applied when the child is reaped */
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_EQ(1, component_reap(pid, status));
+    ASSERT_EQ(0, components[0].health_pid);
+    ASSERT_EQ(0, components[0].last_health_result);
+    ASSERT_TRUE(components[0].last_health_check > 0);
+
+    /* Once reaped the pid is no longer supervised */
+    ASSERT_EQ(0, component_reap(pid, status));
+}
+
+TEST(health_check_timeout_kills_check) {
+    n_components = 0;
+    capability_init();
+
+    create_mock_component(0, "slow", "/bin/true", COMP_TYPE_SERVICE);
+    components[0].state = COMP_ACTIVE;
+    component_set_str(&components[0], &components[0].health_check, "sleep 30");
+    components[0].health_timeout = 1;
+    components[0].health_fail_threshold = 3;
+    n_components = 1;
+
+    check_all_health();
+    pid_t pid = components[0].health_pid;
+    ASSERT_TRUE(pid > 0);
+
+    /* Let the deadline pass, then fire timers */
+    usleep(1100000);
+    component_run_timers();
+    ASSERT_EQ(2, components[0].last_health_result);
+    ASSERT_EQ(1, components[0].health_consecutive_failures);
+
+    /* The killed check is reaped without being counted twice */
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFSIGNALED(status));
+    ASSERT_EQ(1, component_reap(pid, status));
+    ASSERT_EQ(1, components[0].health_consecutive_failures);
+    ASSERT_EQ(0, components[0].health_pid);
+}
+
+TEST(readiness_probe_driven_by_timers) {
+    n_components = 0;
+    capability_init();
+    timer_init();
+
+    const char *ready_file = "/tmp/test_component_timer_ready";
+    unlink(ready_file);
+    create_readiness_component(0, "timer-service", READINESS_FILE, ready_file, 30);
+    components[0].state = COMP_READY_WAIT;
+    components[0].ready_wait_start = time(NULL);
+    n_components = 1;
+
+    /* Entering READY_WAIT arms the deadline and an immediate probe */
+    component_resume(0);
+    ASSERT_TRUE(components[0].timers[TIMER_READINESS_TIMEOUT] > 0);
+    ASSERT_EQ(0, timer_next_ms());
+
+    /* File missing: the probe backs off instead of spinning */
+    component_run_timers();
+    ASSERT_EQ(COMP_READY_WAIT, components[0].state);
+    ASSERT_TRUE(timer_next_ms() > 0);
+
+    FILE *f = fopen(ready_file, "w");
+    ASSERT_NOT_NULL(f);
+    fclose(f);
+
+    usleep(200000);
+    component_run_timers();
+    ASSERT_EQ(COMP_ACTIVE, components[0].state);
+    ASSERT_TRUE(capability_active("test-cap"));
+
+    /* Becoming ready cancels the readiness deadline */
+    ASSERT_EQ(0, components[0].timers[TIMER_READINESS_TIMEOUT]);
+    ASSERT_EQ(0, timer_pending());
+    unlink(ready_file);
+}
+
+TEST(replaced_component_timer_is_ignored) {
+    n_components = 0;
+    capability_init();
+    timer_init();
+
+    create_mock_component(0, "restarting", "/bin/true", COMP_TYPE_SERVICE);
+    n_components = 1;
+
+    /* Re-arming replaces the previous deadline */
+    component_arm_timer(0, TIMER_RESTART, 0);
+    int first = components[0].timers[TIMER_RESTART];
+    component_arm_timer(0, TIMER_RESTART, 0);
+    ASSERT_TRUE(components[0].timers[TIMER_RESTART] != first);
+    ASSERT_EQ(1, timer_pending());
+
+    /* A handle the component no longer holds does nothing when it fires */
+    components[0].timers[TIMER_RESTART] = 0;
+    component_run_timers();
+    ASSERT_EQ(0, timer_pending());
+}
+
+TEST(restart_delay_backs_off_with_jitter) {
+    component_t comp;
+    memset(&comp, 0, sizeof(comp));
+    comp.restart_delay_ms = 1000;
+    comp.restart_delay_max_ms = 30000;
+
+    ASSERT_EQ(1000, (int)component_restart_delay(&comp, 1, 0));
+    ASSERT_EQ(2000, (int)component_restart_delay(&comp, 2, 0));
+    ASSERT_EQ(16000, (int)component_restart_delay(&comp, 5, 0));
+    ASSERT_EQ(30000, (int)component_restart_delay(&comp, 6, 0));
+    ASSERT_EQ(30000, (int)component_restart_delay(&comp, 1000, 0));
+
+    /* Jitter only ever shortens a delay, by at most restart_jitter percent */
+    comp.restart_jitter = 25;
+    ASSERT_EQ(4000, (int)component_restart_delay(&comp, 3, 0));
+    ASSERT_EQ(3000, (int)component_restart_delay(&comp, 3, 1000));
+    ASSERT_EQ(3999, (int)component_restart_delay(&comp, 3, 1));
+    ASSERT_EQ(4000, (int)component_restart_delay(&comp, 3, 1001));
+}
+
+TEST(repeated_failures_quarantine) {
+    n_components = 0;
+    capability_init();
+    timer_init();
+
+    create_mock_component(0, "flapping", "/bin/false", COMP_TYPE_SERVICE);
+    components[0].restart_delay_ms = 100;
+    components[0].restart_delay_max_ms = 800;
+    components[0].restart_decay = 60;
+    components[0].restart_quarantine = 3;
+    components[0].last_restart = time(NULL);
+    components[0].state = COMP_FAILED;
+    n_components = 1;
+
+    uint64_t before = timer_now_ms();
+    ASSERT_EQ(0, component_schedule_restart(0));
+    ASSERT_EQ(1, components[0].failures);
+    ASSERT_TRUE(components[0].restart_due_ms >= before + 100);
+    ASSERT_TRUE(components[0].timers[TIMER_RESTART] > 0);
+
+    ASSERT_EQ(0, component_schedule_restart(0));
+    ASSERT_TRUE(components[0].restart_due_ms >= before + 200);
+
+    ASSERT_EQ(-1, component_schedule_restart(0));
+    ASSERT_EQ(COMP_QUARANTINED, components[0].state);
+    ASSERT_EQ(0, components[0].timers[TIMER_RESTART]);
+
+    /* Only an explicit reset brings it back */
+    ASSERT_EQ(-1, component_reset_failed("nonexistent"));
+    ASSERT_EQ(0, component_reset_failed("flapping"));
+    ASSERT_EQ(COMP_INACTIVE, components[0].state);
+    ASSERT_EQ(0, components[0].failures);
+    ASSERT_EQ(-2, component_reset_failed("flapping"));
+}
+
+TEST(long_run_forgives_failures) {
+    n_components = 0;
+    capability_init();
+    timer_init();
+
+    create_mock_component(0, "steady", "/bin/true", COMP_TYPE_SERVICE);
+    components[0].restart_delay_ms = 100;
+    components[0].restart_decay = 60;
+    components[0].restart_quarantine = 3;
+    components[0].failures = 2;
+    components[0].last_restart = time(NULL) - 61;
+    components[0].state = COMP_FAILED;
+    n_components = 1;
+
+    ASSERT_EQ(0, component_schedule_restart(0));
+    ASSERT_EQ(1, components[0].failures);
+    ASSERT_EQ(COMP_FAILED, components[0].state);
+    component_disarm_timer(0, TIMER_RESTART);
+}
+
+TEST(notify_ready_from_main_process_only) {
+    n_components = 0;
+    capability_init();
+
+    const char *sock_path = "/tmp/yakiros_test_component_notify.sock";
+    ASSERT_TRUE(notify_init(-1, sock_path) >= 0);
+
+    create_readiness_component(0, "notify-service", READINESS_NOTIFY, "", 30);
+    components[0].state = COMP_READY_WAIT;
+    components[0].ready_wait_start = time(NULL);
+    n_components = 1;
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    ASSERT_TRUE(fd >= 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sock_path);
+    const char *msg = "READY=1\nSTATUS=warming up";
+
+    /* We are not the component's main process yet: ignored */
+    components[0].pid = 999999;
+    ASSERT_TRUE(sendto(fd, msg, strlen(msg), 0, (struct sockaddr *)&addr, sizeof(addr)) > 0);
+    component_handle_notify();
+    ASSERT_EQ(COMP_READY_WAIT, components[0].state);
+
+    /* Once we are, READY=1 activates it and STATUS= is kept */
+    components[0].pid = getpid();
+    supervise_watch(getpid(), 0, PROC_MAIN);
+    ASSERT_TRUE(sendto(fd, msg, strlen(msg), 0, (struct sockaddr *)&addr, sizeof(addr)) > 0);
+    component_handle_notify();
+    ASSERT_EQ(COMP_ACTIVE, components[0].state);
+    ASSERT_TRUE(capability_active("test-cap"));
+    ASSERT_STR_EQ("warming up", components[0].notify_status);
+
+    supervise_unwatch(getpid());
+    close(fd);
+    notify_close();
+}
+
+TEST(main_pid_taken_from_own_cgroup_only) {
+    n_components = 0;
+    capability_init();
+
+    const char *sock_path = "/tmp/yakiros_test_component_notify.sock";
+    ASSERT_TRUE(notify_init(-1, sock_path) >= 0);
+
+    create_readiness_component(0, "forking-service", READINESS_NOTIFY, "", 30);
+    components[0].state = COMP_READY_WAIT;
+    components[0].ready_wait_start = time(NULL);
+    components[0].pid = getpid();
+    supervise_watch(getpid(), 0, PROC_MAIN);
+    n_components = 1;
+
+    pid_t child = fork();
+    if (child == 0) {
+        pause();
+        _exit(0);
+    }
+    ASSERT_TRUE(child > 0);
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    ASSERT_TRUE(fd >= 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sock_path);
+    char msg[64];
+    snprintf(msg, sizeof(msg), "MAINPID=%d\nREADY=1", (int)child);
+
+    /* Without a cgroup the pid cannot be vouched for */
+    ASSERT_TRUE(sendto(fd, msg, strlen(msg), 0, (struct sockaddr *)&addr, sizeof(addr)) > 0);
+    component_handle_notify();
+    ASSERT_EQ(getpid(), components[0].pid);
+
+    /* A scratch directory stands in for the cgroup */
+    const char *dir = "/tmp/yakiros_test_component_cgroup";
+    char procs[128];
+    snprintf(procs, sizeof(procs), "%s/cgroup.procs", dir);
+    mkdir(dir, 0755);
+    FILE *f = fopen(procs, "w");
+    ASSERT_NOT_NULL(f);
+    fprintf(f, "%d\n", (int)getpid());
+    fclose(f);
+    components[0].cgroup_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    ASSERT_TRUE(components[0].cgroup_fd > 0);
+
+    /* A pid outside it is ignored, the rest of the message is not */
+    ASSERT_TRUE(sendto(fd, msg, strlen(msg), 0, (struct sockaddr *)&addr, sizeof(addr)) > 0);
+    component_handle_notify();
+    ASSERT_EQ(getpid(), components[0].pid);
+    ASSERT_EQ(COMP_ACTIVE, components[0].state);
+
+    /* One of its own processes becomes the main process */
+    f = fopen(procs, "a");
+    ASSERT_NOT_NULL(f);
+    fprintf(f, "%d\n", (int)child);
+    fclose(f);
+    ASSERT_TRUE(sendto(fd, msg, strlen(msg), 0, (struct sockaddr *)&addr, sizeof(addr)) > 0);
+    component_handle_notify();
+    ASSERT_EQ(child, components[0].pid);
+
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+    supervise_unwatch(child);
+    supervise_unwatch(getpid());
+    close(components[0].cgroup_fd);
+    components[0].cgroup_fd = 0;
+    unlink(procs);
+    rmdir(dir);
+    close(fd);
+    notify_close();
+}
+
+static void write_oom_kills(const char *events, long kills) {
+    FILE *f = fopen(events, "w");
+    if (f) {
+        fprintf(f, "low 0\nhigh 0\nmax 1\noom 1\noom_kill %ld\n", kills);
+        fclose(f);
+    }
+}
+
+TEST(oom_kill_of_a_worker_spares_the_service) {
+    n_components = 0;
+    capability_init();
+    supervise_init(-1);
+
+    /* A scratch directory stands in for the cgroup */
+    const char *dir = "/tmp/yakiros_test_component_oom";
+    char events[128];
+    snprintf(events, sizeof(events), "%s/memory.events", dir);
+    mkdir(dir, 0755);
+    write_oom_kills(events, 0);
+
+    create_mock_component(0, "oom-service", "/bin/sleep", COMP_TYPE_SERVICE);
+    components[0].state = COMP_ACTIVE;
+    components[0].cgroup_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    ASSERT_TRUE(components[0].cgroup_fd > 0);
+    ASSERT_EQ(0, cgroup_setup_oom_monitor(components[0].cgroup_fd));
+    n_components = 1;
+
+    pid_t child = fork();
+    if (child == 0) {
+        pause();
+        _exit(0);
+    }
+    ASSERT_TRUE(child > 0);
+    components[0].pid = child;
+    supervise_watch(child, 0, PROC_MAIN);
+
+    /* Some other process was killed: reported, the service runs on */
+    write_oom_kills(events, 1);
+    check_all_oom_events();
+    usleep(100000);  /* long enough for a kill to land */
+    int status;
+    ASSERT_EQ(0, waitpid(child, &status, WNOHANG));
+    ASSERT_EQ(COMP_ACTIVE, components[0].state);
+
+    /* Opted in, the component goes as a whole */
+    components[0].oom_group = 1;
+    write_oom_kills(events, 2);
+    check_all_oom_events();
+    ASSERT_EQ(child, waitpid(child, &status, 0));
+    ASSERT_TRUE(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL);
+
+    supervise_unwatch(child);
+    cgroup_close(components[0].cgroup_fd);
+    components[0].cgroup_fd = 0;
+    unlink(events);
+    rmdir(dir);
+}
+
+TEST(standby_takes_over_when_main_exits) {
+    n_components = 0;
+    capability_init();
+    timer_init();
+    supervise_init(-1);
+
+    create_mock_component(0, "spare", "/bin/sleep", COMP_TYPE_SERVICE);
+    component_set_str(&components[0], &components[0].args[0], "30");
+    components[0].argc = 1;
+    component_set_str(&components[0], &components[0].provides[0], "spare-api");
+    components[0].n_provides = 1;
+    components[0].standby = 1;
+    components[0].restart_delay_ms = 100;
+    n_components = 1;
+
+    ASSERT_EQ(0, component_start(0));
+    ASSERT_EQ(COMP_ACTIVE, components[0].state);
+    pid_t main_pid = components[0].pid;
+    pid_t standby_pid = components[0].standby_pid;
+    ASSERT_TRUE(standby_pid > 0);
+    ASSERT_NE(main_pid, standby_pid);
+    ASSERT_TRUE(components[0].standby_ready);
+
+    /* The main process dies: the standby becomes it, capabilities stay up */
+    int status;
+    kill(main_pid, SIGKILL);
+    ASSERT_EQ(main_pid, waitpid(main_pid, &status, 0));
+    ASSERT_EQ(1, component_reap(main_pid, status));
+    ASSERT_EQ(COMP_ACTIVE, components[0].state);
+    ASSERT_EQ(standby_pid, components[0].pid);
+    ASSERT_TRUE(capability_active("spare-api"));
+    ASSERT_TRUE(components[0].handoff_sock > 0);
+
+    /* And a new standby is warming up behind it */
+    pid_t next_pid = components[0].standby_pid;
+    ASSERT_TRUE(next_pid > 0);
+    ASSERT_NE(standby_pid, next_pid);
+
+    component_standby_stop(0);
+    ASSERT_EQ(0, components[0].standby_pid);
+    ASSERT_EQ(next_pid, waitpid(next_pid, &status, 0));
+    ASSERT_EQ(1, component_reap(next_pid, status));
+    ASSERT_EQ(0, components[0].timers[TIMER_STANDBY]);
+
+    kill(standby_pid, SIGKILL);
+    ASSERT_EQ(standby_pid, waitpid(standby_pid, &status, 0));
+    ASSERT_EQ(1, component_reap(standby_pid, status));
+    ASSERT_EQ(COMP_FAILED, components[0].state);
+    ASSERT_FALSE(capability_active("spare-api"));
+    component_release_cgroup(0);
+}
+
+/* Wait for the handoff socket to be readable and hand it to the
+ * component, as the main loop would */
+static int handoff_event(int epfd) {
+    struct epoll_event ev;
+    if (epoll_wait(epfd, &ev, 1, 2000) != 1 ||
+        ((event_source_t *)ev.data.ptr)->type != EVENT_HANDOFF) {
+        return 0;
+    }
+    component_handoff_event(ev.data.ptr);
+    return 1;
+}
+
+TEST(standby_upgrade_waits_for_handoff_without_blocking) {
+    n_components = 0;
+    capability_init();
+    timer_init();
+    supervise_init(-1);
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    ASSERT_TRUE(epfd >= 0);
+    component_handoff_init(epfd);
+
+    /* Survives being asked for its descriptors; we answer for it */
+    create_mock_component(0, "swapped", "/bin/sh", COMP_TYPE_SERVICE);
+    component_set_str(&components[0], &components[0].args[0], "-c");
+    component_set_str(&components[0], &components[0].args[1], "trap '' USR1; exec sleep 30");
+    components[0].argc = 2;
+    components[0].standby = 1;
+    n_components = 1;
+
+    ASSERT_EQ(0, component_start(0));
+    pid_t old_pid = components[0].pid;
+    pid_t standby_pid = components[0].standby_pid;
+    ASSERT_TRUE(components[0].standby_ready);
+    int socks[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, socks));
+    components[0].handoff_sock = socks[0];
+    usleep(200000);
+
+    /* Asked, not waited for */
+    ASSERT_EQ(0, component_upgrade("swapped"));
+    ASSERT_EQ(old_pid, components[0].pid);
+    ASSERT_EQ(-4, component_upgrade("swapped"));
+
+    /* The descriptors arrive, the completion later */
+    int pipefd[2];
+    ASSERT_EQ(0, pipe2(pipefd, O_CLOEXEC));
+    ASSERT_EQ(0, handoff_send(socks[1], pipefd, 1));
+    ASSERT_TRUE(handoff_event(epfd));
+    ASSERT_EQ(old_pid, components[0].pid);
+    ASSERT_EQ(0, components[0].n_held_fds);
+
+    ASSERT_EQ(0, send_handoff_complete(socks[1]));
+    ASSERT_TRUE(handoff_event(epfd));
+    ASSERT_EQ(standby_pid, components[0].pid);
+    ASSERT_EQ(COMP_ACTIVE, components[0].state);
+    ASSERT_EQ(1, components[0].n_held_fds);
+
+    int status;
+    component_standby_stop(0);
+    ASSERT_EQ(0, components[0].n_held_fds);
+    kill(old_pid, SIGKILL);
+    ASSERT_EQ(old_pid, waitpid(old_pid, &status, 0));
+    ASSERT_EQ(1, component_reap(old_pid, status));
+    kill(standby_pid, SIGKILL);
+    ASSERT_EQ(standby_pid, waitpid(standby_pid, &status, 0));
+    ASSERT_EQ(1, component_reap(standby_pid, status));
+    while (waitpid(-1, &status, WNOHANG) > 0) {}
+
+    close(socks[1]);
+    close(pipefd[0]);
+    close(pipefd[1]);
+    component_handoff_init(-1);
+    close(epfd);
+    component_release_cgroup(0);
+}
+
+/* Whether pid has the socket fd refers to as its descriptor 3, waiting
+ * for it to get that far */
+static int has_socket_at_fd3(pid_t pid, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) return 0;
+    char want[64], link[64], path[64];
+    snprintf(want, sizeof(want), "socket:[%lu]", (unsigned long)st.st_ino);
+    snprintf(path, sizeof(path), "/proc/%d/fd/3", (int)pid);
+
+    for (int i = 0; i < 200; i++) {
+        ssize_t n = readlink(path, link, sizeof(link) - 1);
+        if (n > 0) {
+            link[n] = '\0';
+            if (strcmp(link, want) == 0) return 1;
+        }
+        usleep(10000);
+    }
+    return 0;
+}
+
+TEST(activation_sockets_outlive_the_process) {
+    n_components = 0;
+    capability_init();
+    timer_init();
+    supervise_init(-1);
+
+    create_mock_component(0, "activated", "/bin/sleep", COMP_TYPE_SERVICE);
+    component_set_str(&components[0], &components[0].args[0], "30");
+    components[0].argc = 1;
+    component_set_str(&components[0], &components[0].provides[0], "activated-api");
+    components[0].n_provides = 1;
+    component_set_str(&components[0], &components[0].sockets[0], "tcp:127.0.0.1:0");
+    components[0].n_sockets = 1;
+    components[0].readiness_method = READINESS_NOTIFY;
+    components[0].readiness_timeout = 30;
+    n_components = 1;
+
+    /* Up before it is ready: clients are queued until it accepts */
+    ASSERT_EQ(0, component_start(0));
+    ASSERT_EQ(COMP_READY_WAIT, components[0].state);
+    ASSERT_TRUE(capability_active("activated-api"));
+    ASSERT_EQ(1, components[0].n_listen_fds);
+    int listen_fd = components[0].listen_fds[0];
+
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    ASSERT_EQ(0, getsockname(listen_fd, (struct sockaddr *)&addr, &len));
+    int early = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_EQ(0, connect(early, (struct sockaddr *)&addr, len));
+
+    pid_t pid = components[0].pid;
+    ASSERT_TRUE(has_socket_at_fd3(pid, listen_fd));
+
+    /* It dies: the socket stays with us and still takes connections */
+    int status;
+    kill(pid, SIGKILL);
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_EQ(1, component_reap(pid, status));
+    ASSERT_EQ(COMP_FAILED, components[0].state);
+    ASSERT_TRUE(capability_active("activated-api"));
+    ASSERT_EQ(listen_fd, components[0].listen_fds[0]);
+    int late = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_EQ(0, connect(late, (struct sockaddr *)&addr, len));
+
+    /* Not coming back: capabilities and then sockets go */
+    component_withdraw_held_provides(0);
+    ASSERT_FALSE(capability_active("activated-api"));
+    component_close_sockets(0);
+    ASSERT_EQ(0, components[0].n_listen_fds);
+    ASSERT_NULL(components[0].listen_fds);
+    int refused = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_EQ(-1, connect(refused, (struct sockaddr *)&addr, len));
+
+    close(early);
+    close(late);
+    close(refused);
+    component_release_cgroup(0);
+}
+
+static void reap_exited(pid_t pid) {
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_EQ(1, component_reap(pid, status));
+}
+
+TEST(on_demand_started_by_dependent_and_stopped_when_unused) {
+    n_components = 0;
+    capability_init();
+    timer_init();
+    supervise_init(-1);
+
+    create_mock_component(0, "lazy", "/bin/sleep", COMP_TYPE_SERVICE);
+    component_set_str(&components[0], &components[0].args[0], "30");
+    components[0].argc = 1;
+    component_set_str(&components[0], &components[0].provides[0], "lazy-api");
+    components[0].n_provides = 1;
+    components[0].on_demand = 1;
+    components[0].idle_timeout = 1;
+    n_components = 1;
+
+    /* Nothing needs it yet */
+    graph_mark_all_dirty();
+    graph_resolve_pending();
+    ASSERT_EQ(COMP_IDLE, components[0].state);
+    ASSERT_EQ(-1, components[0].pid);
+    ASSERT_FALSE(capability_active("lazy-api"));
+
+    /* A dependent that wants to run pulls it up, then starts itself */
+    create_mock_component(1, "user", "/bin/sleep", COMP_TYPE_SERVICE);
+    component_set_str(&components[1], &components[1].args[0], "30");
+    components[1].argc = 1;
+    component_set_str(&components[1], &components[1].requires[0], "lazy-api");
+    components[1].n_requires = 1;
+    n_components = 2;
+    graph_mark_dirty(1);
+    graph_resolve_pending();
+    ASSERT_EQ(COMP_ACTIVE, components[0].state);
+    ASSERT_TRUE(components[0].pid > 0);
+    ASSERT_TRUE(capability_active("lazy-api"));
+    ASSERT_EQ(COMP_ACTIVE, components[1].state);
+
+    /* Used while the dependent runs */
+    usleep(1100000);
+    component_run_timers();
+    ASSERT_EQ(0, components[0].idle_unused);
+
+    /* Once it is gone, two idle checks stop the provider */
+    pid_t user = components[1].pid;
+    kill(user, SIGKILL);
+    reap_exited(user);
+    components[1].state = COMP_QUARANTINED;
+    pid_t lazy = components[0].pid;
+    usleep(1100000);
+    component_run_timers();
+    ASSERT_EQ(1, components[0].idle_unused);
+    usleep(1100000);
+    component_run_timers();
+    reap_exited(lazy);
+    ASSERT_EQ(COMP_IDLE, components[0].state);
+    ASSERT_EQ(-1, components[0].pid);
+    ASSERT_EQ(0, components[0].failures);
+    ASSERT_FALSE(capability_active("lazy-api"));
+    component_release_cgroup(0);
+    component_release_cgroup(1);
+}
+
+TEST(on_demand_started_by_connection) {
+    n_components = 0;
+    capability_init();
+    timer_init();
+    supervise_init(-1);
+
+    create_mock_component(0, "lazy-socket", "/bin/sleep", COMP_TYPE_SERVICE);
+    component_set_str(&components[0], &components[0].args[0], "30");
+    components[0].argc = 1;
+    component_set_str(&components[0], &components[0].provides[0], "lazy-socket-api");
+    components[0].n_provides = 1;
+    component_set_str(&components[0], &components[0].sockets[0], "tcp:127.0.0.1:0");
+    components[0].n_sockets = 1;
+    components[0].on_demand = 1;
+    n_components = 1;
+
+    /* Idle, but listening and advertised */
+    graph_mark_all_dirty();
+    graph_resolve_pending();
+    ASSERT_EQ(COMP_IDLE, components[0].state);
+    ASSERT_EQ(-1, components[0].pid);
+    ASSERT_EQ(1, components[0].n_listen_fds);
+    ASSERT_TRUE(capability_active("lazy-socket-api"));
+
+    /* A connection on another socket is not its business */
+    component_handle_activation(components[0].listen_fds[0] + 100);
+    ASSERT_EQ(0, components[0].demanded);
+
+    component_handle_activation(components[0].listen_fds[0]);
+    ASSERT_EQ(1, components[0].demanded);
+    graph_resolve_pending();
+    ASSERT_EQ(COMP_ACTIVE, components[0].state);
+    ASSERT_TRUE(components[0].pid > 0);
+
+    /* A clean exit (here stopping for being unused) leaves it idle again */
+    pid_t pid = components[0].pid;
+    components[0].idle_stopping = 1;
+    kill(pid, SIGTERM);
+    reap_exited(pid);
+    ASSERT_EQ(COMP_IDLE, components[0].state);
+    ASSERT_TRUE(capability_active("lazy-socket-api"));
+    ASSERT_EQ(0, components[0].demanded);
+
+    component_close_sockets(0);
+    component_release_cgroup(0);
+}
+
+TEST(watchdog_keepalives_over_notify) {
+    n_components = 0;
+    capability_init();
+    timer_init();
+    supervise_init(-1);
+
+    const char *sock_path = "/tmp/yakiros_test_component_watchdog.sock";
+    ASSERT_TRUE(notify_init(-1, sock_path) >= 0);
+
+    create_mock_component(0, "watched", "/bin/true", COMP_TYPE_SERVICE);
+    components[0].state = COMP_ACTIVE;
+    components[0].pid = getpid();
+    components[0].watchdog_sec = 1;
+    components[0].health_fail_threshold = 1;
+    components[0].health_restart_threshold = 5;
+    n_components = 1;
+    supervise_watch(getpid(), 0, PROC_MAIN);
+    component_resume(0);
+    ASSERT_TRUE(components[0].timers[TIMER_WATCHDOG] > 0);
+
+    /* Nothing within the window: a timed out check, here DEGRADED */
+    usleep(1100000);
+    component_run_timers();
+    ASSERT_EQ(2, components[0].last_health_result);
+    ASSERT_EQ(1, components[0].health_consecutive_failures);
+    ASSERT_EQ(COMP_DEGRADED, components[0].state);
+    ASSERT_TRUE(components[0].timers[TIMER_WATCHDOG] > 0);
+
+    /* A keepalive before the next deadline brings it back */
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sock_path);
+    usleep(600000);
+    ASSERT_TRUE(sendto(fd, "WATCHDOG=1", 10, 0, (struct sockaddr *)&addr, sizeof(addr)) > 0);
+    component_handle_notify();
+    usleep(500000);
+    component_run_timers();
+    ASSERT_EQ(COMP_ACTIVE, components[0].state);
+    ASSERT_EQ(0, components[0].health_consecutive_failures);
+    ASSERT_TRUE(components[0].timers[TIMER_WATCHDOG] > 0);
+
+    supervise_unwatch(getpid());
+    component_cancel_check(0);
+    close(fd);
+    notify_close();
+}
+
+TEST(watchdog_pipe_passed_to_the_process) {
+    n_components = 0;
+    capability_init();
+    timer_init();
+    supervise_init(-1);
+
+    create_mock_component(0, "piped", "/bin/sh", COMP_TYPE_SERVICE);
+    component_set_str(&components[0], &components[0].args[0], "-c");
+    component_set_str(&components[0], &components[0].args[1],
+                      "printf %s \"$WATCHDOG_USEC\" > /dev/fd/$WATCHDOG_FD");
+    components[0].argc = 2;
+    components[0].watchdog_sec = 2;
+    n_components = 1;
+
+    ASSERT_EQ(0, component_start(0));
+    ASSERT_TRUE(components[0].watchdog_fd > 0);
+    int rfd = components[0].watchdog_fd;
+    reap_exited(components[0].pid);
+
+    /* Our end outlives the process, holding what it wrote */
+    char buf[32] = "";
+    ASSERT_EQ(7, (int)read(rfd, buf, sizeof(buf) - 1));
+    ASSERT_STR_EQ("2000000", buf);
+    ASSERT_EQ(rfd, components[0].watchdog_fd);
+    ASSERT_EQ(0, components[0].timers[TIMER_WATCHDOG]);
+
+    component_close_watchdog(0);
+    ASSERT_EQ(0, components[0].watchdog_fd);
+    ASSERT_EQ(0, components[0].watchdog_wfd);
+    component_release_cgroup(0);
+}
+
+TEST(hung_process_killed_before_its_restart) {
+    n_components = 0;
+    capability_init();
+    timer_init();
+    supervise_init(-1);
+
+    /* Ignores SIGTERM, and sends no keepalives */
+    create_mock_component(0, "hung", "/bin/sh", COMP_TYPE_SERVICE);
+    component_set_str(&components[0], &components[0].args[0], "-c");
+    component_set_str(&components[0], &components[0].args[1], "trap '' TERM; exec sleep 30");
+    components[0].argc = 2;
+    components[0].watchdog_sec = 1;
+    components[0].health_fail_threshold = 1;
+    components[0].health_restart_threshold = 1;
+    components[0].stop_timeout = 1;
+    n_components = 1;
+
+    ASSERT_EQ(0, component_start(0));
+    pid_t pid = components[0].pid;
+    usleep(1100000);
+    component_run_timers();
+    ASSERT_EQ(COMP_DEGRADED, components[0].state);
+    usleep(1100000);
+    component_run_timers();
+    ASSERT_EQ(COMP_FAILED, components[0].state);
+
+    /* Still there and still watched: nothing is started next to it */
+    usleep(100000);
+    ASSERT_EQ(0, kill(pid, 0));
+    ASSERT_EQ(pid, components[0].pid);
+    ASSERT_NOT_NULL(supervise_lookup(pid));
+    ASSERT_TRUE(components[0].timers[TIMER_STOP_KILL] > 0);
+    graph_resolve();
+    ASSERT_EQ(COMP_FAILED, components[0].state);
+    ASSERT_EQ(pid, components[0].pid);
+
+    /* SIGKILL once stop_timeout is over; the reap lets it restart */
+    usleep(1000000);
+    component_run_timers();
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL);
+    ASSERT_EQ(1, component_reap(pid, status));
+    ASSERT_EQ(-1, components[0].pid);
+    ASSERT_NULL(supervise_lookup(pid));
+    ASSERT_EQ(0, components[0].timers[TIMER_STOP_KILL]);
+    ASSERT_EQ(COMP_FAILED, components[0].state);
+
+    component_release_cgroup(0);
+}
+
 int main(void) {
     /* Initialize logging for tests */
     log_open();
+    component_table_reserve(256);
 
     return RUN_ALL_TESTS();
 }
\ No newline at end of file
@@ -10,11 +10,15 @@
 #include "../../src/component.h"
 #include "../../src/capability.h"
 #include "../../src/log.h"
+#include "../../src/output.h"
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/epoll.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/stat.h>
 
 /* Test socket path in /tmp to avoid system conflicts */
 #define TEST_CONTROL_SOCKET "/tmp/yakiros_test_control.sock"
@@ -29,7 +33,7 @@ static void create_status_test_component(int idx, const char *name, comp_state_t
     memset(comp, 0, sizeof(*comp));
 
     strncpy(comp->name, name, MAX_NAME - 1);
-    strncpy(comp->binary, "/bin/test", MAX_PATH - 1);
+    component_set_str(comp, &comp->binary, "/bin/test");
     comp->type = COMP_TYPE_SERVICE;
     comp->state = state;
     comp->pid = pid;
@@ -241,9 +245,333 @@ TEST(control_socket_cleanup_on_close) {
     unlink(TEST_CONTROL_SOCKET);
 }
 
+/* Drive a control client through epoll until the resolver side closes it,
+ * collecting everything it replied on peer */
+static size_t pump_client(int epoll_fd, int peer, char **reply) {
+    size_t len = 0, cap = 4096;
+    char *buf = malloc(cap);
+
+    for (;;) {
+        struct epoll_event ev[4];
+        int n = epoll_wait(epoll_fd, ev, 4, 0);
+        for (int i = 0; i < n; i++) {
+            control_client_event(ev[i].data.ptr, ev[i].events);
+        }
+
+        ssize_t got;
+        while ((got = recv(peer, buf + len, cap - len - 1, MSG_DONTWAIT)) > 0) {
+            len += (size_t)got;
+            if (cap - len < 1024) buf = realloc(buf, cap *= 2);
+        }
+        if (got == 0) break;                      /* resolver closed */
+        if (n == 0 && control_client_count() == 0) break;
+    }
+
+    buf[len] = '\0';
+    *reply = buf;
+    return len;
+}
+
+static int count_occurrences(const char *haystack, const char *needle) {
+    int n = 0;
+    for (const char *p = haystack; (p = strstr(p, needle)) != NULL; p++) n++;
+    return n;
+}
+
+TEST(control_client_pipelined_commands) {
+    n_components = 0;
+    capability_init();
+    create_status_test_component(0, "web", COMP_ACTIVE, 4321);
+    n_components = 1;
+
+    int epoll_fd = epoll_create1(0);
+    int sv[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv));
+    control_init(epoll_fd);
+    ASSERT_EQ(0, control_add_client(sv[1]));
+    ASSERT_EQ(1, control_client_count());
+
+    /* Two commands in one write, a blank line, and a last unterminated one */
+    const char *cmds = "status\ncaps\n\nstatus";
+    ASSERT_EQ((ssize_t)strlen(cmds), write(sv[0], cmds, strlen(cmds)));
+    shutdown(sv[0], SHUT_WR);
+
+    char *reply;
+    pump_client(epoll_fd, sv[0], &reply);
+    ASSERT_EQ(2, count_occurrences(reply, "Summary:"));
+    ASSERT_EQ(1, count_occurrences(reply, "CAPABILITY"));
+    ASSERT_EQ(0, count_occurrences(reply, "Unknown command"));
+    ASSERT_EQ(0, control_client_count());
+
+    free(reply);
+    close(sv[0]);
+    close(epoll_fd);
+    control_init(-1);
+}
+
+TEST(control_client_large_reply_not_truncated) {
+    n_components = 0;
+    capability_init();
+    for (int i = 0; i < 200; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "svc-%03d", i);
+        create_status_test_component(i, name, COMP_ACTIVE, 1000 + i);
+    }
+    n_components = 200;
+
+    int epoll_fd = epoll_create1(0);
+    int sv[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv));
+    control_init(epoll_fd);
+    ASSERT_EQ(0, control_add_client(sv[1]));
+
+    ASSERT_EQ(7, write(sv[0], "status\n", 7));
+    shutdown(sv[0], SHUT_WR);
+
+    char *reply;
+    size_t len = pump_client(epoll_fd, sv[0], &reply);
+    ASSERT_TRUE(len > 4096);
+    ASSERT_NOT_NULL(strstr(reply, "svc-000"));
+    ASSERT_NOT_NULL(strstr(reply, "svc-199"));
+    ASSERT_NOT_NULL(strstr(reply, "200 total"));
+
+    free(reply);
+    close(sv[0]);
+    close(epoll_fd);
+    control_init(-1);
+    n_components = 0;
+}
+
+TEST(control_execute_appends_to_buffer) {
+    n_components = 0;
+    control_buf_t out = {0};
+
+    control_execute("  bogus  ", &out);
+    size_t first = out.len;
+    ASSERT_TRUE(first > 0);
+    ASSERT_NOT_NULL(strstr(out.data, "Unknown command: bogus"));
+
+    control_execute("status", &out);
+    ASSERT_TRUE(out.len > first);
+    ASSERT_NOT_NULL(strstr(out.data + first, "Summary:"));
+
+    control_buf_free(&out);
+    ASSERT_NULL(out.data);
+}
+
+/* Run every pending control event, then collect whatever the resolver
+ * side has sent so far without waiting for it to close */
+static size_t drain_client(int epoll_fd, int peer, char *buf, size_t size) {
+    struct epoll_event ev[4];
+    int n;
+    while ((n = epoll_wait(epoll_fd, ev, 4, 0)) > 0) {
+        for (int i = 0; i < n; i++) {
+            control_client_event(ev[i].data.ptr, ev[i].events);
+        }
+    }
+
+    size_t len = 0;
+    ssize_t got;
+    while (len < size - 1 && (got = recv(peer, buf + len, size - len - 1, MSG_DONTWAIT)) > 0) {
+        len += (size_t)got;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+/* Frame i of a JSON reply stream, NUL-terminated in place of the next
+ * header; NULL if there are fewer frames */
+static char *json_frame_at(char *buf, size_t len, int index) {
+    size_t off = 0;
+    for (int i = 0; off + 4 <= len; i++) {
+        unsigned char *hdr = (unsigned char *)buf + off;
+        size_t flen = ((size_t)hdr[0] << 24) | ((size_t)hdr[1] << 16) |
+                      ((size_t)hdr[2] << 8) | hdr[3];
+        if (off + 4 + flen > len) return NULL;
+        if (i == index) {
+            static char frame[8192];
+            size_t n = flen < sizeof(frame) - 1 ? flen : sizeof(frame) - 1;
+            memcpy(frame, buf + off + 4, n);
+            frame[n] = '\0';
+            return frame;
+        }
+        off += 4 + flen;
+    }
+    return NULL;
+}
+
+TEST(control_json_status_frames) {
+    n_components = 0;
+    capability_init();
+    create_status_test_component(0, "web \"front\"", COMP_ACTIVE, 4321);
+    n_components = 1;
+
+    int epoll_fd = epoll_create1(0);
+    int sv[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv));
+    control_init(epoll_fd);
+    ASSERT_EQ(0, control_add_client(sv[1]));
+
+    const char *cmds = "proto json\nstatus\nbogus\n";
+    ASSERT_EQ((ssize_t)strlen(cmds), write(sv[0], cmds, strlen(cmds)));
+
+    char buf[16384];
+    size_t len = drain_client(epoll_fd, sv[0], buf, sizeof(buf));
+    ASSERT_NOT_NULL(strstr(json_frame_at(buf, len, 0), "\"protocol\":\"json\""));
+    ASSERT_STR_EQ("{\"type\":\"status\",\"components\":[{\"name\":\"web \\\"front\\\"\","
+                  "\"state\":\"ACTIVE\",\"pid\":4321,\"uptime\":0,\"restarts\":0}]}",
+                  json_frame_at(buf, len, 1));
+    ASSERT_NOT_NULL(strstr(json_frame_at(buf, len, 2), "\"type\":\"text\""));
+    ASSERT_NOT_NULL(strstr(json_frame_at(buf, len, 2), "Unknown command: bogus\\n"));
+
+    close(sv[0]);
+    drain_client(epoll_fd, sv[0], buf, sizeof(buf));
+    ASSERT_EQ(0, control_client_count());
+    close(epoll_fd);
+    control_init(-1);
+}
+
+TEST(control_subscribe_streams_changes) {
+    n_components = 0;
+    capability_init();
+    create_status_test_component(0, "db", COMP_STARTING, 100);
+    n_components = 1;
+    capability_intern("database");
+
+    int epoll_fd = epoll_create1(0);
+    int sv[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv));
+    control_init(epoll_fd);
+    ASSERT_EQ(0, control_add_client(sv[1]));
+
+    /* Subscribing and then closing the write side keeps the stream open */
+    const char *cmds = "proto json\nsubscribe\n";
+    ASSERT_EQ((ssize_t)strlen(cmds), write(sv[0], cmds, strlen(cmds)));
+    shutdown(sv[0], SHUT_WR);
+
+    char buf[16384];
+    size_t len = drain_client(epoll_fd, sv[0], buf, sizeof(buf));
+    ASSERT_NOT_NULL(strstr(json_frame_at(buf, len, 1), "\"subscribed\""));
+    ASSERT_NOT_NULL(strstr(json_frame_at(buf, len, 2), "\"type\":\"status\""));
+    ASSERT_NOT_NULL(strstr(json_frame_at(buf, len, 3), "\"type\":\"caps\""));
+    ASSERT_EQ(1, control_client_count());
+
+    /* Nothing changed: nothing sent */
+    control_publish();
+    ASSERT_EQ(0, drain_client(epoll_fd, sv[0], buf, sizeof(buf)));
+
+    components[0].state = COMP_ACTIVE;
+    capability_register("database", 0);
+    control_publish();
+    len = drain_client(epoll_fd, sv[0], buf, sizeof(buf));
+    char *ev = json_frame_at(buf, len, 0);
+    ASSERT_NOT_NULL(ev);
+    ASSERT_NOT_NULL(strstr(ev, "\"type\":\"component\""));
+    ASSERT_NOT_NULL(strstr(ev, "\"state\":\"ACTIVE\",\"previous\":\"STARTING\""));
+    ev = json_frame_at(buf, len, 1);
+    ASSERT_NOT_NULL(ev);
+    ASSERT_NOT_NULL(strstr(ev, "\"event\":\"up\",\"name\":\"database\""));
+    ASSERT_NOT_NULL(strstr(ev, "\"provider\":\"db\""));
+    ASSERT_NULL(json_frame_at(buf, len, 2));
+
+    capability_mark_degraded("database", 1);
+    control_publish();
+    len = drain_client(epoll_fd, sv[0], buf, sizeof(buf));
+    ASSERT_NOT_NULL(strstr(json_frame_at(buf, len, 0), "\"event\":\"degraded\""));
+
+    /* Hanging up ends the subscription */
+    close(sv[0]);
+    drain_client(epoll_fd, sv[0], buf, sizeof(buf));
+    ASSERT_EQ(0, control_client_count());
+    close(epoll_fd);
+    control_init(-1);
+    n_components = 0;
+}
+
+/* Feed component output through its pipe as the main loop would */
+static void pump_output(int out_epoll) {
+    struct epoll_event ev[4];
+    int n;
+    while ((n = epoll_wait(out_epoll, ev, 4, 50)) > 0) {
+        for (int i = 0; i < n; i++) output_event(ev[i].data.ptr);
+    }
+}
+
+TEST(control_log_follow_streams_output) {
+    n_components = 0;
+    capability_init();
+    create_status_test_component(0, "web", COMP_ACTIVE, 4321);
+    n_components = 1;
+
+    int out_epoll = epoll_create1(0);
+    mkdir("/tmp/yakiros_test_control_out", 0755);
+    output_init(out_epoll, "/tmp/yakiros_test_control_out");
+    int out = output_open("web");
+    ASSERT_TRUE(out >= 0);
+    (void)!write(out, "before\n", 7);
+    pump_output(out_epoll);
+
+    int epoll_fd = epoll_create1(0);
+    int sv[2], js[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv));
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, js));
+    control_init(epoll_fd);
+    ASSERT_EQ(0, control_add_client(sv[1]));
+    ASSERT_EQ(0, control_add_client(js[1]));
+
+    /* Following outlives the end of the request, like a subscription */
+    const char *cmd = "log -f web 5";
+    ASSERT_EQ((ssize_t)strlen(cmd), write(sv[0], cmd, strlen(cmd)));
+    shutdown(sv[0], SHUT_WR);
+    const char *jcmd = "proto json\nlog -f web\n";
+    ASSERT_EQ((ssize_t)strlen(jcmd), write(js[0], jcmd, strlen(jcmd)));
+
+    char buf[16384];
+    drain_client(epoll_fd, sv[0], buf, sizeof(buf));
+    ASSERT_NOT_NULL(strstr(buf, "before\n"));
+    size_t len = drain_client(epoll_fd, js[0], buf, sizeof(buf));
+    ASSERT_NOT_NULL(strstr(json_frame_at(buf, len, 1), "before\\n"));
+    ASSERT_EQ(2, control_client_count());
+
+    (void)!write(out, "after\n", 6);
+    pump_output(out_epoll);
+    drain_client(epoll_fd, sv[0], buf, sizeof(buf));
+    ASSERT_STR_EQ("after\n", buf);
+    len = drain_client(epoll_fd, js[0], buf, sizeof(buf));
+    ASSERT_STR_EQ("{\"type\":\"log\",\"component\":\"web\",\"data\":\"after\\n\"}",
+                  json_frame_at(buf, len, 0));
+
+    /* Unknown components are refused and not followed */
+    int bad[2];
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, bad));
+    ASSERT_EQ(0, control_add_client(bad[1]));
+    ASSERT_EQ((ssize_t)strlen("log -f nosuch"), write(bad[0], "log -f nosuch", 13));
+    shutdown(bad[0], SHUT_WR);
+    drain_client(epoll_fd, bad[0], buf, sizeof(buf));
+    ASSERT_NOT_NULL(strstr(buf, "not found"));
+    ASSERT_EQ(2, control_client_count());
+    close(bad[0]);
+
+    close(sv[0]);
+    close(js[0]);
+    drain_client(epoll_fd, sv[0], buf, sizeof(buf));
+    ASSERT_EQ(0, control_client_count());
+
+    close(out);
+    pump_output(out_epoll);
+    unlink("/tmp/yakiros_test_control_out/web.log");
+    rmdir("/tmp/yakiros_test_control_out");
+    output_init(-1, OUTPUT_DIR);
+    close(out_epoll);
+    close(epoll_fd);
+    control_init(-1);
+    n_components = 0;
+}
+
 int main(void) {
     /* Initialize logging for tests */
     log_open();
+    component_table_reserve(256);
 
     /* Make sure we clean up any leftover test socket */
     unlink(TEST_CONTROL_SOCKET);
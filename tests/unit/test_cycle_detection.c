@@ -10,6 +10,7 @@
 #include "../../src/capability.h"
 #include "../../src/log.h"
 #include <string.h>
+#include <stdlib.h>
 #include <stdio.h>
 
 /* Test helper to create a mock component for cycle testing */
@@ -20,7 +21,7 @@ static void create_cycle_test_component(int idx, const char *name,
     memset(comp, 0, sizeof(*comp));
 
     strncpy(comp->name, name, MAX_NAME - 1);
-    strncpy(comp->binary, "/bin/sleep", MAX_PATH - 1);  /* Mock binary */
+    component_set_str(comp, &comp->binary, "/bin/sleep");  /* Mock binary */
     comp->type = COMP_TYPE_SERVICE;
     comp->state = COMP_INACTIVE;
     comp->pid = -1;
@@ -28,12 +29,12 @@ static void create_cycle_test_component(int idx, const char *name,
     /* Set dependencies */
     comp->n_requires = n_req;
     for (int i = 0; i < n_req && i < MAX_DEPS; i++) {
-        strncpy(comp->requires[i], requires[i], MAX_NAME - 1);
+        component_set_str(comp, &comp->requires[i], requires[i]);
     }
 
     comp->n_provides = n_prov;
     for (int i = 0; i < n_prov && i < MAX_DEPS; i++) {
-        strncpy(comp->provides[i], provides[i], MAX_NAME - 1);
+        component_set_str(comp, &comp->provides[i], provides[i]);
     }
 }
 
@@ -205,8 +206,8 @@ TEST(cycle_complex_interconnected_no_cycle) {
     ASSERT_EQ(0, result);  /* No cycles */
 
     /* Also test topological sort works */
-    int sorted[MAX_COMPONENTS];
-    int topo_result = graph_topological_sort(sorted, MAX_COMPONENTS);
+    int sorted[16];
+    int topo_result = graph_topological_sort(sorted, 16);
     ASSERT_EQ(0, topo_result);
 }
 
@@ -275,9 +276,145 @@ TEST(graph_validation_integration) {
     ASSERT_EQ(0, result);
 }
 
+TEST(cycle_path_is_reported_in_order) {
+    n_components = 0;
+    capability_init();
+
+    /* a -> b -> c -> a, plus d hanging off the cycle */
+    const char *a_req[] = {"cap-b"};
+    const char *a_prov[] = {"cap-a"};
+    create_cycle_test_component(0, "a", a_req, 1, a_prov, 1);
+    const char *b_req[] = {"cap-c"};
+    const char *b_prov[] = {"cap-b"};
+    create_cycle_test_component(1, "b", b_req, 1, b_prov, 1);
+    const char *c_req[] = {"cap-a"};
+    const char *c_prov[] = {"cap-c"};
+    create_cycle_test_component(2, "c", c_req, 1, c_prov, 1);
+    const char *d_req[] = {"cap-a"};
+    const char *d_prov[] = {"cap-d"};
+    create_cycle_test_component(3, "d", d_req, 1, d_prov, 1);
+    n_components = 4;
+
+    cycle_info_t cycle_info;
+    ASSERT_EQ(1, graph_detect_cycles(&cycle_info));
+    ASSERT_EQ(4, cycle_info.cycle_length);
+    ASSERT_STR_EQ("Dependency cycle detected: a -> b -> c -> a", cycle_info.error_message);
+    free(cycle_info.cycle_components);
+
+    graph_metrics_t metrics;
+    ASSERT_EQ(0, graph_analyze_metrics(&metrics));
+    ASSERT_EQ(1, metrics.strongly_connected_components);
+    ASSERT_EQ(1, metrics.max_dependency_depth);   /* d on the cycle */
+}
+
+TEST(long_chain_sorted_and_measured) {
+    /* As long as the capability registry allows */
+    enum { CHAIN = 500 };
+    n_components = 0;
+    capability_init();
+    ASSERT_EQ(0, component_table_reserve(CHAIN));
+
+    char name[32], req[32], prov[32];
+    for (int i = 0; i < CHAIN; i++) {
+        snprintf(name, sizeof(name), "link-%d", i);
+        snprintf(prov, sizeof(prov), "cap-%d", i);
+        snprintf(req, sizeof(req), "cap-%d", i - 1);
+        const char *r[] = {req};
+        const char *p[] = {prov};
+        create_cycle_test_component(i, name, r, i > 0 ? 1 : 0, p, 1);
+    }
+    n_components = CHAIN;
+
+    cycle_info_t cycle_info;
+    ASSERT_EQ(0, graph_detect_cycles(&cycle_info));
+
+    int *sorted = malloc(CHAIN * sizeof(int));
+    ASSERT_EQ(0, graph_topological_sort(sorted, CHAIN));
+    ASSERT_EQ(0, sorted[0]);
+    ASSERT_EQ(CHAIN - 1, sorted[CHAIN - 1]);
+    free(sorted);
+
+    graph_metrics_t metrics;
+    ASSERT_EQ(0, graph_analyze_metrics(&metrics));
+    ASSERT_EQ(CHAIN - 1, metrics.max_dependency_depth);
+    ASSERT_EQ(0, metrics.strongly_connected_components);
+
+    for (int i = 0; i < CHAIN; i++) component_free_strings(&components[i]);
+    n_components = 0;
+}
+
+TEST(scc_and_paths_follow_the_graph) {
+    n_components = 0;
+    capability_init();
+
+    /* web -> api -> {db, cache}; db <-> repl; cache on its own */
+    const char *web_req[] = {"api"};
+    const char *web_prov[] = {"http"};
+    create_cycle_test_component(0, "web", web_req, 1, web_prov, 1);
+    const char *api_req[] = {"sql", "kv"};
+    const char *api_prov[] = {"api"};
+    create_cycle_test_component(1, "api", api_req, 2, api_prov, 1);
+    const char *db_req[] = {"replica"};
+    const char *db_prov[] = {"sql"};
+    create_cycle_test_component(2, "db", db_req, 1, db_prov, 1);
+    const char *repl_req[] = {"sql"};
+    const char *repl_prov[] = {"replica"};
+    create_cycle_test_component(3, "repl", repl_req, 1, repl_prov, 1);
+    const char *cache_prov[] = {"kv"};
+    create_cycle_test_component(4, "cache", NULL, 0, cache_prov, 1);
+    n_components = 5;
+
+    int *cycle = NULL;
+    int n_cycles = -1;
+    ASSERT_EQ(0, graph_find_strongly_connected_components(&cycle, &n_cycles));
+    ASSERT_EQ(1, n_cycles);
+    ASSERT_NOT_NULL(cycle);
+    ASSERT_EQ(-1, cycle[0]);
+    ASSERT_EQ(-1, cycle[1]);
+    ASSERT_EQ(0, cycle[2]);
+    ASSERT_EQ(0, cycle[3]);
+    ASSERT_EQ(-1, cycle[4]);
+    free(cycle);
+
+    ASSERT_EQ(1, graph_depends_on(0, 3));
+    ASSERT_EQ(0, graph_depends_on(4, 0));
+    ASSERT_EQ(1, graph_depends_on(2, 2));     /* on its own cycle */
+    ASSERT_EQ(0, graph_depends_on(1, 1));
+    ASSERT_EQ(-1, graph_depends_on(0, 5));
+
+    int out[8];
+    ASSERT_EQ(4, graph_dependencies(0, out, 8));
+    ASSERT_EQ(2, graph_dependents(4, out, 8)); /* api, web */
+    ASSERT_EQ(0, graph_dependents(0, out, 8));
+    ASSERT_EQ(4, graph_dependents(2, out, 8)); /* web, api, db, repl */
+
+    char desc[256];
+    ASSERT_EQ(0, graph_find_dependency_path("http", "replica", desc, sizeof(desc)));
+    ASSERT_STR_EQ("http [web] -> api [api] -> sql [db] -> replica [repl]", desc);
+    ASSERT_EQ(-1, graph_find_dependency_path("kv", "http", desc, sizeof(desc)));
+    ASSERT_EQ(-1, graph_find_dependency_path("http", "no-such-cap", desc, sizeof(desc)));
+
+    /* The analysis is reused until an edge changes */
+    unsigned int version = graph_analysis_version();
+    ASSERT_EQ(version, graph_analysis_version());
+    components[4].n_requires = 1;
+    component_set_str(&components[4], &components[4].requires[0], "http");
+    components[4].cap_generation = 0;          /* re-intern, as a reload does */
+    ASSERT_NE(version, graph_analysis_version());
+    ASSERT_EQ(1, graph_depends_on(4, 3));
+    ASSERT_EQ(0, graph_find_dependency_path("kv", "http", desc, sizeof(desc)));
+    ASSERT_EQ(0, graph_find_strongly_connected_components(&cycle, &n_cycles));
+    ASSERT_EQ(2, n_cycles);
+    free(cycle);
+
+    for (int i = 0; i < 5; i++) component_free_strings(&components[i]);
+    n_components = 0;
+}
+
 int main(void) {
     /* Initialize logging for tests */
     log_open();
+    component_table_reserve(256);
 
     return RUN_ALL_TESTS();
 }
\ No newline at end of file
@@ -0,0 +1,309 @@
+/*
+ * test_federation.c - Tests for capability federation
+ *
+ * The peer node is played by a UDP socket on the loopback interface.
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/federation.h"
+#include "../../src/capability.h"
+#include "../../src/timer.h"
+#include "../../src/log.h"
+#include <arpa/inet.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define TEST_FED_PORT  47946
+#define TEST_PEER_PORT 47947
+#define TEST_FED_CONFIG "/tmp/yakiros_test_federation.conf"
+#define TEST_SECRET "test federation secret"
+
+static int peer_fd = -1;
+
+/* Federation on TEST_FED_PORT with the fake peer as its only peer */
+static void start_federation(void) {
+    federation_config_t cfg;
+    FILE *f = fopen(TEST_FED_CONFIG, "w");
+    fprintf(f, "node = here\nport = %d\nsecret = " TEST_SECRET "\npeer = 127.0.0.1:%d\n",
+            TEST_FED_PORT, TEST_PEER_PORT);
+    fclose(f);
+    federation_load_config(TEST_FED_CONFIG, &cfg);
+    unlink(TEST_FED_CONFIG);
+    federation_init(-1, &cfg);
+
+    if (peer_fd < 0) {
+        peer_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(TEST_PEER_PORT) };
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(peer_fd, (struct sockaddr *)&addr, sizeof(addr));
+    }
+}
+
+static void send_raw(int fd, const char *msg) {
+    struct sockaddr_in to = { .sin_family = AF_INET, .sin_port = htons(TEST_FED_PORT) };
+    to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sendto(fd, msg, strlen(msg), 0, (struct sockaddr *)&to, sizeof(to));
+    usleep(10000);
+    federation_receive();
+}
+
+/* Send msg with its MAC line under the shared secret */
+static void send_from(int fd, const char *msg) {
+    char buf[FEDERATION_DATAGRAM_MAX + 1];
+    size_t len = strlen(msg);
+    memcpy(buf, msg, len);
+    federation_mac(msg, len, buf + len);
+    strcpy(buf + len + FEDERATION_MAC_HEX, "\n");
+    send_raw(fd, buf);
+}
+
+/* Next datagram federation sent the peer, "" if none within 200ms */
+static char *peer_recv(void) {
+    static char buf[FEDERATION_DATAGRAM_MAX + 1];
+    struct pollfd pfd = { .fd = peer_fd, .events = POLLIN };
+    buf[0] = '\0';
+    if (poll(&pfd, 1, 200) == 1) {
+        ssize_t n = recv(peer_fd, buf, FEDERATION_DATAGRAM_MAX, 0);
+        buf[n > 0 ? n : 0] = '\0';
+    }
+    return buf;
+}
+
+static void drain_peer(void) {
+    char buf[FEDERATION_DATAGRAM_MAX];
+    while (recv(peer_fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) {}
+}
+
+static int changed(int idx) {
+    int out[MAX_CAPABILITIES];
+    int n = capability_take_changes(out, MAX_CAPABILITIES);
+    for (int i = 0; i < n; i++) {
+        if (out[i] == idx) return 1;
+    }
+    return 0;
+}
+
+TEST(config_is_parsed) {
+    federation_config_t cfg;
+    FILE *f = fopen(TEST_FED_CONFIG, "w");
+    fprintf(f, "# cluster\nnode = \"web1\"\nsecret = \"" TEST_SECRET "\"\n\n"
+               "peer = 10.0.0.2\npeer = 10.0.0.3:8000  # db\npeer = [fd00::4]:7000\n");
+    fclose(f);
+    ASSERT_EQ(0, federation_load_config(TEST_FED_CONFIG, &cfg));
+    ASSERT_STR_EQ("web1", cfg.node);
+    ASSERT_STR_EQ(TEST_SECRET, cfg.secret);
+    ASSERT_EQ(FEDERATION_PORT, cfg.port);
+    ASSERT_EQ(3, cfg.n_peers);
+    ASSERT_EQ(FEDERATION_PORT, ntohs(cfg.peers[0].sin6_port));
+    ASSERT_TRUE(IN6_IS_ADDR_V4MAPPED(&cfg.peers[1].sin6_addr));
+    ASSERT_EQ(8000, ntohs(cfg.peers[1].sin6_port));
+    ASSERT_FALSE(IN6_IS_ADDR_V4MAPPED(&cfg.peers[2].sin6_addr));
+    ASSERT_EQ(7000, ntohs(cfg.peers[2].sin6_port));
+
+    f = fopen(TEST_FED_CONFIG, "w");
+    fprintf(f, "node = a@b\npeer = db.example.com\n");
+    fclose(f);
+    ASSERT_EQ(-1, federation_load_config(TEST_FED_CONFIG, &cfg));
+    ASSERT_EQ(0, cfg.n_peers);
+
+    /* Without a secret, or with a short one, peers cannot be trusted */
+    f = fopen(TEST_FED_CONFIG, "w");
+    fprintf(f, "peer = 10.0.0.2\n");
+    fclose(f);
+    ASSERT_EQ(-1, federation_load_config(TEST_FED_CONFIG, &cfg));
+    f = fopen(TEST_FED_CONFIG, "w");
+    fprintf(f, "secret = short\npeer = 10.0.0.2\n");
+    fclose(f);
+    ASSERT_EQ(-1, federation_load_config(TEST_FED_CONFIG, &cfg));
+    ASSERT_EQ(-1, federation_init(-1, &cfg));
+    ASSERT_FALSE(federation_enabled());
+
+    unlink(TEST_FED_CONFIG);
+    ASSERT_EQ(1, federation_load_config(TEST_FED_CONFIG, &cfg));
+}
+
+TEST(remote_capability_follows_the_peer) {
+    capability_init();
+    timer_init();
+    int sql = capability_intern("sql@db1");
+    start_federation();
+    ASSERT_TRUE(federation_enabled());
+    changed(-1);
+
+    send_from(peer_fd, "YKF2 db1 77 0 1 0 0\n+1 sql\n");
+    ASSERT_TRUE(capability_active("sql@db1"));
+    ASSERT_TRUE(changed(sql));
+
+    send_from(peer_fd, "YKF2 db1 77 1 2 0 0\n~2 sql\n");
+    ASSERT_TRUE(capability_active("sql@db1"));
+    ASSERT_TRUE(capability_degraded_by_idx(sql));
+
+    send_from(peer_fd, "YKF2 db1 77 2 3 0 0\n-3 sql\n");
+    ASSERT_FALSE(capability_active("sql@db1"));
+    ASSERT_TRUE(changed(sql));
+
+    /* A late copy of an older state changes nothing */
+    send_from(peer_fd, "YKF2 db1 77 1 2 0 0\n~2 sql\n");
+    ASSERT_FALSE(capability_active("sql@db1"));
+
+    /* Only configured peers are listened to */
+    int stranger = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    send_from(stranger, "YKF2 db1 77 3 4 0 0\n+4 sql\n");
+    close(stranger);
+    ASSERT_FALSE(capability_active("sql@db1"));
+
+    federation_close();
+    ASSERT_FALSE(federation_enabled());
+}
+
+TEST(datagrams_failing_the_mac_are_dropped) {
+    capability_init();
+    timer_init();
+    capability_intern("sql@db1");
+    start_federation();
+
+    /* From the peer's address, but without the secret */
+    send_raw(peer_fd, "YKF2 db1 77 0 1 0 0\n+1 sql\n");
+    ASSERT_FALSE(capability_active("sql@db1"));
+    char forged[256];
+    snprintf(forged, sizeof(forged), "YKF2 db1 77 0 1 0 0\n+1 sql\n%.64d\n", 0);
+    send_raw(peer_fd, forged);
+    ASSERT_FALSE(capability_active("sql@db1"));
+
+    /* Signed, but changed on the way */
+    char buf[256];
+    const char *msg = "YKF2 db1 77 0 1 0 0\n-1 sql\n";
+    strcpy(buf, msg);
+    federation_mac(msg, strlen(msg), buf + strlen(msg));
+    strcat(buf, "\n");
+    buf[strchr(buf, '-') - buf] = '+';
+    send_raw(peer_fd, buf);
+    ASSERT_FALSE(capability_active("sql@db1"));
+
+    send_from(peer_fd, "YKF2 db1 77 0 1 0 0\n+1 sql\n");
+    ASSERT_TRUE(capability_active("sql@db1"));
+
+    /* Our own datagrams carry a MAC the peer can check */
+    drain_peer();
+    federation_tick(timer_now_ms());
+    char *out = peer_recv();
+    size_t len = strlen(out);
+    ASSERT_TRUE(len > FEDERATION_MAC_HEX + 1);
+    out[len - 1] = '\0';
+    ASSERT_TRUE(federation_mac_ok(out, len - FEDERATION_MAC_HEX - 1, out + len - FEDERATION_MAC_HEX - 1));
+
+    federation_close();
+    ASSERT_FALSE(federation_mac_ok(out, len - FEDERATION_MAC_HEX - 1, out + len - FEDERATION_MAC_HEX - 1));
+}
+
+TEST(local_changes_go_out_as_deltas) {
+    capability_init();
+    timer_init();
+    start_federation();
+    drain_peer();
+
+    capability_register("web", 0);
+    federation_flush();
+    char *msg = peer_recv();
+    unsigned int inc, base, upto;
+    ASSERT_EQ(3, sscanf(msg, "YKF2 here %u %u %u", &inc, &base, &upto));
+    ASSERT_EQ(0, (int)base);
+    ASSERT_NOT_NULL(strstr(msg, "\n+1 web\n"));
+
+    /* Once the peer has acknowledged it, only the next change is sent */
+    char ack[128];
+    snprintf(ack, sizeof(ack), "YKF2 db1 5 0 0 %u %u\n", inc, upto);
+    send_from(peer_fd, ack);
+    drain_peer();
+    capability_register("api", 0);
+    capability_mark_degraded("api", 1);
+    federation_flush();
+    msg = peer_recv();
+    ASSERT_NOT_NULL(strstr(msg, "\n~2 api\n"));
+    ASSERT_NULL(strstr(msg, "web"));
+
+    /* Nothing new: no datagram until the heartbeat, which is a bare
+     * header repeating what is unacknowledged */
+    federation_flush();
+    ASSERT_STR_EQ("", peer_recv());
+    federation_tick(timer_now_ms());
+    msg = peer_recv();
+    ASSERT_NOT_NULL(strstr(msg, "~2 api"));
+
+    /* Remote capabilities are not passed on */
+    capability_register("sql@db1", -1);
+    federation_flush();
+    ASSERT_STR_EQ("", peer_recv());
+
+    federation_close();
+    /* Leaving takes everything here down on the peer */
+    msg = peer_recv();
+    ASSERT_NOT_NULL(strstr(msg, "\n-3 web\n-4 api\n"));
+}
+
+TEST(silent_or_restarted_peer_loses_its_capabilities) {
+    capability_init();
+    timer_init();
+    capability_intern("sql@db1");
+    capability_intern("cache@db1");
+    start_federation();
+
+    send_from(peer_fd, "YKF2 db1 77 0 2 0 0\n+1 sql\n+2 cache\n");
+    ASSERT_TRUE(capability_active("sql@db1"));
+    ASSERT_TRUE(capability_active("cache@db1"));
+
+    /* A new incarnation forgets what the old one said */
+    send_from(peer_fd, "YKF2 db1 78 0 1 0 0\n+1 sql\n");
+    ASSERT_TRUE(capability_active("sql@db1"));
+    ASSERT_FALSE(capability_active("cache@db1"));
+
+    /* A replay from the old incarnation is not taken for a restart */
+    send_from(peer_fd, "YKF2 db1 77 0 2 0 0\n+1 sql\n+2 cache\n");
+    ASSERT_TRUE(capability_active("sql@db1"));
+    ASSERT_FALSE(capability_active("cache@db1"));
+
+    federation_tick(timer_now_ms() + FEDERATION_DEAD_MS);
+    ASSERT_FALSE(capability_active("sql@db1"));
+
+    /* Nor, once it is gone, for its return */
+    send_from(peer_fd, "YKF2 db1 77 0 2 0 0\n+1 sql\n+2 cache\n");
+    ASSERT_FALSE(capability_active("sql@db1"));
+
+    federation_peer_t info;
+    ASSERT_EQ(0, federation_peer(0, &info));
+    ASSERT_STR_EQ("db1", info.node);
+    ASSERT_STR_EQ("127.0.0.1:47947", info.addr);
+    ASSERT_FALSE(info.alive);
+    ASSERT_EQ(-1, federation_peer(1, &info));
+
+    federation_close();
+}
+
+TEST(requirement_added_later_sees_known_state) {
+    capability_init();
+    timer_init();
+    start_federation();
+
+    send_from(peer_fd, "YKF2 db1 77 0 1 0 0\n+1 queue\n");
+
+    /* As when a component requiring it is loaded */
+    int idx = capability_intern("queue@db1");
+    ASSERT_FALSE(capability_active_by_idx(idx));
+    federation_flush();
+    ASSERT_TRUE(capability_active_by_idx(idx));
+
+    federation_close();
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+
+    int result = RUN_ALL_TESTS();
+    if (peer_fd >= 0) close(peer_fd);
+    return result;
+}
@@ -0,0 +1,104 @@
+/*
+ * test_filewatch.c - Tests for inotify-based readiness file watches
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/filewatch.h"
+#include "../../src/log.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+
+#define WATCH_DIR "/tmp/yakiros_filewatch_test"
+
+static int seen[256];
+
+static void record_change(int idx) {
+    seen[idx]++;
+}
+
+static void touch(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (f) fclose(f);
+}
+
+static int epfd = -1;
+
+TEST(filewatch_reports_created_file) {
+    mkdir(WATCH_DIR, 0755);
+    unlink(WATCH_DIR "/a.ready");
+    unlink(WATCH_DIR "/b.ready");
+    memset(seen, 0, sizeof(seen));
+
+    ASSERT_TRUE(filewatch_init(epfd) >= 0);
+    ASSERT_EQ(0, filewatch_add(3, WATCH_DIR "/a.ready"));
+    ASSERT_EQ(0, filewatch_add(4, WATCH_DIR "/b.ready"));
+    ASSERT_TRUE(filewatch_active(3));
+    ASSERT_TRUE(filewatch_active(4));
+
+    /* Unrelated files in the directory do not wake anyone */
+    touch(WATCH_DIR "/other");
+    touch(WATCH_DIR "/a.ready");
+
+    struct epoll_event ev;
+    ASSERT_EQ(1, epoll_wait(epfd, &ev, 1, 2000));
+    filewatch_dispatch(record_change);
+    ASSERT_EQ(1, seen[3]);
+    ASSERT_EQ(0, seen[4]);
+
+    /* Files renamed into place count too */
+    touch(WATCH_DIR "/b.tmp");
+    rename(WATCH_DIR "/b.tmp", WATCH_DIR "/b.ready");
+    ASSERT_EQ(1, epoll_wait(epfd, &ev, 1, 2000));
+    filewatch_dispatch(record_change);
+    ASSERT_EQ(1, seen[4]);
+
+    filewatch_clear();
+    ASSERT_FALSE(filewatch_active(3));
+    ASSERT_FALSE(filewatch_active(4));
+}
+
+TEST(filewatch_shared_directory_survives_one_removal) {
+    mkdir(WATCH_DIR, 0755);
+    unlink(WATCH_DIR "/c.ready");
+    memset(seen, 0, sizeof(seen));
+
+    ASSERT_EQ(0, filewatch_add(1, WATCH_DIR "/gone.ready"));
+    ASSERT_EQ(0, filewatch_add(2, WATCH_DIR "/c.ready"));
+
+    /* Same directory, same inotify watch: removing one keeps the other */
+    filewatch_remove(1);
+    ASSERT_TRUE(filewatch_active(2));
+
+    touch(WATCH_DIR "/c.ready");
+    struct epoll_event ev;
+    ASSERT_EQ(1, epoll_wait(epfd, &ev, 1, 2000));
+    filewatch_dispatch(record_change);
+    ASSERT_EQ(0, seen[1]);
+    ASSERT_EQ(1, seen[2]);
+    filewatch_clear();
+}
+
+TEST(filewatch_missing_directory_is_not_watchable) {
+    ASSERT_EQ(-1, filewatch_add(5, "/nonexistent/yakiros/dir/file.ready"));
+    ASSERT_FALSE(filewatch_active(5));
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    int result = RUN_ALL_TESTS();
+
+    unlink(WATCH_DIR "/a.ready");
+    unlink(WATCH_DIR "/b.ready");
+    unlink(WATCH_DIR "/c.ready");
+    unlink(WATCH_DIR "/other");
+    rmdir(WATCH_DIR);
+    close(epfd);
+    return result;
+}
@@ -25,7 +25,7 @@ static void create_test_component(int idx, const char *name, comp_type_t type,
     memset(comp, 0, sizeof(*comp));
 
     strncpy(comp->name, name, MAX_NAME - 1);
-    strncpy(comp->binary, "/bin/true", MAX_PATH - 1);  /* Mock binary */
+    component_set_str(comp, &comp->binary, "/bin/true");  /* Mock binary */
     comp->type = type;
     comp->state = COMP_INACTIVE;
     comp->pid = -1;
@@ -33,12 +33,12 @@ static void create_test_component(int idx, const char *name, comp_type_t type,
     /* Set dependencies */
     comp->n_requires = n_req;
     for (int i = 0; i < n_req && i < MAX_DEPS; i++) {
-        strncpy(comp->requires[i], requires[i], MAX_NAME - 1);
+        component_set_str(comp, &comp->requires[i], requires[i]);
     }
 
     comp->n_provides = n_prov;
     for (int i = 0; i < n_prov && i < MAX_DEPS; i++) {
-        strncpy(comp->provides[i], provides[i], MAX_NAME - 1);
+        component_set_str(comp, &comp->provides[i], provides[i]);
     }
 }
 
@@ -185,6 +185,100 @@ TEST(graph_resolve_dependency_loss) {
     ASSERT_FALSE(capability_active("cap-b"));
 }
 
+TEST(graph_resolve_pending_only_touches_dependents) {
+    /* Reset state and drain anything queued by earlier tests */
+    n_components = 0;
+    capability_init();
+    graph_resolve_pending();
+
+    const char *a_req[] = {};
+    const char *a_prov[] = {"cap-a"};
+    create_test_component(0, "provider", COMP_TYPE_SERVICE,
+                          a_req, 0, a_prov, 1);
+
+    const char *b_req[] = {"cap-a"};
+    const char *b_prov[] = {"cap-b"};
+    create_test_component(1, "consumer", COMP_TYPE_SERVICE,
+                          b_req, 1, b_prov, 1);
+
+    const char *c_req[] = {};
+    const char *c_prov[] = {"cap-c"};
+    create_test_component(2, "bystander", COMP_TYPE_SERVICE,
+                          c_req, 0, c_prov, 1);
+
+    n_components = 3;
+
+    /* Provider comes up outside the resolver */
+    components[0].state = COMP_ACTIVE;
+    capability_register("cap-a", 0);
+
+    /* Only the consumer of cap-a should be evaluated */
+    int changes = graph_resolve_pending();
+    ASSERT_EQ(1, changes);
+    ASSERT_EQ(COMP_ACTIVE, components[1].state);
+    ASSERT_TRUE(capability_active("cap-b"));
+    ASSERT_EQ(COMP_INACTIVE, components[2].state);
+
+    /* Nothing left to do */
+    ASSERT_EQ(0, graph_resolve_pending());
+}
+
+TEST(graph_resolve_pending_withdraw_cascades) {
+    n_components = 0;
+    capability_init();
+    graph_resolve_pending();
+
+    const char *a_req[] = {};
+    const char *a_prov[] = {"cap-a"};
+    create_test_component(0, "provider", COMP_TYPE_SERVICE,
+                          a_req, 0, a_prov, 1);
+
+    const char *b_req[] = {"cap-a"};
+    const char *b_prov[] = {"cap-b"};
+    create_test_component(1, "middle", COMP_TYPE_SERVICE,
+                          b_req, 1, b_prov, 1);
+
+    const char *c_req[] = {"cap-b"};
+    const char *c_prov[] = {"cap-c"};
+    create_test_component(2, "leaf", COMP_TYPE_SERVICE,
+                          c_req, 1, c_prov, 1);
+
+    n_components = 3;
+
+    graph_resolve_full();
+    ASSERT_EQ(COMP_ACTIVE, components[2].state);
+
+    /* Provider dies: withdrawal must propagate down the chain */
+    components[0].state = COMP_FAILED;
+    capability_withdraw("cap-a");
+
+    int changes = graph_resolve_pending();
+    ASSERT_EQ(2, changes);
+    ASSERT_EQ(COMP_FAILED, components[1].state);
+    ASSERT_EQ(COMP_FAILED, components[2].state);
+    ASSERT_FALSE(capability_active("cap-c"));
+}
+
+TEST(graph_mark_dirty_queues_component) {
+    n_components = 0;
+    capability_init();
+    graph_resolve_pending();
+
+    const char *req[] = {};
+    const char *prov[] = {"standalone"};
+    create_test_component(0, "standalone", COMP_TYPE_SERVICE,
+                          req, 0, prov, 1);
+    n_components = 1;
+
+    /* Not queued yet, so the incremental resolver ignores it */
+    ASSERT_EQ(0, graph_resolve_pending());
+    ASSERT_EQ(COMP_INACTIVE, components[0].state);
+
+    graph_mark_dirty(0);
+    ASSERT_EQ(1, graph_resolve_pending());
+    ASSERT_EQ(COMP_ACTIVE, components[0].state);
+}
+
 TEST(graph_resolve_full_converges) {
     /* Reset state */
     n_components = 0;
@@ -292,7 +386,7 @@ static void create_readiness_test_component(int idx, const char *name, comp_type
     memset(comp, 0, sizeof(*comp));
 
     strncpy(comp->name, name, MAX_NAME - 1);
-    strncpy(comp->binary, "/bin/true", MAX_PATH - 1);
+    component_set_str(comp, &comp->binary, "/bin/true");
     comp->type = type;
     comp->state = COMP_INACTIVE;
     comp->pid = -1;
@@ -303,19 +397,21 @@ static void create_readiness_test_component(int idx, const char *name, comp_type
     /* Set dependencies */
     comp->n_requires = n_req;
     for (int i = 0; i < n_req && i < MAX_DEPS; i++) {
-        strncpy(comp->requires[i], requires[i], MAX_NAME - 1);
+        component_set_str(comp, &comp->requires[i], requires[i]);
     }
 
     comp->n_provides = n_prov;
     for (int i = 0; i < n_prov && i < MAX_DEPS; i++) {
-        strncpy(comp->provides[i], provides[i], MAX_NAME - 1);
+        component_set_str(comp, &comp->provides[i], provides[i]);
     }
 
     /* Configure readiness method */
     if (readiness_method == READINESS_FILE) {
-        snprintf(comp->readiness_file, MAX_PATH, "/tmp/test_ready_%s", name);
+        char path[MAX_PATH];
+        snprintf(path, sizeof(path), "/tmp/test_ready_%s", name);
+        component_set_str(comp, &comp->readiness_file, path);
     } else if (readiness_method == READINESS_COMMAND) {
-        strcpy(comp->readiness_check, "/bin/true");
+        component_set_str(comp, &comp->readiness_check, "/bin/true");
     } else if (readiness_method == READINESS_SIGNAL) {
         comp->readiness_signal = SIGUSR1;
     }
@@ -578,8 +674,8 @@ TEST(topological_sort_no_cycles) {
     n_components = 4;
 
     /* Test topological sort */
-    int sorted_components[MAX_COMPONENTS];
-    int result = graph_topological_sort(sorted_components, MAX_COMPONENTS);
+    int sorted_components[8];
+    int result = graph_topological_sort(sorted_components, 8);
 
     ASSERT_EQ(0, result);  /* Success */
 
@@ -616,12 +712,91 @@ TEST(topological_sort_with_cycles) {
     n_components = 2;
 
     /* Test topological sort - should fail due to cycle */
-    int sorted_components[MAX_COMPONENTS];
-    int result = graph_topological_sort(sorted_components, MAX_COMPONENTS);
+    int sorted_components[8];
+    int result = graph_topological_sort(sorted_components, 8);
 
     ASSERT_EQ(-1, result);  /* Failure due to cycles */
 }
 
+TEST(graph_compute_levels_diamond) {
+    n_components = 0;
+    capability_init();
+
+    /* A -> B, A -> D, B + D -> C */
+    const char *a_req[] = {};
+    const char *a_prov[] = {"cap-a"};
+    create_test_component(0, "comp-a", COMP_TYPE_SERVICE, a_req, 0, a_prov, 1);
+
+    const char *c_req[] = {"cap-b", "cap-d"};
+    const char *c_prov[] = {"cap-c"};
+    create_test_component(1, "comp-c", COMP_TYPE_SERVICE, c_req, 2, c_prov, 1);
+
+    const char *b_req[] = {"cap-a"};
+    const char *b_prov[] = {"cap-b"};
+    create_test_component(2, "comp-b", COMP_TYPE_SERVICE, b_req, 1, b_prov, 1);
+
+    const char *d_req[] = {"cap-a"};
+    const char *d_prov[] = {"cap-d"};
+    create_test_component(3, "comp-d", COMP_TYPE_SERVICE, d_req, 1, d_prov, 1);
+
+    n_components = 4;
+
+    int levels[8];
+    ASSERT_EQ(3, graph_compute_levels(levels));
+    ASSERT_EQ(0, levels[0]);
+    ASSERT_EQ(2, levels[1]);
+    ASSERT_EQ(1, levels[2]);
+    ASSERT_EQ(1, levels[3]);
+}
+
+TEST(graph_boot_scheduler_respects_cap) {
+    n_components = 0;
+    capability_init();
+    graph_resolve_pending();
+
+    /* Three independent services that wait for readiness, and one that
+     * needs all of them */
+    const char *req[] = {};
+    const char *p0[] = {"cap-0"};
+    const char *p1[] = {"cap-1"};
+    const char *p2[] = {"cap-2"};
+    create_readiness_test_component(0, "svc-0", COMP_TYPE_SERVICE, req, 0, p0, 1,
+                                    READINESS_FILE, 30);
+    create_readiness_test_component(1, "svc-1", COMP_TYPE_SERVICE, req, 0, p1, 1,
+                                    READINESS_FILE, 30);
+    create_readiness_test_component(2, "svc-2", COMP_TYPE_SERVICE, req, 0, p2, 1,
+                                    READINESS_FILE, 30);
+
+    const char *top_req[] = {"cap-0", "cap-1", "cap-2"};
+    const char *top_prov[] = {"cap-top"};
+    create_test_component(3, "top", COMP_TYPE_SERVICE, top_req, 3, top_prov, 1);
+
+    n_components = 4;
+
+    ASSERT_EQ(2, graph_boot_begin(2));
+    ASSERT_TRUE(graph_boot_active());
+    graph_resolve_full();
+
+    /* Only two of the level-0 services may be starting at once */
+    ASSERT_EQ(COMP_READY_WAIT, components[0].state);
+    ASSERT_EQ(COMP_READY_WAIT, components[1].state);
+    ASSERT_EQ(COMP_INACTIVE, components[2].state);
+
+    /* One becomes ready: the third gets its slot */
+    component_ready(0);
+    graph_resolve_pending();
+    ASSERT_EQ(COMP_READY_WAIT, components[2].state);
+    ASSERT_EQ(COMP_INACTIVE, components[3].state);
+
+    /* The rest become ready: the next level starts and boot completes */
+    component_ready(1);
+    component_ready(2);
+    graph_resolve_pending();
+    ASSERT_EQ(COMP_ACTIVE, components[3].state);
+    ASSERT_TRUE(capability_active("cap-top"));
+    ASSERT_FALSE(graph_boot_active());
+}
+
 TEST(graph_analyze_metrics) {
     /* Reset state */
     n_components = 0;
@@ -707,6 +882,7 @@ TEST(cycle_detection_single_component_no_deps) {
 int main(void) {
     /* Initialize logging for tests */
     log_open();
+    component_table_reserve(256);
 
     return RUN_ALL_TESTS();
 }
\ No newline at end of file
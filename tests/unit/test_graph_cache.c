@@ -0,0 +1,188 @@
+/*
+ * test_graph_cache.c - Tests for the compiled component graph cache
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/component.h"
+#include "../../src/capability.h"
+#include "../../src/graph-cache.h"
+#include "../../src/log.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define CACHE_DIR "/tmp/yakiros_graph_cache_test"
+#define CACHE_FILE CACHE_DIR "/cache/graph.cache"
+
+static void write_component(const char *name, const char *binary, const char *requires) {
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), CACHE_DIR "/%s.toml", name);
+    FILE *f = fopen(path, "w");
+    if (!f) return;
+    fprintf(f, "[component]\nname = \"%s\"\nbinary = \"%s\"\nargs = [\"-f\", \"%s.conf\"]\n\n",
+            name, binary, name);
+    fprintf(f, "[requires]\ncapabilities = [\"%s\"]\n\n", requires);
+    fprintf(f, "[provides]\ncapabilities = [\"%s.api\"]\n", name);
+    fclose(f);
+}
+
+static void reset_dir(void) {
+    DIR *d = opendir(CACHE_DIR);
+    if (d) {
+        struct dirent *ent;
+        while ((ent = readdir(d)) != NULL) {
+            char path[MAX_PATH];
+            snprintf(path, sizeof(path), CACHE_DIR "/%s", ent->d_name);
+            unlink(path);
+        }
+        closedir(d);
+    }
+    unlink(CACHE_FILE);
+    rmdir(CACHE_DIR "/cache");
+    mkdir(CACHE_DIR, 0755);
+}
+
+static void reload(void) {
+    component_table_clear();
+    capability_init();
+    load_components(CACHE_DIR);
+}
+
+static component_t *find(const char *name) {
+    for (int i = 0; i < n_components; i++) {
+        if (strcmp(components[i].name, name) == 0) return &components[i];
+    }
+    return NULL;
+}
+
+TEST(cache_written_and_reused) {
+    reset_dir();
+    graph_cache_set_path(CACHE_FILE);
+    write_component("alpha", "/bin/alpha", "network");
+    write_component("beta", "/bin/beta", "alpha.api");
+
+    reload();
+    ASSERT_EQ(2, n_components);
+    ASSERT_EQ(2, graph_cache_open());
+    graph_cache_close();
+
+    /* The second load takes both records from the cache */
+    reload();
+    ASSERT_EQ(2, n_components);
+    component_t *beta = find("beta");
+    ASSERT_NOT_NULL(beta);
+    ASSERT_STR_EQ("/bin/beta", beta->binary);
+    ASSERT_EQ(2, beta->argc);
+    ASSERT_STR_EQ("beta.conf", beta->args[1]);
+    ASSERT_STR_EQ(CACHE_DIR "/beta.toml", beta->config_path);
+    ASSERT_STR_EQ("alpha.api", beta->requires[0]);
+    ASSERT_STR_EQ("/", beta->isolation_root);
+
+    /* Capability IDs are interned afresh for this process */
+    ASSERT_EQ(capability_index("alpha.api"), beta->requires_id[0]);
+    ASSERT_EQ(capability_index("beta.api"), beta->provides_id[0]);
+}
+
+TEST(cache_lookup_checks_file_identity) {
+    reset_dir();
+    graph_cache_set_path(CACHE_FILE);
+    write_component("alpha", "/bin/alpha", "network");
+    reload();
+
+    struct stat st;
+    ASSERT_EQ(0, stat(CACHE_DIR "/alpha.toml", &st));
+    graph_cache_key_t key;
+    graph_cache_key(&st, &key);
+
+    component_t comp;
+    ASSERT_EQ(1, graph_cache_open());
+    ASSERT_EQ(0, graph_cache_lookup(CACHE_DIR "/alpha.toml", &key, &comp));
+    ASSERT_STR_EQ("alpha", comp.name);
+    component_free_strings(&comp);
+
+    key.size++;
+    ASSERT_EQ(-1, graph_cache_lookup(CACHE_DIR "/alpha.toml", &key, &comp));
+    key.size--;
+    ASSERT_EQ(-1, graph_cache_lookup(CACHE_DIR "/other.toml", &key, &comp));
+    graph_cache_close();
+}
+
+TEST(changed_file_is_parsed_again) {
+    reset_dir();
+    graph_cache_set_path(CACHE_FILE);
+    write_component("alpha", "/bin/alpha", "network");
+    write_component("beta", "/bin/beta", "network");
+    reload();
+
+    write_component("beta", "/usr/local/bin/beta-v2", "network");
+    reload();
+    ASSERT_EQ(2, n_components);
+    ASSERT_STR_EQ("/usr/local/bin/beta-v2", find("beta")->binary);
+    ASSERT_STR_EQ("/bin/alpha", find("alpha")->binary);
+
+    /* Removed files drop out of the rewritten cache */
+    unlink(CACHE_DIR "/alpha.toml");
+    reload();
+    ASSERT_EQ(1, n_components);
+    ASSERT_EQ(1, graph_cache_open());
+    graph_cache_close();
+}
+
+TEST(damaged_cache_is_ignored) {
+    reset_dir();
+    graph_cache_set_path(CACHE_FILE);
+    write_component("alpha", "/bin/alpha", "network");
+    reload();
+
+    /* Truncate the cache in the middle of a record */
+    struct stat st;
+    ASSERT_EQ(0, stat(CACHE_FILE, &st));
+    ASSERT_EQ(0, truncate(CACHE_FILE, st.st_size / 2));
+    ASSERT_EQ(-1, graph_cache_open());
+
+    reload();
+    ASSERT_EQ(1, n_components);
+    ASSERT_STR_EQ("/bin/alpha", components[0].binary);
+    ASSERT_EQ(1, graph_cache_open());
+    graph_cache_close();
+}
+
+TEST(parallel_parse_loads_every_file) {
+    reset_dir();
+    graph_cache_set_path(NULL);
+
+    char name[MAX_NAME];
+    for (int i = 0; i < 200; i++) {
+        snprintf(name, sizeof(name), "svc%03d", i);
+        write_component(name, "/bin/true", "network");
+    }
+
+    reload();
+    ASSERT_EQ(200, n_components);
+    for (int i = 0; i < n_components; i++) {
+        char path[MAX_PATH];
+        snprintf(path, sizeof(path), CACHE_DIR "/%s.toml", components[i].name);
+        ASSERT_STR_EQ(path, components[i].config_path);
+        ASSERT_EQ(capability_index("network"), components[i].requires_id[0]);
+    }
+    ASSERT_NOT_NULL(find("svc000"));
+    ASSERT_NOT_NULL(find("svc199"));
+
+    /* No cache path, no cache file */
+    ASSERT_EQ(-1, access(CACHE_FILE, F_OK));
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+    component_table_reserve(256);
+
+    int result = RUN_ALL_TESTS();
+    reset_dir();
+    rmdir(CACHE_DIR);
+    return result;
+}
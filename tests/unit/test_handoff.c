@@ -0,0 +1,190 @@
+/*
+ * test_handoff.c - Tests for hot-swap file descriptor passing
+ *
+ * Both ends of a handoff run in the test process, over a socketpair.
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/handoff.h"
+#include "../../src/log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+/* More than one batch, and both ends' copies still fit a 1024 fd limit */
+#define MANY_FDS (HANDOFF_BATCH_FDS + 50)
+
+static int listen_on_loopback(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+        return -1;
+    }
+    return fd;
+}
+
+TEST(many_fds_cross_in_batches_with_descriptions) {
+    int socks[2];
+    ASSERT_EQ(0, create_handoff_socketpair(socks));
+
+    int fds[MANY_FDS];
+    fds[0] = listen_on_loopback();
+    ASSERT_TRUE(fds[0] >= 0);
+    for (int i = 1; i < MANY_FDS; i++) {
+        fds[i] = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        ASSERT_TRUE(fds[i] >= 0);
+    }
+
+    ASSERT_EQ(0, handoff_send(socks[0], fds, MANY_FDS));
+
+    handoff_fd_t *got = NULL;
+    ASSERT_EQ(MANY_FDS, handoff_recv(socks[1], 5000, &got));
+    ASSERT_NOT_NULL(got);
+
+    /* The listening socket arrives described as the sender saw it */
+    struct sockaddr_in bound;
+    socklen_t len = sizeof(bound);
+    ASSERT_EQ(0, getsockname(fds[0], (struct sockaddr *)&bound, &len));
+    ASSERT_EQ(SOCK_STREAM, got[0].type);
+    ASSERT_EQ(AF_INET, got[0].family);
+    ASSERT_EQ(1, got[0].listening);
+    ASSERT_EQ((int)sizeof(bound), (int)got[0].addr_len);
+    ASSERT_EQ(bound.sin_port, ((struct sockaddr_in *)&got[0].addr)->sin_port);
+
+    struct stat st;
+    ASSERT_EQ(0, fstat(fds[0], &st));
+    ASSERT_TRUE(st.st_ino == got[0].ino);
+
+    /* ... and is the same socket */
+    ASSERT_EQ(0, fstat(got[0].fd, &st));
+    ASSERT_TRUE(st.st_ino == got[0].ino);
+    ASSERT_TRUE(fcntl(got[0].fd, F_GETFD) & FD_CLOEXEC);
+
+    /* Descriptors past the first batch keep their order */
+    ASSERT_EQ(0, stat("/dev/null", &st));
+    ASSERT_EQ(0, got[MANY_FDS - 1].type);
+    ASSERT_TRUE(st.st_ino == got[MANY_FDS - 1].ino);
+    ASSERT_TRUE(st.st_ino == got[HANDOFF_BATCH_FDS].ino);
+
+    for (int i = 0; i < MANY_FDS; i++) {
+        close(fds[i]);
+        close(got[i].fd);
+    }
+    free(got);
+    close(socks[0]);
+    close(socks[1]);
+}
+
+TEST(empty_handoff_and_completion) {
+    int socks[2];
+    ASSERT_EQ(0, create_handoff_socketpair(socks));
+
+    /* Nothing to hand over is said so explicitly */
+    handoff_fd_t *got = NULL;
+    ASSERT_EQ(0, handoff_send(socks[0], NULL, 0));
+    ASSERT_EQ(0, send_handoff_complete(socks[0]));
+    ASSERT_EQ(0, handoff_recv(socks[1], 1000, &got));
+    free(got);
+    ASSERT_EQ(0, wait_handoff_complete(socks[1], 1000));
+
+    /* Nothing arriving is a timeout */
+    ASSERT_EQ(-1, wait_handoff_complete(socks[1], 50));
+    ASSERT_EQ(ETIMEDOUT, errno);
+    ASSERT_EQ(-1, handoff_recv(socks[1], 50, &got));
+    ASSERT_NULL(got);
+
+    close(socks[0]);
+    close(socks[1]);
+}
+
+TEST(receiver_takes_what_has_arrived) {
+    int socks[2];
+    ASSERT_EQ(0, create_handoff_socketpair(socks));
+    handoff_rx_t *rx = handoff_rx_new(1);
+    ASSERT_NOT_NULL(rx);
+
+    /* Nothing yet, then the descriptors but not the completion */
+    ASSERT_EQ(0, handoff_rx_feed(rx, socks[1]));
+    int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    ASSERT_EQ(0, handoff_send(socks[0], &fd, 1));
+    ASSERT_EQ(0, handoff_rx_feed(rx, socks[1]));
+    handoff_fd_t *got = NULL;
+    ASSERT_EQ(-1, handoff_rx_take(rx, &got));
+
+    /* The completion a byte at a time */
+    for (int i = 0; i < HANDOFF_COMPLETE_LEN - 1; i++) {
+        ASSERT_EQ(1, (int)write(socks[0], HANDOFF_COMPLETE_MSG + i, 1));
+        ASSERT_EQ(0, handoff_rx_feed(rx, socks[1]));
+    }
+    ASSERT_EQ(1, (int)write(socks[0], HANDOFF_COMPLETE_MSG + HANDOFF_COMPLETE_LEN - 1, 1));
+    ASSERT_EQ(1, handoff_rx_feed(rx, socks[1]));
+    ASSERT_EQ(1, handoff_rx_take(rx, &got));
+    ASSERT_NOT_NULL(got);
+    ASSERT_TRUE(got[0].fd >= 0 && got[0].fd != fd);
+    close(got[0].fd);
+    free(got);
+    handoff_rx_free(rx);
+
+    /* A sender gone halfway leaves nothing open */
+    rx = handoff_rx_new(1);
+    ASSERT_EQ(0, handoff_send(socks[0], &fd, 1));
+    close(socks[0]);
+    ASSERT_EQ(-1, handoff_rx_feed(rx, socks[1]));
+    ASSERT_EQ(EPIPE, errno);
+    handoff_rx_free(rx);
+
+    close(fd);
+    close(socks[1]);
+}
+
+TEST(foreign_messages_are_rejected) {
+    int socks[2];
+    ASSERT_EQ(0, create_handoff_socketpair(socks));
+
+    /* Completion where descriptors were expected */
+    handoff_fd_t *got = NULL;
+    ASSERT_EQ(0, send_handoff_complete(socks[0]));
+    ASSERT_EQ(-1, handoff_recv(socks[1], 1000, &got));
+    ASSERT_EQ(EPROTO, errno);
+    ASSERT_NULL(got);
+
+    /* A sender that goes away mid-handoff */
+    close(socks[0]);
+    ASSERT_EQ(-1, handoff_recv(socks[1], 1000, &got));
+    close(socks[1]);
+}
+
+TEST(single_message_fd_passing) {
+    int socks[2];
+    ASSERT_EQ(0, create_handoff_socketpair(socks));
+
+    int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    ASSERT_TRUE(fd >= 0);
+    ASSERT_EQ(0, send_fds(socks[0], &fd, 1));
+
+    int received = -1;
+    ASSERT_EQ(1, recv_fds(socks[1], &received, 1));
+    ASSERT_TRUE(received >= 0);
+    ASSERT_NE(fd, received);
+
+    close(fd);
+    close(received);
+    close(socks[0]);
+    close(socks[1]);
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,233 @@
+/*
+ * test_kexec.c - Tests for the kexec checkpoint and restore schedule
+ *
+ * The schedule runs over a made-up graph of nodes. A node's "process" is
+ * a fake pid that finishes the second time it is collected, so every
+ * round leaves jobs in flight, as CRIU would.
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/kexec.h"
+#include "../../src/log.h"
+#include <string.h>
+
+#define MAX_NODES 8
+#define FAKE_PID_BASE 1000
+
+typedef struct {
+    int next[MAX_NODES][MAX_NODES];   /* the nodes each one releases */
+    int n_next[MAX_NODES];
+    int polls[MAX_NODES];
+    int fail_start;                   /* node that cannot start, -1 for none */
+    int fail_result;                  /* node whose process fails, -1 for none */
+    int stop_on_failure;
+    int started[MAX_NODES], n_started;
+    int done[MAX_NODES], n_done;
+    int seq;                          /* counts starts and finishes */
+    int started_at[MAX_NODES], done_at[MAX_NODES];
+    int results[MAX_NODES];
+    int cycles[MAX_NODES], n_cycles;
+    int running, max_running;
+} fake_t;
+
+static void fake_init(fake_t *f) {
+    memset(f, 0, sizeof(*f));
+    f->fail_start = f->fail_result = -1;
+}
+
+/* to waits for from: to starts once from is done */
+static void fake_edge(fake_t *f, int *waiting, int from, int to) {
+    f->next[from][f->n_next[from]++] = to;
+    waiting[to]++;
+}
+
+static pid_t fake_start(void *ctx, int node) {
+    fake_t *f = ctx;
+    f->started[f->n_started++] = node;
+    f->started_at[node] = ++f->seq;
+    if (node == f->fail_start) return -1;
+    f->polls[node] = 0;
+    if (++f->running > f->max_running) f->max_running = f->running;
+    return FAKE_PID_BASE + node;
+}
+
+static int fake_collect(void *ctx, pid_t pid, uint64_t started_ms, uint64_t now, int *result) {
+    fake_t *f = ctx;
+    int node = pid - FAKE_PID_BASE;
+    (void)started_ms;
+    (void)now;
+    if (++f->polls[node] < 2) return 0;
+    f->running--;
+    *result = node == f->fail_result ? -1 : 0;
+    return 1;
+}
+
+static int fake_finished(void *ctx, int node, int result, uint64_t took_ms) {
+    fake_t *f = ctx;
+    (void)took_ms;
+    f->results[node] = result;
+    f->done[f->n_done++] = node;
+    f->done_at[node] = ++f->seq;
+    return result != 0 && f->stop_on_failure ? -1 : 0;
+}
+
+static int fake_released(void *ctx, int node, const int **nodes) {
+    fake_t *f = ctx;
+    *nodes = f->next[node];
+    return f->n_next[node];
+}
+
+static void fake_cycle(void *ctx, int node) {
+    fake_t *f = ctx;
+    f->cycles[f->n_cycles++] = node;
+}
+
+static void fake_pause(void *ctx) {
+    (void)ctx;
+}
+
+static int fake_schedule(fake_t *f, int count, unsigned char *todo, int *waiting, int workers) {
+    kexec_schedule_ops_t ops = {
+        .ctx = f, .start = fake_start, .collect = fake_collect, .finished = fake_finished,
+        .released = fake_released, .cycle = fake_cycle, .pause = fake_pause,
+    };
+    return kexec_schedule(&ops, count, todo, waiting, workers);
+}
+
+static int position(const int *list, int n, int node) {
+    for (int i = 0; i < n; i++) {
+        if (list[i] == node) return i;
+    }
+    return -1;
+}
+
+/* Whether node started only after from was done */
+static int started_after(const fake_t *f, int from, int node) {
+    return f->done_at[from] && f->started_at[node] > f->done_at[from];
+}
+
+TEST(providers_go_before_their_consumers) {
+    fake_t f;
+    fake_init(&f);
+    unsigned char todo[5] = { 1, 1, 1, 1, 1 };
+    int waiting[5] = { 0 };
+
+    /* web (3) needs app (2) and cache (1), which need db (0); log (4)
+     * needs nothing */
+    fake_edge(&f, waiting, 0, 1);
+    fake_edge(&f, waiting, 0, 2);
+    fake_edge(&f, waiting, 1, 3);
+    fake_edge(&f, waiting, 2, 3);
+
+    ASSERT_EQ(5, fake_schedule(&f, 5, todo, waiting, 4));
+    ASSERT_EQ(5, f.n_done);
+    ASSERT_TRUE(started_after(&f, 0, 1));
+    ASSERT_TRUE(started_after(&f, 0, 2));
+    ASSERT_TRUE(started_after(&f, 1, 3));
+    ASSERT_TRUE(started_after(&f, 2, 3));
+    ASSERT_EQ(0, f.n_cycles);
+
+    /* log ran alongside db, and the two waiting for db together */
+    ASSERT_TRUE(f.started_at[4] < f.done_at[0]);
+    ASSERT_EQ(2, f.max_running);
+    for (int i = 0; i < 5; i++) ASSERT_FALSE(todo[i]);
+}
+
+TEST(no_more_than_workers_at_once) {
+    fake_t f;
+    fake_init(&f);
+    unsigned char todo[6] = { 1, 1, 1, 1, 1, 1 };
+    int waiting[6] = { 0 };
+
+    ASSERT_EQ(6, fake_schedule(&f, 6, todo, waiting, 2));
+    ASSERT_EQ(2, f.max_running);
+    ASSERT_EQ(6, f.n_done);
+
+    fake_init(&f);
+    memset(todo, 1, sizeof(todo));
+    ASSERT_EQ(6, fake_schedule(&f, 6, todo, waiting, 6));
+    ASSERT_EQ(6, f.max_running);
+
+    /* Nodes not to do are left alone */
+    fake_init(&f);
+    memset(todo, 0, sizeof(todo));
+    todo[1] = todo[4] = 1;
+    ASSERT_EQ(2, fake_schedule(&f, 6, todo, waiting, 1));
+    ASSERT_EQ(1, f.max_running);
+    ASSERT_EQ(1, f.started[0]);
+    ASSERT_EQ(4, f.started[1]);
+}
+
+TEST(failure_releases_what_waits) {
+    fake_t f;
+    fake_init(&f);
+    unsigned char todo[4] = { 1, 1, 1, 1 };
+    int waiting[4] = { 0 };
+
+    /* 1 needs 0, which fails; 3 needs 2, which cannot even start */
+    fake_edge(&f, waiting, 0, 1);
+    fake_edge(&f, waiting, 2, 3);
+    f.fail_result = 0;
+    f.fail_start = 2;
+
+    ASSERT_EQ(4, fake_schedule(&f, 4, todo, waiting, 1));
+    ASSERT_EQ(4, f.n_done);
+    ASSERT_NE(0, f.results[0]);
+    ASSERT_EQ(-1, f.results[2]);
+    ASSERT_EQ(0, f.results[1]);
+    ASSERT_EQ(0, f.results[3]);
+    ASSERT_TRUE(started_after(&f, 0, 1));
+    ASSERT_TRUE(started_after(&f, 2, 3));
+    ASSERT_EQ(1, f.max_running);
+}
+
+TEST(failure_can_stop_the_schedule) {
+    fake_t f;
+    fake_init(&f);
+    unsigned char todo[4] = { 1, 1, 1, 1 };
+    int waiting[4] = { 0 };
+
+    /* 0 fails while 1 runs beside it: 1 is still collected, but neither
+     * 2, waiting for 0, nor 3, queued, is started */
+    fake_edge(&f, waiting, 0, 2);
+    f.fail_result = 0;
+    f.stop_on_failure = 1;
+
+    ASSERT_EQ(2, fake_schedule(&f, 4, todo, waiting, 2));
+    ASSERT_EQ(2, f.n_done);
+    ASSERT_EQ(0, f.running);
+    ASSERT_EQ(-1, position(f.started, f.n_started, 2));
+    ASSERT_EQ(-1, position(f.started, f.n_started, 3));
+    ASSERT_TRUE(todo[2]);
+    ASSERT_TRUE(todo[3]);
+}
+
+TEST(cycle_is_broken_open) {
+    fake_t f;
+    fake_init(&f);
+    unsigned char todo[4] = { 1, 1, 1, 1 };
+    int waiting[4] = { 0 };
+
+    /* 1 and 2 wait for each other, 3 for 2; 0 is free */
+    fake_edge(&f, waiting, 1, 2);
+    fake_edge(&f, waiting, 2, 1);
+    fake_edge(&f, waiting, 2, 3);
+
+    ASSERT_EQ(4, fake_schedule(&f, 4, todo, waiting, 4));
+    ASSERT_EQ(4, f.n_done);
+
+    /* Only once nothing else could run, and only the first of it */
+    ASSERT_EQ(1, f.n_cycles);
+    ASSERT_EQ(1, f.cycles[0]);
+    ASSERT_TRUE(started_after(&f, 0, 1));
+    ASSERT_TRUE(started_after(&f, 1, 2));
+    ASSERT_TRUE(started_after(&f, 2, 3));
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+
+    return RUN_ALL_TESTS();
+}
@@ -221,6 +221,68 @@ TEST(log_multiple_calls) {
     unlink(TEST_LOG_FILE);
 }
 
+TEST(log_async_waits_for_flush) {
+    int saved_stderr = redirect_stderr_to_file(TEST_LOG_FILE);
+    ASSERT_NE(-1, saved_stderr);
+
+    log_open();
+    log_set_async(1);
+
+    LOG_INFO("queued one");
+    LOG_WARN("queued two");
+
+    /* Nothing written until the flush */
+    char log_output[2048];
+    ASSERT_EQ(0, read_log_file(log_output, sizeof(log_output)));
+
+    log_flush();
+    log_set_async(0);
+    restore_stderr(saved_stderr);
+
+    int bytes = read_log_file(log_output, sizeof(log_output));
+    ASSERT_TRUE(bytes > 0);
+    char *one = strstr(log_output, "<INFO> queued one\n");
+    char *two = strstr(log_output, "<WARN> queued two\n");
+    ASSERT_NOT_NULL(one);
+    ASSERT_NOT_NULL(two);
+    ASSERT_TRUE(one < two);
+
+    unlink(TEST_LOG_FILE);
+}
+
+TEST(log_async_full_ring_loses_nothing) {
+    int saved_stderr = redirect_stderr_to_file(TEST_LOG_FILE);
+    ASSERT_NE(-1, saved_stderr);
+
+    log_open();
+    log_set_async(1);
+
+    /* Twice what the ring holds; the overflow is written directly */
+    int total = LOG_RING_SLOTS * 2;
+    for (int i = 0; i < total; i++) {
+        LOG_INFO("line %d", i);
+    }
+    log_flush();
+    log_set_async(0);
+    restore_stderr(saved_stderr);
+
+    static char log_output[LOG_RING_SLOTS * 2 * 64];
+    int bytes = read_log_file(log_output, sizeof(log_output));
+    ASSERT_TRUE(bytes > 0);
+
+    int newlines = 0;
+    for (int i = 0; i < bytes; i++) {
+        if (log_output[i] == '\n') newlines++;
+    }
+    ASSERT_EQ(total, newlines);
+    ASSERT_NOT_NULL(strstr(log_output, "line 0\n"));
+    char last[32];
+    snprintf(last, sizeof(last), "line %d\n", total - 1);
+    ASSERT_NOT_NULL(strstr(log_output, last));
+
+    unlink(TEST_LOG_FILE);
+}
+
 int main(void) {
     return RUN_ALL_TESTS();
 }
\ No newline at end of file
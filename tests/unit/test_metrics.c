@@ -0,0 +1,257 @@
+/*
+ * test_metrics.c - Tests for metrics and the OpenMetrics endpoint
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/metrics.h"
+#include "../../src/metrics-export.h"
+#include "../../src/component.h"
+#include "../../src/capability.h"
+#include "../../src/trace.h"
+#include "../../src/log.h"
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define TEST_METRICS_SOCKET "/tmp/yakiros-test-metrics.sock"
+
+static component_t *add_component(int idx, const char *name, comp_type_t type) {
+    component_t *comp = &components[idx];
+    memset(comp, 0, sizeof(*comp));
+    strncpy(comp->name, name, MAX_NAME - 1);
+    comp->type = type;
+    comp->state = COMP_INACTIVE;
+    comp->pid = -1;
+    return comp;
+}
+
+TEST(observations_land_in_their_bucket) {
+    metrics_hist_t h = {0};
+    metrics_hist_observe(&h, 50);        /* <= 100us */
+    metrics_hist_observe(&h, 100);       /* bounds are inclusive */
+    metrics_hist_observe(&h, 101);       /* <= 250us */
+    metrics_hist_observe(&h, 20000000);  /* past 10s: +Inf */
+
+    ASSERT_EQ(2, (int)h.bucket[0]);
+    ASSERT_EQ(1, (int)h.bucket[1]);
+    ASSERT_EQ(1, (int)h.bucket[METRICS_BUCKETS]);
+    ASSERT_EQ(4, (int)h.count);
+    ASSERT_EQ(20000251, (int)h.sum_us);
+}
+
+TEST(readiness_is_observed_from_starting_to_active) {
+    metrics_reset();
+    ASSERT_EQ(0, component_table_reserve(1));
+    component_t *comp = add_component(0, "mx-web", COMP_TYPE_SERVICE);
+
+    component_set_state(comp, COMP_STARTING);
+    component_set_state(comp, COMP_READY_WAIT);
+    usleep(2000);
+    component_set_state(comp, COMP_ACTIVE);
+
+    const metrics_component_t *m = metrics_component("mx-web");
+    ASSERT_NOT_NULL(m);
+    ASSERT_EQ(1, (int)m->readiness.count);
+    ASSERT_TRUE(m->readiness.sum_us >= 2000);
+
+    /* A start that fails is not a readiness sample */
+    component_set_state(comp, COMP_STARTING);
+    component_set_state(comp, COMP_FAILED);
+    component_set_state(comp, COMP_ACTIVE);
+    ASSERT_EQ(1, (int)m->readiness.count);
+}
+
+TEST(oneshot_is_ready_once_done) {
+    metrics_reset();
+    ASSERT_EQ(0, component_table_reserve(1));
+    component_t *comp = add_component(0, "mx-setup", COMP_TYPE_ONESHOT);
+
+    component_set_state(comp, COMP_STARTING);
+    component_set_state(comp, COMP_ACTIVE);
+    const metrics_component_t *m = metrics_component("mx-setup");
+    ASSERT_NOT_NULL(m);
+    ASSERT_EQ(0, (int)m->readiness.count);
+
+    component_set_state(comp, COMP_ONESHOT_DONE);
+    ASSERT_EQ(1, (int)m->readiness.count);
+}
+
+TEST(health_checks_and_oom_kills_are_counted) {
+    metrics_reset();
+    metrics_health_started("mx-db");
+    metrics_health_result("mx-db", 0);
+    metrics_health_started("mx-db");
+    metrics_health_result("mx-db", 2);
+    metrics_health_result("mx-db", 1);   /* could not be started */
+    metrics_oom("mx-db", 3);
+    metrics_oom("mx-db", 0);
+
+    const metrics_component_t *m = metrics_component("mx-db");
+    ASSERT_NOT_NULL(m);
+    ASSERT_EQ(2, (int)m->health.count);
+    ASSERT_EQ(2, (int)m->health_failures);
+    ASSERT_EQ(3, (int)m->oom_kills);
+
+    ASSERT_NULL(metrics_component("mx-never-seen"));
+}
+
+TEST(global_histograms_are_kept_by_kind) {
+    metrics_reset();
+    metrics_observe(METRIC_SPAWN, 300);
+    metrics_observe(METRIC_SPAWN, 700);
+    metrics_observe(METRIC_CONTROL, 5);
+    metrics_observe(METRIC_GLOBAL_KINDS, 5);
+
+    ASSERT_EQ(2, (int)metrics_global(METRIC_SPAWN)->count);
+    ASSERT_EQ(1000, (int)metrics_global(METRIC_SPAWN)->sum_us);
+    ASSERT_EQ(1, (int)metrics_global(METRIC_CONTROL)->count);
+    ASSERT_EQ(0, (int)metrics_global(METRIC_RESOLVE_FULL)->count);
+    ASSERT_NULL(metrics_global(METRIC_GLOBAL_KINDS));
+}
+
+TEST(exposition_is_well_formed) {
+    metrics_reset();
+    capability_init();
+    ASSERT_EQ(0, component_table_reserve(2));
+    component_t *web = add_component(0, "mx-render-web", COMP_TYPE_SERVICE);
+    add_component(1, "mx-render-\"odd\"", COMP_TYPE_SERVICE);
+    n_components = 2;
+    component_set_state(web, COMP_STARTING);
+    component_set_state(web, COMP_ACTIVE);
+    web->restart_count = 1;
+    metrics_observe(METRIC_SPAWN, 1500);
+
+    control_buf_t out = {0};
+    metrics_render(&out);
+    ASSERT_NOT_NULL(out.data);
+
+    ASSERT_TRUE(out.len > 6);
+    ASSERT_STR_EQ("# EOF\n", out.data + out.len - 6);
+    ASSERT_NOT_NULL(strstr(out.data, "# TYPE yakiros_component_up gauge\n"));
+    ASSERT_NOT_NULL(strstr(out.data, "yakiros_component_up{component=\"mx-render-web\"} 1\n"));
+    ASSERT_NOT_NULL(strstr(out.data, "yakiros_component_up{component=\"mx-render-\\\"odd\\\"\"} 0\n"));
+    ASSERT_NOT_NULL(strstr(out.data, "yakiros_component_starts_total{component=\"mx-render-web\"} 1\n"));
+    ASSERT_NOT_NULL(strstr(out.data,
+        "yakiros_component_readiness_seconds_count{component=\"mx-render-web\"} 1\n"));
+    ASSERT_NOT_NULL(strstr(out.data, "yakiros_spawn_seconds_bucket{le=\"0.001\"} 0\n"));
+    ASSERT_NOT_NULL(strstr(out.data, "yakiros_spawn_seconds_bucket{le=\"0.0025\"} 1\n"));
+    ASSERT_NOT_NULL(strstr(out.data, "yakiros_spawn_seconds_sum 0.001500\n"));
+    ASSERT_NOT_NULL(strstr(out.data, "yakiros_components{state=\"ACTIVE\"} 1\n"));
+
+    /* Each family is introduced once, before its samples */
+    char *first = strstr(out.data, "# TYPE yakiros_component_starts counter\n");
+    ASSERT_NOT_NULL(first);
+    ASSERT_NULL(strstr(first + 1, "# TYPE yakiros_component_starts counter\n"));
+    ASSERT_TRUE(strstr(out.data, "yakiros_component_starts_total{") > first);
+
+    control_buf_free(&out);
+    n_components = 0;
+}
+
+TEST(only_changed_components_are_rendered_again) {
+    metrics_reset();
+    capability_init();
+    ASSERT_EQ(0, component_table_reserve(100));
+    for (int i = 0; i < 100; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "mx-inc-%03d", i);
+        add_component(i, name, COMP_TYPE_SERVICE);
+    }
+    n_components = 100;
+
+    control_buf_t out = {0};
+    metrics_render(&out);
+    uint64_t before = metrics_fragments_rendered();
+
+    out.len = 0;
+    metrics_render(&out);
+    ASSERT_EQ(before, metrics_fragments_rendered());
+
+    component_set_state(&components[42], COMP_STARTING);
+    metrics_health_result("mx-inc-007", 1);
+    out.len = 0;
+    metrics_render(&out);
+    ASSERT_EQ(before + 2, metrics_fragments_rendered());
+    ASSERT_NOT_NULL(strstr(out.data,
+        "yakiros_component_health_failures_total{component=\"mx-inc-007\"} 1\n"));
+
+    control_buf_free(&out);
+    n_components = 0;
+}
+
+/* Send req to the endpoint and run the loop until the reply is in */
+static char *scrape(int epoll_fd, const char *req) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strncpy(addr.sun_path, TEST_METRICS_SOCKET, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return NULL;
+    }
+    if (write(fd, req, strlen(req)) != (ssize_t)strlen(req)) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t cap = 65536, len = 0;
+    char *reply = malloc(cap);
+    for (int rounds = 0; rounds < 100; rounds++) {
+        struct epoll_event evs[4];
+        int n = epoll_wait(epoll_fd, evs, 4, 10);
+        for (int i = 0; i < n; i++) {
+            event_source_t *src = evs[i].data.ptr;
+            if (src->type == EVENT_METRICS) metrics_accept(src);
+            else metrics_client_event(src, evs[i].events);
+        }
+        ssize_t got = -1;
+        while (len + 1 < cap && (got = recv(fd, reply + len, cap - 1 - len, MSG_DONTWAIT)) > 0) {
+            len += (size_t)got;
+        }
+        if (got == 0) break;
+    }
+    reply[len] = '\0';
+    close(fd);
+    return reply;
+}
+
+TEST(endpoint_serves_metrics_over_http) {
+    metrics_reset();
+    capability_init();
+    n_components = 0;
+
+    int epoll_fd = epoll_create1(0);
+    ASSERT_EQ(1, metrics_listen(epoll_fd, TEST_METRICS_SOCKET, 0));
+
+    char *reply = scrape(epoll_fd, "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    ASSERT_NOT_NULL(reply);
+    ASSERT_TRUE(strncmp(reply, "HTTP/1.1 200 OK\r\n", 17) == 0);
+    ASSERT_NOT_NULL(strstr(reply, "Content-Type: application/openmetrics-text"));
+    ASSERT_NOT_NULL(strstr(reply, "\r\n\r\n# TYPE yakiros_components gauge\n"));
+    ASSERT_STR_EQ("# EOF\n", reply + strlen(reply) - 6);
+    free(reply);
+
+    reply = scrape(epoll_fd, "GET /other HTTP/1.1\r\n\r\n");
+    ASSERT_NOT_NULL(reply);
+    ASSERT_TRUE(strncmp(reply, "HTTP/1.1 404 ", 13) == 0);
+    free(reply);
+
+    reply = scrape(epoll_fd, "POST /metrics HTTP/1.1\r\n\r\n");
+    ASSERT_NOT_NULL(reply);
+    ASSERT_TRUE(strncmp(reply, "HTTP/1.1 405 ", 13) == 0);
+    free(reply);
+
+    metrics_close_all();
+    close(epoll_fd);
+    unlink(TEST_METRICS_SOCKET);
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,351 @@
+/*
+ * test_migration.c - Tests for live migration between nodes
+ *
+ * The test plays the source node against the target side on a loopback
+ * port; CRIU itself is not needed.
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/migration.h"
+#include "../../src/checkpoint-mgmt.h"
+#include "../../src/component.h"
+#include "../../src/capability.h"
+#include "../../src/federation.h"
+#include "../../src/supervise.h"
+#include "../../src/timer.h"
+#include "../../src/log.h"
+#include <arpa/inet.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#define TEST_MIGRATION_PORT 47948
+#define TEST_FEDERATION_PORT 47949
+#define TEST_COMPONENT "yakiros-test-migrate"
+#define TEST_IN_DIR CHECKPOINT_RUN_DIR "/" TEST_COMPONENT "/" MIGRATION_IN_DIR
+#define TEST_NONCE "00112233445566778899aabbccddeeff"
+
+static int efd = -1;
+
+static void create_service(int idx, const char *name, comp_state_t state) {
+    component_t *comp = &components[idx];
+    memset(comp, 0, sizeof(*comp));
+    strncpy(comp->name, name, MAX_NAME - 1);
+    component_set_str(comp, &comp->binary, "/bin/true");
+    comp->type = COMP_TYPE_SERVICE;
+    comp->state = state;
+}
+
+/* Run the target's side of the main loop until it goes quiet */
+static void pump(void) {
+    struct epoll_event ev[4];
+    int n;
+    while ((n = epoll_wait(efd, ev, 4, 50)) > 0) {
+        for (int i = 0; i < n; i++) {
+            event_source_t *src = ev[i].data.ptr;
+            if (src->type == EVENT_MIGRATION) {
+                migration_accept(src);
+            } else {
+                migration_client_event(src, ev[i].events);
+            }
+        }
+    }
+}
+
+/* Connect to port from 127.0.0.1, the configured peer, or another host */
+static int connect_from(const char *host, int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in from = { .sin_family = AF_INET };
+    inet_pton(AF_INET, host, &from.sin_addr);
+    bind(fd, (struct sockaddr *)&from, sizeof(from));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    pump();
+    return fd;
+}
+
+static void say(int fd, const char *data, size_t len) {
+    send(fd, data, len, MSG_NOSIGNAL);
+    pump();
+}
+
+/* The target's next answer, "" if none came */
+static char *answer(int fd) {
+    static char buf[MIGRATION_LINE_MAX];
+    size_t len = 0;
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    while (len + 1 < sizeof(buf) && poll(&pfd, 1, 200) == 1) {
+        char ch;
+        if (recv(fd, &ch, 1, 0) != 1 || ch == '\n') break;
+        buf[len++] = ch;
+    }
+    buf[len] = '\0';
+    return buf;
+}
+
+static char *ask(int fd, const char *line) {
+    say(fd, line, strlen(line));
+    return answer(fd);
+}
+
+static int peer_closed(int fd) {
+    char ch;
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    return poll(&pfd, 1, 200) == 1 && recv(fd, &ch, 1, 0) == 0;
+}
+
+/* Expect the target's PROOF of the secret for our nonce; its nonce to
+ * theirs, or 0 */
+static int challenge(int fd, char *theirs) {
+    char mac[FEDERATION_MAC_HEX + 1];
+    char *proof = ask(fd, "CHALLENGE " TEST_NONCE "\n");
+    return sscanf(proof, "PROOF %32s %64s", theirs, mac) == 2 &&
+           federation_mac_ok("migrate-target " TEST_NONCE, strlen("migrate-target " TEST_NONCE), mac);
+}
+
+/* Do the source's side of the handshake: 1 if the target took it */
+static int authenticate(int fd) {
+    char theirs[MIGRATION_NONCE_HEX + 1], msg[64], line[128];
+    if (!challenge(fd, theirs)) return 0;
+    int n = snprintf(msg, sizeof(msg), "migrate-source %s", theirs);
+    strcpy(line, "AUTH ");
+    federation_mac(msg, (size_t)n, line + 5);
+    strcat(line, "\n");
+    return strcmp(ask(fd, line), "OK") == 0;
+}
+
+/* An authenticated connection from the configured peer */
+static int connect_target(void) {
+    int fd = connect_from("127.0.0.1", TEST_MIGRATION_PORT);
+    authenticate(fd);
+    return fd;
+}
+
+TEST(target_holds_component_while_it_comes_in) {
+    n_components = 0;
+    capability_init();
+    create_service(0, TEST_COMPONENT, COMP_INACTIVE);
+    create_service(1, "busy", COMP_ACTIVE);
+    components[1].pid = getpid();
+    n_components = 2;
+
+    int fd = connect_target();
+    ASSERT_EQ(0, strncmp(ask(fd, "MIGRATE nothing\n"), "ERR", 3));
+    ASSERT_EQ(0, strncmp(ask(fd, "MIGRATE busy\n"), "ERR", 3));
+    ASSERT_STR_EQ("OK", ask(fd, "MIGRATE " TEST_COMPONENT "\n"));
+    ASSERT_EQ(COMP_MIGRATED, components[0].state);
+    ASSERT_EQ(0, access(TEST_IN_DIR, F_OK));
+
+    /* One migration per connection, and one connection at a time */
+    ASSERT_EQ(0, strncmp(ask(fd, "MIGRATE busy\n"), "ERR already", 11));
+    int other = connect_from("127.0.0.1", TEST_MIGRATION_PORT);
+    ASSERT_STR_EQ("ERR busy", answer(other));
+    close(other);
+
+    /* Going away before it was restored lets it go */
+    close(fd);
+    pump();
+    ASSERT_EQ(COMP_INACTIVE, components[0].state);
+    ASSERT_NE(0, access(TEST_IN_DIR, F_OK));
+    components[1].pid = 0;
+}
+
+TEST(only_peers_may_migrate_in) {
+    n_components = 0;
+    capability_init();
+    create_service(0, TEST_COMPONENT, COMP_INACTIVE);
+    n_components = 1;
+
+    int fd = connect_from("127.0.0.2", TEST_MIGRATION_PORT);
+    ASSERT_TRUE(peer_closed(fd));
+    close(fd);
+    ASSERT_EQ(COMP_INACTIVE, components[0].state);
+
+    /* Nor did the stranger take the slot */
+    fd = connect_target();
+    ASSERT_STR_EQ("OK", ask(fd, "MIGRATE " TEST_COMPONENT "\n"));
+
+    /* Pages are only taken from the peer sending the component */
+    char ready[32];
+    snprintf(ready, sizeof(ready), "READY %d", CHECKPOINT_PAGE_SERVER_PORT);
+    ASSERT_STR_EQ(ready, ask(fd, "PAGES 1 0\n"));
+    int pages = connect_from("127.0.0.2", CHECKPOINT_PAGE_SERVER_PORT);
+    ASSERT_TRUE(peer_closed(pages));
+    close(pages);
+    close(fd);
+    pump();
+    ASSERT_EQ(COMP_INACTIVE, components[0].state);
+}
+
+TEST(peer_must_prove_the_secret) {
+    n_components = 0;
+    capability_init();
+    create_service(0, TEST_COMPONENT, COMP_INACTIVE);
+    n_components = 1;
+
+    /* Nothing is taken before the handshake */
+    int fd = connect_from("127.0.0.1", TEST_MIGRATION_PORT);
+    ASSERT_STR_EQ("ERR unauthenticated", ask(fd, "MIGRATE " TEST_COMPONENT "\n"));
+    ASSERT_TRUE(peer_closed(fd));
+    close(fd);
+    ASSERT_EQ(COMP_INACTIVE, components[0].state);
+
+    fd = connect_from("127.0.0.1", TEST_MIGRATION_PORT);
+    ASSERT_STR_EQ("ERR unauthenticated", ask(fd, "AUTH " TEST_NONCE TEST_NONCE "\n"));
+    ASSERT_TRUE(peer_closed(fd));
+    close(fd);
+
+    /* The target proves itself, but a wrong proof back is refused */
+    char theirs[MIGRATION_NONCE_HEX + 1];
+    fd = connect_from("127.0.0.1", TEST_MIGRATION_PORT);
+    ASSERT_TRUE(challenge(fd, theirs));
+    ASSERT_EQ(MIGRATION_NONCE_HEX, (int)strlen(theirs));
+    char line[128];
+    snprintf(line, sizeof(line), "AUTH %.32s%.32s\n", theirs, theirs);
+    ASSERT_STR_EQ("ERR unauthenticated", ask(fd, line));
+    ASSERT_TRUE(peer_closed(fd));
+    close(fd);
+    ASSERT_EQ(COMP_INACTIVE, components[0].state);
+
+    /* The slot is free for one that knows it */
+    fd = connect_target();
+    ASSERT_STR_EQ("OK", ask(fd, "MIGRATE " TEST_COMPONENT "\n"));
+    close(fd);
+    pump();
+    ASSERT_EQ(COMP_INACTIVE, components[0].state);
+}
+
+TEST(quiet_peer_is_let_go) {
+    n_components = 0;
+    capability_init();
+    timer_init();
+    create_service(0, TEST_COMPONENT, COMP_FAILED);
+    n_components = 1;
+
+    int fd = connect_target();
+    ASSERT_STR_EQ("OK", ask(fd, "MIGRATE " TEST_COMPONENT "\n"));
+    ASSERT_EQ(COMP_MIGRATED, components[0].state);
+
+    /* Nothing is due while it is within its time */
+    timer_kind_t kind;
+    int idx, handle;
+    ASSERT_FALSE(timer_pop(timer_now_ms() + MIGRATION_IDLE_SEC * 1000 - 5000, &kind, &idx, &handle));
+    ASSERT_TRUE(timer_pop(timer_now_ms() + MIGRATION_IDLE_SEC * 1000 + 1, &kind, &idx, &handle));
+    ASSERT_EQ(TIMER_MIGRATION, kind);
+    migration_timer_fired(handle);
+    ASSERT_EQ(COMP_FAILED, components[0].state);
+    ASSERT_TRUE(peer_closed(fd));
+    close(fd);
+
+    /* And the slot is free again */
+    fd = connect_target();
+    ASSERT_STR_EQ("OK", ask(fd, "MIGRATE " TEST_COMPONENT "\n"));
+    close(fd);
+    pump();
+    ASSERT_EQ(COMP_FAILED, components[0].state);
+}
+
+TEST(images_stream_into_the_staging_directory) {
+    n_components = 0;
+    capability_init();
+    create_service(0, TEST_COMPONENT, COMP_FAILED);
+    n_components = 1;
+
+    int fd = connect_target();
+    ASSERT_STR_EQ("OK", ask(fd, "MIGRATE " TEST_COMPONENT "\n"));
+
+    /* Contents may arrive split anyhow, with the next request behind */
+    say(fd, "FILE core-1.img 11\nhello", 24);
+    say(fd, " world", 6);
+    say(fd, "FILE pstree.img 0\n", 18);
+    ASSERT_EQ(0, strncmp(ask(fd, "SIZE 1\n"), "SIZE 0", 6));
+
+    char buf[32] = "";
+    FILE *f = fopen(TEST_IN_DIR "/core-1.img", "r");
+    ASSERT_NOT_NULL(f);
+    buf[fread(buf, 1, sizeof(buf) - 1, f)] = '\0';
+    fclose(f);
+    ASSERT_STR_EQ("hello world", buf);
+    ASSERT_EQ(0, access(TEST_IN_DIR "/pstree.img", F_OK));
+
+    /* Without mm-1.img there is nothing CRIU could restore */
+    ASSERT_EQ(0, strncmp(ask(fd, "RESTORE\n"), "FAIL", 4));
+    ASSERT_EQ(COMP_MIGRATED, components[0].state);
+
+    /* Passes are checked before any page server is started */
+    ASSERT_STR_EQ("ERR bad pass", ask(fd, "PAGES 2 2\n"));
+    ASSERT_STR_EQ("ERR unknown request", ask(fd, "HELLO\n"));
+
+    /* An image name that leaves the directory ends the migration */
+    say(fd, "FILE ../escape.img 1\nx", 22);
+    ASSERT_TRUE(peer_closed(fd));
+    close(fd);
+    ASSERT_NE(0, access(CHECKPOINT_RUN_DIR "/" TEST_COMPONENT "/escape.img", F_OK));
+    ASSERT_EQ(COMP_FAILED, components[0].state);
+}
+
+TEST(source_only_moves_active_services_to_peers) {
+    n_components = 0;
+    capability_init();
+    create_service(0, TEST_COMPONENT, COMP_INACTIVE);
+    create_service(1, "web", COMP_ACTIVE);
+    components[1].pid = getpid();
+    n_components = 2;
+
+    migration_result_t res;
+    ASSERT_EQ(-1, migration_send("nothing", "db1", &res));
+    ASSERT_EQ(-1, migration_send(TEST_COMPONENT, "db1", &res));
+
+    /* No CRIU here, or no federation: either way it stays put */
+    int result = migration_send("web", "db1", &res);
+    ASSERT_TRUE(result == -2 || result == -3);
+    ASSERT_EQ(COMP_ACTIVE, components[1].state);
+    ASSERT_EQ(getpid(), components[1].pid);
+    components[1].pid = 0;
+}
+
+TEST(migrated_component_can_be_taken_back) {
+    n_components = 0;
+    create_service(0, TEST_COMPONENT, COMP_MIGRATED);
+    n_components = 1;
+
+    ASSERT_EQ(0, component_reset_failed(TEST_COMPONENT));
+    ASSERT_EQ(COMP_INACTIVE, components[0].state);
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+    component_table_reserve(16);
+
+    efd = epoll_create1(0);
+    supervise_init(efd);
+
+    /* Migrations are taken from 127.0.0.1 only */
+    federation_config_t cfg = { .node = "target", .secret = "test migration secret",
+                                .port = TEST_FEDERATION_PORT, .n_peers = 1 };
+    cfg.peers[0].sin6_family = AF_INET6;
+    cfg.peers[0].sin6_port = htons(TEST_FEDERATION_PORT);
+    inet_pton(AF_INET6, "::ffff:127.0.0.1", &cfg.peers[0].sin6_addr);
+    if (federation_init(-1, &cfg) < 0) {
+        printf("cannot bind federation port %d\n", TEST_FEDERATION_PORT);
+        return 1;
+    }
+    if (migration_listen(efd, TEST_MIGRATION_PORT) < 0) {
+        printf("cannot listen on port %d\n", TEST_MIGRATION_PORT);
+        return 1;
+    }
+
+    int result = RUN_ALL_TESTS();
+    migration_close_all();
+    federation_close();
+    rmdir(CHECKPOINT_RUN_DIR "/" TEST_COMPONENT);
+    close(efd);
+    return result;
+}
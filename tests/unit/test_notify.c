@@ -0,0 +1,90 @@
+/*
+ * test_notify.c - Tests for the sd_notify-compatible readiness socket
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/notify.h"
+#include "../../src/log.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define TEST_NOTIFY_PATH "/tmp/yakiros_test_notify.sock"
+
+static int send_notify(const char *text) {
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, TEST_NOTIFY_PATH);
+
+    ssize_t n = sendto(fd, text, strlen(text), 0, (struct sockaddr *)&addr, sizeof(addr));
+    close(fd);
+    return n < 0 ? -1 : 0;
+}
+
+TEST(notify_parse_known_fields) {
+    notify_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    const char *text = "READY=1\nSTATUS=Serving 3 clients\nMAINPID=4242\nWATCHDOG=1\nX_CUSTOM=1";
+
+    ASSERT_EQ(4, notify_parse(text, strlen(text), &msg));
+    ASSERT_EQ(1, msg.ready);
+    ASSERT_EQ(1, msg.watchdog);
+    ASSERT_EQ(4242, msg.mainpid);
+    ASSERT_EQ(1, msg.has_status);
+    ASSERT_STR_EQ("Serving 3 clients", msg.status);
+}
+
+TEST(notify_parse_rejects_malformed_values) {
+    notify_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    const char *text = "READY=0\nMAINPID=12abc\nMAINPID=-5\nREADY=1x";
+
+    ASSERT_EQ(0, notify_parse(text, strlen(text), &msg));
+    ASSERT_EQ(0, msg.ready);
+    ASSERT_EQ(0, msg.mainpid);
+    ASSERT_EQ(0, msg.has_status);
+}
+
+TEST(notify_parse_truncates_status) {
+    notify_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    char text[NOTIFY_STATUS_MAX * 2 + 16];
+    strcpy(text, "STATUS=");
+    memset(text + 7, 'x', NOTIFY_STATUS_MAX * 2);
+    text[7 + NOTIFY_STATUS_MAX * 2] = '\0';
+
+    ASSERT_EQ(1, notify_parse(text, strlen(text), &msg));
+    ASSERT_EQ(NOTIFY_STATUS_MAX - 1, (int)strlen(msg.status));
+}
+
+TEST(notify_socket_reports_sender_pid) {
+    ASSERT_TRUE(notify_init(-1, TEST_NOTIFY_PATH) >= 0);
+    ASSERT_STR_EQ(TEST_NOTIFY_PATH, notify_socket_path());
+
+    notify_msg_t msg;
+    ASSERT_EQ(0, notify_receive(&msg));
+
+    ASSERT_EQ(0, send_notify("READY=1\nSTATUS=up"));
+    ASSERT_EQ(1, notify_receive(&msg));
+    ASSERT_EQ(getpid(), msg.sender);
+    ASSERT_EQ(1, msg.ready);
+    ASSERT_STR_EQ("up", msg.status);
+    ASSERT_EQ(0, notify_receive(&msg));
+
+    notify_close();
+    ASSERT_NULL(notify_socket_path());
+    ASSERT_TRUE(access(TEST_NOTIFY_PATH, F_OK) != 0);
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,260 @@
+/*
+ * test_output.c - Tests for component output capture
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/output.h"
+#include "../../src/log.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+
+#define OUTPUT_TEST_DIR "/tmp/yakiros_output_test"
+
+static int epoll_fd = -1;
+
+static void reset_dir(void) {
+    DIR *d = opendir(OUTPUT_TEST_DIR);
+    if (d) {
+        struct dirent *ent;
+        while ((ent = readdir(d)) != NULL) {
+            char path[512];
+            snprintf(path, sizeof(path), OUTPUT_TEST_DIR "/%s", ent->d_name);
+            unlink(path);
+        }
+        closedir(d);
+    }
+    mkdir(OUTPUT_TEST_DIR, 0755);
+}
+
+/* Run the pipes until every closed one has been drained */
+static void drain(void) {
+    struct epoll_event ev[8];
+    int n;
+    while ((n = epoll_wait(epoll_fd, ev, 8, 100)) > 0) {
+        for (int i = 0; i < n; i++) {
+            output_event(ev[i].data.ptr);
+        }
+    }
+}
+
+static void write_str(int fd, const char *s) {
+    (void)!write(fd, s, strlen(s));
+}
+
+static off_t file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+TEST(without_main_loop_writes_log_file) {
+    reset_dir();
+    output_init(-1, OUTPUT_TEST_DIR);
+    int fd = output_open("direct");
+    ASSERT_TRUE(fd >= 0);
+    write_str(fd, "hello\n");
+    close(fd);
+
+    ASSERT_EQ(6, file_size(OUTPUT_TEST_DIR "/direct.log"));
+
+    /* Nothing in memory, so the tail comes from the file */
+    size_t len;
+    char *text = output_tail("direct", 10, &len);
+    ASSERT_NOT_NULL(text);
+    ASSERT_STR_EQ("hello\n", text);
+    free(text);
+}
+
+TEST(pipe_output_reaches_memory_and_file) {
+    reset_dir();
+    output_init(epoll_fd, OUTPUT_TEST_DIR);
+
+    int fd = output_open("svc");
+    ASSERT_TRUE(fd >= 0);
+    write_str(fd, "one\ntwo\nthree\n");
+    write_str(fd, "four");
+    close(fd);
+    drain();
+
+    size_t len;
+    char *text = output_tail("svc", 2, &len);
+    ASSERT_NOT_NULL(text);
+    ASSERT_STR_EQ("three\nfour", text);
+    ASSERT_EQ(10, (int)len);
+    free(text);
+
+    text = output_tail("svc", 100, &len);
+    ASSERT_STR_EQ("one\ntwo\nthree\nfour", text);
+    free(text);
+
+    ASSERT_EQ(18, file_size(OUTPUT_TEST_DIR "/svc.log"));
+    ASSERT_NULL(output_tail("other", 10, &len));
+}
+
+TEST(tail_skips_overwritten_partial_line) {
+    reset_dir();
+    output_init(epoll_fd, OUTPUT_TEST_DIR);
+
+    /* Well over a ring's worth of numbered lines */
+    int fd = output_open("chatty");
+    char line[64];
+    for (int i = 0; i < 5000; i++) {
+        snprintf(line, sizeof(line), "line %05d\n", i);
+        write_str(fd, line);
+        if (i % 500 == 0) drain();
+    }
+    close(fd);
+    drain();
+
+    size_t len;
+    char *text = output_tail("chatty", 1, &len);
+    ASSERT_STR_EQ("line 04999\n", text);
+    free(text);
+
+    /* Memory gives whole lines only */
+    text = output_tail("chatty", 2000, &len);
+    ASSERT_NOT_NULL(text);
+    ASSERT_TRUE(len <= OUTPUT_RING_BYTES);
+    ASSERT_EQ(0, strncmp(text, "line ", 5));
+    ASSERT_EQ(0, (int)(len % 11));
+    free(text);
+
+    /* More than memory holds is read from the file */
+    text = output_tail("chatty", 100000, &len);
+    ASSERT_NOT_NULL(text);
+    ASSERT_EQ(5000 * 11, (int)len);
+    ASSERT_EQ(0, strncmp(text, "line 00000\n", 11));
+    free(text);
+}
+
+TEST(log_file_rotates_at_size_limit) {
+    reset_dir();
+    output_init(epoll_fd, OUTPUT_TEST_DIR);
+    output_set_limits(100, 0, 0);
+
+    int fd = output_open("rot");
+    char line[64];
+    for (int i = 0; i < 40; i++) {
+        snprintf(line, sizeof(line), "%09d\n", i);
+        write_str(fd, line);
+        drain();
+    }
+    close(fd);
+    drain();
+    output_set_limits(0, 0, 0);
+
+    /* 400 bytes at 100 per file: the current file and three old ones */
+    ASSERT_EQ(100, file_size(OUTPUT_TEST_DIR "/rot.log"));
+    ASSERT_EQ(100, file_size(OUTPUT_TEST_DIR "/rot.log.1"));
+    ASSERT_EQ(100, file_size(OUTPUT_TEST_DIR "/rot.log.3"));
+    ASSERT_EQ(-1, file_size(OUTPUT_TEST_DIR "/rot.log.4"));
+}
+
+static void write_file(const char *path, int from, int to) {
+    FILE *f = fopen(path, "w");
+    for (int i = from; i < to; i++) fprintf(f, "line %07d\n", i);
+    fclose(f);
+}
+
+TEST(tail_reads_back_through_rotated_files) {
+    reset_dir();
+    output_init(-1, OUTPUT_TEST_DIR);
+
+    /* Written by an earlier graph-resolver, nothing of it in memory */
+    write_file(OUTPUT_TEST_DIR "/old.log.2", 0, 10);
+    write_file(OUTPUT_TEST_DIR "/old.log.1", 10, 20);
+    write_file(OUTPUT_TEST_DIR "/old.log", 20, 200000);
+
+    size_t len;
+    char *text = output_tail("old", 2, &len);
+    ASSERT_STR_EQ("line 0199998\nline 0199999\n", text);
+    free(text);
+
+    /* The current file already holds the maximum */
+    text = output_tail("old", OUTPUT_TAIL_MAX_LINES + 5, &len);
+    ASSERT_EQ(OUTPUT_TAIL_MAX_LINES * 13, (int)len);
+    ASSERT_EQ(0, strncmp(text, "line 0190000\n", 13));
+    free(text);
+
+    write_file(OUTPUT_TEST_DIR "/old.log", 20, 25);
+    text = output_tail("old", 8, &len);
+    ASSERT_EQ(0, strncmp(text, "line 0000017\n", 13));
+    ASSERT_EQ(8 * 13, (int)len);
+    free(text);
+
+    /* Everything there is, oldest file first */
+    text = output_tail("old", 1000, &len);
+    ASSERT_EQ(25 * 13, (int)len);
+    ASSERT_EQ(0, strncmp(text, "line 0000000\n", 13));
+    free(text);
+}
+
+static char heard[256];
+static size_t heard_len;
+
+static void listen_output(const char *name, const char *data, size_t len) {
+    if (strcmp(name, "talk") != 0 || heard_len + len >= sizeof(heard)) return;
+    memcpy(heard + heard_len, data, len);
+    heard_len += len;
+}
+
+TEST(listener_sees_kept_output) {
+    reset_dir();
+    output_init(epoll_fd, OUTPUT_TEST_DIR);
+    output_set_listener(listen_output);
+    heard_len = 0;
+
+    int fd = output_open("talk");
+    write_str(fd, "first\n");
+    drain();
+    write_str(fd, "second\n");
+    close(fd);
+    drain();
+    output_set_listener(NULL);
+
+    heard[heard_len] = '\0';
+    ASSERT_STR_EQ("first\nsecond\n", heard);
+}
+
+TEST(rate_limit_drops_and_reports) {
+    reset_dir();
+    output_init(epoll_fd, OUTPUT_TEST_DIR);
+    output_set_limits(0, 1000, 10);
+
+    int fd = output_open("flood");
+    write_str(fd, "ok\n");
+    drain();
+    write_str(fd, "this line is over the burst\n");
+    drain();
+
+    /* 50ms at 1000 bytes/s buys the next short line */
+    usleep(50 * 1000);
+    write_str(fd, "back\n");
+    close(fd);
+    drain();
+    output_set_limits(0, 0, 0);
+
+    size_t len;
+    char *text = output_tail("flood", 10, &len);
+    ASSERT_NOT_NULL(text);
+    ASSERT_NULL(strstr(text, "over the burst"));
+    ASSERT_NOT_NULL(strstr(text, "28 bytes of output suppressed"));
+    ASSERT_NOT_NULL(strstr(text, "back\n"));
+    free(text);
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+    int result = RUN_ALL_TESTS();
+    reset_dir();
+    rmdir(OUTPUT_TEST_DIR);
+    return result;
+}
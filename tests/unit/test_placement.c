@@ -0,0 +1,294 @@
+/*
+ * test_placement.c - Tests for CPU and memory placement
+ *
+ * A scratch sysfs tree describes the topology and scratch directories
+ * with cpuset.cpus and cpuset.mems files stand in for cgroups.
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/placement.h"
+#include "../../src/component.h"
+#include "../../src/capability.h"
+#include "../../src/log.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define PLACEMENT_TEST_DIR "/tmp/yakiros_placement_test"
+#define TEST_SYSFS PLACEMENT_TEST_DIR "/sys"
+#define TEST_NODES TEST_SYSFS "/devices/system/node"
+
+static void write_text(const char *path, const char *text) {
+    FILE *f = fopen(path, "w");
+    if (f) {
+        fputs(text, f);
+        fclose(f);
+    }
+}
+
+/* Two nodes of four CPUs each */
+static void two_nodes(void) {
+    mkdir(PLACEMENT_TEST_DIR, 0755);
+    mkdir(TEST_SYSFS, 0755);
+    mkdir(TEST_SYSFS "/devices", 0755);
+    mkdir(TEST_SYSFS "/devices/system", 0755);
+    mkdir(TEST_NODES, 0755);
+    mkdir(TEST_NODES "/node0", 0755);
+    mkdir(TEST_NODES "/node1", 0755);
+    write_text(TEST_NODES "/online", "0-1\n");
+    write_text(TEST_NODES "/node0/cpulist", "0-3\n");
+    write_text(TEST_NODES "/node1/cpulist", "4-7\n");
+}
+
+static void clear_knobs(int fd) {
+    close(openat(fd, "cpuset.cpus", O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    close(openat(fd, "cpuset.mems", O_WRONLY | O_CREAT | O_TRUNC, 0644));
+}
+
+static int fake_cgroup(const char *name) {
+    char path[256];
+    mkdir(PLACEMENT_TEST_DIR, 0755);
+    snprintf(path, sizeof(path), PLACEMENT_TEST_DIR "/%s", name);
+    mkdir(path, 0755);
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    clear_knobs(fd);
+    return fd;
+}
+
+static const char *read_knob(int fd, const char *file) {
+    static char buf[64];
+    buf[0] = '\0';
+    int kfd = openat(fd, file, O_RDONLY);
+    if (kfd >= 0) {
+        ssize_t n = read(kfd, buf, sizeof(buf) - 1);
+        buf[n > 0 ? n : 0] = '\0';
+        close(kfd);
+    }
+    return buf;
+}
+
+static void create_service(int idx, const char *name, const char *requires,
+                           const char *provides) {
+    component_t *comp = &components[idx];
+    memset(comp, 0, sizeof(*comp));
+    strncpy(comp->name, name, MAX_NAME - 1);
+    comp->type = COMP_TYPE_SERVICE;
+    comp->state = COMP_ACTIVE;
+    comp->numa = -1;
+    comp->cgroup_fd = fake_cgroup(name);
+    if (requires) {
+        component_set_str(comp, &comp->requires[0], requires);
+        comp->n_requires = 1;
+    }
+    if (provides) {
+        component_set_str(comp, &comp->provides[0], provides);
+        comp->n_provides = 1;
+    }
+}
+
+static void remove_services(void) {
+    char path[256];
+    for (int i = 0; i < n_components; i++) {
+        int fd = components[i].cgroup_fd;
+        unlinkat(fd, "cpuset.cpus", 0);
+        unlinkat(fd, "cpuset.mems", 0);
+        close(fd);
+        snprintf(path, sizeof(path), PLACEMENT_TEST_DIR "/%s", components[i].name);
+        rmdir(path);
+        component_free_strings(&components[i]);
+    }
+    n_components = 0;
+}
+
+/* Each answer in its own buffer, so two can be compared */
+static const char *placed(int idx, int want_mems) {
+    static char bufs[4][PLACEMENT_LIST_MAX];
+    static int next = 0;
+    char *cpus = bufs[next++ % 4];
+    char mems[128];
+    if (placement_current(components[idx].cgroup_fd, cpus, PLACEMENT_LIST_MAX, mems, sizeof(mems)) < 0) {
+        return "(none)";
+    }
+    if (want_mems) snprintf(cpus, PLACEMENT_LIST_MAX, "%s", mems);
+    return cpus;
+}
+
+static const char *cpus_of(int idx) {
+    return placed(idx, 0);
+}
+
+static const char *mems_of(int idx) {
+    return placed(idx, 1);
+}
+
+static void apply(void) {
+    component_placement_changed();
+    placement_apply();
+}
+
+TEST(cpu_lists_parse_and_format) {
+    placement_set_t set;
+    char buf[64];
+
+    ASSERT_EQ(0, placement_parse_list("0-2,5,7-8\n", &set));
+    placement_format_list(&set, buf, sizeof(buf));
+    ASSERT_STR_EQ("0-2,5,7-8", buf);
+
+    ASSERT_EQ(0, placement_parse_list("", &set));
+    placement_format_list(&set, buf, sizeof(buf));
+    ASSERT_STR_EQ("", buf);
+
+    ASSERT_EQ(-1, placement_parse_list("3-1", &set));
+    ASSERT_EQ(-1, placement_parse_list("1,,2", &set));
+    ASSERT_EQ(-1, placement_parse_list("two", &set));
+    ASSERT_EQ(-1, placement_parse_list("4096", &set));
+
+    /* Too long for the buffer: only whole ranges are kept */
+    ASSERT_EQ(0, placement_parse_list("0,2,4,6", &set));
+    placement_format_list(&set, buf, 6);
+    ASSERT_STR_EQ("0,2,4", buf);
+}
+
+TEST(topology_is_read_from_sysfs) {
+    two_nodes();
+    ASSERT_EQ(2, placement_init(TEST_SYSFS));
+
+    /* A memory-only node is not one to run on */
+    mkdir(TEST_NODES "/node2", 0755);
+    write_text(TEST_NODES "/node2/cpulist", "\n");
+    write_text(TEST_NODES "/online", "0-2\n");
+    ASSERT_EQ(2, placement_init(TEST_SYSFS));
+    unlink(TEST_NODES "/node2/cpulist");
+    rmdir(TEST_NODES "/node2");
+
+    /* Without NUMA the online CPUs are one node */
+    ASSERT_EQ(0, placement_init(PLACEMENT_TEST_DIR "/nothing"));
+    mkdir(TEST_SYSFS "/devices/system/cpu", 0755);
+    write_text(TEST_SYSFS "/devices/system/cpu/online", "0-3\n");
+    ASSERT_EQ(0, rename(TEST_NODES "/online", TEST_NODES "/offline"));
+    ASSERT_EQ(1, placement_init(TEST_SYSFS));
+    ASSERT_EQ(0, rename(TEST_NODES "/offline", TEST_NODES "/online"));
+}
+
+TEST(dependents_share_their_provider_node) {
+    two_nodes();
+    placement_init(TEST_SYSFS);
+    capability_init();
+    create_service(0, "db", NULL, "database");
+    create_service(1, "web", "database", NULL);
+    create_service(2, "cache", NULL, "kv");
+    create_service(3, "worker", "kv", NULL);
+    n_components = 4;
+
+    /* Taken one by one, web and cache would each go where db was not */
+    apply();
+    ASSERT_STR_EQ(cpus_of(0), cpus_of(1));
+    ASSERT_STR_EQ(cpus_of(2), cpus_of(3));
+    ASSERT_TRUE(strcmp(cpus_of(0), cpus_of(2)) != 0);
+    ASSERT_TRUE(strcmp(cpus_of(0), "0-3") == 0 || strcmp(cpus_of(0), "4-7") == 0);
+    ASSERT_STR_EQ(cpus_of(1), read_knob(components[1].cgroup_fd, "cpuset.cpus"));
+    ASSERT_STR_EQ(mems_of(1), read_knob(components[1].cgroup_fd, "cpuset.mems"));
+    ASSERT_STR_EQ(strcmp(cpus_of(1), "0-3") == 0 ? "0" : "1", mems_of(1));
+
+    /* Nothing changed: nothing is written */
+    for (int i = 0; i < n_components; i++) clear_knobs(components[i].cgroup_fd);
+    placement_apply();
+    apply();
+    for (int i = 0; i < n_components; i++) {
+        ASSERT_STR_EQ("", read_knob(components[i].cgroup_fd, "cpuset.cpus"));
+    }
+
+    /* The rest stay put while one is down, which comes back where it was */
+    char cache[PLACEMENT_LIST_MAX];
+    snprintf(cache, sizeof(cache), "%s", cpus_of(2));
+    components[2].state = COMP_FAILED;
+    apply();
+    ASSERT_STR_EQ(cache, cpus_of(3));
+    ASSERT_STR_EQ("", read_knob(components[3].cgroup_fd, "cpuset.cpus"));
+    ASSERT_STR_EQ("", read_knob(components[1].cgroup_fd, "cpuset.cpus"));
+    components[2].state = COMP_ACTIVE;
+    apply();
+    ASSERT_STR_EQ(cache, cpus_of(2));
+    remove_services();
+}
+
+TEST(hints_pin_and_isolate) {
+    two_nodes();
+    placement_init(TEST_SYSFS);
+    capability_init();
+    create_service(0, "pinned", NULL, NULL);
+    strcpy(components[0].cpuset, "6-7");
+    create_service(1, "rt", NULL, NULL);
+    components[1].numa = 0;
+    components[1].isolate_cpus = 2;
+    create_service(2, "near", NULL, NULL);
+    components[2].numa = 1;
+    create_service(3, "plain", NULL, NULL);
+    n_components = 4;
+
+    apply();
+    ASSERT_STR_EQ("6-7", cpus_of(0));
+    ASSERT_STR_EQ("1", mems_of(0));
+    ASSERT_STR_EQ("2-3", cpus_of(1));
+    ASSERT_STR_EQ("0", mems_of(1));
+    ASSERT_STR_EQ("4-7", cpus_of(2));
+    ASSERT_TRUE(strcmp(cpus_of(3), "0-1") == 0 || strcmp(cpus_of(3), "4-7") == 0);
+
+    /* A pin onto someone else's isolated CPUs keeps only the rest */
+    strcpy(components[0].cpuset, "3-4");
+    apply();
+    ASSERT_STR_EQ("4", cpus_of(0));
+
+    /* Stopped, the isolated CPUs are everyone's again */
+    components[1].state = COMP_INACTIVE;
+    apply();
+    ASSERT_STR_EQ("3-4", cpus_of(0));
+    ASSERT_TRUE(strcmp(cpus_of(3), "0-3") == 0 || strcmp(cpus_of(3), "4-7") == 0);
+    remove_services();
+}
+
+TEST(single_node_is_left_alone) {
+    two_nodes();
+    mkdir(TEST_SYSFS "/devices/system/cpu", 0755);
+    write_text(TEST_SYSFS "/devices/system/cpu/online", "0-3\n");
+    ASSERT_EQ(0, rename(TEST_NODES "/online", TEST_NODES "/offline"));
+    ASSERT_EQ(1, placement_init(TEST_SYSFS));
+    capability_init();
+    create_service(0, "db", NULL, "database");
+    create_service(1, "web", "database", NULL);
+    n_components = 2;
+
+    apply();
+    ASSERT_STR_EQ("(none)", cpus_of(0));
+    ASSERT_STR_EQ("", read_knob(components[1].cgroup_fd, "cpuset.cpus"));
+
+    /* Isolating a CPU confines the others to the rest, until it stops */
+    components[0].isolate_cpus = 1;
+    apply();
+    ASSERT_STR_EQ("3", cpus_of(0));
+    ASSERT_STR_EQ("0-2", cpus_of(1));
+    ASSERT_STR_EQ("0-2", read_knob(components[1].cgroup_fd, "cpuset.cpus"));
+
+    components[0].isolate_cpus = 0;
+    clear_knobs(components[1].cgroup_fd);
+    apply();
+    ASSERT_STR_EQ("(none)", cpus_of(1));
+    ASSERT_STR_EQ("\n", read_knob(components[1].cgroup_fd, "cpuset.cpus"));
+    ASSERT_EQ(0, rename(TEST_NODES "/offline", TEST_NODES "/online"));
+    remove_services();
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+    component_table_reserve(16);
+
+    int result = RUN_ALL_TESTS();
+
+    system("rm -rf " PLACEMENT_TEST_DIR);
+    return result;
+}
@@ -0,0 +1,195 @@
+/*
+ * test_pressure.c - Tests for the PSI-driven adaptive limit controller
+ *
+ * Scratch directories with memory.high and cpu.weight files stand in for
+ * cgroups. No epoll set is given, so no PSI triggers are armed and stalls
+ * are fed in directly.
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/pressure.h"
+#include "../../src/log.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define PRESSURE_TEST_DIR "/tmp/yakiros_pressure_test"
+
+static int fake_cgroup(const char *name) {
+    char path[256];
+    mkdir(PRESSURE_TEST_DIR, 0755);
+    snprintf(path, sizeof(path), PRESSURE_TEST_DIR "/%s", name);
+    mkdir(path, 0755);
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    close(openat(fd, "memory.high", O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    close(openat(fd, "cpu.weight", O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    return fd;
+}
+
+static void remove_cgroup(int fd, const char *name) {
+    char path[256];
+    unlinkat(fd, "memory.high", 0);
+    unlinkat(fd, "cpu.weight", 0);
+    close(fd);
+    snprintf(path, sizeof(path), PRESSURE_TEST_DIR "/%s", name);
+    rmdir(path);
+}
+
+static const char *read_knob(int fd, const char *file) {
+    static char buf[64];
+    buf[0] = '\0';
+    int kfd = openat(fd, file, O_RDONLY);
+    if (kfd >= 0) {
+        ssize_t n = read(kfd, buf, sizeof(buf) - 1);
+        buf[n > 0 ? n : 0] = '\0';
+        close(kfd);
+    }
+    return buf;
+}
+
+static void adaptive(component_t *comp, const char *name, int priority) {
+    memset(comp, 0, sizeof(*comp));
+    strcpy(comp->name, name);
+    comp->adaptive = 1;
+    comp->priority = priority;
+    strcpy(comp->memory_high_min, "16M");
+    strcpy(comp->memory_high_max, "80M");
+    strcpy(comp->memory_high, "48M");
+    comp->cpu_weight_min = 50;
+    comp->cpu_weight_max = 450;
+}
+
+TEST(static_components_are_not_controlled) {
+    int fd = fake_cgroup("static");
+    component_t comp;
+    adaptive(&comp, "static", 0);
+    comp.adaptive = 0;
+
+    ASSERT_EQ(0, pressure_add(fd, &comp));
+    ASSERT_EQ(-1, (int)pressure_current(fd, PRESSURE_MEMORY));
+
+    /* Adaptive, but only a cpu.weight range */
+    comp.adaptive = 1;
+    comp.memory_high_min[0] = '\0';
+    ASSERT_EQ(0, pressure_add(fd, &comp));
+    ASSERT_EQ(-1, (int)pressure_current(fd, PRESSURE_MEMORY));
+    ASSERT_EQ(100, (int)pressure_current(fd, PRESSURE_CPU));
+    ASSERT_STR_EQ("", read_knob(fd, "memory.high"));
+    ASSERT_STR_EQ("100", read_knob(fd, "cpu.weight"));
+
+    pressure_remove(fd);
+    ASSERT_EQ(-1, (int)pressure_current(fd, PRESSURE_CPU));
+    remove_cgroup(fd, "static");
+}
+
+TEST(stall_shifts_headroom_to_higher_priority) {
+    component_t comp;
+    int db = fake_cgroup("db");
+    int batch = fake_cgroup("batch");
+    int peer = fake_cgroup("peer");
+
+    adaptive(&comp, "db", 10);
+    ASSERT_EQ(0, pressure_add(db, &comp));
+    adaptive(&comp, "batch", 0);
+    ASSERT_EQ(0, pressure_add(batch, &comp));
+    adaptive(&comp, "peer", 10);
+    ASSERT_EQ(0, pressure_add(peer, &comp));
+
+    ASSERT_STR_EQ("50331648", read_knob(db, "memory.high"));
+
+    /* 64MB range in steps of 16MB */
+    pressure_stall(db, PRESSURE_MEMORY, 1000);
+    ASSERT_STR_EQ("67108864", read_knob(db, "memory.high"));
+    ASSERT_STR_EQ("33554432", read_knob(batch, "memory.high"));
+    ASSERT_STR_EQ("50331648", read_knob(peer, "memory.high"));
+    ASSERT_STR_EQ("100", read_knob(db, "cpu.weight"));
+
+    pressure_stall(db, PRESSURE_MEMORY, 2000);
+    pressure_stall(db, PRESSURE_MEMORY, 3000);
+    ASSERT_EQ(80 << 20, (int)pressure_current(db, PRESSURE_MEMORY));
+    ASSERT_EQ(16 << 20, (int)pressure_current(batch, PRESSURE_MEMORY));
+
+    /* A low priority stall takes nothing from the others */
+    pressure_stall(batch, PRESSURE_CPU, 3000);
+    ASSERT_EQ(200, (int)pressure_current(batch, PRESSURE_CPU));
+    ASSERT_EQ(100, (int)pressure_current(db, PRESSURE_CPU));
+    ASSERT_EQ(100, (int)pressure_current(peer, PRESSURE_CPU));
+
+    pressure_remove(db);
+    pressure_remove(batch);
+    pressure_remove(peer);
+    remove_cgroup(db, "db");
+    remove_cgroup(batch, "batch");
+    remove_cgroup(peer, "peer");
+}
+
+TEST(values_drift_back_once_settled) {
+    component_t comp;
+    int fd = fake_cgroup("drift");
+    adaptive(&comp, "drift", 5);
+    ASSERT_EQ(0, pressure_add(fd, &comp));
+
+    uint64_t t = 100000;
+    pressure_stall(fd, PRESSURE_CPU, t);
+    pressure_stall(fd, PRESSURE_CPU, t);
+    ASSERT_EQ(300, (int)pressure_current(fd, PRESSURE_CPU));
+
+    /* Too soon */
+    pressure_relax(t + PRESSURE_SETTLE_MS - 1);
+    ASSERT_EQ(300, (int)pressure_current(fd, PRESSURE_CPU));
+
+    pressure_relax(t + PRESSURE_SETTLE_MS);
+    ASSERT_EQ(200, (int)pressure_current(fd, PRESSURE_CPU));
+    pressure_relax(t + PRESSURE_SETTLE_MS + PRESSURE_INTERVAL_MS);
+    pressure_relax(t + PRESSURE_SETTLE_MS + 2 * PRESSURE_INTERVAL_MS);
+    ASSERT_EQ(100, (int)pressure_current(fd, PRESSURE_CPU));
+    ASSERT_STR_EQ("100", read_knob(fd, "cpu.weight"));
+
+    pressure_remove(fd);
+    remove_cgroup(fd, "drift");
+}
+
+TEST(removed_entries_wait_for_reap) {
+    component_t comp;
+    int db = fake_cgroup("db");
+    int batch = fake_cgroup("batch");
+
+    adaptive(&comp, "db", 10);
+    ASSERT_EQ(0, pressure_add(db, &comp));
+    adaptive(&comp, "batch", 0);
+    ASSERT_EQ(0, pressure_add(batch, &comp));
+
+    /* Gone for everything but the free, which waits for the batch */
+    pressure_remove(batch);
+    ASSERT_EQ(-1, (int)pressure_current(batch, PRESSURE_MEMORY));
+    pressure_stall(db, PRESSURE_MEMORY, 1000);
+    ASSERT_STR_EQ("50331648", read_knob(batch, "memory.high"));
+    pressure_relax(1000 + PRESSURE_SETTLE_MS);
+    ASSERT_EQ(48 << 20, (int)pressure_current(db, PRESSURE_MEMORY));
+
+    /* The descriptor may be reused meanwhile */
+    ASSERT_EQ(0, pressure_add(batch, &comp));
+    ASSERT_EQ(48 << 20, (int)pressure_current(batch, PRESSURE_MEMORY));
+    pressure_reap();
+    ASSERT_EQ(48 << 20, (int)pressure_current(batch, PRESSURE_MEMORY));
+
+    pressure_remove(db);
+    pressure_remove(batch);
+    pressure_reap();
+    remove_cgroup(db, "db");
+    remove_cgroup(batch, "batch");
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+
+    int result = RUN_ALL_TESTS();
+
+    rmdir(PRESSURE_TEST_DIR);
+    return result;
+}
@@ -0,0 +1,245 @@
+/*
+ * test_reload.c - Tests for incremental reload of component declarations
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/component.h"
+#include "../../src/capability.h"
+#include "../../src/graph-cache.h"
+#include "../../src/reload.h"
+#include "../../src/timer.h"
+#include "../../src/log.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define RELOAD_DIR "/tmp/yakiros_reload_test"
+
+static void write_component(const char *name, const char *binary, const char *requires) {
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), RELOAD_DIR "/%s.toml", name);
+    FILE *f = fopen(path, "w");
+    if (!f) return;
+    fprintf(f, "[component]\nname = \"%s\"\nbinary = \"%s\"\n\n", name, binary);
+    fprintf(f, "[requires]\ncapabilities = [\"%s\"]\n\n", requires);
+    fprintf(f, "[provides]\ncapabilities = [\"%s.api\"]\n", name);
+    fclose(f);
+}
+
+static void write_raw(const char *file, const char *text) {
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), RELOAD_DIR "/%s", file);
+    FILE *f = fopen(path, "w");
+    if (!f) return;
+    fputs(text, f);
+    fclose(f);
+}
+
+static void remove_component(const char *name) {
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), RELOAD_DIR "/%s.toml", name);
+    unlink(path);
+}
+
+/* Fresh directory holding the given components, loaded into the table */
+static void setup(const char **names, int n) {
+    DIR *d = opendir(RELOAD_DIR);
+    if (d) {
+        struct dirent *ent;
+        while ((ent = readdir(d)) != NULL) {
+            char path[MAX_PATH];
+            snprintf(path, sizeof(path), RELOAD_DIR "/%s", ent->d_name);
+            unlink(path);
+        }
+        closedir(d);
+    }
+    mkdir(RELOAD_DIR, 0755);
+
+    for (int i = 0; i < n; i++) {
+        write_component(names[i], "/bin/true", "network");
+    }
+    timer_init();
+    component_table_clear();
+    capability_init();
+    load_components(RELOAD_DIR);
+    reload_init(RELOAD_DIR);
+}
+
+static int find(const char *name) {
+    for (int i = 0; i < n_components; i++) {
+        if (strcmp(components[i].name, name) == 0) return i;
+    }
+    return -1;
+}
+
+TEST(new_file_adds_component) {
+    const char *names[] = { "alpha" };
+    setup(names, 1);
+    ASSERT_EQ(1, n_components);
+
+    write_component("beta", "/bin/beta", "alpha.api");
+    reload_note("beta.toml");
+
+    reload_stats_t st;
+    ASSERT_EQ(1, reload_apply(&st));
+    ASSERT_EQ(1, st.added);
+    ASSERT_EQ(0, st.changed);
+    ASSERT_EQ(2, n_components);
+
+    int idx = find("beta");
+    ASSERT_EQ(1, idx);
+    ASSERT_STR_EQ("/bin/beta", components[idx].binary);
+    ASSERT_EQ(capability_index("alpha.api"), components[idx].requires_id[0]);
+    ASSERT_EQ(COMP_INACTIVE, components[idx].state);
+}
+
+TEST(changed_file_keeps_runtime_state) {
+    const char *names[] = { "alpha", "beta" };
+    setup(names, 2);
+    int idx = find("beta");
+    components[idx].state = COMP_ACTIVE;
+    components[idx].pid = 4242;
+    components[idx].restart_count = 3;
+    capability_register("beta.api", idx);
+
+    write_component("beta", "/usr/bin/beta-v2", "network");
+    reload_note("beta.toml");
+
+    reload_stats_t st;
+    ASSERT_EQ(1, reload_apply(&st));
+    ASSERT_EQ(1, st.changed);
+
+    /* Same slot, same process, new declaration */
+    ASSERT_EQ(idx, find("beta"));
+    ASSERT_STR_EQ("/usr/bin/beta-v2", components[idx].binary);
+    ASSERT_EQ(COMP_ACTIVE, components[idx].state);
+    ASSERT_EQ(4242, components[idx].pid);
+    ASSERT_EQ(3, components[idx].restart_count);
+    ASSERT_TRUE(capability_active("beta.api"));
+    ASSERT_EQ(idx, capability_provider(capability_index("beta.api")));
+    components[idx].pid = -1;
+}
+
+TEST(untouched_declaration_is_a_no_op) {
+    const char *names[] = { "alpha", "beta" };
+    setup(names, 2);
+    const char *binary = components[0].binary;
+
+    /* Rewritten with identical contents, as inotify reports for a touch */
+    write_component("alpha", "/bin/true", "network");
+    reload_note("alpha.toml");
+
+    reload_stats_t st;
+    ASSERT_EQ(0, reload_apply(&st));
+    ASSERT_EQ(1, st.unchanged);
+    ASSERT_EQ(2, n_components);
+    ASSERT_TRUE(binary == components[0].binary);
+}
+
+TEST(removed_file_moves_last_component) {
+    const char *names[] = { "alpha", "beta", "gamma" };
+    setup(names, 3);
+
+    /* Remove whichever component loaded first; the last one moves */
+    char first[MAX_NAME], last[MAX_NAME], api[MAX_NAME + 8], gone[MAX_NAME + 8];
+    snprintf(first, sizeof(first), "%s", components[0].name);
+    snprintf(last, sizeof(last), "%s", components[2].name);
+    components[2].state = COMP_ACTIVE;
+    snprintf(api, sizeof(api), "%s.api", last);
+    capability_register(api, 2);
+    snprintf(gone, sizeof(gone), "%s.api", first);
+    capability_register(gone, 0);
+
+    remove_component(first);
+    char file[MAX_NAME + 8];
+    snprintf(file, sizeof(file), "%s.toml", first);
+    reload_note(file);
+
+    reload_stats_t st;
+    ASSERT_EQ(1, reload_apply(&st));
+    ASSERT_EQ(1, st.removed);
+    ASSERT_EQ(2, n_components);
+    ASSERT_EQ(-1, find(first));
+    ASSERT_FALSE(capability_active(gone));
+
+    /* The last component took the free slot and its registration followed */
+    ASSERT_EQ(0, find(last));
+    ASSERT_EQ(COMP_ACTIVE, components[0].state);
+    ASSERT_TRUE(capability_active(api));
+    ASSERT_EQ(0, capability_provider(capability_index(api)));
+}
+
+TEST(unparsable_file_keeps_old_declaration) {
+    const char *names[] = { "alpha" };
+    setup(names, 1);
+
+    write_raw("alpha.toml", "[component]\nname = \"alpha\"\n");
+    reload_note("alpha.toml");
+
+    reload_stats_t st;
+    ASSERT_EQ(0, reload_apply(&st));
+    ASSERT_EQ(1, st.failed);
+    ASSERT_EQ(1, n_components);
+    ASSERT_STR_EQ("/bin/true", components[0].binary);
+}
+
+TEST(notes_are_coalesced) {
+    const char *names[] = { "alpha" };
+    setup(names, 1);
+    ASSERT_EQ(-1, timer_next_ms());
+
+    /* An editor's save: write a temp file, rename it over the original */
+    reload_note(".alpha.toml.swp");
+    reload_note("alpha.toml~");
+    reload_note("alpha.toml");
+    reload_note("alpha.toml");
+    write_component("beta", "/bin/beta", "network");
+    reload_note("beta.toml");
+    ASSERT_EQ(2, reload_pending());
+
+    int due = timer_next_ms();
+    ASSERT_TRUE(due > 0 && due <= RELOAD_DEBOUNCE_MS);
+
+    reload_stats_t st;
+    ASSERT_EQ(1, reload_apply(&st));
+    ASSERT_EQ(1, st.unchanged);
+    ASSERT_EQ(1, st.added);
+    ASSERT_EQ(0, reload_pending());
+    ASSERT_EQ(-1, timer_next_ms());
+}
+
+TEST(rescan_finds_every_change) {
+    const char *names[] = { "alpha", "beta" };
+    setup(names, 2);
+
+    remove_component("alpha");
+    write_component("beta", "/bin/beta-v2", "network");
+    write_component("gamma", "/bin/gamma", "network");
+    reload_note_all();
+    ASSERT_EQ(-1, reload_pending());
+
+    reload_stats_t st;
+    ASSERT_EQ(3, reload_apply(&st));
+    ASSERT_EQ(1, st.added);
+    ASSERT_EQ(1, st.changed);
+    ASSERT_EQ(1, st.removed);
+    ASSERT_EQ(2, n_components);
+    ASSERT_STR_EQ("/bin/beta-v2", components[find("beta")].binary);
+    ASSERT_NE(-1, find("gamma"));
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+    component_table_reserve(256);
+
+    int result = RUN_ALL_TESTS();
+    const char *none[] = { NULL };
+    setup(none, 0);
+    rmdir(RELOAD_DIR);
+    return result;
+}
@@ -0,0 +1,177 @@
+/*
+ * test_shutdown.c - Tests for ordered shutdown
+ *
+ * Components are /bin/sh scripts that note in a shared file when they
+ * are asked to stop and when they are done.
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/shutdown.h"
+#include "../../src/component.h"
+#include "../../src/capability.h"
+#include "../../src/supervise.h"
+#include "../../src/timer.h"
+#include "../../src/log.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/epoll.h>
+
+#define TEST_SHUTDOWN_LOG "/tmp/yakiros_test_shutdown.log"
+
+static void create_stop_component(int idx, const char *name, const char *requires,
+                                  const char *provides) {
+    component_t *comp = &components[idx];
+    memset(comp, 0, sizeof(*comp));
+    strncpy(comp->name, name, MAX_NAME - 1);
+    component_set_str(comp, &comp->binary, "/bin/sh");
+    comp->type = COMP_TYPE_SERVICE;
+    comp->state = COMP_ACTIVE;
+    comp->pid = -1;
+    comp->stop_signal = SIGTERM;
+    comp->stop_timeout = 5;
+    if (requires) {
+        component_set_str(comp, &comp->requires[0], requires);
+        comp->n_requires = 1;
+    }
+    if (provides) {
+        component_set_str(comp, &comp->provides[0], provides);
+        comp->n_provides = 1;
+    }
+}
+
+/* Run script as idx's process, then have it wait on a background sleep
+ * so the shell takes its trap at once rather than after the sleep */
+static void run_component(int idx, const char *script) {
+    char full[512];
+    snprintf(full, sizeof(full), "%s; sleep 30 & wait; wait", script);
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl("/bin/sh", "sh", "-c", full, (char *)NULL);
+        _exit(127);
+    }
+    components[idx].pid = pid;
+    supervise_watch(pid, idx, PROC_MAIN);
+}
+
+static char *read_log(void) {
+    static char buf[256];
+    buf[0] = '\0';
+    FILE *f = fopen(TEST_SHUTDOWN_LOG, "r");
+    if (f) {
+        size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+        buf[n] = '\0';
+        fclose(f);
+    }
+    return buf;
+}
+
+TEST(dependents_stop_before_providers) {
+    n_components = 0;
+    capability_init();
+    int efd = epoll_create1(0);
+    supervise_init(efd);
+    unlink(TEST_SHUTDOWN_LOG);
+
+    /* web -> app -> db, and a cache nothing depends on */
+    create_stop_component(0, "db", NULL, "sql");
+    create_stop_component(1, "app", "sql", "api");
+    create_stop_component(2, "web", "api", NULL);
+    create_stop_component(3, "cache", NULL, NULL);
+    n_components = 4;
+
+    /* Dependents take a moment to exit; were they not waited for, their
+     * providers would note their stop first */
+    run_component(0, "trap 'echo db >> " TEST_SHUTDOWN_LOG "; kill $!; exit 0' TERM");
+    run_component(1, "trap 'sleep 0.2; echo app >> " TEST_SHUTDOWN_LOG "; kill $!; exit 0' TERM");
+    run_component(2, "trap 'sleep 0.2; echo web >> " TEST_SHUTDOWN_LOG "; kill $!; exit 0' TERM");
+    run_component(3, "trap 'echo cache >> " TEST_SHUTDOWN_LOG "; kill $!; exit 0' TERM");
+    usleep(200000);
+
+    uint64_t started = timer_now_ms();
+    ASSERT_EQ(0, shutdown_components());
+    uint64_t took = timer_now_ms() - started;
+
+    /* cache stops alongside web, not after db */
+    ASSERT_STR_EQ("cache\nweb\napp\ndb\n", read_log());
+    ASSERT_TRUE(took < 2000);
+    for (int i = 0; i < 4; i++) {
+        ASSERT_EQ(-1, components[i].pid);
+        ASSERT_EQ(COMP_INACTIVE, components[i].state);
+    }
+    ASSERT_EQ(0, supervise_count());
+
+    unlink(TEST_SHUTDOWN_LOG);
+    close(efd);
+}
+
+TEST(stop_signal_and_timeout_apply) {
+    n_components = 0;
+    capability_init();
+    supervise_init(-1);   /* no pidfds: exits are polled */
+    unlink(TEST_SHUTDOWN_LOG);
+
+    create_stop_component(0, "interrupted", NULL, NULL);
+    components[0].stop_signal = SIGINT;
+    create_stop_component(1, "stubborn", NULL, NULL);
+    components[1].stop_timeout = 1;
+    n_components = 2;
+
+    run_component(0, "trap 'echo int >> " TEST_SHUTDOWN_LOG "; kill $!; exit 0' INT");
+    run_component(1, "trap '' TERM; exec sleep 30");
+    usleep(200000);
+
+    uint64_t started = timer_now_ms();
+    ASSERT_EQ(1, shutdown_components());
+    uint64_t took = timer_now_ms() - started;
+
+    /* SIGKILL came once stop_timeout had passed, no later */
+    ASSERT_STR_EQ("int\n", read_log());
+    ASSERT_TRUE(took >= 1000);
+    ASSERT_TRUE(took < 2000);
+    ASSERT_EQ(-1, components[1].pid);
+
+    unlink(TEST_SHUTDOWN_LOG);
+}
+
+TEST(cycle_members_stop_together) {
+    n_components = 0;
+    capability_init();
+    int efd = epoll_create1(0);
+    supervise_init(efd);
+
+    create_stop_component(0, "primary", "replica", "sql");
+    create_stop_component(1, "replica", "sql", "replica");
+    n_components = 2;
+    run_component(0, "trap 'kill $!; exit 0' TERM");
+    run_component(1, "trap 'kill $!; exit 0' TERM");
+    usleep(200000);
+
+    uint64_t started = timer_now_ms();
+    ASSERT_EQ(0, shutdown_components());
+    ASSERT_TRUE(timer_now_ms() - started < 1000);
+    ASSERT_EQ(-1, components[0].pid);
+    ASSERT_EQ(-1, components[1].pid);
+    close(efd);
+}
+
+TEST(nothing_to_stop) {
+    n_components = 0;
+    ASSERT_EQ(0, shutdown_components());
+
+    create_stop_component(0, "inactive", NULL, NULL);
+    components[0].state = COMP_INACTIVE;
+    n_components = 1;
+    ASSERT_EQ(0, shutdown_components());
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+    component_table_reserve(16);
+
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,208 @@
+/*
+ * test_spawn.c - Tests for process spawning
+ *
+ * Children are /bin/sh scripts reporting what they were given on the
+ * descriptor their output goes to.
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/spawn.h"
+#include "../../src/log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* Run "/bin/sh -c script" as set up by sp_setup, collecting its output in
+ * out. Returns its exit status, or -1. */
+static int run_script(const char *script, void (*sp_setup)(spawn_t *, int),
+                      char *out, size_t size, pid_t *pid_out) {
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) < 0) return -1;
+
+    char *argv[] = { "/bin/sh", "-c", (char *)script, NULL };
+    spawn_t sp;
+    spawn_init(&sp, "test", "/bin/sh", argv);
+    spawn_output(&sp, pipefd[1]);
+    if (sp_setup) sp_setup(&sp, pipefd[1]);
+    pid_t pid = spawn_run(&sp);
+    close(pipefd[1]);
+    if (pid < 0) {
+        close(pipefd[0]);
+        return -1;
+    }
+    if (pid_out) *pid_out = pid;
+
+    size_t used = 0;
+    ssize_t n;
+    while (used < size - 1 && (n = read(pipefd[0], out + used, size - 1 - used)) > 0) {
+        used += (size_t)n;
+    }
+    out[used] = '\0';
+    close(pipefd[0]);
+
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) return -1;
+    return WEXITSTATUS(status);
+}
+
+static void with_environment(spawn_t *sp, int out_fd) {
+    (void)out_fd;
+    spawn_setenv(sp, "SPAWN_TEST", "new");
+    spawn_setenv_pid(sp, "SPAWN_PID");
+}
+
+TEST(environment_is_ours_with_additions) {
+    setenv("SPAWN_TEST", "old", 1);
+    setenv("SPAWN_KEPT", "kept", 1);
+
+    char out[256];
+    pid_t pid = 0;
+    ASSERT_EQ(0, run_script("echo \"$SPAWN_TEST $SPAWN_KEPT $SPAWN_PID $$\"",
+                            with_environment, out, sizeof(out), &pid));
+    char expected[128];
+    snprintf(expected, sizeof(expected), "new kept %d %d\n", (int)pid, (int)pid);
+    ASSERT_STR_EQ(expected, out);
+
+    /* Ours is untouched */
+    ASSERT_STR_EQ("old", getenv("SPAWN_TEST"));
+    ASSERT_NULL(getenv("SPAWN_PID"));
+    unsetenv("SPAWN_TEST");
+    unsetenv("SPAWN_KEPT");
+}
+
+/* Each of a pair of descriptors is placed where the other was */
+static int swap_a = -1, swap_b = -1;
+
+static void with_swapped(spawn_t *sp, int out_fd) {
+    (void)out_fd;
+    spawn_fd(sp, swap_a, swap_b);
+    spawn_fd(sp, swap_b, swap_a);
+}
+
+TEST(descriptors_are_moved_into_place) {
+    int a[2], b[2];
+    ASSERT_EQ(0, pipe2(a, O_CLOEXEC));
+    ASSERT_EQ(0, pipe2(b, O_CLOEXEC));
+    swap_a = a[0];
+    swap_b = b[0];
+    ASSERT_EQ(1, write(a[1], "a", 1));
+    ASSERT_EQ(1, write(b[1], "b", 1));
+    close(a[1]);
+    close(b[1]);
+
+    char script[256], out[64];
+    snprintf(script, sizeof(script), "read -r x <&%d; read -r y <&%d; echo \"$x$y\"",
+             swap_a, swap_b);
+    ASSERT_EQ(0, run_script(script, with_swapped, out, sizeof(out), NULL));
+    ASSERT_STR_EQ("ba\n", out);
+    close(a[0]);
+    close(b[0]);
+}
+
+static void with_session(spawn_t *sp, int out_fd) {
+    (void)out_fd;
+    sp->new_session = 1;
+}
+
+TEST(signals_reset_in_a_new_session) {
+    signal(SIGUSR1, SIG_IGN);
+
+    char out[256];
+    pid_t pid = 0;
+    ASSERT_EQ(0, run_script("grep '^SigIgn' /proc/$$/status; cut -d' ' -f6 /proc/$$/stat",
+                            with_session, out, sizeof(out), &pid));
+    char expected[128];
+    snprintf(expected, sizeof(expected), "SigIgn:\t0000000000000000\n%d\n", (int)pid);
+    ASSERT_STR_EQ(expected, out);
+    signal(SIGUSR1, SIG_DFL);
+}
+
+static void with_devnull(spawn_t *sp, int out_fd) {
+    /* stdin only: the script's verdict still reaches us */
+    (void)out_fd;
+    spawn_fd(sp, SPAWN_DEVNULL, STDIN_FILENO);
+}
+
+TEST(devnull_as_a_source) {
+    char out[64];
+    ASSERT_EQ(0, run_script("readlink /proc/$$/fd/0", with_devnull, out, sizeof(out), NULL));
+    ASSERT_STR_EQ("/dev/null\n", out);
+}
+
+TEST(exec_failure_is_reported) {
+    int pipefd[2];
+    ASSERT_EQ(0, pipe2(pipefd, O_CLOEXEC));
+
+    char *argv[] = { "/nonexistent/yakiros-spawn-test", NULL };
+    spawn_t sp;
+    spawn_init(&sp, "missing", argv[0], argv);
+    spawn_output(&sp, pipefd[1]);
+    pid_t pid = spawn_run(&sp);
+    ASSERT_TRUE(pid > 0);
+    ASSERT_STR_EQ("exec", sp.failed);
+    ASSERT_EQ(ENOENT, sp.err);
+    close(pipefd[1]);
+
+    char out[256];
+    ssize_t n = read(pipefd[0], out, sizeof(out) - 1);
+    ASSERT_TRUE(n > 0);
+    out[n] = '\0';
+    ASSERT_TRUE(strstr(out, "exec failed for 'missing'") != NULL);
+    close(pipefd[0]);
+
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(127, WEXITSTATUS(status));
+}
+
+TEST(cgroup_join_failure_is_reported) {
+    const char *dir = "/tmp/yakiros_spawn_test_cgroup";
+    mkdir(dir, 0755);
+    int cgroup_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    ASSERT_TRUE(cgroup_fd >= 0);
+
+    /* No cgroup.procs to write itself into: it never runs */
+    char *argv[] = { "/bin/true", NULL };
+    spawn_t sp;
+    spawn_init(&sp, "unlimited", argv[0], argv);
+    spawn_output(&sp, SPAWN_DEVNULL);
+    sp.cgroup_fd = cgroup_fd;
+    pid_t pid = spawn_run(&sp);
+    ASSERT_TRUE(pid > 0);
+    ASSERT_STR_EQ("joining its cgroup", sp.failed);
+    ASSERT_EQ(ENOENT, sp.err);
+
+    int status;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(126, WEXITSTATUS(status));
+
+    /* One it can join runs */
+    close(openat(cgroup_fd, "cgroup.procs", O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    spawn_init(&sp, "limited", argv[0], argv);
+    sp.cgroup_fd = cgroup_fd;
+    pid = spawn_run(&sp);
+    ASSERT_TRUE(pid > 0);
+    ASSERT_NULL(sp.failed);
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_EQ(0, WEXITSTATUS(status));
+
+    unlinkat(cgroup_fd, "cgroup.procs", 0);
+    close(cgroup_fd);
+    rmdir(dir);
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+
+    return RUN_ALL_TESTS();
+}
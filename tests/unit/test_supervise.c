@@ -0,0 +1,156 @@
+/*
+ * test_supervise.c - Tests for pidfd-based process supervision
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/supervise.h"
+#include "../../src/log.h"
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+
+TEST(supervise_watch_and_lookup) {
+    supervise_init(-1);
+
+    ASSERT_EQ(0, supervise_watch(1234, 7, PROC_MAIN));
+    proc_watch_t *w = supervise_lookup(1234);
+    ASSERT_NOT_NULL(w);
+    ASSERT_EQ(1234, w->pid);
+    ASSERT_EQ(7, w->idx);
+    ASSERT_EQ(PROC_MAIN, w->role);
+    ASSERT_EQ(-1, w->src.fd);
+    ASSERT_NULL(supervise_lookup(4321));
+
+    /* Watching again re-points the entry instead of adding one */
+    ASSERT_EQ(0, supervise_watch(1234, 9, PROC_HEALTH));
+    ASSERT_EQ(1, supervise_count());
+    ASSERT_EQ(9, supervise_lookup(1234)->idx);
+    ASSERT_EQ(PROC_HEALTH, supervise_lookup(1234)->role);
+
+    supervise_unwatch(1234);
+    ASSERT_NULL(supervise_lookup(1234));
+    ASSERT_EQ(0, supervise_count());
+
+    /* Unknown and invalid pids are ignored */
+    supervise_unwatch(1234);
+    ASSERT_EQ(-1, supervise_watch(0, 0, PROC_MAIN));
+    ASSERT_EQ(-1, supervise_signal(0, 0));
+    ASSERT_EQ(-1, supervise_signal(-1, 0));
+}
+
+TEST(supervise_unwatch_keeps_other_entries_reachable) {
+    supervise_init(-1);
+
+    /* Enough pids to force collisions in the index */
+    for (int pid = 100; pid < 100 + MAX_WATCHES; pid++) {
+        ASSERT_EQ(0, supervise_watch(pid, pid - 100, PROC_MAIN));
+    }
+    ASSERT_EQ(MAX_WATCHES, supervise_count());
+    ASSERT_EQ(-1, supervise_watch(99999, 0, PROC_MAIN));
+
+    for (int pid = 100; pid < 100 + MAX_WATCHES; pid += 2) {
+        supervise_unwatch(pid);
+    }
+    for (int pid = 100; pid < 100 + MAX_WATCHES; pid++) {
+        proc_watch_t *w = supervise_lookup(pid);
+        if ((pid - 100) % 2 == 0) {
+            ASSERT_NULL(w);
+        } else {
+            ASSERT_NOT_NULL(w);
+            ASSERT_EQ(pid - 100, w->idx);
+        }
+    }
+    ASSERT_EQ(MAX_WATCHES / 2, supervise_count());
+}
+
+TEST(supervise_pidfd_delivers_exit) {
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    ASSERT_TRUE(epfd >= 0);
+
+    if (!supervise_init(epfd)) {
+        /* Kernel without pidfd: nothing more to check */
+        close(epfd);
+        supervise_init(-1);
+        return;
+    }
+
+    pid_t pid = fork();
+    ASSERT_TRUE(pid >= 0);
+    if (pid == 0) {
+        _exit(3);
+    }
+
+    ASSERT_EQ(0, supervise_watch(pid, 5, PROC_READINESS));
+    proc_watch_t *w = supervise_lookup(pid);
+    ASSERT_NOT_NULL(w);
+    ASSERT_TRUE(w->src.fd >= 0);
+
+    struct epoll_event ev;
+    ASSERT_EQ(1, epoll_wait(epfd, &ev, 1, 5000));
+    ASSERT_TRUE(ev.data.ptr == &w->src);
+    ASSERT_EQ(EVENT_PROCESS, ((event_source_t *)ev.data.ptr)->type);
+
+    int status = 0;
+    ASSERT_EQ(1, supervise_collect(w, &status));
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(3, WEXITSTATUS(status));
+
+    supervise_unwatch(pid);
+    ASSERT_EQ(0, supervise_count());
+
+    supervise_init(-1);
+    close(epfd);
+}
+
+TEST(supervise_collect_takes_only_its_own_exit) {
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    ASSERT_TRUE(epfd >= 0);
+
+    if (!supervise_init(epfd)) {
+        close(epfd);
+        supervise_init(-1);
+        return;
+    }
+
+    /* An unwatched child exits first and stays a zombie */
+    pid_t orphan = fork();
+    ASSERT_TRUE(orphan >= 0);
+    if (orphan == 0) {
+        _exit(0);
+    }
+    pid_t pid = fork();
+    ASSERT_TRUE(pid >= 0);
+    if (pid == 0) {
+        pause();
+        _exit(0);
+    }
+    ASSERT_EQ(0, supervise_watch(pid, 1, PROC_MAIN));
+    proc_watch_t *w = supervise_lookup(pid);
+
+    int status = 0;
+    ASSERT_EQ(0, supervise_collect(w, &status));
+    ASSERT_EQ(0, supervise_signal(pid, SIGKILL));
+    struct epoll_event ev;
+    ASSERT_EQ(1, epoll_wait(epfd, &ev, 1, 5000));
+    ASSERT_EQ(1, supervise_collect(w, &status));
+    ASSERT_TRUE(WIFSIGNALED(status));
+    ASSERT_EQ(SIGKILL, WTERMSIG(status));
+
+    /* The other one was left alone */
+    ASSERT_EQ(orphan, waitpid(orphan, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+
+    supervise_unwatch(pid);
+    supervise_init(-1);
+    close(epfd);
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+
+    return RUN_ALL_TESTS();
+}
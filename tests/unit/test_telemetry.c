@@ -0,0 +1,156 @@
+/*
+ * test_telemetry.c - Tests for per-component resource telemetry
+ *
+ * A scratch directory holding hand-written control files stands in for
+ * a cgroup v2 directory.
+ */
+
+#define _GNU_SOURCE
+#include "../test_framework.h"
+#include "../../src/telemetry.h"
+#include "../../src/log.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define TELEMETRY_TEST_DIR "/tmp/yakiros_telemetry_test"
+
+static const char *files[] = {
+    "cpu.stat", "memory.current", "memory.stat", "io.stat",
+    "cpu.pressure", "memory.pressure", "io.pressure", NULL
+};
+
+static void put(const char *name, const char *text) {
+    char path[256];
+    snprintf(path, sizeof(path), TELEMETRY_TEST_DIR "/%s", name);
+    FILE *f = fopen(path, "w");
+    fputs(text, f);
+    fclose(f);
+}
+
+static int fake_cgroup(void) {
+    mkdir(TELEMETRY_TEST_DIR, 0755);
+    for (int i = 0; files[i]; i++) {
+        char path[256];
+        snprintf(path, sizeof(path), TELEMETRY_TEST_DIR "/%s", files[i]);
+        unlink(path);
+    }
+    return open(TELEMETRY_TEST_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+static void put_usage(unsigned long cpu_usec, unsigned long rbytes) {
+    char buf[256];
+    snprintf(buf, sizeof(buf), "usage_usec %lu\nuser_usec 10\nsystem_usec 5\n", cpu_usec);
+    put("cpu.stat", buf);
+    snprintf(buf, sizeof(buf),
+             "8:0 rbytes=%lu wbytes=100 rios=1 wios=1 dbytes=0 dios=0\n"
+             "8:16 rbytes=%lu wbytes=50 rios=1 wios=1 dbytes=0 dios=0\n", rbytes, rbytes);
+    put("io.stat", buf);
+}
+
+TEST(sample_parses_control_files) {
+    int fd = fake_cgroup();
+    ASSERT_EQ(0, telemetry_add(fd));
+
+    put_usage(123456, 1000);
+    put("memory.current", "4194304\n");
+    put("memory.stat", "anon 3145728\nfile 1048576\nkernel 4096\nanon_thp 0\nfile_mapped 7\n");
+    put("cpu.pressure", "some avg10=1.25 avg60=0.50 avg300=0.10 total=1234\n"
+                        "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n");
+    put("memory.pressure", "some avg10=0.05 avg60=0.00 avg300=0.00 total=1\n"
+                           "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n");
+    put("io.pressure", "some avg10=100.00 avg60=0.00 avg300=0.00 total=9\n");
+    telemetry_sample();
+
+    telemetry_sample_t s;
+    ASSERT_EQ(1, telemetry_history(fd, &s, 1));
+    ASSERT_EQ(123456, (int)s.cpu_usec);
+    ASSERT_EQ(4194304, (int)s.mem_current);
+    ASSERT_EQ(3145728, (int)s.mem_anon);
+    ASSERT_EQ(1048576, (int)s.mem_file);
+    ASSERT_EQ(2000, (int)s.io_rbytes);
+    ASSERT_EQ(150, (int)s.io_wbytes);
+    ASSERT_EQ(125, s.cpu_some);
+    ASSERT_EQ(5, s.mem_some);
+    ASSERT_EQ(10000, s.io_some);
+    ASSERT_EQ(TELEMETRY_HAVE_CPU | TELEMETRY_HAVE_MEMORY | TELEMETRY_HAVE_IO |
+              TELEMETRY_HAVE_PRESSURE, s.have);
+
+    telemetry_remove(fd);
+    close(fd);
+}
+
+TEST(missing_controllers_leave_fields_unset) {
+    int fd = fake_cgroup();
+    ASSERT_EQ(0, telemetry_add(fd));
+    put("memory.current", "8192\n");
+    telemetry_sample();
+
+    telemetry_sample_t s;
+    ASSERT_EQ(1, telemetry_history(fd, &s, 1));
+    ASSERT_EQ(TELEMETRY_HAVE_MEMORY, s.have);
+    ASSERT_EQ(8192, (int)s.mem_current);
+    ASSERT_EQ(0, (int)s.cpu_usec);
+
+    telemetry_remove(fd);
+    ASSERT_EQ(0, telemetry_history(fd, &s, 1));
+    close(fd);
+}
+
+TEST(ring_keeps_latest_samples_in_order) {
+    int fd = fake_cgroup();
+    ASSERT_EQ(0, telemetry_add(fd));
+
+    for (int i = 1; i <= TELEMETRY_SAMPLES + 5; i++) {
+        put_usage((unsigned long)i, 0);
+        telemetry_sample();
+    }
+
+    telemetry_sample_t s[TELEMETRY_SAMPLES + 5];
+    ASSERT_EQ(TELEMETRY_SAMPLES, telemetry_history(fd, s, TELEMETRY_SAMPLES + 5));
+    ASSERT_EQ(6, (int)s[0].cpu_usec);
+    ASSERT_EQ(TELEMETRY_SAMPLES + 5, (int)s[TELEMETRY_SAMPLES - 1].cpu_usec);
+
+    /* Asking for fewer gives the newest */
+    ASSERT_EQ(2, telemetry_history(fd, s, 2));
+    ASSERT_EQ(TELEMETRY_SAMPLES + 4, (int)s[0].cpu_usec);
+
+    telemetry_remove(fd);
+    close(fd);
+}
+
+TEST(rate_between_samples) {
+    telemetry_sample_t a = {0}, b = {0};
+    a.time_ms = 1000;
+    a.cpu_usec = 1000000;
+    a.io_rbytes = 0;
+    b.time_ms = 3000;
+    b.cpu_usec = 2000000;    /* 1s of CPU over 2s */
+    b.io_rbytes = 4096;
+
+    telemetry_rate_t r;
+    telemetry_rate(&a, &b, &r);
+    ASSERT_EQ(50, (int)(r.cpu_percent + 0.5));
+    ASSERT_EQ(2048, (int)r.io_read_bps);
+
+    /* A recreated cgroup starts its counters over */
+    b.cpu_usec = 10;
+    telemetry_rate(&a, &b, &r);
+    ASSERT_EQ(0, (int)r.cpu_percent);
+
+    telemetry_rate(&b, &a, &r);
+    ASSERT_EQ(0, (int)r.io_read_bps);
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+
+    int result = RUN_ALL_TESTS();
+
+    close(fake_cgroup());
+    rmdir(TELEMETRY_TEST_DIR);
+    return result;
+}
@@ -0,0 +1,165 @@
+/*
+ * test_timer.c - Tests for the deadline scheduler
+ */
+
+#include "../test_framework.h"
+#include "../../src/timer.h"
+#include "../../src/log.h"
+#include <string.h>
+#include <poll.h>
+
+TEST(timer_empty_scheduler) {
+    timer_init();
+
+    timer_kind_t kind;
+    int idx;
+    ASSERT_EQ(-1, timer_next_ms());
+    ASSERT_EQ(0, timer_expire(timer_now_ms(), &kind, &idx));
+    ASSERT_EQ(0, timer_pending());
+}
+
+TEST(timer_expires_in_deadline_order) {
+    timer_init();
+
+    ASSERT_TRUE(timer_add(300, TIMER_HEALTH_TIMEOUT, 3) > 0);
+    ASSERT_TRUE(timer_add(100, TIMER_HEALTH_TIMEOUT, 1) > 0);
+    ASSERT_TRUE(timer_add(200, TIMER_HEALTH_TIMEOUT, 2) > 0);
+    ASSERT_EQ(3, timer_pending());
+
+    timer_kind_t kind;
+    int idx;
+
+    /* Nothing due before the first deadline */
+    ASSERT_EQ(0, timer_expire(99, &kind, &idx));
+
+    ASSERT_EQ(1, timer_expire(250, &kind, &idx));
+    ASSERT_EQ(1, idx);
+    ASSERT_EQ(TIMER_HEALTH_TIMEOUT, kind);
+    ASSERT_EQ(1, timer_expire(250, &kind, &idx));
+    ASSERT_EQ(2, idx);
+    ASSERT_EQ(0, timer_expire(250, &kind, &idx));
+
+    ASSERT_EQ(1, timer_expire(300, &kind, &idx));
+    ASSERT_EQ(3, idx);
+    ASSERT_EQ(0, timer_pending());
+}
+
+TEST(timer_cancel_removes_timer) {
+    timer_init();
+
+    int a = timer_add(100, TIMER_HEALTH_TIMEOUT, 1);
+    int b = timer_add(200, TIMER_HEALTH_TIMEOUT, 2);
+    timer_cancel(a);
+    ASSERT_EQ(1, timer_pending());
+
+    timer_kind_t kind;
+    int idx;
+    ASSERT_EQ(1, timer_expire(1000, &kind, &idx));
+    ASSERT_EQ(2, idx);
+
+    /* Cancelling fired, stale and empty handles is harmless */
+    timer_cancel(b);
+    timer_cancel(a);
+    timer_cancel(0);
+    ASSERT_EQ(0, timer_pending());
+}
+
+TEST(timer_stale_handle_does_not_cancel_reused_slot) {
+    timer_init();
+
+    int old = timer_add(100, TIMER_HEALTH_TIMEOUT, 1);
+    timer_cancel(old);
+
+    /* The freed slot is reused with a new generation */
+    int fresh = timer_add(100, TIMER_HEALTH_TIMEOUT, 2);
+    ASSERT_NE(old, fresh);
+
+    timer_cancel(old);
+    ASSERT_EQ(1, timer_pending());
+}
+
+TEST(timer_next_ms_reports_overdue_as_zero) {
+    timer_init();
+
+    timer_add(0, TIMER_HEALTH_TIMEOUT, 0);
+    ASSERT_EQ(0, timer_next_ms());
+
+    timer_init();
+    timer_add(timer_now_ms() + 60000, TIMER_HEALTH_TIMEOUT, 0);
+    int next = timer_next_ms();
+    ASSERT_TRUE(next > 59000 && next <= 60000);
+}
+
+TEST(timer_many_timers_stay_ordered) {
+    timer_init();
+
+    /* Insert in a scrambled order and cancel every third one */
+    int handles[MAX_TIMERS];
+    for (int i = 0; i < MAX_TIMERS; i++) {
+        int deadline = (i * 7919) % MAX_TIMERS;
+        handles[i] = timer_add((uint64_t)deadline, TIMER_HEALTH_TIMEOUT, deadline);
+        ASSERT_TRUE(handles[i] > 0);
+    }
+    ASSERT_EQ(-1, timer_add(0, TIMER_HEALTH_TIMEOUT, 0)); /* full */
+
+    for (int i = 0; i < MAX_TIMERS; i += 3) {
+        timer_cancel(handles[i]);
+    }
+
+    timer_kind_t kind;
+    int idx, last = -1;
+    while (timer_expire(MAX_TIMERS, &kind, &idx)) {
+        ASSERT_TRUE(idx >= last);
+        last = idx;
+    }
+    ASSERT_EQ(0, timer_pending());
+}
+
+TEST(timer_pop_reports_handle) {
+    timer_init();
+
+    int a = timer_add(100, TIMER_HEALTH_DUE, 1);
+    int b = timer_add(200, TIMER_RESTART, 2);
+
+    timer_kind_t kind;
+    int idx, handle;
+    ASSERT_EQ(1, timer_pop(300, &kind, &idx, &handle));
+    ASSERT_EQ(a, handle);
+    ASSERT_EQ(TIMER_HEALTH_DUE, kind);
+    ASSERT_EQ(1, timer_pop(300, &kind, &idx, &handle));
+    ASSERT_EQ(b, handle);
+    ASSERT_EQ(2, idx);
+    ASSERT_EQ(0, timer_pop(300, &kind, &idx, &handle));
+}
+
+TEST(timer_fd_fires_at_deadline) {
+    timer_init();
+
+    int fd = timer_fd_open();
+    ASSERT_TRUE(fd >= 0);
+
+    /* Nothing pending: the fd stays quiet */
+    timer_fd_update();
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    ASSERT_EQ(0, poll(&pfd, 1, 50));
+
+    timer_add(timer_now_ms() + 30, TIMER_HEALTH_DUE, 0);
+    timer_fd_update();
+    ASSERT_EQ(1, poll(&pfd, 1, 2000));
+    timer_fd_ack();
+
+    timer_kind_t kind;
+    int idx;
+    ASSERT_EQ(1, timer_expire(timer_now_ms(), &kind, &idx));
+
+    /* Re-arming after the last timer is gone disarms the fd */
+    timer_fd_update();
+    ASSERT_EQ(0, poll(&pfd, 1, 50));
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+
+    return RUN_ALL_TESTS();
+}
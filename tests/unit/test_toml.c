@@ -67,6 +67,8 @@ TEST(parse_complex_service) {
 
     /* Check lifecycle settings */
     ASSERT_EQ(1, comp.reload_signal);  /* SIGHUP */
+    ASSERT_EQ(2, comp.stop_signal);    /* SIGINT */
+    ASSERT_EQ(60, comp.stop_timeout);
     ASSERT_STR_EQ("/usr/bin/pg_isready", comp.health_check);
     ASSERT_EQ(30, comp.health_interval);
 }
@@ -129,6 +131,8 @@ TEST(component_defaults) {
     ASSERT_EQ(COMP_INACTIVE, comp.state);
     ASSERT_EQ(HANDOFF_NONE, comp.handoff);
     ASSERT_EQ(0, comp.reload_signal);
+    ASSERT_EQ(15, comp.stop_signal);   /* SIGTERM */
+    ASSERT_EQ(10, comp.stop_timeout);
     ASSERT_EQ(0, comp.health_interval);
     ASSERT_EQ(-1, comp.pid);
     ASSERT_EQ(0, comp.restart_count);
@@ -137,6 +141,131 @@ TEST(component_defaults) {
     ASSERT_STR_EQ(TEST_DATA_DIR "/simple-service.toml", comp.config_path);
 }
 
+TEST(parse_standby_service) {
+    component_t comp;
+    ASSERT_EQ(0, parse_component(TEST_DATA_DIR "/standby-service.toml", &comp));
+
+    ASSERT_EQ(1, comp.standby);
+    ASSERT_STR_EQ("128M", comp.standby_memory_high);
+    ASSERT_EQ(5, comp.standby_cpu_weight);
+    ASSERT_STR_EQ("512M", comp.memory_high);
+    ASSERT_EQ(0, comp.standby_pid);
+
+    /* Standby caps are part of the cgroup limits */
+    component_t other = comp;
+    other.standby_cpu_weight = 50;
+    ASSERT_FALSE(component_same_limits(&comp, &other));
+
+    /* Without the keys there is no standby, capped to a tenth by default */
+    component_t plain;
+    ASSERT_EQ(0, parse_component(TEST_DATA_DIR "/simple-service.toml", &plain));
+    ASSERT_EQ(0, plain.standby);
+    ASSERT_EQ(10, plain.standby_cpu_weight);
+    ASSERT_STR_EQ("", plain.standby_memory_high);
+    component_free_strings(&plain);
+    component_free_strings(&comp);
+}
+
+TEST(parse_placement_hints) {
+    component_t comp;
+    ASSERT_EQ(0, parse_component(TEST_DATA_DIR "/pinned-service.toml", &comp));
+
+    ASSERT_STR_EQ("2-3", comp.cpuset);
+    ASSERT_EQ(0, comp.numa);
+    ASSERT_EQ(2, comp.isolate_cpus);
+
+    /* Hints are followed without reopening the cgroup */
+    component_t other = comp;
+    other.numa = 1;
+    ASSERT_TRUE(component_same_limits(&comp, &other));
+    ASSERT_FALSE(component_same_declaration(&comp, &other));
+
+    /* Any node, shared CPUs by default */
+    component_t plain;
+    ASSERT_EQ(0, parse_component(TEST_DATA_DIR "/simple-service.toml", &plain));
+    ASSERT_STR_EQ("", plain.cpuset);
+    ASSERT_EQ(-1, plain.numa);
+    ASSERT_EQ(0, plain.isolate_cpus);
+    component_free_strings(&plain);
+    component_free_strings(&comp);
+}
+
+TEST(parse_socket_service) {
+    component_t comp;
+    ASSERT_EQ(0, parse_component(TEST_DATA_DIR "/socket-service.toml", &comp));
+
+    ASSERT_EQ(2, comp.n_sockets);
+    ASSERT_STR_EQ("tcp:8080", comp.sockets[0]);
+    ASSERT_STR_EQ("unix:/run/socket-service.sock", comp.sockets[1]);
+    ASSERT_EQ(64, comp.socket_backlog);
+    ASSERT_EQ(0, comp.n_listen_fds);
+
+    /* Sockets are part of the declaration */
+    component_t other = comp;
+    other.n_sockets = 1;
+    ASSERT_FALSE(component_same_sockets(&comp, &other));
+    ASSERT_FALSE(component_same_declaration(&comp, &other));
+
+    component_t plain;
+    ASSERT_EQ(0, parse_component(TEST_DATA_DIR "/simple-service.toml", &plain));
+    ASSERT_EQ(0, plain.n_sockets);
+    ASSERT_EQ(0, plain.socket_backlog);
+    component_free_strings(&plain);
+    component_free_strings(&comp);
+    ASSERT_NULL(comp.sockets[0]);
+}
+
+TEST(parse_on_demand_service) {
+    component_t comp;
+    ASSERT_EQ(0, parse_component(TEST_DATA_DIR "/on-demand-service.toml", &comp));
+
+    ASSERT_EQ(1, comp.on_demand);
+    ASSERT_EQ(300, comp.idle_timeout);
+    ASSERT_EQ(1, comp.n_sockets);
+    ASSERT_EQ(0, comp.demanded);
+
+    component_t other = comp;
+    other.on_demand = 0;
+    ASSERT_FALSE(component_same_declaration(&comp, &other));
+
+    /* Started eagerly and kept running unless asked otherwise */
+    component_t plain;
+    ASSERT_EQ(0, parse_component(TEST_DATA_DIR "/simple-service.toml", &plain));
+    ASSERT_EQ(0, plain.on_demand);
+    ASSERT_EQ(0, plain.idle_timeout);
+    component_free_strings(&plain);
+    component_free_strings(&comp);
+}
+
+TEST(component_strings_survive_arena_growth) {
+    component_t comp;
+    ASSERT_EQ(0, parse_component(TEST_DATA_DIR "/simple-service.toml", &comp));
+
+    /* Enough long strings to force the arena to move several times */
+    char value[200];
+    memset(value, 'x', sizeof(value) - 1);
+    value[sizeof(value) - 1] = '\0';
+    for (int i = 0; i < 8; i++) {
+        ASSERT_EQ(0, component_set_str(&comp, &comp.health_check, value));
+    }
+
+    ASSERT_STR_EQ("simple-service", comp.name);
+    ASSERT_STR_EQ("/usr/bin/simple-daemon", comp.binary);
+    ASSERT_STR_EQ("--config", comp.args[0]);
+    ASSERT_STR_EQ("network", comp.requires[0]);
+    ASSERT_STR_EQ("simple-api", comp.provides[0]);
+    ASSERT_STR_EQ(value, comp.health_check);
+
+    /* A field may be set from a string already in the arena */
+    ASSERT_EQ(0, component_set_str(&comp, &comp.readiness_check, comp.binary));
+    ASSERT_STR_EQ("/usr/bin/simple-daemon", comp.readiness_check);
+
+    component_free_strings(&comp);
+    ASSERT_NULL(comp.binary);
+    ASSERT_NULL(comp.requires[0]);
+    ASSERT_STR_EQ("", comp_str(comp.health_check));
+}
+
 int main(void) {
     /* Initialize logging for tests */
     log_open();
@@ -71,6 +71,20 @@ TEST(parse_readiness_signal_config) {
     ASSERT_STR_EQ("logging", comp.provides[0]);
 }
 
+TEST(parse_readiness_notify_config) {
+    component_t comp;
+    int result = parse_component(TEST_DATA_DIR "/readiness-notify.toml", &comp);
+
+    ASSERT_EQ(0, result);
+    ASSERT_STR_EQ("notify-daemon", comp.name);
+
+    /* Check readiness configuration */
+    ASSERT_EQ(READINESS_NOTIFY, comp.readiness_method);
+    ASSERT_EQ(20, comp.readiness_timeout);
+    ASSERT_EQ(1, comp.n_provides);
+    ASSERT_STR_EQ("notify-service", comp.provides[0]);
+}
+
 TEST(parse_component_without_readiness) {
     component_t comp;
     int result = parse_component(TEST_DATA_DIR "/simple-service.toml", &comp);
@@ -116,11 +130,11 @@ TEST(readiness_method_priority) {
 
     /* Simulate parsing readiness_file first */
     comp.readiness_method = READINESS_FILE;
-    strcpy(comp.readiness_file, "/tmp/test.ready");
+    component_set_str(&comp, &comp.readiness_file, "/tmp/test.ready");
 
     /* Then readiness_check overwrites it */
     comp.readiness_method = READINESS_COMMAND;
-    strcpy(comp.readiness_check, "/bin/true");
+    component_set_str(&comp, &comp.readiness_check, "/bin/true");
 
     ASSERT_EQ(READINESS_COMMAND, comp.readiness_method);
     ASSERT_STR_EQ("/bin/true", comp.readiness_check);
@@ -0,0 +1,95 @@
+/*
+ * test_trace.c - Tests for lifecycle tracing
+ */
+
+#include "../test_framework.h"
+#include "../../src/trace.h"
+#include "../../src/log.h"
+#include <string.h>
+
+TEST(names_are_interned_once) {
+    int a = trace_intern("trace-a");
+    int b = trace_intern("trace-b");
+    ASSERT_TRUE(a >= 0);
+    ASSERT_TRUE(b >= 0);
+    ASSERT_NE(a, b);
+    ASSERT_EQ(a, trace_intern("trace-a"));
+    ASSERT_STR_EQ("trace-a", trace_name(a));
+    ASSERT_STR_EQ("trace-b", trace_name(b));
+
+    ASSERT_EQ(-1, trace_intern(NULL));
+    ASSERT_STR_EQ("?", trace_name(-1));
+}
+
+TEST(events_are_recorded_in_order) {
+    trace_reset();
+    trace_boot_begin();
+    trace_state("web", 0, 1);
+    trace_capability(7, 1, 3);
+    trace_capability(7, 0, 3);
+    trace_boot_end();
+
+    ASSERT_EQ(5, trace_count());
+    ASSERT_EQ(0, (int)trace_dropped());
+    ASSERT_EQ(TRACE_BOOT_BEGIN, trace_event(0)->kind);
+
+    const trace_event_t *ev = trace_event(1);
+    ASSERT_EQ(TRACE_STATE, ev->kind);
+    ASSERT_STR_EQ("web", trace_name(ev->name));
+    ASSERT_EQ(0, ev->from);
+    ASSERT_EQ(1, ev->to);
+
+    ASSERT_EQ(TRACE_CAP_UP, trace_event(2)->kind);
+    ASSERT_EQ(7, trace_event(2)->cap);
+    ASSERT_EQ(3, trace_event(2)->value);
+    ASSERT_EQ(TRACE_CAP_DOWN, trace_event(3)->kind);
+    ASSERT_EQ(TRACE_BOOT_END, trace_event(4)->kind);
+    ASSERT_NULL(trace_event(5));
+
+    for (int i = 1; i < trace_count(); i++) {
+        ASSERT_TRUE(trace_event(i)->time_us >= trace_event(i - 1)->time_us);
+    }
+}
+
+TEST(spawn_records_its_duration) {
+    trace_reset();
+    uint64_t started = trace_now_us() - 1500;
+    trace_spawn("web", "/usr/bin/web", 42, started);
+
+    ASSERT_EQ(1, trace_count());
+    const trace_event_t *ev = trace_event(0);
+    ASSERT_EQ(TRACE_SPAWN, ev->kind);
+    ASSERT_EQ(started, ev->time_us);
+    ASSERT_TRUE(ev->duration_us >= 1500);
+    ASSERT_STR_EQ("web", trace_name(ev->name));
+    ASSERT_STR_EQ("/usr/bin/web", trace_name(ev->cap));
+    ASSERT_EQ(42, ev->value);
+}
+
+TEST(boot_is_kept_while_the_ring_turns) {
+    trace_reset();
+    int total = TRACE_KEPT + TRACE_RING + 10;
+    for (int i = 0; i < total; i++) {
+        trace_capability(i, 1, -1);
+    }
+
+    ASSERT_EQ(TRACE_KEPT + TRACE_RING, trace_count());
+    ASSERT_EQ(10, (int)trace_dropped());
+
+    /* The first events stay; the ring holds the latest */
+    ASSERT_EQ(0, trace_event(0)->cap);
+    ASSERT_EQ(TRACE_KEPT - 1, trace_event(TRACE_KEPT - 1)->cap);
+    ASSERT_EQ(TRACE_KEPT + 10, trace_event(TRACE_KEPT)->cap);
+    ASSERT_EQ(total - 1, trace_event(trace_count() - 1)->cap);
+    ASSERT_NULL(trace_event(trace_count()));
+
+    trace_reset();
+    ASSERT_EQ(0, trace_count());
+}
+
+int main(void) {
+    /* Initialize logging for tests */
+    log_open();
+
+    return RUN_ALL_TESTS();
+}
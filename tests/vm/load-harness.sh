@@ -0,0 +1,338 @@
+#!/bin/bash
+#
+# YakirOS Load Harness
+# ====================
+#
+# Boots YakirOS in the test VM with N generated components and measures
+# how the resolver holds up, so scheduler and resolver changes can be
+# compared run against run:
+#
+# - Time until every generated capability was up, from the boot trace
+# - PID 1 CPU time and RSS, after boot and under churn
+# - SIGCHLD-to-restart latency of crash-injected components
+# - Control socket latency, idle and under supervision churn
+#
+# The components come from scripts/load-components.py and all run
+# tests/load-worker; the same seed and options give the same graph.
+# Results go to one key=value file; --compare prints the change against
+# an earlier one.
+#
+
+set -e
+
+TEST_DIR="$(cd "$(dirname "$0")" && pwd)"
+REPO_DIR="$(cd "$TEST_DIR/../.." && pwd)"
+GENERATOR="$REPO_DIR/scripts/load-components.py"
+VM_SSH_PORT="2222"
+VM_HOST="localhost"
+
+# Load configuration (see --help)
+COMPONENTS=100
+SEED=1
+READINESS="none=40,notify=30,file=30"
+SLOW=10
+CRASHERS=20
+CRASH_RATE=6
+CHURN_SECONDS=60
+PROBE_INTERVAL_MS=10
+BOOT_TIMEOUT=300
+REBOOT=1
+KEEP=0
+COMPARE=""
+RESULTS_DIR="/tmp/yakiros-load-results/$(date +%Y%m%d-%H%M%S)"
+
+# Colors
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+BLUE='\033[0;34m'
+PURPLE='\033[0;35m'
+CYAN='\033[0;36m'
+NC='\033[0m'
+
+log_info() {
+    echo -e "${BLUE}[LOAD] $1${NC}"
+}
+
+log_success() {
+    echo -e "${GREEN}[LOAD] ✅ $1${NC}"
+}
+
+log_warn() {
+    echo -e "${YELLOW}[LOAD] ⚠️  $1${NC}"
+}
+
+log_error() {
+    echo -e "${RED}[LOAD] ❌ $1${NC}"
+}
+
+log_metric() {
+    echo -e "${CYAN}[LOAD] 📊 $1${NC}"
+}
+
+log_header() {
+    echo -e "\n${PURPLE}🚀 $1${NC}"
+    echo "================================================================="
+}
+
+vm_run() {
+    ssh -o StrictHostKeyChecking=no -p ${VM_SSH_PORT} root@${VM_HOST} "$@"
+}
+
+vm_copy() {
+    scp -q -o StrictHostKeyChecking=no -P ${VM_SSH_PORT} "$@"
+}
+
+# Record one result, for the results file and --compare
+record() {
+    echo "$1=$2" >> "$RESULTS_FILE"
+}
+
+# Parse command line arguments
+parse_arguments() {
+    while [[ $# -gt 0 ]]; do
+        case $1 in
+            --components=*)  COMPONENTS="${1#*=}" ;;
+            --seed=*)        SEED="${1#*=}" ;;
+            --readiness=*)   READINESS="${1#*=}" ;;
+            --slow=*)        SLOW="${1#*=}" ;;
+            --crashers=*)    CRASHERS="${1#*=}" ;;
+            --crash-rate=*)  CRASH_RATE="${1#*=}" ;;
+            --churn=*)       CHURN_SECONDS="${1#*=}" ;;
+            --port=*)        VM_SSH_PORT="${1#*=}" ;;
+            --results=*)     RESULTS_DIR="${1#*=}" ;;
+            --compare=*)     COMPARE="${1#*=}" ;;
+            --no-reboot)     REBOOT=0 ;;
+            --keep)          KEEP=1 ;;
+            --help|-h)
+                echo "YakirOS Load Harness"
+                echo "Usage: $0 [options]"
+                echo
+                echo "Options:"
+                echo "  --components=N      Generated components (default: $COMPONENTS, at most 480)"
+                echo "  --seed=N            Generator seed (default: $SEED)"
+                echo "  --readiness=MIX     Readiness methods by weight (default: $READINESS)"
+                echo "  --slow=PCT          Percent of components slow to get ready (default: $SLOW)"
+                echo "  --crashers=PCT      Percent of components that crash (default: $CRASHERS)"
+                echo "  --crash-rate=N      Crashes per minute of each of them (default: $CRASH_RATE)"
+                echo "  --churn=SECONDS     How long to inject crashes (default: $CHURN_SECONDS)"
+                echo "  --port=PORT         VM SSH port (default: $VM_SSH_PORT)"
+                echo "  --results=DIR       Where to put the results (default: $RESULTS_DIR)"
+                echo "  --compare=FILE      Compare with an earlier load-results.txt"
+                echo "  --no-reboot         Measure the running VM; skips the boot metrics"
+                echo "  --keep              Leave the generated components installed"
+                echo "  --help              Show this help"
+                exit 0
+                ;;
+            *)
+                log_error "Unknown option: $1"
+                echo "Use --help for usage information"
+                exit 1
+                ;;
+        esac
+        shift
+    done
+}
+
+check_prerequisites() {
+    log_header "Checking Prerequisites"
+
+    if ! command -v python3 >/dev/null 2>&1; then
+        log_error "python3 not found - needed to generate the components"
+        exit 1
+    fi
+
+    if ! ssh -o StrictHostKeyChecking=no -o ConnectTimeout=5 -p ${VM_SSH_PORT} root@${VM_HOST} true 2>/dev/null; then
+        log_error "Cannot connect to VM. Ensure VM is running:"
+        log_error "  ./setup-vm-step11.sh start-vm"
+        exit 1
+    fi
+    log_success "VM connection established"
+
+    mkdir -p "$RESULTS_DIR"
+    RESULTS_FILE="$RESULTS_DIR/load-results.txt"
+    : > "$RESULTS_FILE"
+}
+
+# Build the worker and probe statically, so they run whatever libc the
+# VM has, and generate the components
+prepare_load() {
+    log_header "Preparing $COMPONENTS Components"
+
+    local cc="${CC:-cc}"
+    if command -v "${MUSL_CC:-musl-gcc}" >/dev/null 2>&1; then
+        cc="${MUSL_CC:-musl-gcc}"
+    fi
+    make -s -C "$REPO_DIR" -B CC="$cc" LDFLAGS=-static tests/load-worker tests/control-probe
+    log_success "Built load-worker and control-probe with $cc"
+
+    python3 "$GENERATOR" generate --count "$COMPONENTS" --seed "$SEED" \
+        --readiness "$READINESS" --slow "$SLOW" --crashers "$CRASHERS" \
+        --crash-rate "$CRASH_RATE" --out "$RESULTS_DIR/components" | tee "$RESULTS_DIR/components.txt"
+
+    record components "$COMPONENTS"
+    record seed "$SEED"
+    record readiness "$READINESS"
+    record crashers_pct "$CRASHERS"
+    record crash_rate_per_min "$CRASH_RATE"
+    record git_rev "$(git -C "$REPO_DIR" rev-parse --short HEAD 2>/dev/null || echo unknown)"
+}
+
+install_load() {
+    log_info "Installing the load into the VM..."
+
+    vm_copy "$REPO_DIR/tests/load-worker" "$REPO_DIR/tests/control-probe" root@${VM_HOST}:/usr/local/bin/
+    vm_run "rm -f /etc/graph.d/load-*.toml"
+    vm_copy "$RESULTS_DIR"/components/load-*.toml root@${VM_HOST}:/etc/graph.d/
+    vm_run "chmod +x /usr/local/bin/load-worker /usr/local/bin/control-probe; sync"
+
+    log_success "Installed $COMPONENTS components"
+}
+
+# Cold boot: the whole VM, so graph-resolver starts the load as PID 1
+boot_vm() {
+    log_header "Booting YakirOS"
+
+    (cd "$TEST_DIR" && ./setup-vm-step11.sh stop-vm >/dev/null)
+    sleep 2
+    (cd "$TEST_DIR" && ./setup-vm-step11.sh start-vm >/dev/null)
+    log_success "VM is back up"
+}
+
+# Wait for the whole graph to come up, and take the measurements of boot
+measure_boot() {
+    log_header "Time to All Capabilities"
+
+    local trace="$RESULTS_DIR/boot-trace.json"
+    local waited=0
+    local caps=""
+    while true; do
+        vm_run "graphctl analyze-boot --chrome" > "$trace" 2>/dev/null || true
+        if caps=$(python3 "$GENERATOR" caps-up "$trace" --count "$COMPONENTS" 2>/dev/null); then
+            break
+        fi
+        if [ $waited -ge $BOOT_TIMEOUT ]; then
+            log_error "Not every capability came up within ${BOOT_TIMEOUT}s: ${caps:-no trace}"
+            exit 1
+        fi
+        sleep 2
+        waited=$((waited + 2))
+    done
+    vm_run "graphctl analyze-boot" > "$RESULTS_DIR/boot-analysis.txt"
+
+    # caps N/N all_up_ms A since_boot_ms B dropped D
+    local all_up=$(echo "$caps" | awk '{print $4}')
+    local since_boot=$(echo "$caps" | awk '{print $6}')
+    local dropped=$(echo "$caps" | awk '{print $8}')
+    record boot_all_caps_ms "$all_up"
+    record boot_scheduler_ms "$since_boot"
+    record boot_trace_dropped "$dropped"
+    log_metric "All $COMPONENTS capabilities up ${all_up}ms after the kernel started (${since_boot}ms after the boot scheduler took over)"
+
+    sample_pid1 boot
+}
+
+# PID 1 CPU time (ms) and RSS (KB); $1 names the sample
+CPU_MS=0
+sample_pid1() {
+    local sample=$(vm_run "awk '{print \$14 + \$15}' /proc/1/stat; getconf CLK_TCK 2>/dev/null || echo 100; \
+                           awk '/^VmRSS|^VmHWM/ {print \$2}' /proc/1/status")
+    local ticks=$(echo "$sample" | sed -n 1p)
+    local hz=$(echo "$sample" | sed -n 2p)
+    local hwm=$(echo "$sample" | sed -n 3p)
+    local rss=$(echo "$sample" | sed -n 4p)
+
+    CPU_MS=$((ticks * 1000 / hz))
+    record "pid1_cpu_$1_ms" "$CPU_MS"
+    record "pid1_rss_$1_kb" "$rss"
+    record "pid1_hwm_$1_kb" "$hwm"
+    log_metric "PID 1 after $1: ${CPU_MS}ms CPU, ${rss}KB RSS (peak ${hwm}KB)"
+}
+
+# control-probe prints: samples N failed N p50 US p90 US p99 US max US
+record_probe() {
+    local name="$1" result="$2"
+    record "control_$1_samples" "$(echo "$result" | awk '{print $2}')"
+    record "control_$1_failed" "$(echo "$result" | awk '{print $4}')"
+    record "control_$1_p50_us" "$(echo "$result" | awk '{print $6}')"
+    record "control_$1_p99_us" "$(echo "$result" | awk '{print $10}')"
+    record "control_$1_max_us" "$(echo "$result" | awk '{print $12}')"
+    log_metric "Control socket, $name: $result"
+}
+
+measure_idle() {
+    log_header "Control Socket, Idle"
+    record_probe idle "$(vm_run "/usr/local/bin/control-probe -n 200 -i ${PROBE_INTERVAL_MS}")"
+    sample_pid1 idle
+}
+
+# Crash components for CHURN_SECONDS while timing the control socket
+measure_churn() {
+    log_header "Supervision Churn (${CHURN_SECONDS}s)"
+
+    local count=$((CHURN_SECONDS * 1000 / PROBE_INTERVAL_MS))
+    local cpu_before=$CPU_MS
+    local start=$(date +%s%N)
+
+    vm_run "rm -f /run/yakiros-load/restarts; touch /run/yakiros-load/churn"
+    local probe=$(vm_run "/usr/local/bin/control-probe -n $count -i ${PROBE_INTERVAL_MS}")
+    vm_run "rm -f /run/yakiros-load/churn"
+
+    local elapsed_ms=$((($(date +%s%N) - start) / 1000000))
+    record_probe churn "$probe"
+
+    sample_pid1 churn
+    local cpu_pct=$(awk "BEGIN {printf \"%.2f\", ($CPU_MS - $cpu_before) * 100 / $elapsed_ms}")
+    record pid1_cpu_churn_pct "$cpu_pct"
+    log_metric "PID 1 used ${cpu_pct}% CPU during churn"
+
+    vm_run "cat /run/yakiros-load/restarts 2>/dev/null" > "$RESULTS_DIR/restarts.txt" || true
+    local restarts=$(python3 "$GENERATOR" restarts "$RESULTS_DIR/restarts.txt" || true)
+    # samples N p50 US p90 US p99 US max US
+    record restarts "$(echo "$restarts" | awk '{print $2}')"
+    record restart_p50_us "$(echo "$restarts" | awk '{print $4}')"
+    record restart_p99_us "$(echo "$restarts" | awk '{print $8}')"
+    record restart_max_us "$(echo "$restarts" | awk '{print $10}')"
+    log_metric "Crash to restart: $restarts"
+}
+
+cleanup_load() {
+    if [ $KEEP -eq 1 ]; then
+        log_info "Leaving the load components installed (--keep)"
+        return
+    fi
+    vm_run "rm -f /etc/graph.d/load-*.toml" || log_warn "Could not remove the load components"
+}
+
+show_results() {
+    log_header "Load Results"
+    cat "$RESULTS_FILE"
+    echo
+    echo -e "${PURPLE}📁 Results Directory: $RESULTS_DIR${NC}"
+
+    if [ -n "$COMPARE" ]; then
+        log_header "Compared with $COMPARE"
+        python3 "$GENERATOR" compare "$COMPARE" "$RESULTS_FILE"
+    fi
+}
+
+main() {
+    parse_arguments "$@"
+    check_prerequisites
+    prepare_load
+    install_load
+
+    if [ $REBOOT -eq 1 ]; then
+        boot_vm
+    else
+        # graph-resolver picks up the new graph.d files by itself
+        log_warn "Not rebooting: the times to all capabilities are from the kernel start, not a boot"
+    fi
+    measure_boot
+    measure_idle
+    measure_churn
+    cleanup_load
+    show_results
+}
+
+main "$@"